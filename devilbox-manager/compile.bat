@@ -17,12 +17,12 @@ taskkill /F /IM DevilboxManager.exe 2>nul
 echo Process killed or not running.
 
 echo Step 4: Compiling...
-g++ main.cpp utils\*.c -Iutils -o DevilboxManager.exe -lole32 -lcomctl32 -lshell32 -lgdi32 -lcomdlg32 -mwindows
+g++ main.cpp utils\*.c -Iutils -o DevilboxManager.exe -lole32 -lcomctl32 -lshell32 -lgdi32 -lcomdlg32 -lws2_32 -mwindows
 
 if %ERRORLEVEL% NEQ 0 (
   echo Compilation failed with error code %ERRORLEVEL%
   echo Trying without -mwindows flag for error output...
-  g++ main.cpp utils\*.c -Iutils -o DevilboxManager.exe -lole32 -lcomctl32 -lshell32 -lgdi32 -lcomdlg32
+  g++ main.cpp utils\*.c -Iutils -o DevilboxManager.exe -lole32 -lcomctl32 -lshell32 -lgdi32 -lcomdlg32 -lws2_32
 )
 
 if exist DevilboxManager.exe (
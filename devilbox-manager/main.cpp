@@ -10,8 +10,18 @@
 #include <commctrl.h>
 #include <time.h>
 #include "utils/backup_utils.h"
+#include "utils/backup_store.h"
+#include "utils/backup_restore.h"
+#include "utils/backup_rotation.h"
+#include "utils/archive_writer.h"
+#include "utils/deflate.h"
+#include "utils/backup_filter.h"
 #include "utils/logs_viewer.h"
+#include "utils/timeline_viewer.h"
+#include "utils/search_viewer.h"
+#include "utils/access_viewer.h"
 #include "utils/settings.h"
+#include "utils/hosts_sync.h"
 
 #pragma comment(lib, "comctl32.lib")
 #pragma comment(lib, "ole32.lib")
@@ -27,7 +37,6 @@ version='6.0.0.0' processorArchitecture='*' publicKeyToken='6595b64144ccf1df' la
 #define MAX_PROJECTS 100
 #define MAX_VERSIONS 20
 #define MAX_LINE 1024
-#define MAX_BUFFER 1048576 // 1MB buffer for logs
 
 // Status refresh interval in milliseconds
 #define STATUS_REFRESH_INTERVAL 5000
@@ -49,6 +58,7 @@ enum
     IDM_WWW,
     IDM_CHANGEDIR,
     IDM_CONTROL_PANEL,
+    IDM_HOSTS_SYNC,
     IDM_WEBSITE_OPEN = 2000,
     IDM_WEBSITE_FOLDER = 2500,
     IDM_WEBSITE_BACKUP = 2750, // Новый ID для функции бэкапа
@@ -58,6 +68,9 @@ enum
     IDM_MYSQL_VERSION = 6000,
     IDM_CHECK_STATUS = 6500,
     IDM_PHP_LOGS = 6600,
+    IDM_LOG_TIMELINE = 6650,
+    IDM_LOG_SEARCH = 6660,
+    IDM_ACCESS_STATS = 6670,
     IDM_SETTINGS = 6700,
 };
 
@@ -71,7 +84,30 @@ enum
     ID_SUBDIRS_CHECK,
     ID_DAYS_EDIT,
     ID_BACKUP_BTN,
-    ID_CANCEL_BTN
+    ID_CANCEL_BTN,
+    ID_INCREMENTAL_CHECK,
+    ID_MODE_COMBO,
+    ID_SNAPSHOTS_BTN,
+    ID_SNAPSHOT_LIST,
+    ID_RESTORE_TARGET,
+    ID_RESTORE_BTN,
+    ID_RESTORE_CLOSE,
+    ID_LEVEL_COMBO,
+    ID_THREADS_EDIT,
+    ID_MEMORY_EDIT,
+    ID_EXCLUDES_EDIT,
+    ID_BANDWIDTH_EDIT,
+    ID_BACKGROUND_CHECK,
+    ID_DATABASE_CHECK,
+    ID_DATABASE_EDIT,
+    ID_RESTORE_DATABASE,
+    ID_KEEP_HOURLY_EDIT,
+    ID_KEEP_DAILY_EDIT,
+    ID_KEEP_WEEKLY_EDIT,
+    ID_VERIFY_BTN,
+    ID_PLAN_BTN,
+    ID_OVERLAPPED_CHECK,
+    ID_JOURNAL_CHECK
 };
 
 // Server status enum
@@ -100,6 +136,11 @@ typedef struct
     char php[50];
     char httpd[50];
     char mysql[50];
+    char tld[50];
+    char listen_ip[64];
+    char backup_dir[MAX_PATH_LEN];
+    char mysql_password[128];
+    char time_zone[64];
     char php_versions[MAX_VERSIONS][50];
     char httpd_versions[MAX_VERSIONS][50];
     char mysql_versions[MAX_VERSIONS][50];
@@ -136,14 +177,49 @@ typedef struct
     HWND hSourcePath;
     HWND hTargetPath;
     HWND hExtensions;
+    HWND hExcludes;
     HWND hSubdirs;
     HWND hDays;
+    HWND hIncremental;
+    HWND hInfo;
+    HWND hMode;
+    HWND hBrowse;
+    HWND hLevel;
+    HWND hThreads;
+    HWND hMemory;
+    HWND hBandwidth;
+    HWND hBackground;
+    HWND hDatabaseCheck;
+    HWND hDatabase;
+    HWND hKeepHourly;
+    HWND hKeepDaily;
+    HWND hKeepWeekly;
+    HWND hOverlapped;
+    HWND hJournal;
     char project_path[MAX_PATH_LEN];
+    char repo_path[MAX_PATH_LEN];
+    char copy_target[MAX_PATH_LEN];
     int project_index;
+    int mode;
 } BackupDialogState;
 
 static BackupDialogState backup_dialog = {0};
 
+// Состояние диалога восстановления бэкапа
+typedef struct
+{
+    HWND hDlg;
+    HWND hList;
+    HWND hTarget;
+    HWND hDatabase;
+    char repo_path[MAX_PATH_LEN];
+    char backup_dir[MAX_PATH_LEN];
+    RestoreSource sources[RESTORE_MAX_SOURCES];
+    int source_count;
+} RestoreDialogState;
+
+static RestoreDialogState restore_dialog = {0};
+
 /*******************************************************************************
  * Function Prototypes
  *******************************************************************************/
@@ -164,6 +240,7 @@ static void load_versions(void);
 static void set_version(const char *type, const char *version);
 static void update_tray(void);
 static void restart_service(const char *service);
+static void sync_project_hosts(void);
 
 // Menu management
 static void clean_menus(void);
@@ -173,6 +250,9 @@ static void update_menu_status(void);
 // Функции для диалога бэкапа
 static void show_backup_dialog(int project_index);
 static LRESULT CALLBACK BackupDialogProc(HWND hwnd, UINT msg, WPARAM wp, LPARAM lp);
+static BOOL read_backup_options(HWND hwnd, BackupOptions *options);
+static void show_restore_dialog(HWND owner);
+static LRESULT CALLBACK RestoreDialogProc(HWND hwnd, UINT msg, WPARAM wp, LPARAM lp);
 
 /*******************************************************************************
  * Application Initialization and Core Functions
@@ -526,6 +606,9 @@ static LRESULT CALLBACK WindowProc(HWND hwnd, UINT msg, WPARAM wp, LPARAM lp)
                 ShellExecute(NULL, "open", "C:\\Windows\\System32\\drivers\\etc\\hosts",
                              NULL, NULL, SW_SHOW);
                 break;
+            case IDM_HOSTS_SYNC:
+                sync_project_hosts();
+                break;
             case IDM_ENV:
             {
                 char path[MAX_PATH_LEN];
@@ -565,6 +648,15 @@ static LRESULT CALLBACK WindowProc(HWND hwnd, UINT msg, WPARAM wp, LPARAM lp)
             case IDM_PHP_LOGS:
                 show_php_logs(app.path, app.php);
                 break;
+            case IDM_LOG_TIMELINE:
+                show_log_timeline(app.path, app.php, app.httpd, app.mysql, app.time_zone);
+                break;
+            case IDM_LOG_SEARCH:
+                show_log_search(app.path);
+                break;
+            case IDM_ACCESS_STATS:
+                show_access_stats(app.path, app.httpd);
+                break;
             case IDM_EXIT:
                 DestroyWindow(hwnd);
                 break;
@@ -753,7 +845,7 @@ static void scan_projects(void)
                      "%s\\data\\www\\%s\\htdocs", app.path, fd.cFileName);
 
             snprintf(app.projects[app.project_count].url, sizeof(app.projects[0].url),
-                     "http://%s.local", fd.cFileName);
+                     "http://%s.%s", fd.cFileName, app.tld);
 
             app.project_count++;
         }
@@ -770,6 +862,13 @@ static void load_versions(void)
     char env_path[MAX_PATH_LEN];
     snprintf(env_path, sizeof(env_path), "%s\\.env", app.path);
 
+    // Defaults for settings that may be missing in older .env files, or without one
+    strcpy(app.tld, "local");
+    strcpy(app.listen_ip, HOSTS_DEFAULT_IP);
+    strcpy(app.backup_dir, "./backups");
+    app.mysql_password[0] = 0;
+    strcpy(app.time_zone, "UTC");
+
     FILE *f = fopen(env_path, "r");
     if (!f)
         return;
@@ -798,6 +897,34 @@ static void load_versions(void)
             strncpy(app.mysql, line + 13, sizeof(app.mysql) - 1);
             app.mysql[strcspn(app.mysql, "\r\n")] = 0;
         }
+        else if (strncmp(line, "TLD_SUFFIX=", 11) == 0 && line[11] && !strchr("\r\n", line[11]))
+        {
+            strncpy(app.tld, line + 11, sizeof(app.tld) - 1);
+            app.tld[strcspn(app.tld, "\r\n")] = 0;
+        }
+        else if (strncmp(line, "LOCAL_LISTEN_ADDR=", 18) == 0 && line[18] && !strchr("\r\n", line[18]))
+        {
+            // Format is "<ip>:" (trailing colon) or empty for all interfaces
+            strncpy(app.listen_ip, line + 18, sizeof(app.listen_ip) - 1);
+            app.listen_ip[strcspn(app.listen_ip, ":\r\n")] = 0;
+            if (!app.listen_ip[0] || strcmp(app.listen_ip, "0.0.0.0") == 0)
+                strcpy(app.listen_ip, HOSTS_DEFAULT_IP);
+        }
+        else if (strncmp(line, "HOST_PATH_BACKUPDIR=", 20) == 0 && line[20] && !strchr("\r\n", line[20]))
+        {
+            strncpy(app.backup_dir, line + 20, sizeof(app.backup_dir) - 1);
+            app.backup_dir[strcspn(app.backup_dir, "\r\n")] = 0;
+        }
+        else if (strncmp(line, "MYSQL_ROOT_PASSWORD=", 20) == 0)
+        {
+            strncpy(app.mysql_password, line + 20, sizeof(app.mysql_password) - 1);
+            app.mysql_password[strcspn(app.mysql_password, "\r\n")] = 0;
+        }
+        else if (strncmp(line, "TIMEZONE=", 9) == 0 && line[9] && !strchr("\r\n", line[9]))
+        {
+            strncpy(app.time_zone, line + 9, sizeof(app.time_zone) - 1);
+            app.time_zone[strcspn(app.time_zone, "\r\n")] = 0;
+        }
     }
 
     // Second pass - collect all versions (including commented)
@@ -1030,6 +1157,53 @@ static void restart_service(const char *service)
     }
 }
 
+/**
+ * Sync hosts entries of all projects and verify that their vhosts resolve
+ */
+static void sync_project_hosts(void)
+{
+    const char *names[MAX_PROJECTS];
+    HostsSyncReport report;
+    char msg[2048];
+    int len;
+
+    memset(&report, 0, sizeof(report));
+
+    for (int i = 0; i < app.project_count; i++)
+        names[i] = app.projects[i].name;
+
+    if (!sync_hosts_entries(names, app.project_count, app.tld, app.listen_ip, &report))
+    {
+        const char *hint = "";
+        if (report.error == ERROR_ACCESS_DENIED)
+            hint = "\nRun DevilboxManager as administrator to edit hosts.";
+        else if (report.error == ERROR_INVALID_DATA)
+            hint = "\nThe hosts file has a '" HOSTS_BLOCK_BEGIN "' line without its '" HOSTS_BLOCK_END "' line.";
+
+        snprintf(msg, sizeof(msg), "Failed to update the hosts file (Error: %lu).%s", report.error, hint);
+        MessageBox(NULL, msg, "Hosts Sync", MB_ICONERROR);
+        return;
+    }
+
+    verify_vhosts_resolution(names, app.project_count, app.tld, app.listen_ip, 5000, &report);
+
+    len = snprintf(msg, sizeof(msg),
+                   "Hosts file %s.\nAdded: %d, updated: %d, removed: %d, conflicts: %d\n\n"
+                   "Resolved to %s: %d of %d vhosts",
+                   report.written ? "updated" : "already up to date",
+                   report.added, report.updated, report.removed, report.conflicts,
+                   app.listen_ip, report.resolved, app.project_count);
+
+    if (report.failed[0] && len > 0 && len < (int)sizeof(msg))
+    {
+        snprintf(msg + len, sizeof(msg) - len, "\nNot resolving to %s: %s",
+                 app.listen_ip, report.failed);
+    }
+
+    MessageBox(NULL, msg, "Hosts Sync",
+               MB_OK | (report.failed[0] ? MB_ICONWARNING : MB_ICONINFORMATION));
+}
+
 /*******************************************************************************
  * Menu Management Functions
  *******************************************************************************/
@@ -1157,8 +1331,12 @@ static void create_menus(void)
     AppendMenu(app.menu, MF_STRING, IDM_CONTROL_PANEL, "Control Panel");
     AppendMenu(app.menu, MF_STRING, IDM_WWW, "Open Projects Folder");
     AppendMenu(app.menu, MF_STRING, IDM_HOSTS, "Edit hosts");
+    AppendMenu(app.menu, MF_STRING, IDM_HOSTS_SYNC, "Sync hosts entries");
     AppendMenu(app.menu, MF_STRING, IDM_ENV, "Edit .env");
     AppendMenu(app.menu, MF_STRING, IDM_PHP_LOGS, "View PHP Error Logs");
+    AppendMenu(app.menu, MF_STRING, IDM_LOG_TIMELINE, "View Log Timeline");
+    AppendMenu(app.menu, MF_STRING, IDM_LOG_SEARCH, "Search Logs");
+    AppendMenu(app.menu, MF_STRING, IDM_ACCESS_STATS, "Access Log Statistics");
     AppendMenu(app.menu, MF_STRING, IDM_CHANGEDIR, "Change Devilbox Directory");
     AppendMenu(app.menu, MF_STRING, IDM_SETTINGS, "Settings");
     AppendMenu(app.menu, MF_SEPARATOR, 0, NULL);
@@ -1184,8 +1362,12 @@ static void create_menus(void)
     AppendMenu(configMenu, MF_STRING, IDM_CONTROL_PANEL, "Control Panel");
     AppendMenu(configMenu, MF_STRING, IDM_WWW, "Open Projects Folder");
     AppendMenu(configMenu, MF_STRING, IDM_HOSTS, "Edit hosts");
+    AppendMenu(configMenu, MF_STRING, IDM_HOSTS_SYNC, "Sync hosts entries");
     AppendMenu(configMenu, MF_STRING, IDM_ENV, "Edit .env");
     AppendMenu(configMenu, MF_STRING, IDM_PHP_LOGS, "View PHP Error Logs");
+    AppendMenu(configMenu, MF_STRING, IDM_LOG_TIMELINE, "View Log Timeline");
+    AppendMenu(configMenu, MF_STRING, IDM_LOG_SEARCH, "Search Logs");
+    AppendMenu(configMenu, MF_STRING, IDM_ACCESS_STATS, "Access Log Statistics");
 
     // Add all menus to main menu
     AppendMenu(app.mainMenu, MF_POPUP, (UINT_PTR)fileMenu, "File");
@@ -1213,6 +1395,7 @@ static void show_backup_dialog(int project_index)
     // Сохраняем информацию о проекте
     backup_dialog.project_index = project_index;
     strncpy(backup_dialog.project_path, app.projects[project_index].path, MAX_PATH_LEN - 1);
+    store_get_repo_path(app.path, app.backup_dir, backup_dialog.repo_path, sizeof(backup_dialog.repo_path));
 
     // Регистрируем класс диалога
     WNDCLASSEX wcDialog;
@@ -1230,7 +1413,7 @@ static void show_backup_dialog(int project_index)
         "DevilboxBackupDialog",
         "Backup Project Files",
         WS_OVERLAPPEDWINDOW | WS_VISIBLE,
-        100, 100, 600, 380,
+        100, 100, 600, 610,
         NULL, NULL, GetModuleHandle(NULL), NULL);
 
     if (!backup_dialog.hDlg)
@@ -1254,9 +1437,9 @@ static void show_backup_dialog(int project_index)
                                                WS_CHILD | WS_VISIBLE | WS_BORDER | ES_AUTOHSCROLL,
                                                130, 60, 370, 25, (HMENU)ID_TARGET_PATH, WS_EX_CLIENTEDGE);
 
-    create_control(backup_dialog.hDlg, "BUTTON", "Browse...",
-                   WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_PUSHBUTTON,
-                   510, 60, 70, 25, (HMENU)ID_BROWSE_BTN, 0);
+    backup_dialog.hBrowse = create_control(backup_dialog.hDlg, "BUTTON", "Browse...",
+                                           WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_PUSHBUTTON,
+                                           510, 60, 70, 25, (HMENU)ID_BROWSE_BTN, 0);
 
     create_control(backup_dialog.hDlg, "STATIC", "File Extensions (separated by comma):",
                    WS_CHILD | WS_VISIBLE, 10, 100, 250, 20, NULL, 0);
@@ -1269,6 +1452,14 @@ static void show_backup_dialog(int project_index)
                                             WS_CHILD | WS_VISIBLE | BS_AUTOCHECKBOX | WS_TABSTOP,
                                             10, 165, 200, 25, (HMENU)ID_SUBDIRS_CHECK, 0);
 
+    // Исключения в стиле .gitignore: такие каталоги не обходятся вовсе
+    create_control(backup_dialog.hDlg, "STATIC", "Exclude:",
+                   WS_CHILD | WS_VISIBLE, 220, 168, 55, 20, NULL, 0);
+
+    backup_dialog.hExcludes = create_control(backup_dialog.hDlg, "EDIT", FILTER_DEFAULT_EXCLUDES,
+                                             WS_CHILD | WS_VISIBLE | WS_BORDER | ES_AUTOHSCROLL,
+                                             280, 165, 300, 25, (HMENU)ID_EXCLUDES_EDIT, WS_EX_CLIENTEDGE);
+
     create_control(backup_dialog.hDlg, "STATIC", "Days to look back:",
                    WS_CHILD | WS_VISIBLE, 10, 200, 120, 20, NULL, 0);
 
@@ -1276,22 +1467,152 @@ static void show_backup_dialog(int project_index)
                                          WS_CHILD | WS_VISIBLE | WS_BORDER | ES_NUMBER,
                                          130, 200, 50, 25, (HMENU)ID_DAYS_EDIT, WS_EX_CLIENTEDGE);
 
-    // Устанавливаем состояние чекбокса по умолчанию (включено)
+    backup_dialog.hIncremental = create_control(backup_dialog.hDlg, "BUTTON", "Incremental (copy only files changed since the last backup)",
+                                                WS_CHILD | WS_VISIBLE | BS_AUTOCHECKBOX | WS_TABSTOP,
+                                                200, 200, 380, 25, (HMENU)ID_INCREMENTAL_CHECK, 0);
+
+    // Устанавливаем состояние чекбоксов по умолчанию (включено)
     SendMessage(backup_dialog.hSubdirs, BM_SETCHECK, BST_CHECKED, 0);
+    SendMessage(backup_dialog.hIncremental, BM_SETCHECK, BST_CHECKED, 0);
+    EnableWindow(backup_dialog.hDays, FALSE);
+
+    // Режим: копия файлов или снапшот в дедуплицирующем репозитории
+    create_control(backup_dialog.hDlg, "STATIC", "Backup mode:",
+                   WS_CHILD | WS_VISIBLE, 10, 280, 120, 20, NULL, 0);
+
+    backup_dialog.hMode = create_control(backup_dialog.hDlg, "COMBOBOX", "",
+                                         WS_CHILD | WS_VISIBLE | WS_TABSTOP | CBS_DROPDOWNLIST,
+                                         130, 277, 450, 200, (HMENU)ID_MODE_COMBO, 0);
+    SendMessage(backup_dialog.hMode, CB_ADDSTRING, 0, (LPARAM) "Copy files to the target directory");
+    SendMessage(backup_dialog.hMode, CB_ADDSTRING, 0, (LPARAM) "Snapshot to the deduplicated repository (HOST_PATH_BACKUPDIR)");
+    SendMessage(backup_dialog.hMode, CB_ADDSTRING, 0, (LPARAM) "Compressed archive (.tar.gz) in the target directory");
+    SendMessage(backup_dialog.hMode, CB_ADDSTRING, 0, (LPARAM) "Dated snapshots with hardlinks in the target directory");
+    SendMessage(backup_dialog.hMode, CB_SETCURSEL, BACKUP_MODE_COPY, 0);
+    backup_dialog.mode = BACKUP_MODE_COPY;
+
+    // Параметры сжатия архива: уровень, потоки и потолок памяти
+    create_control(backup_dialog.hDlg, "STATIC", "Compression:",
+                   WS_CHILD | WS_VISIBLE, 10, 320, 120, 20, NULL, 0);
+
+    backup_dialog.hLevel = create_control(backup_dialog.hDlg, "COMBOBOX", "",
+                                          WS_CHILD | WS_VISIBLE | WS_TABSTOP | CBS_DROPDOWNLIST,
+                                          130, 317, 170, 200, (HMENU)ID_LEVEL_COMBO, 0);
+    SendMessage(backup_dialog.hLevel, CB_ADDSTRING, 0, (LPARAM) "Fastest (level 1)");
+    SendMessage(backup_dialog.hLevel, CB_ADDSTRING, 0, (LPARAM) "Default (level 6)");
+    SendMessage(backup_dialog.hLevel, CB_ADDSTRING, 0, (LPARAM) "Best (level 9)");
+    SendMessage(backup_dialog.hLevel, CB_SETCURSEL, 1, 0);
+
+    create_control(backup_dialog.hDlg, "STATIC", "Threads:",
+                   WS_CHILD | WS_VISIBLE, 315, 320, 55, 20, NULL, 0);
+
+    backup_dialog.hThreads = create_control(backup_dialog.hDlg, "EDIT", "0",
+                                            WS_CHILD | WS_VISIBLE | WS_BORDER | ES_NUMBER,
+                                            370, 317, 40, 25, (HMENU)ID_THREADS_EDIT, WS_EX_CLIENTEDGE);
+
+    create_control(backup_dialog.hDlg, "STATIC", "Memory (MB):",
+                   WS_CHILD | WS_VISIBLE, 425, 320, 85, 20, NULL, 0);
+
+    char memory_mb[16];
+    sprintf(memory_mb, "%d", ARCHIVE_DEFAULT_MEMORY_MB);
+    backup_dialog.hMemory = create_control(backup_dialog.hDlg, "EDIT", memory_mb,
+                                           WS_CHILD | WS_VISIBLE | WS_BORDER | ES_NUMBER,
+                                           510, 317, 70, 25, (HMENU)ID_MEMORY_EDIT, WS_EX_CLIENTEDGE);
+    EnableWindow(backup_dialog.hLevel, FALSE);
+    EnableWindow(backup_dialog.hThreads, FALSE);
+    EnableWindow(backup_dialog.hMemory, FALSE);
+
+    // Нагрузка на диск во время бэкапа
+    create_control(backup_dialog.hDlg, "STATIC", "I/O limit (MB/s):",
+                   WS_CHILD | WS_VISIBLE, 10, 360, 120, 20, NULL, 0);
+
+    backup_dialog.hBandwidth = create_control(backup_dialog.hDlg, "EDIT", "0",
+                                              WS_CHILD | WS_VISIBLE | WS_BORDER | ES_NUMBER,
+                                              130, 357, 50, 25, (HMENU)ID_BANDWIDTH_EDIT, WS_EX_CLIENTEDGE);
+
+    backup_dialog.hBackground = create_control(backup_dialog.hDlg, "BUTTON", "Low I/O priority (0 MB/s = no limit)",
+                                               WS_CHILD | WS_VISIBLE | BS_AUTOCHECKBOX | WS_TABSTOP,
+                                               200, 357, 380, 25, (HMENU)ID_BACKGROUND_CHECK, 0);
+    SendMessage(backup_dialog.hBackground, BM_SETCHECK, BST_CHECKED, 0);
+
+    // Дамп базы данных проекта из сервиса mysql
+    backup_dialog.hDatabaseCheck = create_control(backup_dialog.hDlg, "BUTTON", "Dump database:",
+                                                  WS_CHILD | WS_VISIBLE | BS_AUTOCHECKBOX | WS_TABSTOP,
+                                                  10, 397, 120, 25, (HMENU)ID_DATABASE_CHECK, 0);
+
+    backup_dialog.hDatabase = create_control(backup_dialog.hDlg, "EDIT", app.projects[project_index].name,
+                                             WS_CHILD | WS_VISIBLE | WS_BORDER | ES_AUTOHSCROLL,
+                                             130, 397, 180, 25, (HMENU)ID_DATABASE_EDIT, WS_EX_CLIENTEDGE);
+    EnableWindow(backup_dialog.hDatabase, FALSE);
+
+    create_control(backup_dialog.hDlg, "STATIC", "(one file per table, dumped in parallel)",
+                   WS_CHILD | WS_VISIBLE, 320, 400, 260, 20, NULL, 0);
+
+    // Сколько датированных снапшотов хранить: последние по часам, дням и неделям
+    char keep[16];
+    create_control(backup_dialog.hDlg, "STATIC", "Keep snapshots:",
+                   WS_CHILD | WS_VISIBLE, 10, 440, 120, 20, NULL, 0);
+
+    sprintf(keep, "%d", ROTATION_DEFAULT_HOURLY);
+    backup_dialog.hKeepHourly = create_control(backup_dialog.hDlg, "EDIT", keep,
+                                               WS_CHILD | WS_VISIBLE | WS_BORDER | ES_NUMBER,
+                                               130, 437, 40, 25, (HMENU)ID_KEEP_HOURLY_EDIT, WS_EX_CLIENTEDGE);
+    create_control(backup_dialog.hDlg, "STATIC", "hourly",
+                   WS_CHILD | WS_VISIBLE, 175, 440, 50, 20, NULL, 0);
+
+    sprintf(keep, "%d", ROTATION_DEFAULT_DAILY);
+    backup_dialog.hKeepDaily = create_control(backup_dialog.hDlg, "EDIT", keep,
+                                              WS_CHILD | WS_VISIBLE | WS_BORDER | ES_NUMBER,
+                                              230, 437, 40, 25, (HMENU)ID_KEEP_DAILY_EDIT, WS_EX_CLIENTEDGE);
+    create_control(backup_dialog.hDlg, "STATIC", "daily",
+                   WS_CHILD | WS_VISIBLE, 275, 440, 45, 20, NULL, 0);
+
+    sprintf(keep, "%d", ROTATION_DEFAULT_WEEKLY);
+    backup_dialog.hKeepWeekly = create_control(backup_dialog.hDlg, "EDIT", keep,
+                                               WS_CHILD | WS_VISIBLE | WS_BORDER | ES_NUMBER,
+                                               320, 437, 40, 25, (HMENU)ID_KEEP_WEEKLY_EDIT, WS_EX_CLIENTEDGE);
+    create_control(backup_dialog.hDlg, "STATIC", "weekly (all 0 = keep every snapshot)",
+                   WS_CHILD | WS_VISIBLE, 365, 440, 215, 20, NULL, 0);
+    EnableWindow(backup_dialog.hKeepHourly, FALSE);
+    EnableWindow(backup_dialog.hKeepDaily, FALSE);
+    EnableWindow(backup_dialog.hKeepWeekly, FALSE);
+
+    // Копирование через порт завершения: много файлов в полёте на один поток
+    backup_dialog.hOverlapped = create_control(backup_dialog.hDlg, "BUTTON",
+                                               "Overlapped I/O (many files in flight)",
+                                               WS_CHILD | WS_VISIBLE | BS_AUTOCHECKBOX | WS_TABSTOP,
+                                               10, 477, 280, 25, (HMENU)ID_OVERLAPPED_CHECK, 0);
+
+    // Журнал изменений NTFS: инкрементальная копия обходит только изменённые пути
+    backup_dialog.hJournal = create_control(backup_dialog.hDlg, "BUTTON",
+                                            "Change journal (incremental, NTFS, administrator)",
+                                            WS_CHILD | WS_VISIBLE | BS_AUTOCHECKBOX | WS_TABSTOP,
+                                            300, 477, 280, 25, (HMENU)ID_JOURNAL_CHECK, 0);
 
     // Кнопки
+    create_control(backup_dialog.hDlg, "BUTTON", "Restore...",
+                   WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_PUSHBUTTON,
+                   10, 520, 100, 30, (HMENU)ID_SNAPSHOTS_BTN, 0);
+
+    create_control(backup_dialog.hDlg, "BUTTON", "Verify",
+                   WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_PUSHBUTTON,
+                   120, 520, 80, 30, (HMENU)ID_VERIFY_BTN, 0);
+
+    create_control(backup_dialog.hDlg, "BUTTON", "Dry run",
+                   WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_PUSHBUTTON,
+                   210, 520, 80, 30, (HMENU)ID_PLAN_BTN, 0);
+
     create_control(backup_dialog.hDlg, "BUTTON", "Backup",
                    WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_DEFPUSHBUTTON,
-                   400, 300, 80, 30, (HMENU)ID_BACKUP_BTN, 0);
+                   400, 520, 80, 30, (HMENU)ID_BACKUP_BTN, 0);
 
     create_control(backup_dialog.hDlg, "BUTTON", "Cancel",
                    WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_PUSHBUTTON,
-                   490, 300, 80, 30, (HMENU)ID_CANCEL_BTN, 0);
+                   520, 520, 80, 30, (HMENU)ID_CANCEL_BTN, 0);
 
     // Информационная надпись
-    create_control(backup_dialog.hDlg, "STATIC",
-                   "Files modified in the specified number of days will be copied to the target directory.",
-                   WS_CHILD | WS_VISIBLE, 10, 240, 570, 20, NULL, 0);
+    backup_dialog.hInfo = create_control(backup_dialog.hDlg, "STATIC",
+                                         "New and changed files are copied, the target keeps a manifest of the last backup.",
+                                         WS_CHILD | WS_VISIBLE, 10, 240, 570, 20, NULL, 0);
 
     // Устанавливаем иконку
     HICON hIcon = LoadIcon(NULL, IDI_APPLICATION);
@@ -1303,6 +1624,80 @@ static void show_backup_dialog(int project_index)
     UpdateWindow(backup_dialog.hDlg);
 }
 
+/**
+ * Read the backup options from the dialog controls
+ */
+static BOOL read_backup_options(HWND hwnd, BackupOptions *options)
+{
+    char days_str[10] = {0};
+
+    memset(options, 0, sizeof(*options));
+    options->days = 7; // Default value
+
+    // Get values from controls
+    GetWindowText(backup_dialog.hSourcePath, options->source_path, sizeof(options->source_path));
+    GetWindowText(backup_dialog.hTargetPath, options->target_path, sizeof(options->target_path));
+    GetWindowText(backup_dialog.hExtensions, options->extensions, sizeof(options->extensions));
+    GetWindowText(backup_dialog.hExcludes, options->excludes, sizeof(options->excludes));
+    GetWindowText(backup_dialog.hDays, days_str, sizeof(days_str));
+
+    // Convert checkbox states to int (0 or 1)
+    options->include_subdirs = (SendMessage(backup_dialog.hSubdirs, BM_GETCHECK, 0, 0) == BST_CHECKED) ? 1 : 0;
+    options->incremental = (SendMessage(backup_dialog.hIncremental, BM_GETCHECK, 0, 0) == BST_CHECKED) ? 1 : 0;
+    options->mode = backup_dialog.mode;
+
+    // Archive compression settings (0 threads = one per CPU)
+    static const int levels[] = {DEFLATE_LEVEL_FASTEST, DEFLATE_LEVEL_DEFAULT, DEFLATE_LEVEL_BEST};
+    int level = (int)SendMessage(backup_dialog.hLevel, CB_GETCURSEL, 0, 0);
+    char number[16] = {0};
+    options->compression_level = level >= 0 && level < 3 ? levels[level] : ARCHIVE_DEFAULT_LEVEL;
+    GetWindowText(backup_dialog.hThreads, number, sizeof(number));
+    options->threads = atoi(number);
+    GetWindowText(backup_dialog.hMemory, number, sizeof(number));
+    options->memory_mb = atoi(number) > 0 ? atoi(number) : ARCHIVE_DEFAULT_MEMORY_MB;
+
+    // Disk load: 0 MB/s means no limit
+    GetWindowText(backup_dialog.hBandwidth, number, sizeof(number));
+    options->bandwidth_mb = atoi(number) > 0 ? atoi(number) : 0;
+    options->background = (SendMessage(backup_dialog.hBackground, BM_GETCHECK, 0, 0) == BST_CHECKED) ? 1 : 0;
+    options->overlapped = (SendMessage(backup_dialog.hOverlapped, BM_GETCHECK, 0, 0) == BST_CHECKED) ? 1 : 0;
+    options->use_journal = (SendMessage(backup_dialog.hJournal, BM_GETCHECK, 0, 0) == BST_CHECKED) ? 1 : 0;
+
+    // Snapshot retention
+    GetWindowText(backup_dialog.hKeepHourly, number, sizeof(number));
+    options->keep_hourly = atoi(number);
+    GetWindowText(backup_dialog.hKeepDaily, number, sizeof(number));
+    options->keep_daily = atoi(number);
+    GetWindowText(backup_dialog.hKeepWeekly, number, sizeof(number));
+    options->keep_weekly = atoi(number);
+
+    // The database is dumped through the devilbox mysql service
+    if (SendMessage(backup_dialog.hDatabaseCheck, BM_GETCHECK, 0, 0) == BST_CHECKED)
+    {
+        GetWindowText(backup_dialog.hDatabase, options->database, sizeof(options->database));
+        strncpy(options->devilbox_path, app.path, sizeof(options->devilbox_path) - 1);
+        strncpy(options->db_password, app.mysql_password, sizeof(options->db_password) - 1);
+    }
+
+    // Convert days string to number
+    if (strlen(days_str) > 0)
+    {
+        options->days = atoi(days_str);
+        if (options->days <= 0)
+            options->days = 7; // Default if invalid
+    }
+
+    // Validate required fields
+    if (strlen(options->source_path) == 0 || strlen(options->target_path) == 0)
+    {
+        MessageBox(hwnd, "Source and target directories must be specified.",
+                   "Validation Error", MB_ICONWARNING);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
 /**
  * Процедура окна для диалога бэкапа
  */
@@ -1334,46 +1729,156 @@ static LRESULT CALLBACK BackupDialogProc(HWND hwnd, UINT msg, WPARAM wp, LPARAM
             break;
         }
 
-        case ID_BACKUP_BTN:
+        case ID_MODE_COMBO:
         {
-            char source_path[MAX_PATH_LEN] = {0};
-            char target_path[MAX_PATH_LEN] = {0};
-            char extensions[MAX_PATH_LEN] = {0};
-            char days_str[10] = {0};
-            int days = 7;        // Default value
-            int include_subdirs; // Changed to int type for compatibility
-
-            // Get values from controls
-            GetWindowText(backup_dialog.hSourcePath, source_path, sizeof(source_path));
-            GetWindowText(backup_dialog.hTargetPath, target_path, sizeof(target_path));
-            GetWindowText(backup_dialog.hExtensions, extensions, sizeof(extensions));
-            GetWindowText(backup_dialog.hDays, days_str, sizeof(days_str));
-
-            // Convert checkbox state to int (0 or 1)
-            include_subdirs = (SendMessage(backup_dialog.hSubdirs, BM_GETCHECK, 0, 0) == BST_CHECKED) ? 1 : 0;
-
-            // Convert days string to number
-            if (strlen(days_str) > 0)
+            if (HIWORD(wp) != CBN_SELCHANGE)
+                break;
+
+            // The repository lives under HOST_PATH_BACKUPDIR and keeps full snapshots
+            int mode = (int)SendMessage(backup_dialog.hMode, CB_GETCURSEL, 0, 0);
+            BOOL store = mode == BACKUP_MODE_STORE;
+            BOOL archive = mode == BACKUP_MODE_ARCHIVE;
+            BOOL rotation = mode == BACKUP_MODE_ROTATION;
+            BOOL incremental = SendMessage(backup_dialog.hIncremental, BM_GETCHECK, 0, 0) == BST_CHECKED;
+            if (store && backup_dialog.mode != BACKUP_MODE_STORE)
             {
-                days = atoi(days_str);
-                if (days <= 0)
-                    days = 7; // Default if invalid
+                GetWindowText(backup_dialog.hTargetPath, backup_dialog.copy_target, sizeof(backup_dialog.copy_target));
+                SetWindowText(backup_dialog.hTargetPath, backup_dialog.repo_path);
             }
+            else if (!store && backup_dialog.mode == BACKUP_MODE_STORE)
+            {
+                SetWindowText(backup_dialog.hTargetPath, backup_dialog.copy_target);
+            }
+            backup_dialog.mode = mode;
 
-            // Validate required fields
-            if (strlen(source_path) == 0 || strlen(target_path) == 0)
+            // Snapshots of a project default to its own folder beside the repository
+            char target[MAX_PATH_LEN];
+            GetWindowText(backup_dialog.hTargetPath, target, sizeof(target));
+            if (rotation && !target[0])
+            {
+                char *p = strrchr(backup_dialog.repo_path, '\\');
+                snprintf(target, sizeof(target), "%.*s\\%s", p ? (int)(p - backup_dialog.repo_path) : 0,
+                         backup_dialog.repo_path, app.projects[backup_dialog.project_index].name);
+                SetWindowText(backup_dialog.hTargetPath, target);
+            }
+
+            // Archives always contain every matching file
+            EnableWindow(backup_dialog.hTargetPath, !store);
+            EnableWindow(backup_dialog.hBrowse, !store);
+            EnableWindow(backup_dialog.hIncremental, mode == BACKUP_MODE_COPY);
+            EnableWindow(backup_dialog.hDays, mode == BACKUP_MODE_COPY && !incremental);
+            EnableWindow(backup_dialog.hLevel, archive);
+            EnableWindow(backup_dialog.hThreads, archive);
+            EnableWindow(backup_dialog.hMemory, archive);
+            EnableWindow(backup_dialog.hKeepHourly, rotation);
+            EnableWindow(backup_dialog.hKeepDaily, rotation);
+            EnableWindow(backup_dialog.hKeepWeekly, rotation);
+            EnableWindow(backup_dialog.hOverlapped, mode == BACKUP_MODE_COPY || rotation);
+            EnableWindow(backup_dialog.hJournal, mode == BACKUP_MODE_COPY && incremental);
+            SetWindowText(backup_dialog.hInfo,
+                          store ? "Files are chunked into the repository, identical content is stored only once."
+                          : archive ? "Matching files are streamed into one .tar.gz, compressed on several threads."
+                          : rotation ? "Each run adds a dated folder, unchanged files are hardlinks to the previous one."
+                          : incremental ? "New and changed files are copied, the target keeps a manifest of the last backup."
+                                        : "Files modified in the specified number of days will be copied to the target directory.");
+            break;
+        }
+
+        case ID_SNAPSHOTS_BTN:
+            show_restore_dialog(hwnd);
+            break;
+
+        case ID_VERIFY_BTN:
+        {
+            // Сверка копии с исходными файлами: хеши обеих копий и манифеста
+            VerifyOptions options;
+            memset(&options, 0, sizeof(options));
+
+            if (backup_dialog.mode == BACKUP_MODE_STORE || backup_dialog.mode == BACKUP_MODE_ARCHIVE)
+            {
+                MessageBox(hwnd, "Verify checks copied folders and rotation snapshots.\n"
+                                 "Repository snapshots and archives are checked when they are restored.",
+                           "Verify Backup", MB_ICONINFORMATION);
+                break;
+            }
+
+            GetWindowText(backup_dialog.hSourcePath, options.source_path, sizeof(options.source_path));
+            GetWindowText(backup_dialog.hTargetPath, options.target_path, sizeof(options.target_path));
+            GetWindowText(backup_dialog.hExtensions, options.extensions, sizeof(options.extensions));
+            GetWindowText(backup_dialog.hExcludes, options.excludes, sizeof(options.excludes));
+            options.include_subdirs = (SendMessage(backup_dialog.hSubdirs, BM_GETCHECK, 0, 0) == BST_CHECKED) ? 1 : 0;
+
+            // Rotation targets are checked through their newest snapshot
+            if (backup_dialog.mode == BACKUP_MODE_ROTATION && options.target_path[0])
+            {
+                RotationSnapshot *snapshots = (RotationSnapshot *)malloc(ROTATION_MAX_SNAPSHOTS * sizeof(RotationSnapshot));
+                int count = snapshots ? rotation_list(options.target_path, snapshots, ROTATION_MAX_SNAPSHOTS) : 0;
+
+                if (count > 0)
+                {
+                    size_t used = strlen(options.target_path);
+                    snprintf(options.target_path + used, sizeof(options.target_path) - used, "\\%s", snapshots[0].id);
+                }
+                free(snapshots);
+                if (count == 0)
+                {
+                    MessageBox(hwnd, "The target directory has no snapshots yet.", "Verify Backup", MB_ICONINFORMATION);
+                    break;
+                }
+            }
+
+            if (strlen(options.source_path) == 0 || strlen(options.target_path) == 0)
             {
                 MessageBox(hwnd, "Source and target directories must be specified.",
                            "Validation Error", MB_ICONWARNING);
                 break;
             }
 
+            execute_verify(&options, hwnd);
+            break;
+        }
+
+        case ID_DATABASE_CHECK:
+            EnableWindow(backup_dialog.hDatabase,
+                         SendMessage(backup_dialog.hDatabaseCheck, BM_GETCHECK, 0, 0) == BST_CHECKED);
+            break;
+
+        case ID_INCREMENTAL_CHECK:
+        {
+            // The days filter only applies to non-incremental backups
+            BOOL incremental = SendMessage(backup_dialog.hIncremental, BM_GETCHECK, 0, 0) == BST_CHECKED;
+            EnableWindow(backup_dialog.hDays, !incremental);
+            EnableWindow(backup_dialog.hJournal, incremental);
+            SetWindowText(backup_dialog.hInfo,
+                          incremental ? "New and changed files are copied, the target keeps a manifest of the last backup."
+                                      : "Files modified in the specified number of days will be copied to the target directory.");
+            break;
+        }
+
+        case ID_BACKUP_BTN:
+        {
+            BackupOptions options;
+
+            if (!read_backup_options(hwnd, &options))
+                break;
+
             // Execute backup using function from backup_utils.h
-            execute_backup(source_path, target_path, extensions, include_subdirs, days);
+            // (the job runs in the background with its own progress window)
+            execute_backup(&options);
             DestroyWindow(hwnd);
             break;
         }
 
+        case ID_PLAN_BTN:
+        {
+            // Пробный прогон: сколько файлов и байт затронет бэкап и сколько он займёт
+            BackupOptions options;
+
+            if (read_backup_options(hwnd, &options))
+                execute_plan(&options, hwnd);
+            break;
+        }
+
         case ID_CANCEL_BTN:
             DestroyWindow(hwnd);
             break;
@@ -1394,6 +1899,186 @@ static LRESULT CALLBACK BackupDialogProc(HWND hwnd, UINT msg, WPARAM wp, LPARAM
     return 0;
 }
 
+/**
+ * Диалог выбора и восстановления бэкапа: снапшота, архива или папки
+ */
+static void show_restore_dialog(HWND owner)
+{
+    char item[MAX_PATH_LEN + 100];
+
+    if (restore_dialog.hDlg && IsWindow(restore_dialog.hDlg))
+    {
+        SetForegroundWindow(restore_dialog.hDlg);
+        return;
+    }
+
+    // Copy and archive backups live in the target directory, snapshots in the repository
+    strncpy(restore_dialog.repo_path, backup_dialog.repo_path, MAX_PATH_LEN - 1);
+    if (backup_dialog.mode == BACKUP_MODE_STORE)
+        strncpy(restore_dialog.backup_dir, backup_dialog.copy_target, MAX_PATH_LEN - 1);
+    else
+        GetWindowText(backup_dialog.hTargetPath, restore_dialog.backup_dir, sizeof(restore_dialog.backup_dir));
+
+    restore_dialog.source_count = restore_list_sources(restore_dialog.repo_path, restore_dialog.backup_dir,
+                                                       restore_dialog.sources, RESTORE_MAX_SOURCES);
+    if (restore_dialog.source_count == 0)
+    {
+        snprintf(item, sizeof(item), "No backups found in %s or %s.", restore_dialog.repo_path,
+                 restore_dialog.backup_dir);
+        MessageBox(owner, item, "Restore Backup", MB_ICONINFORMATION);
+        return;
+    }
+
+    WNDCLASSEX wcDialog;
+    memset(&wcDialog, 0, sizeof(WNDCLASSEX));
+    wcDialog.cbSize = sizeof(WNDCLASSEX);
+    wcDialog.lpfnWndProc = RestoreDialogProc;
+    wcDialog.hInstance = GetModuleHandle(NULL);
+    wcDialog.hbrBackground = (HBRUSH)(COLOR_WINDOW + 1);
+    wcDialog.lpszClassName = "DevilboxRestoreDialog";
+    RegisterClassEx(&wcDialog);
+
+    restore_dialog.hDlg = CreateWindowEx(
+        WS_EX_DLGMODALFRAME,
+        "DevilboxRestoreDialog",
+        "Restore Backup",
+        WS_OVERLAPPEDWINDOW | WS_VISIBLE,
+        120, 120, 600, 360,
+        owner, NULL, GetModuleHandle(NULL), NULL);
+
+    if (!restore_dialog.hDlg)
+    {
+        MessageBox(owner, "Failed to create restore dialog window.", "Error", MB_ICONERROR);
+        return;
+    }
+
+    create_control(restore_dialog.hDlg, "STATIC", "Backups, newest first:",
+                   WS_CHILD | WS_VISIBLE, 10, 10, 570, 20, NULL, 0);
+
+    restore_dialog.hList = create_control(restore_dialog.hDlg, "LISTBOX", "",
+                                          WS_CHILD | WS_VISIBLE | WS_BORDER | WS_VSCROLL | WS_TABSTOP |
+                                              LBS_NOTIFY | LBS_NOINTEGRALHEIGHT,
+                                          10, 35, 570, 200, (HMENU)ID_SNAPSHOT_LIST, WS_EX_CLIENTEDGE);
+
+    for (int i = 0; i < restore_dialog.source_count; i++)
+        SendMessage(restore_dialog.hList, LB_ADDSTRING, 0, (LPARAM)restore_dialog.sources[i].description);
+
+    create_control(restore_dialog.hDlg, "STATIC", "Restore to:",
+                   WS_CHILD | WS_VISIBLE, 10, 250, 120, 20, NULL, 0);
+
+    restore_dialog.hTarget = create_control(restore_dialog.hDlg, "EDIT", "",
+                                            WS_CHILD | WS_VISIBLE | WS_BORDER | ES_AUTOHSCROLL,
+                                            130, 248, 450, 25, (HMENU)ID_RESTORE_TARGET, WS_EX_CLIENTEDGE);
+
+    // Дамп базы данных восстанавливается только по явному запросу
+    restore_dialog.hDatabase = create_control(restore_dialog.hDlg, "BUTTON", "Replay the database dump",
+                                              WS_CHILD | WS_VISIBLE | BS_AUTOCHECKBOX | WS_TABSTOP,
+                                              10, 288, 380, 25, (HMENU)ID_RESTORE_DATABASE, 0);
+
+    create_control(restore_dialog.hDlg, "BUTTON", "Restore",
+                   WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_DEFPUSHBUTTON,
+                   400, 285, 80, 30, (HMENU)ID_RESTORE_BTN, 0);
+
+    create_control(restore_dialog.hDlg, "BUTTON", "Close",
+                   WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_PUSHBUTTON,
+                   490, 285, 80, 30, (HMENU)ID_RESTORE_CLOSE, 0);
+
+    // Новейший бэкап выбран по умолчанию
+    SendMessage(restore_dialog.hList, LB_SETCURSEL, 0, 0);
+    SendMessage(restore_dialog.hDlg, WM_COMMAND, MAKEWPARAM(ID_SNAPSHOT_LIST, LBN_SELCHANGE), 0);
+
+    ShowWindow(restore_dialog.hDlg, SW_SHOW);
+    UpdateWindow(restore_dialog.hDlg);
+}
+
+/**
+ * Процедура окна для диалога восстановления
+ */
+static LRESULT CALLBACK RestoreDialogProc(HWND hwnd, UINT msg, WPARAM wp, LPARAM lp)
+{
+    switch (msg)
+    {
+    case WM_COMMAND:
+        switch (LOWORD(wp))
+        {
+        case ID_SNAPSHOT_LIST:
+        {
+            if (HIWORD(wp) != LBN_SELCHANGE)
+                break;
+
+            // Restore next to the original directory, never over it by default
+            int sel = (int)SendMessage(restore_dialog.hList, LB_GETCURSEL, 0, 0);
+            if (sel >= 0 && sel < restore_dialog.source_count)
+            {
+                const RestoreSource *source = &restore_dialog.sources[sel];
+                char target[MAX_PATH_LEN];
+                snprintf(target, sizeof(target), "%s-restore-%s",
+                         source->origin[0] ? source->origin : backup_dialog.project_path, source->name);
+                SetWindowText(restore_dialog.hTarget, target);
+
+                SendMessage(restore_dialog.hDatabase, BM_SETCHECK, BST_UNCHECKED, 0);
+                EnableWindow(restore_dialog.hDatabase, source->dump_dir[0] != '\0');
+            }
+            break;
+        }
+
+        case ID_RESTORE_BTN:
+        {
+            char target[MAX_PATH_LEN] = {0};
+            int sel = (int)SendMessage(restore_dialog.hList, LB_GETCURSEL, 0, 0);
+
+            GetWindowText(restore_dialog.hTarget, target, sizeof(target));
+            if (sel < 0 || sel >= restore_dialog.source_count || strlen(target) == 0)
+            {
+                MessageBox(hwnd, "Select a backup and a target directory.", "Validation Error", MB_ICONWARNING);
+                break;
+            }
+
+            // Files already restored with the same size and time are kept, a repeated restore resumes
+            if (GetFileAttributes(target) != INVALID_FILE_ATTRIBUTES &&
+                MessageBox(hwnd, "The target directory exists, files in it will be overwritten. Continue?",
+                           "Restore Backup", MB_YESNO | MB_ICONQUESTION) != IDYES)
+                break;
+
+            RestoreOptions options;
+            memset(&options, 0, sizeof(options));
+            options.source = restore_dialog.sources[sel];
+            strncpy(options.target_path, target, sizeof(options.target_path) - 1);
+
+            if (SendMessage(restore_dialog.hDatabase, BM_GETCHECK, 0, 0) == BST_CHECKED)
+            {
+                if (MessageBox(hwnd, "The tables of the dump will replace those in the mysql service. Continue?",
+                               "Restore Backup", MB_YESNO | MB_ICONQUESTION) != IDYES)
+                    break;
+                options.database = 1;
+                strncpy(options.devilbox_path, app.path, sizeof(options.devilbox_path) - 1);
+                strncpy(options.db_password, app.mysql_password, sizeof(options.db_password) - 1);
+            }
+
+            execute_restore(&options, hwnd);
+            break;
+        }
+
+        case ID_RESTORE_CLOSE:
+            DestroyWindow(hwnd);
+            break;
+        }
+        break;
+
+    case WM_CLOSE:
+        DestroyWindow(hwnd);
+        break;
+
+    case WM_DESTROY:
+        restore_dialog.hDlg = NULL;
+        break;
+
+    default:
+        return DefWindowProc(hwnd, msg, wp, lp);
+    }
+    return 0;
+}
+
 /**
  * Update menu status without rebuilding
  */
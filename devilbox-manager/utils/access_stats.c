@@ -0,0 +1,995 @@
+/*******************************************************************************
+ * Access Stats Module Implementation
+ * Access log parsing by format, per-chunk vhost tables merged per log
+ *******************************************************************************/
+
+ #include "access_stats.h"
+ #include "log_reader.h"
+ #include "log_scan.h"
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ 
+ // Longest line parsed, longer ones are cut
+ #define ACCESS_LINE_MAX 8192
+ 
+ // Literal texts and fields of a format at most
+ #define ACCESS_FORMAT_TOKENS 64
+ 
+ // What a format field holds, as far as the statistics go
+ typedef enum
+ {
+     FIELD_OTHER,
+     FIELD_TIME,
+     FIELD_STATUS,
+     FIELD_BYTES,
+     FIELD_HOST,
+     FIELD_SECONDS,           // Request time in seconds, maybe with a fraction
+     FIELD_MILLISECONDS,
+     FIELD_MICROSECONDS
+ } FieldKind;
+ 
+ // A format is literal text to match with fields in between
+ typedef struct
+ {
+     const char *text;        // Literal text, NULL for a field
+     size_t length;
+     FieldKind kind;
+ } FormatToken;
+ 
+ struct AccessFormat
+ {
+     char source[ACCESS_FORMAT_MAX];
+     char literals[ACCESS_FORMAT_MAX];  // The literal texts, unescaped
+     FormatToken tokens[ACCESS_FORMAT_TOKENS];
+     int count;
+     BOOL timed;
+ };
+ 
+ // Field values of one line
+ typedef struct
+ {
+     const char *host;
+     size_t host_length;
+     const char *time;        // Timestamp text, from its opening bracket if it has one
+     size_t time_length;
+     int status;
+     ULONGLONG bytes;
+     ULONGLONG us;
+     BOOL timed;
+ } AccessLine;
+ 
+ // Vhosts of one log or one chunk
+ typedef struct
+ {
+     AccessVhost *vhosts;
+     size_t count;
+     size_t capacity;
+     size_t last;             // Vhost of the last line, lines come in runs
+ } VhostTable;
+ 
+ // An access log and how far it has been parsed
+ typedef struct
+ {
+     char path[MAX_PATH_LEN];
+     char vhost[64];          // Vhost of lines without a host field
+     ULONGLONG file_id;
+     ULONGLONG parsed;        // Offset of the first line not parsed yet
+     VhostTable table;
+     BOOL seen;               // Still among the logs of the update
+     BOOL restart;            // This update parses it again from the start
+     BOOL failed;             // A chunk of this update could not be read
+     ULONGLONG next_id;
+     ULONGLONG next_parsed;
+     LogReader *reader;       // Reader the chunks were planned with, copied to each thread
+ } AccessLog;
+ 
+ // A piece of a log parsed by one thread
+ typedef struct
+ {
+     AccessLog *log;
+     ULONGLONG start;
+     ULONGLONG end;
+     VhostTable table;
+     ULONGLONG lines;
+     ULONGLONG unparsed;
+     BOOL failed;
+ } AccessChunk;
+ 
+ // Chunks shared by the parsing threads, taken in order
+ typedef struct
+ {
+     const AccessFormat *format;
+     AccessChunk *chunks;
+     LONG count;
+     volatile LONG next;
+     volatile LONG *cancel;
+ } ChunkQueue;
+ 
+ // Timestamp of the last line, most lines share their second with the one before
+ typedef struct
+ {
+     char text[32];
+     size_t length;
+     ULONGLONG time;
+ } TimeCache;
+ 
+ struct AccessStats
+ {
+     char format[ACCESS_FORMAT_MAX];  // Source of the format the logs were parsed with
+     AccessLog *logs;
+     int count;
+     VhostTable merged;
+ };
+ 
+ static FieldKind nginx_field(const char *name, size_t length);
+ static FieldKind apache_field(const char *modifier, size_t modifier_length, char letter);
+ static BOOL parse_line(const AccessFormat *format, const char *p, const char *end, AccessLine *line);
+ static void parse_chunk(AccessChunk *chunk, LogReader *reader, const AccessFormat *format, volatile LONG *cancel);
+ static DWORD WINAPI chunk_thread(LPVOID param);
+ static BOOL plan_chunks(AccessLog *log, AccessChunk **chunks, int *count, int *capacity);
+ static AccessVhost *find_vhost(VhostTable *table, const char *name, size_t length);
+ static BOOL merge_table(VhostTable *table, const VhostTable *other);
+ static void free_table(VhostTable *table);
+ static void default_vhost(const char *path, char *vhost, size_t size);
+ 
+ AccessFormat *access_format_compile(const char *format, char *error, size_t error_size)
+ {
+     AccessFormat *compiled = (AccessFormat *)calloc(1, sizeof(AccessFormat));
+     const char *p = format;
+     size_t used = 0, literal = 0;
+     BOOL nginx = FALSE, field = FALSE;
+ 
+     if (!compiled)
+     {
+         snprintf(error, error_size, "out of memory");
+         return NULL;
+     }
+     if (strlen(format) >= sizeof(compiled->source))
+     {
+         snprintf(error, error_size, "the format is too long");
+         free(compiled);
+         return NULL;
+     }
+     strcpy(compiled->source, format);
+ 
+     // nginx names variables, Apache uses % directives
+     for (const char *q = strchr(format, '$'); q && !nginx; q = strchr(q + 1, '$'))
+         nginx = q[1] == '{' || q[1] == '_' || (q[1] >= 'a' && q[1] <= 'z') || (q[1] >= 'A' && q[1] <= 'Z');
+ 
+     while (*p)
+     {
+         const char *name = NULL, *modifier = NULL;
+         size_t name_length = 0, modifier_length = 0;
+         char letter = 0;
+ 
+         if (*p == '\\' && p[1])
+         {
+             // Escaped quotes as written in the config file
+             compiled->literals[used++] = p[1];
+             p += 2;
+             continue;
+         }
+         if (nginx && *p == '$')
+         {
+             const char *start = p + (p[1] == '{' ? 2 : 1);
+             const char *q = start;
+ 
+             while ((*q >= 'a' && *q <= 'z') || (*q >= 'A' && *q <= 'Z') || (*q >= '0' && *q <= '9') || *q == '_')
+                 q++;
+             if (q > start && (p[1] != '{' || *q == '}'))
+             {
+                 name = start;
+                 name_length = (size_t)(q - start);
+                 p = p[1] == '{' ? q + 1 : q;
+             }
+         }
+         else if (!nginx && *p == '%' && p[1] != '%')
+         {
+             const char *q = p + 1;
+ 
+             // %>s, %{Referer}i, %{ms}T
+             while (*q == '<' || *q == '>')
+                 q++;
+             if (*q == '{')
+             {
+                 const char *close = strchr(q, '}');
+ 
+                 if (!close)
+                 {
+                     snprintf(error, error_size, "missing '}' in the format");
+                     free(compiled);
+                     return NULL;
+                 }
+                 modifier = q + 1;
+                 modifier_length = (size_t)(close - q - 1);
+                 q = close + 1;
+             }
+             if ((*q >= 'a' && *q <= 'z') || (*q >= 'A' && *q <= 'Z'))
+             {
+                 letter = *q;
+                 p = q + 1;
+             }
+         }
+         else if (!nginx && *p == '%')
+         {
+             compiled->literals[used++] = '%';
+             p += 2;
+             continue;
+         }
+ 
+         if (!name && !letter)
+         {
+             compiled->literals[used++] = *p++;
+             continue;
+         }
+ 
+         if (compiled->count >= ACCESS_FORMAT_TOKENS - 2)
+         {
+             snprintf(error, error_size, "the format has too many fields");
+             free(compiled);
+             return NULL;
+         }
+ 
+         // A field ends where the text after it starts, two fields in a row cannot be told apart
+         if (used > literal)
+         {
+             FormatToken *token = &compiled->tokens[compiled->count++];
+ 
+             token->text = compiled->literals + literal;
+             token->length = used - literal;
+             literal = used;
+             field = FALSE;
+         }
+         if (field)
+         {
+             snprintf(error, error_size, "fields must be separated by text");
+             free(compiled);
+             return NULL;
+         }
+         compiled->tokens[compiled->count].kind = name ? nginx_field(name, name_length)
+                                                       : apache_field(modifier, modifier_length, letter);
+         if (compiled->tokens[compiled->count].kind >= FIELD_SECONDS)
+             compiled->timed = TRUE;
+         compiled->count++;
+         field = TRUE;
+     }
+ 
+     if (used > literal)
+     {
+         compiled->tokens[compiled->count].text = compiled->literals + literal;
+         compiled->tokens[compiled->count].length = used - literal;
+         compiled->count++;
+     }
+     if (compiled->count == 0 || (compiled->count == 1 && compiled->tokens[0].text))
+     {
+         snprintf(error, error_size, "the format has no fields");
+         free(compiled);
+         return NULL;
+     }
+     return compiled;
+ }
+ 
+ BOOL access_format_timed(const AccessFormat *format)
+ {
+     return format->timed;
+ }
+ 
+ void access_format_free(AccessFormat *format)
+ {
+     free(format);
+ }
+ 
+ /**
+  * Kind of an nginx variable
+  */
+ static FieldKind nginx_field(const char *name, size_t length)
+ {
+     static const struct
+     {
+         const char *name;
+         FieldKind kind;
+     } fields[] = {
+         {"time_local", FIELD_TIME},
+         {"time_iso8601", FIELD_TIME},
+         {"status", FIELD_STATUS},
+         {"body_bytes_sent", FIELD_BYTES},
+         {"bytes_sent", FIELD_BYTES},
+         {"host", FIELD_HOST},
+         {"server_name", FIELD_HOST},
+         {"http_host", FIELD_HOST},
+         {"request_time", FIELD_SECONDS},
+     };
+ 
+     for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++)
+     {
+         if (strlen(fields[i].name) == length && memcmp(fields[i].name, name, length) == 0)
+             return fields[i].kind;
+     }
+     return FIELD_OTHER;
+ }
+ 
+ /**
+  * Kind of an Apache format directive
+  */
+ static FieldKind apache_field(const char *modifier, size_t modifier_length, char letter)
+ {
+     switch (letter)
+     {
+     case 't':
+         return modifier ? FIELD_OTHER : FIELD_TIME;
+     case 's':
+         return FIELD_STATUS;
+     case 'b':
+     case 'B':
+     case 'O':
+         return FIELD_BYTES;
+     case 'v':
+     case 'V':
+         return FIELD_HOST;
+     case 'i':
+         return modifier && modifier_length == 4 && _strnicmp(modifier, "Host", 4) == 0 ? FIELD_HOST : FIELD_OTHER;
+     case 'D':
+         return FIELD_MICROSECONDS;
+     case 'T':
+         // %T is in seconds unless a unit is given
+         if (modifier && modifier_length == 2 && memcmp(modifier, "ms", 2) == 0)
+             return FIELD_MILLISECONDS;
+         if (modifier && modifier_length == 2 && memcmp(modifier, "us", 2) == 0)
+             return FIELD_MICROSECONDS;
+         return FIELD_SECONDS;
+     }
+     return FIELD_OTHER;
+ }
+ 
+ /**
+  * Read a whole number, FALSE for "-" or no digits
+  */
+ static BOOL parse_number(const char *p, const char *end, ULONGLONG *value)
+ {
+     *value = 0;
+     if (p == end || *p < '0' || *p > '9')
+         return FALSE;
+     for (; p < end && *p >= '0' && *p <= '9'; p++)
+         *value = *value * 10 + (ULONGLONG)(*p - '0');
+     return TRUE;
+ }
+ 
+ /**
+  * Store the value of a field
+  */
+ static void set_field(FieldKind kind, const char *line, const char *p, const char *end, AccessLine *values)
+ {
+     ULONGLONG number;
+ 
+     switch (kind)
+     {
+     case FIELD_TIME:
+         // Access log times are recognized by their bracket: [10/Oct/2024:13:55:36 +0000]
+         if (p > line && p[-1] == '[')
+             p--;
+         values->time = p;
+         values->time_length = (size_t)(end - p);
+         break;
+     case FIELD_STATUS:
+         if (parse_number(p, end, &number))
+             values->status = (int)number;
+         break;
+     case FIELD_BYTES:
+         parse_number(p, end, &values->bytes);
+         break;
+     case FIELD_HOST:
+         if (end - p > 1 || (end > p && *p != '-'))
+         {
+             values->host = p;
+             values->host_length = (size_t)(end - p);
+         }
+         break;
+     case FIELD_SECONDS:
+         // "0.123": the fraction is read to microseconds
+         if (parse_number(p, end, &number))
+         {
+             ULONGLONG scale = 100000;
+ 
+             values->us = number * 1000000;
+             while (p < end && *p != '.')
+                 p++;
+             for (p++; p < end && *p >= '0' && *p <= '9' && scale > 0; p++, scale /= 10)
+                 values->us += (ULONGLONG)(*p - '0') * scale;
+             values->timed = TRUE;
+         }
+         break;
+     case FIELD_MILLISECONDS:
+         values->timed = parse_number(p, end, &number);
+         values->us = number * 1000;
+         break;
+     case FIELD_MICROSECONDS:
+         values->timed = parse_number(p, end, &values->us);
+         break;
+     case FIELD_OTHER:
+         break;
+     }
+ }
+ 
+ /**
+  * Match a line against a format and pick out the fields
+  */
+ static BOOL parse_line(const AccessFormat *format, const char *p, const char *end, AccessLine *values)
+ {
+     const char *line = p;
+ 
+     memset(values, 0, sizeof(*values));
+     for (int i = 0; i < format->count; i++)
+     {
+         const FormatToken *token = &format->tokens[i];
+         const char *stop = end;
+ 
+         if (token->text)
+         {
+             if ((size_t)(end - p) < token->length || memcmp(p, token->text, token->length) != 0)
+                 return FALSE;
+             p += token->length;
+             continue;
+         }
+ 
+         // The field runs up to the text after it, or to the end of the line
+         if (i + 1 < format->count)
+         {
+             const FormatToken *next = &format->tokens[i + 1];
+             const char *q = p;
+ 
+             for (;;)
+             {
+                 q = (const char *)memchr(q, next->text[0], (size_t)(end - q));
+                 if (!q || (size_t)(end - q) < next->length)
+                     return FALSE;
+                 if (memcmp(q, next->text, next->length) == 0)
+                     break;
+                 q++;
+             }
+             stop = q;
+         }
+         set_field(token->kind, line, p, stop, values);
+         p = stop;
+     }
+     return TRUE;
+ }
+ 
+ /**
+  * Count one line for its vhost
+  */
+ static void add_line(AccessChunk *chunk, const AccessFormat *format, const char *p, size_t length, TimeCache *cache)
+ {
+     AccessLine values;
+     AccessVhost *vhost;
+     ULONGLONG time = 0;
+ 
+     if (length > 0 && p[length - 1] == '\r')
+         length--;
+     chunk->lines++;
+     if (!parse_line(format, p, p + length, &values))
+     {
+         chunk->unparsed++;
+         return;
+     }
+ 
+     vhost = values.host ? find_vhost(&chunk->table, values.host, values.host_length)
+                         : find_vhost(&chunk->table, chunk->log->vhost, strlen(chunk->log->vhost));
+     if (!vhost)
+     {
+         chunk->failed = TRUE;
+         return;
+     }
+ 
+     if (values.time)
+     {
+         // The time up to the seconds decides, the zone is the same throughout a log
+         size_t key = values.time_length < sizeof(cache->text) ? values.time_length : sizeof(cache->text);
+ 
+         if (key != cache->length || memcmp(values.time, cache->text, key) != 0)
+         {
+             memcpy(cache->text, values.time, key);
+             cache->length = key;
+             if (!log_parse_time(values.time, values.time_length, &cache->time))
+                 cache->time = 0;
+         }
+         time = cache->time;
+     }
+ 
+     vhost->requests++;
+     vhost->bytes += values.bytes;
+     vhost->status[values.status >= 100 && values.status < 600 ? values.status / 100 : 0]++;
+     if (time && (!vhost->first || time < vhost->first))
+         vhost->first = time;
+     if (time > vhost->last)
+         vhost->last = time;
+     if (values.timed)
+         access_histogram_add(&vhost->times, values.us);
+ }
+ 
+ /**
+  * Parse the lines of a chunk into its own vhost table
+  */
+ static void parse_chunk(AccessChunk *chunk, LogReader *reader, const AccessFormat *format, volatile LONG *cancel)
+ {
+     ULONGLONG offset = chunk->start;
+     TimeCache cache;
+ 
+     memset(&cache, 0, sizeof(cache));
+     while (offset < chunk->end && !chunk->failed && !(cancel && *cancel))
+     {
+         size_t length;
+         const char *start = log_reader_map(reader, offset, &length);
+         const char *p = start, *end, *newline;
+ 
+         if (!p)
+         {
+             chunk->failed = TRUE;
+             break;
+         }
+         if (length > chunk->end - offset)
+             length = (size_t)(chunk->end - offset);
+         end = p + length;
+ 
+         // The whole lines in the view; the chunk ends at a line start
+         while (p < end && (newline = (const char *)memchr(p, '\n', (size_t)(end - p))) != NULL)
+         {
+             add_line(chunk, format, p, (size_t)(newline - p), &cache);
+             p = newline + 1;
+         }
+         offset += (ULONGLONG)(p - start);
+ 
+         if (p == start)
+         {
+             // A line longer than the view ahead of it
+             char line[ACCESS_LINE_MAX];
+             size_t used = log_reader_get_line(reader, offset, line, sizeof(line), &offset);
+ 
+             add_line(chunk, format, line, used, &cache);
+         }
+     }
+ }
+ 
+ /**
+  * Parsing thread: take chunks until none are left. The chunks of a log follow
+  * each other, a thread reads them through its own copy of the planned reader.
+  */
+ static DWORD WINAPI chunk_thread(LPVOID param)
+ {
+     ChunkQueue *queue = (ChunkQueue *)param;
+     LogReader *reader = NULL;
+     AccessLog *log = NULL;
+     LONG next;
+ 
+     while ((next = InterlockedIncrement(&queue->next) - 1) < queue->count)
+     {
+         AccessChunk *chunk = &queue->chunks[next];
+ 
+         if (chunk->log != log)
+         {
+             log_reader_close(reader);
+             log = chunk->log;
+             reader = log_reader_clone(log->reader);
+         }
+         if (reader)
+             parse_chunk(chunk, reader, queue->format, queue->cancel);
+         else
+             chunk->failed = TRUE;
+     }
+ 
+     log_reader_close(reader);
+     return 0;
+ }
+ 
+ /**
+  * Bucket of a request time: exact below 64, then 32 buckets per power of two
+  */
+ static int histogram_bucket(ULONGLONG us)
+ {
+     int msb = 5, shift, bucket;
+ 
+     if (us < 64)
+         return (int)us;
+     while (msb < 63 && (us >> (msb + 1)) != 0)
+         msb++;
+     shift = msb - 5;
+     bucket = shift * 32 + (int)(us >> shift);
+     return bucket < ACCESS_HISTOGRAM_BUCKETS ? bucket : ACCESS_HISTOGRAM_BUCKETS - 1;
+ }
+ 
+ void access_histogram_add(AccessHistogram *histogram, ULONGLONG us)
+ {
+     histogram->buckets[histogram_bucket(us)]++;
+     histogram->count++;
+ }
+ 
+ void access_histogram_merge(AccessHistogram *histogram, const AccessHistogram *other)
+ {
+     if (other->count == 0)
+         return;
+ 
+     for (int i = 0; i < ACCESS_HISTOGRAM_BUCKETS; i++)
+         histogram->buckets[i] += other->buckets[i];
+     histogram->count += other->count;
+ }
+ 
+ ULONGLONG access_histogram_percentile(const AccessHistogram *histogram, double percent)
+ {
+     ULONGLONG rank = (ULONGLONG)(percent / 100.0 * (double)histogram->count + 0.999999);
+     ULONGLONG seen = 0;
+ 
+     if (histogram->count == 0)
+         return 0;
+     if (rank < 1)
+         rank = 1;
+ 
+     for (int i = 0; i < ACCESS_HISTOGRAM_BUCKETS; i++)
+     {
+         seen += histogram->buckets[i];
+         if (seen >= rank)
+         {
+             int shift = i / 32 - 1;
+ 
+             if (i < 64)
+                 return (ULONGLONG)i;
+             return ((ULONGLONG)(i - shift * 32) << shift) + ((1ULL << shift) >> 1);
+         }
+     }
+     return 0;
+ }
+ 
+ AccessStats *access_stats_create(void)
+ {
+     return (AccessStats *)calloc(1, sizeof(AccessStats));
+ }
+ 
+ /**
+  * Order of the listed vhosts: most requests first
+  */
+ static int compare_vhosts(const void *a, const void *b)
+ {
+     const AccessVhost *va = (const AccessVhost *)a, *vb = (const AccessVhost *)b;
+ 
+     if (va->requests != vb->requests)
+         return va->requests > vb->requests ? -1 : 1;
+     return strcmp(va->name, vb->name);
+ }
+ 
+ BOOL access_stats_update(AccessStats *stats, const char *const *paths, int count, const AccessFormat *format,
+                          volatile LONG *cancel, AccessUpdateStats *update)
+ {
+     AccessChunk *chunks = NULL;
+     int chunk_count = 0, chunk_capacity = 0, worker_count = 0, kept = 0;
+     HANDLE workers[ACCESS_STATS_MAX_THREADS];
+     LARGE_INTEGER frequency, started, finished;
+     ChunkQueue queue;
+     SYSTEM_INFO si;
+     BOOL ok = TRUE;
+ 
+     QueryPerformanceFrequency(&frequency);
+     QueryPerformanceCounter(&started);
+     if (update)
+         memset(update, 0, sizeof(*update));
+ 
+     // Another format reads every log again
+     if (strcmp(stats->format, format->source) != 0)
+     {
+         for (int i = 0; i < stats->count; i++)
+             free_table(&stats->logs[i].table);
+         stats->count = 0;
+         strcpy(stats->format, format->source);
+     }
+     if (!stats->logs)
+     {
+         stats->logs = (AccessLog *)calloc(ACCESS_STATS_MAX_LOGS, sizeof(AccessLog));
+         if (!stats->logs)
+             return FALSE;
+     }
+ 
+     // Logs no longer there are dropped, new ones start from the beginning
+     for (int i = 0; i < stats->count; i++)
+         stats->logs[i].seen = FALSE;
+     for (int i = 0; i < count; i++)
+     {
+         int j = 0;
+ 
+         while (j < stats->count && _stricmp(stats->logs[j].path, paths[i]) != 0)
+             j++;
+         if (j == stats->count)
+         {
+             if (stats->count >= ACCESS_STATS_MAX_LOGS)
+                 continue;
+             memset(&stats->logs[j], 0, sizeof(AccessLog));
+             strncpy(stats->logs[j].path, paths[i], sizeof(stats->logs[j].path) - 1);
+             default_vhost(paths[i], stats->logs[j].vhost, sizeof(stats->logs[j].vhost));
+             stats->count++;
+         }
+         stats->logs[j].seen = TRUE;
+     }
+     for (int i = 0; i < stats->count; i++)
+     {
+         if (stats->logs[i].seen)
+             stats->logs[kept++] = stats->logs[i];
+         else
+             free_table(&stats->logs[i].table);
+     }
+     stats->count = kept;
+ 
+     for (int i = 0; i < stats->count && ok; i++)
+         ok = plan_chunks(&stats->logs[i], &chunks, &chunk_count, &chunk_capacity);
+ 
+     // Chunks go to every CPU, each thread takes the next one when done
+     GetSystemInfo(&si);
+     queue.format = format;
+     queue.chunks = chunks;
+     queue.count = chunk_count;
+     queue.next = 0;
+     queue.cancel = cancel;
+     if (ok)
+     {
+         int threads = (int)si.dwNumberOfProcessors;
+ 
+         if (threads > ACCESS_STATS_MAX_THREADS)
+             threads = ACCESS_STATS_MAX_THREADS;
+         if (threads > chunk_count)
+             threads = chunk_count;
+         for (int i = 0; i < threads; i++)
+         {
+             workers[worker_count] = CreateThread(NULL, 0, chunk_thread, &queue, 0, NULL);
+             if (workers[worker_count])
+                 worker_count++;
+         }
+         if (worker_count == 0)
+             chunk_thread(&queue);
+         else
+             WaitForMultipleObjects(worker_count, workers, TRUE, INFINITE);
+         for (int i = 0; i < worker_count; i++)
+             CloseHandle(workers[i]);
+     }
+     for (int i = 0; i < stats->count; i++)
+     {
+         log_reader_close(stats->logs[i].reader);
+         stats->logs[i].reader = NULL;
+     }
+ 
+     for (int i = 0; i < chunk_count; i++)
+     {
+         if (chunks[i].failed)
+             chunks[i].log->failed = TRUE;
+     }
+     if (cancel && *cancel)
+         ok = FALSE;
+ 
+     // Chunk tables add up per log; a log with a chunk that could not be read stays as it was
+     for (int i = 0; i < chunk_count && ok; i++)
+     {
+         AccessChunk *chunk = &chunks[i];
+         AccessLog *log = chunk->log;
+ 
+         if (log->failed)
+             continue;
+         if (log->restart)
+         {
+             free_table(&log->table);
+             log->restart = FALSE;
+         }
+         if (!merge_table(&log->table, &chunk->table))
+             ok = FALSE;
+         if (update)
+         {
+             update->lines += chunk->lines;
+             update->unparsed += chunk->unparsed;
+             update->bytes += chunk->end - chunk->start;
+         }
+     }
+     for (int i = 0; i < stats->count && ok; i++)
+     {
+         AccessLog *log = &stats->logs[i];
+ 
+         if (log->failed)
+             continue;
+         if (log->restart)
+             free_table(&log->table);
+         log->file_id = log->next_id;
+         log->parsed = log->next_parsed;
+     }
+     for (int i = 0; i < stats->count; i++)
+         stats->logs[i].restart = stats->logs[i].failed = FALSE;
+ 
+     for (int i = 0; i < chunk_count; i++)
+         free_table(&chunks[i].table);
+     free(chunks);
+     if (!ok)
+         return FALSE;
+ 
+     // Vhosts logging to more than one log add up
+     stats->merged.count = 0;
+     stats->merged.last = 0;
+     for (int i = 0; i < stats->count && ok; i++)
+         ok = merge_table(&stats->merged, &stats->logs[i].table);
+     if (stats->merged.count > 1)
+         qsort(stats->merged.vhosts, stats->merged.count, sizeof(AccessVhost), compare_vhosts);
+     stats->merged.last = 0;
+ 
+     QueryPerformanceCounter(&finished);
+     if (update)
+     {
+         update->logs = stats->count;
+         update->threads = worker_count > 0 ? worker_count : 1;
+         update->elapsed_us = (ULONGLONG)((finished.QuadPart - started.QuadPart) * 1000000 / frequency.QuadPart);
+     }
+     return ok;
+ }
+ 
+ const AccessVhost *access_stats_vhosts(const AccessStats *stats, size_t *count)
+ {
+     *count = stats->merged.count;
+     return stats->merged.vhosts;
+ }
+ 
+ void access_stats_free(AccessStats *stats)
+ {
+     if (!stats)
+         return;
+ 
+     for (int i = 0; i < stats->count; i++)
+         free_table(&stats->logs[i].table);
+     free(stats->logs);
+     free_table(&stats->merged);
+     free(stats);
+ }
+ 
+ /**
+  * Cut the lines of a log not parsed yet into chunks at line starts. A log
+  * that was rotated, replaced or truncated is parsed from the start again.
+  * The reader is kept for the parsing threads, so they read the same rotated
+  * copies the chunks were cut from and no compressed copy is indexed twice.
+  */
+ static BOOL plan_chunks(AccessLog *log, AccessChunk **chunks, int *count, int *capacity)
+ {
+     LogReader *reader = log_reader_open_rotated(log->path);
+     ULONGLONG id = 0, size, end, from, pieces;
+ 
+     // A log missing for a moment during rotation keeps its statistics
+     log->failed = !reader;
+     if (!reader)
+         return TRUE;
+ 
+     log_reader_file_id(reader, &id);
+     size = log_reader_size(reader);
+     log->restart = id != log->file_id || size < log->parsed;
+     from = log->restart ? 0 : log->parsed;
+ 
+     // A line still being written is left for the next update
+     end = log_reader_line_start(reader, size);
+     log->next_id = id;
+     log->next_parsed = end > from ? end : from;
+     pieces = end > from ? (end - from + ACCESS_STATS_CHUNK - 1) / ACCESS_STATS_CHUNK : 0;
+ 
+     for (ULONGLONG i = 0; i < pieces; i++)
+     {
+         ULONGLONG start = i == 0 ? from : log_reader_line_start(reader, from + (end - from) * i / pieces);
+         ULONGLONG stop = i + 1 == pieces ? end : log_reader_line_start(reader, from + (end - from) * (i + 1) / pieces);
+         AccessChunk *chunk;
+ 
+         if (stop <= start)
+             continue;
+         if (*count == *capacity)
+         {
+             int grown_capacity = *capacity ? *capacity * 2 : 64;
+             AccessChunk *grown = (AccessChunk *)realloc(*chunks, (size_t)grown_capacity * sizeof(AccessChunk));
+ 
+             if (!grown)
+             {
+                 log_reader_close(reader);
+                 return FALSE;
+             }
+             *chunks = grown;
+             *capacity = grown_capacity;
+         }
+ 
+         chunk = &(*chunks)[(*count)++];
+         memset(chunk, 0, sizeof(*chunk));
+         chunk->log = log;
+         chunk->start = start;
+         chunk->end = stop;
+     }
+ 
+     // The threads map their own views
+     log_reader_unmap(reader);
+     log->reader = reader;
+     return TRUE;
+ }
+ 
+ /**
+  * Find a vhost by name, adding it when new. Past the limit the rest count
+  * together as "(other)".
+  * @return Vhost, NULL when out of memory
+  */
+ static AccessVhost *find_vhost(VhostTable *table, const char *name, size_t length)
+ {
+     AccessVhost *vhost;
+ 
+     if (length >= sizeof(vhost->name))
+         length = sizeof(vhost->name) - 1;
+     if (table->last < table->count && strncmp(table->vhosts[table->last].name, name, length) == 0 &&
+         table->vhosts[table->last].name[length] == '\0')
+         return &table->vhosts[table->last];
+ 
+     for (size_t i = 0; i < table->count; i++)
+     {
+         if (strncmp(table->vhosts[i].name, name, length) == 0 && table->vhosts[i].name[length] == '\0')
+         {
+             table->last = i;
+             return &table->vhosts[i];
+         }
+     }
+ 
+     if (table->count >= ACCESS_STATS_MAX_VHOSTS - 1 && !(length == 7 && memcmp(name, "(other)", 7) == 0))
+         return find_vhost(table, "(other)", 7);
+     if (table->count == table->capacity)
+     {
+         size_t capacity = table->capacity ? table->capacity * 2 : 4;
+         AccessVhost *grown = (AccessVhost *)realloc(table->vhosts, capacity * sizeof(AccessVhost));
+ 
+         if (!grown)
+             return NULL;
+         table->vhosts = grown;
+         table->capacity = capacity;
+     }
+ 
+     vhost = &table->vhosts[table->count];
+     memset(vhost, 0, sizeof(*vhost));
+     memcpy(vhost->name, name, length);
+     table->last = table->count++;
+     return vhost;
+ }
+ 
+ /**
+  * Add the vhosts of one table to another
+  */
+ static BOOL merge_table(VhostTable *table, const VhostTable *other)
+ {
+     for (size_t i = 0; i < other->count; i++)
+     {
+         const AccessVhost *from = &other->vhosts[i];
+         AccessVhost *to = find_vhost(table, from->name, strlen(from->name));
+ 
+         if (!to)
+             return FALSE;
+         to->requests += from->requests;
+         to->bytes += from->bytes;
+         for (int j = 0; j < 6; j++)
+             to->status[j] += from->status[j];
+         if (from->first && (!to->first || from->first < to->first))
+             to->first = from->first;
+         if (from->last > to->last)
+             to->last = from->last;
+         access_histogram_merge(&to->times, &from->times);
+     }
+     return TRUE;
+ }
+ 
+ static void free_table(VhostTable *table)
+ {
+     free(table->vhosts);
+     memset(table, 0, sizeof(*table));
+ }
+ 
+ /**
+  * Vhost named by a log file: "project-access.log" is "project"
+  */
+ static void default_vhost(const char *path, char *vhost, size_t size)
+ {
+     const char *slash = strrchr(path, '\\');
+     const char *name = slash ? slash + 1 : path;
+     size_t length = strlen(name);
+ 
+     if (length > 4 && _stricmp(name + length - 4, ".log") == 0)
+         length -= 4;
+     if (length > 7 && _strnicmp(name + length - 7, "-access", 7) == 0)
+         length -= 7;
+     else if (length > 7 && _strnicmp(name + length - 7, "_access", 7) == 0)
+         length -= 7;
+     snprintf(vhost, size, "%.*s", (int)length, name);
+ }
\ No newline at end of file
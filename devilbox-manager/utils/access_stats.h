@@ -0,0 +1,165 @@
+/*******************************************************************************
+ * Access Stats Module Header
+ * Per-vhost statistics of web server access logs: request rate, status mix,
+ * bytes and request time percentiles, parsed in parallel and kept up to date
+ * as the logs grow
+ *******************************************************************************/
+#ifndef ACCESS_STATS_H
+#define ACCESS_STATS_H
+
+#include <windows.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Maximum path length constant (if not already defined)
+#ifndef MAX_PATH_LEN
+#define MAX_PATH_LEN 260
+#endif
+
+// The "combined" formats the Devilbox vhosts log with, neither has the request time
+#define ACCESS_FORMAT_NGINX "$remote_addr - $remote_user [$time_local] \"$request\" $status $body_bytes_sent " \
+                            "\"$http_referer\" \"$http_user_agent\""
+#define ACCESS_FORMAT_APACHE "%h %l %u %t \"%r\" %>s %b \"%{Referer}i\" \"%{User-Agent}i\""
+
+// Longest format string
+#define ACCESS_FORMAT_MAX 512
+
+// Access logs and vhosts tracked at most
+#define ACCESS_STATS_MAX_LOGS 256
+#define ACCESS_STATS_MAX_VHOSTS 256
+
+// Bytes of a log parsed as one piece of work, the unit spread over the threads
+#define ACCESS_STATS_CHUNK (8 * 1048576)
+
+// Parsing threads at most
+#define ACCESS_STATS_MAX_THREADS 16
+
+// Request time histogram: exact below 64 us, then 32 buckets per power of two (3% wide)
+#define ACCESS_HISTOGRAM_BUCKETS 1152
+
+// Request times in microseconds; histograms of separately parsed pieces add up
+typedef struct
+{
+    ULONGLONG count;
+    ULONGLONG buckets[ACCESS_HISTOGRAM_BUCKETS];
+} AccessHistogram;
+
+// Statistics of one vhost
+typedef struct
+{
+    char name[64];
+    ULONGLONG requests;
+    ULONGLONG bytes;
+    ULONGLONG status[6];     // By class: [2] for 2xx and so on, [0] for anything else
+    ULONGLONG first;         // Times of the earliest and the latest request (FILETIME), 0 if none
+    ULONGLONG last;
+    AccessHistogram times;   // Requests with a request time
+} AccessVhost;
+
+// Work done by the last update
+typedef struct
+{
+    ULONGLONG lines;         // Lines parsed
+    ULONGLONG unparsed;      // Lines not in the format
+    ULONGLONG bytes;         // Bytes read
+    int logs;                // Logs tracked
+    int threads;
+    ULONGLONG elapsed_us;
+} AccessUpdateStats;
+
+// Compiled log format (opaque)
+typedef struct AccessFormat AccessFormat;
+
+// Statistics of a set of access logs (opaque)
+typedef struct AccessStats AccessStats;
+
+/**
+ * Compile a log format: an nginx log_format string ($status, $request_time,
+ * ...) or an Apache LogFormat string (%>s, %D, ...), without the quotes of
+ * the config file. Fields must be separated by some text.
+ * @param format Format string
+ * @param error Receives the reason on failure
+ * @param error_size Size of the error buffer
+ * @return Format, NULL if it is not valid
+ */
+AccessFormat *access_format_compile(const char *format, char *error, size_t error_size);
+
+/**
+ * Check whether a format logs the request time, needed for the percentiles
+ * @param format Format
+ * @return TRUE if it has a request time field
+ */
+BOOL access_format_timed(const AccessFormat *format);
+
+/**
+ * Free a format
+ * @param format Format (may be NULL)
+ */
+void access_format_free(AccessFormat *format);
+
+/**
+ * Add a request time to a histogram
+ * @param histogram Histogram
+ * @param us Request time in microseconds
+ */
+void access_histogram_add(AccessHistogram *histogram, ULONGLONG us);
+
+/**
+ * Add the counts of one histogram to another
+ * @param histogram Histogram to add to
+ * @param other Histogram to add
+ */
+void access_histogram_merge(AccessHistogram *histogram, const AccessHistogram *other);
+
+/**
+ * Get a percentile of a histogram
+ * @param histogram Histogram
+ * @param percent Percentile, 0 to 100
+ * @return Request time in microseconds (the middle of its bucket), 0 if empty
+ */
+ULONGLONG access_histogram_percentile(const AccessHistogram *histogram, double percent);
+
+/**
+ * Create empty statistics
+ * @return Statistics, NULL when out of memory
+ */
+AccessStats *access_stats_create(void);
+
+/**
+ * Bring the statistics up to date with a set of access logs. Each log is
+ * read with its rotated copies; only lines added since the last update are
+ * parsed, a rotated or truncated log is parsed again. The new lines are cut
+ * into chunks parsed on all CPUs. A log without a host field counts for
+ * the vhost in its name: "project-access.log" is "project".
+ * @param stats Statistics
+ * @param paths Access log paths
+ * @param count Number of paths
+ * @param format Log format; a changed format starts over
+ * @param cancel Set to nonzero to stop; the statistics stay as they were (may be NULL)
+ * @param update Receives the work done (may be NULL)
+ * @return TRUE if completed, FALSE if cancelled or out of memory
+ */
+BOOL access_stats_update(AccessStats *stats, const char *const *paths, int count, const AccessFormat *format,
+                         volatile LONG *cancel, AccessUpdateStats *update);
+
+/**
+ * Get the vhosts, the busiest first
+ * @param stats Statistics
+ * @param count Receives the number of vhosts
+ * @return Vhosts, valid until the next update
+ */
+const AccessVhost *access_stats_vhosts(const AccessStats *stats, size_t *count);
+
+/**
+ * Free statistics
+ * @param stats Statistics (may be NULL)
+ */
+void access_stats_free(AccessStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ACCESS_STATS_H */
\ No newline at end of file
@@ -0,0 +1,510 @@
+/*******************************************************************************
+ * Access Viewer Module Implementation
+ * Shows requests, status mix and request time percentiles per vhost
+ *******************************************************************************/
+
+ #include "access_viewer.h"
+ #include "access_stats.h"
+ #include "logs_viewer.h"
+ #include "log_reader.h"
+ #include "settings.h"
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ #include <ctype.h>
+ 
+ // Posted by the update thread when it is done
+ #define WM_ACCESS_DONE (WM_APP + 1)
+ 
+ // Registry value holding the log format
+ #define ACCESS_FORMAT_SETTING "AccessLogFormat"
+ 
+ // Room for one vhost row of the table
+ #define ACCESS_ROW_SIZE 192
+ 
+ // One update, owned by the update thread until it is done
+ typedef struct
+ {
+     AccessFormat *format;
+     char (*files)[MAX_PATH_LEN];
+     int file_count;
+     BOOL completed;
+     AccessUpdateStats update;
+     volatile LONG cancelled;
+ } AccessJob;
+ 
+ // Access statistics dialog state structure
+ typedef struct
+ {
+     HWND hDlg;
+     HWND hFormat;
+     HWND hUpdate;
+     HWND hAuto;
+     HWND hEdit;
+     HWND hStatus;
+     HFONT hFont;
+     char log_dir[MAX_PATH_LEN];
+     BOOL nginx;
+     AccessStats *stats;         // Kept between updates, so only new lines are parsed
+     BOOL timed;                 // The format of the statistics has a request time
+     AccessJob *job;
+     HANDLE hThread;
+ } AccessDialogState;
+ 
+ // Global state for the access statistics dialog
+ static AccessDialogState access_dialog = {0};
+ 
+ // Format presets: the Devilbox defaults and the same with the request time
+ static const char *const nginx_formats[] = {
+     ACCESS_FORMAT_NGINX,
+     ACCESS_FORMAT_NGINX " $request_time",
+ };
+ static const char *const apache_formats[] = {
+     ACCESS_FORMAT_APACHE,
+     ACCESS_FORMAT_APACHE " %D",
+ };
+ 
+ // Forward declarations of internal functions
+ static LRESULT CALLBACK AccessDialogProc(HWND hwnd, UINT msg, WPARAM wp, LPARAM lp);
+ static void start_update(void);
+ static void stop_update(void);
+ static void show_stats(void);
+ static DWORD WINAPI update_thread(LPVOID param);
+ static void collect_access_logs(AccessJob *job);
+ static BOOL is_access_log(const char *name);
+ static void format_time(char *buffer, size_t size, const AccessHistogram *times, double percent);
+ static void free_job(AccessJob *job);
+ 
+ /**
+  * Display the access statistics dialog
+  */
+ void show_access_stats(const char *app_path, const char *httpd_version)
+ {
+     char format[ACCESS_FORMAT_MAX];
+     const char *const *presets;
+ 
+     // Check if dialog is already open
+     if (access_dialog.hDlg && IsWindow(access_dialog.hDlg))
+     {
+         SetForegroundWindow(access_dialog.hDlg);
+         return;
+     }
+ 
+     // The vhosts log next to each other, e.g. log\nginx-stable\project-access.log
+     snprintf(access_dialog.log_dir, sizeof(access_dialog.log_dir), "%s\\log\\%s", app_path, httpd_version);
+     access_dialog.nginx = strncmp(httpd_version, "nginx", 5) == 0;
+     presets = access_dialog.nginx ? nginx_formats : apache_formats;
+ 
+     // Register dialog class
+     WNDCLASSEX wcDialog;
+     memset(&wcDialog, 0, sizeof(WNDCLASSEX));
+     wcDialog.cbSize = sizeof(WNDCLASSEX);
+     wcDialog.lpfnWndProc = AccessDialogProc;
+     wcDialog.hInstance = GetModuleHandle(NULL);
+     wcDialog.hbrBackground = (HBRUSH)(COLOR_WINDOW + 1);
+     wcDialog.lpszClassName = "DevilboxAccessDialog";
+     RegisterClassEx(&wcDialog);
+ 
+     // Create dialog window
+     access_dialog.hDlg = CreateWindowEx(
+         WS_EX_DLGMODALFRAME,
+         "DevilboxAccessDialog",
+         "Access Log Statistics",
+         WS_OVERLAPPEDWINDOW | WS_VISIBLE,
+         100, 100, 1000, 700,
+         NULL, NULL, GetModuleHandle(NULL), NULL);
+ 
+     if (!access_dialog.hDlg)
+     {
+         MessageBox(NULL, "Failed to create access statistics window.", "Error", MB_ICONERROR);
+         return;
+     }
+ 
+     // Log format: a preset or the format of the server config
+     create_control(access_dialog.hDlg, "STATIC", "Format:",
+                    WS_CHILD | WS_VISIBLE, 10, 12, 50, 20, NULL, 0);
+ 
+     access_dialog.hFormat = create_control(access_dialog.hDlg, "COMBOBOX", "",
+                                            WS_CHILD | WS_VISIBLE | WS_TABSTOP | WS_VSCROLL | CBS_DROPDOWN |
+                                                CBS_AUTOHSCROLL,
+                                            65, 10, 600, 200, (HMENU)ID_ACCESS_FORMAT, 0);
+     SendMessage(access_dialog.hFormat, CB_LIMITTEXT, ACCESS_FORMAT_MAX - 1, 0);
+     for (int i = 0; i < 2; i++)
+         SendMessage(access_dialog.hFormat, CB_ADDSTRING, 0, (LPARAM)presets[i]);
+ 
+     load_setting_text(ACCESS_FORMAT_SETTING, format, sizeof(format));
+     SetWindowText(access_dialog.hFormat, format[0] ? format : presets[0]);
+ 
+     access_dialog.hAuto = create_control(access_dialog.hDlg, "BUTTON", "Auto-update",
+                                          WS_CHILD | WS_VISIBLE | WS_TABSTOP | BS_AUTOCHECKBOX,
+                                          680, 10, 110, 24, (HMENU)ID_ACCESS_AUTO, 0);
+ 
+     access_dialog.hUpdate = create_control(access_dialog.hDlg, "BUTTON", "Update",
+                                            WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_DEFPUSHBUTTON,
+                                            890, 10, 90, 24, (HMENU)ID_ACCESS_UPDATE_BTN, 0);
+ 
+     // Table of the vhosts
+     access_dialog.hEdit = create_control(access_dialog.hDlg, "EDIT", "",
+                                          WS_CHILD | WS_VISIBLE | WS_VSCROLL | WS_HSCROLL |
+                                              ES_MULTILINE | ES_AUTOHSCROLL | ES_AUTOVSCROLL | ES_READONLY,
+                                          10, 45, 970, 565, (HMENU)ID_ACCESS_EDIT, WS_EX_CLIENTEDGE);
+ 
+     // Set a monospaced font so the columns line up
+     access_dialog.hFont = CreateFont(16, 0, 0, 0, FW_NORMAL, FALSE, FALSE, FALSE,
+                                      DEFAULT_CHARSET, OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS,
+                                      DEFAULT_QUALITY, FIXED_PITCH | FF_MODERN, "Consolas");
+     SendMessage(access_dialog.hEdit, WM_SETFONT, (WPARAM)access_dialog.hFont, TRUE);
+ 
+     create_control(access_dialog.hDlg, "BUTTON", "Close",
+                    WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_PUSHBUTTON,
+                    10, 620, 100, 30, (HMENU)ID_ACCESS_CLOSE_BTN, 0);
+ 
+     access_dialog.hStatus = create_control(access_dialog.hDlg, "STATIC", "",
+                                            WS_CHILD | WS_VISIBLE, 130, 627, 850, 20, (HMENU)ID_ACCESS_STATUS, 0);
+ 
+     // Set icon
+     HICON hIcon = LoadIcon(NULL, IDI_APPLICATION);
+     SendMessage(access_dialog.hDlg, WM_SETICON, ICON_BIG, (LPARAM)hIcon);
+     SendMessage(access_dialog.hDlg, WM_SETICON, ICON_SMALL, (LPARAM)hIcon);
+ 
+     // Show window
+     ShowWindow(access_dialog.hDlg, SW_SHOW);
+     UpdateWindow(access_dialog.hDlg);
+ 
+     start_update();
+ }
+ 
+ /**
+  * Start bringing the statistics up to date in the background
+  */
+ static void start_update(void)
+ {
+     char format[ACCESS_FORMAT_MAX];
+     char error[128];
+     char message[256];
+     AccessJob *job;
+ 
+     if (!access_dialog.stats)
+         access_dialog.stats = access_stats_create();
+     job = (AccessJob *)calloc(1, sizeof(AccessJob));
+     if (job)
+         job->files = (char (*)[MAX_PATH_LEN])malloc(ACCESS_STATS_MAX_LOGS * MAX_PATH_LEN);
+     if (!access_dialog.stats || !job || !job->files)
+     {
+         free_job(job);
+         SetWindowText(access_dialog.hStatus, "Memory allocation failed.");
+         return;
+     }
+ 
+     GetWindowText(access_dialog.hFormat, format, sizeof(format));
+     job->format = access_format_compile(format, error, sizeof(error));
+     if (!job->format)
+     {
+         free_job(job);
+         snprintf(message, sizeof(message), "Invalid log format: %s", error);
+         SetWindowText(access_dialog.hStatus, message);
+         return;
+     }
+     save_setting_text(ACCESS_FORMAT_SETTING, format);
+ 
+     access_dialog.job = job;
+     access_dialog.hThread = CreateThread(NULL, 0, update_thread, job, 0, NULL);
+     if (!access_dialog.hThread)
+     {
+         access_dialog.job = NULL;
+         free_job(job);
+         SetWindowText(access_dialog.hStatus, "Failed to start the update.");
+         return;
+     }
+ 
+     SetWindowText(access_dialog.hStatus, "Reading access logs...");
+     SetWindowText(access_dialog.hUpdate, "Stop");
+ }
+ 
+ /**
+  * Stop a running update and wait for its thread
+  */
+ static void stop_update(void)
+ {
+     if (!access_dialog.hThread)
+         return;
+ 
+     InterlockedExchange(&access_dialog.job->cancelled, 1);
+     WaitForSingleObject(access_dialog.hThread, INFINITE);
+     CloseHandle(access_dialog.hThread);
+     access_dialog.hThread = NULL;
+ }
+ 
+ /**
+  * Show the table of the vhosts and the work the finished update took
+  */
+ static void show_stats(void)
+ {
+     AccessJob *job = access_dialog.job;
+     const AccessVhost *vhosts;
+     size_t count;
+     size_t used;
+     char *text;
+     char status[384];
+     int length;
+ 
+     if (job->file_count == 0)
+     {
+         snprintf(status, sizeof(status), "No access logs found in %s", access_dialog.log_dir);
+         SetWindowText(access_dialog.hStatus, status);
+         return;
+     }
+ 
+     // A stopped update leaves the statistics as they were
+     if (job->completed)
+         access_dialog.timed = access_format_timed(job->format);
+ 
+     vhosts = access_stats_vhosts(access_dialog.stats, &count);
+     text = (char *)malloc((count + 2) * ACCESS_ROW_SIZE);
+     if (!text)
+     {
+         SetWindowText(access_dialog.hStatus, "Memory allocation failed.");
+         return;
+     }
+ 
+     used = (size_t)snprintf(text, ACCESS_ROW_SIZE, "%-28s %10s %9s %6s %6s %6s %6s %10s %9s %9s %9s\r\n",
+                             "Vhost", "Requests", "Req/min", "2xx", "3xx", "4xx", "5xx", "MB", "p50", "p95", "p99");
+     for (size_t i = 0; i < count; i++)
+     {
+         const AccessVhost *vhost = &vhosts[i];
+         double share[6];
+         char rate[16];
+         char p50[16], p95[16], p99[16];
+         int written;
+ 
+         for (int c = 2; c <= 5; c++)
+             share[c] = vhost->requests ? vhost->status[c] * 100.0 / vhost->requests : 0.0;
+ 
+         // Average over the logged span (FILETIME counts 100 ns)
+         if (vhost->last > vhost->first)
+             snprintf(rate, sizeof(rate), "%.1f", vhost->requests * 600000000.0 / (double)(vhost->last - vhost->first));
+         else
+             strcpy(rate, "-");
+ 
+         format_time(p50, sizeof(p50), &vhost->times, 50.0);
+         format_time(p95, sizeof(p95), &vhost->times, 95.0);
+         format_time(p99, sizeof(p99), &vhost->times, 99.0);
+ 
+         written = snprintf(text + used, ACCESS_ROW_SIZE,
+                            "%-28.28s %10llu %9s %5.1f%% %5.1f%% %5.1f%% %5.1f%% %10.1f %9s %9s %9s\r\n",
+                            vhost->name, vhost->requests, rate, share[2], share[3], share[4], share[5],
+                            vhost->bytes / (1024.0 * 1024.0), p50, p95, p99);
+         if (written > 0)
+             used += (size_t)written < ACCESS_ROW_SIZE ? (size_t)written : ACCESS_ROW_SIZE - 1;
+     }
+     SetWindowText(access_dialog.hEdit, count ? text : "No requests logged.");
+     free(text);
+ 
+     length = snprintf(status, sizeof(status),
+                       "%d vhosts in %d logs, %llu lines (%llu unparsed) read in %llu ms on %d threads", (int)count,
+                       job->update.logs, job->update.lines, job->update.unparsed, job->update.elapsed_us / 1000,
+                       job->update.threads);
+     if (!job->completed && length > 0 && (size_t)length < sizeof(status))
+         length += snprintf(status + length, sizeof(status) - length, " (stopped)");
+ 
+     // The default combined formats log no request time
+     if (!access_dialog.timed && count > 0 && length > 0 && (size_t)length < sizeof(status))
+         snprintf(status + length, sizeof(status) - length, "; log %s for the percentiles",
+                  access_dialog.nginx ? "$request_time" : "%D");
+     SetWindowText(access_dialog.hStatus, status);
+ }
+ 
+ /**
+  * Update thread: find the access logs and parse what was added to them
+  */
+ static DWORD WINAPI update_thread(LPVOID param)
+ {
+     AccessJob *job = (AccessJob *)param;
+     HWND hDlg = access_dialog.hDlg;
+     const char *paths[ACCESS_STATS_MAX_LOGS];
+ 
+     collect_access_logs(job);
+     for (int i = 0; i < job->file_count; i++)
+         paths[i] = job->files[i];
+ 
+     if (job->file_count > 0)
+         job->completed = access_stats_update(access_dialog.stats, paths, job->file_count, job->format,
+                                              &job->cancelled, &job->update);
+ 
+     PostMessage(hDlg, WM_ACCESS_DONE, 0, 0);
+     return 0;
+ }
+ 
+ /**
+  * Add the access logs of the web server to the job
+  */
+ static void collect_access_logs(AccessJob *job)
+ {
+     char pattern[MAX_PATH_LEN];
+     WIN32_FIND_DATA fd;
+     HANDLE hFind;
+ 
+     snprintf(pattern, sizeof(pattern), "%s\\*", access_dialog.log_dir);
+     hFind = FindFirstFile(pattern, &fd);
+     if (hFind == INVALID_HANDLE_VALUE)
+         return;
+ 
+     do
+     {
+         if ((fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) || !is_access_log(fd.cFileName))
+             continue;
+         if (job->file_count >= ACCESS_STATS_MAX_LOGS || job->cancelled)
+             break;
+ 
+         snprintf(job->files[job->file_count++], MAX_PATH_LEN, "%s\\%s", access_dialog.log_dir, fd.cFileName);
+     } while (FindNextFile(hFind, &fd));
+ 
+     FindClose(hFind);
+ }
+ 
+ /**
+  * Check whether a file is an access log being written; its rotated copies
+  * are read with it, indexes and seek points are skipped
+  */
+ static BOOL is_access_log(const char *name)
+ {
+     char lower[MAX_PATH_LEN];
+     size_t i;
+ 
+     for (i = 0; name[i] && i < sizeof(lower) - 1; i++)
+         lower[i] = (char)tolower((unsigned char)name[i]);
+     lower[i] = '\0';
+     return strstr(lower, "access") && log_reader_is_log(name, FALSE);
+ }
+ 
+ /**
+  * Format a request time percentile as milliseconds or seconds, "-" without times
+  */
+ static void format_time(char *buffer, size_t size, const AccessHistogram *times, double percent)
+ {
+     ULONGLONG us;
+ 
+     if (times->count == 0)
+     {
+         snprintf(buffer, size, "-");
+         return;
+     }
+ 
+     us = access_histogram_percentile(times, percent);
+     if (us < 1000000)
+         snprintf(buffer, size, "%.1f ms", us / 1000.0);
+     else
+         snprintf(buffer, size, "%.2f s", us / 1000000.0);
+ }
+ 
+ /**
+  * Free an update job
+  */
+ static void free_job(AccessJob *job)
+ {
+     if (!job)
+         return;
+ 
+     access_format_free(job->format);
+     free(job->files);
+     free(job);
+ }
+ 
+ /**
+  * Access statistics dialog window procedure
+  */
+ static LRESULT CALLBACK AccessDialogProc(HWND hwnd, UINT msg, WPARAM wp, LPARAM lp)
+ {
+     switch (msg)
+     {
+     case WM_COMMAND:
+         switch (LOWORD(wp))
+         {
+         case ID_ACCESS_UPDATE_BTN:
+             // The button stops a running update
+             if (access_dialog.hThread)
+                 InterlockedExchange(&access_dialog.job->cancelled, 1);
+             else
+             {
+                 free_job(access_dialog.job);
+                 access_dialog.job = NULL;
+                 start_update();
+             }
+             break;
+         case ID_ACCESS_AUTO:
+             if (SendMessage(access_dialog.hAuto, BM_GETCHECK, 0, 0) == BST_CHECKED)
+                 SetTimer(hwnd, ID_ACCESS_TIMER, ACCESS_AUTO_UPDATE_SECONDS * 1000, NULL);
+             else
+                 KillTimer(hwnd, ID_ACCESS_TIMER);
+             break;
+         case ID_ACCESS_CLOSE_BTN:
+             DestroyWindow(hwnd);
+             break;
+         }
+         break;
+ 
+     case WM_TIMER:
+         // An update still running is left to finish
+         if (wp == ID_ACCESS_TIMER && !access_dialog.hThread)
+         {
+             free_job(access_dialog.job);
+             access_dialog.job = NULL;
+             start_update();
+         }
+         break;
+ 
+     case WM_ACCESS_DONE:
+         if (access_dialog.hThread)
+         {
+             stop_update();
+             show_stats();
+             SetWindowText(access_dialog.hUpdate, "Update");
+         }
+         break;
+ 
+     case WM_SIZE:
+         if (access_dialog.hEdit)
+         {
+             RECT rcClient;
+             GetClientRect(hwnd, &rcClient);
+ 
+             // Resize the table to fit the window
+             SetWindowPos(access_dialog.hEdit, NULL,
+                          10, 45, rcClient.right - 20, rcClient.bottom - 100, SWP_NOZORDER);
+ 
+             // Keep the update button on the right
+             SetWindowPos(access_dialog.hUpdate, NULL,
+                          rcClient.right - 100, 10, 90, 24, SWP_NOZORDER);
+ 
+             // Reposition the close button and status at the bottom
+             SetWindowPos(GetDlgItem(hwnd, ID_ACCESS_CLOSE_BTN), NULL,
+                          10, rcClient.bottom - 40, 100, 30, SWP_NOZORDER);
+             SetWindowPos(access_dialog.hStatus, NULL,
+                          130, rcClient.bottom - 33, rcClient.right - 140, 20, SWP_NOZORDER);
+         }
+         break;
+ 
+     case WM_CLOSE:
+         DestroyWindow(hwnd);
+         break;
+ 
+     case WM_DESTROY:
+         KillTimer(hwnd, ID_ACCESS_TIMER);
+         stop_update();
+         free_job(access_dialog.job);
+         access_dialog.job = NULL;
+         access_stats_free(access_dialog.stats);
+         access_dialog.stats = NULL;
+         access_dialog.timed = FALSE;
+         if (access_dialog.hFont)
+             DeleteObject(access_dialog.hFont);
+         access_dialog.hFont = NULL;
+         access_dialog.hDlg = access_dialog.hFormat = access_dialog.hUpdate = access_dialog.hAuto = NULL;
+         access_dialog.hEdit = access_dialog.hStatus = NULL;
+         break;
+ 
+     default:
+         return DefWindowProc(hwnd, msg, wp, lp);
+     }
+     return 0;
+ }
\ No newline at end of file
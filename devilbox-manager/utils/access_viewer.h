@@ -0,0 +1,47 @@
+/*******************************************************************************
+ * Access Viewer Module Header
+ * Per-vhost request statistics from the access logs of the web server
+ *******************************************************************************/
+#ifndef ACCESS_VIEWER_H
+#define ACCESS_VIEWER_H
+
+#include <windows.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Maximum path length constant (if not already defined)
+#ifndef MAX_PATH_LEN
+#define MAX_PATH_LEN 260
+#endif
+
+// Seconds between updates when auto-update is on
+#define ACCESS_AUTO_UPDATE_SECONDS 5
+
+// Access statistics dialog control IDs
+enum
+{
+    ID_ACCESS_FORMAT = 400,
+    ID_ACCESS_UPDATE_BTN,
+    ID_ACCESS_AUTO,
+    ID_ACCESS_EDIT,
+    ID_ACCESS_CLOSE_BTN,
+    ID_ACCESS_STATUS,
+    ID_ACCESS_TIMER
+};
+
+/**
+ * Display the access statistics dialog. The access logs are looked up in
+ * the log directory of the web server; the log format is kept with the
+ * settings.
+ * @param app_path Base path of the Devilbox installation
+ * @param httpd_version HTTPD_SERVER of .env (e.g. "nginx-stable")
+ */
+void show_access_stats(const char *app_path, const char *httpd_version);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ACCESS_VIEWER_H */
\ No newline at end of file
@@ -0,0 +1,656 @@
+/*******************************************************************************
+ * Archive Writer Module Implementation
+ * Tar stream producer, parallel deflate workers and an in-order gzip writer
+ *******************************************************************************/
+
+ #include "archive_writer.h"
+ #include "deflate.h"
+ #include <stdio.h>
+ #include <string.h>
+ #include <stdlib.h>
+ 
+ #define TAR_RECORD 512
+ 
+ // Block size limits, halved from the maximum until the memory ceiling fits
+ #define MAX_BLOCK_SIZE (1024 * 1024)
+ #define MIN_BLOCK_SIZE (64 * 1024)
+ 
+ // Approximate compressor state per thread (hash tables and symbol buffer)
+ #define WORKER_MEMORY (320 * 1024)
+ 
+ // Read size when a file's data is larger than the free space of the block
+ #define FILE_READ_CHUNK (256 * 1024)
+ 
+ // Seconds between 1601-01-01 (FILETIME) and 1970-01-01 (tar)
+ #define UNIX_EPOCH_OFFSET 11644473600LL
+ 
+ // One block of the tar stream
+ typedef struct
+ {
+     BYTE *input;        // DEFLATE_WINDOW bytes of dictionary, then the block data
+     size_t dict_len;
+     size_t len;
+     BYTE *output;       // Compressed block
+     size_t out_len;
+     size_t out_capacity;
+     DWORD crc;          // CRC-32 of the block data
+     BOOL final;
+     BOOL failed;
+     HANDLE done;        // Set when the block is compressed
+ } ArchiveBlock;
+ 
+ struct ArchiveWriter
+ {
+     char path[MAX_PATH_LEN];
+     char temp_path[MAX_PATH_LEN];
+     HANDLE file;
+     int level;
+ 
+     // Block ring: the producer fills block N in slot N % slot_count
+     ArchiveBlock *slots;
+     int slot_count;
+     size_t block_size;
+     HANDLE free_slots;          // Semaphore: slots the producer may fill
+     HANDLE queued;              // Semaphore: blocks waiting for a worker
+     volatile LONG next_block;   // Next block a worker takes
+     volatile LONG block_count;  // Total number of blocks, known at close
+     LONG fill_block;            // Block being filled
+     ArchiveBlock *current;
+ 
+     HANDLE *workers;
+     int worker_count;
+     HANDLE writer;
+ 
+     volatile LONG failed;
+     DWORD error;
+ 
+     // Statistics
+     DWORD crc;
+     volatile LONGLONG bytes_in;
+     volatile LONGLONG bytes_out;
+     volatile LONGLONG files;
+ };
+ 
+ /**
+  * Record the first error of the archive
+  */
+ static void set_failed(ArchiveWriter *archive, DWORD error)
+ {
+     if (InterlockedExchange(&archive->failed, 1) == 0)
+         archive->error = error;
+ }
+ 
+ /**
+  * Compression worker: takes queued blocks in sequence order and compresses
+  * them with the preceding data as dictionary
+  */
+ static DWORD WINAPI compress_thread(LPVOID param)
+ {
+     ArchiveWriter *archive = (ArchiveWriter *)param;
+     DeflateWork work;
+     BOOL ready = deflate_work_init(&work);
+ 
+     for (;;)
+     {
+         WaitForSingleObject(archive->queued, INFINITE);
+         LONG index = InterlockedIncrement(&archive->next_block) - 1;
+         if (index >= archive->block_count)
+             break;
+ 
+         ArchiveBlock *block = &archive->slots[index % archive->slot_count];
+         block->failed = TRUE;
+         if (ready)
+         {
+             // Compress straight into the block's output buffer
+             work.out = block->output;
+             work.out_capacity = block->out_capacity;
+             if (deflate_compress(&work, block->input + DEFLATE_WINDOW - block->dict_len, block->dict_len,
+                                  block->len, archive->level, block->final))
+             {
+                 block->output = work.out;
+                 block->out_capacity = work.out_capacity;
+                 block->out_len = work.out_len;
+                 block->crc = deflate_crc32(0, block->input + DEFLATE_WINDOW, block->len);
+                 block->failed = FALSE;
+             }
+             work.out = NULL;
+             work.out_capacity = 0;
+         }
+         SetEvent(block->done);
+     }
+ 
+     if (ready)
+         deflate_work_free(&work);
+     return 0;
+ }
+ 
+ /**
+  * Writer: stores compressed blocks in sequence order and hands their slots
+  * back to the producer
+  */
+ static DWORD WINAPI write_thread(LPVOID param)
+ {
+     ArchiveWriter *archive = (ArchiveWriter *)param;
+     LONG index = 0;
+     BOOL final = FALSE;
+ 
+     while (!final)
+     {
+         ArchiveBlock *block = &archive->slots[index % archive->slot_count];
+         WaitForSingleObject(block->done, INFINITE);
+ 
+         if (block->failed)
+             set_failed(archive, ERROR_NOT_ENOUGH_MEMORY);
+         if (!archive->failed)
+         {
+             DWORD written = 0;
+             if (!WriteFile(archive->file, block->output, (DWORD)block->out_len, &written, NULL) ||
+                 written != block->out_len)
+                 set_failed(archive, GetLastError());
+         }
+         archive->crc = deflate_crc32_combine(archive->crc, block->crc, block->len);
+         archive->bytes_out += block->out_len;
+ 
+         final = block->final;
+         index++;
+         ReleaseSemaphore(archive->free_slots, 1, NULL);
+     }
+     return 0;
+ }
+ 
+ /**
+  * Take the next slot for filling and copy the end of the previous block into
+  * its dictionary area
+  */
+ static void acquire_block(ArchiveWriter *archive)
+ {
+     ArchiveBlock *previous = archive->current;
+ 
+     WaitForSingleObject(archive->free_slots, INFINITE);
+     ArchiveBlock *block = &archive->slots[archive->fill_block % archive->slot_count];
+ 
+     block->dict_len = 0;
+     if (previous)
+     {
+         // The previous block keeps its slot until the writer is done with it
+         size_t available = previous->dict_len + previous->len;
+         block->dict_len = available < DEFLATE_WINDOW ? available : DEFLATE_WINDOW;
+         memcpy(block->input + DEFLATE_WINDOW - block->dict_len,
+                previous->input + DEFLATE_WINDOW + previous->len - block->dict_len, block->dict_len);
+     }
+     block->len = 0;
+     block->out_len = 0;
+     block->final = FALSE;
+     block->failed = FALSE;
+     archive->current = block;
+ }
+ 
+ /**
+  * Queue the current block for compression
+  */
+ static void submit_block(ArchiveWriter *archive, BOOL final)
+ {
+     archive->current->final = final;
+     archive->bytes_in += archive->current->len;
+     archive->fill_block++;
+     ReleaseSemaphore(archive->queued, 1, NULL);
+     if (!final)
+         acquire_block(archive);
+ }
+ 
+ /**
+  * Append data to the tar stream
+  */
+ static void archive_write(ArchiveWriter *archive, const void *data, size_t len)
+ {
+     const BYTE *bytes = (const BYTE *)data;
+ 
+     while (len > 0)
+     {
+         ArchiveBlock *block = archive->current;
+         size_t space = archive->block_size - block->len;
+         size_t part = len < space ? len : space;
+ 
+         if (bytes)
+         {
+             memcpy(block->input + DEFLATE_WINDOW + block->len, bytes, part);
+             bytes += part;
+         }
+         else
+             memset(block->input + DEFLATE_WINDOW + block->len, 0, part);
+         block->len += part;
+         len -= part;
+ 
+         if (block->len == archive->block_size)
+             submit_block(archive, FALSE);
+     }
+ }
+ 
+ /**
+  * Pad the tar stream to the next record boundary
+  */
+ static void archive_pad(ArchiveWriter *archive, ULONGLONG size)
+ {
+     size_t rest = (size_t)(size % TAR_RECORD);
+     if (rest)
+         archive_write(archive, NULL, TAR_RECORD - rest);
+ }
+ 
+ /**
+  * Store a number in a tar header field: octal when it fits, otherwise the
+  * GNU base-256 form
+  */
+ static void put_number(char *field, int width, ULONGLONG value)
+ {
+     if (value >= (1ULL << (3 * (width - 1))))
+     {
+         memset(field, 0, width);
+         field[0] = (char)0x80;
+         for (int i = width - 1; i > 0 && value; i--)
+         {
+             field[i] = (char)(value & 0xFF);
+             value >>= 8;
+         }
+         return;
+     }
+ 
+     char text[24];
+     snprintf(text, sizeof(text), "%0*llo", width - 1, value);
+     memcpy(field, text, width - 1);
+     field[width - 1] = '\0';
+ }
+ 
+ /**
+  * Build a ustar header record
+  */
+ static void build_header(BYTE *header, const char *name, const char *prefix, char type,
+                          ULONGLONG size, LONGLONG mtime)
+ {
+     memset(header, 0, TAR_RECORD);
+     strncpy((char *)header, name, 100);
+     put_number((char *)header + 100, 8, type == '5' ? 0755 : 0644);
+     put_number((char *)header + 108, 8, 0);
+     put_number((char *)header + 116, 8, 0);
+     put_number((char *)header + 124, 12, size);
+     put_number((char *)header + 136, 12, mtime > 0 ? (ULONGLONG)mtime : 0);
+     header[156] = type;
+     memcpy(header + 257, "ustar", 6);
+     memcpy(header + 263, "00", 2);
+     if (prefix)
+         strncpy((char *)header + 345, prefix, 155);
+ 
+     // Checksum is computed with the checksum field set to spaces
+     unsigned int sum = 0;
+     memset(header + 148, ' ', 8);
+     for (int i = 0; i < TAR_RECORD; i++)
+         sum += header[i];
+     char text[8];
+     snprintf(text, sizeof(text), "%06o", sum & 0777777);
+     memcpy(header + 148, text, 7);
+ }
+ 
+ /**
+  * Write the header of a file entry. Names that do not fit the ustar
+  * name/prefix fields get a pax extended header with the full path.
+  */
+ static void write_entry_header(ArchiveWriter *archive, const char *name, ULONGLONG size, LONGLONG mtime)
+ {
+     BYTE header[TAR_RECORD];
+     size_t name_len = strlen(name);
+ 
+     if (name_len <= 100)
+     {
+         build_header(header, name, NULL, '0', size, mtime);
+         archive_write(archive, header, TAR_RECORD);
+         return;
+     }
+ 
+     // Split at a '/' so the prefix and the name both fit
+     for (const char *slash = strchr(name, '/'); slash; slash = strchr(slash + 1, '/'))
+     {
+         size_t prefix_len = slash - name;
+         if (prefix_len > 155)
+             break;
+         if (name_len - prefix_len - 1 <= 100 && name_len - prefix_len - 1 > 0)
+         {
+             char prefix[156];
+             memcpy(prefix, name, prefix_len);
+             prefix[prefix_len] = '\0';
+             build_header(header, slash + 1, prefix, '0', size, mtime);
+             archive_write(archive, header, TAR_RECORD);
+             return;
+         }
+     }
+ 
+     // pax record "<length> path=<name>\n", the length counts its own digits
+     size_t body = strlen(" path=") + name_len + 1;
+     size_t record = body + 1;
+     while (record != body + snprintf(NULL, 0, "%lu", (unsigned long)record))
+         record = body + snprintf(NULL, 0, "%lu", (unsigned long)record);
+ 
+     char *pax = (char *)malloc(record + 1);
+     if (!pax)
+     {
+         set_failed(archive, ERROR_NOT_ENOUGH_MEMORY);
+         return;
+     }
+     snprintf(pax, record + 1, "%lu path=%s\n", (unsigned long)record, name);
+ 
+     build_header(header, "././@PaxHeader", NULL, 'x', record, mtime);
+     archive_write(archive, header, TAR_RECORD);
+     archive_write(archive, pax, record);
+     archive_pad(archive, record);
+     free(pax);
+ 
+     // The regular header keeps the tail of the name for readers without pax
+     build_header(header, name + name_len - 100, NULL, '0', size, mtime);
+     archive_write(archive, header, TAR_RECORD);
+ }
+ 
+ /**
+  * Pick the thread count, block size and number of blocks in flight that fit
+  * the memory ceiling
+  */
+ static void plan_memory(ArchiveWriter *archive, int threads, int memory_mb)
+ {
+     LONGLONG budget = (LONGLONG)memory_mb * 1024 * 1024;
+     size_t block_size = MAX_BLOCK_SIZE;
+     int slots;
+ 
+     // Each thread needs its compressor state and at least one block
+     for (;;)
+     {
+         LONGLONG per_slot = DEFLATE_WINDOW + block_size + deflate_bound(block_size);
+         LONGLONG left = budget - (LONGLONG)threads * WORKER_MEMORY;
+ 
+         // Two blocks per thread keep the workers busy while the writer drains
+         slots = threads * 2 + 2;
+         while (slots > threads + 1 && (LONGLONG)slots * per_slot > left)
+             slots--;
+         if ((LONGLONG)slots * per_slot <= left)
+             break;
+ 
+         if (block_size > MIN_BLOCK_SIZE)
+             block_size /= 2;
+         else if (threads > 1)
+             threads--;
+         else
+             break;
+     }
+ 
+     archive->worker_count = threads;
+     archive->slot_count = slots;
+     archive->block_size = block_size;
+ }
+ 
+ /**
+  * Release the slots of an archive
+  */
+ static void free_slots(ArchiveWriter *archive)
+ {
+     if (!archive->slots)
+         return;
+     for (int i = 0; i < archive->slot_count; i++)
+     {
+         free(archive->slots[i].input);
+         free(archive->slots[i].output);
+         if (archive->slots[i].done)
+             CloseHandle(archive->slots[i].done);
+     }
+     free(archive->slots);
+     archive->slots = NULL;
+ }
+ 
+ ArchiveWriter *archive_open(const char *path, const ArchiveOptions *options)
+ {
+     ArchiveWriter *archive = (ArchiveWriter *)calloc(1, sizeof(ArchiveWriter));
+     if (!archive)
+         return NULL;
+ 
+     int threads = options->threads;
+     if (threads <= 0)
+     {
+         SYSTEM_INFO info;
+         GetSystemInfo(&info);
+         threads = (int)info.dwNumberOfProcessors;
+     }
+     if (threads < 1)
+         threads = 1;
+     if (threads > ARCHIVE_MAX_THREADS)
+         threads = ARCHIVE_MAX_THREADS;
+ 
+     archive->level = options->level < 1 ? 1 : options->level > 9 ? 9 : options->level;
+     archive->block_count = MAXLONG;
+     plan_memory(archive, threads, options->memory_mb > 0 ? options->memory_mb : ARCHIVE_DEFAULT_MEMORY_MB);
+ 
+     strncpy(archive->path, path, MAX_PATH_LEN - 1);
+     snprintf(archive->temp_path, MAX_PATH_LEN, "%s.tmp", path);
+     archive->file = CreateFile(archive->temp_path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                                FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+     if (archive->file == INVALID_HANDLE_VALUE)
+     {
+         free(archive);
+         return NULL;
+     }
+ 
+     archive->slots = (ArchiveBlock *)calloc(archive->slot_count, sizeof(ArchiveBlock));
+     BOOL ok = archive->slots != NULL;
+     for (int i = 0; ok && i < archive->slot_count; i++)
+     {
+         ArchiveBlock *block = &archive->slots[i];
+         block->out_capacity = deflate_bound(archive->block_size);
+         block->input = (BYTE *)malloc(DEFLATE_WINDOW + archive->block_size);
+         block->output = (BYTE *)malloc(block->out_capacity);
+         block->done = CreateEvent(NULL, FALSE, FALSE, NULL);
+         ok = block->input && block->output && block->done;
+     }
+ 
+     archive->free_slots = CreateSemaphore(NULL, archive->slot_count, archive->slot_count, NULL);
+     archive->queued = CreateSemaphore(NULL, 0, MAXLONG, NULL);
+     archive->workers = (HANDLE *)calloc(archive->worker_count, sizeof(HANDLE));
+     ok = ok && archive->free_slots && archive->queued && archive->workers;
+ 
+     // gzip member header: deflate, no flags, mtime 0, unknown OS
+     static const BYTE gzip_header[10] = {0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff};
+     DWORD written = 0;
+     ok = ok && WriteFile(archive->file, gzip_header, sizeof(gzip_header), &written, NULL) &&
+          written == sizeof(gzip_header);
+     archive->bytes_out = sizeof(gzip_header);
+ 
+     if (ok)
+         archive->writer = CreateThread(NULL, 0, write_thread, archive, 0, NULL);
+     ok = ok && archive->writer;
+ 
+     int started = 0;
+     while (ok && started < archive->worker_count)
+     {
+         archive->workers[started] = CreateThread(NULL, 0, compress_thread, archive, 0, NULL);
+         if (!archive->workers[started])
+             break;
+         started++;
+     }
+     if (ok && started == 0)
+         ok = FALSE;
+ 
+     if (!ok)
+     {
+         // Threads that did start stop at the first block when block_count is 0
+         archive->block_count = 0;
+         if (archive->queued && started > 0)
+             ReleaseSemaphore(archive->queued, started, NULL);
+         if (started > 0)
+             WaitForMultipleObjects(started, archive->workers, TRUE, INFINITE);
+         for (int i = 0; i < started; i++)
+             CloseHandle(archive->workers[i]);
+         if (archive->writer)
+         {
+             // Unblock the writer with an empty final block
+             archive->slots[0].final = TRUE;
+             archive->slots[0].failed = TRUE;
+             SetEvent(archive->slots[0].done);
+             WaitForSingleObject(archive->writer, INFINITE);
+             CloseHandle(archive->writer);
+         }
+         free(archive->workers);
+         if (archive->free_slots)
+             CloseHandle(archive->free_slots);
+         if (archive->queued)
+             CloseHandle(archive->queued);
+         free_slots(archive);
+         CloseHandle(archive->file);
+         DeleteFile(archive->temp_path);
+         free(archive);
+         return NULL;
+     }
+ 
+     // Fewer threads than planned still work, the ring just has spare slots
+     archive->worker_count = started;
+     acquire_block(archive);
+     return archive;
+ }
+ 
+ BOOL archive_add_file(ArchiveWriter *archive, const char *file, const char *name, char *status_message)
+ {
+     WIN32_FILE_ATTRIBUTE_DATA data;
+     if (!GetFileAttributesEx(file, GetFileExInfoStandard, &data))
+     {
+         if (status_message)
+             sprintf(status_message, "Cannot read attributes: %s", file);
+         return FALSE;
+     }
+ 
+     HANDLE handle = CreateFile(file, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+                                FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+     if (handle == INVALID_HANDLE_VALUE)
+     {
+         if (status_message)
+             sprintf(status_message, "Cannot open: %s", file);
+         return FALSE;
+     }
+ 
+     ULONGLONG size = ((ULONGLONG)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+     ULARGE_INTEGER time;
+     time.LowPart = data.ftLastWriteTime.dwLowDateTime;
+     time.HighPart = data.ftLastWriteTime.dwHighDateTime;
+     LONGLONG mtime = (LONGLONG)(time.QuadPart / 10000000) - UNIX_EPOCH_OFFSET;
+ 
+     // tar names use forward slashes
+     char tar_name[MAX_PATH_LEN];
+     strncpy(tar_name, name, MAX_PATH_LEN - 1);
+     tar_name[MAX_PATH_LEN - 1] = '\0';
+     for (char *p = tar_name; *p; p++)
+         if (*p == '\\')
+             *p = '/';
+ 
+     write_entry_header(archive, tar_name, size, mtime);
+ 
+     // Read straight into the block buffers; the header promised exactly size bytes
+     ULONGLONG remaining = size;
+     BOOL truncated = FALSE;
+     while (remaining > 0 && !archive->failed)
+     {
+         ArchiveBlock *block = archive->current;
+         size_t space = archive->block_size - block->len;
+         DWORD want = (DWORD)(remaining < space ? remaining : space);
+         if (want > FILE_READ_CHUNK)
+             want = FILE_READ_CHUNK;
+ 
+         DWORD got = 0;
+         if (!ReadFile(handle, block->input + DEFLATE_WINDOW + block->len, want, &got, NULL) || got == 0)
+         {
+             // File shrank or became unreadable: keep the archive consistent
+             truncated = TRUE;
+             archive_write(archive, NULL, (size_t)remaining);
+             break;
+         }
+         block->len += got;
+         remaining -= got;
+         if (block->len == archive->block_size)
+             submit_block(archive, FALSE);
+     }
+     CloseHandle(handle);
+     archive_pad(archive, size);
+     archive->files++;
+ 
+     if (status_message)
+     {
+         if (truncated)
+             sprintf(status_message, "Archived (changed while reading, zero padded): %s", file);
+         else
+             sprintf(status_message, "Archived: %s", file);
+     }
+     return !archive->failed;
+ }
+ 
+ void archive_get_stats(ArchiveWriter *archive, ArchiveStats *stats)
+ {
+     stats->files = archive->files;
+     stats->bytes_in = archive->bytes_in + (archive->current ? archive->current->len : 0);
+     stats->bytes_out = archive->bytes_out;
+     stats->threads = archive->worker_count;
+     stats->blocks = archive->slot_count;
+     stats->block_size = (DWORD)archive->block_size;
+     stats->memory = (LONGLONG)archive->worker_count * WORKER_MEMORY +
+                     (LONGLONG)archive->slot_count *
+                         (DEFLATE_WINDOW + archive->block_size + deflate_bound(archive->block_size));
+ }
+ 
+ void archive_cancel(ArchiveWriter *archive)
+ {
+     set_failed(archive, ERROR_CANCELLED);
+ }
+ 
+ BOOL archive_close(ArchiveWriter *archive, ArchiveStats *stats)
+ {
+     // End of archive: two zero records, then the final block
+     archive_write(archive, NULL, 2 * TAR_RECORD);
+     submit_block(archive, TRUE);
+ 
+     // Workers past the last block stop
+     archive->block_count = archive->fill_block;
+     ReleaseSemaphore(archive->queued, archive->worker_count, NULL);
+     WaitForMultipleObjects(archive->worker_count, archive->workers, TRUE, INFINITE);
+     WaitForSingleObject(archive->writer, INFINITE);
+ 
+     // gzip trailer: CRC-32 and length modulo 2^32, little endian
+     if (!archive->failed)
+     {
+         ULONGLONG total = archive->bytes_in;
+         BYTE trailer[8];
+         for (int i = 0; i < 4; i++)
+         {
+             trailer[i] = (BYTE)(archive->crc >> (8 * i));
+             trailer[4 + i] = (BYTE)(total >> (8 * i));
+         }
+         DWORD written = 0;
+         if (!WriteFile(archive->file, trailer, sizeof(trailer), &written, NULL) || written != sizeof(trailer))
+             set_failed(archive, GetLastError());
+         archive->bytes_out += sizeof(trailer);
+     }
+ 
+     if (stats)
+     {
+         archive->current = NULL;
+         archive_get_stats(archive, stats);
+     }
+ 
+     for (int i = 0; i < archive->worker_count; i++)
+         CloseHandle(archive->workers[i]);
+     CloseHandle(archive->writer);
+     CloseHandle(archive->free_slots);
+     CloseHandle(archive->queued);
+     free(archive->workers);
+     free_slots(archive);
+ 
+     if (!archive->failed && !FlushFileBuffers(archive->file))
+         set_failed(archive, GetLastError());
+     CloseHandle(archive->file);
+ 
+     BOOL ok = !archive->failed;
+     if (ok && !MoveFileEx(archive->temp_path, archive->path, MOVEFILE_REPLACE_EXISTING))
+         ok = FALSE;
+     if (!ok)
+         DeleteFile(archive->temp_path);
+     free(archive);
+     return ok;
+ }
\ No newline at end of file
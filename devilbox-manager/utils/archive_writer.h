@@ -0,0 +1,96 @@
+/*******************************************************************************
+ * Archive Writer Module Header
+ * Streams files into a single .tar.gz: the caller appends tar entries, the
+ * stream is cut into blocks that a pool of threads compresses in parallel
+ * and a writer thread stores them in order with one sequential file write
+ *******************************************************************************/
+#ifndef ARCHIVE_WRITER_H
+#define ARCHIVE_WRITER_H
+
+#include <windows.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Maximum path length constant (if not already defined)
+#ifndef MAX_PATH_LEN
+#define MAX_PATH_LEN 260
+#endif
+
+#define ARCHIVE_EXTENSION ".tar.gz"
+
+// Defaults for the backup dialog
+#define ARCHIVE_DEFAULT_LEVEL 6
+#define ARCHIVE_DEFAULT_MEMORY_MB 64
+#define ARCHIVE_MAX_THREADS 32
+
+// Archive settings
+typedef struct
+{
+    int level;      // gzip level 1 (fastest) - 9 (best)
+    int threads;    // Compression threads, 0 for one per CPU
+    int memory_mb;  // Ceiling for buffered blocks and compressor state
+} ArchiveOptions;
+
+// Archive statistics
+typedef struct
+{
+    LONGLONG files;
+    LONGLONG bytes_in;     // Uncompressed tar stream
+    LONGLONG bytes_out;    // Compressed bytes written
+    int threads;
+    int blocks;            // Blocks buffered at most (in flight)
+    DWORD block_size;
+    LONGLONG memory;       // Memory used by blocks and compressors
+} ArchiveStats;
+
+// Archive being written (opaque)
+typedef struct ArchiveWriter ArchiveWriter;
+
+/**
+ * Create an archive and start the compression threads
+ * @param path Archive file to create
+ * @param options Compression settings
+ * @return Archive, NULL if the file or the threads cannot be created
+ */
+ArchiveWriter *archive_open(const char *path, const ArchiveOptions *options);
+
+/**
+ * Append a file to the archive (call from one thread only)
+ * @param archive Archive
+ * @param file Full path of the file
+ * @param name Name inside the archive (relative path)
+ * @param status_message Receives a status or error message (may be NULL)
+ * @return TRUE if the file was added
+ */
+BOOL archive_add_file(ArchiveWriter *archive, const char *file, const char *name, char *status_message);
+
+/**
+ * Get the statistics of an archive being written
+ * @param archive Archive
+ * @param stats Receives the statistics
+ */
+void archive_get_stats(ArchiveWriter *archive, ArchiveStats *stats);
+
+/**
+ * Abandon the archive: files being added stop early and archive_close
+ * deletes the partial output
+ * @param archive Archive
+ */
+void archive_cancel(ArchiveWriter *archive);
+
+/**
+ * Finish the archive, wait for the threads and release it. A failed archive
+ * is deleted, a complete one is renamed from its temporary name.
+ * @param archive Archive
+ * @param stats Receives the final statistics (may be NULL)
+ * @return TRUE if the archive is complete
+ */
+BOOL archive_close(ArchiveWriter *archive, ArchiveStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ARCHIVE_WRITER_H */
\ No newline at end of file
@@ -0,0 +1,408 @@
+/*******************************************************************************
+ * Async Copy Module Implementation
+ * Completion port copier: one read or write in flight per file, many files
+ *******************************************************************************/
+
+ #include "async_copy.h"
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ 
+ #ifndef MAX_PATH_LEN
+ #define MAX_PATH_LEN 260
+ #endif
+ 
+ // Completions collected per call of GetQueuedCompletionStatusEx
+ #define ASYNC_COPY_BATCH 64
+ 
+ // Declarations missing from older MinGW headers
+ #ifndef FILE_SKIP_COMPLETION_PORT_ON_SUCCESS
+ #define FILE_SKIP_COMPLETION_PORT_ON_SUCCESS 0x1
+ #endif
+ #ifndef FILE_SKIP_SET_EVENT_ON_HANDLE
+ #define FILE_SKIP_SET_EVENT_ON_HANDLE 0x2
+ #endif
+ #ifndef ERROR_REQUEST_ABORTED
+ #define ERROR_REQUEST_ABORTED 1235L
+ #endif
+ 
+ // Completion of GetQueuedCompletionStatusEx (OVERLAPPED_ENTRY)
+ typedef struct
+ {
+     ULONG_PTR key;
+     LPOVERLAPPED overlapped;
+     ULONG_PTR internal;
+     DWORD bytes;
+ } AsyncEntry;
+ 
+ // Vista and later, looked up at run time so the program still starts on XP
+ typedef BOOL (WINAPI *GetQueuedCompletionStatusExFunc)(HANDLE, AsyncEntry *, ULONG, PULONG, DWORD, BOOL);
+ typedef BOOL (WINAPI *SetFileCompletionNotificationModesFunc)(HANDLE, UCHAR);
+ 
+ // Operation a file in flight waits for
+ enum
+ {
+     ASYNC_READ,
+     ASYNC_WRITE
+ };
+ 
+ // File in flight
+ typedef struct
+ {
+     OVERLAPPED overlapped;
+     HANDLE in;
+     HANDLE out;
+     BYTE *buffer;           // ASYNC_COPY_CHUNK bytes of the copier buffers
+     ULONGLONG size;         // Size when the copy started
+     ULONGLONG offset;       // Bytes written so far
+     DWORD length;           // Bytes of the last read, written next
+     int operation;          // ASYNC_READ or ASYNC_WRITE
+     BOOL skip_on_success;   // Reads and writes that complete right away post no completion
+     FILETIME creation_time;
+     FILETIME access_time;
+     FILETIME write_time;
+     FastCopyOptions options;
+     AsyncCopyDone done;
+     void *tag;
+     char target[MAX_PATH_LEN];
+ } AsyncSlot;
+ 
+ struct AsyncCopier
+ {
+     HANDLE port;
+     BYTE *buffers;
+     AsyncSlot *slots;
+     AsyncSlot **free_slots;
+     int free_count;
+     int window;
+     int active;
+     LARGE_INTEGER busy_since;   // Copies overlap, the time the window is busy is counted once
+     GetQueuedCompletionStatusExFunc get_completions;
+     SetFileCompletionNotificationModesFunc set_notification_modes;
+ };
+ 
+ // Forward declarations
+ static void finish_copy(AsyncCopier *copier, AsyncSlot *slot, DWORD error);
+ static void advance_copy(AsyncCopier *copier, AsyncSlot *slot, BOOL ok, DWORD bytes, DWORD error);
+ static BOOL start_operation(AsyncCopier *copier, AsyncSlot *slot, DWORD *bytes, DWORD *error);
+ 
+ /**
+  * Close a finished copy, hand it to the caller and free its place in the window
+  */
+ static void finish_copy(AsyncCopier *copier, AsyncSlot *slot, DWORD error)
+ {
+     FastCopyStats *stats = slot->options.stats;
+     LARGE_INTEGER end, frequency;
+ 
+     // The source may have shrunk since the target was preallocated
+     if (!error)
+     {
+         LARGE_INTEGER length;
+ 
+         length.QuadPart = (LONGLONG)slot->offset;
+         if (!SetFilePointerEx(slot->out, length, NULL, FILE_BEGIN) || !SetEndOfFile(slot->out) ||
+             !SetFileTime(slot->out, &slot->creation_time, &slot->access_time, &slot->write_time))
+             error = GetLastError();
+     }
+ 
+     CloseHandle(slot->out);
+     CloseHandle(slot->in);
+     if (error)
+         DeleteFile(slot->target);
+     else if (stats)
+     {
+         FastCopyCounter *counter = &stats->strategies[FAST_COPY_OVERLAPPED];
+ 
+         QueryPerformanceCounter(&end);
+         QueryPerformanceFrequency(&frequency);
+         InterlockedIncrement64(&counter->files);
+         InterlockedExchangeAdd64(&counter->bytes, (LONGLONG)slot->offset);
+         InterlockedExchangeAdd64(&counter->microseconds,
+                                  (end.QuadPart - copier->busy_since.QuadPart) * 1000000 / frequency.QuadPart);
+         copier->busy_since = end;
+     }
+ 
+     copier->free_slots[copier->free_count++] = slot;
+     copier->active--;
+     slot->done(error ? -1 : FAST_COPY_OVERLAPPED, error, slot->tag);
+ }
+ 
+ /**
+  * Queue the next read or write of a file. Returns TRUE when it completed
+  * right away and no completion will be posted, with its result in bytes and error.
+  */
+ static BOOL start_operation(AsyncCopier *copier, AsyncSlot *slot, DWORD *bytes, DWORD *error)
+ {
+     BOOL ok;
+ 
+     memset(&slot->overlapped, 0, sizeof(slot->overlapped));
+     slot->overlapped.Offset = (DWORD)slot->offset;
+     slot->overlapped.OffsetHigh = (DWORD)(slot->offset >> 32);
+ 
+     if (slot->operation == ASYNC_READ)
+         ok = ReadFile(slot->in, slot->buffer, ASYNC_COPY_CHUNK, NULL, &slot->overlapped);
+     else
+         ok = WriteFile(slot->out, slot->buffer, slot->length, NULL, &slot->overlapped);
+ 
+     *error = ok ? 0 : GetLastError();
+     if (*error == ERROR_IO_PENDING)
+         return FALSE;
+ 
+     // Without FILE_SKIP_COMPLETION_PORT_ON_SUCCESS the port still gets the completion
+     if (ok && !slot->skip_on_success)
+         return FALSE;
+ 
+     *bytes = 0;
+     if (ok && !GetOverlappedResult(slot->operation == ASYNC_READ ? slot->in : slot->out,
+                                    &slot->overlapped, bytes, FALSE))
+         *error = GetLastError();
+     return TRUE;
+ }
+ 
+ /**
+  * Move a copy on after a completed read or write, until it has to wait for the disk
+  */
+ static void advance_copy(AsyncCopier *copier, AsyncSlot *slot, BOOL ok, DWORD bytes, DWORD error)
+ {
+     for (;;)
+     {
+         if (slot->operation == ASYNC_READ)
+         {
+             // End of the file, also when reading past it failed
+             if ((ok && bytes == 0) || (!ok && error == ERROR_HANDLE_EOF))
+             {
+                 finish_copy(copier, slot, 0);
+                 return;
+             }
+             if (!ok)
+             {
+                 finish_copy(copier, slot, error);
+                 return;
+             }
+             slot->length = bytes;
+             slot->operation = ASYNC_WRITE;
+         }
+         else
+         {
+             if (!ok || bytes != slot->length)
+             {
+                 finish_copy(copier, slot, ok ? ERROR_WRITE_FAULT : error);
+                 return;
+             }
+             slot->offset += bytes;
+             if (slot->options.progress && !slot->options.progress(bytes, slot->options.context))
+             {
+                 finish_copy(copier, slot, ERROR_REQUEST_ABORTED);
+                 return;
+             }
+ 
+             // A short read reached the end, one more read would only say so
+             if (bytes < ASYNC_COPY_CHUNK && slot->offset >= slot->size)
+             {
+                 finish_copy(copier, slot, 0);
+                 return;
+             }
+             slot->operation = ASYNC_READ;
+         }
+ 
+         if (!start_operation(copier, slot, &bytes, &error))
+             return;
+         ok = error == 0;
+     }
+ }
+ 
+ AsyncCopier *async_copy_create(int window)
+ {
+     AsyncCopier *copier;
+     HMODULE kernel = GetModuleHandle("kernel32.dll");
+ 
+     if (window < 1 || window > ASYNC_COPY_WINDOW)
+         window = ASYNC_COPY_WINDOW;
+ 
+     copier = (AsyncCopier *)calloc(1, sizeof(AsyncCopier));
+     if (!copier)
+         return NULL;
+ 
+     copier->window = window;
+     copier->port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+     copier->buffers = (BYTE *)VirtualAlloc(NULL, (SIZE_T)window * ASYNC_COPY_CHUNK, MEM_COMMIT | MEM_RESERVE,
+                                            PAGE_READWRITE);
+     copier->slots = (AsyncSlot *)calloc(window, sizeof(AsyncSlot));
+     copier->free_slots = (AsyncSlot **)calloc(window, sizeof(AsyncSlot *));
+     if (!copier->port || !copier->buffers || !copier->slots || !copier->free_slots)
+     {
+         async_copy_free(copier);
+         return NULL;
+     }
+ 
+     for (int i = 0; i < window; i++)
+     {
+         copier->slots[i].buffer = copier->buffers + (SIZE_T)i * ASYNC_COPY_CHUNK;
+         copier->free_slots[copier->free_count++] = &copier->slots[window - 1 - i];
+     }
+ 
+     if (kernel)
+     {
+         copier->get_completions =
+             (GetQueuedCompletionStatusExFunc)GetProcAddress(kernel, "GetQueuedCompletionStatusEx");
+         copier->set_notification_modes =
+             (SetFileCompletionNotificationModesFunc)GetProcAddress(kernel, "SetFileCompletionNotificationModes");
+     }
+     return copier;
+ }
+ 
+ void async_copy_submit(AsyncCopier *copier, const char *source, const char *target,
+                        const FastCopyOptions *options, AsyncCopyDone done, void *tag)
+ {
+     WIN32_FILE_ATTRIBUTE_DATA attr;
+     AsyncSlot *slot;
+     DWORD bytes = 0, error = 0;
+ 
+     while (copier->free_count == 0)
+         async_copy_wait(copier, INFINITE);
+ 
+     if (!GetFileAttributesEx(source, GetFileExInfoStandard, &attr))
+     {
+         done(-1, GetLastError(), tag);
+         return;
+     }
+ 
+     slot = copier->free_slots[--copier->free_count];
+     if (copier->active++ == 0)
+         QueryPerformanceCounter(&copier->busy_since);
+     slot->size = ((ULONGLONG)attr.nFileSizeHigh << 32) | attr.nFileSizeLow;
+     slot->offset = 0;
+     slot->operation = ASYNC_READ;
+     slot->creation_time = attr.ftCreationTime;
+     slot->access_time = attr.ftLastAccessTime;
+     slot->write_time = attr.ftLastWriteTime;
+     slot->done = done;
+     slot->tag = tag;
+     if (options)
+         slot->options = *options;
+     else
+         memset(&slot->options, 0, sizeof(slot->options));
+     strncpy(slot->target, target, sizeof(slot->target) - 1);
+     slot->target[sizeof(slot->target) - 1] = 0;
+ 
+     // Other programs may keep the file open for writing (logs, databases)
+     slot->in = CreateFile(source, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+                           FILE_FLAG_OVERLAPPED | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+     if (slot->in == INVALID_HANDLE_VALUE)
+     {
+         error = GetLastError();
+         copier->free_slots[copier->free_count++] = slot;
+         copier->active--;
+         done(-1, error, tag);
+         return;
+     }
+     slot->out = CreateFile(target, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+     if (slot->out == INVALID_HANDLE_VALUE)
+     {
+         error = GetLastError();
+         CloseHandle(slot->in);
+         copier->free_slots[copier->free_count++] = slot;
+         copier->active--;
+         done(-1, error, tag);
+         return;
+     }
+ 
+     // Reserving the whole size at once keeps large copies contiguous
+     if (slot->size > ASYNC_COPY_CHUNK)
+     {
+         LARGE_INTEGER end;
+ 
+         end.QuadPart = (LONGLONG)slot->size;
+         if (SetFilePointerEx(slot->out, end, NULL, FILE_BEGIN))
+             SetEndOfFile(slot->out);
+     }
+ 
+     if (!CreateIoCompletionPort(slot->in, copier->port, (ULONG_PTR)slot, 0) ||
+         !CreateIoCompletionPort(slot->out, copier->port, (ULONG_PTR)slot, 0))
+     {
+         finish_copy(copier, slot, GetLastError());
+         return;
+     }
+ 
+     // Cached reads of small files mostly complete at once, they need no trip through the port
+     slot->skip_on_success = FALSE;
+     if (copier->set_notification_modes)
+     {
+         UCHAR modes = FILE_SKIP_COMPLETION_PORT_ON_SUCCESS | FILE_SKIP_SET_EVENT_ON_HANDLE;
+ 
+         slot->skip_on_success = copier->set_notification_modes(slot->in, modes) &&
+                                 copier->set_notification_modes(slot->out, modes);
+     }
+ 
+     // Empty files need no read at all
+     if (slot->size == 0)
+     {
+         finish_copy(copier, slot, 0);
+         return;
+     }
+ 
+     if (start_operation(copier, slot, &bytes, &error))
+         advance_copy(copier, slot, error == 0, bytes, error);
+ }
+ 
+ int async_copy_wait(AsyncCopier *copier, DWORD timeout)
+ {
+     if (copier->active == 0)
+         return 0;
+ 
+     if (copier->get_completions)
+     {
+         AsyncEntry entries[ASYNC_COPY_BATCH];
+         ULONG count = 0;
+ 
+         if (!copier->get_completions(copier->port, entries, ASYNC_COPY_BATCH, &count, timeout, FALSE))
+             return copier->active;
+ 
+         for (ULONG i = 0; i < count; i++)
+         {
+             AsyncSlot *slot = (AsyncSlot *)entries[i].key;
+             DWORD bytes = 0, error = 0;
+             BOOL ok = GetOverlappedResult(slot->operation == ASYNC_READ ? slot->in : slot->out,
+                                           &slot->overlapped, &bytes, FALSE);
+ 
+             if (!ok)
+                 error = GetLastError();
+             advance_copy(copier, slot, ok, bytes, error);
+         }
+     }
+     else
+     {
+         DWORD bytes = 0;
+         ULONG_PTR key = 0;
+         LPOVERLAPPED overlapped = NULL;
+         BOOL ok = GetQueuedCompletionStatus(copier->port, &bytes, &key, &overlapped, timeout);
+ 
+         // A failed read or write still hands back its OVERLAPPED, a timeout does not
+         if (overlapped)
+             advance_copy(copier, (AsyncSlot *)key, ok, bytes, ok ? 0 : GetLastError());
+     }
+     return copier->active;
+ }
+ 
+ int async_copy_active(const AsyncCopier *copier)
+ {
+     return copier ? copier->active : 0;
+ }
+ 
+ void async_copy_free(AsyncCopier *copier)
+ {
+     if (!copier)
+         return;
+ 
+     while (copier->active > 0)
+         async_copy_wait(copier, INFINITE);
+ 
+     if (copier->port)
+         CloseHandle(copier->port);
+     if (copier->buffers)
+         VirtualFree(copier->buffers, 0, MEM_RELEASE);
+     free(copier->slots);
+     free(copier->free_slots);
+     free(copier);
+ }
\ No newline at end of file
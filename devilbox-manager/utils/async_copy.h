@@ -0,0 +1,80 @@
+/*******************************************************************************
+ * Async Copy Module Header
+ * Overlapped copy of many files from one thread: the reads and writes of a
+ * bounded window of files are queued on an I/O completion port, completions
+ * are collected in batches and the buffers are allocated once per copier
+ *******************************************************************************/
+#ifndef ASYNC_COPY_H
+#define ASYNC_COPY_H
+
+#include <windows.h>
+#include "fast_copy.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Files in flight per copier
+#define ASYNC_COPY_WINDOW 64
+
+// Buffer of a file in flight, larger files take several reads
+#define ASYNC_COPY_CHUNK (256 * 1024)
+
+/**
+ * Completion callback, called on the thread of the copier
+ * @param result FAST_COPY_OVERLAPPED, -1 on failure
+ * @param error Reason of a failure, ERROR_REQUEST_ABORTED when the progress callback aborted the copy
+ * @param tag Caller tag of the copy
+ */
+typedef void (*AsyncCopyDone)(int result, DWORD error, void *tag);
+
+typedef struct AsyncCopier AsyncCopier;
+
+/**
+ * Create a copier with its completion port and buffers
+ * @param window Files in flight, at most ASYNC_COPY_WINDOW
+ * @return Copier, NULL if the port or the buffers could not be created
+ */
+AsyncCopier *async_copy_create(int window);
+
+/**
+ * Start copying a file, keeping its timestamps. Waits for a free place in
+ * the window first, finishing other copies meanwhile. The target is
+ * overwritten, its directory must exist. The callback is called exactly
+ * once, right away when the copy cannot be started.
+ * @param copier Copier
+ * @param source Source file
+ * @param target Target file
+ * @param options Statistics and progress callback (may be NULL), copied
+ * @param done Completion callback
+ * @param tag Passed to the callback
+ */
+void async_copy_submit(AsyncCopier *copier, const char *source, const char *target,
+                       const FastCopyOptions *options, AsyncCopyDone done, void *tag);
+
+/**
+ * Finish the copies that completed, waiting up to a timeout for the first one
+ * @param copier Copier
+ * @param timeout Longest wait (ms), 0 to only collect what is done
+ * @return Copies still in flight
+ */
+int async_copy_wait(AsyncCopier *copier, DWORD timeout);
+
+/**
+ * Get the number of copies in flight
+ * @param copier Copier
+ * @return Copies started and not finished
+ */
+int async_copy_active(const AsyncCopier *copier);
+
+/**
+ * Finish every copy in flight and free the copier
+ * @param copier Copier (may be NULL)
+ */
+void async_copy_free(AsyncCopier *copier);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ASYNC_COPY_H */
\ No newline at end of file
@@ -0,0 +1,437 @@
+/*******************************************************************************
+ * Backup Filter Module Implementation
+ * Hashed extension and name sets, ordered wildcard rules and a glob matcher
+ *******************************************************************************/
+
+ #include "backup_filter.h"
+ #include <stdlib.h>
+ #include <string.h>
+ 
+ #define RULE_SEPARATORS ",;\r\n"
+ #define MAX_RULE_LEN 260
+ #define SET_INITIAL_SIZE 16
+ 
+ // Open addressing set of folded (lower case, '/' separated) strings
+ typedef struct
+ {
+     char **slots;
+     DWORD mask;
+     DWORD count;
+ } NameSet;
+ 
+ // Exclude pattern that needs the glob matcher
+ typedef struct
+ {
+     char *pattern;        // Folded, without leading and trailing '/'
+     BOOL negate;          // "!pattern" includes again what earlier rules excluded
+     BOOL directory_only;  // "pattern/" only matches directories
+     BOOL anchored;        // Contains a '/', matched against the whole relative path
+ } FilterRule;
+ 
+ struct BackupFilter
+ {
+     NameSet extensions;      // ".php", ".htaccess"
+     BOOL all_files;          // "*" in the extension list
+     NameSet excluded_dirs;   // Literal directory names ("vendor", ".git")
+     NameSet excluded_names;  // Literal names of files and directories
+     FilterRule *rules;       // Remaining patterns, in order (the last match wins)
+     int rule_count;
+ };
+ 
+ /**
+  * Fold a character for comparison: Windows names are case-insensitive
+  * and both separators are accepted
+  */
+ static char fold_char(char c)
+ {
+     if (c >= 'A' && c <= 'Z')
+         return (char)(c + ('a' - 'A'));
+     return c == '\\' ? '/' : c;
+ }
+ 
+ /**
+  * FNV-1a of a folded string
+  */
+ static DWORD fold_hash(const char *s, size_t len)
+ {
+     DWORD hash = 2166136261u;
+ 
+     for (size_t i = 0; i < len; i++)
+     {
+         hash ^= (unsigned char)fold_char(s[i]);
+         hash *= 16777619u;
+     }
+     return hash;
+ }
+ 
+ /**
+  * Check whether a set contains a string (compared folded)
+  */
+ static BOOL set_contains(const NameSet *set, const char *s, size_t len)
+ {
+     if (set->count == 0)
+         return FALSE;
+ 
+     for (DWORD i = fold_hash(s, len) & set->mask; set->slots[i]; i = (i + 1) & set->mask)
+     {
+         const char *entry = set->slots[i];
+         size_t k = 0;
+ 
+         while (k < len && entry[k] && entry[k] == fold_char(s[k]))
+             k++;
+         if (k == len && entry[k] == '\0')
+             return TRUE;
+     }
+     return FALSE;
+ }
+ 
+ /**
+  * Add a folded string to a set, growing it at half load
+  */
+ static BOOL set_add(NameSet *set, const char *s)
+ {
+     size_t len = strlen(s);
+ 
+     if (set_contains(set, s, len))
+         return TRUE;
+ 
+     if ((set->count + 1) * 2 > set->mask + 1 || !set->slots)
+     {
+         DWORD size = set->slots ? (set->mask + 1) * 2 : SET_INITIAL_SIZE;
+         char **slots = (char **)calloc(size, sizeof(char *));
+         if (!slots)
+             return FALSE;
+ 
+         for (DWORD i = 0; set->slots && i <= set->mask; i++)
+         {
+             if (!set->slots[i])
+                 continue;
+             DWORD j = fold_hash(set->slots[i], strlen(set->slots[i])) & (size - 1);
+             while (slots[j])
+                 j = (j + 1) & (size - 1);
+             slots[j] = set->slots[i];
+         }
+         free(set->slots);
+         set->slots = slots;
+         set->mask = size - 1;
+     }
+ 
+     char *copy = _strdup(s);
+     if (!copy)
+         return FALSE;
+ 
+     DWORD i = fold_hash(copy, len) & set->mask;
+     while (set->slots[i])
+         i = (i + 1) & set->mask;
+     set->slots[i] = copy;
+     set->count++;
+     return TRUE;
+ }
+ 
+ static void set_free(NameSet *set)
+ {
+     for (DWORD i = 0; set->slots && i <= set->mask; i++)
+         free(set->slots[i]);
+     free(set->slots);
+ }
+ 
+ /**
+  * Match a character class "[...]" at p against c. Returns the position
+  * after the class, or NULL when the class is not terminated.
+  */
+ static const char *match_class(const char *p, char c, BOOL *matched)
+ {
+     BOOL negate = FALSE;
+ 
+     p++;
+     if (*p == '!' || *p == '^')
+     {
+         negate = TRUE;
+         p++;
+     }
+ 
+     *matched = FALSE;
+     for (BOOL first = TRUE; *p && (first || *p != ']'); first = FALSE)
+     {
+         if (p[1] == '-' && p[2] && p[2] != ']')
+         {
+             if (c >= p[0] && c <= p[2])
+                 *matched = TRUE;
+             p += 3;
+         }
+         else
+         {
+             if (c == *p)
+                 *matched = TRUE;
+             p++;
+         }
+     }
+     if (*p != ']')
+         return NULL;
+ 
+     if (negate)
+         *matched = !*matched;
+     return p + 1;
+ }
+ 
+ /**
+  * Match a folded glob against text. '*' and '?' stay within one path
+  * component, "**" spans any number of components.
+  */
+ static BOOL glob_match(const char *p, const char *s, const char *end)
+ {
+     while (*p)
+     {
+         if (p[0] == '*' && p[1] == '*')
+         {
+             // "**/" also matches no directory at all, a trailing "**" everything
+             p += 2;
+             BOOL slash = *p == '/';
+             if (slash)
+                 p++;
+             if (!*p)
+                 return TRUE;
+             for (const char *t = s; t <= end; t++)
+             {
+                 if ((!slash || t == s || t[-1] == '/' || t[-1] == '\\') && glob_match(p, t, end))
+                     return TRUE;
+             }
+             return FALSE;
+         }
+ 
+         if (*p == '*')
+         {
+             p++;
+             for (const char *t = s; t <= end; t++)
+             {
+                 if (glob_match(p, t, end))
+                     return TRUE;
+                 if (t < end && fold_char(*t) == '/')
+                     break;
+             }
+             return FALSE;
+         }
+ 
+         if (s == end)
+             return FALSE;
+         char c = fold_char(*s);
+ 
+         if (*p == '?')
+         {
+             if (c == '/')
+                 return FALSE;
+             p++;
+         }
+         else if (*p == '[')
+         {
+             BOOL matched;
+             const char *next = match_class(p, c, &matched);
+             if (next)
+             {
+                 if (!matched || c == '/')
+                     return FALSE;
+                 p = next;
+             }
+             else if (c == '[')
+                 p++;
+             else
+                 return FALSE;
+         }
+         else if (*p == c)
+             p++;
+         else
+             return FALSE;
+         s++;
+     }
+     return s == end;
+ }
+ 
+ /**
+  * Get the next token of a separated list, trimmed of spaces
+  */
+ static BOOL next_token(const char **cursor, char *token)
+ {
+     const char *s = *cursor;
+ 
+     while (*s && (strchr(RULE_SEPARATORS, *s) || *s == ' ' || *s == '\t'))
+         s++;
+     if (!*s)
+         return FALSE;
+ 
+     size_t len = strcspn(s, RULE_SEPARATORS);
+     *cursor = s + len;
+     while (len > 0 && (s[len - 1] == ' ' || s[len - 1] == '\t'))
+         len--;
+     if (len >= MAX_RULE_LEN)
+         len = MAX_RULE_LEN - 1;
+ 
+     for (size_t i = 0; i < len; i++)
+         token[i] = fold_char(s[i]);
+     token[len] = '\0';
+     return TRUE;
+ }
+ 
+ /**
+  * Check exclude rules for a file or directory
+  */
+ static BOOL is_excluded(const BackupFilter *filter, const char *relative_path, BOOL is_dir)
+ {
+     const char *name = relative_path;
+     const char *end = relative_path + strlen(relative_path);
+     BOOL excluded = FALSE;
+ 
+     for (const char *p = relative_path; *p; p++)
+     {
+         if (*p == '\\' || *p == '/')
+             name = p + 1;
+     }
+ 
+     // Literal names are only hashed when there are no "!" rules, so their order does not matter
+     if (set_contains(&filter->excluded_names, name, end - name) ||
+         (is_dir && set_contains(&filter->excluded_dirs, name, end - name)))
+         return TRUE;
+ 
+     for (int i = 0; i < filter->rule_count; i++)
+     {
+         const FilterRule *rule = &filter->rules[i];
+ 
+         if (rule->directory_only && !is_dir)
+             continue;
+         if (excluded != rule->negate)
+             continue;
+         if (glob_match(rule->pattern, rule->anchored ? relative_path : name, end))
+             excluded = !rule->negate;
+     }
+     return excluded;
+ }
+ 
+ BackupFilter *filter_compile(const char *extensions, const char *excludes)
+ {
+     BackupFilter *filter = (BackupFilter *)calloc(1, sizeof(BackupFilter));
+     char token[MAX_RULE_LEN + 1];
+     const char *cursor;
+     BOOL ok = TRUE;
+ 
+     if (!filter)
+         return NULL;
+ 
+     // Extensions are stored with their leading dot
+     cursor = extensions ? extensions : "";
+     while (ok && next_token(&cursor, token))
+     {
+         if (strcmp(token, "*") == 0 || strcmp(token, "*.*") == 0)
+             filter->all_files = TRUE;
+         else if (token[0] == '.')
+             ok = set_add(&filter->extensions, token);
+         else
+         {
+             char dotted[MAX_RULE_LEN + 2] = ".";
+             strcat(dotted, token);
+             ok = set_add(&filter->extensions, dotted);
+         }
+     }
+ 
+     // Negated rules need every rule evaluated in order
+     BOOL ordered = excludes && strchr(excludes, '!') != NULL;
+     cursor = excludes ? excludes : "";
+     while (ok && next_token(&cursor, token))
+     {
+         char *pattern = token;
+         BOOL negate = FALSE, directory_only = FALSE, anchored = FALSE;
+         size_t len;
+ 
+         if (*pattern == '!')
+         {
+             negate = TRUE;
+             pattern++;
+         }
+         len = strlen(pattern);
+         while (len > 0 && pattern[len - 1] == '/')
+         {
+             directory_only = TRUE;
+             pattern[--len] = '\0';
+         }
+         if (*pattern == '/')
+         {
+             anchored = TRUE;
+             while (*pattern == '/')
+                 pattern++;
+         }
+         if (!*pattern)
+             continue;
+         if (strchr(pattern, '/'))
+             anchored = TRUE;
+ 
+         // Plain names hash, everything else goes through the matcher
+         if (!ordered && !anchored && !strpbrk(pattern, "*?["))
+         {
+             ok = set_add(directory_only ? &filter->excluded_dirs : &filter->excluded_names, pattern);
+             continue;
+         }
+ 
+         FilterRule *rules = (FilterRule *)realloc(filter->rules, (filter->rule_count + 1) * sizeof(FilterRule));
+         if (!rules)
+         {
+             ok = FALSE;
+             break;
+         }
+         filter->rules = rules;
+ 
+         FilterRule *rule = &filter->rules[filter->rule_count];
+         rule->pattern = _strdup(pattern);
+         rule->negate = negate;
+         rule->directory_only = directory_only;
+         rule->anchored = anchored;
+         if (!rule->pattern)
+             ok = FALSE;
+         else
+             filter->rule_count++;
+     }
+ 
+     if (!ok)
+     {
+         filter_free(filter);
+         return NULL;
+     }
+     return filter;
+ }
+ 
+ void filter_free(BackupFilter *filter)
+ {
+     if (!filter)
+         return;
+ 
+     set_free(&filter->extensions);
+     set_free(&filter->excluded_dirs);
+     set_free(&filter->excluded_names);
+     for (int i = 0; i < filter->rule_count; i++)
+         free(filter->rules[i].pattern);
+     free(filter->rules);
+     free(filter);
+ }
+ 
+ BOOL filter_match_file(const BackupFilter *filter, const char *relative_path)
+ {
+     // Extension first: most files of a project are rejected here
+     if (!filter->all_files)
+     {
+         const char *extension = NULL;
+ 
+         for (const char *p = relative_path; *p; p++)
+         {
+             if (*p == '.')
+                 extension = p;
+             else if (*p == '\\' || *p == '/')
+                 extension = NULL;
+         }
+         if (!extension || !set_contains(&filter->extensions, extension, strlen(extension)))
+             return FALSE;
+     }
+ 
+     return !is_excluded(filter, relative_path, FALSE);
+ }
+ 
+ BOOL filter_prune_directory(const BackupFilter *filter, const char *relative_path)
+ {
+     return is_excluded(filter, relative_path, TRUE);
+ }
\ No newline at end of file
@@ -0,0 +1,57 @@
+/*******************************************************************************
+ * Backup Filter Module Header
+ * Include (extension list) and exclude (gitignore-style patterns) rules,
+ * compiled once per backup and shared by the walker threads
+ *******************************************************************************/
+#ifndef BACKUP_FILTER_H
+#define BACKUP_FILTER_H
+
+#include <windows.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Excludes suggested in the backup dialog
+#define FILTER_DEFAULT_EXCLUDES "vendor/,node_modules/,.git/"
+
+// Compiled filter (opaque, read-only after compilation)
+typedef struct BackupFilter BackupFilter;
+
+/**
+ * Compile include and exclude rules
+ * @param extensions Extensions separated by ',' or ';' ("php,js,.htaccess"), "*" for all files
+ * @param excludes Patterns separated by ',', ';' or new lines: "name" matches at any
+ *                 depth, "dir/" only directories, "/path" from the source root,
+ *                 '*', '?', '**' and [a-z] wildcards, "!pattern" re-includes
+ * @return Filter, NULL when out of memory
+ */
+BackupFilter *filter_compile(const char *extensions, const char *excludes);
+
+/**
+ * Release a compiled filter
+ * @param filter Filter (may be NULL)
+ */
+void filter_free(BackupFilter *filter);
+
+/**
+ * Check whether a file is backed up
+ * @param filter Filter
+ * @param relative_path Path relative to the source root ('\\' or '/' separators)
+ * @return TRUE if the extension is included and no exclude rule matches
+ */
+BOOL filter_match_file(const BackupFilter *filter, const char *relative_path);
+
+/**
+ * Check whether a directory is skipped with everything below it
+ * @param filter Filter
+ * @param relative_path Path relative to the source root
+ * @return TRUE if the directory is excluded
+ */
+BOOL filter_prune_directory(const BackupFilter *filter, const char *relative_path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BACKUP_FILTER_H */
\ No newline at end of file
@@ -0,0 +1,476 @@
+/*******************************************************************************
+ * Backup Manifest Module Implementation
+ * Tracks path, size, modification time and content hash of every file in a
+ * backup target so incremental runs copy only files that really changed
+ *******************************************************************************/
+
+ #include "backup_manifest.h"
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ #include <ctype.h>
+ 
+ #define MANIFEST_HEADER "# DevilboxManager backup manifest v1"
+ 
+ // Manifest item as kept in memory
+ typedef struct
+ {
+     char *path;
+     ULONGLONG size;
+     ULONGLONG mtime;
+     ULONGLONG hash;
+     BOOL seen;
+ } ManifestItem;
+ 
+ // Hash of a directory marked missing, with its position in the caller's list
+ typedef struct
+ {
+     unsigned long hash;
+     int index;
+ } MissingTree;
+ 
+ // Manifest with an open addressing index over the items
+ struct BackupManifest
+ {
+     CRITICAL_SECTION lock;
+     ManifestItem *items;
+     int count;
+     int capacity;
+     int *table;
+     size_t mask;
+ };
+ 
+ // Forward declarations of internal functions
+ static unsigned long hash_path(const char *path);
+ static int find_item(BackupManifest *manifest, const char *path);
+ static BOOL rebuild_table(BackupManifest *manifest, size_t slots);
+ static BOOL add_item(BackupManifest *manifest, const char *path, ULONGLONG size,
+                      ULONGLONG mtime, ULONGLONG hash, BOOL seen);
+ static int compare_trees(const void *a, const void *b);
+ static BOOL under_missing_tree(const char *path, const MissingTree *trees, int count, const char *const *paths);
+ 
+ /**
+  * Case-insensitive FNV-1a hash of a relative path (Windows paths ignore case)
+  */
+ static unsigned long hash_path(const char *path)
+ {
+     unsigned long hash = 2166136261UL;
+ 
+     while (*path)
+     {
+         char c = *path++;
+         hash ^= (unsigned char)(c == '/' ? '\\' : tolower((unsigned char)c));
+         hash *= 16777619UL;
+     }
+ 
+     return hash;
+ }
+ 
+ /**
+  * Find the item index of a path, -1 if missing
+  */
+ static int find_item(BackupManifest *manifest, const char *path)
+ {
+     if (!manifest->table)
+         return -1;
+ 
+     size_t i = hash_path(path) & manifest->mask;
+     while (manifest->table[i] >= 0)
+     {
+         if (_stricmp(manifest->items[manifest->table[i]].path, path) == 0)
+             return manifest->table[i];
+         i = (i + 1) & manifest->mask;
+     }
+ 
+     return -1;
+ }
+ 
+ /**
+  * Rebuild the index with the given number of slots (power of two)
+  */
+ static BOOL rebuild_table(BackupManifest *manifest, size_t slots)
+ {
+     int *table = (int *)malloc(slots * sizeof(int));
+     if (!table)
+         return FALSE;
+ 
+     memset(table, 0xff, slots * sizeof(int));
+     for (int n = 0; n < manifest->count; n++)
+     {
+         size_t i = hash_path(manifest->items[n].path) & (slots - 1);
+         while (table[i] >= 0)
+             i = (i + 1) & (slots - 1);
+         table[i] = n;
+     }
+ 
+     free(manifest->table);
+     manifest->table = table;
+     manifest->mask = slots - 1;
+     return TRUE;
+ }
+ 
+ /**
+  * Append an item and index it, keeping the index at most half full
+  */
+ static BOOL add_item(BackupManifest *manifest, const char *path, ULONGLONG size,
+                      ULONGLONG mtime, ULONGLONG hash, BOOL seen)
+ {
+     if (manifest->count == manifest->capacity)
+     {
+         int capacity = manifest->capacity ? manifest->capacity * 2 : 1024;
+         ManifestItem *items = (ManifestItem *)realloc(manifest->items, capacity * sizeof(ManifestItem));
+         if (!items)
+             return FALSE;
+         manifest->items = items;
+         manifest->capacity = capacity;
+     }
+ 
+     ManifestItem *item = &manifest->items[manifest->count];
+     item->path = _strdup(path);
+     if (!item->path)
+         return FALSE;
+ 
+     item->size = size;
+     item->mtime = mtime;
+     item->hash = hash;
+     item->seen = seen;
+     manifest->count++;
+ 
+     if (!manifest->table || (size_t)manifest->count * 2 > manifest->mask + 1)
+         return rebuild_table(manifest, manifest->table ? (manifest->mask + 1) * 2 : 4096);
+ 
+     size_t i = hash_path(path) & manifest->mask;
+     while (manifest->table[i] >= 0)
+         i = (i + 1) & manifest->mask;
+     manifest->table[i] = manifest->count - 1;
+ 
+     return TRUE;
+ }
+ 
+ /**
+  * Load the manifest of a backup target, an empty one if there is none yet
+  */
+ BackupManifest *manifest_load(const char *root)
+ {
+     char manifest_path[MAX_PATH_LEN];
+     char line[MAX_PATH_LEN + 100];
+ 
+     BackupManifest *manifest = (BackupManifest *)calloc(1, sizeof(BackupManifest));
+     if (!manifest)
+         return NULL;
+ 
+     InitializeCriticalSection(&manifest->lock);
+ 
+     snprintf(manifest_path, sizeof(manifest_path), "%s\\%s", root, MANIFEST_FILE_NAME);
+     FILE *f = fopen(manifest_path, "r");
+     if (!f)
+         return manifest;
+ 
+     while (fgets(line, sizeof(line), f))
+     {
+         ULONGLONG hash, size, mtime;
+         int offset = 0;
+ 
+         if (line[0] == '#')
+             continue;
+ 
+         line[strcspn(line, "\r\n")] = 0;
+         if (sscanf(line, "%llx\t%llu\t%llu\t%n", &hash, &size, &mtime, &offset) != 3 || !offset)
+             continue;
+ 
+         if (find_item(manifest, line + offset) < 0)
+             add_item(manifest, line + offset, size, mtime, hash, FALSE);
+     }
+ 
+     fclose(f);
+     return manifest;
+ }
+ 
+ /**
+  * Look up a file and mark it as present in the current run
+  */
+ BOOL manifest_lookup(BackupManifest *manifest, const char *relative_path, ManifestEntry *entry)
+ {
+     EnterCriticalSection(&manifest->lock);
+ 
+     int n = find_item(manifest, relative_path);
+     if (n >= 0)
+     {
+         ManifestItem *item = &manifest->items[n];
+         item->seen = TRUE;
+         if (entry)
+         {
+             strncpy(entry->path, item->path, sizeof(entry->path) - 1);
+             entry->path[sizeof(entry->path) - 1] = '\0';
+             entry->size = item->size;
+             entry->mtime = item->mtime;
+             entry->hash = item->hash;
+         }
+     }
+ 
+     LeaveCriticalSection(&manifest->lock);
+     return n >= 0;
+ }
+ 
+ /**
+  * Add or update a file and mark it as present in the current run
+  */
+ void manifest_update(BackupManifest *manifest, const char *relative_path,
+                      ULONGLONG size, ULONGLONG mtime, ULONGLONG hash)
+ {
+     EnterCriticalSection(&manifest->lock);
+ 
+     int n = find_item(manifest, relative_path);
+     if (n >= 0)
+     {
+         manifest->items[n].size = size;
+         manifest->items[n].mtime = mtime;
+         manifest->items[n].hash = hash;
+         manifest->items[n].seen = TRUE;
+     }
+     else
+     {
+         add_item(manifest, relative_path, size, mtime, hash, TRUE);
+     }
+ 
+     LeaveCriticalSection(&manifest->lock);
+ }
+ 
+ /**
+  * Order missing directories by hash for the binary search
+  */
+ static int compare_trees(const void *a, const void *b)
+ {
+     unsigned long x = ((const MissingTree *)a)->hash;
+     unsigned long y = ((const MissingTree *)b)->hash;
+ 
+     return x < y ? -1 : x > y;
+ }
+ 
+ /**
+  * Check whether a path lies below one of the missing directories. The hash of
+  * every parent directory falls out of hashing the path once.
+  */
+ static BOOL under_missing_tree(const char *path, const MissingTree *trees, int count, const char *const *paths)
+ {
+     unsigned long hash = 2166136261UL;
+ 
+     for (const char *p = path; *p; p++)
+     {
+         char c = *p == '/' ? '\\' : (char)tolower((unsigned char)*p);
+ 
+         if (c == '\\' && p > path)
+         {
+             size_t length = (size_t)(p - path);
+             int low = 0, high = count;
+ 
+             while (low < high)
+             {
+                 int middle = (low + high) / 2;
+                 if (trees[middle].hash < hash)
+                     low = middle + 1;
+                 else
+                     high = middle;
+             }
+             for (int i = low; i < count && trees[i].hash == hash; i++)
+             {
+                 const char *tree = paths[trees[i].index];
+                 if (strlen(tree) == length && _strnicmp(path, tree, length) == 0)
+                     return TRUE;
+             }
+         }
+ 
+         hash ^= (unsigned char)c;
+         hash *= 16777619UL;
+     }
+ 
+     return FALSE;
+ }
+ 
+ /**
+  * Mark every file as present in the current run
+  */
+ void manifest_mark_all_seen(BackupManifest *manifest)
+ {
+     EnterCriticalSection(&manifest->lock);
+     for (int n = 0; n < manifest->count; n++)
+         manifest->items[n].seen = TRUE;
+     LeaveCriticalSection(&manifest->lock);
+ }
+ 
+ /**
+  * Mark files, or everything below directories, as missing from the current run
+  */
+ void manifest_mark_missing(BackupManifest *manifest, const char *const *paths, int count, BOOL subtree)
+ {
+     MissingTree *trees;
+ 
+     if (count <= 0)
+         return;
+ 
+     EnterCriticalSection(&manifest->lock);
+ 
+     if (!subtree)
+     {
+         for (int i = 0; i < count; i++)
+         {
+             int n = find_item(manifest, paths[i]);
+             if (n >= 0)
+                 manifest->items[n].seen = FALSE;
+         }
+     }
+     else if ((trees = (MissingTree *)malloc(count * sizeof(MissingTree))) != NULL)
+     {
+         // One pass over the files however many directories are missing
+         for (int i = 0; i < count; i++)
+         {
+             trees[i].hash = hash_path(paths[i]);
+             trees[i].index = i;
+         }
+         qsort(trees, count, sizeof(MissingTree), compare_trees);
+ 
+         for (int n = 0; n < manifest->count; n++)
+         {
+             if (manifest->items[n].seen && under_missing_tree(manifest->items[n].path, trees, count, paths))
+                 manifest->items[n].seen = FALSE;
+         }
+         free(trees);
+     }
+ 
+     LeaveCriticalSection(&manifest->lock);
+ }
+ 
+ /**
+  * Drop files that were not seen in the current run and log them as deleted
+  */
+ int manifest_record_deletions(BackupManifest *manifest, const char *root)
+ {
+     char log_path[MAX_PATH_LEN];
+     SYSTEMTIME st;
+     FILE *log = NULL;
+     int deleted = 0;
+     int kept = 0;
+ 
+     EnterCriticalSection(&manifest->lock);
+ 
+     GetLocalTime(&st);
+     for (int n = 0; n < manifest->count; n++)
+     {
+         ManifestItem *item = &manifest->items[n];
+ 
+         if (item->seen)
+         {
+             item->seen = FALSE;
+             manifest->items[kept++] = *item;
+             continue;
+         }
+ 
+         if (!log)
+         {
+             snprintf(log_path, sizeof(log_path), "%s\\%s", root, MANIFEST_DELETIONS_FILE_NAME);
+             log = fopen(log_path, "a");
+         }
+         if (log)
+         {
+             fprintf(log, "%04d-%02d-%02d %02d:%02d:%02d\t%s\n", st.wYear, st.wMonth, st.wDay,
+                     st.wHour, st.wMinute, st.wSecond, item->path);
+         }
+ 
+         free(item->path);
+         deleted++;
+     }
+ 
+     if (log)
+         fclose(log);
+ 
+     if (deleted > 0)
+     {
+         manifest->count = kept;
+         rebuild_table(manifest, manifest->mask + 1);
+     }
+ 
+     LeaveCriticalSection(&manifest->lock);
+     return deleted;
+ }
+ 
+ /**
+  * Write the manifest atomically to the backup target
+  */
+ BOOL manifest_save(BackupManifest *manifest, const char *root)
+ {
+     char manifest_path[MAX_PATH_LEN];
+     char tmp_path[MAX_PATH_LEN];
+     BOOL ok;
+ 
+     snprintf(manifest_path, sizeof(manifest_path), "%s\\%s", root, MANIFEST_FILE_NAME);
+     snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", manifest_path);
+ 
+     FILE *f = fopen(tmp_path, "w");
+     if (!f)
+         return FALSE;
+ 
+     // Large buffer, manifests of big projects have hundreds of thousands of lines
+     setvbuf(f, NULL, _IOFBF, 1 << 20);
+ 
+     EnterCriticalSection(&manifest->lock);
+     fprintf(f, "%s\n", MANIFEST_HEADER);
+     for (int n = 0; n < manifest->count; n++)
+     {
+         ManifestItem *item = &manifest->items[n];
+         fprintf(f, "%016llx\t%llu\t%llu\t%s\n", item->hash, item->size, item->mtime, item->path);
+     }
+     LeaveCriticalSection(&manifest->lock);
+ 
+     ok = !ferror(f);
+     ok = (fclose(f) == 0) && ok;
+ 
+     if (ok)
+         ok = MoveFileEx(tmp_path, manifest_path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+ 
+     if (!ok)
+         DeleteFile(tmp_path);
+ 
+     return ok;
+ }
+ 
+ /**
+  * Number of files in the manifest
+  */
+ int manifest_count(const BackupManifest *manifest)
+ {
+     return manifest->count;
+ }
+ 
+ /**
+  * Get a manifest entry by position
+  */
+ BOOL manifest_get_entry(const BackupManifest *manifest, int index, ManifestEntry *entry)
+ {
+     if (index < 0 || index >= manifest->count)
+         return FALSE;
+ 
+     const ManifestItem *item = &manifest->items[index];
+     strncpy(entry->path, item->path, sizeof(entry->path) - 1);
+     entry->path[sizeof(entry->path) - 1] = '\0';
+     entry->size = item->size;
+     entry->mtime = item->mtime;
+     entry->hash = item->hash;
+     return TRUE;
+ }
+ 
+ /**
+  * Release a manifest
+  */
+ void manifest_free(BackupManifest *manifest)
+ {
+     if (!manifest)
+         return;
+ 
+     for (int n = 0; n < manifest->count; n++)
+         free(manifest->items[n].path);
+ 
+     free(manifest->items);
+     free(manifest->table);
+     DeleteCriticalSection(&manifest->lock);
+     free(manifest);
+ }
\ No newline at end of file
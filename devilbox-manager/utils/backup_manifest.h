@@ -0,0 +1,123 @@
+/*******************************************************************************
+ * Backup Manifest Module Header
+ * Tracks path, size, modification time and content hash of every file in a
+ * backup target so incremental runs copy only files that really changed
+ *******************************************************************************/
+#ifndef BACKUP_MANIFEST_H
+#define BACKUP_MANIFEST_H
+
+#include <windows.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Maximum path length constant (if not already defined)
+#ifndef MAX_PATH_LEN
+#define MAX_PATH_LEN 260
+#endif
+
+// Manifest and deletion log file names inside the backup target
+#define MANIFEST_FILE_NAME ".devilbox-manifest"
+#define MANIFEST_DELETIONS_FILE_NAME ".devilbox-deletions"
+
+// Manifest entry of a backed up file
+typedef struct
+{
+    char path[MAX_PATH_LEN]; // Path relative to the backup root
+    ULONGLONG size;          // File size in bytes
+    ULONGLONG mtime;         // Last write time (FILETIME as 64-bit value)
+    ULONGLONG hash;          // XXH64 of the file content
+} ManifestEntry;
+
+// Manifest of a backup target (opaque)
+typedef struct BackupManifest BackupManifest;
+
+/**
+ * Load the manifest of a backup target, an empty one if there is none yet
+ * @param root Backup target directory
+ * @return Manifest, NULL on allocation failure
+ */
+BackupManifest *manifest_load(const char *root);
+
+/**
+ * Look up a file and mark it as present in the current run
+ * @param manifest Manifest
+ * @param relative_path Path relative to the backup root
+ * @param entry Receives the entry if found
+ * @return TRUE if the file is in the manifest
+ */
+BOOL manifest_lookup(BackupManifest *manifest, const char *relative_path, ManifestEntry *entry);
+
+/**
+ * Add or update a file and mark it as present in the current run
+ * @param manifest Manifest
+ * @param relative_path Path relative to the backup root
+ * @param size File size
+ * @param mtime Last write time
+ * @param hash Content hash
+ */
+void manifest_update(BackupManifest *manifest, const char *relative_path,
+                     ULONGLONG size, ULONGLONG mtime, ULONGLONG hash);
+
+/**
+ * Mark every file as present in the current run, for runs that visit only
+ * the files a change journal reported
+ * @param manifest Manifest
+ */
+void manifest_mark_all_seen(BackupManifest *manifest);
+
+/**
+ * Mark files as missing from the current run: manifest_record_deletions drops
+ * them unless a lookup or an update sees them again
+ * @param manifest Manifest
+ * @param paths Paths relative to the backup root
+ * @param count Number of paths
+ * @param subtree Mark everything below the paths (directories) instead of the files themselves
+ */
+void manifest_mark_missing(BackupManifest *manifest, const char *const *paths, int count, BOOL subtree);
+
+/**
+ * Drop files that were not seen in the current run and append them to the
+ * deletion log of the backup target
+ * @param manifest Manifest
+ * @param root Backup target directory
+ * @return Number of deleted files
+ */
+int manifest_record_deletions(BackupManifest *manifest, const char *root);
+
+/**
+ * Write the manifest atomically to the backup target
+ * @param manifest Manifest
+ * @param root Backup target directory
+ * @return TRUE on success
+ */
+BOOL manifest_save(BackupManifest *manifest, const char *root);
+
+/**
+ * Number of files in the manifest
+ * @param manifest Manifest
+ * @return Entry count
+ */
+int manifest_count(const BackupManifest *manifest);
+
+/**
+ * Get a manifest entry by position, for listing every file
+ * @param manifest Manifest
+ * @param index Position, 0 to manifest_count - 1
+ * @param entry Receives the entry
+ * @return TRUE if the position is valid
+ */
+BOOL manifest_get_entry(const BackupManifest *manifest, int index, ManifestEntry *entry);
+
+/**
+ * Release a manifest
+ * @param manifest Manifest to free
+ */
+void manifest_free(BackupManifest *manifest);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BACKUP_MANIFEST_H */
\ No newline at end of file
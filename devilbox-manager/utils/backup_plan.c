@@ -0,0 +1,377 @@
+/*******************************************************************************
+ * Backup Plan Module Implementation
+ * Parallel dry-run listing of a backup source with batched directory reads
+ *******************************************************************************/
+
+ #include "backup_plan.h"
+ #include "backup_manifest.h"
+ #include "backup_filter.h"
+ #include "backup_rotation.h"
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ 
+ // Declarations missing from older MinGW headers
+ #ifndef FIND_FIRST_EX_LARGE_FETCH
+ #define FIND_FIRST_EX_LARGE_FETCH 2
+ #endif
+ #define PLAN_FIND_INFO_BASIC ((FINDEX_INFO_LEVELS)1)
+ 
+ // Rough rates of a backup to a local disk, used for the estimate
+ #define PLAN_WRITE_MB_PER_S 100     // Copying or storing file data
+ #define PLAN_ARCHIVE_MB_PER_S 25    // Compressing, per thread at the default level
+ #define PLAN_FILES_PER_S 1000       // Creating, writing and closing a file
+ #define PLAN_UNCHANGED_PER_S 20000  // Skipping or linking a file the manifest knows
+ 
+ // Shared state of the walkers
+ typedef struct
+ {
+     const BackupOptions *options;
+     BackupPlan *plan;
+     BackupFilter *filter;
+     BackupManifest *manifest;
+     ULONGLONG modified_after;   // Days filter as FILETIME value, 0 for none
+     CRITICAL_SECTION lock;      // Guards the directory stack and the largest files
+     char **dirs;                // Directories to list, relative to the source
+     int dir_count;
+     int dir_capacity;
+     volatile LONG pending;      // Directories queued or being listed
+     volatile LONG failed;
+ } PlanRun;
+ 
+ // Forward declarations of internal functions
+ static HANDLE find_first(const char *search_path, WIN32_FIND_DATA *fd);
+ static BOOL push_dir(PlanRun *job, const char *relative_dir);
+ static char *pop_dir(PlanRun *job);
+ static void add_largest(PlanFile *largest, int *count, const char *relative_path, LONGLONG size);
+ static void plan_file(PlanRun *job, const char *relative_path, const WIN32_FIND_DATA *fd,
+                       PlanFile *largest, int *largest_count);
+ static void list_directory(PlanRun *job, const char *relative_dir, PlanFile *largest, int *largest_count);
+ static DWORD WINAPI plan_thread(LPVOID param);
+ 
+ /**
+  * Open a directory listing. Windows 7 and later skip the short names and
+  * fill larger batches per call; older systems reject the flags.
+  */
+ static HANDLE find_first(const char *search_path, WIN32_FIND_DATA *fd)
+ {
+     HANDLE hFind = FindFirstFileEx(search_path, PLAN_FIND_INFO_BASIC, fd, FindExSearchNameMatch, NULL,
+                                    FIND_FIRST_EX_LARGE_FETCH);
+ 
+     if (hFind == INVALID_HANDLE_VALUE && GetLastError() == ERROR_INVALID_PARAMETER)
+         hFind = FindFirstFile(search_path, fd);
+     return hFind;
+ }
+ 
+ static BOOL push_dir(PlanRun *job, const char *relative_dir)
+ {
+     char *dir = _strdup(relative_dir);
+     BOOL ok = FALSE;
+ 
+     if (!dir)
+         return FALSE;
+ 
+     EnterCriticalSection(&job->lock);
+     if (job->dir_count == job->dir_capacity)
+     {
+         int capacity = job->dir_capacity ? job->dir_capacity * 2 : 256;
+         char **grown = (char **)realloc(job->dirs, capacity * sizeof(char *));
+         if (grown)
+         {
+             job->dirs = grown;
+             job->dir_capacity = capacity;
+         }
+     }
+     if (job->dir_count < job->dir_capacity)
+     {
+         job->dirs[job->dir_count++] = dir;
+         InterlockedIncrement(&job->pending);
+         ok = TRUE;
+     }
+     LeaveCriticalSection(&job->lock);
+ 
+     if (!ok)
+         free(dir);
+     return ok;
+ }
+ 
+ static char *pop_dir(PlanRun *job)
+ {
+     char *dir = NULL;
+ 
+     EnterCriticalSection(&job->lock);
+     if (job->dir_count > 0)
+         dir = job->dirs[--job->dir_count];
+     LeaveCriticalSection(&job->lock);
+     return dir;
+ }
+ 
+ /**
+  * Insert a file into a largest-first list of PLAN_LARGEST_FILES entries
+  */
+ static void add_largest(PlanFile *largest, int *count, const char *relative_path, LONGLONG size)
+ {
+     int i = *count;
+ 
+     if (i == PLAN_LARGEST_FILES)
+     {
+         if (size <= largest[i - 1].size)
+             return;
+         i--;
+     }
+     else
+     {
+         (*count)++;
+     }
+ 
+     for (; i > 0 && largest[i - 1].size < size; i--)
+         largest[i] = largest[i - 1];
+     strncpy(largest[i].path, relative_path, sizeof(largest[i].path) - 1);
+     largest[i].path[sizeof(largest[i].path) - 1] = '\0';
+     largest[i].size = size;
+ }
+ 
+ /**
+  * Count a file the way the engine would treat it
+  */
+ static void plan_file(PlanRun *job, const char *relative_path, const WIN32_FIND_DATA *fd,
+                       PlanFile *largest, int *largest_count)
+ {
+     BackupPlan *plan = job->plan;
+     ULARGE_INTEGER mtime;
+     LONGLONG size = ((LONGLONG)fd->nFileSizeHigh << 32) | fd->nFileSizeLow;
+     ManifestEntry entry;
+ 
+     mtime.LowPart = fd->ftLastWriteTime.dwLowDateTime;
+     mtime.HighPart = fd->ftLastWriteTime.dwHighDateTime;
+     if (job->modified_after && mtime.QuadPart < job->modified_after)
+         return;
+ 
+     InterlockedIncrement(&plan->files);
+     InterlockedExchangeAdd64(&plan->bytes, size);
+     add_largest(largest, largest_count, relative_path, size);
+ 
+     // Same size and time as in the manifest: skipped, or linked by rotation
+     if (job->manifest && manifest_lookup(job->manifest, relative_path, &entry) &&
+         entry.size == (ULONGLONG)size && entry.mtime == mtime.QuadPart)
+     {
+         InterlockedIncrement(&plan->files_unchanged);
+         return;
+     }
+ 
+     InterlockedIncrement(&plan->files_write);
+     InterlockedExchangeAdd64(&plan->bytes_write, size);
+ }
+ 
+ static void list_directory(PlanRun *job, const char *relative_dir, PlanFile *largest, int *largest_count)
+ {
+     char search_path[MAX_PATH_LEN], relative_path[MAX_PATH_LEN];
+     WIN32_FIND_DATA fd;
+     HANDLE hFind;
+ 
+     if (relative_dir[0])
+         snprintf(search_path, sizeof(search_path), "%s\\%s\\*", job->options->source_path, relative_dir);
+     else
+         snprintf(search_path, sizeof(search_path), "%s\\*", job->options->source_path);
+ 
+     hFind = find_first(search_path, &fd);
+     if (hFind == INVALID_HANDLE_VALUE)
+     {
+         // The source itself must be listable, subdirectories may vanish meanwhile
+         if (!relative_dir[0])
+             job->failed = TRUE;
+         return;
+     }
+ 
+     InterlockedIncrement(&job->plan->dirs);
+     do
+     {
+         if (strcmp(fd.cFileName, ".") == 0 || strcmp(fd.cFileName, "..") == 0)
+             continue;
+ 
+         if (relative_dir[0])
+             snprintf(relative_path, sizeof(relative_path), "%s\\%s", relative_dir, fd.cFileName);
+         else
+             snprintf(relative_path, sizeof(relative_path), "%s", fd.cFileName);
+ 
+         if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+         {
+             if (job->options->include_subdirs && !filter_prune_directory(job->filter, relative_path) &&
+                 !push_dir(job, relative_path))
+                 job->failed = TRUE;
+         }
+         else if (filter_match_file(job->filter, relative_path))
+         {
+             plan_file(job, relative_path, &fd, largest, largest_count);
+         }
+     } while (!job->plan->cancelled && FindNextFile(hFind, &fd));
+ 
+     FindClose(hFind);
+ }
+ 
+ /**
+  * Walker: lists directories until none is queued or being listed
+  */
+ static DWORD WINAPI plan_thread(LPVOID param)
+ {
+     PlanRun *job = (PlanRun *)param;
+     PlanFile largest[PLAN_LARGEST_FILES];
+     int largest_count = 0;
+ 
+     while (job->pending > 0 && !job->plan->cancelled)
+     {
+         char *dir = pop_dir(job);
+ 
+         if (!dir)
+         {
+             // Directories still being listed may queue more
+             Sleep(1);
+             continue;
+         }
+         list_directory(job, dir, largest, &largest_count);
+         free(dir);
+         InterlockedDecrement(&job->pending);
+     }
+ 
+     EnterCriticalSection(&job->lock);
+     for (int i = 0; i < largest_count; i++)
+         add_largest(job->plan->largest, &job->plan->largest_count, largest[i].path, largest[i].size);
+     LeaveCriticalSection(&job->lock);
+     return 0;
+ }
+ 
+ BOOL backup_plan(const BackupOptions *options, BackupPlan *plan)
+ {
+     PlanRun job;
+     HANDLE workers[PLAN_MAX_THREADS];
+     SYSTEM_INFO si;
+     DWORD start = GetTickCount();
+     int worker_count = 0;
+     double rate;
+ 
+     memset(&job, 0, sizeof(job));
+     job.options = options;
+     job.plan = plan;
+     job.filter = filter_compile(options->extensions, options->excludes);
+     if (!job.filter)
+         return FALSE;
+     InitializeCriticalSection(&job.lock);
+ 
+     // Incremental copies compare with the target, rotation with its newest snapshot
+     if (options->mode == BACKUP_MODE_COPY && options->incremental)
+     {
+         job.manifest = manifest_load(options->target_path);
+     }
+     else if (options->mode == BACKUP_MODE_ROTATION)
+     {
+         RotationSnapshot *snapshots = (RotationSnapshot *)malloc(ROTATION_MAX_SNAPSHOTS * sizeof(RotationSnapshot));
+         int count = snapshots ? rotation_list(options->target_path, snapshots, ROTATION_MAX_SNAPSHOTS) : 0;
+         char dir[MAX_PATH_LEN];
+ 
+         if (count > 0)
+         {
+             snprintf(dir, sizeof(dir), "%s\\%s", options->target_path, snapshots[0].id);
+             job.manifest = manifest_load(dir);
+         }
+         free(snapshots);
+     }
+     plan->manifest = job.manifest && manifest_count(job.manifest) > 0;
+ 
+     // Plain copies take only files modified in the last N days
+     if (options->mode == BACKUP_MODE_COPY && !options->incremental && options->days > 0)
+     {
+         SYSTEMTIME st;
+         FILETIME now;
+         ULARGE_INTEGER value;
+ 
+         GetSystemTime(&st);
+         SystemTimeToFileTime(&st, &now);
+         value.LowPart = now.dwLowDateTime;
+         value.HighPart = now.dwHighDateTime;
+         job.modified_after = value.QuadPart - (ULONGLONG)options->days * 864000000000ULL;
+     }
+ 
+     // Listing waits on the file system, two walkers per CPU overlap the waits
+     GetSystemInfo(&si);
+     plan->threads = 2 * (int)si.dwNumberOfProcessors;
+     if (plan->threads > PLAN_MAX_THREADS)
+         plan->threads = PLAN_MAX_THREADS;
+     if (plan->threads < 1)
+         plan->threads = 1;
+ 
+     if (push_dir(&job, ""))
+     {
+         for (int i = 0; i < plan->threads; i++)
+         {
+             workers[worker_count] = CreateThread(NULL, 0, plan_thread, &job, 0, NULL);
+             if (workers[worker_count])
+                 worker_count++;
+         }
+         if (worker_count == 0)
+             plan_thread(&job);
+         else
+             WaitForMultipleObjects(worker_count, workers, TRUE, INFINITE);
+         for (int i = 0; i < worker_count; i++)
+             CloseHandle(workers[i]);
+         plan->threads = worker_count > 0 ? worker_count : 1;
+     }
+     else
+     {
+         job.failed = TRUE;
+     }
+     plan->scan_ms = GetTickCount() - start;
+ 
+     // Archives compress on every CPU unless told otherwise; an I/O limit caps any mode
+     if (options->mode == BACKUP_MODE_ARCHIVE)
+         rate = PLAN_ARCHIVE_MB_PER_S * (options->threads > 0 ? options->threads : (int)si.dwNumberOfProcessors);
+     else
+         rate = PLAN_WRITE_MB_PER_S;
+     if (options->bandwidth_mb > 0 && options->bandwidth_mb < rate)
+         rate = options->bandwidth_mb;
+     plan->estimated_ms = (DWORD)(plan->bytes_write / 1048576.0 / rate * 1000.0 +
+                                  plan->files_write * 1000.0 / PLAN_FILES_PER_S +
+                                  plan->files_unchanged * 1000.0 / PLAN_UNCHANGED_PER_S);
+ 
+     while (job.dir_count > 0)
+         free(job.dirs[--job.dir_count]);
+     free(job.dirs);
+     if (job.manifest)
+         manifest_free(job.manifest);
+     filter_free(job.filter);
+     DeleteCriticalSection(&job.lock);
+ 
+     return !job.failed && !plan->cancelled;
+ }
+ 
+ void backup_plan_format_report(const BackupOptions *options, const BackupPlan *plan, char *buffer, size_t size)
+ {
+     DWORD seconds = (plan->estimated_ms + 999) / 1000;
+     int used;
+ 
+     used = snprintf(buffer, size, "%ld files, %.1f MB in %ld directories (listed in %.1f s on %d threads).",
+                     plan->files, plan->bytes / 1048576.0, plan->dirs, plan->scan_ms / 1000.0, plan->threads);
+ 
+     if (used > 0 && (size_t)used < size)
+     {
+         if (plan->manifest)
+             used += snprintf(buffer + used, size - used, "\n%ld files (%.1f MB) changed since the last backup, %ld %s.",
+                              plan->files_write, plan->bytes_write / 1048576.0, plan->files_unchanged,
+                              options->mode == BACKUP_MODE_ROTATION ? "would be hardlinked" : "are unchanged");
+         else if (options->mode == BACKUP_MODE_STORE)
+             used += snprintf(buffer + used, size - used,
+                              "\nAll of them are read; the repository skips unchanged files and stores new data once.");
+         else
+             used += snprintf(buffer + used, size - used, "\nAll %ld files would be %s.", plan->files_write,
+                              options->mode == BACKUP_MODE_ARCHIVE ? "archived" : "copied");
+     }
+ 
+     if (used > 0 && (size_t)used < size)
+         used += snprintf(buffer + used, size - used, "\nEstimated duration: %s%lu min %02lu s.",
+                          options->mode == BACKUP_MODE_STORE ? "at most " : "", seconds / 60, seconds % 60);
+ 
+     if (used > 0 && (size_t)used < size && plan->largest_count > 0)
+         used += snprintf(buffer + used, size - used, "\n\nLargest files:");
+     for (int i = 0; i < plan->largest_count && used > 0 && (size_t)used < size; i++)
+         used += snprintf(buffer + used, size - used, "\n%10.1f MB  %s", plan->largest[i].size / 1048576.0,
+                          plan->largest[i].path);
+ }
\ No newline at end of file
@@ -0,0 +1,74 @@
+/*******************************************************************************
+ * Backup Plan Module Header
+ * Dry run of a backup: lists the source tree on parallel walkers with the
+ * same rules as the engine and tells how many files and bytes a run would
+ * touch, which files are the largest and roughly how long it would take
+ *******************************************************************************/
+#ifndef BACKUP_PLAN_H
+#define BACKUP_PLAN_H
+
+#include <windows.h>
+#include "backup_utils.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Maximum path length constant (if not already defined)
+#ifndef MAX_PATH_LEN
+#define MAX_PATH_LEN 260
+#endif
+
+// Upper bound of the plan walkers
+#define PLAN_MAX_THREADS 16
+
+// Largest files listed in a plan
+#define PLAN_LARGEST_FILES 10
+
+// File of the largest files list
+typedef struct
+{
+    char path[MAX_PATH_LEN];  // Relative to the source
+    LONGLONG size;
+} PlanFile;
+
+// Result of a dry run, live while it runs
+typedef struct
+{
+    volatile LONG dirs;               // Directories listed
+    volatile LONG files;              // Files the backup selects
+    volatile LONGLONG bytes;
+    volatile LONG files_write;        // Files the backup would write
+    volatile LONGLONG bytes_write;
+    volatile LONG files_unchanged;    // Files the manifest knows unchanged (linked in rotation mode)
+    volatile LONG cancelled;          // Set to stop the plan
+    int threads;                      // Walkers used
+    BOOL manifest;                    // Compared against a manifest
+    DWORD scan_ms;                    // Wall time of the listing
+    DWORD estimated_ms;               // Estimated duration of the backup
+    int largest_count;
+    PlanFile largest[PLAN_LARGEST_FILES];  // Largest selected files, largest first
+} BackupPlan;
+
+/**
+ * Plan a backup without copying anything
+ * @param options Backup options as they would be passed to backup_directory
+ * @param plan Zeroed plan, updated while the source is listed
+ * @return TRUE if the whole tree was listed
+ */
+BOOL backup_plan(const BackupOptions *options, BackupPlan *plan);
+
+/**
+ * Summarize a plan for a message box
+ * @param options Backup options of the plan
+ * @param plan Finished plan
+ * @param buffer Receives the report
+ * @param size Size of the buffer
+ */
+void backup_plan_format_report(const BackupOptions *options, const BackupPlan *plan, char *buffer, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BACKUP_PLAN_H */
\ No newline at end of file
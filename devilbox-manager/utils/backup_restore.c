@@ -0,0 +1,1333 @@
+/*******************************************************************************
+ * Backup Restore Module Implementation
+ * Source listing, tree and archive restores on worker threads, the tar
+ * stream parser and the database replay thread
+ *******************************************************************************/
+
+ #include "backup_restore.h"
+ #include "backup_utils.h"
+ #include "backup_manifest.h"
+ #include "backup_rotation.h"
+ #include "archive_writer.h"
+ #include "deflate.h"
+ #include "hash_utils.h"
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ 
+ // Copy buffer of a tree restore worker
+ #define RESTORE_BUFFER_SIZE (1024 * 1024)
+ 
+ // Archive entries up to this size are read whole and written by the workers,
+ // larger ones are written by the tar parser as they are decompressed
+ #define RESTORE_SMALL_FILE (1024 * 1024)
+ 
+ // Small archive entries waiting for a worker
+ #define RESTORE_QUEUE_SIZE 64
+ 
+ // Longest pax header or GNU long name accepted
+ #define TAR_MAX_META (64 * 1024)
+ 
+ #define TAR_RECORD 512
+ 
+ // Seconds between 1601-01-01 (FILETIME) and 1970-01-01 (tar)
+ #define UNIX_EPOCH_OFFSET 11644473600LL
+ 
+ // File of a tree restore
+ typedef struct
+ {
+     char *path;      // Relative to the source
+     ULONGLONG size;
+     ULONGLONG mtime;
+     ULONGLONG hash;  // Manifest hash of the content
+     BOOL verify;     // The manifest vouches for this file, hash is checked
+ } TreeFile;
+ 
+ // Shared state of a tree restore
+ typedef struct
+ {
+     const RestoreOptions *options;
+     RestoreProgress *progress;
+     BackupManifest *manifest;
+     TreeFile *files;
+     int count;
+     int capacity;
+     volatile LONG next;
+     CRITICAL_SECTION lock;  // Guards progress->error
+ } TreeRestore;
+ 
+ // Archive entry read whole, waiting for a worker
+ typedef struct
+ {
+     char target[MAX_PATH_LEN];
+     ULONGLONG mtime;
+     size_t size;
+     BYTE data[1];
+ } ArchiveEntry;
+ 
+ // Shared state of an archive restore
+ typedef struct
+ {
+     const RestoreOptions *options;
+     RestoreProgress *progress;
+     CRITICAL_SECTION lock;  // Guards the queue and progress->error
+ 
+     // Small entries on their way to the workers
+     ArchiveEntry *queue[RESTORE_QUEUE_SIZE];
+     int head;
+     int tail;
+     HANDLE free_slots;
+     HANDLE used_slots;
+ 
+     // Tar stream state
+     BYTE header[TAR_RECORD];
+     size_t header_len;
+     int zero_records;
+     BOOL ended;
+     BOOL failed;
+     char type;                // Type of the entry whose data follows
+     ULONGLONG remaining;      // Data bytes of the entry still to come
+     ULONGLONG padding;        // Bytes up to the next record after the data
+     char *meta;               // Data of a pax header or long name
+     size_t meta_len;
+     char long_name[MAX_PATH_LEN];
+     char target[MAX_PATH_LEN];
+     ULONGLONG mtime;
+     ULONGLONG size;
+     BOOL skip;                // The entry is already in place or not a file
+     ArchiveEntry *entry;      // Small entry being collected
+     HANDLE file;              // Large entry being written
+     char temp[MAX_PATH_LEN + 16];
+     BOOL file_ok;
+ } ArchiveRestore;
+ 
+ static void archive_data_end(ArchiveRestore *archive);
+ 
+ static BOOL is_cancelled(const RestoreProgress *progress)
+ {
+     return progress->cancelled != 0;
+ }
+ 
+ /**
+  * Record the first error of the file restore
+  */
+ static void set_error(RestoreProgress *progress, CRITICAL_SECTION *lock, const char *message)
+ {
+     EnterCriticalSection(lock);
+     if (!progress->error[0])
+     {
+         strncpy(progress->error, message, sizeof(progress->error) - 1);
+         progress->error[sizeof(progress->error) - 1] = '\0';
+     }
+     LeaveCriticalSection(lock);
+ }
+ 
+ static BOOL directory_exists(const char *path)
+ {
+     DWORD attributes = GetFileAttributes(path);
+     return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY);
+ }
+ 
+ /**
+  * A directory holding a database dump written beside the files
+  */
+ static BOOL is_dump_dir(const char *path)
+ {
+     char schema[MAX_PATH_LEN];
+ 
+     snprintf(schema, sizeof(schema), "%s\\%s", path, DB_DUMP_SCHEMA_FILE);
+     return GetFileAttributes(schema) != INVALID_FILE_ATTRIBUTES;
+ }
+ 
+ static BOOL has_suffix(const char *name, const char *suffix)
+ {
+     size_t len = strlen(name), suffix_len = strlen(suffix);
+     return len > suffix_len && _stricmp(name + len - suffix_len, suffix) == 0;
+ }
+ 
+ static ULONGLONG filetime_value(const FILETIME *time)
+ {
+     return ((ULONGLONG)time->dwHighDateTime << 32) | time->dwLowDateTime;
+ }
+ 
+ /*******************************************************************************
+  * Restored files
+  *******************************************************************************/
+ 
+ BOOL restore_file_current(const char *target, ULONGLONG size, ULONGLONG mtime)
+ {
+     WIN32_FILE_ATTRIBUTE_DATA data;
+ 
+     if (!GetFileAttributesEx(target, GetFileExInfoStandard, &data) ||
+         (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+         return FALSE;
+     return (((ULONGLONG)data.nFileSizeHigh << 32) | data.nFileSizeLow) == size &&
+            filetime_value(&data.ftLastWriteTime) == mtime;
+ }
+ 
+ HANDLE restore_file_create(const char *target, char *temp, size_t temp_size, ULONGLONG size)
+ {
+     char dir[MAX_PATH_LEN];
+     char *slash;
+     HANDLE file;
+ 
+     if (snprintf(temp, temp_size, "%s" RESTORE_TEMP_SUFFIX, target) >= (int)temp_size)
+         return INVALID_HANDLE_VALUE;
+ 
+     strncpy(dir, target, sizeof(dir) - 1);
+     dir[sizeof(dir) - 1] = '\0';
+     slash = strrchr(dir, '\\');
+     if (slash)
+     {
+         *slash = '\0';
+         create_directory_path(dir);
+     }
+ 
+     file = CreateFile(temp, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                       FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+ 
+     // Reserving the space up front keeps large files in few fragments
+     if (file != INVALID_HANDLE_VALUE && size > RESTORE_SMALL_FILE)
+     {
+         LARGE_INTEGER end, start;
+ 
+         end.QuadPart = (LONGLONG)size;
+         start.QuadPart = 0;
+         if (SetFilePointerEx(file, end, NULL, FILE_BEGIN))
+             SetEndOfFile(file);
+         SetFilePointerEx(file, start, NULL, FILE_BEGIN);
+     }
+     return file;
+ }
+ 
+ BOOL restore_file_finish(HANDLE file, const char *temp, const char *target, ULONGLONG mtime, BOOL ok)
+ {
+     FILETIME time;
+ 
+     time.dwLowDateTime = (DWORD)mtime;
+     time.dwHighDateTime = (DWORD)(mtime >> 32);
+     if (ok && mtime)
+         ok = SetFileTime(file, NULL, NULL, &time);
+     CloseHandle(file);
+ 
+     if (ok)
+         ok = MoveFileEx(temp, target, MOVEFILE_REPLACE_EXISTING);
+     if (!ok)
+         DeleteFile(temp);
+     return ok;
+ }
+ 
+ /*******************************************************************************
+  * Source listing
+  *******************************************************************************/
+ 
+ static int compare_sources(const void *a, const void *b)
+ {
+     // Run names end in their time, so each project's newest archive comes first
+     return -strcmp(((const RestoreSource *)a)->name, ((const RestoreSource *)b)->name);
+ }
+ 
+ /**
+  * Directory holds copied files: anything besides archives, dumps and
+  * restore leftovers
+  */
+ static BOOL has_copied_files(const char *dir)
+ {
+     char search_path[MAX_PATH_LEN];
+     WIN32_FIND_DATA fd;
+     HANDLE hFind;
+     BOOL found = FALSE;
+ 
+     snprintf(search_path, sizeof(search_path), "%s\\*", dir);
+     hFind = FindFirstFile(search_path, &fd);
+     if (hFind == INVALID_HANDLE_VALUE)
+         return FALSE;
+ 
+     do
+     {
+         char path[MAX_PATH_LEN];
+ 
+         if (strcmp(fd.cFileName, ".") == 0 || strcmp(fd.cFileName, "..") == 0 ||
+             has_suffix(fd.cFileName, ARCHIVE_EXTENSION) || has_suffix(fd.cFileName, RESTORE_TEMP_SUFFIX) ||
+             _stricmp(fd.cFileName, MANIFEST_DELETIONS_FILE_NAME) == 0)
+             continue;
+ 
+         snprintf(path, sizeof(path), "%s\\%s", dir, fd.cFileName);
+         if (!(fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) || !is_dump_dir(path))
+             found = TRUE;
+     } while (!found && FindNextFile(hFind, &fd));
+ 
+     FindClose(hFind);
+     return found;
+ }
+ 
+ /**
+  * Newest database dump in a directory of copy backups; dumps that belong
+  * to an archive of the same run are left to the archive
+  */
+ static void find_newest_dump(const char *dir, char *dump_dir, size_t size)
+ {
+     char search_path[MAX_PATH_LEN];
+     WIN32_FIND_DATA fd;
+     ULONGLONG newest = 0;
+     HANDLE hFind;
+ 
+     dump_dir[0] = '\0';
+     snprintf(search_path, sizeof(search_path), "%s\\*.db", dir);
+     hFind = FindFirstFile(search_path, &fd);
+     if (hFind == INVALID_HANDLE_VALUE)
+         return;
+ 
+     do
+     {
+         char path[MAX_PATH_LEN], archive[MAX_PATH_LEN];
+ 
+         snprintf(path, sizeof(path), "%s\\%s", dir, fd.cFileName);
+         snprintf(archive, sizeof(archive), "%.*s" ARCHIVE_EXTENSION, (int)strlen(path) - 3, path);
+         if ((fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && is_dump_dir(path) &&
+             GetFileAttributes(archive) == INVALID_FILE_ATTRIBUTES && filetime_value(&fd.ftLastWriteTime) >= newest)
+         {
+             newest = filetime_value(&fd.ftLastWriteTime);
+             snprintf(dump_dir, size, "%s", path);
+         }
+     } while (FindNextFile(hFind, &fd));
+ 
+     FindClose(hFind);
+ }
+ 
+ int restore_list_sources(const char *repo_path, const char *backup_dir, RestoreSource *sources, int max)
+ {
+     StoreSnapshotInfo *infos = (StoreSnapshotInfo *)malloc(STORE_MAX_SNAPSHOTS * sizeof(StoreSnapshotInfo));
+     RotationSnapshot *rotation;
+     int count = 0, archives, rotated = 0;
+ 
+     // Repository snapshots, each with the dump taken in the same run
+     if (infos && repo_path && repo_path[0])
+     {
+         int snapshots = store_list_snapshots(repo_path, infos, STORE_MAX_SNAPSHOTS);
+ 
+         for (int i = 0; i < snapshots && count < max; i++)
+         {
+             RestoreSource *source = &sources[count++];
+ 
+             memset(source, 0, sizeof(*source));
+             source->kind = RESTORE_SOURCE_SNAPSHOT;
+             snprintf(source->path, sizeof(source->path), "%s", repo_path);
+             snprintf(source->snapshot_id, sizeof(source->snapshot_id), "%s", infos[i].id);
+             snprintf(source->name, sizeof(source->name), "%s", infos[i].id);
+             snprintf(source->origin, sizeof(source->origin), "%s", infos[i].source);
+             snprintf(source->dump_dir, sizeof(source->dump_dir), "%s\\snapshots\\%s.db", repo_path, infos[i].id);
+             if (!is_dump_dir(source->dump_dir))
+                 source->dump_dir[0] = '\0';
+             snprintf(source->description, sizeof(source->description), "Snapshot  %s   %s   %lld files   %.1f MB%s   %s",
+                      infos[i].id, infos[i].time, infos[i].files, infos[i].bytes / 1048576.0,
+                      source->dump_dir[0] ? " + database" : "", infos[i].source);
+         }
+     }
+     free(infos);
+ 
+     if (!backup_dir || !backup_dir[0] || !directory_exists(backup_dir))
+         return count;
+ 
+     // Rotation snapshots from their index, each restored as a tree
+     rotation = (RotationSnapshot *)malloc(ROTATION_MAX_SNAPSHOTS * sizeof(RotationSnapshot));
+     if (rotation)
+     {
+         int snapshots = rotation_list(backup_dir, rotation, ROTATION_MAX_SNAPSHOTS);
+ 
+         for (int i = 0; i < snapshots && count < max; i++)
+         {
+             RestoreSource *source = &sources[count];
+ 
+             memset(source, 0, sizeof(*source));
+             source->kind = RESTORE_SOURCE_TREE;
+             snprintf(source->path, sizeof(source->path), "%s\\%s", backup_dir, rotation[i].id);
+             if (!directory_exists(source->path))
+                 continue;
+             snprintf(source->name, sizeof(source->name), "%s", rotation[i].id);
+             find_newest_dump(source->path, source->dump_dir, sizeof(source->dump_dir));
+             snprintf(source->description, sizeof(source->description), "Rotation  %s   %lld files   %.1f MB%s",
+                      rotation[i].id, rotation[i].files, rotation[i].bytes / 1048576.0,
+                      source->dump_dir[0] ? " + database" : "");
+             count++;
+             rotated++;
+         }
+         free(rotation);
+     }
+ 
+     // Archives, each with the dump of its run
+     archives = count;
+     {
+         char search_path[MAX_PATH_LEN];
+         WIN32_FIND_DATA fd;
+         HANDLE hFind;
+ 
+         snprintf(search_path, sizeof(search_path), "%s\\*" ARCHIVE_EXTENSION, backup_dir);
+         hFind = FindFirstFile(search_path, &fd);
+         if (hFind != INVALID_HANDLE_VALUE)
+         {
+             do
+             {
+                 size_t len = strlen(fd.cFileName) - (sizeof(ARCHIVE_EXTENSION) - 1);
+                 RestoreSource *source;
+ 
+                 if ((fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) || !has_suffix(fd.cFileName, ARCHIVE_EXTENSION))
+                     continue;
+                 if (count >= max)
+                     break;
+ 
+                 source = &sources[count++];
+                 memset(source, 0, sizeof(*source));
+                 source->kind = RESTORE_SOURCE_ARCHIVE;
+                 snprintf(source->path, sizeof(source->path), "%s\\%s", backup_dir, fd.cFileName);
+                 snprintf(source->name, sizeof(source->name), "%.*s", (int)len, fd.cFileName);
+                 snprintf(source->dump_dir, sizeof(source->dump_dir), "%s\\%s.db", backup_dir, source->name);
+                 if (!is_dump_dir(source->dump_dir))
+                     source->dump_dir[0] = '\0';
+                 snprintf(source->description, sizeof(source->description), "Archive   %s   %.1f MB%s",
+                          fd.cFileName, (((ULONGLONG)fd.nFileSizeHigh << 32) | fd.nFileSizeLow) / 1048576.0,
+                          source->dump_dir[0] ? " + database" : "");
+             } while (FindNextFile(hFind, &fd));
+             FindClose(hFind);
+         }
+         qsort(sources + archives, count - archives, sizeof(RestoreSource), compare_sources);
+     }
+ 
+     // The copy backup directory itself, unless it holds rotation snapshots
+     if (count < max && !rotated && has_copied_files(backup_dir))
+     {
+         RestoreSource *source = &sources[count++];
+         BackupManifest *manifest = manifest_load(backup_dir);
+         const char *name = strrchr(backup_dir, '\\');
+ 
+         memset(source, 0, sizeof(*source));
+         source->kind = RESTORE_SOURCE_TREE;
+         snprintf(source->path, sizeof(source->path), "%s", backup_dir);
+         snprintf(source->name, sizeof(source->name), "%s", name && name[1] ? name + 1 : backup_dir);
+         find_newest_dump(backup_dir, source->dump_dir, sizeof(source->dump_dir));
+         if (manifest && manifest_count(manifest) > 0)
+             snprintf(source->description, sizeof(source->description), "Folder    %s   %d files in manifest%s",
+                      backup_dir, manifest_count(manifest), source->dump_dir[0] ? " + database" : "");
+         else
+             snprintf(source->description, sizeof(source->description), "Folder    %s%s",
+                      backup_dir, source->dump_dir[0] ? " + database" : "");
+         if (manifest)
+             manifest_free(manifest);
+     }
+ 
+     return count;
+ }
+ 
+ /*******************************************************************************
+  * Tree restore
+  *******************************************************************************/
+ 
+ static BOOL tree_add(TreeRestore *tree, const char *relative_path, const WIN32_FIND_DATA *fd)
+ {
+     ManifestEntry entry;
+     TreeFile *file;
+ 
+     if (tree->count == tree->capacity)
+     {
+         int capacity = tree->capacity ? tree->capacity * 2 : 1024;
+         TreeFile *grown = (TreeFile *)realloc(tree->files, capacity * sizeof(TreeFile));
+         if (!grown)
+             return FALSE;
+         tree->files = grown;
+         tree->capacity = capacity;
+     }
+ 
+     file = &tree->files[tree->count];
+     file->path = _strdup(relative_path);
+     if (!file->path)
+         return FALSE;
+     file->size = ((ULONGLONG)fd->nFileSizeHigh << 32) | fd->nFileSizeLow;
+     file->mtime = filetime_value(&fd->ftLastWriteTime);
+ 
+     // Copy backups that ignore the manifest leave stale entries: only one
+     // that still describes the file is trusted for its hash
+     file->verify = tree->manifest && manifest_lookup(tree->manifest, relative_path, &entry) &&
+                    entry.size == file->size && entry.mtime == file->mtime;
+     file->hash = file->verify ? entry.hash : 0;
+ 
+     tree->count++;
+     tree->progress->files.files_total = tree->count;
+     tree->progress->files.bytes_total += (LONGLONG)file->size;
+     return TRUE;
+ }
+ 
+ /**
+  * List the files of a copy backup, without the manifest, dumps and
+  * leftovers of earlier restores
+  */
+ static BOOL tree_scan(TreeRestore *tree, const char *dir, const char *relative_dir)
+ {
+     char search_path[MAX_PATH_LEN];
+     WIN32_FIND_DATA fd;
+     HANDLE hFind;
+     BOOL ok = TRUE;
+ 
+     snprintf(search_path, sizeof(search_path), "%s\\*", dir);
+     hFind = FindFirstFile(search_path, &fd);
+     if (hFind == INVALID_HANDLE_VALUE)
+         return TRUE;
+ 
+     do
+     {
+         char path[MAX_PATH_LEN], relative_path[MAX_PATH_LEN];
+ 
+         if (strcmp(fd.cFileName, ".") == 0 || strcmp(fd.cFileName, "..") == 0 ||
+             has_suffix(fd.cFileName, RESTORE_TEMP_SUFFIX))
+             continue;
+         if (!relative_dir[0] && (_strnicmp(fd.cFileName, MANIFEST_FILE_NAME, strlen(MANIFEST_FILE_NAME)) == 0 ||
+                                  _stricmp(fd.cFileName, MANIFEST_DELETIONS_FILE_NAME) == 0))
+             continue;
+ 
+         // Archive backups written into the same directory are not part of the tree
+         if (!relative_dir[0] && has_suffix(fd.cFileName, ARCHIVE_EXTENSION) &&
+             !(tree->manifest && manifest_lookup(tree->manifest, fd.cFileName, NULL)))
+             continue;
+ 
+         snprintf(path, sizeof(path), "%s\\%s", dir, fd.cFileName);
+         if (relative_dir[0])
+             snprintf(relative_path, sizeof(relative_path), "%s\\%s", relative_dir, fd.cFileName);
+         else
+             snprintf(relative_path, sizeof(relative_path), "%s", fd.cFileName);
+ 
+         if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+         {
+             if (!is_dump_dir(path))
+                 ok = tree_scan(tree, path, relative_path);
+         }
+         else
+         {
+             ok = tree_add(tree, relative_path, &fd);
+         }
+     } while (ok && !is_cancelled(tree->progress) && FindNextFile(hFind, &fd));
+ 
+     FindClose(hFind);
+     return ok;
+ }
+ 
+ /**
+  * Copy one file of a tree, hashing it on the way when the manifest has
+  * its hash
+  */
+ static BOOL tree_restore_file(TreeRestore *tree, const TreeFile *file, BYTE *buffer)
+ {
+     char source_file[MAX_PATH_LEN], target_file[MAX_PATH_LEN], temp_file[MAX_PATH_LEN + 16];
+     char message[MAX_PATH_LEN + 64];
+     StoreRestoreProgress *progress = &tree->progress->files;
+     LONGLONG reported = 0;
+     HashState hash;
+     HANDLE source, target;
+     BOOL ok = TRUE;
+     DWORD got = 0, written;
+ 
+     snprintf(source_file, sizeof(source_file), "%s\\%s", tree->options->source.path, file->path);
+     snprintf(target_file, sizeof(target_file), "%s\\%s", tree->options->target_path, file->path);
+     if (restore_file_current(target_file, file->size, file->mtime))
+     {
+         InterlockedExchangeAdd64(&progress->bytes_done, (LONGLONG)file->size);
+         InterlockedExchangeAdd64(&progress->bytes_skipped, (LONGLONG)file->size);
+         InterlockedIncrement(&progress->files_skipped);
+         return TRUE;
+     }
+ 
+     source = CreateFile(source_file, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                         FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+     if (source == INVALID_HANDLE_VALUE)
+     {
+         snprintf(message, sizeof(message), "Cannot open %s", source_file);
+         set_error(tree->progress, &tree->lock, message);
+         return FALSE;
+     }
+     target = restore_file_create(target_file, temp_file, sizeof(temp_file), file->size);
+     if (target == INVALID_HANDLE_VALUE)
+     {
+         CloseHandle(source);
+         snprintf(message, sizeof(message), "Cannot create %s", target_file);
+         set_error(tree->progress, &tree->lock, message);
+         return FALSE;
+     }
+ 
+     hash_init(&hash, 0);
+     while (ok && !is_cancelled(tree->progress))
+     {
+         ok = ReadFile(source, buffer, RESTORE_BUFFER_SIZE, &got, NULL);
+         if (!ok || got == 0)
+             break;
+         if (file->verify)
+             hash_update(&hash, buffer, got);
+         ok = WriteFile(target, buffer, got, &written, NULL) && written == got;
+         if (ok)
+         {
+             InterlockedExchangeAdd64(&progress->bytes_done, got);
+             reported += got;
+         }
+     }
+     CloseHandle(source);
+ 
+     if (ok && is_cancelled(tree->progress))
+         ok = FALSE;
+     else if (ok && file->verify && hash_final(&hash) != file->hash)
+     {
+         snprintf(message, sizeof(message), "Content does not match the manifest: %s", source_file);
+         set_error(tree->progress, &tree->lock, message);
+         ok = FALSE;
+     }
+     else if (!ok)
+     {
+         snprintf(message, sizeof(message), "Cannot copy %s (Error: %lu)", source_file, GetLastError());
+         set_error(tree->progress, &tree->lock, message);
+     }
+ 
+     ok = restore_file_finish(target, temp_file, target_file, file->mtime, ok);
+     if (!ok)
+         InterlockedExchangeAdd64(&progress->bytes_done, -reported);
+     return ok;
+ }
+ 
+ /**
+  * Tree restore worker: takes the next file until none are left
+  */
+ static DWORD WINAPI tree_restore_thread(LPVOID param)
+ {
+     TreeRestore *tree = (TreeRestore *)param;
+     StoreRestoreProgress *progress = &tree->progress->files;
+     BYTE *buffer = (BYTE *)malloc(RESTORE_BUFFER_SIZE);
+ 
+     for (;;)
+     {
+         LONG n = InterlockedIncrement(&tree->next) - 1;
+ 
+         if (n >= tree->count || is_cancelled(tree->progress))
+             break;
+ 
+         const TreeFile *file = &tree->files[n];
+         store_set_current(progress, file->path);
+ 
+         if (buffer && tree_restore_file(tree, file, buffer))
+             InterlockedIncrement(&progress->files_done);
+         else
+             InterlockedIncrement(&progress->files_failed);
+     }
+ 
+     free(buffer);
+     return 0;
+ }
+ 
+ static int compare_tree_files(const void *a, const void *b)
+ {
+     ULONGLONG size_a = ((const TreeFile *)a)->size;
+     ULONGLONG size_b = ((const TreeFile *)b)->size;
+ 
+     return size_a < size_b ? 1 : size_a > size_b ? -1 : 0;
+ }
+ 
+ /**
+  * Restore a directory of copy backups, largest files first
+  */
+ static BOOL restore_tree(const RestoreOptions *options, RestoreProgress *progress)
+ {
+     TreeRestore tree;
+     HANDLE workers[STORE_RESTORE_MAX_THREADS];
+     char source_full[MAX_PATH_LEN], target_full[MAX_PATH_LEN];
+     int worker_count = 0;
+     BOOL ok;
+ 
+     // Restoring a tree onto itself would truncate every file it reads
+     if (!GetFullPathName(options->source.path, sizeof(source_full), source_full, NULL) ||
+         !GetFullPathName(options->target_path, sizeof(target_full), target_full, NULL) ||
+         _stricmp(source_full, target_full) == 0)
+     {
+         snprintf(progress->error, sizeof(progress->error), "The target is the backup directory itself.");
+         return FALSE;
+     }
+ 
+     memset(&tree, 0, sizeof(tree));
+     tree.options = options;
+     tree.progress = progress;
+     tree.manifest = manifest_load(options->source.path);
+     InitializeCriticalSection(&tree.lock);
+ 
+     ok = tree_scan(&tree, options->source.path, "") && create_directory_path(options->target_path);
+     if (!ok && !progress->error[0])
+         snprintf(progress->error, sizeof(progress->error), "Cannot list %s", options->source.path);
+ 
+     if (ok && tree.count > 0)
+     {
+         int threads = progress->threads < tree.count ? progress->threads : tree.count;
+ 
+         qsort(tree.files, tree.count, sizeof(TreeFile), compare_tree_files);
+         for (int i = 0; i < threads; i++)
+         {
+             workers[worker_count] = CreateThread(NULL, 0, tree_restore_thread, &tree, 0, NULL);
+             if (workers[worker_count])
+                 worker_count++;
+         }
+         if (worker_count == 0)
+             tree_restore_thread(&tree);
+         else
+             WaitForMultipleObjects(worker_count, workers, TRUE, INFINITE);
+         for (int i = 0; i < worker_count; i++)
+             CloseHandle(workers[i]);
+     }
+ 
+     ok = ok && progress->files.files_done == tree.count && !is_cancelled(progress);
+ 
+     for (int i = 0; i < tree.count; i++)
+         free(tree.files[i].path);
+     free(tree.files);
+     if (tree.manifest)
+         manifest_free(tree.manifest);
+     DeleteCriticalSection(&tree.lock);
+     return ok;
+ }
+ 
+ /*******************************************************************************
+  * Archive restore
+  *******************************************************************************/
+ 
+ /**
+  * Read a tar number: octal text, or GNU base-256 when the high bit is set
+  */
+ static ULONGLONG tar_number(const BYTE *field, int width)
+ {
+     ULONGLONG value = 0;
+     int i = 0;
+ 
+     if (field[0] & 0x80)
+     {
+         for (i = 1; i < width; i++)
+             value = (value << 8) | field[i];
+         return value;
+     }
+ 
+     while (i < width && field[i] == ' ')
+         i++;
+     for (; i < width && field[i] >= '0' && field[i] <= '7'; i++)
+         value = value * 8 + (field[i] - '0');
+     return value;
+ }
+ 
+ static BOOL tar_checksum_ok(const BYTE *header)
+ {
+     unsigned int sum = 0;
+ 
+     for (int i = 0; i < TAR_RECORD; i++)
+         sum += i >= 148 && i < 156 ? ' ' : header[i];
+     return sum == (unsigned int)tar_number(header + 148, 8);
+ }
+ 
+ /**
+  * Turn an entry name into a target path. Absolute names and ".." are
+  * refused, an archive must not write outside the target.
+  */
+ static BOOL tar_target_path(const RestoreOptions *options, const char *name, char *target, size_t size)
+ {
+     char relative[MAX_PATH_LEN];
+     size_t len;
+ 
+     while (name[0] == '.' && name[1] == '/')
+         name += 2;
+     if (!name[0] || name[0] == '/' || name[0] == '\\' || strchr(name, ':'))
+         return FALSE;
+ 
+     snprintf(relative, sizeof(relative), "%s", name);
+     for (char *p = relative; *p; p++)
+         if (*p == '/')
+             *p = '\\';
+     len = strlen(relative);
+     while (len > 0 && relative[len - 1] == '\\')
+         relative[--len] = '\0';
+ 
+     for (const char *part = relative; *part;)
+     {
+         size_t part_len = strcspn(part, "\\");
+         if (part_len == 2 && part[0] == '.' && part[1] == '.')
+             return FALSE;
+         part += part_len;
+         part += strspn(part, "\\");
+     }
+ 
+     return len > 0 && snprintf(target, size, "%s\\%s", options->target_path, relative) < (int)size;
+ }
+ 
+ /**
+  * Hand a complete small entry to the workers
+  */
+ static void archive_queue_push(ArchiveRestore *archive, ArchiveEntry *entry)
+ {
+     WaitForSingleObject(archive->free_slots, INFINITE);
+     EnterCriticalSection(&archive->lock);
+     archive->queue[archive->tail] = entry;
+     archive->tail = (archive->tail + 1) % RESTORE_QUEUE_SIZE;
+     LeaveCriticalSection(&archive->lock);
+     ReleaseSemaphore(archive->used_slots, 1, NULL);
+ }
+ 
+ /**
+  * Write one small entry
+  */
+ static BOOL archive_write_entry(ArchiveRestore *archive, const ArchiveEntry *entry)
+ {
+     char temp[MAX_PATH_LEN + 16], message[MAX_PATH_LEN + 64];
+     DWORD written = 0;
+     HANDLE file;
+     BOOL ok;
+ 
+     file = restore_file_create(entry->target, temp, sizeof(temp), entry->size);
+     if (file == INVALID_HANDLE_VALUE)
+     {
+         snprintf(message, sizeof(message), "Cannot create %s", entry->target);
+         set_error(archive->progress, &archive->lock, message);
+         return FALSE;
+     }
+     ok = entry->size == 0 || (WriteFile(file, entry->data, (DWORD)entry->size, &written, NULL) && written == entry->size);
+     ok = restore_file_finish(file, temp, entry->target, entry->mtime, ok);
+     if (!ok)
+     {
+         snprintf(message, sizeof(message), "Cannot write %s", entry->target);
+         set_error(archive->progress, &archive->lock, message);
+     }
+     return ok;
+ }
+ 
+ /**
+  * Archive restore worker: writes small entries until the parser sends NULL
+  */
+ static DWORD WINAPI archive_restore_thread(LPVOID param)
+ {
+     ArchiveRestore *archive = (ArchiveRestore *)param;
+     StoreRestoreProgress *progress = &archive->progress->files;
+ 
+     for (;;)
+     {
+         ArchiveEntry *entry;
+ 
+         WaitForSingleObject(archive->used_slots, INFINITE);
+         EnterCriticalSection(&archive->lock);
+         entry = archive->queue[archive->head];
+         archive->head = (archive->head + 1) % RESTORE_QUEUE_SIZE;
+         LeaveCriticalSection(&archive->lock);
+         ReleaseSemaphore(archive->free_slots, 1, NULL);
+ 
+         if (!entry)
+             break;
+ 
+         // A cancelled restore drains the queue without writing
+         if (!is_cancelled(archive->progress) && archive_write_entry(archive, entry))
+         {
+             InterlockedExchangeAdd64(&progress->bytes_done, (LONGLONG)entry->size);
+             InterlockedIncrement(&progress->files_done);
+         }
+         else
+         {
+             InterlockedIncrement(&progress->files_failed);
+         }
+         free(entry);
+     }
+     return 0;
+ }
+ 
+ /**
+  * Start the data of a file entry: skip it when already in place, collect
+  * a small one, open a large one
+  */
+ static void archive_begin_file(ArchiveRestore *archive)
+ {
+     StoreRestoreProgress *progress = &archive->progress->files;
+     char message[MAX_PATH_LEN + 64];
+ 
+     InterlockedIncrement(&progress->files_total);
+     InterlockedExchangeAdd64(&progress->bytes_total, (LONGLONG)archive->size);
+     store_set_current(progress, archive->target + strlen(archive->options->target_path) + 1);
+ 
+     if (restore_file_current(archive->target, archive->size, archive->mtime))
+     {
+         InterlockedExchangeAdd64(&progress->bytes_done, (LONGLONG)archive->size);
+         InterlockedExchangeAdd64(&progress->bytes_skipped, (LONGLONG)archive->size);
+         InterlockedIncrement(&progress->files_skipped);
+         InterlockedIncrement(&progress->files_done);
+         archive->skip = TRUE;
+         return;
+     }
+ 
+     if (archive->size <= RESTORE_SMALL_FILE)
+     {
+         archive->entry = (ArchiveEntry *)malloc(sizeof(ArchiveEntry) + (size_t)archive->size);
+         if (archive->entry)
+         {
+             strcpy(archive->entry->target, archive->target);
+             archive->entry->mtime = archive->mtime;
+             archive->entry->size = 0;
+         }
+     }
+     else
+     {
+         archive->file = restore_file_create(archive->target, archive->temp, sizeof(archive->temp), archive->size);
+         archive->file_ok = archive->file != INVALID_HANDLE_VALUE;
+     }
+ 
+     if (!archive->entry && archive->file == INVALID_HANDLE_VALUE)
+     {
+         snprintf(message, sizeof(message), "Cannot create %s", archive->target);
+         set_error(archive->progress, &archive->lock, message);
+         InterlockedIncrement(&progress->files_failed);
+         archive->skip = TRUE;
+     }
+ }
+ 
+ /**
+  * All data of a file entry has arrived
+  */
+ static void archive_end_file(ArchiveRestore *archive)
+ {
+     StoreRestoreProgress *progress = &archive->progress->files;
+ 
+     if (archive->entry)
+     {
+         archive_queue_push(archive, archive->entry);
+         archive->entry = NULL;
+     }
+     else if (archive->file != INVALID_HANDLE_VALUE)
+     {
+         if (restore_file_finish(archive->file, archive->temp, archive->target, archive->mtime, archive->file_ok))
+         {
+             InterlockedIncrement(&progress->files_done);
+         }
+         else
+         {
+             char message[MAX_PATH_LEN + 64];
+ 
+             snprintf(message, sizeof(message), "Cannot write %s", archive->target);
+             set_error(archive->progress, &archive->lock, message);
+             InterlockedExchangeAdd64(&progress->bytes_done, -(LONGLONG)archive->size);
+             InterlockedIncrement(&progress->files_failed);
+         }
+         archive->file = INVALID_HANDLE_VALUE;
+     }
+ }
+ 
+ /**
+  * Take the path out of a pax extended header: records "<len> key=value\n"
+  */
+ static void archive_parse_pax(ArchiveRestore *archive)
+ {
+     size_t pos = 0;
+ 
+     while (pos < archive->meta_len)
+     {
+         char *record = archive->meta + pos;
+         unsigned long len = strtoul(record, NULL, 10);
+         char *key = (char *)memchr(record, ' ', archive->meta_len - pos);
+ 
+         if (len == 0 || pos + len > archive->meta_len || !key || key >= record + len)
+             break;
+         key++;
+         if (strncmp(key, "path=", 5) == 0)
+         {
+             size_t value_len = record + len - 1 - (key + 5);
+             if (value_len < sizeof(archive->long_name))
+             {
+                 memcpy(archive->long_name, key + 5, value_len);
+                 archive->long_name[value_len] = '\0';
+             }
+         }
+         pos += len;
+     }
+ }
+ 
+ /**
+  * A header record is complete: set up the entry that follows
+  */
+ static BOOL archive_header(ArchiveRestore *archive)
+ {
+     const BYTE *header = archive->header;
+     char name[MAX_PATH_LEN];
+     ULONGLONG size;
+     int i;
+ 
+     // The archive ends with two zero records
+     for (i = 0; i < TAR_RECORD && header[i] == 0; i++)
+         ;
+     if (i == TAR_RECORD)
+     {
+         if (++archive->zero_records == 2)
+             archive->ended = TRUE;
+         return TRUE;
+     }
+     archive->zero_records = 0;
+ 
+     if (!tar_checksum_ok(header))
+         return FALSE;
+ 
+     size = tar_number(header + 124, 12);
+     archive->type = header[156] ? (char)header[156] : '0';
+     archive->remaining = size;
+     archive->padding = (TAR_RECORD - size % TAR_RECORD) % TAR_RECORD;
+     archive->skip = TRUE;
+ 
+     // Pax headers and GNU long names carry the path of the next entry
+     if (archive->type == 'x' || archive->type == 'L')
+     {
+         if (size > TAR_MAX_META)
+             return FALSE;
+         archive->meta = (char *)malloc((size_t)size + 1);
+         archive->meta_len = 0;
+         if (archive->meta && size == 0)
+             archive_data_end(archive);
+         return archive->meta != NULL || size == 0;
+     }
+ 
+     if (archive->long_name[0])
+     {
+         snprintf(name, sizeof(name), "%s", archive->long_name);
+         archive->long_name[0] = '\0';
+     }
+     else if (memcmp(header + 257, "ustar", 5) == 0 && header[345])
+         snprintf(name, sizeof(name), "%.155s/%.100s", (const char *)header + 345, (const char *)header);
+     else
+         snprintf(name, sizeof(name), "%.100s", (const char *)header);
+ 
+     if (archive->type != '0' && archive->type != '7' && archive->type != '5')
+         return TRUE;
+     if (!tar_target_path(archive->options, name, archive->target, sizeof(archive->target)))
+     {
+         char message[MAX_PATH_LEN + 64];
+ 
+         snprintf(message, sizeof(message), "Entry outside the target skipped: %s", name);
+         set_error(archive->progress, &archive->lock, message);
+         InterlockedIncrement(&archive->progress->files.files_total);
+         InterlockedIncrement(&archive->progress->files.files_failed);
+         return TRUE;
+     }
+ 
+     if (archive->type == '5')
+     {
+         create_directory_path(archive->target);
+         return TRUE;
+     }
+ 
+     archive->size = size;
+     archive->mtime = (tar_number(header + 136, 12) + UNIX_EPOCH_OFFSET) * 10000000ULL;
+     archive->skip = FALSE;
+     archive_begin_file(archive);
+     if (!archive->skip && size == 0)
+         archive_end_file(archive);
+     return TRUE;
+ }
+ 
+ /**
+  * Data bytes of the current entry
+  */
+ static void archive_data(ArchiveRestore *archive, const BYTE *data, size_t len)
+ {
+     if (archive->meta)
+     {
+         memcpy(archive->meta + archive->meta_len, data, len);
+         archive->meta_len += len;
+     }
+     else if (archive->skip)
+     {
+         // Already in place or not a regular file
+     }
+     else if (archive->entry)
+     {
+         memcpy(archive->entry->data + archive->entry->size, data, len);
+         archive->entry->size += len;
+     }
+     else if (archive->file != INVALID_HANDLE_VALUE && archive->file_ok)
+     {
+         DWORD written = 0;
+ 
+         archive->file_ok = WriteFile(archive->file, data, (DWORD)len, &written, NULL) && written == len;
+         if (archive->file_ok)
+             InterlockedExchangeAdd64(&archive->progress->files.bytes_done, (LONGLONG)len);
+     }
+ }
+ 
+ /**
+  * The data of the current entry is complete
+  */
+ static void archive_data_end(ArchiveRestore *archive)
+ {
+     if (archive->meta)
+     {
+         archive->meta[archive->meta_len] = '\0';
+         if (archive->type == 'x')
+             archive_parse_pax(archive);
+         else
+             snprintf(archive->long_name, sizeof(archive->long_name), "%s", archive->meta);
+         free(archive->meta);
+         archive->meta = NULL;
+     }
+     else if (!archive->skip)
+     {
+         archive_end_file(archive);
+     }
+ }
+ 
+ /**
+  * Decompressed tar stream: a push parser over header records, entry data
+  * and padding
+  */
+ static BOOL archive_output(void *context, const BYTE *data, size_t len)
+ {
+     ArchiveRestore *archive = (ArchiveRestore *)context;
+ 
+     if (is_cancelled(archive->progress) || archive->failed)
+         return FALSE;
+ 
+     while (len > 0 && !archive->ended)
+     {
+         size_t take;
+ 
+         if (archive->remaining > 0)
+         {
+             take = len < archive->remaining ? len : (size_t)archive->remaining;
+             archive_data(archive, data, take);
+             archive->remaining -= take;
+             if (archive->remaining == 0)
+                 archive_data_end(archive);
+         }
+         else if (archive->padding > 0)
+         {
+             take = len < archive->padding ? len : (size_t)archive->padding;
+             archive->padding -= take;
+         }
+         else
+         {
+             take = TAR_RECORD - archive->header_len;
+             if (take > len)
+                 take = len;
+             memcpy(archive->header + archive->header_len, data, take);
+             archive->header_len += take;
+             if (archive->header_len == TAR_RECORD)
+             {
+                 archive->header_len = 0;
+                 if (!archive_header(archive))
+                 {
+                     archive->failed = TRUE;
+                     return FALSE;
+                 }
+             }
+         }
+         data += take;
+         len -= take;
+     }
+     return TRUE;
+ }
+ 
+ /**
+  * Restore a .tar.gz archive. Decompression is sequential, so one thread
+  * parses the stream while the workers write the small files it collects.
+  */
+ static BOOL restore_archive(const RestoreOptions *options, RestoreProgress *progress)
+ {
+     ArchiveRestore *archive = (ArchiveRestore *)calloc(1, sizeof(ArchiveRestore));
+     HANDLE workers[STORE_RESTORE_MAX_THREADS];
+     LARGE_INTEGER size;
+     int worker_count = 0;
+     HANDLE file;
+     BOOL inflated, ok;
+ 
+     if (!archive)
+         return FALSE;
+ 
+     file = CreateFile(options->source.path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                       FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+     if (file == INVALID_HANDLE_VALUE || !create_directory_path(options->target_path))
+     {
+         snprintf(progress->error, sizeof(progress->error), "Cannot open %s", options->source.path);
+         if (file != INVALID_HANDLE_VALUE)
+             CloseHandle(file);
+         free(archive);
+         return FALSE;
+     }
+     if (GetFileSizeEx(file, &size))
+         progress->source_size = size.QuadPart;
+ 
+     archive->options = options;
+     archive->progress = progress;
+     archive->file = INVALID_HANDLE_VALUE;
+     InitializeCriticalSection(&archive->lock);
+     archive->free_slots = CreateSemaphore(NULL, RESTORE_QUEUE_SIZE, RESTORE_QUEUE_SIZE, NULL);
+     archive->used_slots = CreateSemaphore(NULL, 0, RESTORE_QUEUE_SIZE, NULL);
+ 
+     // The parser thread counts as one of the workers
+     if (archive->free_slots && archive->used_slots)
+     {
+         int threads = progress->threads > 1 ? progress->threads - 1 : 1;
+ 
+         for (int i = 0; i < threads; i++)
+         {
+             workers[worker_count] = CreateThread(NULL, 0, archive_restore_thread, archive, 0, NULL);
+             if (workers[worker_count])
+                 worker_count++;
+         }
+     }
+     if (worker_count == 0)
+     {
+         snprintf(progress->error, sizeof(progress->error), "Cannot start the restore workers.");
+         ok = FALSE;
+     }
+     else
+     {
+         inflated = inflate_gzip_file(file, archive_output, archive, &progress->source_read);
+ 
+         // An entry cut off by an error or cancel is dropped
+         if (archive->file != INVALID_HANDLE_VALUE)
+         {
+             restore_file_finish(archive->file, archive->temp, archive->target, 0, FALSE);
+             InterlockedIncrement(&progress->files.files_failed);
+         }
+         free(archive->entry);
+         free(archive->meta);
+ 
+         for (int i = 0; i < worker_count; i++)
+             archive_queue_push(archive, NULL);
+         WaitForMultipleObjects(worker_count, workers, TRUE, INFINITE);
+         for (int i = 0; i < worker_count; i++)
+             CloseHandle(workers[i]);
+ 
+         if (!is_cancelled(progress) && (!inflated || !archive->ended))
+             set_error(progress, &archive->lock,
+                       archive->failed ? "The archive is damaged: bad tar header."
+                       : !inflated     ? "The archive is damaged: the compressed data is invalid."
+                                       : "The archive is truncated.");
+         ok = inflated && archive->ended && progress->files.files_failed == 0 && !is_cancelled(progress);
+     }
+ 
+     CloseHandle(file);
+     if (archive->free_slots)
+         CloseHandle(archive->free_slots);
+     if (archive->used_slots)
+         CloseHandle(archive->used_slots);
+     DeleteCriticalSection(&archive->lock);
+     free(archive);
+     return ok;
+ }
+ 
+ /*******************************************************************************
+  * Restore job
+  *******************************************************************************/
+ 
+ // Database replay thread parameter
+ typedef struct
+ {
+     const RestoreOptions *options;
+     RestoreProgress *progress;
+ } RestoreJobParam;
+ 
+ /**
+  * Replay the dump of the backup, runs beside the file restore
+  */
+ static DWORD WINAPI restore_db_thread(LPVOID param)
+ {
+     RestoreJobParam *job = (RestoreJobParam *)param;
+     DbDumpOptions db_options;
+     DWORD start = GetTickCount();
+ 
+     memset(&db_options, 0, sizeof(db_options));
+     db_options.devilbox_path = job->options->devilbox_path;
+     db_options.password = job->options->db_password;
+     job->progress->db_ok = db_restore_database(&db_options, job->options->source.dump_dir, &job->progress->db,
+                                                job->progress->db_error, sizeof(job->progress->db_error));
+     job->progress->db_ms = GetTickCount() - start;
+     return 0;
+ }
+ 
+ void restore_progress_init(RestoreProgress *progress)
+ {
+     memset(progress, 0, sizeof(*progress));
+     InitializeCriticalSection(&progress->lock);
+     progress->files.lock = &progress->lock;
+ }
+ 
+ void restore_progress_free(RestoreProgress *progress)
+ {
+     DeleteCriticalSection(&progress->lock);
+ }
+ 
+ BOOL restore_backup(const RestoreOptions *options, RestoreProgress *progress)
+ {
+     RestoreJobParam job;
+     HANDLE db_thread = NULL;
+     SYSTEM_INFO si;
+     DWORD start = GetTickCount();
+     BOOL database = options->database && options->source.dump_dir[0];
+ 
+     progress->files.cancelled = &progress->cancelled;
+     progress->db.cancelled = &progress->cancelled;
+ 
+     // Restores mostly wait for the disks, one worker per CPU keeps them busy
+     GetSystemInfo(&si);
+     progress->threads = options->threads > 0 ? options->threads : (int)si.dwNumberOfProcessors;
+     if (progress->threads > STORE_RESTORE_MAX_THREADS)
+         progress->threads = STORE_RESTORE_MAX_THREADS;
+     if (progress->threads < 1)
+         progress->threads = 1;
+ 
+     job.options = options;
+     job.progress = progress;
+     if (database)
+         db_thread = CreateThread(NULL, 0, restore_db_thread, &job, 0, NULL);
+ 
+     switch (options->source.kind)
+     {
+     case RESTORE_SOURCE_SNAPSHOT:
+         progress->files_ok = store_restore_snapshot(options->source.path, options->source.snapshot_id,
+                                                     options->target_path, progress->threads, &progress->files);
+         if (!progress->files_ok && !progress->error[0] && progress->files.files_total == 0)
+             snprintf(progress->error, sizeof(progress->error), "Snapshot %s cannot be read.",
+                      options->source.snapshot_id);
+         break;
+     case RESTORE_SOURCE_TREE:
+         progress->files_ok = restore_tree(options, progress);
+         break;
+     case RESTORE_SOURCE_ARCHIVE:
+         progress->files_ok = restore_archive(options, progress);
+         break;
+     }
+     progress->files_ms = GetTickCount() - start;
+ 
+     if (database && db_thread)
+     {
+         WaitForSingleObject(db_thread, INFINITE);
+         CloseHandle(db_thread);
+     }
+     else if (database)
+     {
+         restore_db_thread(&job);
+     }
+ 
+     return progress->files_ok && (!database || progress->db_ok);
+ }
+ 
+ void restore_format_report(const RestoreOptions *options, const RestoreProgress *progress, char *buffer, size_t size)
+ {
+     const StoreRestoreProgress *files = &progress->files;
+     double mb = (files->bytes_done - files->bytes_skipped) / 1048576.0;
+     double seconds = progress->files_ms / 1000.0;
+     int used;
+ 
+     used = snprintf(buffer, size, "Restored %ld of %ld files (%ld already in place, %ld failed), "
+                                   "%.1f MB in %.1f s, %.1f MB/s on %d threads.",
+                     files->files_done, files->files_total, files->files_skipped, files->files_failed, mb,
+                     seconds, seconds > 0 ? mb / seconds : 0.0, progress->threads);
+ 
+     if (used > 0 && (size_t)used < size && options->database && options->source.dump_dir[0])
+     {
+         if (progress->db_ok)
+             used += snprintf(buffer + used, size - used, "\nDatabase: %ld tables replayed in %.1f s.",
+                              progress->db.tables_done, progress->db_ms / 1000.0);
+         else
+             used += snprintf(buffer + used, size - used, "\nDatabase: %ld of %ld tables replayed. %s",
+                              progress->db.tables_done, progress->db.tables_total, progress->db_error);
+     }
+ 
+     if (used > 0 && (size_t)used < size && progress->error[0])
+         snprintf(buffer + used, size - used, "\n%s", progress->error);
+ }
\ No newline at end of file
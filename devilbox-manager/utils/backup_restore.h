@@ -0,0 +1,158 @@
+/*******************************************************************************
+ * Backup Restore Module Header
+ * Restores any kind of backup - a repository snapshot, a copied tree or a
+ * .tar.gz archive - on parallel workers that verify the data they write,
+ * replays its database dump beside them and resumes interrupted runs
+ *******************************************************************************/
+#ifndef BACKUP_RESTORE_H
+#define BACKUP_RESTORE_H
+
+#include <windows.h>
+#include "backup_store.h"
+#include "db_dump.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Maximum path length constant (if not already defined)
+#ifndef MAX_PATH_LEN
+#define MAX_PATH_LEN 260
+#endif
+
+// Files are written under this suffix and renamed once complete
+#define RESTORE_TEMP_SUFFIX ".restoring"
+
+// Maximum number of backups returned by restore_list_sources
+#define RESTORE_MAX_SOURCES 256
+
+// Kinds of backup that can be restored
+enum
+{
+    RESTORE_SOURCE_SNAPSHOT,  // Snapshot in the deduplicating repository
+    RESTORE_SOURCE_TREE,      // Directory written by copy backups
+    RESTORE_SOURCE_ARCHIVE    // .tar.gz written by archive backups
+};
+
+// Backup found for a restore
+typedef struct
+{
+    int kind;                         // RESTORE_SOURCE_*
+    char path[MAX_PATH_LEN];          // Repository, backup directory or archive file
+    char snapshot_id[32];             // Snapshots only
+    char name[MAX_PATH_LEN];          // Snapshot ID, run name of an archive or directory name
+    char origin[MAX_PATH_LEN];        // Directory that was backed up, empty if unknown
+    char dump_dir[MAX_PATH_LEN];      // Database dump taken with the files, empty for none
+    char description[MAX_PATH_LEN + 100];  // One line for listings
+} RestoreSource;
+
+// Restore job options as entered in the restore dialog
+typedef struct
+{
+    RestoreSource source;
+    char target_path[MAX_PATH_LEN];
+    int threads;                       // File workers, 0 for one per CPU
+    int database;                      // Replay the dump of the source into the mysql service
+    char devilbox_path[MAX_PATH_LEN];  // docker-compose project of the mysql service
+    char db_password[128];             // MYSQL_ROOT_PASSWORD from .env
+} RestoreOptions;
+
+// Live state of a running restore, shared with the progress window
+typedef struct
+{
+    StoreRestoreProgress files;
+    DbDumpProgress db;
+    volatile LONG cancelled;          // Set to stop, a later run resumes
+    volatile LONGLONG source_read;    // Archives: compressed bytes read so far
+    LONGLONG source_size;             // Archives: size of the archive file
+    int threads;                      // File workers actually used
+    DWORD files_ms;                   // Wall time of the file restore
+    DWORD db_ms;                      // Wall time of the database replay
+    BOOL files_ok;
+    BOOL db_ok;
+    char error[MAX_PATH_LEN * 2];     // First file error
+    char db_error[MAX_PATH_LEN * 2];  // First database error
+    CRITICAL_SECTION lock;            // Guards files.current
+} RestoreProgress;
+
+/**
+ * List the backups that can be restored, newest first: snapshots of the
+ * repository, rotation snapshots and archives in the backup directory and
+ * the directory itself when copy backups wrote into it
+ * @param repo_path Repository directory
+ * @param backup_dir Target directory of copy and archive backups
+ * @param sources Receives up to max backups
+ * @param max Capacity of sources
+ * @return Number of backups returned
+ */
+int restore_list_sources(const char *repo_path, const char *backup_dir, RestoreSource *sources, int max);
+
+/**
+ * Prepare the progress of a restore
+ * @param progress Progress to initialize
+ */
+void restore_progress_init(RestoreProgress *progress);
+
+/**
+ * Release the progress of a finished restore
+ * @param progress Progress set up by restore_progress_init
+ */
+void restore_progress_free(RestoreProgress *progress);
+
+/**
+ * Restore a backup into a directory and, if requested, replay its database
+ * dump at the same time. Files already in place with the same size and
+ * modification time are kept, so a cancelled restore resumes when run again.
+ * @param options Restore parameters
+ * @param progress Progress set up by restore_progress_init, updated while the restore runs
+ * @return TRUE if every file (and every table) was restored
+ */
+BOOL restore_backup(const RestoreOptions *options, RestoreProgress *progress);
+
+/**
+ * Summarize a finished restore: file counts, wall time, throughput and the
+ * database result
+ * @param options Restore parameters
+ * @param progress Progress of the finished restore
+ * @param buffer Receives the report
+ * @param size Size of the buffer
+ */
+void restore_format_report(const RestoreOptions *options, const RestoreProgress *progress, char *buffer, size_t size);
+
+/**
+ * Check whether a file an earlier restore wrote is still in place
+ * @param target Restored file
+ * @param size Expected size
+ * @param mtime Expected last write time (FILETIME as 64-bit value)
+ * @return TRUE if the file exists with this size and time
+ */
+BOOL restore_file_current(const char *target, ULONGLONG size, ULONGLONG mtime);
+
+/**
+ * Create the temporary file a restored file is written to, with its
+ * directory, preallocated to the final size
+ * @param target Restored file
+ * @param temp Receives the temporary file name
+ * @param temp_size Size of the temp buffer
+ * @param size Final size of the file
+ * @return File handle, INVALID_HANDLE_VALUE on failure
+ */
+HANDLE restore_file_create(const char *target, char *temp, size_t temp_size, ULONGLONG size);
+
+/**
+ * Complete a restored file: set its time and rename it into place, or
+ * delete it when writing failed
+ * @param file Handle from restore_file_create
+ * @param temp Temporary file name
+ * @param target Restored file
+ * @param mtime Last write time (FILETIME as 64-bit value)
+ * @param ok The content was written and verified
+ * @return TRUE if the file is in place
+ */
+BOOL restore_file_finish(HANDLE file, const char *temp, const char *target, ULONGLONG mtime, BOOL ok);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BACKUP_RESTORE_H */
\ No newline at end of file
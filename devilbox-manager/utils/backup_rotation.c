@@ -0,0 +1,522 @@
+/*******************************************************************************
+ * Backup Rotation Module Implementation
+ * Dated snapshot directories with hardlinks to unchanged files, an index of
+ * the snapshots and hourly/daily/weekly retention
+ *******************************************************************************/
+
+ #include "backup_rotation.h"
+ #include "backup_manifest.h"
+ #include "backup_utils.h"
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ #include <ctype.h>
+ 
+ #define ROTATION_INDEX_HEADER "# DevilboxManager snapshot index v1"
+ 
+ // Forward declarations of internal functions
+ static BOOL is_snapshot_name(const char *name);
+ static int compare_newest_first(const void *a, const void *b);
+ static BOOL remove_tree(const char *dir);
+ static int read_index(const char *root, RotationSnapshot *snapshots, int max);
+ static int rebuild_index(const char *root, RotationSnapshot *snapshots, int max);
+ static BOOL write_index(const char *root, const RotationSnapshot *snapshots, int count);
+ static LONGLONG snapshot_day(const char *id);
+ 
+ /**
+  * Check whether a directory name is a snapshot ID: YYYYMMDD-HHMMSS with an
+  * optional -N suffix for runs started in the same second
+  */
+ static BOOL is_snapshot_name(const char *name)
+ {
+     for (int i = 0; i < 15; i++)
+     {
+         if (i == 8 ? name[i] != '-' : !isdigit((unsigned char)name[i]))
+             return FALSE;
+     }
+     if (name[15] == '-')
+     {
+         if (!isdigit((unsigned char)name[16]))
+             return FALSE;
+         for (const char *p = name + 16; *p; p++)
+             if (!isdigit((unsigned char)*p))
+                 return FALSE;
+         return TRUE;
+     }
+     return name[15] == '\0';
+ }
+ 
+ /**
+  * Order snapshots by ID, newest first
+  */
+ static int compare_newest_first(const void *a, const void *b)
+ {
+     const RotationSnapshot *sa = (const RotationSnapshot *)a;
+     const RotationSnapshot *sb = (const RotationSnapshot *)b;
+     size_t la = strlen(sa->id), lb = strlen(sb->id);
+ 
+     // A -N suffix sorts after the plain ID of the same second
+     if (la != lb && strncmp(sa->id, sb->id, 15) == 0)
+         return la < lb ? 1 : -1;
+     return strcmp(sb->id, sa->id);
+ }
+ 
+ /**
+  * Delete a directory tree. Deleting a hardlink only drops that name, the
+  * other snapshots keep the file.
+  */
+ static BOOL remove_tree(const char *dir)
+ {
+     char search_path[MAX_PATH_LEN], path[MAX_PATH_LEN];
+     WIN32_FIND_DATA fd;
+     HANDLE hFind;
+     BOOL ok = TRUE;
+ 
+     snprintf(search_path, sizeof(search_path), "%s\\*", dir);
+     hFind = FindFirstFile(search_path, &fd);
+     if (hFind != INVALID_HANDLE_VALUE)
+     {
+         do
+         {
+             if (strcmp(fd.cFileName, ".") == 0 || strcmp(fd.cFileName, "..") == 0)
+                 continue;
+ 
+             snprintf(path, sizeof(path), "%s\\%s", dir, fd.cFileName);
+             if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+             {
+                 ok = remove_tree(path) && ok;
+             }
+             else if (!DeleteFile(path))
+             {
+                 // Read-only copies; the attribute belongs to the file, so the
+                 // links in other snapshots lose it as well
+                 SetFileAttributes(path, FILE_ATTRIBUTE_NORMAL);
+                 ok = DeleteFile(path) && ok;
+             }
+         } while (FindNextFile(hFind, &fd));
+         FindClose(hFind);
+     }
+ 
+     return RemoveDirectory(dir) && ok;
+ }
+ 
+ /**
+  * Read the index file, -1 if there is none
+  */
+ static int read_index(const char *root, RotationSnapshot *snapshots, int max)
+ {
+     char path[MAX_PATH_LEN], line[256];
+     int count = 0;
+ 
+     snprintf(path, sizeof(path), "%s\\%s", root, ROTATION_INDEX_FILE);
+     FILE *f = fopen(path, "r");
+     if (!f)
+         return -1;
+ 
+     if (!fgets(line, sizeof(line), f) || strncmp(line, ROTATION_INDEX_HEADER, strlen(ROTATION_INDEX_HEADER)) != 0)
+     {
+         fclose(f);
+         return -1;
+     }
+ 
+     while (count < max && fgets(line, sizeof(line), f))
+     {
+         RotationSnapshot *snapshot = &snapshots[count];
+ 
+         memset(snapshot, 0, sizeof(*snapshot));
+         if (sscanf(line, "%31[^\t]\t%lld\t%lld\t%lld\t%lld", snapshot->id, &snapshot->files,
+                    &snapshot->files_linked, &snapshot->bytes, &snapshot->bytes_copied) != 5 ||
+             !is_snapshot_name(snapshot->id))
+             continue;
+         count++;
+     }
+ 
+     fclose(f);
+     return count;
+ }
+ 
+ /**
+  * Recreate the index from the snapshot directories, with the totals taken
+  * from their manifests. Only needed when the index was lost.
+  */
+ static int rebuild_index(const char *root, RotationSnapshot *snapshots, int max)
+ {
+     char search_path[MAX_PATH_LEN], dir[MAX_PATH_LEN];
+     WIN32_FIND_DATA fd;
+     HANDLE hFind;
+     int count = 0;
+ 
+     snprintf(search_path, sizeof(search_path), "%s\\*", root);
+     hFind = FindFirstFile(search_path, &fd);
+     if (hFind == INVALID_HANDLE_VALUE)
+         return 0;
+ 
+     do
+     {
+         RotationSnapshot *snapshot = &snapshots[count];
+         BackupManifest *manifest;
+         ManifestEntry entry;
+ 
+         if (!(fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) || strlen(fd.cFileName) >= sizeof(snapshot->id) ||
+             !is_snapshot_name(fd.cFileName))
+             continue;
+ 
+         memset(snapshot, 0, sizeof(*snapshot));
+         strcpy(snapshot->id, fd.cFileName);
+ 
+         snprintf(dir, sizeof(dir), "%s\\%s", root, fd.cFileName);
+         manifest = manifest_load(dir);
+         if (manifest)
+         {
+             snapshot->files = manifest_count(manifest);
+             for (int i = 0; manifest_get_entry(manifest, i, &entry); i++)
+                 snapshot->bytes += entry.size;
+             manifest_free(manifest);
+         }
+         count++;
+     } while (count < max && FindNextFile(hFind, &fd));
+     FindClose(hFind);
+ 
+     if (count > 0)
+         write_index(root, snapshots, count);
+     return count;
+ }
+ 
+ /**
+  * Write the index atomically, oldest snapshot first
+  */
+ static BOOL write_index(const char *root, const RotationSnapshot *snapshots, int count)
+ {
+     char path[MAX_PATH_LEN], tmp_path[MAX_PATH_LEN];
+     RotationSnapshot *sorted;
+     BOOL ok;
+ 
+     sorted = (RotationSnapshot *)malloc((count > 0 ? count : 1) * sizeof(RotationSnapshot));
+     if (!sorted)
+         return FALSE;
+     memcpy(sorted, snapshots, count * sizeof(RotationSnapshot));
+     qsort(sorted, count, sizeof(RotationSnapshot), compare_newest_first);
+ 
+     snprintf(path, sizeof(path), "%s\\%s", root, ROTATION_INDEX_FILE);
+     snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+ 
+     FILE *f = fopen(tmp_path, "w");
+     if (!f)
+     {
+         free(sorted);
+         return FALSE;
+     }
+ 
+     fprintf(f, "%s\n", ROTATION_INDEX_HEADER);
+     for (int i = count - 1; i >= 0; i--)
+         fprintf(f, "%s\t%lld\t%lld\t%lld\t%lld\n", sorted[i].id, sorted[i].files, sorted[i].files_linked,
+                 sorted[i].bytes, sorted[i].bytes_copied);
+     free(sorted);
+ 
+     ok = !ferror(f);
+     ok = (fclose(f) == 0) && ok;
+ 
+     if (ok)
+         ok = MoveFileEx(tmp_path, path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+ 
+     if (!ok)
+         DeleteFile(tmp_path);
+ 
+     return ok;
+ }
+ 
+ /**
+  * Day number of a snapshot ID. Day 0 (1 January 1601) was a Monday, so
+  * day / 7 numbers the weeks from Monday to Sunday.
+  */
+ static LONGLONG snapshot_day(const char *id)
+ {
+     SYSTEMTIME st;
+     FILETIME ft;
+     ULARGE_INTEGER time;
+ 
+     memset(&st, 0, sizeof(st));
+     st.wYear = (WORD)((id[0] - '0') * 1000 + (id[1] - '0') * 100 + (id[2] - '0') * 10 + (id[3] - '0'));
+     st.wMonth = (WORD)((id[4] - '0') * 10 + (id[5] - '0'));
+     st.wDay = (WORD)((id[6] - '0') * 10 + (id[7] - '0'));
+     if (!SystemTimeToFileTime(&st, &ft))
+         return 0;
+ 
+     time.LowPart = ft.dwLowDateTime;
+     time.HighPart = ft.dwHighDateTime;
+     return (LONGLONG)(time.QuadPart / 864000000000ULL);
+ }
+ 
+ /**
+  * Start a snapshot in the work directory
+  */
+ BOOL rotation_begin(const char *root, char *id, char *work_dir, char *previous_dir)
+ {
+     RotationSnapshot *snapshots;
+     char search_path[MAX_PATH_LEN], path[MAX_PATH_LEN];
+     WIN32_FIND_DATA fd;
+     HANDLE hFind;
+     SYSTEMTIME st;
+     int count;
+ 
+     previous_dir[0] = 0;
+     work_dir[0] = 0;
+     if (!create_directory_path(root))
+         return FALSE;
+ 
+     // Interrupted runs leave a work directory behind
+     snprintf(search_path, sizeof(search_path), "%s\\*" ROTATION_WORK_SUFFIX, root);
+     hFind = FindFirstFile(search_path, &fd);
+     if (hFind != INVALID_HANDLE_VALUE)
+     {
+         do
+         {
+             if (!(fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+                 continue;
+             snprintf(path, sizeof(path), "%s\\%s", root, fd.cFileName);
+             remove_tree(path);
+         } while (FindNextFile(hFind, &fd));
+         FindClose(hFind);
+     }
+ 
+     // Unchanged files are linked from the newest snapshot still on disk
+     snapshots = (RotationSnapshot *)malloc(ROTATION_MAX_SNAPSHOTS * sizeof(RotationSnapshot));
+     if (!snapshots)
+         return FALSE;
+     count = rotation_list(root, snapshots, ROTATION_MAX_SNAPSHOTS);
+     for (int i = 0; i < count; i++)
+     {
+         DWORD attributes;
+ 
+         snprintf(path, MAX_PATH_LEN, "%s\\%s", root, snapshots[i].id);
+         attributes = GetFileAttributes(path);
+         if (attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY))
+         {
+             strcpy(previous_dir, path);
+             break;
+         }
+     }
+     free(snapshots);
+ 
+     GetLocalTime(&st);
+     snprintf(id, 32, "%04d%02d%02d-%02d%02d%02d", st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond);
+     snprintf(path, sizeof(path), "%s\\%s", root, id);
+     for (int n = 2; GetFileAttributes(path) != INVALID_FILE_ATTRIBUTES; n++)
+     {
+         snprintf(id + 15, 32 - 15, "-%d", n);
+         snprintf(path, sizeof(path), "%s\\%s", root, id);
+     }
+ 
+     snprintf(work_dir, MAX_PATH_LEN, "%s" ROTATION_WORK_SUFFIX, path);
+     return CreateDirectory(work_dir, NULL);
+ }
+ 
+ /**
+  * Rename the work directory to the snapshot ID and index it
+  */
+ BOOL rotation_commit(const char *root, const RotationSnapshot *snapshot)
+ {
+     RotationSnapshot *snapshots;
+     char work_dir[MAX_PATH_LEN], dir[MAX_PATH_LEN];
+     int count, kept = 0;
+     BOOL ok;
+ 
+     snprintf(dir, sizeof(dir), "%s\\%s", root, snapshot->id);
+     snprintf(work_dir, sizeof(work_dir), "%s" ROTATION_WORK_SUFFIX, dir);
+     if (!MoveFileEx(work_dir, dir, MOVEFILE_WRITE_THROUGH))
+         return FALSE;
+ 
+     snapshots = (RotationSnapshot *)malloc((ROTATION_MAX_SNAPSHOTS + 1) * sizeof(RotationSnapshot));
+     if (!snapshots)
+         return FALSE;
+ 
+     // A rebuilt index already has the new directory, without its counters
+     count = rotation_list(root, snapshots, ROTATION_MAX_SNAPSHOTS);
+     for (int i = 0; i < count; i++)
+         if (strcmp(snapshots[i].id, snapshot->id) != 0)
+             snapshots[kept++] = snapshots[i];
+     snapshots[kept++] = *snapshot;
+ 
+     ok = write_index(root, snapshots, kept);
+     free(snapshots);
+     return ok;
+ }
+ 
+ /**
+  * Drop the work directory of a run
+  */
+ void rotation_abort(const char *root, const char *id)
+ {
+     char work_dir[MAX_PATH_LEN];
+ 
+     snprintf(work_dir, sizeof(work_dir), "%s\\%s" ROTATION_WORK_SUFFIX, root, id);
+     remove_tree(work_dir);
+ }
+ 
+ /**
+  * List the snapshots in a target, newest first
+  */
+ int rotation_list(const char *root, RotationSnapshot *snapshots, int max)
+ {
+     int count = read_index(root, snapshots, max);
+ 
+     if (count < 0)
+         count = rebuild_index(root, snapshots, max);
+ 
+     qsort(snapshots, count, sizeof(RotationSnapshot), compare_newest_first);
+     return count;
+ }
+ 
+ /**
+  * Mark the snapshots a policy keeps: walking from the newest, the first
+  * snapshot of every new hour, day and week counts towards that rule until
+  * it has its number of snapshots
+  */
+ int rotation_select(const RotationSnapshot *snapshots, int count, const RotationPolicy *policy, BOOL *keep)
+ {
+     LONGLONG last_day = -1, last_week = -1;
+     char last_hour[16] = "";
+     int hourly = 0, daily = 0, weekly = 0;
+     int pruned = 0;
+ 
+     for (int i = 0; i < count; i++)
+     {
+         LONGLONG day = snapshot_day(snapshots[i].id);
+ 
+         keep[i] = (i == 0) || (policy->hourly <= 0 && policy->daily <= 0 && policy->weekly <= 0);
+ 
+         if (hourly < policy->hourly && strncmp(snapshots[i].id, last_hour, 11) != 0)
+         {
+             memcpy(last_hour, snapshots[i].id, 11);
+             last_hour[11] = 0;
+             hourly++;
+             keep[i] = TRUE;
+         }
+         if (daily < policy->daily && day != last_day)
+         {
+             last_day = day;
+             daily++;
+             keep[i] = TRUE;
+         }
+         if (weekly < policy->weekly && day / 7 != last_week)
+         {
+             last_week = day / 7;
+             weekly++;
+             keep[i] = TRUE;
+         }
+ 
+         if (!keep[i])
+             pruned++;
+     }
+ 
+     return pruned;
+ }
+ 
+ /**
+  * Delete the snapshots outside the retention policy and drop them from the index
+  */
+ int rotation_prune(const char *root, const RotationPolicy *policy)
+ {
+     RotationSnapshot *snapshots;
+     BOOL *keep;
+     char dir[MAX_PATH_LEN];
+     int count, kept = 0, deleted = 0;
+ 
+     snapshots = (RotationSnapshot *)malloc(ROTATION_MAX_SNAPSHOTS * sizeof(RotationSnapshot));
+     keep = (BOOL *)malloc(ROTATION_MAX_SNAPSHOTS * sizeof(BOOL));
+     if (!snapshots || !keep)
+     {
+         free(snapshots);
+         free(keep);
+         return 0;
+     }
+ 
+     count = rotation_list(root, snapshots, ROTATION_MAX_SNAPSHOTS);
+     if (rotation_select(snapshots, count, policy, keep) > 0)
+     {
+         for (int i = 0; i < count; i++)
+         {
+             if (!keep[i])
+             {
+                 snprintf(dir, sizeof(dir), "%s\\%s", root, snapshots[i].id);
+ 
+                 // A snapshot that could not be removed completely stays listed
+                 // so the next run tries again
+                 if (remove_tree(dir) || GetFileAttributes(dir) == INVALID_FILE_ATTRIBUTES)
+                 {
+                     deleted++;
+                     continue;
+                 }
+             }
+             snapshots[kept++] = snapshots[i];
+         }
+         write_index(root, snapshots, kept);
+     }
+ 
+     free(snapshots);
+     free(keep);
+     return deleted;
+ }
+ 
+ /**
+  * Compare the manifests of two snapshots
+  */
+ BOOL rotation_diff(const char *root, const char *old_id, const char *new_id, RotationDiff *diff)
+ {
+     char old_dir[MAX_PATH_LEN], new_dir[MAX_PATH_LEN], path[MAX_PATH_LEN];
+     BackupManifest *old_manifest, *new_manifest;
+     ManifestEntry entry, previous;
+ 
+     memset(diff, 0, sizeof(*diff));
+     snprintf(old_dir, sizeof(old_dir), "%s\\%s", root, old_id);
+     snprintf(new_dir, sizeof(new_dir), "%s\\%s", root, new_id);
+ 
+     snprintf(path, sizeof(path), "%s\\%s", old_dir, MANIFEST_FILE_NAME);
+     if (GetFileAttributes(path) == INVALID_FILE_ATTRIBUTES)
+         return FALSE;
+     snprintf(path, sizeof(path), "%s\\%s", new_dir, MANIFEST_FILE_NAME);
+     if (GetFileAttributes(path) == INVALID_FILE_ATTRIBUTES)
+         return FALSE;
+ 
+     old_manifest = manifest_load(old_dir);
+     new_manifest = manifest_load(new_dir);
+     if (!old_manifest || !new_manifest)
+     {
+         if (old_manifest)
+             manifest_free(old_manifest);
+         if (new_manifest)
+             manifest_free(new_manifest);
+         return FALSE;
+     }
+ 
+     for (int i = 0; manifest_get_entry(new_manifest, i, &entry); i++)
+     {
+         if (!manifest_lookup(old_manifest, entry.path, &previous))
+         {
+             diff->added++;
+             diff->bytes_added += entry.size;
+         }
+         else if (previous.size != entry.size || previous.hash != entry.hash)
+         {
+             diff->changed++;
+             diff->bytes_added += entry.size;
+         }
+         else
+         {
+             diff->unchanged++;
+         }
+     }
+ 
+     for (int i = 0; manifest_get_entry(old_manifest, i, &entry); i++)
+     {
+         if (!manifest_lookup(new_manifest, entry.path, NULL))
+         {
+             diff->removed++;
+             diff->bytes_removed += entry.size;
+         }
+     }
+ 
+     manifest_free(old_manifest);
+     manifest_free(new_manifest);
+     return TRUE;
+ }
\ No newline at end of file
@@ -0,0 +1,133 @@
+/*******************************************************************************
+ * Backup Rotation Module Header
+ * Dated snapshot directories in a backup target: each run writes a new
+ * directory and hardlinks the files that did not change from the previous
+ * one, an index file lists the snapshots and retention rules prune them
+ *******************************************************************************/
+#ifndef BACKUP_ROTATION_H
+#define BACKUP_ROTATION_H
+
+#include <windows.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Maximum path length constant (if not already defined)
+#ifndef MAX_PATH_LEN
+#define MAX_PATH_LEN 260
+#endif
+
+// Index of the snapshots in the target, one line per snapshot
+#define ROTATION_INDEX_FILE ".devilbox-snapshots"
+
+// A run writes into <id>.partial, renamed to <id> once complete
+#define ROTATION_WORK_SUFFIX ".partial"
+
+// Maximum number of snapshots kept in a target
+#define ROTATION_MAX_SNAPSHOTS 1024
+
+// Default retention
+#define ROTATION_DEFAULT_HOURLY 24
+#define ROTATION_DEFAULT_DAILY 7
+#define ROTATION_DEFAULT_WEEKLY 4
+
+// Retention: the newest snapshot of each of the last N hours, days and weeks
+// is kept, and always the newest one. All zero keeps every snapshot.
+typedef struct
+{
+    int hourly;
+    int daily;
+    int weekly;
+} RotationPolicy;
+
+// Index entry of a snapshot
+typedef struct
+{
+    char id[32];            // Local time YYYYMMDD-HHMMSS, also the directory name
+    LONGLONG files;
+    LONGLONG files_linked;  // Hardlinked from the previous snapshot
+    LONGLONG bytes;
+    LONGLONG bytes_copied;  // Bytes actually written by the run
+} RotationSnapshot;
+
+// Difference between two snapshots, from their manifests
+typedef struct
+{
+    LONGLONG added;
+    LONGLONG changed;
+    LONGLONG removed;
+    LONGLONG unchanged;
+    LONGLONG bytes_added;    // Size of added and changed files
+    LONGLONG bytes_removed;  // Size of removed files
+} RotationDiff;
+
+/**
+ * Start a snapshot: clear what interrupted runs left and create the work
+ * directory
+ * @param root Backup target directory
+ * @param id Receives the snapshot ID (at least 32 characters)
+ * @param work_dir Receives the directory the run writes to (MAX_PATH_LEN)
+ * @param previous_dir Receives the newest snapshot directory, empty if none (MAX_PATH_LEN)
+ * @return TRUE if the work directory was created
+ */
+BOOL rotation_begin(const char *root, char *id, char *work_dir, char *previous_dir);
+
+/**
+ * Move a finished run into place and add it to the index
+ * @param root Backup target directory
+ * @param snapshot Snapshot ID and counters
+ * @return TRUE on success
+ */
+BOOL rotation_commit(const char *root, const RotationSnapshot *snapshot);
+
+/**
+ * Delete the work directory of a cancelled or failed run
+ * @param root Backup target directory
+ * @param id Snapshot ID from rotation_begin
+ */
+void rotation_abort(const char *root, const char *id);
+
+/**
+ * List the snapshots from the index, newest first. A missing index is
+ * rebuilt from the snapshot directories and their manifests.
+ * @param root Backup target directory
+ * @param snapshots Receives up to max entries
+ * @param max Capacity of snapshots
+ * @return Number of snapshots returned
+ */
+int rotation_list(const char *root, RotationSnapshot *snapshots, int max);
+
+/**
+ * Apply a retention policy to a list of snapshots
+ * @param snapshots Snapshots, newest first
+ * @param count Number of snapshots
+ * @param policy Retention policy
+ * @param keep Receives TRUE for every snapshot that is kept
+ * @return Number of snapshots to delete
+ */
+int rotation_select(const RotationSnapshot *snapshots, int count, const RotationPolicy *policy, BOOL *keep);
+
+/**
+ * Delete the snapshots a retention policy does not keep
+ * @param root Backup target directory
+ * @param policy Retention policy
+ * @return Number of snapshots deleted
+ */
+int rotation_prune(const char *root, const RotationPolicy *policy);
+
+/**
+ * Compare two snapshots by their manifests, without reading the trees
+ * @param root Backup target directory
+ * @param old_id Older snapshot
+ * @param new_id Newer snapshot
+ * @param diff Receives the differences
+ * @return TRUE if both manifests could be read
+ */
+BOOL rotation_diff(const char *root, const char *old_id, const char *new_id, RotationDiff *diff);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BACKUP_ROTATION_H */
\ No newline at end of file
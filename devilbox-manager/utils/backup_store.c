@@ -0,0 +1,1310 @@
+/*******************************************************************************
+ * Backup Store Module Implementation
+ * Content-addressed backup repository with content-defined chunking,
+ * pack files, a chunk index and restorable snapshots
+ *******************************************************************************/
+
+ #include "backup_store.h"
+ #include "backup_utils.h"
+ #include "backup_restore.h"
+ #include "hash_utils.h"
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ #include <ctype.h>
+ 
+ #define SNAPSHOT_HEADER "# DevilboxManager snapshot v1"
+ #define INDEX_MAGIC "DBXIDX01"
+ #define INDEX_MAGIC_LEN 8
+ 
+ // Buffers for reading source files and writing pack files
+ #define STORE_READ_BUFFER (1024 * 1024)
+ #define STORE_WRITE_BUFFER (1024 * 1024)
+ 
+ // Second seed of the 128-bit chunk ID
+ #define CHUNK_ID_SEED 0x9E3779B97F4A7C15ULL
+ 
+ // Gear hash cut masks: stricter below the average size, looser above it.
+ // The high bits depend on the last 48+ bytes, the low bits only on the last few
+ #define CHUNK_MASK_SMALL 0xFFFF000000000000ULL
+ #define CHUNK_MASK_LARGE 0xFFF0000000000000ULL
+ 
+ // 128-bit chunk ID made of two independently seeded XXH64 hashes
+ typedef struct
+ {
+     ULONGLONG h[2];
+ } ChunkId;
+ 
+ // Location of a chunk, stored as is in the index file (32 bytes)
+ typedef struct
+ {
+     ChunkId id;
+     DWORD pack;
+     DWORD length;
+     ULONGLONG offset;
+ } ChunkLocation;
+ 
+ // Chunk index with an open addressing table
+ typedef struct
+ {
+     ChunkLocation *items;
+     int count;
+     int capacity;
+     int *table;
+     size_t mask;
+ } ChunkIndex;
+ 
+ // File recorded in a snapshot
+ typedef struct
+ {
+     char *path;
+     ULONGLONG size;
+     ULONGLONG mtime;
+     int chunk_count;
+     ChunkId *chunks;
+ } SnapshotFile;
+ 
+ // Files of a snapshot with an optional path index
+ typedef struct
+ {
+     SnapshotFile *items;
+     int count;
+     int capacity;
+     int *table;
+     size_t mask;
+ } FileList;
+ 
+ // Backup session
+ struct BackupStore
+ {
+     char repo_path[MAX_PATH_LEN];
+     char source_root[MAX_PATH_LEN];
+     CRITICAL_SECTION lock;
+ 
+     ChunkIndex index;
+     int index_loaded;          // Chunks that were already in the index file
+ 
+     HANDLE pack;
+     DWORD pack_id;
+     ULONGLONG pack_size;       // Including buffered bytes
+     BYTE *write_buffer;
+     DWORD write_used;
+     BOOL write_failed;
+ 
+     FileList files;            // Snapshot being written
+     FileList parent;           // Latest snapshot of the same source
+ 
+     StoreStats stats;
+ };
+ 
+ // Shared state of a snapshot restore
+ typedef struct
+ {
+     const char *repo_path;
+     const char *target_path;
+     ChunkIndex index;
+     FileList list;
+     const SnapshotFile **order;  // Files, largest first
+     volatile LONG next;
+     StoreRestoreProgress *progress;
+     volatile LONG failed;
+ } SnapshotRestore;
+ 
+ static ULONGLONG gear[256];
+ static BOOL gear_ready = FALSE;
+ 
+ // Forward declarations of internal functions
+ static void init_gear(void);
+ static size_t find_cut(const BYTE *data, size_t length);
+ static void chunk_id(const BYTE *data, size_t length, ChunkId *id);
+ static unsigned long hash_name(const char *path);
+ static int index_find(const ChunkIndex *index, const ChunkId *id);
+ static BOOL index_add(ChunkIndex *index, const ChunkLocation *location);
+ static BOOL index_load(const char *repo_path, ChunkIndex *index);
+ static void index_free(ChunkIndex *index);
+ static int files_find(const FileList *list, const char *path);
+ static BOOL files_add(FileList *list, const char *path, ULONGLONG size, ULONGLONG mtime,
+                       int chunk_count, ChunkId *chunks);
+ static BOOL files_build_table(FileList *list);
+ static void files_free(FileList *list);
+ static BOOL read_snapshot(const char *repo_path, const char *snapshot_id, FileList *list,
+                           StoreSnapshotInfo *info);
+ static BOOL read_snapshot_info(const char *snap_path, StoreSnapshotInfo *info);
+ static BOOL flush_pack(BackupStore *store);
+ static BOOL open_pack(BackupStore *store);
+ static BOOL put_chunk(BackupStore *store, const BYTE *data, DWORD length, const ChunkId *id);
+ static BOOL write_index(BackupStore *store);
+ static BOOL restore_snapshot_file(SnapshotRestore *restore, const SnapshotFile *file, BYTE *buffer,
+                                   HANDLE *pack, DWORD *pack_id);
+ static DWORD WINAPI restore_snapshot_thread(LPVOID param);
+ static int compare_size_desc(const void *a, const void *b);
+ 
+ /**
+  * Fill the gear table with fixed pseudo-random values (splitmix64), the table
+  * must never change or chunk boundaries of old snapshots would no longer match
+  */
+ static void init_gear(void)
+ {
+     ULONGLONG x = 0x6465766C626F78ULL;
+ 
+     if (gear_ready)
+         return;
+ 
+     for (int i = 0; i < 256; i++)
+     {
+         ULONGLONG z = (x += 0x9E3779B97F4A7C15ULL);
+         z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+         z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+         gear[i] = z ^ (z >> 31);
+     }
+ 
+     gear_ready = TRUE;
+ }
+ 
+ /**
+  * Find the end of the next chunk (FastCDC style normalized chunking)
+  */
+ static size_t find_cut(const BYTE *data, size_t length)
+ {
+     ULONGLONG fp = 0;
+     size_t normal = STORE_CHUNK_AVG;
+     size_t limit = STORE_CHUNK_MAX;
+     size_t i = STORE_CHUNK_MIN;
+ 
+     if (length <= STORE_CHUNK_MIN)
+         return length;
+     if (length < limit)
+         limit = length;
+     if (length < normal)
+         normal = length;
+ 
+     for (; i < normal; i++)
+     {
+         fp = (fp << 1) + gear[data[i]];
+         if (!(fp & CHUNK_MASK_SMALL))
+             return i;
+     }
+ 
+     for (; i < limit; i++)
+     {
+         fp = (fp << 1) + gear[data[i]];
+         if (!(fp & CHUNK_MASK_LARGE))
+             return i;
+     }
+ 
+     return limit;
+ }
+ 
+ /**
+  * Compute the ID of a chunk
+  */
+ static void chunk_id(const BYTE *data, size_t length, ChunkId *id)
+ {
+     id->h[0] = hash_buffer(data, length, 0);
+     id->h[1] = hash_buffer(data, length, CHUNK_ID_SEED);
+ }
+ 
+ /**
+  * Case-insensitive FNV-1a hash of a relative path
+  */
+ static unsigned long hash_name(const char *path)
+ {
+     unsigned long hash = 2166136261UL;
+ 
+     while (*path)
+     {
+         char c = *path++;
+         hash ^= (unsigned char)(c == '/' ? '\\' : tolower((unsigned char)c));
+         hash *= 16777619UL;
+     }
+ 
+     return hash;
+ }
+ 
+ /**
+  * Find a chunk in the index, -1 if missing
+  */
+ static int index_find(const ChunkIndex *index, const ChunkId *id)
+ {
+     if (!index->table)
+         return -1;
+ 
+     size_t i = (size_t)id->h[0] & index->mask;
+     while (index->table[i] >= 0)
+     {
+         const ChunkId *other = &index->items[index->table[i]].id;
+         if (other->h[0] == id->h[0] && other->h[1] == id->h[1])
+             return index->table[i];
+         i = (i + 1) & index->mask;
+     }
+ 
+     return -1;
+ }
+ 
+ /**
+  * Add a chunk location, keeping the table at most half full
+  */
+ static BOOL index_add(ChunkIndex *index, const ChunkLocation *location)
+ {
+     if (index->count == index->capacity)
+     {
+         int capacity = index->capacity ? index->capacity * 2 : 4096;
+         ChunkLocation *items = (ChunkLocation *)realloc(index->items, capacity * sizeof(ChunkLocation));
+         if (!items)
+             return FALSE;
+         index->items = items;
+         index->capacity = capacity;
+     }
+ 
+     if (!index->table || (size_t)(index->count + 1) * 2 > index->mask + 1)
+     {
+         size_t slots = index->table ? (index->mask + 1) * 2 : 8192;
+         int *table = (int *)malloc(slots * sizeof(int));
+         if (!table)
+             return FALSE;
+ 
+         memset(table, 0xff, slots * sizeof(int));
+         for (int n = 0; n < index->count; n++)
+         {
+             size_t i = (size_t)index->items[n].id.h[0] & (slots - 1);
+             while (table[i] >= 0)
+                 i = (i + 1) & (slots - 1);
+             table[i] = n;
+         }
+ 
+         free(index->table);
+         index->table = table;
+         index->mask = slots - 1;
+     }
+ 
+     index->items[index->count] = *location;
+     size_t i = (size_t)location->id.h[0] & index->mask;
+     while (index->table[i] >= 0)
+         i = (i + 1) & index->mask;
+     index->table[i] = index->count++;
+ 
+     return TRUE;
+ }
+ 
+ /**
+  * Load the chunk index of a repository
+  */
+ static BOOL index_load(const char *repo_path, ChunkIndex *index)
+ {
+     char index_path[MAX_PATH_LEN];
+     char magic[INDEX_MAGIC_LEN];
+     ChunkLocation location;
+ 
+     memset(index, 0, sizeof(*index));
+ 
+     snprintf(index_path, sizeof(index_path), "%s\\index", repo_path);
+     FILE *f = fopen(index_path, "rb");
+     if (!f)
+         return GetFileAttributes(index_path) == INVALID_FILE_ATTRIBUTES;
+ 
+     setvbuf(f, NULL, _IOFBF, 1 << 20);
+ 
+     if (fread(magic, 1, sizeof(magic), f) != sizeof(magic) ||
+         memcmp(magic, INDEX_MAGIC, INDEX_MAGIC_LEN) != 0)
+     {
+         fclose(f);
+         return FALSE;
+     }
+ 
+     // A record cut short by an interrupted run is ignored and overwritten later
+     while (fread(&location, sizeof(location), 1, f) == 1)
+     {
+         if (index_find(index, &location.id) < 0 && !index_add(index, &location))
+         {
+             fclose(f);
+             return FALSE;
+         }
+     }
+ 
+     fclose(f);
+     return TRUE;
+ }
+ 
+ /**
+  * Release a chunk index
+  */
+ static void index_free(ChunkIndex *index)
+ {
+     free(index->items);
+     free(index->table);
+     memset(index, 0, sizeof(*index));
+ }
+ 
+ /**
+  * Find a file by relative path, -1 if missing (needs files_build_table)
+  */
+ static int files_find(const FileList *list, const char *path)
+ {
+     if (!list->table)
+         return -1;
+ 
+     size_t i = hash_name(path) & list->mask;
+     while (list->table[i] >= 0)
+     {
+         if (_stricmp(list->items[list->table[i]].path, path) == 0)
+             return list->table[i];
+         i = (i + 1) & list->mask;
+     }
+ 
+     return -1;
+ }
+ 
+ /**
+  * Append a file, the list takes ownership of the chunk array
+  */
+ static BOOL files_add(FileList *list, const char *path, ULONGLONG size, ULONGLONG mtime,
+                       int chunk_count, ChunkId *chunks)
+ {
+     if (list->count == list->capacity)
+     {
+         int capacity = list->capacity ? list->capacity * 2 : 1024;
+         SnapshotFile *items = (SnapshotFile *)realloc(list->items, capacity * sizeof(SnapshotFile));
+         if (!items)
+             return FALSE;
+         list->items = items;
+         list->capacity = capacity;
+     }
+ 
+     SnapshotFile *file = &list->items[list->count];
+     file->path = _strdup(path);
+     if (!file->path)
+         return FALSE;
+ 
+     file->size = size;
+     file->mtime = mtime;
+     file->chunk_count = chunk_count;
+     file->chunks = chunks;
+     list->count++;
+ 
+     return TRUE;
+ }
+ 
+ /**
+  * Index the files of a list by path
+  */
+ static BOOL files_build_table(FileList *list)
+ {
+     size_t slots = 1024;
+ 
+     while (slots < (size_t)list->count * 2)
+         slots *= 2;
+ 
+     free(list->table);
+     list->table = (int *)malloc(slots * sizeof(int));
+     if (!list->table)
+         return FALSE;
+ 
+     memset(list->table, 0xff, slots * sizeof(int));
+     list->mask = slots - 1;
+     for (int n = 0; n < list->count; n++)
+     {
+         size_t i = hash_name(list->items[n].path) & list->mask;
+         while (list->table[i] >= 0)
+             i = (i + 1) & list->mask;
+         list->table[i] = n;
+     }
+ 
+     return TRUE;
+ }
+ 
+ /**
+  * Release a file list
+  */
+ static void files_free(FileList *list)
+ {
+     for (int n = 0; n < list->count; n++)
+     {
+         free(list->items[n].path);
+         free(list->items[n].chunks);
+     }
+ 
+     free(list->items);
+     free(list->table);
+     memset(list, 0, sizeof(*list));
+ }
+ 
+ /**
+  * Read the header of a snapshot file
+  */
+ static BOOL read_snapshot_info(const char *snap_path, StoreSnapshotInfo *info)
+ {
+     char line[MAX_PATH_LEN + 100];
+ 
+     memset(info, 0, sizeof(*info));
+ 
+     FILE *f = fopen(snap_path, "r");
+     if (!f)
+         return FALSE;
+ 
+     if (!fgets(line, sizeof(line), f) || strncmp(line, SNAPSHOT_HEADER, strlen(SNAPSHOT_HEADER)) != 0)
+     {
+         fclose(f);
+         return FALSE;
+     }
+ 
+     // Header lines come before the first file
+     while (fgets(line, sizeof(line), f) && line[0] != 'F')
+     {
+         char *value = strchr(line, '\t');
+         if (!value)
+             continue;
+         *value++ = 0;
+         value[strcspn(value, "\r\n")] = 0;
+ 
+         if (strcmp(line, "id") == 0)
+             strncpy(info->id, value, sizeof(info->id) - 1);
+         else if (strcmp(line, "time") == 0)
+             strncpy(info->time, value, sizeof(info->time) - 1);
+         else if (strcmp(line, "source") == 0)
+             strncpy(info->source, value, sizeof(info->source) - 1);
+         else if (strcmp(line, "files") == 0)
+             info->files = strtoll(value, NULL, 10);
+         else if (strcmp(line, "bytes") == 0)
+             info->bytes = strtoll(value, NULL, 10);
+     }
+ 
+     fclose(f);
+     return info->id[0] != 0;
+ }
+ 
+ /**
+  * Read the file list of a snapshot
+  */
+ static BOOL read_snapshot(const char *repo_path, const char *snapshot_id, FileList *list,
+                           StoreSnapshotInfo *info)
+ {
+     char snap_path[MAX_PATH_LEN];
+     char line[MAX_PATH_LEN + 100];
+     SnapshotFile *current = NULL;
+     int chunks_read = 0;
+     BOOL ok = TRUE;
+ 
+     snprintf(snap_path, sizeof(snap_path), "%s\\snapshots\\%s.snap", repo_path, snapshot_id);
+     if (info && !read_snapshot_info(snap_path, info))
+         return FALSE;
+ 
+     FILE *f = fopen(snap_path, "r");
+     if (!f)
+         return FALSE;
+ 
+     setvbuf(f, NULL, _IOFBF, 1 << 20);
+ 
+     while (ok && fgets(line, sizeof(line), f))
+     {
+         line[strcspn(line, "\r\n")] = 0;
+ 
+         if (line[0] == 'F' && line[1] == '\t')
+         {
+             ULONGLONG size, mtime;
+             int chunk_count, offset = 0;
+ 
+             if (current && chunks_read != current->chunk_count)
+                 ok = FALSE;
+ 
+             if (!ok || sscanf(line + 2, "%llu\t%llu\t%d\t%n", &size, &mtime, &chunk_count, &offset) != 3 ||
+                 !offset || chunk_count < 0)
+             {
+                 ok = FALSE;
+                 break;
+             }
+ 
+             ChunkId *chunks = chunk_count ? (ChunkId *)malloc(chunk_count * sizeof(ChunkId)) : NULL;
+             if ((chunk_count && !chunks) || !files_add(list, line + 2 + offset, size, mtime, chunk_count, chunks))
+             {
+                 free(chunks);
+                 ok = FALSE;
+                 break;
+             }
+ 
+             current = &list->items[list->count - 1];
+             chunks_read = 0;
+         }
+         else if (line[0] == 'C' && line[1] == '\t')
+         {
+             if (!current || chunks_read >= current->chunk_count ||
+                 sscanf(line + 2, "%16llx%16llx", &current->chunks[chunks_read].h[0],
+                        &current->chunks[chunks_read].h[1]) != 2)
+             {
+                 ok = FALSE;
+                 break;
+             }
+             chunks_read++;
+         }
+     }
+ 
+     if (current && chunks_read != current->chunk_count)
+         ok = FALSE;
+ 
+     fclose(f);
+     return ok;
+ }
+ 
+ /**
+  * Get the repository path for a devilbox installation
+  */
+ void store_get_repo_path(const char *devilbox_path, const char *backup_dir, char *repo_path, size_t size)
+ {
+     char dir[MAX_PATH_LEN];
+     char *p;
+ 
+     strncpy(dir, backup_dir && backup_dir[0] ? backup_dir : "./backups", sizeof(dir) - 1);
+     dir[sizeof(dir) - 1] = 0;
+ 
+     for (p = dir; *p; p++)
+     {
+         if (*p == '/')
+             *p = '\\';
+     }
+ 
+     // Relative paths in .env are relative to the devilbox directory
+     p = dir;
+     if (p[0] == '.' && p[1] == '\\')
+         p += 2;
+ 
+     if (dir[0] == '\\' || (isalpha((unsigned char)dir[0]) && dir[1] == ':'))
+         snprintf(repo_path, size, "%s\\%s", dir, STORE_DIR_NAME);
+     else
+         snprintf(repo_path, size, "%s\\%s\\%s", devilbox_path, p, STORE_DIR_NAME);
+ }
+ 
+ /**
+  * Open a repository (creating it if needed) and start a new snapshot
+  */
+ BackupStore *store_open(const char *repo_path, const char *source_root)
+ {
+     char path[MAX_PATH_LEN];
+     StoreSnapshotInfo snapshots[STORE_MAX_SNAPSHOTS];
+ 
+     init_gear();
+ 
+     snprintf(path, sizeof(path), "%s\\packs", repo_path);
+     if (!create_directory_path(path))
+         return NULL;
+     snprintf(path, sizeof(path), "%s\\snapshots", repo_path);
+     if (!create_directory_path(path))
+         return NULL;
+ 
+     BackupStore *store = (BackupStore *)calloc(1, sizeof(BackupStore));
+     if (!store)
+         return NULL;
+ 
+     strncpy(store->repo_path, repo_path, sizeof(store->repo_path) - 1);
+     strncpy(store->source_root, source_root, sizeof(store->source_root) - 1);
+     store->pack = INVALID_HANDLE_VALUE;
+     store->write_buffer = (BYTE *)malloc(STORE_WRITE_BUFFER);
+     InitializeCriticalSection(&store->lock);
+ 
+     if (!store->write_buffer || !index_load(repo_path, &store->index))
+     {
+         store_close(store);
+         return NULL;
+     }
+     store->index_loaded = store->index.count;
+ 
+     // Continue the newest pack file
+     store->pack_id = 1;
+     for (int n = 0; n < store->index.count; n++)
+     {
+         if (store->index.items[n].pack > store->pack_id)
+             store->pack_id = store->index.items[n].pack;
+     }
+ 
+     // Files unchanged since the latest snapshot of this source reuse its chunk lists
+     int count = store_list_snapshots(repo_path, snapshots, STORE_MAX_SNAPSHOTS);
+     for (int n = 0; n < count; n++)
+     {
+         if (_stricmp(snapshots[n].source, source_root) == 0)
+         {
+             if (!read_snapshot(repo_path, snapshots[n].id, &store->parent, NULL) ||
+                 !files_build_table(&store->parent))
+                 files_free(&store->parent);
+             break;
+         }
+     }
+ 
+     return store;
+ }
+ 
+ /**
+  * Write buffered chunk data to the current pack file
+  */
+ static BOOL flush_pack(BackupStore *store)
+ {
+     DWORD written = 0;
+ 
+     if (store->write_used == 0)
+         return !store->write_failed;
+ 
+     if (!WriteFile(store->pack, store->write_buffer, store->write_used, &written, NULL) ||
+         written != store->write_used)
+         store->write_failed = TRUE;
+ 
+     store->write_used = 0;
+     return !store->write_failed;
+ }
+ 
+ /**
+  * Open the current pack file for appending, moving on to the next one when full
+  */
+ static BOOL open_pack(BackupStore *store)
+ {
+     char pack_path[MAX_PATH_LEN];
+     LARGE_INTEGER size;
+     LARGE_INTEGER zero;
+ 
+     zero.QuadPart = 0;
+ 
+     for (;;)
+     {
+         snprintf(pack_path, sizeof(pack_path), "%s\\packs\\pack-%06lu.pack", store->repo_path,
+                  (unsigned long)store->pack_id);
+ 
+         store->pack = CreateFile(pack_path, GENERIC_WRITE, FILE_SHARE_READ, NULL,
+                                  OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+         if (store->pack == INVALID_HANDLE_VALUE)
+             return FALSE;
+ 
+         if (!GetFileSizeEx(store->pack, &size))
+         {
+             CloseHandle(store->pack);
+             store->pack = INVALID_HANDLE_VALUE;
+             return FALSE;
+         }
+ 
+         if ((ULONGLONG)size.QuadPart < STORE_PACK_SIZE)
+             break;
+ 
+         CloseHandle(store->pack);
+         store->pack = INVALID_HANDLE_VALUE;
+         store->pack_id++;
+     }
+ 
+     // Data left by an interrupted run is unreferenced, new chunks go after it
+     SetFilePointerEx(store->pack, zero, NULL, FILE_END);
+     store->pack_size = size.QuadPart;
+     return TRUE;
+ }
+ 
+ /**
+  * Store a chunk unless it is already known (called with the store lock held)
+  */
+ static BOOL put_chunk(BackupStore *store, const BYTE *data, DWORD length, const ChunkId *id)
+ {
+     ChunkLocation location;
+ 
+     if (index_find(&store->index, id) >= 0)
+         return TRUE;
+ 
+     if (store->pack != INVALID_HANDLE_VALUE && store->pack_size + length > STORE_PACK_SIZE)
+     {
+         BOOL ok = flush_pack(store);
+         FlushFileBuffers(store->pack);
+         CloseHandle(store->pack);
+         store->pack = INVALID_HANDLE_VALUE;
+         store->pack_id++;
+         if (!ok)
+             return FALSE;
+     }
+ 
+     if (store->pack == INVALID_HANDLE_VALUE && !open_pack(store))
+         return FALSE;
+ 
+     if (store->write_used + length > STORE_WRITE_BUFFER && !flush_pack(store))
+         return FALSE;
+ 
+     memcpy(store->write_buffer + store->write_used, data, length);
+     store->write_used += length;
+ 
+     location.id = *id;
+     location.pack = store->pack_id;
+     location.length = length;
+     location.offset = store->pack_size;
+     store->pack_size += length;
+ 
+     if (!index_add(&store->index, &location))
+         return FALSE;
+ 
+     store->stats.chunks_new++;
+     store->stats.bytes_new += length;
+     return TRUE;
+ }
+ 
+ /**
+  * Chunk a file into the store and record it in the snapshot
+  */
+ int store_add_file(BackupStore *store, const char *file, const char *relative_path, char *status_message)
+ {
+     WIN32_FILE_ATTRIBUTE_DATA attr;
+     ULARGE_INTEGER size, mtime;
+     ChunkId *chunks = NULL;
+     int chunk_count = 0;
+     int chunk_capacity = 0;
+     size_t start = 0, end = 0;
+     DWORD read = 0;
+     BOOL eof = FALSE;
+     BOOL ok = TRUE;
+ 
+     if (!GetFileAttributesEx(file, GetFileExInfoStandard, &attr))
+     {
+         if (status_message)
+             sprintf(status_message, "Failed to read attributes: %s (Error: %lu)", file, GetLastError());
+         return STORE_FILE_FAILED;
+     }
+ 
+     size.LowPart = attr.nFileSizeLow;
+     size.HighPart = attr.nFileSizeHigh;
+     mtime.LowPart = attr.ftLastWriteTime.dwLowDateTime;
+     mtime.HighPart = attr.ftLastWriteTime.dwHighDateTime;
+ 
+     // The parent list is read-only during the session, no lock needed
+     int n = files_find(&store->parent, relative_path);
+     if (n >= 0 && store->parent.items[n].size == size.QuadPart && store->parent.items[n].mtime == mtime.QuadPart)
+     {
+         const SnapshotFile *parent = &store->parent.items[n];
+ 
+         if (parent->chunk_count)
+         {
+             chunks = (ChunkId *)malloc(parent->chunk_count * sizeof(ChunkId));
+             if (!chunks)
+                 return STORE_FILE_FAILED;
+             memcpy(chunks, parent->chunks, parent->chunk_count * sizeof(ChunkId));
+         }
+ 
+         EnterCriticalSection(&store->lock);
+         ok = files_add(&store->files, relative_path, size.QuadPart, mtime.QuadPart, parent->chunk_count, chunks);
+         if (ok)
+         {
+             store->stats.files++;
+             store->stats.files_reused++;
+             store->stats.bytes_scanned += size.QuadPart;
+             store->stats.chunks += parent->chunk_count;
+         }
+         LeaveCriticalSection(&store->lock);
+ 
+         if (!ok)
+         {
+             free(chunks);
+             return STORE_FILE_FAILED;
+         }
+         return STORE_FILE_REUSED;
+     }
+ 
+     HANDLE hFile = CreateFile(file, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                               OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+     if (hFile == INVALID_HANDLE_VALUE)
+     {
+         if (status_message)
+             sprintf(status_message, "Failed to open file: %s (Error: %lu)", file, GetLastError());
+         return STORE_FILE_FAILED;
+     }
+ 
+     BYTE *buffer = (BYTE *)malloc(STORE_READ_BUFFER);
+     if (!buffer)
+     {
+         CloseHandle(hFile);
+         return STORE_FILE_FAILED;
+     }
+ 
+     // Keep at least one maximum chunk in the buffer so cut points do not depend on read sizes
+     while (ok)
+     {
+         if (!eof && end - start < STORE_CHUNK_MAX)
+         {
+             memmove(buffer, buffer + start, end - start);
+             end -= start;
+             start = 0;
+ 
+             if (!ReadFile(hFile, buffer + end, (DWORD)(STORE_READ_BUFFER - end), &read, NULL))
+             {
+                 ok = FALSE;
+                 break;
+             }
+             if (read == 0)
+                 eof = TRUE;
+             end += read;
+             continue;
+         }
+ 
+         if (start == end)
+             break;
+ 
+         size_t length = find_cut(buffer + start, end - start);
+         ChunkId id;
+         chunk_id(buffer + start, length, &id);
+ 
+         if (chunk_count == chunk_capacity)
+         {
+             int capacity = chunk_capacity ? chunk_capacity * 2 : 16;
+             ChunkId *grown = (ChunkId *)realloc(chunks, capacity * sizeof(ChunkId));
+             if (!grown)
+             {
+                 ok = FALSE;
+                 break;
+             }
+             chunks = grown;
+             chunk_capacity = capacity;
+         }
+         chunks[chunk_count++] = id;
+ 
+         EnterCriticalSection(&store->lock);
+         ok = put_chunk(store, buffer + start, (DWORD)length, &id);
+         LeaveCriticalSection(&store->lock);
+ 
+         start += length;
+     }
+ 
+     free(buffer);
+     CloseHandle(hFile);
+ 
+     if (ok)
+     {
+         EnterCriticalSection(&store->lock);
+         ok = files_add(&store->files, relative_path, size.QuadPart, mtime.QuadPart, chunk_count, chunks);
+         if (ok)
+         {
+             store->stats.files++;
+             store->stats.bytes_scanned += size.QuadPart;
+             store->stats.bytes_read += size.QuadPart;
+             store->stats.chunks += chunk_count;
+         }
+         LeaveCriticalSection(&store->lock);
+     }
+ 
+     if (!ok)
+     {
+         free(chunks);
+         if (status_message)
+             sprintf(status_message, "Failed to store file: %s (Error: %lu)", file, GetLastError());
+         return STORE_FILE_FAILED;
+     }
+ 
+     if (status_message)
+         sprintf(status_message, "Stored: %s", relative_path);
+ 
+     return STORE_FILE_STORED;
+ }
+ 
+ /**
+  * Append the chunks added in this session to the index file
+  */
+ static BOOL write_index(BackupStore *store)
+ {
+     char index_path[MAX_PATH_LEN];
+     LARGE_INTEGER position;
+     DWORD written = 0;
+     BOOL ok = TRUE;
+ 
+     if (store->index.count == store->index_loaded)
+         return TRUE;
+ 
+     snprintf(index_path, sizeof(index_path), "%s\\index", store->repo_path);
+     HANDLE hFile = CreateFile(index_path, GENERIC_WRITE, 0, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+     if (hFile == INVALID_HANDLE_VALUE)
+         return FALSE;
+ 
+     if (store->index_loaded == 0)
+         ok = WriteFile(hFile, INDEX_MAGIC, INDEX_MAGIC_LEN, &written, NULL) && written == INDEX_MAGIC_LEN;
+ 
+     // Append after the last complete record, dropping a torn one from an interrupted run
+     position.QuadPart = INDEX_MAGIC_LEN + (LONGLONG)store->index_loaded * sizeof(ChunkLocation);
+     if (ok)
+         ok = SetFilePointerEx(hFile, position, NULL, FILE_BEGIN);
+ 
+     for (int n = store->index_loaded; ok && n < store->index.count; n += 4096)
+     {
+         int count = store->index.count - n < 4096 ? store->index.count - n : 4096;
+         DWORD bytes = count * sizeof(ChunkLocation);
+         ok = WriteFile(hFile, &store->index.items[n], bytes, &written, NULL) && written == bytes;
+     }
+ 
+     if (ok)
+         ok = SetEndOfFile(hFile) && FlushFileBuffers(hFile);
+ 
+     CloseHandle(hFile);
+     if (ok)
+         store->index_loaded = store->index.count;
+ 
+     return ok;
+ }
+ 
+ /**
+  * Flush pack files, append new chunks to the index and write the snapshot
+  */
+ BOOL store_commit(BackupStore *store, char *snapshot_id)
+ {
+     char snap_path[MAX_PATH_LEN];
+     char tmp_path[MAX_PATH_LEN];
+     char id[32];
+     SYSTEMTIME st;
+     BOOL ok = TRUE;
+ 
+     EnterCriticalSection(&store->lock);
+ 
+     // Pack data must be durable before the index refers to it
+     if (store->pack != INVALID_HANDLE_VALUE)
+     {
+         ok = flush_pack(store) && FlushFileBuffers(store->pack);
+         CloseHandle(store->pack);
+         store->pack = INVALID_HANDLE_VALUE;
+     }
+     else
+     {
+         ok = !store->write_failed;
+     }
+ 
+     if (ok)
+         ok = write_index(store);
+ 
+     // Snapshot ID from the local time, made unique if a run finishes within the same second
+     GetLocalTime(&st);
+     snprintf(id, sizeof(id), "%04d%02d%02d-%02d%02d%02d", st.wYear, st.wMonth, st.wDay,
+              st.wHour, st.wMinute, st.wSecond);
+     snprintf(snap_path, sizeof(snap_path), "%s\\snapshots\\%s.snap", store->repo_path, id);
+     for (int n = 2; GetFileAttributes(snap_path) != INVALID_FILE_ATTRIBUTES; n++)
+     {
+         snprintf(id, sizeof(id), "%04d%02d%02d-%02d%02d%02d-%d", st.wYear, st.wMonth, st.wDay,
+                  st.wHour, st.wMinute, st.wSecond, n);
+         snprintf(snap_path, sizeof(snap_path), "%s\\snapshots\\%s.snap", store->repo_path, id);
+     }
+     snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", snap_path);
+ 
+     FILE *f = ok ? fopen(tmp_path, "w") : NULL;
+     if (f)
+     {
+         setvbuf(f, NULL, _IOFBF, 1 << 20);
+ 
+         fprintf(f, "%s\n", SNAPSHOT_HEADER);
+         fprintf(f, "id\t%s\n", id);
+         fprintf(f, "time\t%04d-%02d-%02d %02d:%02d:%02d\n", st.wYear, st.wMonth, st.wDay,
+                 st.wHour, st.wMinute, st.wSecond);
+         fprintf(f, "source\t%s\n", store->source_root);
+         fprintf(f, "files\t%lld\n", store->stats.files);
+         fprintf(f, "bytes\t%lld\n", store->stats.bytes_scanned);
+ 
+         for (int n = 0; n < store->files.count; n++)
+         {
+             const SnapshotFile *file = &store->files.items[n];
+             fprintf(f, "F\t%llu\t%llu\t%d\t%s\n", file->size, file->mtime, file->chunk_count, file->path);
+             for (int c = 0; c < file->chunk_count; c++)
+                 fprintf(f, "C\t%016llx%016llx\n", file->chunks[c].h[0], file->chunks[c].h[1]);
+         }
+ 
+         ok = !ferror(f);
+         ok = (fclose(f) == 0) && ok;
+ 
+         if (ok)
+             ok = MoveFileEx(tmp_path, snap_path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+         if (!ok)
+             DeleteFile(tmp_path);
+     }
+     else
+     {
+         ok = FALSE;
+     }
+ 
+     LeaveCriticalSection(&store->lock);
+ 
+     if (ok && snapshot_id)
+         strcpy(snapshot_id, id);
+ 
+     return ok;
+ }
+ 
+ /**
+  * Get the ingest statistics of a backup session
+  */
+ void store_get_stats(BackupStore *store, StoreStats *stats)
+ {
+     EnterCriticalSection(&store->lock);
+     *stats = store->stats;
+     LeaveCriticalSection(&store->lock);
+ }
+ 
+ /**
+  * Close a backup session
+  */
+ void store_close(BackupStore *store)
+ {
+     if (!store)
+         return;
+ 
+     if (store->pack != INVALID_HANDLE_VALUE)
+     {
+         flush_pack(store);
+         CloseHandle(store->pack);
+     }
+ 
+     index_free(&store->index);
+     files_free(&store->files);
+     files_free(&store->parent);
+     free(store->write_buffer);
+     DeleteCriticalSection(&store->lock);
+     free(store);
+ }
+ 
+ /**
+  * List the snapshots of a repository, newest first
+  */
+ int store_list_snapshots(const char *repo_path, StoreSnapshotInfo *infos, int max)
+ {
+     char search_path[MAX_PATH_LEN];
+     char snap_path[MAX_PATH_LEN];
+     WIN32_FIND_DATA fd;
+     int count = 0;
+ 
+     snprintf(search_path, sizeof(search_path), "%s\\snapshots\\*.snap", repo_path);
+     HANDLE hFind = FindFirstFile(search_path, &fd);
+     if (hFind == INVALID_HANDLE_VALUE)
+         return 0;
+ 
+     do
+     {
+         StoreSnapshotInfo info;
+ 
+         if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+             continue;
+ 
+         snprintf(snap_path, sizeof(snap_path), "%s\\snapshots\\%s", repo_path, fd.cFileName);
+         if (!read_snapshot_info(snap_path, &info))
+             continue;
+ 
+         // Insertion sort by ID, which starts with the timestamp
+         int i = count < max ? count : max - 1;
+         if (count == max && strcmp(info.id, infos[i].id) <= 0)
+             continue;
+         while (i > 0 && strcmp(info.id, infos[i - 1].id) > 0)
+         {
+             infos[i] = infos[i - 1];
+             i--;
+         }
+         infos[i] = info;
+         if (count < max)
+             count++;
+     } while (FindNextFile(hFind, &fd));
+ 
+     FindClose(hFind);
+     return count;
+ }
+ 
+ /**
+  * Restore one file from its chunks. Every chunk is checked against its ID
+  * before it is written.
+  */
+ static BOOL restore_snapshot_file(SnapshotRestore *restore, const SnapshotFile *file, BYTE *buffer,
+                                   HANDLE *pack, DWORD *pack_id)
+ {
+     char pack_path[MAX_PATH_LEN];
+     char target_file[MAX_PATH_LEN];
+     char temp_file[MAX_PATH_LEN + 16];
+     StoreRestoreProgress *progress = restore->progress;
+     LONGLONG reported = 0;
+     HANDLE hFile;
+     BOOL ok = TRUE;
+ 
+     snprintf(target_file, sizeof(target_file), "%s\\%s", restore->target_path, file->path);
+     if (restore_file_current(target_file, file->size, file->mtime))
+     {
+         InterlockedExchangeAdd64(&progress->bytes_done, (LONGLONG)file->size);
+         InterlockedExchangeAdd64(&progress->bytes_skipped, (LONGLONG)file->size);
+         InterlockedIncrement(&progress->files_skipped);
+         return TRUE;
+     }
+ 
+     hFile = restore_file_create(target_file, temp_file, sizeof(temp_file), file->size);
+     if (hFile == INVALID_HANDLE_VALUE)
+         return FALSE;
+ 
+     for (int c = 0; ok && c < file->chunk_count; c++)
+     {
+         int i = index_find(&restore->index, &file->chunks[c]);
+         const ChunkLocation *location = i >= 0 ? &restore->index.items[i] : NULL;
+         LARGE_INTEGER offset;
+         DWORD read = 0, written = 0;
+         ChunkId id;
+ 
+         if (!location || location->length > STORE_CHUNK_MAX ||
+             (progress->cancelled && *progress->cancelled))
+         {
+             ok = FALSE;
+             break;
+         }
+ 
+         if (*pack == INVALID_HANDLE_VALUE || *pack_id != location->pack)
+         {
+             if (*pack != INVALID_HANDLE_VALUE)
+                 CloseHandle(*pack);
+             snprintf(pack_path, sizeof(pack_path), "%s\\packs\\pack-%06lu.pack", restore->repo_path,
+                      (unsigned long)location->pack);
+             *pack = CreateFile(pack_path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                                OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+             *pack_id = location->pack;
+             if (*pack == INVALID_HANDLE_VALUE)
+             {
+                 ok = FALSE;
+                 break;
+             }
+         }
+ 
+         offset.QuadPart = (LONGLONG)location->offset;
+         ok = SetFilePointerEx(*pack, offset, NULL, FILE_BEGIN) &&
+              ReadFile(*pack, buffer, location->length, &read, NULL) && read == location->length;
+ 
+         // Never write data that does not match its ID
+         if (ok)
+         {
+             chunk_id(buffer, location->length, &id);
+             ok = id.h[0] == file->chunks[c].h[0] && id.h[1] == file->chunks[c].h[1];
+         }
+ 
+         if (ok)
+             ok = WriteFile(hFile, buffer, location->length, &written, NULL) && written == location->length;
+ 
+         if (ok)
+         {
+             InterlockedExchangeAdd64(&progress->bytes_done, location->length);
+             reported += location->length;
+         }
+     }
+ 
+     // A failed file is taken out of the byte count again
+     ok = restore_file_finish(hFile, temp_file, target_file, file->mtime, ok);
+     if (!ok)
+         InterlockedExchangeAdd64(&progress->bytes_done, -reported);
+     return ok;
+ }
+ 
+ /**
+  * Restore worker: takes the next file until none are left. Each worker
+  * keeps its own pack file open and its own chunk buffer.
+  */
+ static DWORD WINAPI restore_snapshot_thread(LPVOID param)
+ {
+     SnapshotRestore *restore = (SnapshotRestore *)param;
+     StoreRestoreProgress *progress = restore->progress;
+     HANDLE pack = INVALID_HANDLE_VALUE;
+     DWORD pack_id = 0;
+     BYTE *buffer = (BYTE *)malloc(STORE_CHUNK_MAX);
+ 
+     for (;;)
+     {
+         LONG n = InterlockedIncrement(&restore->next) - 1;
+ 
+         if (n >= restore->list.count || (progress->cancelled && *progress->cancelled))
+             break;
+ 
+         const SnapshotFile *file = restore->order[n];
+         store_set_current(progress, file->path);
+ 
+         if (buffer && restore_snapshot_file(restore, file, buffer, &pack, &pack_id))
+         {
+             InterlockedIncrement(&progress->files_done);
+         }
+         else
+         {
+             InterlockedIncrement(&progress->files_failed);
+             InterlockedExchange(&restore->failed, TRUE);
+         }
+     }
+ 
+     if (pack != INVALID_HANDLE_VALUE)
+         CloseHandle(pack);
+     free(buffer);
+     return 0;
+ }
+ 
+ /**
+  * Order of a restore: large files first, so no worker ends with one alone
+  */
+ static int compare_size_desc(const void *a, const void *b)
+ {
+     ULONGLONG size_a = (*(const SnapshotFile *const *)a)->size;
+     ULONGLONG size_b = (*(const SnapshotFile *const *)b)->size;
+ 
+     return size_a < size_b ? 1 : size_a > size_b ? -1 : 0;
+ }
+ 
+ /**
+  * Restore all files of a snapshot into a directory
+  */
+ BOOL store_restore_snapshot(const char *repo_path, const char *snapshot_id, const char *target_path,
+                             int threads, StoreRestoreProgress *progress)
+ {
+     SnapshotRestore restore;
+     StoreSnapshotInfo info;
+     HANDLE workers[STORE_RESTORE_MAX_THREADS];
+     int worker_count = 0;
+     BOOL ok;
+ 
+     memset(&restore, 0, sizeof(restore));
+     restore.repo_path = repo_path;
+     restore.target_path = target_path;
+     restore.progress = progress;
+ 
+     if (!index_load(repo_path, &restore.index))
+         return FALSE;
+ 
+     if (!read_snapshot(repo_path, snapshot_id, &restore.list, &info) || !create_directory_path(target_path))
+     {
+         files_free(&restore.list);
+         index_free(&restore.index);
+         return FALSE;
+     }
+ 
+     restore.order = (const SnapshotFile **)malloc((restore.list.count + 1) * sizeof(SnapshotFile *));
+     if (!restore.order)
+     {
+         files_free(&restore.list);
+         index_free(&restore.index);
+         return FALSE;
+     }
+     for (int n = 0; n < restore.list.count; n++)
+     {
+         restore.order[n] = &restore.list.items[n];
+         progress->bytes_total += (LONGLONG)restore.list.items[n].size;
+     }
+     progress->files_total = restore.list.count;
+ 
+     qsort(restore.order, restore.list.count, sizeof(SnapshotFile *), compare_size_desc);
+ 
+     if (threads > STORE_RESTORE_MAX_THREADS)
+         threads = STORE_RESTORE_MAX_THREADS;
+     if (threads > restore.list.count)
+         threads = restore.list.count;
+     if (threads < 1)
+         threads = 1;
+     for (int i = 0; i < threads; i++)
+     {
+         workers[worker_count] = CreateThread(NULL, 0, restore_snapshot_thread, &restore, 0, NULL);
+         if (workers[worker_count])
+             worker_count++;
+     }
+     if (worker_count == 0)
+         restore_snapshot_thread(&restore);
+     else
+         WaitForMultipleObjects(worker_count, workers, TRUE, INFINITE);
+     for (int i = 0; i < worker_count; i++)
+         CloseHandle(workers[i]);
+ 
+     ok = !restore.failed && !(progress->cancelled && *progress->cancelled);
+     free(restore.order);
+     files_free(&restore.list);
+     index_free(&restore.index);
+     return ok;
+ }
+ 
+ /**
+  * Record the file being restored for the progress window
+  */
+ void store_set_current(StoreRestoreProgress *progress, const char *path)
+ {
+     if (progress->lock)
+         EnterCriticalSection(progress->lock);
+     strncpy(progress->current, path, sizeof(progress->current) - 1);
+     if (progress->lock)
+         LeaveCriticalSection(progress->lock);
+ }
\ No newline at end of file
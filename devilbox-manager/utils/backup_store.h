@@ -0,0 +1,168 @@
+/*******************************************************************************
+ * Backup Store Module Header
+ * Content-addressed backup repository: files are split into content-defined
+ * chunks, every distinct chunk is stored once in large pack files and each
+ * backup run is recorded as a snapshot that can be restored by its ID
+ *******************************************************************************/
+#ifndef BACKUP_STORE_H
+#define BACKUP_STORE_H
+
+#include <windows.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Maximum path length constant (if not already defined)
+#ifndef MAX_PATH_LEN
+#define MAX_PATH_LEN 260
+#endif
+
+// Repository directory inside HOST_PATH_BACKUPDIR (next to mysql/, pgsql/, ...)
+#define STORE_DIR_NAME "files"
+
+// Content-defined chunking bounds in bytes
+#define STORE_CHUNK_MIN (4 * 1024)
+#define STORE_CHUNK_AVG (16 * 1024)
+#define STORE_CHUNK_MAX (64 * 1024)
+
+// Pack files are closed and a new one started above this size
+#define STORE_PACK_SIZE (64 * 1024 * 1024)
+
+// Maximum number of snapshots returned by store_list_snapshots
+#define STORE_MAX_SNAPSHOTS 256
+
+// Upper bound of the restore workers
+#define STORE_RESTORE_MAX_THREADS 32
+
+// Result of adding a file to a snapshot
+enum
+{
+    STORE_FILE_FAILED,
+    STORE_FILE_STORED,   // Content was read, chunked and stored
+    STORE_FILE_REUSED    // Unchanged since the parent snapshot, chunks reused
+};
+
+// Ingest statistics of a backup session
+typedef struct
+{
+    LONGLONG files;          // Files recorded in the snapshot
+    LONGLONG files_reused;   // Files taken over from the parent snapshot
+    LONGLONG bytes_scanned;  // Logical size of all recorded files
+    LONGLONG bytes_read;     // Bytes actually read and chunked
+    LONGLONG bytes_new;      // Bytes of chunks that were not yet in the store
+    LONGLONG chunks;         // Chunk references in the snapshot
+    LONGLONG chunks_new;     // Chunks written to pack files
+} StoreStats;
+
+// Snapshot summary for listings
+typedef struct
+{
+    char id[32];
+    char time[32];
+    char source[MAX_PATH_LEN];
+    LONGLONG files;
+    LONGLONG bytes;
+} StoreSnapshotInfo;
+
+// Restore progress, updated while a restore runs
+typedef struct
+{
+    volatile LONG files_total;
+    volatile LONG files_done;       // Including files_skipped
+    volatile LONG files_skipped;    // Already restored by an interrupted run
+    volatile LONG files_failed;
+    volatile LONGLONG bytes_total;
+    volatile LONGLONG bytes_done;   // Including bytes_skipped
+    volatile LONGLONG bytes_skipped;
+    volatile LONG *cancelled;       // Stops the restore when set (may be NULL)
+    CRITICAL_SECTION *lock;         // Guards current (may be NULL)
+    char current[MAX_PATH_LEN];     // File being restored, for the progress window
+} StoreRestoreProgress;
+
+// Backup session writing one snapshot (opaque)
+typedef struct BackupStore BackupStore;
+
+/**
+ * Get the repository path for a devilbox installation
+ * @param devilbox_path Devilbox directory
+ * @param backup_dir HOST_PATH_BACKUPDIR value (relative to devilbox_path or absolute)
+ * @param repo_path Receives the repository path
+ * @param size Size of the repo_path buffer
+ */
+void store_get_repo_path(const char *devilbox_path, const char *backup_dir, char *repo_path, size_t size);
+
+/**
+ * Open a repository (creating it if needed) and start a new snapshot
+ * @param repo_path Repository directory
+ * @param source_root Directory that is backed up
+ * @return Backup session, NULL if the repository cannot be opened
+ */
+BackupStore *store_open(const char *repo_path, const char *source_root);
+
+/**
+ * Chunk a file into the store and record it in the snapshot (thread-safe)
+ * @param store Backup session
+ * @param file Full path of the file
+ * @param relative_path Path relative to the source root
+ * @param status_message Receives a status or error message (may be NULL)
+ * @return STORE_FILE_STORED, STORE_FILE_REUSED or STORE_FILE_FAILED
+ */
+int store_add_file(BackupStore *store, const char *file, const char *relative_path, char *status_message);
+
+/**
+ * Flush pack files, append new chunks to the index and write the snapshot
+ * @param store Backup session
+ * @param snapshot_id Receives the snapshot ID (at least 32 characters)
+ * @return TRUE on success
+ */
+BOOL store_commit(BackupStore *store, char *snapshot_id);
+
+/**
+ * Get the ingest statistics of a backup session
+ * @param store Backup session
+ * @param stats Receives the statistics
+ */
+void store_get_stats(BackupStore *store, StoreStats *stats);
+
+/**
+ * Close a backup session (an uncommitted snapshot is discarded)
+ * @param store Backup session
+ */
+void store_close(BackupStore *store);
+
+/**
+ * List the snapshots of a repository, newest first
+ * @param repo_path Repository directory
+ * @param infos Receives up to max snapshot summaries
+ * @param max Capacity of infos
+ * @return Number of snapshots returned
+ */
+int store_list_snapshots(const char *repo_path, StoreSnapshotInfo *infos, int max);
+
+/**
+ * Restore all files of a snapshot into a directory on several threads,
+ * largest files first. Files that an interrupted restore already wrote
+ * are kept.
+ * @param repo_path Repository directory
+ * @param snapshot_id Snapshot to restore
+ * @param target_path Directory that receives the files
+ * @param threads Worker threads (1 - STORE_RESTORE_MAX_THREADS)
+ * @param progress Progress counters
+ * @return TRUE if every file was restored
+ */
+BOOL store_restore_snapshot(const char *repo_path, const char *snapshot_id, const char *target_path,
+                            int threads, StoreRestoreProgress *progress);
+
+/**
+ * Record the file a restore is working on, under the lock of the progress
+ * @param progress Progress counters
+ * @param path File being restored
+ */
+void store_set_current(StoreRestoreProgress *progress, const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BACKUP_STORE_H */
\ No newline at end of file
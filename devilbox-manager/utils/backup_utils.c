@@ -3,70 +3,265 @@
  *******************************************************************************/
 
  #include "backup_utils.h"
+ #include "backup_manifest.h"
+ #include "backup_store.h"
+ #include "backup_restore.h"
+ #include "archive_writer.h"
+ #include "fast_copy.h"
+ #include "async_copy.h"
+ #include "backup_filter.h"
+ #include "backup_rotation.h"
+ #include "backup_verify.h"
+ #include "backup_plan.h"
+ #include "change_journal.h"
+ #include "hash_utils.h"
  #include <stdio.h>
  #include <string.h>
  #include <commctrl.h>
  
- // Forward declaration for internal recursive function
- static void backup_directory_internal(const char *source_dir, const char *target_dir,
-                                      const char *extensions, int include_subdirs,
-                                      int days, HWND hStatus, const char *source_root,
-                                      int *file_count);
+ // Upper bounds of the backup engine thread pools
+ #define BACKUP_MAX_WALKERS 4
+ #define BACKUP_MAX_COPIERS 16
+ // Capacity of the bounded queue between walkers and copy workers
+ #define BACKUP_QUEUE_SIZE 1024
+ // Interval of status updates while a backup is running (ms)
+ #define BACKUP_STATUS_INTERVAL 200
+ // Longest single sleep of the I/O throttle, cancellation is noticed in between (ms)
+ #define BACKUP_THROTTLE_SLICE 100
  
- /**
-  * Check if file has matching extension
-  */
- BOOL file_has_extension(const char *filename, const char *extensions)
- {
-     char ext_list[MAX_PATH_LEN];
-     char *token;
-     char file_ext[MAX_PATH_LEN] = "";
+ // Progress window of a task
+ #define ID_BACKUP_PAUSE 101
+ #define ID_BACKUP_TIMER 1
+ // Owner windows a task disables while it runs
+ #define TASK_MAX_OWNERS 4
+ // Wait for a cancelled task when its window is destroyed, before leaving it to finish alone (ms)
+ #define TASK_CLOSE_WAIT 2000
  
-     // Get file extension
-     const char *ext = strrchr(filename, '.');
-     if (ext) {
-         strcpy(file_ext, ext);
-     }
-     else if (strncmp(filename, ".htaccess", 9) == 0) {
-         // Special case for .htaccess
-         strcpy(file_ext, ".htaccess");
-     }
-     else {
-         return FALSE;
-     }
+ // Declarations missing from older MinGW headers
+ #ifndef THREAD_MODE_BACKGROUND_BEGIN
+ #define THREAD_MODE_BACKGROUND_BEGIN 0x00010000
+ #endif
  
-     // Copy extension list for safe tokenization
-     strcpy(ext_list, extensions);
+ // Directory deque of a walker: the owner works at the tail, thieves take from the head
+ typedef struct {
+     CRITICAL_SECTION lock;
+     char **items;
+     int head;
+     int tail;
+     int capacity;
+ } DirDeque;
  
-     // Check all extensions
-     token = strtok(ext_list, ",;");
-     while (token) {
-         // Trim whitespace
-         while (*token == ' ')
-             token++;
+ // File found by a walker, with its size for the progress totals
+ typedef struct {
+     LONGLONG size;
+     char path[1];
+ } QueuedFile;
  
-         // Check if extension matches
-         if (*token == '.') {
-             if (_stricmp(file_ext, token) == 0)
-                 return TRUE;
-         }
-         else {
-             char temp[MAX_PATH_LEN] = ".";
-             strcat(temp, token);
-             if (_stricmp(file_ext, temp) == 0)
-                 return TRUE;
-         }
+ // Bounded queue of files waiting to be copied
+ typedef struct {
+     CRITICAL_SECTION lock;
+     HANDLE free_slots;
+     HANDLE used_slots;
+     QueuedFile **items;
+     int head;
+     int count;
+ } CopyQueue;
  
-         // Next token
-         token = strtok(NULL, ",;");
-     }
+ // Result of backing up a single file
+ enum {
+     BACKUP_FILE_COPIED,
+     BACKUP_FILE_UNCHANGED,
+     BACKUP_FILE_FAILED,
+     BACKUP_FILE_PENDING   // Started on the overlapped copier, its callback finishes the file
+ };
  
-     // Check special case for .htaccess
-     if (strcmp(filename, ".htaccess") == 0 && strstr(extensions, "htaccess") != NULL)
-         return TRUE;
+ // Shared state of a running backup
+ typedef struct BackupEngine {
+     const char *source_root;
+     const char *target_root;
+     BackupFilter *filter;
+     int include_subdirs;
+     int days;
+     BackupManifest *manifest;
+     const char *link_root;       // Rotation: previous snapshot, unchanged files are linked from it
+     BackupStore *store;
+     ArchiveWriter *archive;
+     FastCopyStats copy_stats;
+     BackupProgress *progress;
+     int background;
+     int overlapped;              // Copy workers queue their copies on a completion port
  
-     return FALSE;
- }
+     // Bandwidth limit: a virtual clock (ms since throttle_start) of when the
+     // transfers so far are due at the configured rate
+     double bytes_per_ms;
+     double throttle_clock;
+     DWORD throttle_start;
+     CRITICAL_SECTION throttle_lock;
+ 
+     DirDeque deques[BACKUP_MAX_WALKERS];
+     int walker_count;
+     int copier_count;
+     volatile LONG pending_dirs;
+     volatile LONG active_walkers;
+     volatile LONG active_copiers;
+ 
+     CopyQueue queue;
+     HANDLE done_event;
+ 
+     volatile LONG files_copied;
+     volatile LONG files_unchanged;
+     volatile LONG files_failed;
+     volatile LONG files_linked;
+     volatile LONG dirs_scanned;
+     volatile LONGLONG bytes_copied;
+ 
+     // Database dump, runs on its own thread beside the walkers and copiers
+     HANDLE dump_thread;
+     DbDumpOptions dump_options;
+     char dump_dir[MAX_PATH_LEN];
+     char dump_error[MAX_PATH_LEN];
+     BOOL dump_ok;
+ } BackupEngine;
+ 
+ // Progress of one file copy
+ typedef struct {
+     BackupEngine *engine;
+     LONGLONG reported;
+ } CopyContext;
+ 
+ // File taken from the copy queue, until its result is counted
+ typedef struct {
+     BackupEngine *engine;
+     QueuedFile *file;
+     AsyncCopier *async;          // Overlapped copier of the worker, NULL to copy right away
+     CopyContext copy;
+     FastCopyOptions copy_options;
+     // Manifest entry recorded once the copy is complete
+     BOOL update_manifest;
+     ULONGLONG size;
+     ULONGLONG mtime;
+     ULONGLONG hash;
+ } CopyTask;
+ 
+ // Walker thread parameter
+ typedef struct {
+     BackupEngine *engine;
+     int index;
+ } WalkerParam;
+ 
+ // Restore thread parameter
+ typedef struct {
+     RestoreOptions options;
+     RestoreProgress progress;
+     BOOL result;
+ } RestoreJob;
+ 
+ // Verify thread parameter
+ typedef struct {
+     VerifyOptions options;
+     VerifyProgress progress;
+     BOOL result;
+ } VerifyJob;
+ 
+ // Plan thread parameter
+ typedef struct {
+     BackupOptions options;
+     BackupPlan plan;
+     BOOL result;
+ } PlanJob;
+ 
+ typedef struct BackupTask BackupTask;
+ 
+ // Kind of work a task window runs: backup, restore, verify or plan
+ typedef struct {
+     const char *title;                   // Caption while it runs
+     const char *status;                  // Status line until the first update
+     BOOL progress_bar;
+     LPTHREAD_START_ROUTINE run;          // Thread procedure, receives the job
+     void (*update)(BackupTask *task);    // Refresh the status, counters and progress bar
+     void (*cancel)(void *job);
+     void (*report)(BackupTask *task);    // Show the outcome once the thread is done
+     void (*release)(void *job);
+     void (*pause)(void *job, BOOL pause);  // NULL if the task cannot be paused
+ } BackupTaskKind;
+ 
+ // Backup, restore, verify or plan running in the background with its progress window
+ struct BackupTask {
+     const BackupTaskKind *kind;
+     void *job;
+     HANDLE thread;
+     HWND hwnd;
+     HWND hStatus;
+     HWND hCounters;
+     HWND hProgress;
+     HWND hPause;
+     HWND hCancel;
+     HWND disabled[TASK_MAX_OWNERS];      // Owners that take no input until the task is done
+     int disabled_count;
+     DWORD start_time;
+     DWORD paused_since;
+     DWORD paused_time;                   // Time spent paused, left out of the rate (ms)
+     BOOL paused;
+     BOOL cancelling;
+     BOOL finished;
+ };
+ 
+ // Backup thread parameter
+ typedef struct {
+     BackupOptions options;
+     BackupProgress progress;
+ } BackupJob;
+ 
+ // Forward declarations for the backup engine
+ static void deque_push(DirDeque *deque, char *dir);
+ static char *deque_pop(DirDeque *deque);
+ static char *deque_steal(DirDeque *deque);
+ static void queue_push(CopyQueue *queue, QueuedFile *file);
+ static QueuedFile *queue_pop(CopyQueue *queue, AsyncCopier *async);
+ static void scan_directory(BackupEngine *engine, int index, const char *dir);
+ static DWORD WINAPI walker_thread(LPVOID param);
+ static void walker_finished(BackupEngine *engine);
+ static DWORD WINAPI copier_thread(LPVOID param);
+ static int copy_task_file(CopyTask *task, char *status_message);
+ static void copy_task_done(int result, DWORD error, void *tag);
+ static void finish_task(CopyTask *task, int result, const char *status_message);
+ static void set_engine_status(BackupEngine *engine, const char *message);
+ static void throttle_io(BackupEngine *engine, LONGLONG bytes);
+ static BOOL copy_progress(LONGLONG bytes, void *context);
+ static void enter_background_mode(BackupEngine *engine);
+ static void queue_file(BackupEngine *engine, const char *full_path, LONGLONG size);
+ static BOOL journal_dir_reachable(BackupEngine *engine, const char *relative_dir);
+ static BOOL seed_from_journal(BackupEngine *engine, JournalChanges *changes);
+ static void queue_journal_files(BackupEngine *engine, JournalChanges *changes);
+ static const char *get_relative_path(BackupEngine *engine, const char *file);
+ static int backup_file_if_changed(CopyTask *task, char *status_message);
+ static DWORD WINAPI dump_thread(LPVOID param);
+ static void start_task(const BackupTaskKind *kind, void *job, HWND owner);
+ static void enable_owners(BackupTask *task);
+ static LRESULT CALLBACK backup_task_proc(HWND hwnd, UINT msg, WPARAM wp, LPARAM lp);
+ static DWORD WINAPI release_task_thread(LPVOID param);
+ static void release_task(BackupTask *task);
+ static DWORD WINAPI backup_thread(LPVOID param);
+ static void update_backup(BackupTask *task);
+ static void pause_backup(void *job, BOOL pause);
+ static void cancel_backup(void *job);
+ static void report_backup(BackupTask *task);
+ static void release_backup(void *job);
+ static DWORD WINAPI restore_thread(LPVOID param);
+ static void update_restore(BackupTask *task);
+ static void cancel_restore(void *job);
+ static void report_restore(BackupTask *task);
+ static void release_restore(void *job);
+ static DWORD WINAPI verify_thread(LPVOID param);
+ static void update_verify(BackupTask *task);
+ static void cancel_verify(void *job);
+ static void report_verify(BackupTask *task);
+ static void release_verify(void *job);
+ static DWORD WINAPI plan_thread(LPVOID param);
+ static void update_plan(BackupTask *task);
+ static void cancel_plan(void *job);
+ static void report_plan(BackupTask *task);
+ static void release_plan(void *job);
  
  /**
   * Create directory path recursively
@@ -157,13 +352,12 @@
  }
  
  /**
-  * Copy file while preserving the directory structure
+  * Build the target path of a source file and create its directory
   */
- BOOL copy_file_with_path(const char *source_file, const char *source_root,
-                         const char *target_root, char *status_message)
+ static BOOL make_target_path(const char *source_file, const char *source_root, const char *target_root,
+                              char *target_file, char *status_message)
  {
      char relative_path[MAX_PATH_LEN] = {0};
-     char target_file[MAX_PATH_LEN] = {0};
      char target_dir[MAX_PATH_LEN] = {0};
      char *p;
  
@@ -188,6 +382,7 @@
  
      // Create full target path including directories
      _snprintf(target_file, MAX_PATH_LEN, "%s\\%s", target_root, relative_path);
+     target_file[MAX_PATH_LEN - 1] = 0;
  
      // Extract target directory path
      strcpy(target_dir, target_file);
@@ -204,8 +399,24 @@
          }
      }
  
-     // Copy the file
-     if (!CopyFile(source_file, target_file, FALSE)) {
+     return TRUE;
+ }
+ 
+ /**
+  * Copy file while preserving the directory structure
+  */
+ BOOL copy_file_with_path(const char *source_file, const char *source_root,
+                         const char *target_root, char *status_message, const FastCopyOptions *copy_options)
+ {
+     char target_file[MAX_PATH_LEN] = {0};
+     int strategy;
+ 
+     if (!make_target_path(source_file, source_root, target_root, target_file, status_message))
+         return FALSE;
+ 
+     // Copy the file with the cheapest strategy the volumes allow
+     strategy = fast_copy_file(source_file, target_file, copy_options);
+     if (strategy < 0) {
          if (status_message) {
              sprintf(status_message, "Failed to copy file: %s (Error: %d)",
                      source_file, GetLastError());
@@ -214,150 +425,1735 @@
      }
  
      if (status_message) {
-         sprintf(status_message, "Copied: %s", relative_path);
+         sprintf(status_message, "Copied (%s): %s", fast_copy_strategy_name(strategy),
+                 target_file + strlen(target_root) + 1);
      }
  
      return TRUE;
  }
  
  /**
-  * Backup directory with proper directory structure preservation
+  * Push a directory to the owner end of a walker deque
+  */
+ static void deque_push(DirDeque *deque, char *dir)
+ {
+     EnterCriticalSection(&deque->lock);
+ 
+     if (deque->tail == deque->capacity) {
+         // Reclaim the stolen part before growing
+         if (deque->head > 0) {
+             memmove(deque->items, deque->items + deque->head,
+                     (deque->tail - deque->head) * sizeof(char *));
+             deque->tail -= deque->head;
+             deque->head = 0;
+         }
+         if (deque->tail == deque->capacity) {
+             int capacity = deque->capacity ? deque->capacity * 2 : 64;
+             char **items = (char **)realloc(deque->items, capacity * sizeof(char *));
+             if (!items) {
+                 LeaveCriticalSection(&deque->lock);
+                 free(dir);
+                 return;
+             }
+             deque->items = items;
+             deque->capacity = capacity;
+         }
+     }
+ 
+     deque->items[deque->tail++] = dir;
+     LeaveCriticalSection(&deque->lock);
+ }
+ 
+ /**
+  * Pop the most recently pushed directory (depth first for the owner)
+  */
+ static char *deque_pop(DirDeque *deque)
+ {
+     char *dir = NULL;
+ 
+     EnterCriticalSection(&deque->lock);
+     if (deque->tail > deque->head) {
+         dir = deque->items[--deque->tail];
+         if (deque->tail == deque->head)
+             deque->head = deque->tail = 0;
+     }
+     LeaveCriticalSection(&deque->lock);
+ 
+     return dir;
+ }
+ 
+ /**
+  * Steal the oldest directory (closest to the root, so the largest subtree)
+  */
+ static char *deque_steal(DirDeque *deque)
+ {
+     char *dir = NULL;
+ 
+     // Never wait on a busy victim, just try the next one
+     if (!TryEnterCriticalSection(&deque->lock))
+         return NULL;
+ 
+     if (deque->tail > deque->head) {
+         dir = deque->items[deque->head++];
+         if (deque->tail == deque->head)
+             deque->head = deque->tail = 0;
+     }
+     LeaveCriticalSection(&deque->lock);
+ 
+     return dir;
+ }
+ 
+ /**
+  * Add a file to the copy queue, blocking while the queue is full
+  */
+ static void queue_push(CopyQueue *queue, QueuedFile *file)
+ {
+     WaitForSingleObject(queue->free_slots, INFINITE);
+ 
+     EnterCriticalSection(&queue->lock);
+     queue->items[(queue->head + queue->count) % BACKUP_QUEUE_SIZE] = file;
+     queue->count++;
+     LeaveCriticalSection(&queue->lock);
+ 
+     ReleaseSemaphore(queue->used_slots, 1, NULL);
+ }
+ 
+ /**
+  * Take a file from the copy queue, NULL tells the copy worker to stop.
+  * Overlapped copies of the worker are finished while it waits.
+  */
+ static QueuedFile *queue_pop(CopyQueue *queue, AsyncCopier *async)
+ {
+     QueuedFile *file;
+ 
+     while (WaitForSingleObject(queue->used_slots, async_copy_active(async) ? 0 : INFINITE) == WAIT_TIMEOUT)
+         async_copy_wait(async, 1);
+ 
+     EnterCriticalSection(&queue->lock);
+     file = queue->items[queue->head];
+     queue->head = (queue->head + 1) % BACKUP_QUEUE_SIZE;
+     queue->count--;
+     LeaveCriticalSection(&queue->lock);
+ 
+     ReleaseSemaphore(queue->free_slots, 1, NULL);
+     return file;
+ }
+ 
+ /**
+  * Remember the latest status message for the progress window
+  */
+ static void set_engine_status(BackupEngine *engine, const char *message)
+ {
+     BackupProgress *progress = engine->progress;
+ 
+     EnterCriticalSection(&progress->lock);
+     strncpy(progress->message, message, sizeof(progress->message) - 1);
+     LeaveCriticalSection(&progress->lock);
+ }
+ 
+ /**
+  * Bandwidth limit: every transfer moves the virtual clock on by its duration
+  * at the configured rate, threads ahead of the wall clock sleep until it catches up
   */
- void backup_directory(const char *source_dir, const char *target_dir,
-                      const char *extensions, int include_subdirs,
-                      int days, HWND hStatus)
+ static void throttle_io(BackupEngine *engine, LONGLONG bytes)
  {
-     int file_count = 0;
-     
-     // Start the recursive backup process with source_dir as the source_root
-     backup_directory_internal(source_dir, target_dir, extensions, include_subdirs,
-                              days, hStatus, source_dir, &file_count);
-     
-     // Show final status message
-     if (hStatus) {
-         char status_message[MAX_PATH_LEN * 2];
-         sprintf(status_message, "Backup complete. Copied %d files.", file_count);
-         SetWindowText(hStatus, status_message);
+     double now, delay;
+ 
+     if (engine->bytes_per_ms <= 0 || bytes <= 0)
+         return;
+ 
+     EnterCriticalSection(&engine->throttle_lock);
+     now = (double)(GetTickCount() - engine->throttle_start);
+     // Idle time (pauses, listing) is not saved up for a burst
+     if (engine->throttle_clock < now)
+         engine->throttle_clock = now;
+     engine->throttle_clock += bytes / engine->bytes_per_ms;
+     delay = engine->throttle_clock - now;
+     LeaveCriticalSection(&engine->throttle_lock);
+ 
+     while (delay >= 1 && !engine->progress->cancelled) {
+         DWORD slice = delay < BACKUP_THROTTLE_SLICE ? (DWORD)delay : BACKUP_THROTTLE_SLICE;
+         Sleep(slice);
+         delay -= slice;
      }
  }
  
  /**
-  * Internal recursive function to backup directories and files while preserving structure
+  * Progress of a file copy: counts the bytes, applies the bandwidth limit
+  * and holds the copy while the backup is paused
+  */
+ static BOOL copy_progress(LONGLONG bytes, void *context)
+ {
+     CopyContext *copy = (CopyContext *)context;
+     BackupProgress *progress = copy->engine->progress;
+ 
+     copy->reported += bytes;
+     InterlockedExchangeAdd64(&progress->bytes_done, bytes);
+     throttle_io(copy->engine, bytes);
+     WaitForSingleObject(progress->resume_event, INFINITE);
+     return !progress->cancelled;
+ }
+ 
+ /**
+  * Lower the I/O and CPU priority of a worker thread (Vista and later,
+  * older systems keep the normal priority)
+  */
+ static void enter_background_mode(BackupEngine *engine)
+ {
+     if (engine->background)
+         SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+ }
+ 
+ /**
+  * List one directory: subdirectories go to the walker deque, matching files to the copy queue
   */
- static void backup_directory_internal(const char *source_dir, const char *target_dir,
-                                      const char *extensions, int include_subdirs,
-                                      int days, HWND hStatus, const char *source_root,
-                                      int *file_count)
+ static void scan_directory(BackupEngine *engine, int index, const char *dir)
  {
      char search_path[MAX_PATH_LEN];
      char full_path[MAX_PATH_LEN];
-     char status_message[MAX_PATH_LEN * 2];
      WIN32_FIND_DATA fd;
      HANDLE hFind;
  
-     // Format search path for finding all files in current directory
-     _snprintf(search_path, MAX_PATH_LEN, "%s\\*", source_dir);
+     _snprintf(search_path, MAX_PATH_LEN, "%s\\*", dir);
+     search_path[MAX_PATH_LEN - 1] = 0;
  
-     // Start search
      hFind = FindFirstFile(search_path, &fd);
      if (hFind == INVALID_HANDLE_VALUE)
          return;
  
+     InterlockedIncrement(&engine->dirs_scanned);
+ 
      do {
          // Skip . and ..
          if (strcmp(fd.cFileName, ".") == 0 || strcmp(fd.cFileName, "..") == 0)
              continue;
  
-         // Create full path to the current file/directory
-         _snprintf(full_path, MAX_PATH_LEN, "%s\\%s", source_dir, fd.cFileName);
+         _snprintf(full_path, MAX_PATH_LEN, "%s\\%s", dir, fd.cFileName);
+         full_path[MAX_PATH_LEN - 1] = 0;
  
          if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
-             // If this is a directory and we need to include subdirectories
-             if (include_subdirs) {
-                 // Recursively process subdirectory, maintaining original source_root
-                 backup_directory_internal(full_path, target_dir, extensions, include_subdirs,
-                                          days, hStatus, source_root, file_count);
-             }
-         } else {
-             // This is a file - check if it matches our criteria
-             if (file_has_extension(fd.cFileName, extensions) &&
-                 is_file_modified_recently(full_path, days)) {
- 
-                 // Copy file with preserved directory structure
-                 if (copy_file_with_path(full_path, source_root, target_dir, status_message)) {
-                     (*file_count)++;
-                     
-                     if (hStatus) {
-                         SetWindowText(hStatus, status_message);
-                     }
-                 } else if (hStatus) {
-                     SetWindowText(hStatus, status_message);
+             // Excluded subtrees (vendor, node_modules, .git) are never listed
+             if (engine->include_subdirs && !filter_prune_directory(engine->filter, get_relative_path(engine, full_path))) {
+                 char *subdir = _strdup(full_path);
+                 if (subdir) {
+                     InterlockedIncrement(&engine->pending_dirs);
+                     deque_push(&engine->deques[index], subdir);
                  }
              }
+         } else if (filter_match_file(engine->filter, get_relative_path(engine, full_path)) &&
+                    (engine->manifest || engine->store || engine->archive || is_file_modified_recently(full_path, engine->days))) {
+             queue_file(engine, full_path, ((LONGLONG)fd.nFileSizeHigh << 32) | fd.nFileSizeLow);
          }
-     } while (FindNextFile(hFind, &fd));
+     } while (!engine->progress->cancelled && FindNextFile(hFind, &fd));
  
      FindClose(hFind);
  }
  
  /**
-  * Execute backup with progress dialog
+  * Hand a file to the copy workers
   */
- void execute_backup(const char *source_path, const char *target_path,
-                    const char *extensions, int include_subdirs, int days)
+ static void queue_file(BackupEngine *engine, const char *full_path, LONGLONG size)
  {
-     HWND hDlg;
-     HWND hStatus;
-     HWND hProgress;
-     HWND hButton;
+     size_t len = strlen(full_path);
+     QueuedFile *file = (QueuedFile *)malloc(sizeof(QueuedFile) + len);
  
-     // Create simple progress window
-     hDlg = CreateWindowEx(
-         WS_EX_DLGMODALFRAME,
-         "STATIC",
-         "Backup in Progress",
-         WS_POPUP | WS_CAPTION | WS_SYSMENU | WS_VISIBLE,
-         CW_USEDEFAULT, CW_USEDEFAULT, 500, 150,
-         NULL, NULL, GetModuleHandle(NULL), NULL);
+     if (file) {
+         file->size = size;
+         memcpy(file->path, full_path, len + 1);
+         InterlockedIncrement(&engine->progress->files_found);
+         InterlockedExchangeAdd64(&engine->progress->bytes_found, file->size);
+         queue_push(&engine->queue, file);
+     }
+ }
+ 
+ /**
+  * Check whether listing from the source root would reach a directory
+  */
+ static BOOL journal_dir_reachable(BackupEngine *engine, const char *relative_dir)
+ {
+     char path[MAX_PATH_LEN];
+ 
+     if (!relative_dir[0])
+         return TRUE;
+     if (!engine->include_subdirs)
+         return FALSE;
+ 
+     // Every parent on the way down must pass the exclude rules
+     snprintf(path, sizeof(path), "%s", relative_dir);
+     for (char *p = path; ; p++) {
+         if (*p == '\\' || *p == 0) {
+             char c = *p;
+             BOOL pruned;
+ 
+             *p = 0;
+             pruned = filter_prune_directory(engine->filter, path);
+             *p = c;
+             if (pruned)
+                 return FALSE;
+             if (!c)
+                 break;
+         }
+     }
+     return TRUE;
+ }
+ 
+ /**
+  * Set up a run over what the change journal reported: everything else counts
+  * as seen, files below deleted or replaced directories as missing, and new
+  * directories go to the first walker to be listed in full
+  */
+ static BOOL seed_from_journal(BackupEngine *engine, JournalChanges *changes)
+ {
+     int count = journal_change_count(changes);
+     const char **trees = (const char **)malloc((count > 0 ? count : 1) * sizeof(const char *));
+     int tree_count = 0;
+ 
+     if (!trees)
+         return FALSE;
+ 
+     manifest_mark_all_seen(engine->manifest);
+     for (int i = 0; i < count; i++) {
+         int kind;
+         const char *path = journal_get_change(changes, i, &kind);
+ 
+         if (kind == JOURNAL_CHANGE_FILE)
+             continue;
+         trees[tree_count++] = path;
+ 
+         if (kind == JOURNAL_CHANGE_TREE && journal_dir_reachable(engine, path)) {
+             char *dir = (char *)malloc(strlen(engine->source_root) + strlen(path) + 2);
+             if (dir) {
+                 sprintf(dir, "%s\\%s", engine->source_root, path);
+                 engine->pending_dirs++;
+                 deque_push(&engine->deques[0], dir);
+             }
+         }
+     }
+     manifest_mark_missing(engine->manifest, trees, tree_count, TRUE);
+     free(trees);
+     return TRUE;
+ }
+ 
+ /**
+  * Queue the files the change journal reported. Files deleted since, or no
+  * longer matching the rules, count as missing.
+  */
+ static void queue_journal_files(BackupEngine *engine, JournalChanges *changes)
+ {
+     int count = journal_change_count(changes);
+ 
+     for (int i = 0; i < count && !engine->progress->cancelled; i++) {
+         char full_path[MAX_PATH_LEN];
+         char dir[MAX_PATH_LEN];
+         WIN32_FILE_ATTRIBUTE_DATA attr;
+         int kind;
+         const char *path = journal_get_change(changes, i, &kind);
+         char *p;
+ 
+         if (kind != JOURNAL_CHANGE_FILE)
+             continue;
+ 
+         snprintf(dir, sizeof(dir), "%s", path);
+         p = strrchr(dir, '\\');
+         *(p ? p : dir) = 0;
+         snprintf(full_path, sizeof(full_path), "%s\\%s", engine->source_root, path);
+ 
+         if (journal_dir_reachable(engine, dir) && filter_match_file(engine->filter, path) &&
+             GetFileAttributesEx(full_path, GetFileExInfoStandard, &attr) &&
+             !(attr.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+             queue_file(engine, full_path, ((LONGLONG)attr.nFileSizeHigh << 32) | attr.nFileSizeLow);
+         else
+             manifest_mark_missing(engine->manifest, &path, 1, FALSE);
+     }
+ }
+ 
+ /**
+  * Walker thread: drains its own deque, then steals from the other walkers
+  */
+ static DWORD WINAPI walker_thread(LPVOID param)
+ {
+     BackupEngine *engine = ((WalkerParam *)param)->engine;
+     int index = ((WalkerParam *)param)->index;
+ 
+     enter_background_mode(engine);
+     for (;;) {
+         char *dir = deque_pop(&engine->deques[index]);
+ 
+         for (int i = 1; !dir && i < engine->walker_count; i++)
+             dir = deque_steal(&engine->deques[(index + i) % engine->walker_count]);
+ 
+         if (!dir) {
+             // Directories still being listed may produce more work
+             if (engine->pending_dirs == 0)
+                 break;
+             Sleep(1);
+             continue;
+         }
+ 
+         // Hold while paused; once cancelled the deques are only drained
+         WaitForSingleObject(engine->progress->resume_event, INFINITE);
+         if (!engine->progress->cancelled)
+             scan_directory(engine, index, dir);
+         free(dir);
+         InterlockedDecrement(&engine->pending_dirs);
+     }
+ 
+     walker_finished(engine);
+     return 0;
+ }
+ 
+ /**
+  * The last walker tells every copy worker to stop once the queue drains
+  */
+ static void walker_finished(BackupEngine *engine)
+ {
+     if (InterlockedDecrement(&engine->active_walkers) == 0) {
+         engine->progress->scanning = FALSE;
+         for (int i = 0; i < engine->copier_count; i++)
+             queue_push(&engine->queue, NULL);
+     }
+ }
+ 
+ /**
+  * Copy worker thread
+  */
+ static DWORD WINAPI copier_thread(LPVOID param)
+ {
+     BackupEngine *engine = (BackupEngine *)param;
+     BackupProgress *progress = engine->progress;
+     char status_message[MAX_PATH_LEN * 2];
+     AsyncCopier *async = NULL;
+     QueuedFile *file;
+ 
+     // Without a completion port the worker copies one file at a time
+     if (engine->overlapped)
+         async = async_copy_create(ASYNC_COPY_WINDOW);
+ 
+     enter_background_mode(engine);
+     while ((file = queue_pop(&engine->queue, async)) != NULL) {
+         CopyTask *task;
+         int result;
+ 
+         // Hold while paused; once cancelled the queue is only drained
+         WaitForSingleObject(progress->resume_event, INFINITE);
+         task = progress->cancelled ? NULL : (CopyTask *)calloc(1, sizeof(CopyTask));
+         if (!task) {
+             free(file);
+             continue;
+         }
+ 
+         task->engine = engine;
+         task->file = file;
+         task->async = async;
+         task->copy.engine = engine;
+         task->copy_options.stats = &engine->copy_stats;
+         task->copy_options.progress = copy_progress;
+         task->copy_options.context = &task->copy;
+ 
+         if (engine->store) {
+             int stored = store_add_file(engine->store, file->path, get_relative_path(engine, file->path), status_message);
+             result = stored == STORE_FILE_STORED ? BACKUP_FILE_COPIED :
+                      stored == STORE_FILE_REUSED ? BACKUP_FILE_UNCHANGED : BACKUP_FILE_FAILED;
+         }
+         else if (engine->archive)
+             result = archive_add_file(engine->archive, file->path, get_relative_path(engine, file->path), status_message)
+                      ? BACKUP_FILE_COPIED : BACKUP_FILE_FAILED;
+         else if (engine->manifest)
+             result = backup_file_if_changed(task, status_message);
+         else
+             result = copy_task_file(task, status_message);
+ 
+         if (result != BACKUP_FILE_PENDING)
+             finish_task(task, result, status_message);
+     }
  
-     if (!hDlg) {
-         MessageBox(NULL, "Failed to create progress window.", "Error", MB_ICONERROR);
+     async_copy_free(async);
+ 
+     if (InterlockedDecrement(&engine->active_copiers) == 0)
+         SetEvent(engine->done_event);
+ 
+     return 0;
+ }
+ 
+ /**
+  * Copy a file into the target tree, right away or on the overlapped copier
+  */
+ static int copy_task_file(CopyTask *task, char *status_message)
+ {
+     BackupEngine *engine = task->engine;
+     char target_file[MAX_PATH_LEN];
+ 
+     if (!task->async)
+         return copy_file_with_path(task->file->path, engine->source_root, engine->target_root, status_message,
+                                    &task->copy_options) ? BACKUP_FILE_COPIED : BACKUP_FILE_FAILED;
+ 
+     if (!make_target_path(task->file->path, engine->source_root, engine->target_root, target_file, status_message))
+         return BACKUP_FILE_FAILED;
+ 
+     async_copy_submit(task->async, task->file->path, target_file, &task->copy_options, copy_task_done, task);
+     return BACKUP_FILE_PENDING;
+ }
+ 
+ /**
+  * Completion of an overlapped copy
+  */
+ static void copy_task_done(int result, DWORD error, void *tag)
+ {
+     CopyTask *task = (CopyTask *)tag;
+     char status_message[MAX_PATH_LEN * 2];
+ 
+     if (result < 0)
+         sprintf(status_message, "Failed to copy file: %s (Error: %lu)", task->file->path, error);
+     else
+         sprintf(status_message, "Copied (%s): %s", fast_copy_strategy_name(result),
+                 get_relative_path(task->engine, task->file->path));
+ 
+     finish_task(task, result < 0 ? BACKUP_FILE_FAILED : BACKUP_FILE_COPIED, status_message);
+ }
+ 
+ /**
+  * Count the result of a file and free it
+  */
+ static void finish_task(CopyTask *task, int result, const char *status_message)
+ {
+     BackupEngine *engine = task->engine;
+     BackupProgress *progress = engine->progress;
+     QueuedFile *file = task->file;
+ 
+     // A copy aborted by cancelling is neither done nor failed
+     if (result == BACKUP_FILE_FAILED && progress->cancelled) {
+         InterlockedExchangeAdd64(&progress->bytes_done, -task->copy.reported);
+         free(file);
+         free(task);
          return;
      }
  
-     // Add controls
-     hStatus = CreateWindowEx(
-         0, "STATIC", "Starting backup...",
-         WS_CHILD | WS_VISIBLE | SS_LEFT,
-         10, 20, 470, 20,
-         hDlg, NULL, GetModuleHandle(NULL), NULL);
+     // Copies against a manifest are recorded once they are complete
+     if (result == BACKUP_FILE_COPIED && engine->manifest) {
+         InterlockedExchangeAdd64(&engine->bytes_copied, task->size);
+         if (task->update_manifest)
+             manifest_update(engine->manifest, get_relative_path(engine, file->path), task->size, task->mtime, task->hash);
+     }
  
-     hProgress = CreateWindowEx(
-         0, PROGRESS_CLASS, NULL,
-         WS_CHILD | WS_VISIBLE | PBS_SMOOTH,
-         10, 50, 470, 20,
-         hDlg, NULL, GetModuleHandle(NULL), NULL);
+     // The repository and the archive read whole files, they are throttled file by file
+     if ((engine->store || engine->archive) && result != BACKUP_FILE_UNCHANGED)
+         throttle_io(engine, file->size);
  
-     hButton = CreateWindowEx(
-         0, "BUTTON", "Cancel",
-         WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
-         200, 80, 100, 30,
-         hDlg, (HMENU)IDCANCEL, GetModuleHandle(NULL), NULL);
+     // Bytes the copy did not report: cloned, unchanged, stored, archived and failed files
+     if (file->size > task->copy.reported)
+         InterlockedExchangeAdd64(&progress->bytes_done, file->size - task->copy.reported);
+     InterlockedIncrement(&progress->files_done);
+ 
+     if (result == BACKUP_FILE_COPIED)
+         InterlockedIncrement(&engine->files_copied);
+     else if (result == BACKUP_FILE_UNCHANGED)
+         InterlockedIncrement(&engine->files_unchanged);
+     else
+         InterlockedIncrement(&engine->files_failed);
+ 
+     if (result != BACKUP_FILE_UNCHANGED)
+         set_engine_status(engine, status_message);
+     free(file);
+     free(task);
+ }
+ 
+ /**
+  * Path of a source file relative to the source root
+  */
+ static const char *get_relative_path(BackupEngine *engine, const char *file)
+ {
+     const char *relative_path = file + strlen(engine->source_root);
+ 
+     while (*relative_path == '\\' || *relative_path == '/')
+         relative_path++;
+ 
+     return relative_path;
+ }
+ 
+ /**
+  * Put an unchanged file into a rotation snapshot as a hardlink to its copy in
+  * the previous snapshot. Volumes without hardlinks, files at the link limit
+  * and copies missing from the previous snapshot are copied from the source.
+  */
+ static int link_unchanged_file(CopyTask *task, const char *relative_path, char *status_message)
+ {
+     BackupEngine *engine = task->engine;
+     char existing[MAX_PATH_LEN], link[MAX_PATH_LEN], dir[MAX_PATH_LEN];
+     char *p;
+ 
+     if (!engine->link_root)
+         return BACKUP_FILE_UNCHANGED;
+ 
+     snprintf(existing, sizeof(existing), "%s\\%s", engine->link_root, relative_path);
+     snprintf(link, sizeof(link), "%s\\%s", engine->target_root, relative_path);
+     strcpy(dir, link);
+     p = strrchr(dir, '\\');
+     if (p)
+         *p = 0;
+ 
+     if (create_directory_path(dir) && CreateHardLink(link, existing, NULL)) {
+         InterlockedIncrement(&engine->files_linked);
+         return BACKUP_FILE_UNCHANGED;
+     }
+ 
+     // The manifest entry is current already
+     task->update_manifest = FALSE;
+     return copy_task_file(task, status_message);
+ }
  
-     // Initialize progress bar
-     SendMessage(hProgress, PBM_SETRANGE, 0, MAKELPARAM(0, 100));
-     SendMessage(hProgress, PBM_SETSTEP, 1, 0);
+ /**
+  * Incremental backup of one file: size and modification time decide first,
+  * the content hash settles files that were touched but not changed
+  */
+ static int backup_file_if_changed(CopyTask *task, char *status_message)
+ {
+     BackupEngine *engine = task->engine;
+     const char *file = task->file->path;
+     WIN32_FILE_ATTRIBUTE_DATA attr;
+     ManifestEntry entry;
+     ULARGE_INTEGER size, mtime;
+     ULONGLONG hash;
+     const char *relative_path = get_relative_path(engine, file);
+ 
+     if (!GetFileAttributesEx(file, GetFileExInfoStandard, &attr)) {
+         sprintf(status_message, "Failed to read attributes: %s (Error: %lu)", file, GetLastError());
+         return BACKUP_FILE_FAILED;
+     }
+ 
+     size.LowPart = attr.nFileSizeLow;
+     size.HighPart = attr.nFileSizeHigh;
+     mtime.LowPart = attr.ftLastWriteTime.dwLowDateTime;
+     mtime.HighPart = attr.ftLastWriteTime.dwHighDateTime;
+     task->size = size.QuadPart;
+ 
+     BOOL known = manifest_lookup(engine->manifest, relative_path, &entry);
+     if (known && entry.size == size.QuadPart && entry.mtime == mtime.QuadPart)
+         return link_unchanged_file(task, relative_path, status_message);
  
-     // Update window
-     ShowWindow(hDlg, SW_SHOW);
-     UpdateWindow(hDlg);
+     if (!hash_file(file, &hash, NULL)) {
+         sprintf(status_message, "Failed to read file: %s (Error: %lu)", file, GetLastError());
+         return BACKUP_FILE_FAILED;
+     }
+ 
+     if (known && entry.size == size.QuadPart && entry.hash == hash) {
+         // Only the timestamp changed, remember it to skip hashing next time
+         manifest_update(engine->manifest, relative_path, size.QuadPart, mtime.QuadPart, hash);
+         return link_unchanged_file(task, relative_path, status_message);
+     }
+ 
+     // The manifest learns the new content once the copy is complete
+     task->update_manifest = TRUE;
+     task->mtime = mtime.QuadPart;
+     task->hash = hash;
+     return copy_task_file(task, status_message);
+ }
  
-     // Start backup operation - use consistent int parameters
-     backup_directory(source_path, target_path, extensions, include_subdirs, days, hStatus);
+ /**
+  * Database dump thread
+  */
+ static DWORD WINAPI dump_thread(LPVOID param)
+ {
+     BackupEngine *engine = (BackupEngine *)param;
  
-     // Show completion message
-     MessageBox(hDlg, "Backup completed successfully!", "Backup Complete", MB_OK | MB_ICONINFORMATION);
+     engine->dump_ok = db_dump_database(&engine->dump_options, engine->dump_dir, &engine->progress->db,
+                                        engine->dump_error, sizeof(engine->dump_error));
+     return 0;
+ }
+ 
+ /**
+  * Progress of a backup starts unpaused with empty counters
+  */
+ BOOL backup_progress_init(BackupProgress *progress)
+ {
+     memset(progress, 0, sizeof(*progress));
+     progress->resume_event = CreateEvent(NULL, TRUE, TRUE, NULL);
+     if (!progress->resume_event)
+         return FALSE;
+ 
+     InitializeCriticalSection(&progress->lock);
+     return TRUE;
+ }
+ 
+ void backup_progress_free(BackupProgress *progress)
+ {
+     CloseHandle(progress->resume_event);
+     DeleteCriticalSection(&progress->lock);
+ }
+ 
+ /**
+  * Pause or resume a running backup. Workers stop between files and
+  * between the chunks of large copies.
+  */
+ void backup_pause(BackupProgress *progress, BOOL pause)
+ {
+     if (pause && !progress->cancelled)
+         ResetEvent(progress->resume_event);
+     else
+         SetEvent(progress->resume_event);
+ }
+ 
+ /**
+  * Stop a running backup: copies in progress are aborted, the remaining
+  * files are skipped and no snapshot or archive is kept
+  */
+ void backup_cancel(BackupProgress *progress)
+ {
+     InterlockedExchange(&progress->cancelled, TRUE);
+     SetEvent(progress->resume_event);
+ }
+ 
+ /**
+  * Backup directory with proper directory structure preservation.
+  * Directories are listed by a pool of work-stealing walkers and files are
+  * copied by a bounded pool of copy workers. Returns when the backup is
+  * finished or cancelled; progress receives the counters and the summary.
+  */
+ void backup_directory(const BackupOptions *options, BackupProgress *progress)
+ {
+     BackupEngine *engine;
+     WalkerParam walkers[BACKUP_MAX_WALKERS];
+     HANDLE threads[BACKUP_MAX_WALKERS + BACKUP_MAX_COPIERS];
+     int thread_count = 0;
+     SYSTEM_INFO si;
+     DWORD start_time = GetTickCount();
+     char status_message[MAX_PATH_LEN * 2];
+     char snapshot_id[32] = "";
+     char run_name[MAX_PATH_LEN];
+     char archive_path[MAX_PATH_LEN] = "";
+     char rotation_id[32] = "";
+     char work_dir[MAX_PATH_LEN];
+     char previous_dir[MAX_PATH_LEN] = "";
+     ArchiveStats archive_stats;
+     BOOL archive_ok = FALSE;
+     BOOL cancelled;
+     BOOL rotation_ok = FALSE;
+     BOOL diff_ok = FALSE;
+     RotationDiff diff;
+     int deleted = 0;
+     int pruned = 0;
+     BOOL use_journal = options->use_journal && options->incremental && options->mode == BACKUP_MODE_COPY;
+     BOOL journal_ok = FALSE;
+     JournalCursor journal_now, journal_last;
+     JournalChanges *changes = NULL;
+     char journal_reason[MAX_PATH_LEN] = "";
+ 
+     engine = (BackupEngine *)calloc(1, sizeof(BackupEngine));
+     if (!engine)
+         return;
+ 
+     engine->source_root = options->source_path;
+     engine->target_root = options->target_path;
+     engine->include_subdirs = options->include_subdirs;
+     engine->days = options->days;
+     engine->progress = progress;
+     engine->background = options->background;
+     engine->overlapped = options->overlapped && (options->mode == BACKUP_MODE_COPY || options->mode == BACKUP_MODE_ROTATION);
+     engine->bytes_per_ms = options->bandwidth_mb > 0 ? options->bandwidth_mb * 1048576.0 / 1000.0 : 0.0;
+     engine->throttle_start = GetTickCount();
+ 
+     // Archives and dumps of a run are named after the project, e.g. www-20250101-120000
+     {
+         SYSTEMTIME st;
+         const char *project = options->source_path;
+ 
+         for (const char *p = options->source_path; *p; p++)
+             if ((*p == '\\' || *p == '/') && p[1])
+                 project = p + 1;
+         GetLocalTime(&st);
+         snprintf(run_name, sizeof(run_name), "%s-%04d%02d%02d-%02d%02d%02d",
+                  project, st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond);
+     }
+ 
+     // Include and exclude rules are compiled once and shared by the walkers
+     engine->filter = filter_compile(options->extensions, options->excludes);
+     if (!engine->filter) {
+         set_engine_status(engine, "Backup failed: out of memory.");
+         free(engine);
+         return;
+     }
+ 
+     // Incremental backups compare against the manifest of the target
+     if (options->incremental && options->mode == BACKUP_MODE_COPY) {
+         create_directory_path(options->target_path);
+         engine->manifest = manifest_load(options->target_path);
+     }
+ 
+     // The change journal names what changed since the last complete run, the
+     // rest of the tree is not listed. The position is taken before anything is
+     // read, changes made while the run is going are seen again next time.
+     if (use_journal && engine->manifest) {
+         journal_ok = journal_query(options->source_path, &journal_now, journal_reason, sizeof(journal_reason));
+         if (journal_ok) {
+             HashState rules;
+ 
+             hash_init(&rules, 0);
+             hash_update(&rules, options->extensions, strlen(options->extensions) + 1);
+             hash_update(&rules, options->excludes, strlen(options->excludes) + 1);
+             hash_update(&rules, &options->include_subdirs, sizeof(options->include_subdirs));
+             journal_now.rules = hash_final(&rules);
+ 
+             if (manifest_count(engine->manifest) == 0 ||
+                 !journal_load_cursor(options->target_path, options->source_path, &journal_last))
+                 strcpy(journal_reason, "no journal position from a previous backup");
+             else if (journal_last.rules != journal_now.rules)
+                 strcpy(journal_reason, "the file rules changed since the last backup");
+             else
+                 changes = journal_read_changes(options->source_path, &journal_last, &journal_now,
+                                                journal_reason, sizeof(journal_reason));
+         }
+     }
+ 
+     // Rotation writes a new dated directory and compares against the manifest
+     // of the previous one, whose unchanged files it links
+     if (options->mode == BACKUP_MODE_ROTATION) {
+         if (!rotation_begin(options->target_path, rotation_id, work_dir, previous_dir)) {
+             sprintf(status_message, "Failed to create a snapshot directory in %s", options->target_path);
+             set_engine_status(engine, status_message);
+             filter_free(engine->filter);
+             free(engine);
+             return;
+         }
+         engine->target_root = work_dir;
+         if (previous_dir[0])
+             engine->link_root = previous_dir;
+         engine->manifest = manifest_load(previous_dir[0] ? previous_dir : work_dir);
+     }
+ 
+     // Repository backups record a complete snapshot, unchanged files cost no I/O
+     if (options->mode == BACKUP_MODE_STORE) {
+         engine->store = store_open(options->target_path, options->source_path);
+         if (!engine->store) {
+             sprintf(status_message, "Failed to open backup repository: %s", options->target_path);
+             set_engine_status(engine, status_message);
+             filter_free(engine->filter);
+             free(engine);
+             return;
+         }
+     }
+ 
+     // Archives are one file per run
+     if (options->mode == BACKUP_MODE_ARCHIVE) {
+         ArchiveOptions archive_options;
+ 
+         snprintf(archive_path, sizeof(archive_path), "%s\\%s" ARCHIVE_EXTENSION, options->target_path, run_name);
+ 
+         archive_options.level = options->compression_level;
+         archive_options.threads = options->threads;
+         archive_options.memory_mb = options->memory_mb;
+         create_directory_path(options->target_path);
+         engine->archive = archive_open(archive_path, &archive_options);
+         if (!engine->archive) {
+             sprintf(status_message, "Failed to create archive: %s", archive_path);
+             set_engine_status(engine, status_message);
+             filter_free(engine->filter);
+             free(engine);
+             return;
+         }
+     }
+ 
+     // Listing is CPU and metadata bound, copying mostly waits for the disks
+     GetSystemInfo(&si);
+     engine->walker_count = si.dwNumberOfProcessors < BACKUP_MAX_WALKERS ? (int)si.dwNumberOfProcessors : BACKUP_MAX_WALKERS;
+     engine->copier_count = si.dwNumberOfProcessors * 2 < BACKUP_MAX_COPIERS ? (int)si.dwNumberOfProcessors * 2 : BACKUP_MAX_COPIERS;
+     if (engine->walker_count < 1)
+         engine->walker_count = 1;
+     if (engine->copier_count < 2)
+         engine->copier_count = 2;
+ 
+     // The tar stream is sequential, the archive compresses on its own threads
+     if (engine->archive)
+         engine->copier_count = 1;
+ 
+     // Overlapped workers keep a window of copies each, one per CPU leaves the hashing enough threads
+     if (engine->overlapped)
+         engine->copier_count = (int)si.dwNumberOfProcessors < BACKUP_MAX_COPIERS ? (int)si.dwNumberOfProcessors : BACKUP_MAX_COPIERS;
+     if (engine->copier_count < 1)
+         engine->copier_count = 1;
+ 
+     for (int i = 0; i < engine->walker_count; i++)
+         InitializeCriticalSection(&engine->deques[i].lock);
+     InitializeCriticalSection(&engine->queue.lock);
+     InitializeCriticalSection(&engine->throttle_lock);
+     engine->queue.items = (QueuedFile **)calloc(BACKUP_QUEUE_SIZE, sizeof(QueuedFile *));
+     engine->queue.free_slots = CreateSemaphore(NULL, BACKUP_QUEUE_SIZE, BACKUP_QUEUE_SIZE, NULL);
+     engine->queue.used_slots = CreateSemaphore(NULL, 0, BACKUP_QUEUE_SIZE, NULL);
+     engine->done_event = CreateEvent(NULL, TRUE, FALSE, NULL);
+ 
+     // The dump goes next to the files: <run>.db in the target directory or in the
+     // rotation snapshot, for the repository beside the snapshot file once its ID is known
+     if (options->database[0]) {
+         if (engine->store)
+             snprintf(engine->dump_dir, sizeof(engine->dump_dir), "%s\\snapshots\\%s.db.tmp",
+                      options->target_path, run_name);
+         else
+             snprintf(engine->dump_dir, sizeof(engine->dump_dir), "%s\\%s.db", engine->target_root, run_name);
+ 
+         engine->dump_options.devilbox_path = options->devilbox_path;
+         engine->dump_options.database = options->database;
+         engine->dump_options.password = options->db_password;
+         engine->dump_options.level = options->compression_level > 0 ? options->compression_level : ARCHIVE_DEFAULT_LEVEL;
+         engine->dump_options.consistent = TRUE;
+         progress->db.cancelled = &progress->cancelled;
+         if (create_directory_path(engine->dump_dir))
+             engine->dump_thread = CreateThread(NULL, 0, dump_thread, engine, 0, NULL);
+         if (!engine->dump_thread)
+             sprintf(engine->dump_error, "Cannot start the database dump into %s", engine->dump_dir);
+     }
+ 
+     // Seed the first walker with the source root, or with the directories the journal reported
+     char *root = changes ? NULL : _strdup(options->source_path);
+     if (engine->queue.items && engine->queue.free_slots && engine->queue.used_slots &&
+         engine->done_event && (root || (changes && seed_from_journal(engine, changes)))) {
+         if (root) {
+             engine->pending_dirs = 1;
+             deque_push(&engine->deques[0], root);
+         }
+         progress->scanning = TRUE;
+ 
+         engine->active_copiers = engine->copier_count;
+         for (int i = 0; i < engine->copier_count; i++) {
+             HANDLE thread = CreateThread(NULL, 0, copier_thread, engine, 0, NULL);
+             if (thread)
+                 threads[thread_count++] = thread;
+             else
+                 InterlockedDecrement(&engine->active_copiers);
+         }
+         engine->copier_count = engine->active_copiers;
+ 
+         // Changed files go first, the walkers end the queue
+         if (changes && engine->copier_count > 0)
+             queue_journal_files(engine, changes);
+ 
+         engine->active_walkers = engine->walker_count;
+         for (int i = 0; i < engine->walker_count; i++) {
+             walkers[i].engine = engine;
+             walkers[i].index = i;
+         }
+         if (engine->copier_count > 0) {
+             for (int i = 0; i < engine->walker_count; i++) {
+                 HANDLE thread = CreateThread(NULL, 0, walker_thread, &walkers[i], 0, NULL);
+                 if (thread)
+                     threads[thread_count++] = thread;
+                 else if (i == 0)
+                     walker_thread(&walkers[i]);
+                 else
+                     walker_finished(engine);
+             }
+         } else {
+             // No copy worker could be started, nothing will be copied
+             SetEvent(engine->done_event);
+         }
+ 
+         WaitForSingleObject(engine->done_event, INFINITE);
+         WaitForMultipleObjects(thread_count, threads, TRUE, INFINITE);
+     } else {
+         free(root);
+         journal_ok = FALSE;
+     }
+     progress->scanning = FALSE;
+     if (engine->dump_thread) {
+         WaitForSingleObject(engine->dump_thread, INFINITE);
+         CloseHandle(engine->dump_thread);
+     }
+     cancelled = progress->cancelled;
+ 
+     for (int i = 0; i < thread_count; i++)
+         CloseHandle(threads[i]);
+ 
+     // Files missing from a full run are recorded as deleted. A rotation snapshot
+     // holds only what this run wrote, its manifest must not list anything else.
+     if (engine->manifest) {
+         if (thread_count > 0 && !cancelled && (options->include_subdirs || rotation_id[0]))
+             deleted = manifest_record_deletions(engine->manifest, engine->target_root);
+         if (!cancelled || !rotation_id[0])
+             journal_ok = manifest_save(engine->manifest, engine->target_root) && journal_ok;
+         manifest_free(engine->manifest);
+     }
+ 
+     // The next run may start from this position only if nothing before it was missed
+     if (use_journal) {
+         journal_ok = journal_ok && thread_count > 0 && !cancelled && engine->files_failed == 0;
+         journal_save_cursor(options->target_path, options->source_path, journal_ok ? &journal_now : NULL);
+     }
+ 
+     // A cancelled run leaves no snapshot behind
+     if (engine->store) {
+         if (cancelled || thread_count == 0 || !store_commit(engine->store, snapshot_id))
+             snapshot_id[0] = 0;
+     }
+ 
+     if (engine->archive) {
+         if (cancelled)
+             archive_cancel(engine->archive);
+         archive_ok = archive_close(engine->archive, &archive_stats) && thread_count > 0;
+     }
+ 
+     // A rotation snapshot is indexed once complete, then the retention policy applies
+     if (rotation_id[0]) {
+         if (!cancelled && thread_count > 0) {
+             RotationSnapshot snapshot;
+ 
+             memset(&snapshot, 0, sizeof(snapshot));
+             strcpy(snapshot.id, rotation_id);
+             snapshot.files = engine->files_copied + engine->files_unchanged;
+             snapshot.files_linked = engine->files_linked;
+             snapshot.bytes = progress->bytes_found;
+             snapshot.bytes_copied = engine->bytes_copied;
+             rotation_ok = rotation_commit(options->target_path, &snapshot);
+         }
+         if (rotation_ok) {
+             RotationPolicy policy = {options->keep_hourly, options->keep_daily, options->keep_weekly};
+ 
+             if (engine->dump_dir[0])
+                 snprintf(engine->dump_dir, sizeof(engine->dump_dir), "%s\\%s\\%s.db", options->target_path,
+                          rotation_id, run_name);
+ 
+             // What changed since the previous snapshot, before pruning may remove it
+             if (previous_dir[0])
+                 diff_ok = rotation_diff(options->target_path, strrchr(previous_dir, '\\') + 1, rotation_id, &diff);
+             pruned = rotation_prune(options->target_path, &policy);
+         } else {
+             rotation_abort(options->target_path, rotation_id);
+             engine->dump_dir[0] = 0;
+         }
+     }
+ 
+     // The dump of a repository snapshot is named after it
+     if (engine->dump_dir[0]) {
+         char dump_dir[MAX_PATH_LEN];
+ 
+         if (cancelled || (engine->store && !snapshot_id[0])) {
+             db_dump_remove(engine->dump_dir);
+         } else if (engine->store) {
+             snprintf(dump_dir, sizeof(dump_dir), "%s\\snapshots\\%s.db", options->target_path, snapshot_id);
+             if (MoveFileEx(engine->dump_dir, dump_dir, 0))
+                 strcpy(engine->dump_dir, dump_dir);
+         }
+     }
+ 
+     // Final status message
+     if (cancelled) {
+         sprintf(status_message, "Backup cancelled after %ld of %ld files (%.1f MB)%s",
+                 progress->files_done, progress->files_found, progress->bytes_done / 1048576.0,
+                 engine->archive ? ", the partial archive was deleted." :
+                 engine->store || rotation_id[0] ? ", no snapshot was recorded." : ".");
+     } else if (options->mode == BACKUP_MODE_ARCHIVE) {
+         DWORD elapsed = GetTickCount() - start_time;
+ 
+         if (archive_ok)
+             sprintf(status_message, "Archive %s: %lld files (%ld failed), %.1f MB -> %.1f MB, ratio %.2f:1, "
+                     "%.1f MB/s on %d threads, %.0f MB memory.",
+                     archive_path, archive_stats.files, engine->files_failed,
+                     archive_stats.bytes_in / 1048576.0, archive_stats.bytes_out / 1048576.0,
+                     archive_stats.bytes_out ? (double)archive_stats.bytes_in / archive_stats.bytes_out : 0.0,
+                     elapsed ? archive_stats.bytes_in / 1048576.0 * 1000.0 / elapsed : 0.0,
+                     archive_stats.threads, archive_stats.memory / 1048576.0);
+         else
+             sprintf(status_message, "Backup failed: the archive could not be written: %s", archive_path);
+     } else if (engine->store) {
+         StoreStats stats;
+         DWORD elapsed = GetTickCount() - start_time;
+         char ratio[32];
+ 
+         store_get_stats(engine->store, &stats);
+         if (stats.bytes_new > 0)
+             sprintf(ratio, "%.1f:1", (double)stats.bytes_scanned / stats.bytes_new);
+         else
+             strcpy(ratio, "no new data");
+ 
+         if (snapshot_id[0])
+             sprintf(status_message, "Snapshot %s: %lld files (%lld unchanged, %ld failed), %.1f MB scanned, "
+                     "%.1f MB new, dedup %s, ingest %.1f MB/s.",
+                     snapshot_id, stats.files, stats.files_reused, engine->files_failed,
+                     stats.bytes_scanned / 1048576.0, stats.bytes_new / 1048576.0, ratio,
+                     elapsed ? stats.bytes_read / 1048576.0 * 1000.0 / elapsed : 0.0);
+         else
+             strcpy(status_message, "Backup failed: the snapshot could not be written to the repository.");
+     } else if (rotation_id[0]) {
+         DWORD elapsed = GetTickCount() - start_time;
+         size_t used;
+ 
+         if (rotation_ok)
+             sprintf(status_message, "Snapshot %s: %ld files (%ld linked, %ld failed), %.1f MB written in %.1f s",
+                     rotation_id, engine->files_copied + engine->files_unchanged, engine->files_linked,
+                     engine->files_failed, engine->bytes_copied / 1048576.0, elapsed / 1000.0);
+         else
+             sprintf(status_message, "Backup failed: the snapshot could not be completed in %s.", options->target_path);
+ 
+         used = strlen(status_message);
+         if (diff_ok)
+             snprintf(status_message + used, sizeof(status_message) - used,
+                      "; since %s: %lld added, %lld changed, %lld removed", strrchr(previous_dir, '\\') + 1,
+                      diff.added, diff.changed, diff.removed);
+         used = strlen(status_message);
+         if (rotation_ok)
+             snprintf(status_message + used, sizeof(status_message) - used,
+                      pruned ? "; %d old snapshots pruned." : ".", pruned);
+     } else {
+         DWORD elapsed = GetTickCount() - start_time;
+         sprintf(status_message, "Backup complete. Copied %ld files (%ld unchanged, %d deleted, %ld failed) "
+                 "in %.1f s, %.0f files/s.",
+                 engine->files_copied, engine->files_unchanged, deleted, engine->files_failed,
+                 elapsed / 1000.0,
+                 elapsed ? (engine->files_copied + engine->files_unchanged) * 1000.0 / elapsed
+                         : (double)(engine->files_copied + engine->files_unchanged));
+ 
+         // Throughput of each copy strategy used
+         char strategies[MAX_PATH_LEN];
+         fast_copy_format_stats(&engine->copy_stats, strategies, sizeof(strategies));
+         if (strategies[0])
+             snprintf(status_message + strlen(status_message), sizeof(status_message) - strlen(status_message),
+                      " %s.", strategies);
+ 
+         if (changes)
+             snprintf(status_message + strlen(status_message), sizeof(status_message) - strlen(status_message),
+                      " Change journal: %d changes in %lld records.", journal_change_count(changes),
+                      journal_record_count(changes));
+         else if (use_journal && journal_reason[0])
+             snprintf(status_message + strlen(status_message), sizeof(status_message) - strlen(status_message),
+                      " Full scan: %s.", journal_reason);
+     }
+     journal_free_changes(changes);
+ 
+     if (options->database[0] && !cancelled) {
+         size_t used = strlen(status_message);
+         DbDumpProgress *db = &progress->db;
+ 
+         if (engine->dump_ok)
+             snprintf(status_message + used, sizeof(status_message) - used,
+                      " Database %s: %ld tables, %.1f MB -> %.1f MB%s.", options->database, db->tables_done - 1,
+                      db->bytes_in / 1048576.0, db->bytes_out / 1048576.0,
+                      db->consistent ? ", consistent" : ", without global read lock");
+         else
+             snprintf(status_message + used, sizeof(status_message) - used,
+                      " Database %s: %ld of %ld parts failed: %s", options->database, db->tables_failed,
+                      db->tables_total, engine->dump_error[0] ? engine->dump_error : "unknown error");
+     }
+     set_engine_status(engine, status_message);
+ 
+     for (int i = 0; i < engine->walker_count; i++) {
+         free(engine->deques[i].items);
+         DeleteCriticalSection(&engine->deques[i].lock);
+     }
+     DeleteCriticalSection(&engine->queue.lock);
+     DeleteCriticalSection(&engine->throttle_lock);
+     if (engine->queue.free_slots)
+         CloseHandle(engine->queue.free_slots);
+     if (engine->queue.used_slots)
+         CloseHandle(engine->queue.used_slots);
+     if (engine->done_event)
+         CloseHandle(engine->done_event);
+     store_close(engine->store);
+     filter_free(engine->filter);
+     free(engine->queue.items);
+     free(engine);
+ }
+ 
+ /**
+  * Open the progress window of a task and start its thread. Returns at once;
+  * the window owns the job from now on and shows the outcome when it is done.
+  */
+ static void start_task(const BackupTaskKind *kind, void *job, HWND owner)
+ {
+     WNDCLASSEX wc = {0};
+     HINSTANCE instance = GetModuleHandle(NULL);
+     int button_y = kind->progress_bar ? 90 : 62;
+     BackupTask *task;
+ 
+     task = (BackupTask *)calloc(1, sizeof(BackupTask));
+     if (!task) {
+         kind->release(job);
+         return;
+     }
+     task->kind = kind;
+     task->job = job;
+ 
+     // Registering again fails harmlessly while a second task is started
+     wc.cbSize = sizeof(WNDCLASSEX);
+     wc.lpfnWndProc = backup_task_proc;
+     wc.hInstance = instance;
+     wc.hCursor = LoadCursor(NULL, IDC_ARROW);
+     wc.hbrBackground = (HBRUSH)(COLOR_BTNFACE + 1);
+     wc.lpszClassName = "DevilboxBackupTask";
+     RegisterClassEx(&wc);
+ 
+     task->hwnd = CreateWindowEx(
+         WS_EX_DLGMODALFRAME,
+         "DevilboxBackupTask",
+         kind->title,
+         WS_POPUP | WS_CAPTION | WS_SYSMENU | WS_VISIBLE,
+         CW_USEDEFAULT, CW_USEDEFAULT, 500, button_y + 80,
+         owner, NULL, instance, task);
+ 
+     if (!task->hwnd) {
+         MessageBox(owner, "Failed to create progress window.", "Error", MB_ICONERROR);
+         kind->release(job);
+         free(task);
+         return;
+     }
+ 
+     task->hStatus = CreateWindowEx(
+         0, "STATIC", kind->status,
+         WS_CHILD | WS_VISIBLE | SS_LEFT | SS_PATHELLIPSIS,
+         10, 10, 470, 20,
+         task->hwnd, NULL, instance, NULL);
+ 
+     task->hCounters = CreateWindowEx(
+         0, "STATIC", "",
+         WS_CHILD | WS_VISIBLE | SS_LEFT,
+         10, 32, 470, 20,
+         task->hwnd, NULL, instance, NULL);
+ 
+     if (kind->progress_bar) {
+         task->hProgress = CreateWindowEx(
+             0, PROGRESS_CLASS, NULL,
+             WS_CHILD | WS_VISIBLE | PBS_SMOOTH,
+             10, 58, 470, 20,
+             task->hwnd, NULL, instance, NULL);
+         SendMessage(task->hProgress, PBM_SETRANGE, 0, MAKELPARAM(0, 1000));
+     }
+ 
+     if (kind->pause) {
+         task->hPause = CreateWindowEx(
+             0, "BUTTON", "Pause",
+             WS_CHILD | WS_VISIBLE | WS_TABSTOP | BS_PUSHBUTTON,
+             145, button_y, 100, 30,
+             task->hwnd, (HMENU)ID_BACKUP_PAUSE, instance, NULL);
+     }
+ 
+     task->hCancel = CreateWindowEx(
+         0, "BUTTON", "Cancel",
+         WS_CHILD | WS_VISIBLE | WS_TABSTOP | BS_PUSHBUTTON,
+         kind->pause ? 255 : 200, button_y, 100, 30,
+         task->hwnd, (HMENU)IDCANCEL, instance, NULL);
+ 
+     // The dialogs that start jobs wait for this one, the whole owner chain
+     for (HWND hOwner = owner; hOwner && task->disabled_count < TASK_MAX_OWNERS;
+          hOwner = GetWindow(hOwner, GW_OWNER)) {
+         if (IsWindowEnabled(hOwner)) {
+             EnableWindow(hOwner, FALSE);
+             task->disabled[task->disabled_count++] = hOwner;
+         }
+     }
+ 
+     task->start_time = GetTickCount();
+     task->thread = CreateThread(NULL, 0, kind->run, job, 0, NULL);
+     if (!task->thread) {
+         MessageBox(task->hwnd, "Failed to start the task.", "Error", MB_ICONERROR);
+         DestroyWindow(task->hwnd);
+         return;
+     }
+     SetTimer(task->hwnd, ID_BACKUP_TIMER, BACKUP_STATUS_INTERVAL, NULL);
+ 
+     ShowWindow(task->hwnd, SW_SHOW);
+     UpdateWindow(task->hwnd);
+     SetFocus(task->hCancel);
+ }
+ 
+ /**
+  * Give the owners of a task window their input back
+  */
+ static void enable_owners(BackupTask *task)
+ {
+     while (task->disabled_count > 0)
+         EnableWindow(task->disabled[--task->disabled_count], TRUE);
+ }
+ 
+ /**
+  * Task progress window procedure
+  */
+ static LRESULT CALLBACK backup_task_proc(HWND hwnd, UINT msg, WPARAM wp, LPARAM lp)
+ {
+     BackupTask *task = (BackupTask *)GetWindowLongPtr(hwnd, GWLP_USERDATA);
+ 
+     switch (msg) {
+     case WM_NCCREATE:
+         SetWindowLongPtr(hwnd, GWLP_USERDATA, (LONG_PTR)((CREATESTRUCT *)lp)->lpCreateParams);
+         break;
+ 
+     case WM_TIMER:
+         if (task->finished)
+             return 0;
+         if (WaitForSingleObject(task->thread, 0) == WAIT_OBJECT_0) {
+             // The outcome is shown over the progress window, then both go away
+             task->finished = TRUE;
+             KillTimer(hwnd, ID_BACKUP_TIMER);
+             task->kind->report(task);
+             enable_owners(task);
+             DestroyWindow(hwnd);
+         } else if (!task->cancelling) {
+             task->kind->update(task);
+         }
+         return 0;
+ 
+     case WM_COMMAND:
+         if (LOWORD(wp) == ID_BACKUP_PAUSE && !task->finished && !task->cancelling) {
+             task->paused = !task->paused;
+             if (task->paused)
+                 task->paused_since = GetTickCount();
+             else
+                 task->paused_time += GetTickCount() - task->paused_since;
+             task->kind->pause(task->job, task->paused);
+             SetWindowText(task->hPause, task->paused ? "Resume" : "Pause");
+             task->kind->update(task);
+         } else if (LOWORD(wp) == IDCANCEL) {
+             SendMessage(hwnd, WM_CLOSE, 0, 0);
+         }
+         return 0;
+ 
+     case WM_CLOSE:
+         // A running task is stopped, the window closes once it has reported
+         if (!task->finished && !task->cancelling && task->thread) {
+             if (task->paused) {
+                 task->paused = FALSE;
+                 task->paused_time += GetTickCount() - task->paused_since;
+             }
+             task->cancelling = TRUE;
+             task->kind->cancel(task->job);
+             if (task->hPause)
+                 EnableWindow(task->hPause, FALSE);
+             EnableWindow(task->hCancel, FALSE);
+             SetWindowText(task->hStatus, "Cancelling...");
+         }
+         return 0;
+ 
+     case WM_DESTROY:
+         enable_owners(task);
+         break;
+ 
+     case WM_NCDESTROY:
+         if (!task)
+             break;
+         // Destroyed with its owner: the job is cancelled, but a thread blocked in a
+         // child process may not notice for a while; it is released once it is done
+         if (task->thread && !task->finished)
+             task->kind->cancel(task->job);
+         if (!task->thread || WaitForSingleObject(task->thread, TASK_CLOSE_WAIT) == WAIT_OBJECT_0) {
+             release_task(task);
+         } else {
+             HANDLE waiter = CreateThread(NULL, 0, release_task_thread, task, 0, NULL);
+ 
+             // Without a thread to wait, the job is left to the running thread for good
+             if (waiter)
+                 CloseHandle(waiter);
+         }
+         break;
+     }
+ 
+     return DefWindowProc(hwnd, msg, wp, lp);
+ }
+ 
+ /**
+  * Wait for the thread of a task whose window is gone, then free the job
+  */
+ static DWORD WINAPI release_task_thread(LPVOID param)
+ {
+     BackupTask *task = (BackupTask *)param;
+ 
+     WaitForSingleObject(task->thread, INFINITE);
+     release_task(task);
+     return 0;
+ }
+ 
+ /**
+  * Free a task whose thread is done
+  */
+ static void release_task(BackupTask *task)
+ {
+     if (task->thread)
+         CloseHandle(task->thread);
+     task->kind->release(task->job);
+     free(task);
+ }
+ 
+ /**
+  * Backup thread
+  */
+ static DWORD WINAPI backup_thread(LPVOID param)
+ {
+     BackupJob *job = (BackupJob *)param;
+ 
+     backup_directory(&job->options, &job->progress);
+     return 0;
+ }
+ 
+ /**
+  * Show the latest message, the counters, the rate and the time left
+  */
+ static void update_backup(BackupTask *task)
+ {
+     BackupProgress *progress = &((BackupJob *)task->job)->progress;
+     char text[MAX_PATH_LEN * 2];
+     DWORD now = GetTickCount();
+     DWORD active = now - task->start_time - task->paused_time - (task->paused ? now - task->paused_since : 0);
+     LONGLONG done = progress->bytes_done;
+     LONGLONG found = progress->bytes_found;
+     int len;
+ 
+     EnterCriticalSection(&progress->lock);
+     strcpy(text, progress->message);
+     LeaveCriticalSection(&progress->lock);
+     if (text[0])
+         SetWindowText(task->hStatus, text);
+ 
+     len = sprintf(text, "%ld of %ld files, %.1f of %.1f MB, %.1f MB/s",
+                   progress->files_done, progress->files_found, done / 1048576.0, found / 1048576.0,
+                   active ? done / 1048576.0 * 1000.0 / active : 0.0);
+     if (progress->db.tables_total > 0)
+         len += sprintf(text + len, ", database %ld of %ld",
+                        progress->db.tables_done + progress->db.tables_failed, progress->db.tables_total);
+ 
+     // The totals still grow while the walkers list directories
+     if (task->paused)
+         strcpy(text + len, ", paused");
+     else if (progress->scanning)
+         strcpy(text + len, ", scanning...");
+     else if (done > 0 && found > done) {
+         DWORD eta = (DWORD)((double)(found - done) * active / done / 1000.0);
+         sprintf(text + len, ", %lu:%02lu left", eta / 60, eta % 60);
+     }
+     SetWindowText(task->hCounters, text);
+ 
+     if (found > 0)
+         SendMessage(task->hProgress, PBM_SETPOS, (WPARAM)(done < found ? done * 1000 / found : 1000), 0);
+ }
+ 
+ /**
+  * Pause or resume a backup
+  */
+ static void pause_backup(void *job, BOOL pause)
+ {
+     backup_pause(&((BackupJob *)job)->progress, pause);
+ }
+ 
+ /**
+  * Stop a backup, the partial result is discarded
+  */
+ static void cancel_backup(void *job)
+ {
+     backup_cancel(&((BackupJob *)job)->progress);
+ }
+ 
+ /**
+  * Show the summary of a finished backup
+  */
+ static void report_backup(BackupTask *task)
+ {
+     BackupProgress *progress = &((BackupJob *)task->job)->progress;
+ 
+     if (progress->cancelled)
+         MessageBox(task->hwnd, progress->message, "Backup Cancelled", MB_OK | MB_ICONWARNING);
+     else
+         MessageBox(task->hwnd, progress->message, "Backup Finished", MB_OK | MB_ICONINFORMATION);
+ }
+ 
+ /**
+  * Free a backup job
+  */
+ static void release_backup(void *job)
+ {
+     backup_progress_free(&((BackupJob *)job)->progress);
+     free(job);
+ }
+ 
+ static const BackupTaskKind backup_task = {
+     "Backup in Progress", "Starting backup...", TRUE,
+     backup_thread, update_backup, cancel_backup, report_backup, release_backup, pause_backup
+ };
+ 
+ /**
+  * Start a backup job in the background with a progress window. Returns
+  * at once; the window offers pause and cancel and shows the summary. It
+  * has no owner, the dialog that starts it closes.
+  */
+ void execute_backup(const BackupOptions *options)
+ {
+     BackupJob *job;
+ 
+     job = (BackupJob *)calloc(1, sizeof(BackupJob));
+     if (!job)
+         return;
+ 
+     job->options = *options;
+     if (!backup_progress_init(&job->progress)) {
+         free(job);
+         return;
+     }
+     start_task(&backup_task, job, NULL);
+ }
+ 
+ /**
+  * Restore thread
+  */
+ static DWORD WINAPI restore_thread(LPVOID param)
+ {
+     RestoreJob *job = (RestoreJob *)param;
+ 
+     job->result = restore_backup(&job->options, &job->progress);
+     return 0;
+ }
+ 
+ /**
+  * Show the file being restored, the counters and the share done
+  */
+ static void update_restore(BackupTask *task)
+ {
+     RestoreJob *job = (RestoreJob *)task->job;
+     const StoreRestoreProgress *files = &job->progress.files;
+     const DbDumpProgress *db = &job->progress.db;
+     DWORD elapsed = GetTickCount() - task->start_time;
+     LONG done = files->files_done + files->files_failed;
+     double mb = (files->bytes_done - files->bytes_skipped) / 1048576.0;
+     char text[MAX_PATH_LEN + 64];
+     int used;
+ 
+     if (files->files_total > 0) {
+         EnterCriticalSection(&job->progress.lock);
+         sprintf(text, "Restoring: %s", files->current);
+         LeaveCriticalSection(&job->progress.lock);
+         SetWindowText(task->hStatus, text);
+     }
+     used = sprintf(text, "%ld of %ld files, %.1f MB/s", done, files->files_total,
+                    elapsed > 0 ? mb * 1000.0 / elapsed : 0.0);
+     if (db->tables_total > 0)
+         sprintf(text + used, "   Database: %ld of %ld tables",
+                 db->tables_done + db->tables_failed, db->tables_total);
+     SetWindowText(task->hCounters, text);
+ 
+     // Archives only know their compressed size up front
+     if (job->progress.source_size > 0)
+         SendMessage(task->hProgress, PBM_SETPOS,
+                     (WPARAM)(job->progress.source_read * 1000 / job->progress.source_size), 0);
+     else if (files->bytes_total > 0)
+         SendMessage(task->hProgress, PBM_SETPOS, (WPARAM)(files->bytes_done * 1000 / files->bytes_total), 0);
+ }
+ 
+ /**
+  * Stop a restore, a later run with the same target resumes it
+  */
+ static void cancel_restore(void *job)
+ {
+     InterlockedExchange(&((RestoreJob *)job)->progress.cancelled, 1);
+ }
+ 
+ /**
+  * Show the summary of a finished restore
+  */
+ static void report_restore(BackupTask *task)
+ {
+     RestoreJob *job = (RestoreJob *)task->job;
+     char status_message[MAX_PATH_LEN * 4];
+ 
+     restore_format_report(&job->options, &job->progress, status_message, sizeof(status_message));
+     if (job->result) {
+         MessageBox(task->hwnd, status_message, "Restore Complete", MB_OK | MB_ICONINFORMATION);
+     } else if (job->progress.cancelled) {
+         strcat(status_message, "\n\nThe restore was cancelled. Run it again with the same target to resume.");
+         MessageBox(task->hwnd, status_message, "Restore Cancelled", MB_OK | MB_ICONWARNING);
+     } else {
+         strcat(status_message, "\n\nRun the restore again with the same target to retry the missing files.");
+         MessageBox(task->hwnd, status_message, "Restore Failed", MB_OK | MB_ICONWARNING);
+     }
+ }
+ 
+ /**
+  * Free a restore job
+  */
+ static void release_restore(void *job)
+ {
+     restore_progress_free(&((RestoreJob *)job)->progress);
+     free(job);
+ }
+ 
+ static const BackupTaskKind restore_task = {
+     "Restore in Progress", "Starting restore...", TRUE,
+     restore_thread, update_restore, cancel_restore, report_restore, release_restore, NULL
+ };
+ 
+ /**
+  * Restore a backup in the background with a progress window
+  */
+ void execute_restore(const RestoreOptions *options, HWND owner)
+ {
+     RestoreJob *job;
+ 
+     job = (RestoreJob *)calloc(1, sizeof(RestoreJob));
+     if (!job)
+         return;
+ 
+     job->options = *options;
+     restore_progress_init(&job->progress);
+     start_task(&restore_task, job, owner);
+ }
+ 
+ /**
+  * Verify thread
+  */
+ static DWORD WINAPI verify_thread(LPVOID param)
+ {
+     VerifyJob *job = (VerifyJob *)param;
+ 
+     job->result = verify_backup(&job->options, &job->progress);
+     return 0;
+ }
+ 
+ /**
+  * Show the file being hashed, the counters and the share done
+  */
+ static void update_verify(BackupTask *task)
+ {
+     VerifyJob *job = (VerifyJob *)task->job;
+     VerifyProgress *progress = &job->progress;
+     DWORD elapsed = GetTickCount() - task->start_time;
+     char text[MAX_PATH_LEN + 64];
+ 
+     if (progress->files_done > 0) {
+         EnterCriticalSection(&progress->lock);
+         sprintf(text, "Hashing: %s", progress->current);
+         LeaveCriticalSection(&progress->lock);
+         SetWindowText(task->hStatus, text);
+     }
+     sprintf(text, "%ld of %ld files, %ld problems, %.1f MB/s",
+             progress->files_done, progress->files_total,
+             progress->mismatched + progress->missing + progress->unreadable,
+             elapsed > 0 ? progress->bytes_done / 1048576.0 * 1000.0 / elapsed : 0.0);
+     SetWindowText(task->hCounters, text);
+     if (progress->bytes_total > 0)
+         SendMessage(task->hProgress, PBM_SETPOS, (WPARAM)(progress->bytes_done * 1000 / progress->bytes_total), 0);
+ }
+ 
+ /**
+  * Stop a verify
+  */
+ static void cancel_verify(void *job)
+ {
+     InterlockedExchange(&((VerifyJob *)job)->progress.cancelled, 1);
+ }
+ 
+ /**
+  * Show the summary of a finished verify
+  */
+ static void report_verify(BackupTask *task)
+ {
+     VerifyJob *job = (VerifyJob *)task->job;
+     char report[VERIFY_MAX_PROBLEMS * (MAX_PATH_LEN + 16) + 512];
+ 
+     verify_format_report(&job->options, &job->progress, report, sizeof(report));
+     if (job->result) {
+         MessageBox(task->hwnd, report, "Backup Verified", MB_OK | MB_ICONINFORMATION);
+     } else if (job->progress.cancelled) {
+         MessageBox(task->hwnd, report, "Verify Cancelled", MB_OK | MB_ICONWARNING);
+     } else {
+         size_t used = strlen(report);
+         snprintf(report + used, sizeof(report) - used, "\n\nRun the backup again to replace the files that do not match.");
+         MessageBox(task->hwnd, report, "Verify Failed", MB_OK | MB_ICONWARNING);
+     }
+ }
+ 
+ /**
+  * Free a verify job
+  */
+ static void release_verify(void *job)
+ {
+     verify_progress_free(&((VerifyJob *)job)->progress);
+     free(job);
+ }
+ 
+ static const BackupTaskKind verify_task = {
+     "Verify in Progress", "Listing files...", TRUE,
+     verify_thread, update_verify, cancel_verify, report_verify, release_verify, NULL
+ };
+ 
+ /**
+  * Verify a backup in the background with a progress window
+  */
+ void execute_verify(const VerifyOptions *options, HWND owner)
+ {
+     VerifyJob *job;
+ 
+     job = (VerifyJob *)calloc(1, sizeof(VerifyJob));
+     if (!job)
+         return;
+ 
+     job->options = *options;
+     verify_progress_init(&job->progress);
+     start_task(&verify_task, job, owner);
+ }
+ 
+ /**
+  * Plan thread
+  */
+ static DWORD WINAPI plan_thread(LPVOID param)
+ {
+     PlanJob *job = (PlanJob *)param;
+ 
+     job->result = backup_plan(&job->options, &job->plan);
+     return 0;
+ }
+ 
+ /**
+  * Show the files listed so far
+  */
+ static void update_plan(BackupTask *task)
+ {
+     PlanJob *job = (PlanJob *)task->job;
+     char text[MAX_PATH_LEN];
+ 
+     sprintf(text, "%ld files, %.1f MB in %ld directories",
+             job->plan.files, job->plan.bytes / 1048576.0, job->plan.dirs);
+     SetWindowText(task->hCounters, text);
+ }
+ 
+ /**
+  * Stop a plan
+  */
+ static void cancel_plan(void *job)
+ {
+     InterlockedExchange(&((PlanJob *)job)->plan.cancelled, 1);
+ }
+ 
+ /**
+  * Show the plan once the source is listed; a cancelled plan has nothing to show
+  */
+ static void report_plan(BackupTask *task)
+ {
+     PlanJob *job = (PlanJob *)task->job;
+     char report[PLAN_LARGEST_FILES * (MAX_PATH_LEN + 20) + 512];
+ 
+     if (job->plan.cancelled)
+         return;
+ 
+     backup_plan_format_report(&job->options, &job->plan, report, sizeof(report));
+     if (job->result)
+         MessageBox(task->hwnd, report, "Backup Plan", MB_OK | MB_ICONINFORMATION);
+     else
+         MessageBox(task->hwnd, report, "Backup Plan (source not fully listed)", MB_OK | MB_ICONWARNING);
+ }
+ 
+ /**
+  * Free a plan job
+  */
+ static void release_plan(void *job)
+ {
+     free(job);
+ }
+ 
+ static const BackupTaskKind plan_task = {
+     "Planning Backup", "Listing files...", FALSE,
+     plan_thread, update_plan, cancel_plan, report_plan, release_plan, NULL
+ };
+ 
+ /**
+  * Dry run of a backup in the background with a progress window
+  */
+ void execute_plan(const BackupOptions *options, HWND owner)
+ {
+     PlanJob *job;
+ 
+     job = (PlanJob *)calloc(1, sizeof(PlanJob));
+     if (!job)
+         return;
  
-     // Close progress window
-     DestroyWindow(hDlg);
+     job->options = *options;
+     start_task(&plan_task, job, owner);
  }
\ No newline at end of file
@@ -5,6 +5,10 @@
 #define BACKUP_UTILS_H
 
 #include <windows.h>
+#include "fast_copy.h"
+#include "db_dump.h"
+#include "backup_restore.h"
+#include "backup_verify.h"
 
 #ifndef MAX_PATH_LEN
 #define MAX_PATH_LEN 260
@@ -14,17 +18,70 @@
 extern "C" {
 #endif
 
+// Backup modes
+enum
+{
+    BACKUP_MODE_COPY,     // Copy files into the target directory
+    BACKUP_MODE_STORE,    // Add a snapshot to the deduplicating repository at target_path
+    BACKUP_MODE_ARCHIVE,  // Write one .tar.gz archive into the target directory
+    BACKUP_MODE_ROTATION  // Write a dated snapshot directory, unchanged files hardlinked to the previous one
+};
+
+// Backup job options as entered in the backup dialog
+typedef struct
+{
+    char source_path[MAX_PATH_LEN];
+    char target_path[MAX_PATH_LEN];
+    char extensions[MAX_PATH_LEN];
+    char excludes[MAX_PATH_LEN];  // gitignore-style patterns, see backup_filter.h
+    int include_subdirs;
+    int days;          // Copy files modified in the last N days (non-incremental only)
+    int incremental;   // Copy only files that differ from the target manifest
+    int mode;          // BACKUP_MODE_*
+    int compression_level;  // Archive and database dump: gzip level 1-9
+    int threads;            // Archive only: compression threads, 0 for one per CPU
+    int memory_mb;          // Archive only: memory ceiling of the compression pipeline
+    int bandwidth_mb;       // I/O limit in MB/s, 0 for none
+    int background;         // Run the workers with background (low) I/O and CPU priority
+    int overlapped;         // Copy and rotation: overlapped copies through a completion port, see async_copy.h
+    int use_journal;        // Incremental copy only: visit what the change journal reports, see change_journal.h
+    int keep_hourly;        // Rotation only: retention, see backup_rotation.h
+    int keep_daily;
+    int keep_weekly;
+    char database[64];      // Database dumped next to the files, empty for none
+    char devilbox_path[MAX_PATH_LEN];  // docker-compose project of the mysql service
+    char db_password[128];  // MYSQL_ROOT_PASSWORD from .env
+} BackupOptions;
+
+// Live state of a running backup, shared with the progress window
+typedef struct
+{
+    volatile LONG files_found;        // Files queued so far
+    volatile LONG files_done;         // Files copied, unchanged or failed
+    volatile LONGLONG bytes_found;
+    volatile LONGLONG bytes_done;
+    volatile LONG scanning;           // Directories are still being listed, the totals grow
+    volatile LONG cancelled;          // Set to stop the backup, the partial result is discarded
+    DbDumpProgress db;                // Database dump running beside the file workers
+    HANDLE resume_event;              // Manual-reset, reset while the backup is paused
+    CRITICAL_SECTION lock;            // Guards message
+    char message[MAX_PATH_LEN * 2];   // Latest status line, the summary when finished
+} BackupProgress;
+
 // Function declarations with simple signatures to avoid type conflicts
-BOOL file_has_extension(const char *filename, const char *extensions);
 BOOL create_directory_path(const char *path);
 BOOL is_file_modified_recently(const char *filename, int days);
 BOOL copy_file_with_path(const char *source_file, const char *source_root,
-                         const char *target_root, char *status_message);
-void backup_directory(const char *source_dir, const char *target_dir,
-                     const char *extensions, int include_subdirs,
-                     int days, HWND hStatus);
-void execute_backup(const char *source_path, const char *target_path,
-                   const char *extensions, int include_subdirs, int days);
+                         const char *target_root, char *status_message, const FastCopyOptions *copy_options);
+BOOL backup_progress_init(BackupProgress *progress);
+void backup_progress_free(BackupProgress *progress);
+void backup_pause(BackupProgress *progress, BOOL pause);
+void backup_cancel(BackupProgress *progress);
+void backup_directory(const BackupOptions *options, BackupProgress *progress);
+void execute_backup(const BackupOptions *options);
+void execute_restore(const RestoreOptions *options, HWND owner);
+void execute_verify(const VerifyOptions *options, HWND owner);
+void execute_plan(const BackupOptions *options, HWND owner);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,376 @@
+/*******************************************************************************
+ * Backup Verify Module Implementation
+ * Hashes source and backup copies of every file on a pool of workers and
+ * compares them with the manifest, or with each other when there is none
+ *******************************************************************************/
+
+ #include "backup_verify.h"
+ #include "backup_manifest.h"
+ #include "backup_filter.h"
+ #include "hash_utils.h"
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ 
+ // Read size of the hash workers
+ #define VERIFY_BUFFER_SIZE (1024 * 1024)
+ 
+ // File to verify
+ typedef struct
+ {
+     char *path;       // Relative to source and target
+     ULONGLONG size;
+     ULONGLONG hash;   // Manifest hash, when known
+ } VerifyFile;
+ 
+ // Shared state of the workers
+ typedef struct
+ {
+     const VerifyOptions *options;
+     VerifyProgress *progress;
+     VerifyFile *files;
+     int count;
+     int capacity;
+     volatile LONG next;
+ } VerifyRun;
+ 
+ // Result of hashing one copy
+ enum
+ {
+     VERIFY_READ_OK,
+     VERIFY_READ_MISSING,
+     VERIFY_READ_FAILED,
+     VERIFY_READ_CANCELLED
+ };
+ 
+ // Forward declarations of internal functions
+ static BOOL add_file(VerifyRun *job, const char *relative_path, ULONGLONG size, ULONGLONG hash);
+ static BOOL scan_source(VerifyRun *job, const BackupFilter *filter, const char *dir, const char *relative_dir);
+ static int hash_copy(VerifyProgress *progress, const char *path, BYTE *buffer, ULONGLONG *hash, ULONGLONG *size);
+ static void add_problem(VerifyProgress *progress, const char *kind, const char *relative_path);
+ static void verify_file(VerifyRun *job, const VerifyFile *file, BYTE *buffer);
+ static DWORD WINAPI verify_thread(LPVOID param);
+ static int compare_files(const void *a, const void *b);
+ 
+ static BOOL add_file(VerifyRun *job, const char *relative_path, ULONGLONG size, ULONGLONG hash)
+ {
+     if (job->count == job->capacity)
+     {
+         int capacity = job->capacity ? job->capacity * 2 : 1024;
+         VerifyFile *grown = (VerifyFile *)realloc(job->files, capacity * sizeof(VerifyFile));
+         if (!grown)
+             return FALSE;
+         job->files = grown;
+         job->capacity = capacity;
+     }
+ 
+     job->files[job->count].path = _strdup(relative_path);
+     if (!job->files[job->count].path)
+         return FALSE;
+     job->files[job->count].size = size;
+     job->files[job->count].hash = hash;
+     job->count++;
+ 
+     job->progress->files_total = job->count;
+     job->progress->bytes_total += 2 * size;
+     return TRUE;
+ }
+ 
+ /**
+  * Collect the source files a backup with these rules copies
+  */
+ static BOOL scan_source(VerifyRun *job, const BackupFilter *filter, const char *dir, const char *relative_dir)
+ {
+     char search_path[MAX_PATH_LEN];
+     WIN32_FIND_DATA fd;
+     HANDLE hFind;
+     BOOL ok = TRUE;
+ 
+     snprintf(search_path, sizeof(search_path), "%s\\*", dir);
+     hFind = FindFirstFile(search_path, &fd);
+     if (hFind == INVALID_HANDLE_VALUE)
+         return relative_dir[0] != '\0';
+ 
+     do
+     {
+         char path[MAX_PATH_LEN], relative_path[MAX_PATH_LEN];
+ 
+         if (strcmp(fd.cFileName, ".") == 0 || strcmp(fd.cFileName, "..") == 0)
+             continue;
+ 
+         snprintf(path, sizeof(path), "%s\\%s", dir, fd.cFileName);
+         if (relative_dir[0])
+             snprintf(relative_path, sizeof(relative_path), "%s\\%s", relative_dir, fd.cFileName);
+         else
+             snprintf(relative_path, sizeof(relative_path), "%s", fd.cFileName);
+ 
+         if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+         {
+             if (job->options->include_subdirs && !filter_prune_directory(filter, relative_path))
+                 ok = scan_source(job, filter, path, relative_path);
+         }
+         else if (filter_match_file(filter, relative_path))
+         {
+             ok = add_file(job, relative_path, ((ULONGLONG)fd.nFileSizeHigh << 32) | fd.nFileSizeLow, 0);
+         }
+     } while (ok && !job->progress->cancelled && FindNextFile(hFind, &fd));
+ 
+     FindClose(hFind);
+     return ok;
+ }
+ 
+ /**
+  * Hash one copy of a file, counting its bytes as they are read
+  */
+ static int hash_copy(VerifyProgress *progress, const char *path, BYTE *buffer, ULONGLONG *hash, ULONGLONG *size)
+ {
+     HashState state;
+     DWORD read = 0;
+     BOOL ok;
+ 
+     HANDLE hFile = CreateFile(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                               OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+     if (hFile == INVALID_HANDLE_VALUE)
+     {
+         DWORD error = GetLastError();
+         return error == ERROR_FILE_NOT_FOUND || error == ERROR_PATH_NOT_FOUND ? VERIFY_READ_MISSING : VERIFY_READ_FAILED;
+     }
+ 
+     hash_init(&state, 0);
+     while ((ok = ReadFile(hFile, buffer, VERIFY_BUFFER_SIZE, &read, NULL)) && read > 0)
+     {
+         hash_update(&state, buffer, read);
+         InterlockedExchangeAdd64(&progress->bytes_done, read);
+         if (progress->cancelled)
+             break;
+     }
+     CloseHandle(hFile);
+ 
+     if (progress->cancelled)
+         return VERIFY_READ_CANCELLED;
+     if (!ok)
+         return VERIFY_READ_FAILED;
+ 
+     *hash = hash_final(&state);
+     *size = state.total_len;
+     return VERIFY_READ_OK;
+ }
+ 
+ /**
+  * Keep a problem for the report while there is room
+  */
+ static void add_problem(VerifyProgress *progress, const char *kind, const char *relative_path)
+ {
+     LONG n = InterlockedIncrement(&progress->problem_count) - 1;
+ 
+     if (n < VERIFY_MAX_PROBLEMS)
+         snprintf(progress->problems[n], sizeof(progress->problems[n]), "%s: %s", kind, relative_path);
+ }
+ 
+ /**
+  * Check one file: the backup copy against the manifest hash, or against the
+  * source when the backup has no manifest
+  */
+ static void verify_file(VerifyRun *job, const VerifyFile *file, BYTE *buffer)
+ {
+     VerifyProgress *progress = job->progress;
+     char source[MAX_PATH_LEN], target[MAX_PATH_LEN];
+     ULONGLONG target_hash = 0, target_size = 0, source_hash = 0, source_size = 0;
+     int target_read, source_read;
+ 
+     snprintf(target, sizeof(target), "%s\\%s", job->options->target_path, file->path);
+     snprintf(source, sizeof(source), "%s\\%s", job->options->source_path, file->path);
+ 
+     target_read = hash_copy(progress, target, buffer, &target_hash, &target_size);
+     if (target_read == VERIFY_READ_CANCELLED)
+         return;
+     source_read = hash_copy(progress, source, buffer, &source_hash, &source_size);
+     if (source_read == VERIFY_READ_CANCELLED)
+         return;
+ 
+     // With a manifest the source only tells what changed since the backup,
+     // without one an unreadable source leaves the copy unchecked
+     if (source_read == VERIFY_READ_MISSING)
+         InterlockedIncrement(&progress->source_missing);
+     else if (source_read == VERIFY_READ_FAILED)
+     {
+         if (!progress->manifest)
+             InterlockedIncrement(&progress->unreadable);
+         add_problem(progress, "Source unreadable", file->path);
+     }
+     else if (progress->manifest && (source_hash != file->hash || source_size != file->size))
+         InterlockedIncrement(&progress->source_changed);
+ 
+     if (target_read == VERIFY_READ_MISSING)
+     {
+         InterlockedIncrement(&progress->missing);
+         add_problem(progress, "Missing", file->path);
+     }
+     else if (target_read == VERIFY_READ_FAILED)
+     {
+         InterlockedIncrement(&progress->unreadable);
+         add_problem(progress, "Unreadable", file->path);
+     }
+     else if (progress->manifest)
+     {
+         if (target_hash == file->hash && target_size == file->size)
+             InterlockedIncrement(&progress->matched);
+         else
+         {
+             InterlockedIncrement(&progress->mismatched);
+             add_problem(progress, "Corrupt", file->path);
+         }
+     }
+     else if (source_read == VERIFY_READ_OK)
+     {
+         if (target_hash == source_hash && target_size == source_size)
+             InterlockedIncrement(&progress->matched);
+         else
+         {
+             InterlockedIncrement(&progress->mismatched);
+             add_problem(progress, "Differs", file->path);
+         }
+     }
+ 
+     InterlockedIncrement(&progress->files_done);
+ }
+ 
+ static DWORD WINAPI verify_thread(LPVOID param)
+ {
+     VerifyRun *job = (VerifyRun *)param;
+     BYTE *buffer = (BYTE *)malloc(VERIFY_BUFFER_SIZE);
+ 
+     for (;;)
+     {
+         LONG n = InterlockedIncrement(&job->next) - 1;
+ 
+         if (n >= job->count || job->progress->cancelled || !buffer)
+             break;
+ 
+         EnterCriticalSection(&job->progress->lock);
+         strncpy(job->progress->current, job->files[n].path, sizeof(job->progress->current) - 1);
+         LeaveCriticalSection(&job->progress->lock);
+         verify_file(job, &job->files[n], buffer);
+     }
+ 
+     free(buffer);
+     return 0;
+ }
+ 
+ static int compare_files(const void *a, const void *b)
+ {
+     ULONGLONG size_a = ((const VerifyFile *)a)->size;
+     ULONGLONG size_b = ((const VerifyFile *)b)->size;
+ 
+     return size_a < size_b ? 1 : size_a > size_b ? -1 : 0;
+ }
+ 
+ /**
+  * Verify a backup, largest files first so the workers finish together
+  */
+ void verify_progress_init(VerifyProgress *progress)
+ {
+     memset(progress, 0, sizeof(*progress));
+     InitializeCriticalSection(&progress->lock);
+ }
+ 
+ void verify_progress_free(VerifyProgress *progress)
+ {
+     DeleteCriticalSection(&progress->lock);
+ }
+ 
+ BOOL verify_backup(const VerifyOptions *options, VerifyProgress *progress)
+ {
+     VerifyRun job;
+     HANDLE workers[VERIFY_MAX_THREADS];
+     char manifest_path[MAX_PATH_LEN];
+     SYSTEM_INFO si;
+     DWORD start = GetTickCount();
+     int worker_count = 0;
+     BOOL ok = TRUE;
+ 
+     memset(&job, 0, sizeof(job));
+     job.options = options;
+     job.progress = progress;
+ 
+     // The files of the backup: its manifest, or what the filter selects in the source
+     snprintf(manifest_path, sizeof(manifest_path), "%s\\%s", options->target_path, MANIFEST_FILE_NAME);
+     if (GetFileAttributes(manifest_path) != INVALID_FILE_ATTRIBUTES)
+     {
+         BackupManifest *manifest = manifest_load(options->target_path);
+         ManifestEntry entry;
+ 
+         ok = manifest != NULL;
+         for (int i = 0; ok && manifest_get_entry(manifest, i, &entry); i++)
+             ok = add_file(&job, entry.path, entry.size, entry.hash);
+         if (manifest)
+             manifest_free(manifest);
+         progress->manifest = TRUE;
+     }
+     else
+     {
+         BackupFilter *filter = filter_compile(options->extensions, options->excludes);
+ 
+         ok = filter && scan_source(&job, filter, options->source_path, "");
+         filter_free(filter);
+     }
+ 
+     // Two workers per CPU: while one waits for a read the other hashes
+     GetSystemInfo(&si);
+     progress->threads = options->threads > 0 ? options->threads : 2 * (int)si.dwNumberOfProcessors;
+     if (progress->threads > VERIFY_MAX_THREADS)
+         progress->threads = VERIFY_MAX_THREADS;
+     if (progress->threads > job.count)
+         progress->threads = job.count;
+     if (progress->threads < 1)
+         progress->threads = 1;
+ 
+     if (ok && job.count > 0)
+     {
+         qsort(job.files, job.count, sizeof(VerifyFile), compare_files);
+         for (int i = 0; i < progress->threads; i++)
+         {
+             workers[worker_count] = CreateThread(NULL, 0, verify_thread, &job, 0, NULL);
+             if (workers[worker_count])
+                 worker_count++;
+         }
+         if (worker_count == 0)
+             verify_thread(&job);
+         else
+             WaitForMultipleObjects(worker_count, workers, TRUE, INFINITE);
+         for (int i = 0; i < worker_count; i++)
+             CloseHandle(workers[i]);
+     }
+     progress->elapsed_ms = GetTickCount() - start;
+ 
+     for (int i = 0; i < job.count; i++)
+         free(job.files[i].path);
+     free(job.files);
+ 
+     return ok && !progress->cancelled && progress->files_done == job.count &&
+            progress->mismatched == 0 && progress->missing == 0 && progress->unreadable == 0;
+ }
+ 
+ void verify_format_report(const VerifyOptions *options, const VerifyProgress *progress, char *buffer, size_t size)
+ {
+     double mb = progress->bytes_done / 1048576.0;
+     double seconds = progress->elapsed_ms / 1000.0;
+     LONG problems = progress->problem_count < VERIFY_MAX_PROBLEMS ? progress->problem_count : VERIFY_MAX_PROBLEMS;
+     int used;
+ 
+     used = snprintf(buffer, size, "Verified %ld of %ld files of %s against the %s: %ld intact, %ld corrupt, "
+                                   "%ld missing, %ld unreadable. %.1f MB hashed in %.1f s, %.1f MB/s on %d threads.",
+                     progress->files_done, progress->files_total, options->target_path,
+                     progress->manifest ? "manifest" : "source",
+                     progress->matched, progress->mismatched, progress->missing, progress->unreadable, mb, seconds,
+                     seconds > 0 ? mb / seconds : 0.0, progress->threads);
+ 
+     if (used > 0 && (size_t)used < size && (progress->source_changed || progress->source_missing))
+         used += snprintf(buffer + used, size - used, "\nSince the backup %ld source files changed and %ld were deleted.",
+                          progress->source_changed, progress->source_missing);
+ 
+     for (LONG i = 0; i < problems && used > 0 && (size_t)used < size; i++)
+         used += snprintf(buffer + used, size - used, "\n%s", progress->problems[i]);
+     if (used > 0 && (size_t)used < size && progress->problem_count > problems)
+         snprintf(buffer + used, size - used, "\n... and %ld more.", progress->problem_count - problems);
+ }
\ No newline at end of file
@@ -0,0 +1,95 @@
+/*******************************************************************************
+ * Backup Verify Module Header
+ * Confirms that a copied backup matches its source: parallel workers hash
+ * both copies of every file and check them against the manifest
+ *******************************************************************************/
+#ifndef BACKUP_VERIFY_H
+#define BACKUP_VERIFY_H
+
+#include <windows.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Maximum path length constant (if not already defined)
+#ifndef MAX_PATH_LEN
+#define MAX_PATH_LEN 260
+#endif
+
+// Upper bound of the verify workers
+#define VERIFY_MAX_THREADS 32
+
+// Problems kept for the report, the counters cover all of them
+#define VERIFY_MAX_PROBLEMS 32
+
+// Verify job options
+typedef struct
+{
+    char source_path[MAX_PATH_LEN];
+    char target_path[MAX_PATH_LEN];  // Copy backup directory or rotation snapshot
+    char extensions[MAX_PATH_LEN];   // Without a manifest: the files a backup copies
+    char excludes[MAX_PATH_LEN];
+    int include_subdirs;
+    int threads;                     // Hash workers, 0 for two per CPU
+} VerifyOptions;
+
+// Live state of a running verify, shared with the progress window
+typedef struct
+{
+    volatile LONG files_total;
+    volatile LONG files_done;
+    volatile LONGLONG bytes_total;    // Source and backup together
+    volatile LONGLONG bytes_done;
+    volatile LONG matched;            // Backup copy is intact
+    volatile LONG mismatched;         // Backup copy differs from the manifest or the source
+    volatile LONG missing;            // Backup copy does not exist
+    volatile LONG unreadable;         // A copy could not be read
+    volatile LONG source_changed;     // Source changed since the backup (not an error)
+    volatile LONG source_missing;     // Source deleted since the backup (not an error)
+    volatile LONG cancelled;          // Set to stop the verify
+    BOOL manifest;                    // Checked against the manifest of the backup
+    int threads;                      // Workers actually used
+    DWORD elapsed_ms;
+    CRITICAL_SECTION lock;            // Guards current
+    char current[MAX_PATH_LEN];       // File being hashed, for the progress window
+    volatile LONG problem_count;
+    char problems[VERIFY_MAX_PROBLEMS][MAX_PATH_LEN + 16];
+} VerifyProgress;
+
+/**
+ * Prepare the progress of a verify
+ * @param progress Progress to initialize
+ */
+void verify_progress_init(VerifyProgress *progress);
+
+/**
+ * Release the progress of a finished verify
+ * @param progress Progress set up by verify_progress_init
+ */
+void verify_progress_free(VerifyProgress *progress);
+
+/**
+ * Verify a backup directory against its source. With a manifest every file
+ * it lists is checked against its recorded hash, without one every source
+ * file the filter matches must have an identical copy in the backup.
+ * @param options Verify parameters
+ * @param progress Progress set up by verify_progress_init, updated while the verify runs
+ * @return TRUE if every file of the backup is present and intact
+ */
+BOOL verify_backup(const VerifyOptions *options, VerifyProgress *progress);
+
+/**
+ * Summarize a finished verify: counts, throughput and the first problems
+ * @param options Verify parameters
+ * @param progress Progress of the finished verify
+ * @param buffer Receives the report
+ * @param size Size of the buffer
+ */
+void verify_format_report(const VerifyOptions *options, const VerifyProgress *progress, char *buffer, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BACKUP_VERIFY_H */
\ No newline at end of file
@@ -0,0 +1,799 @@
+/*******************************************************************************
+ * Change Journal Module Implementation
+ * USN records between two positions, resolved to paths below the source root
+ *******************************************************************************/
+
+ #include "change_journal.h"
+ #include <winioctl.h>
+ #include <stddef.h>
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ #include <ctype.h>
+ 
+ #define JOURNAL_HEADER "# DevilboxManager change journal cursor v1"
+ 
+ // Output buffer of one FSCTL_READ_USN_JOURNAL call
+ #define JOURNAL_BUFFER_SIZE (64 * 1024)
+ 
+ // Declarations missing from older MinGW headers
+ #ifndef FSCTL_READ_USN_JOURNAL
+ #define FSCTL_READ_USN_JOURNAL CTL_CODE(FILE_DEVICE_FILE_SYSTEM, 46, METHOD_NEITHER, FILE_ANY_ACCESS)
+ #endif
+ #ifndef FSCTL_QUERY_USN_JOURNAL
+ #define FSCTL_QUERY_USN_JOURNAL CTL_CODE(FILE_DEVICE_FILE_SYSTEM, 61, METHOD_BUFFERED, FILE_ANY_ACCESS)
+ #endif
+ #ifndef ERROR_JOURNAL_NOT_ACTIVE
+ #define ERROR_JOURNAL_NOT_ACTIVE 1179L
+ #endif
+ #ifndef ERROR_JOURNAL_ENTRY_DELETED
+ #define ERROR_JOURNAL_ENTRY_DELETED 1181L
+ #endif
+ #ifndef USN_REASON_DATA_OVERWRITE
+ #define USN_REASON_DATA_OVERWRITE 0x00000001
+ #define USN_REASON_DATA_EXTEND 0x00000002
+ #define USN_REASON_DATA_TRUNCATION 0x00000004
+ #define USN_REASON_FILE_CREATE 0x00000100
+ #define USN_REASON_FILE_DELETE 0x00000200
+ #define USN_REASON_RENAME_OLD_NAME 0x00001000
+ #define USN_REASON_RENAME_NEW_NAME 0x00002000
+ #define USN_REASON_BASIC_INFO_CHANGE 0x00008000
+ #define USN_REASON_HARD_LINK_CHANGE 0x00010000
+ #endif
+ 
+ // Records that make a file worth checking: content, name, timestamps
+ #define JOURNAL_FILE_REASONS (USN_REASON_DATA_OVERWRITE | USN_REASON_DATA_EXTEND | USN_REASON_DATA_TRUNCATION | \
+                               USN_REASON_FILE_CREATE | USN_REASON_FILE_DELETE | USN_REASON_RENAME_OLD_NAME | \
+                               USN_REASON_RENAME_NEW_NAME | USN_REASON_BASIC_INFO_CHANGE | USN_REASON_HARD_LINK_CHANGE)
+ // Directory records that move whole subtrees
+ #define JOURNAL_GONE_REASONS (USN_REASON_FILE_DELETE | USN_REASON_RENAME_OLD_NAME)
+ #define JOURNAL_TREE_REASONS (USN_REASON_FILE_CREATE | USN_REASON_RENAME_NEW_NAME)
+ 
+ // USN_JOURNAL_DATA
+ typedef struct
+ {
+     ULONGLONG journal_id;
+     LONGLONG first_usn;
+     LONGLONG next_usn;
+     LONGLONG lowest_valid_usn;
+     LONGLONG max_usn;
+     ULONGLONG maximum_size;
+     ULONGLONG allocation_delta;
+ } JournalData;
+ 
+ // READ_USN_JOURNAL_DATA (version 0)
+ typedef struct
+ {
+     LONGLONG start_usn;
+     DWORD reason_mask;
+     DWORD return_only_on_close;
+     ULONGLONG timeout;
+     ULONGLONG bytes_to_wait_for;
+     ULONGLONG journal_id;
+ } JournalRead;
+ 
+ // USN_RECORD (version 2, NTFS)
+ typedef struct
+ {
+     DWORD record_length;
+     WORD major_version;
+     WORD minor_version;
+     ULONGLONG file_id;
+     ULONGLONG parent_id;
+     LONGLONG usn;
+     LARGE_INTEGER timestamp;
+     DWORD reason;
+     DWORD source_info;
+     DWORD security_id;
+     DWORD attributes;
+     WORD name_length;   // Bytes
+     WORD name_offset;
+     WCHAR name[1];
+ } JournalRecord;
+ 
+ // FILE_ID_DESCRIPTOR with a 64-bit file ID
+ typedef struct
+ {
+     DWORD size;
+     int type;
+     union
+     {
+         LARGE_INTEGER file_id;
+         BYTE object_id[16];
+     } id;
+ } JournalFileId;
+ 
+ // Vista and later, looked up at run time so the program still starts on XP
+ typedef HANDLE (WINAPI *OpenFileByIdFunc)(HANDLE, JournalFileId *, DWORD, DWORD, LPSECURITY_ATTRIBUTES, DWORD);
+ typedef DWORD (WINAPI *GetFinalPathNameByHandleFunc)(HANDLE, LPSTR, DWORD, DWORD);
+ 
+ // Resolution state of a directory
+ enum
+ {
+     DIR_UNRESOLVED,
+     DIR_RESOLVING,
+     DIR_RESOLVED
+ };
+ 
+ // Directory met in the journal, by file ID
+ typedef struct
+ {
+     ULONGLONG id;
+     ULONGLONG parent;
+     char *name;        // Last name the journal recorded, NULL if it has no record of its own
+     char *path;        // Full path, NULL if it cannot be resolved
+     int state;
+ } JournalDir;
+ 
+ // Changed path
+ typedef struct
+ {
+     int kind;
+     char *path;
+ } JournalChange;
+ 
+ struct JournalChanges
+ {
+     JournalChange *items;
+     int count;
+     int capacity;
+     LONGLONG records;
+ };
+ 
+ // State of one read of the journal
+ typedef struct
+ {
+     HANDLE volume;
+     char root[MAX_PATH_LEN];   // Final path of the source root, without a trailing backslash
+     size_t root_length;
+     JournalDir **dirs;         // Open addressing by file ID
+     size_t dir_mask;
+     size_t dir_count;
+     BYTE *buffer;
+     OpenFileByIdFunc open_by_id;
+     GetFinalPathNameByHandleFunc get_final_path;
+     JournalChanges *changes;
+     BOOL overflow;             // Too many changes to be worth it
+ } JournalScan;
+ 
+ // Forward declarations of internal functions
+ static BOOL load_functions(JournalScan *scan);
+ static HANDLE open_volume(const char *source_root, JournalData *data, DWORD *serial, char *reason, size_t size);
+ static BOOL final_path(JournalScan *scan, HANDLE handle, char *path, size_t size);
+ static JournalDir *find_dir(JournalScan *scan, ULONGLONG id);
+ static const char *resolve_dir(JournalScan *scan, ULONGLONG id);
+ static const char *relative_to_root(const JournalScan *scan, const char *path);
+ static void record_name(const JournalRecord *record, char *name, size_t size);
+ static void add_change(JournalScan *scan, int kind, const char *parent, const char *name);
+ static void note_directory(JournalScan *scan, const JournalRecord *record);
+ static void note_change(JournalScan *scan, const JournalRecord *record);
+ static BOOL read_records(JournalScan *scan, const JournalCursor *from, const JournalCursor *to, int pass,
+                          char *reason, size_t size);
+ static int compare_changes(const void *a, const void *b);
+ static void compact_changes(JournalChanges *changes);
+ static void free_scan(JournalScan *scan);
+ 
+ /**
+  * Look up the Vista functions that turn file IDs into paths
+  */
+ static BOOL load_functions(JournalScan *scan)
+ {
+     HMODULE kernel = GetModuleHandle("kernel32.dll");
+ 
+     if (!kernel)
+         return FALSE;
+     scan->open_by_id = (OpenFileByIdFunc)GetProcAddress(kernel, "OpenFileById");
+     scan->get_final_path = (GetFinalPathNameByHandleFunc)GetProcAddress(kernel, "GetFinalPathNameByHandleA");
+     return scan->open_by_id && scan->get_final_path;
+ }
+ 
+ /**
+  * Open the volume of a source tree and query its journal
+  */
+ static HANDLE open_volume(const char *source_root, JournalData *data, DWORD *serial, char *reason, size_t size)
+ {
+     char mount_point[MAX_PATH_LEN], volume_name[MAX_PATH_LEN];
+     DWORD returned = 0, error;
+     size_t length;
+     HANDLE volume;
+ 
+     if (!GetVolumePathName(source_root, mount_point, sizeof(mount_point)) ||
+         !GetVolumeNameForVolumeMountPoint(mount_point, volume_name, sizeof(volume_name)))
+     {
+         snprintf(reason, size, "the volume of %s has no change journal", source_root);
+         return INVALID_HANDLE_VALUE;
+     }
+ 
+     if (!GetVolumeInformation(mount_point, NULL, 0, serial, NULL, NULL, NULL, 0))
+         *serial = 0;
+ 
+     // \\?\Volume{...}\ names the root directory, without the backslash the volume itself
+     length = strlen(volume_name);
+     if (length > 0 && volume_name[length - 1] == '\\')
+         volume_name[length - 1] = 0;
+ 
+     volume = CreateFile(volume_name, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
+     if (volume == INVALID_HANDLE_VALUE)
+     {
+         error = GetLastError();
+         if (error == ERROR_ACCESS_DENIED)
+             snprintf(reason, size, "reading the change journal needs administrator rights");
+         else
+             snprintf(reason, size, "cannot open volume %s (error %lu)", mount_point, error);
+         return INVALID_HANDLE_VALUE;
+     }
+ 
+     if (!DeviceIoControl(volume, FSCTL_QUERY_USN_JOURNAL, NULL, 0, data, sizeof(JournalData), &returned, NULL))
+     {
+         error = GetLastError();
+         if (error == ERROR_JOURNAL_NOT_ACTIVE)
+             snprintf(reason, size, "the change journal is not active on %s", mount_point);
+         else
+             snprintf(reason, size, "%s has no change journal (error %lu)", mount_point, error);
+         CloseHandle(volume);
+         return INVALID_HANDLE_VALUE;
+     }
+ 
+     return volume;
+ }
+ 
+ /**
+  * Full DOS path of an open file or directory, without the \\?\ prefix
+  */
+ static BOOL final_path(JournalScan *scan, HANDLE handle, char *path, size_t size)
+ {
+     char buffer[MAX_PATH_LEN + 8];
+     DWORD length = scan->get_final_path(handle, buffer, sizeof(buffer), 0);
+     const char *start = buffer;
+ 
+     if (length == 0 || length >= sizeof(buffer))
+         return FALSE;
+ 
+     if (strncmp(buffer, "\\\\?\\UNC\\", 8) == 0)
+     {
+         snprintf(path, size, "\\\\%s", buffer + 8);
+         return TRUE;
+     }
+     if (strncmp(buffer, "\\\\?\\", 4) == 0)
+         start += 4;
+     snprintf(path, size, "%s", start);
+     return TRUE;
+ }
+ 
+ /**
+  * Find a directory by file ID, adding it when missing. Entries are allocated
+  * one by one, pointers stay valid while the table grows.
+  */
+ static JournalDir *find_dir(JournalScan *scan, ULONGLONG id)
+ {
+     size_t i;
+ 
+     if (!scan->dirs || (scan->dir_count + 1) * 2 > scan->dir_mask + 1)
+     {
+         size_t slots = scan->dirs ? (scan->dir_mask + 1) * 2 : 4096;
+         JournalDir **dirs = (JournalDir **)calloc(slots, sizeof(JournalDir *));
+ 
+         if (!dirs)
+             return NULL;
+         for (size_t n = 0; scan->dirs && n <= scan->dir_mask; n++)
+         {
+             if (!scan->dirs[n])
+                 continue;
+             i = (size_t)(scan->dirs[n]->id * 0x9E3779B97F4A7C15ULL >> 20) & (slots - 1);
+             while (dirs[i])
+                 i = (i + 1) & (slots - 1);
+             dirs[i] = scan->dirs[n];
+         }
+         free(scan->dirs);
+         scan->dirs = dirs;
+         scan->dir_mask = slots - 1;
+     }
+ 
+     i = (size_t)(id * 0x9E3779B97F4A7C15ULL >> 20) & scan->dir_mask;
+     while (scan->dirs[i])
+     {
+         if (scan->dirs[i]->id == id)
+             return scan->dirs[i];
+         i = (i + 1) & scan->dir_mask;
+     }
+ 
+     scan->dirs[i] = (JournalDir *)calloc(1, sizeof(JournalDir));
+     if (scan->dirs[i])
+     {
+         scan->dirs[i]->id = id;
+         scan->dir_count++;
+     }
+     return scan->dirs[i];
+ }
+ 
+ /**
+  * Full path of a directory: from its own journal records (it may be gone
+  * by now), else by opening it by ID
+  */
+ static const char *resolve_dir(JournalScan *scan, ULONGLONG id)
+ {
+     JournalDir *dir = find_dir(scan, id);
+     char path[MAX_PATH_LEN];
+ 
+     if (!dir || dir->state == DIR_RESOLVING)
+         return NULL;
+     if (dir->state == DIR_RESOLVED)
+         return dir->path;
+ 
+     dir->state = DIR_RESOLVING;
+     path[0] = 0;
+     if (dir->name)
+     {
+         const char *parent = resolve_dir(scan, dir->parent);
+ 
+         if (parent)
+             snprintf(path, sizeof(path), "%s\\%s", parent, dir->name);
+     }
+     else
+     {
+         JournalFileId file_id;
+         HANDLE handle;
+ 
+         memset(&file_id, 0, sizeof(file_id));
+         file_id.size = sizeof(file_id);
+         file_id.id.file_id.QuadPart = (LONGLONG)id;
+         handle = scan->open_by_id(scan->volume, &file_id, FILE_READ_ATTRIBUTES,
+                                   FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                                   FILE_FLAG_BACKUP_SEMANTICS);
+         if (handle != INVALID_HANDLE_VALUE)
+         {
+             if (!final_path(scan, handle, path, sizeof(path)))
+                 path[0] = 0;
+             CloseHandle(handle);
+         }
+     }
+ 
+     dir->path = path[0] ? _strdup(path) : NULL;
+     dir->state = DIR_RESOLVED;
+     return dir->path;
+ }
+ 
+ /**
+  * Path relative to the source root, NULL if outside of it
+  */
+ static const char *relative_to_root(const JournalScan *scan, const char *path)
+ {
+     if (_strnicmp(path, scan->root, scan->root_length) != 0)
+         return NULL;
+     if (path[scan->root_length] == 0)
+         return path + scan->root_length;
+     if (path[scan->root_length] != '\\')
+         return NULL;
+     return path + scan->root_length + 1;
+ }
+ 
+ /**
+  * File name of a record in the ANSI code page the rest of the program uses
+  */
+ static void record_name(const JournalRecord *record, char *name, size_t size)
+ {
+     const WCHAR *wide = (const WCHAR *)((const BYTE *)record + record->name_offset);
+     int length = WideCharToMultiByte(CP_ACP, 0, wide, record->name_length / sizeof(WCHAR), name, (int)size - 1,
+                                      NULL, NULL);
+ 
+     name[length > 0 ? length : 0] = 0;
+ }
+ 
+ /**
+  * Remember a changed path if it lies below the source root
+  */
+ static void add_change(JournalScan *scan, int kind, const char *parent, const char *name)
+ {
+     JournalChanges *changes = scan->changes;
+     const char *relative = relative_to_root(scan, parent);
+     char path[MAX_PATH_LEN];
+ 
+     if (!relative || !name[0])
+         return;
+ 
+     if (relative[0])
+         snprintf(path, sizeof(path), "%s\\%s", relative, name);
+     else
+         snprintf(path, sizeof(path), "%s", name);
+ 
+     // Duplicates go at the end, a busy project still fits in a few times the limit
+     if (changes->count >= JOURNAL_MAX_CHANGES * 4)
+     {
+         scan->overflow = TRUE;
+         return;
+     }
+     if (changes->count == changes->capacity)
+     {
+         int capacity = changes->capacity ? changes->capacity * 2 : 1024;
+         JournalChange *items = (JournalChange *)realloc(changes->items, capacity * sizeof(JournalChange));
+ 
+         if (!items)
+         {
+             scan->overflow = TRUE;
+             return;
+         }
+         changes->items = items;
+         changes->capacity = capacity;
+     }
+ 
+     changes->items[changes->count].kind = kind;
+     changes->items[changes->count].path = _strdup(path);
+     if (changes->items[changes->count].path)
+         changes->count++;
+ }
+ 
+ /**
+  * First pass: where every directory with records of its own was last seen
+  */
+ static void note_directory(JournalScan *scan, const JournalRecord *record)
+ {
+     char name[MAX_PATH_LEN];
+     JournalDir *dir;
+ 
+     if (!(record->attributes & FILE_ATTRIBUTE_DIRECTORY))
+         return;
+ 
+     dir = find_dir(scan, record->file_id);
+     if (!dir)
+         return;
+     record_name(record, name, sizeof(name));
+     free(dir->name);
+     dir->name = _strdup(name);
+     dir->parent = record->parent_id;
+ }
+ 
+ /**
+  * Second pass: turn a record into a change below the source root
+  */
+ static void note_change(JournalScan *scan, const JournalRecord *record)
+ {
+     char name[MAX_PATH_LEN];
+     const char *parent;
+ 
+     scan->changes->records++;
+     if (record->attributes & FILE_ATTRIBUTE_DIRECTORY)
+     {
+         if (!(record->reason & (JOURNAL_GONE_REASONS | JOURNAL_TREE_REASONS)))
+             return;
+     }
+     else if (!(record->reason & JOURNAL_FILE_REASONS))
+     {
+         return;
+     }
+ 
+     parent = resolve_dir(scan, record->parent_id);
+     if (!parent || !relative_to_root(scan, parent))
+         return;
+ 
+     record_name(record, name, sizeof(name));
+     if (!(record->attributes & FILE_ATTRIBUTE_DIRECTORY))
+     {
+         add_change(scan, JOURNAL_CHANGE_FILE, parent, name);
+         return;
+     }
+     if (record->reason & JOURNAL_GONE_REASONS)
+         add_change(scan, JOURNAL_CHANGE_GONE, parent, name);
+     if (record->reason & JOURNAL_TREE_REASONS)
+         add_change(scan, JOURNAL_CHANGE_TREE, parent, name);
+ }
+ 
+ /**
+  * Read the records between two positions, in large batches
+  */
+ static BOOL read_records(JournalScan *scan, const JournalCursor *from, const JournalCursor *to, int pass,
+                          char *reason, size_t size)
+ {
+     JournalRead read;
+     BOOL done = FALSE;
+ 
+     memset(&read, 0, sizeof(read));
+     read.start_usn = from->usn;
+     read.reason_mask = 0xFFFFFFFF;
+     read.journal_id = from->journal_id;
+ 
+     while (!done && !scan->overflow && read.start_usn < to->usn)
+     {
+         DWORD returned = 0;
+ 
+         if (!DeviceIoControl(scan->volume, FSCTL_READ_USN_JOURNAL, &read, sizeof(read), scan->buffer,
+                              JOURNAL_BUFFER_SIZE, &returned, NULL))
+         {
+             DWORD error = GetLastError();
+ 
+             if (error == ERROR_JOURNAL_ENTRY_DELETED)
+                 snprintf(reason, size, "the change journal wrapped since the last backup");
+             else
+                 snprintf(reason, size, "the change journal cannot be read (error %lu)", error);
+             return FALSE;
+         }
+         if (returned <= sizeof(LONGLONG))
+             break;
+ 
+         // The buffer starts with the position after its last record
+         for (DWORD offset = sizeof(LONGLONG); offset + offsetof(JournalRecord, name) <= returned;)
+         {
+             const JournalRecord *record = (const JournalRecord *)(scan->buffer + offset);
+ 
+             if (record->record_length == 0 || record->usn >= to->usn)
+             {
+                 done = record->record_length != 0;
+                 break;
+             }
+             if (record->major_version == 2)
+             {
+                 if (pass == 1)
+                     note_directory(scan, record);
+                 else
+                     note_change(scan, record);
+             }
+             offset += record->record_length;
+         }
+         read.start_usn = *(const LONGLONG *)scan->buffer;
+     }
+ 
+     return TRUE;
+ }
+ 
+ /**
+  * Order changes so a directory comes right before everything below it
+  */
+ static int compare_changes(const void *a, const void *b)
+ {
+     const JournalChange *x = (const JournalChange *)a;
+     const JournalChange *y = (const JournalChange *)b;
+     const unsigned char *p = (const unsigned char *)x->path;
+     const unsigned char *q = (const unsigned char *)y->path;
+ 
+     for (;; p++, q++)
+     {
+         int c = *p == '\\' ? 1 : tolower(*p);
+         int d = *q == '\\' ? 1 : tolower(*q);
+ 
+         if (c != d)
+             return c - d;
+         if (!c)
+             break;
+     }
+     return x->kind - y->kind;
+ }
+ 
+ /**
+  * Sort the changes, drop duplicates and everything below a directory change
+  */
+ static void compact_changes(JournalChanges *changes)
+ {
+     const char *tree = NULL;
+     size_t tree_length = 0;
+     int kept = 0;
+ 
+     qsort(changes->items, changes->count, sizeof(JournalChange), compare_changes);
+ 
+     for (int i = 0; i < changes->count; i++)
+     {
+         JournalChange *change = &changes->items[i];
+ 
+         if ((kept > 0 && compare_changes(change, &changes->items[kept - 1]) == 0) ||
+             (tree && _strnicmp(change->path, tree, tree_length) == 0 && change->path[tree_length] == '\\'))
+         {
+             free(change->path);
+             continue;
+         }
+ 
+         // Below a directory that is gone or listed in full, nothing else matters
+         changes->items[kept++] = *change;
+         if (change->kind != JOURNAL_CHANGE_FILE)
+         {
+             tree = changes->items[kept - 1].path;
+             tree_length = strlen(tree);
+         }
+     }
+     changes->count = kept;
+ }
+ 
+ /**
+  * Release the state of a read
+  */
+ static void free_scan(JournalScan *scan)
+ {
+     for (size_t n = 0; scan->dirs && n <= scan->dir_mask; n++)
+     {
+         if (!scan->dirs[n])
+             continue;
+         free(scan->dirs[n]->name);
+         free(scan->dirs[n]->path);
+         free(scan->dirs[n]);
+     }
+     free(scan->dirs);
+     free(scan->buffer);
+     if (scan->volume != INVALID_HANDLE_VALUE)
+         CloseHandle(scan->volume);
+ }
+ 
+ BOOL journal_query(const char *source_root, JournalCursor *cursor, char *reason, size_t size)
+ {
+     JournalScan scan;
+     JournalData data;
+     HANDLE volume;
+ 
+     memset(&scan, 0, sizeof(scan));
+     if (!load_functions(&scan))
+     {
+         snprintf(reason, size, "this Windows version cannot resolve change journal records");
+         return FALSE;
+     }
+ 
+     volume = open_volume(source_root, &data, &cursor->volume_serial, reason, size);
+     if (volume == INVALID_HANDLE_VALUE)
+         return FALSE;
+ 
+     cursor->journal_id = data.journal_id;
+     cursor->usn = data.next_usn;
+     CloseHandle(volume);
+     return TRUE;
+ }
+ 
+ BOOL journal_load_cursor(const char *target_root, const char *source_root, JournalCursor *cursor)
+ {
+     char path[MAX_PATH_LEN];
+     char line[MAX_PATH_LEN + 100];
+     char source[MAX_PATH_LEN];
+     BOOL found = FALSE;
+     FILE *f;
+ 
+     snprintf(path, sizeof(path), "%s\\%s", target_root, JOURNAL_CURSOR_FILE);
+     f = fopen(path, "r");
+     if (!f)
+         return FALSE;
+ 
+     if (fgets(line, sizeof(line), f) && strncmp(line, JOURNAL_HEADER, strlen(JOURNAL_HEADER)) == 0 &&
+         fgets(line, sizeof(line), f))
+     {
+         unsigned long serial;
+         int offset = 0;
+ 
+         line[strcspn(line, "\r\n")] = 0;
+         if (sscanf(line, "%lx\t%llx\t%lld\t%llx\t%n", &serial, &cursor->journal_id, &cursor->usn, &cursor->rules,
+                    &offset) == 4 && offset)
+         {
+             snprintf(source, sizeof(source), "%s", line + offset);
+             cursor->volume_serial = (DWORD)serial;
+             found = _stricmp(source, source_root) == 0;
+         }
+     }
+ 
+     fclose(f);
+     return found;
+ }
+ 
+ BOOL journal_save_cursor(const char *target_root, const char *source_root, const JournalCursor *cursor)
+ {
+     char path[MAX_PATH_LEN];
+     char tmp_path[MAX_PATH_LEN];
+     BOOL ok;
+     FILE *f;
+ 
+     snprintf(path, sizeof(path), "%s\\%s", target_root, JOURNAL_CURSOR_FILE);
+     if (!cursor)
+         return DeleteFile(path) || GetLastError() == ERROR_FILE_NOT_FOUND;
+ 
+     snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+     f = fopen(tmp_path, "w");
+     if (!f)
+         return FALSE;
+ 
+     fprintf(f, "%s\n%08lx\t%016llx\t%lld\t%016llx\t%s\n", JOURNAL_HEADER, (unsigned long)cursor->volume_serial,
+             cursor->journal_id, cursor->usn, cursor->rules, source_root);
+     ok = !ferror(f);
+     ok = (fclose(f) == 0) && ok;
+ 
+     if (ok)
+         ok = MoveFileEx(tmp_path, path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+     if (!ok)
+         DeleteFile(tmp_path);
+     return ok;
+ }
+ 
+ JournalChanges *journal_read_changes(const char *source_root, const JournalCursor *from, const JournalCursor *to,
+                                      char *reason, size_t size)
+ {
+     JournalScan scan;
+     JournalData data;
+     DWORD serial = 0;
+     HANDLE root;
+     BOOL ok;
+ 
+     memset(&scan, 0, sizeof(scan));
+     scan.volume = INVALID_HANDLE_VALUE;
+     if (!load_functions(&scan))
+     {
+         snprintf(reason, size, "this Windows version cannot resolve change journal records");
+         return NULL;
+     }
+ 
+     scan.volume = open_volume(source_root, &data, &serial, reason, size);
+     if (scan.volume == INVALID_HANDLE_VALUE)
+         return NULL;
+ 
+     // Records older than the last backup must all still be there
+     if (serial != from->volume_serial)
+         snprintf(reason, size, "the project moved to another volume");
+     else if (data.journal_id != from->journal_id || data.journal_id != to->journal_id)
+         snprintf(reason, size, "the change journal was recreated");
+     else if (from->usn < data.first_usn)
+         snprintf(reason, size, "the change journal wrapped since the last backup");
+     else
+         reason[0] = 0;
+     if (reason[0])
+     {
+         free_scan(&scan);
+         return NULL;
+     }
+ 
+     // Parents are compared with the final path of the root, whatever way it was typed
+     root = CreateFile(source_root, FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                       NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+     ok = root != INVALID_HANDLE_VALUE && final_path(&scan, root, scan.root, sizeof(scan.root));
+     if (root != INVALID_HANDLE_VALUE)
+         CloseHandle(root);
+     scan.root_length = strlen(scan.root);
+     while (scan.root_length > 0 && scan.root[scan.root_length - 1] == '\\')
+         scan.root[--scan.root_length] = 0;
+ 
+     scan.buffer = (BYTE *)malloc(JOURNAL_BUFFER_SIZE);
+     scan.changes = (JournalChanges *)calloc(1, sizeof(JournalChanges));
+     if (!ok || !scan.buffer || !scan.changes)
+     {
+         snprintf(reason, size, "cannot open %s", source_root);
+         free(scan.changes);
+         free_scan(&scan);
+         return NULL;
+     }
+ 
+     // Directories deleted since are known only from their own records, read those first
+     ok = read_records(&scan, from, to, 1, reason, size) && read_records(&scan, from, to, 2, reason, size);
+     if (ok)
+         compact_changes(scan.changes);
+     if (ok && (scan.overflow || scan.changes->count > JOURNAL_MAX_CHANGES))
+     {
+         snprintf(reason, size, "more than %d changes, listing the tree is faster", JOURNAL_MAX_CHANGES);
+         ok = FALSE;
+     }
+ 
+     free_scan(&scan);
+     if (!ok)
+     {
+         journal_free_changes(scan.changes);
+         return NULL;
+     }
+     return scan.changes;
+ }
+ 
+ int journal_change_count(const JournalChanges *changes)
+ {
+     return changes ? changes->count : 0;
+ }
+ 
+ const char *journal_get_change(const JournalChanges *changes, int index, int *kind)
+ {
+     if (!changes || index < 0 || index >= changes->count)
+         return NULL;
+     if (kind)
+         *kind = changes->items[index].kind;
+     return changes->items[index].path;
+ }
+ 
+ LONGLONG journal_record_count(const JournalChanges *changes)
+ {
+     return changes ? changes->records : 0;
+ }
+ 
+ void journal_free_changes(JournalChanges *changes)
+ {
+     if (!changes)
+         return;
+ 
+     for (int i = 0; i < changes->count; i++)
+         free(changes->items[i].path);
+     free(changes->items);
+     free(changes);
+ }
\ No newline at end of file
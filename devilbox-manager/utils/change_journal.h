@@ -0,0 +1,125 @@
+/*******************************************************************************
+ * Change Journal Module Header
+ * Reads the NTFS change journal (USN journal) of the source volume so an
+ * incremental backup visits only the paths that changed since the last run
+ * instead of listing the whole project
+ *******************************************************************************/
+#ifndef CHANGE_JOURNAL_H
+#define CHANGE_JOURNAL_H
+
+#include <windows.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Maximum path length constant (if not already defined)
+#ifndef MAX_PATH_LEN
+#define MAX_PATH_LEN 260
+#endif
+
+// Journal position of the last backup, kept beside the manifest of the target
+// (the name starts like the manifest so restores leave it out)
+#define JOURNAL_CURSOR_FILE ".devilbox-manifest.journal"
+
+// More changes than this and listing the tree is cheaper
+#define JOURNAL_MAX_CHANGES 200000
+
+// Kinds of changes
+enum
+{
+    JOURNAL_CHANGE_FILE,  // File created, written, renamed or deleted: check it
+    JOURNAL_CHANGE_GONE,  // Directory deleted or renamed away: everything below is gone
+    JOURNAL_CHANGE_TREE   // Directory created or renamed into place: list everything below
+};
+
+// Position in the change journal of a volume
+typedef struct
+{
+    DWORD volume_serial;
+    ULONGLONG journal_id;  // Changes when the journal is deleted and created again
+    LONGLONG usn;          // Next record to read
+    ULONGLONG rules;       // Hash of the filter rules of the backup, other rules need a full listing
+} JournalCursor;
+
+// Changes of a source tree between two journal positions (opaque)
+typedef struct JournalChanges JournalChanges;
+
+/**
+ * Get the current end of the change journal of the volume holding a source tree
+ * @param source_root Source directory
+ * @param cursor Receives the position
+ * @param reason Receives why the journal cannot be used
+ * @param size Size of the reason buffer
+ * @return TRUE if the journal can be read (NTFS, journal active, administrator rights)
+ */
+BOOL journal_query(const char *source_root, JournalCursor *cursor, char *reason, size_t size);
+
+/**
+ * Load the position of the last backup into a target
+ * @param target_root Backup target directory
+ * @param source_root Source directory the position belongs to
+ * @param cursor Receives the position
+ * @return TRUE if the target has a position for this source
+ */
+BOOL journal_load_cursor(const char *target_root, const char *source_root, JournalCursor *cursor);
+
+/**
+ * Store the position a backup into a target is complete up to
+ * @param target_root Backup target directory
+ * @param source_root Source directory
+ * @param cursor Position, NULL to remove it so the next backup lists the whole tree
+ * @return TRUE on success
+ */
+BOOL journal_save_cursor(const char *target_root, const char *source_root, const JournalCursor *cursor);
+
+/**
+ * Read what changed below a source tree between two positions. Paths are
+ * relative to the source root, sorted so a directory comes right before
+ * everything below it, without duplicates and without anything below a
+ * directory change.
+ * @param source_root Source directory
+ * @param from Position of the last backup
+ * @param to Current position from journal_query
+ * @param reason Receives why the changes are not available
+ * @param size Size of the reason buffer
+ * @return Changes, NULL when the whole tree must be listed (journal wrapped,
+ *         recreated or on another volume, too many changes)
+ */
+JournalChanges *journal_read_changes(const char *source_root, const JournalCursor *from, const JournalCursor *to,
+                                     char *reason, size_t size);
+
+/**
+ * Number of changes
+ * @param changes Changes
+ * @return Change count
+ */
+int journal_change_count(const JournalChanges *changes);
+
+/**
+ * Get a change by position
+ * @param changes Changes
+ * @param index Position, 0 to journal_change_count - 1
+ * @param kind Receives the JOURNAL_CHANGE_* kind
+ * @return Path relative to the source root
+ */
+const char *journal_get_change(const JournalChanges *changes, int index, int *kind);
+
+/**
+ * Get the number of journal records read
+ * @param changes Changes
+ * @return Records of the whole volume between the two positions
+ */
+LONGLONG journal_record_count(const JournalChanges *changes);
+
+/**
+ * Release changes
+ * @param changes Changes (may be NULL)
+ */
+void journal_free_changes(JournalChanges *changes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CHANGE_JOURNAL_H */
\ No newline at end of file
@@ -0,0 +1,1291 @@
+/*******************************************************************************
+ * Database Dump Module Implementation
+ * Child processes of the MySQL tools, the global read lock session,
+ * per-table gzip streams and their replay
+ *******************************************************************************/
+
+ #include "db_dump.h"
+ #include "deflate.h"
+ #include <stdio.h>
+ #include <string.h>
+ #include <stdlib.h>
+ 
+ #ifndef MAX_PATH_LEN
+ #define MAX_PATH_LEN 260
+ #endif
+ 
+ // Input compressed per deflate call
+ #define DUMP_BLOCK_SIZE (256 * 1024)
+ 
+ // Longest wait for the global read lock, long-running queries delay it (ms)
+ #define LOCK_TIMEOUT 30000
+ 
+ #define MAX_COMMAND_LEN 2048
+ 
+ // Variable the MySQL tools read the password from, kept off the command line
+ #define PASSWORD_ENV "MYSQL_PWD"
+ 
+ // Bytes of a schema file searched for the database name, and of a table
+ // file held back for its table name
+ #define SCHEMA_PEEK_SIZE (64 * 1024)
+ 
+ // Standard handles of a child that are connected to pipes, the others go to NUL
+ #define CHILD_PIPE_INPUT 1
+ #define CHILD_PIPE_OUTPUT 2
+ 
+ // Running MySQL tool
+ typedef struct
+ {
+     HANDLE process;
+     HANDLE output;  // Read end of its stdout, NULL when it writes to NUL
+     HANDLE input;   // Write end of its stdin, NULL when it reads NUL
+     HANDLE errors;  // Temporary file receiving its stderr
+ } ChildProcess;
+ 
+ // gzip file written block by block, each block with the previous window as dictionary
+ typedef struct
+ {
+     HANDLE file;
+     DeflateWork work;
+     BYTE *buffer;  // DEFLATE_WINDOW of history followed by DUMP_BLOCK_SIZE of input
+     size_t dict_len;
+     size_t len;
+     DWORD crc;
+     ULONGLONG size;
+     LONGLONG written;
+     int level;
+     BOOL failed;
+ } GzipStream;
+ 
+ // Shared state of a dump
+ typedef struct
+ {
+     const DbDumpOptions *options;
+     const char *dir;              // Directory of the dump files
+     DbDumpProgress *progress;
+     char client[MAX_PATH_LEN];
+     char *environment;            // Environment of the children with the password, NULL without one
+     char **tables;  // Largest first; entry 0 is NULL and stands for the schema (file names on restore)
+     int table_count;
+     volatile LONG next_table;
+     char *error;
+     size_t error_size;
+     CRITICAL_SECTION lock;        // Guards error and the restore journal
+     CRITICAL_SECTION spawn_lock;  // Children are started one at a time, see start_child
+     char database[64];            // Restore: database of the dump
+     char **restored;              // Restore: files replayed by an interrupted run
+     int restored_count;
+ } DumpJob;
+ 
+ // Dump file found for a restore
+ typedef struct
+ {
+     char *name;
+     ULONGLONG size;
+ } DumpFile;
+ 
+ // SQL text of a dump file on its way into the mysql client
+ typedef struct
+ {
+     DumpJob *job;
+     HANDLE input;
+     char *held;       // Resume: start of the file, held back until its table is known
+     size_t held_len;
+ } ReplayStream;
+ 
+ // Start of a schema file, searched for its USE statement
+ typedef struct
+ {
+     char text[SCHEMA_PEEK_SIZE];
+     size_t len;
+ } SchemaPeek;
+ 
+ static const BYTE gzip_header[10] = {0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff};
+ 
+ static BOOL is_cancelled(const DumpJob *job)
+ {
+     return job->progress->cancelled && *job->progress->cancelled;
+ }
+ 
+ /**
+  * Record the first error of the dump
+  */
+ static void set_error(DumpJob *job, const char *message)
+ {
+     EnterCriticalSection(&job->lock);
+     if (job->error && job->error_size && !job->error[0])
+     {
+         strncpy(job->error, message, job->error_size - 1);
+         job->error[job->error_size - 1] = '\0';
+     }
+     LeaveCriticalSection(&job->lock);
+ }
+ 
+ /**
+  * Append an argument, quoted for CommandLineToArgv: backslashes before a
+  * quote are doubled and quotes escaped
+  */
+ static BOOL append_arg(char *command, size_t size, const char *arg)
+ {
+     size_t used = strlen(command);
+ 
+     if (used + 2 >= size)
+         return FALSE;
+     command[used++] = ' ';
+     command[used++] = '"';
+ 
+     for (const char *p = arg;; p++)
+     {
+         size_t slashes = 0;
+ 
+         while (*p == '\\')
+         {
+             slashes++;
+             p++;
+         }
+         // Backslashes are only special in front of a quote
+         size_t copies = *p == '"' || *p == '\0' ? slashes * 2 : slashes;
+         if (used + copies + 3 >= size)
+             return FALSE;
+         memset(command + used, '\\', copies);
+         used += copies;
+ 
+         if (*p == '\0')
+             break;
+         if (*p == '"')
+             command[used++] = '\\';
+         command[used++] = *p;
+     }
+ 
+     command[used++] = '"';
+     command[used] = '\0';
+     return TRUE;
+ }
+ 
+ /**
+  * Start the command line of a MySQL tool with the connection options; the
+  * password is passed in the environment, see build_environment
+  */
+ static BOOL build_command(const DumpJob *job, const char *tool, char *command, size_t size)
+ {
+     return snprintf(command, size, "%s %s -uroot --default-character-set=utf8mb4", job->client, tool) < (int)size;
+ }
+ 
+ /**
+  * Build the environment block of the children: ours with MYSQL_PWD set to
+  * the password, in sorted order. Command lines can be read by any local
+  * process, the environment of a process only by its owner.
+  */
+ static BOOL build_environment(DumpJob *job)
+ {
+     const char *password = job->options->password;
+     size_t name_len = strlen(PASSWORD_ENV);
+     size_t total = 0, used = 0;
+     BOOL placed = FALSE;
+     char *strings, *p;
+ 
+     if (!password || !password[0])
+         return TRUE;
+ 
+     strings = GetEnvironmentStrings();
+     if (!strings)
+         return FALSE;
+     for (p = strings; *p; p += strlen(p) + 1)
+         total += strlen(p) + 1;
+ 
+     job->environment = (char *)malloc(total + name_len + strlen(password) + 3);
+     if (!job->environment)
+     {
+         FreeEnvironmentStrings(strings);
+         return FALSE;
+     }
+ 
+     for (p = strings;; p += strlen(p) + 1)
+     {
+         // Entries for drive directories start with '=' and stay in front
+         if (!placed && (!*p || (*p != '=' && _stricmp(p, PASSWORD_ENV "=") > 0)))
+         {
+             used += sprintf(job->environment + used, "%s=%s", PASSWORD_ENV, password) + 1;
+             placed = TRUE;
+         }
+         if (!*p)
+             break;
+         if (_strnicmp(p, PASSWORD_ENV "=", name_len + 1) == 0)
+             continue;
+         strcpy(job->environment + used, p);
+         used += strlen(p) + 1;
+     }
+     job->environment[used] = '\0';
+ 
+     FreeEnvironmentStrings(strings);
+     return TRUE;
+ }
+ 
+ /**
+  * Start a child process with stdin and stdout on pipes or NUL (CHILD_PIPE_*)
+  * and stderr in a temporary file (a second pipe would need its own reader)
+  */
+ static BOOL start_child(DumpJob *job, char *command, int pipes, ChildProcess *child)
+ {
+     SECURITY_ATTRIBUTES sa;
+     STARTUPINFO si;
+     PROCESS_INFORMATION pi;
+     HANDLE out_write = NULL, in_read = NULL;
+     char temp_dir[MAX_PATH_LEN], temp_file[MAX_PATH_LEN];
+     BOOL ok;
+ 
+     memset(child, 0, sizeof(*child));
+     memset(&sa, 0, sizeof(sa));
+     sa.nLength = sizeof(sa);
+     sa.bInheritHandle = TRUE;
+ 
+     // The inheritable ends of one child must not leak into another started
+     // at the same time: it would keep the pipe open and its reader waiting
+     EnterCriticalSection(&job->spawn_lock);
+ 
+     if (pipes & CHILD_PIPE_OUTPUT)
+         ok = CreatePipe(&child->output, &out_write, &sa, 0);
+     else
+         ok = (out_write = CreateFile("NUL", GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, &sa,
+                                      OPEN_EXISTING, 0, NULL)) != INVALID_HANDLE_VALUE;
+     if (ok && (pipes & CHILD_PIPE_INPUT))
+         ok = CreatePipe(&in_read, &child->input, &sa, 0);
+     else if (ok)
+         in_read = CreateFile("NUL", GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, &sa, OPEN_EXISTING, 0, NULL);
+ 
+     if (ok && GetTempPath(sizeof(temp_dir), temp_dir) && GetTempFileName(temp_dir, "dbd", 0, temp_file))
+         child->errors = CreateFile(temp_file, GENERIC_READ | GENERIC_WRITE,
+                                    FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, &sa, CREATE_ALWAYS,
+                                    FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+     ok = ok && in_read != INVALID_HANDLE_VALUE && child->errors && child->errors != INVALID_HANDLE_VALUE;
+ 
+     if (ok)
+     {
+         // The parent's ends stay private
+         if (child->output)
+             SetHandleInformation(child->output, HANDLE_FLAG_INHERIT, 0);
+         if (child->input)
+             SetHandleInformation(child->input, HANDLE_FLAG_INHERIT, 0);
+ 
+         memset(&si, 0, sizeof(si));
+         si.cb = sizeof(si);
+         si.dwFlags = STARTF_USESTDHANDLES;
+         si.hStdInput = in_read;
+         si.hStdOutput = out_write;
+         si.hStdError = child->errors;
+         ok = CreateProcess(NULL, command, NULL, NULL, TRUE, CREATE_NO_WINDOW, job->environment,
+                            job->options->devilbox_path, &si, &pi);
+         SetHandleInformation(child->errors, HANDLE_FLAG_INHERIT, 0);
+     }
+ 
+     if (out_write && out_write != INVALID_HANDLE_VALUE)
+         CloseHandle(out_write);
+     if (in_read && in_read != INVALID_HANDLE_VALUE)
+         CloseHandle(in_read);
+     LeaveCriticalSection(&job->spawn_lock);
+ 
+     if (!ok)
+     {
+         if (child->output)
+             CloseHandle(child->output);
+         if (child->input)
+             CloseHandle(child->input);
+         if (child->errors && child->errors != INVALID_HANDLE_VALUE)
+             CloseHandle(child->errors);
+         memset(child, 0, sizeof(*child));
+         return FALSE;
+     }
+ 
+     CloseHandle(pi.hThread);
+     child->process = pi.hProcess;
+     return TRUE;
+ }
+ 
+ /**
+  * Wait for a child to exit and release it. The first error line of its
+  * output is returned when it failed, past the warnings the tools may
+  * start with.
+  */
+ static BOOL finish_child(ChildProcess *child, char *message, size_t size)
+ {
+     DWORD exit_code = 1;
+ 
+     if (child->input)
+         CloseHandle(child->input);
+     WaitForSingleObject(child->process, INFINITE);
+     GetExitCodeProcess(child->process, &exit_code);
+ 
+     if (exit_code != 0 && message && size > 1)
+     {
+         char output[1024], *line = output;
+         DWORD got = 0;
+ 
+         output[0] = '\0';
+         SetFilePointer(child->errors, 0, NULL, FILE_BEGIN);
+         if (ReadFile(child->errors, output, sizeof(output) - 1, &got, NULL))
+             output[got] = '\0';
+         for (;;)
+         {
+             size_t len = strcspn(line, "\r\n");
+             char end = line[len];
+ 
+             line[len] = '\0';
+             if (!end || !strstr(line, "[Warning]"))
+                 break;
+             line += len + 1;
+             line += strspn(line, "\r\n");
+         }
+ 
+         if (line[0])
+             snprintf(message, size, "%s", line);
+         else
+             snprintf(message, size, "exit code %lu", exit_code);
+     }
+ 
+     if (child->output)
+         CloseHandle(child->output);
+     CloseHandle(child->errors);
+     CloseHandle(child->process);
+     memset(child, 0, sizeof(*child));
+     return exit_code == 0;
+ }
+ 
+ /**
+  * Run a command and collect its output
+  */
+ static char *run_capture(DumpJob *job, char *command, char *message, size_t size)
+ {
+     ChildProcess child;
+     char *output;
+     size_t len = 0, capacity = 4096;
+     DWORD got;
+ 
+     if (!start_child(job, command, CHILD_PIPE_OUTPUT, &child))
+     {
+         snprintf(message, size, "cannot start: %s", command);
+         return NULL;
+     }
+ 
+     output = (char *)malloc(capacity);
+     while (output && ReadFile(child.output, output + len, (DWORD)(capacity - len - 1), &got, NULL) && got > 0)
+     {
+         len += got;
+         if (capacity - len < 1024)
+         {
+             char *grown = (char *)realloc(output, capacity * 2);
+             if (!grown)
+             {
+                 free(output);
+                 output = NULL;
+                 break;
+             }
+             output = grown;
+             capacity *= 2;
+         }
+     }
+     if (output)
+         output[len] = '\0';
+ 
+     if (!finish_child(&child, message, size) || !output)
+     {
+         if (!output)
+             snprintf(message, size, "out of memory");
+         free(output);
+         return NULL;
+     }
+     return output;
+ }
+ 
+ /**
+  * Find the command prefix of the MySQL tools: an override, or docker exec
+  * into the mysql container, which starts much faster than docker-compose
+  * exec for every table. Docker is given the name of MYSQL_PWD only and
+  * takes its value from our environment.
+  */
+ static void find_client(DumpJob *job)
+ {
+     const char *pass_env = job->options->password && job->options->password[0] ? " -e " PASSWORD_ENV : "";
+     char command[MAX_COMMAND_LEN], message[256];
+     char *output;
+ 
+     if (job->options->client && job->options->client[0])
+     {
+         strncpy(job->client, job->options->client, sizeof(job->client) - 1);
+         return;
+     }
+     if (GetEnvironmentVariable(DB_DUMP_CLIENT_ENV, job->client, sizeof(job->client)) > 0 &&
+         strlen(job->client) < sizeof(job->client) - 1)
+         return;
+ 
+     snprintf(job->client, sizeof(job->client), "docker-compose exec -T%s " DB_DUMP_SERVICE, pass_env);
+     strcpy(command, "docker-compose ps -q " DB_DUMP_SERVICE);
+     output = run_capture(job, command, message, sizeof(message));
+     if (output)
+     {
+         size_t len = strspn(output, "0123456789abcdef");
+         if (len >= 12 && len < 80)
+             snprintf(job->client, sizeof(job->client), "docker exec -i%s %.*s", pass_env, (int)len, output);
+         free(output);
+     }
+ }
+ 
+ /**
+  * Take the global read lock in a session kept open for the whole dump.
+  * Writers wait, every table dump sees the same state.
+  */
+ static BOOL acquire_read_lock(DumpJob *job, ChildProcess *session)
+ {
+     static const char statements[] = "FLUSH TABLES WITH READ LOCK;\nSELECT 'locked';\n";
+     char command[MAX_COMMAND_LEN], reply[256];
+     DWORD start = GetTickCount(), written;
+     size_t len = 0;
+ 
+     if (!build_command(job, "mysql", command, sizeof(command)) ||
+         !append_arg(command, sizeof(command), "-N") || !start_child(job, command, CHILD_PIPE_INPUT | CHILD_PIPE_OUTPUT, session))
+         return FALSE;
+ 
+     if (WriteFile(session->input, statements, sizeof(statements) - 1, &written, NULL))
+     {
+         while (GetTickCount() - start < LOCK_TIMEOUT && !is_cancelled(job))
+         {
+             DWORD available = 0, got = 0;
+ 
+             if (!PeekNamedPipe(session->output, NULL, 0, NULL, &available, NULL))
+                 break;
+             if (available == 0)
+             {
+                 // The session ended without the lock (no server, no privilege)
+                 if (WaitForSingleObject(session->process, 20) == WAIT_OBJECT_0)
+                     break;
+                 continue;
+             }
+             if (!ReadFile(session->output, reply + len, (DWORD)(sizeof(reply) - 1 - len), &got, NULL) || got == 0)
+                 break;
+             len += got;
+             reply[len] = '\0';
+             if (strstr(reply, "locked"))
+                 return TRUE;
+             if (len == sizeof(reply) - 1)
+                 break;
+         }
+     }
+ 
+     TerminateProcess(session->process, 1);
+     finish_child(session, NULL, 0);
+     return FALSE;
+ }
+ 
+ /**
+  * End the lock session, the server releases the lock with the connection
+  */
+ static void release_read_lock(ChildProcess *session)
+ {
+     finish_child(session, NULL, 0);
+ }
+ 
+ /**
+  * List the base tables of the database, largest first
+  */
+ static BOOL list_tables(DumpJob *job)
+ {
+     char command[MAX_COMMAND_LEN], query[512], message[256];
+     char *output, *line, *next;
+ 
+     // Only plain names: the name is part of an SQL string and file names
+     for (const char *p = job->options->database; *p; p++)
+     {
+         if (!strchr("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_$-", *p))
+         {
+             set_error(job, "Database names may only contain letters, digits, '_', '$' and '-'.");
+             return FALSE;
+         }
+     }
+ 
+     snprintf(query, sizeof(query),
+              "SELECT TABLE_NAME FROM information_schema.TABLES WHERE TABLE_SCHEMA = '%s' "
+              "AND TABLE_TYPE = 'BASE TABLE' ORDER BY DATA_LENGTH + INDEX_LENGTH DESC",
+              job->options->database);
+     if (!build_command(job, "mysql", command, sizeof(command)) || !append_arg(command, sizeof(command), "-N") ||
+         !append_arg(command, sizeof(command), "-B") || !append_arg(command, sizeof(command), "-e") ||
+         !append_arg(command, sizeof(command), query))
+     {
+         set_error(job, "Command line too long.");
+         return FALSE;
+     }
+ 
+     output = run_capture(job, command, message, sizeof(message));
+     if (!output)
+     {
+         char error[320];
+         snprintf(error, sizeof(error), "Cannot list tables: %s", message);
+         set_error(job, error);
+         return FALSE;
+     }
+ 
+     // Entry 0 is the schema
+     job->tables = (char **)calloc(1, sizeof(char *));
+     job->table_count = job->tables ? 1 : 0;
+     for (line = output; job->tables && *line; line = next)
+     {
+         size_t len = strcspn(line, "\r\n");
+         next = line + len;
+         next += strspn(next, "\r\n");
+         if (len == 0)
+             continue;
+ 
+         char **tables = (char **)realloc(job->tables, (job->table_count + 1) * sizeof(char *));
+         char *name = (char *)malloc(len + 1);
+         if (!tables || !name)
+         {
+             free(name);
+             if (tables)
+                 job->tables = tables;
+             break;
+         }
+         memcpy(name, line, len);
+         name[len] = '\0';
+         job->tables = tables;
+         job->tables[job->table_count++] = name;
+     }
+     free(output);
+ 
+     if (!job->tables)
+     {
+         set_error(job, "Out of memory.");
+         return FALSE;
+     }
+     return TRUE;
+ }
+ 
+ static BOOL gzip_open(GzipStream *gz, const char *path, int level)
+ {
+     DWORD written = 0;
+ 
+     memset(gz, 0, sizeof(*gz));
+     gz->level = level;
+     gz->buffer = (BYTE *)malloc(DEFLATE_WINDOW + DUMP_BLOCK_SIZE);
+     if (!gz->buffer || !deflate_work_init(&gz->work))
+     {
+         free(gz->buffer);
+         return FALSE;
+     }
+ 
+     gz->file = CreateFile(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+     if (gz->file == INVALID_HANDLE_VALUE)
+     {
+         deflate_work_free(&gz->work);
+         free(gz->buffer);
+         return FALSE;
+     }
+ 
+     gz->failed = !WriteFile(gz->file, gzip_header, sizeof(gzip_header), &written, NULL) ||
+                  written != sizeof(gzip_header);
+     gz->written = written;
+     return TRUE;
+ }
+ 
+ /**
+  * Compress the buffered input and keep its last window as the dictionary
+  * of the next block
+  */
+ static void gzip_flush(GzipStream *gz, BOOL final)
+ {
+     DWORD written = 0;
+     size_t keep;
+ 
+     if (gz->failed)
+         return;
+     if (!deflate_compress(&gz->work, gz->buffer + DEFLATE_WINDOW - gz->dict_len, gz->dict_len, gz->len,
+                           gz->level, final) ||
+         !WriteFile(gz->file, gz->work.out, (DWORD)gz->work.out_len, &written, NULL) ||
+         written != gz->work.out_len)
+     {
+         gz->failed = TRUE;
+         return;
+     }
+     gz->written += written;
+ 
+     keep = gz->dict_len + gz->len < DEFLATE_WINDOW ? gz->dict_len + gz->len : DEFLATE_WINDOW;
+     memmove(gz->buffer + DEFLATE_WINDOW - keep, gz->buffer + DEFLATE_WINDOW + gz->len - keep, keep);
+     gz->dict_len = keep;
+     gz->len = 0;
+ }
+ 
+ /**
+  * Finish the stream with the gzip trailer (CRC-32 and length modulo 2^32)
+  */
+ static BOOL gzip_close(GzipStream *gz)
+ {
+     BYTE trailer[8];
+     DWORD written = 0;
+ 
+     gzip_flush(gz, TRUE);
+     for (int i = 0; i < 4; i++)
+     {
+         trailer[i] = (BYTE)(gz->crc >> (8 * i));
+         trailer[4 + i] = (BYTE)(gz->size >> (8 * i));
+     }
+     if (!gz->failed && (!WriteFile(gz->file, trailer, sizeof(trailer), &written, NULL) || written != sizeof(trailer)))
+         gz->failed = TRUE;
+     gz->written += written;
+ 
+     CloseHandle(gz->file);
+     deflate_work_free(&gz->work);
+     free(gz->buffer);
+     return !gz->failed;
+ }
+ 
+ /**
+  * Dump one table (NULL for the schema) into <name>.sql.gz: mysqldump's
+  * output is read straight into the compression buffer
+  */
+ static BOOL dump_table(DumpJob *job, const char *table)
+ {
+     char command[MAX_COMMAND_LEN], path[MAX_PATH_LEN], temp_path[MAX_PATH_LEN + 4];
+     char file_name[MAX_PATH_LEN], message[256], error[MAX_PATH_LEN + 320];
+     ChildProcess child;
+     GzipStream gz;
+     LONGLONG reported = 0;
+     BOOL ok, exited, written;
+ 
+     if (table)
+     {
+         // Table names may hold characters Windows does not allow in file names
+         size_t len = 0;
+         for (const char *p = table; *p && len < sizeof(file_name) - sizeof(DB_DUMP_EXTENSION) - 1; p++)
+             file_name[len++] = strchr("\\/:*?\"<>|", *p) || (unsigned char)*p < 32 ? '_' : *p;
+         strcpy(file_name + len, DB_DUMP_EXTENSION);
+     }
+     else
+     {
+         strcpy(file_name, DB_DUMP_SCHEMA_FILE);
+     }
+     snprintf(path, sizeof(path), "%s\\%s", job->dir, file_name);
+     snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+ 
+     // The schema has every CREATE statement, the tables only their rows and triggers
+     ok = build_command(job, "mysqldump", command, sizeof(command));
+     if (table)
+         ok = ok && append_arg(command, sizeof(command), "--single-transaction") &&
+              append_arg(command, sizeof(command), "--quick") &&
+              append_arg(command, sizeof(command), "--skip-lock-tables") &&
+              append_arg(command, sizeof(command), "--no-create-info") &&
+              append_arg(command, sizeof(command), "--hex-blob") &&
+              append_arg(command, sizeof(command), job->options->database) &&
+              append_arg(command, sizeof(command), table);
+     else
+         ok = ok && append_arg(command, sizeof(command), "--no-data") &&
+              append_arg(command, sizeof(command), "--routines") &&
+              append_arg(command, sizeof(command), "--events") &&
+              append_arg(command, sizeof(command), "--skip-triggers") &&
+              append_arg(command, sizeof(command), "--skip-lock-tables") &&
+              append_arg(command, sizeof(command), "--databases") &&
+              append_arg(command, sizeof(command), job->options->database);
+     if (!ok)
+     {
+         set_error(job, "Command line too long.");
+         return FALSE;
+     }
+ 
+     if (!gzip_open(&gz, temp_path, job->options->level))
+     {
+         snprintf(error, sizeof(error), "Cannot create %s (Error: %lu)", temp_path, GetLastError());
+         set_error(job, error);
+         return FALSE;
+     }
+     if (!start_child(job, command, CHILD_PIPE_OUTPUT, &child))
+     {
+         gzip_close(&gz);
+         DeleteFile(temp_path);
+         snprintf(error, sizeof(error), "Cannot start: %s", job->client);
+         set_error(job, error);
+         return FALSE;
+     }
+ 
+     for (;;)
+     {
+         DWORD got = 0;
+ 
+         if (!ReadFile(child.output, gz.buffer + DEFLATE_WINDOW + gz.len, (DWORD)(DUMP_BLOCK_SIZE - gz.len),
+                       &got, NULL) || got == 0)
+             break;
+         gz.crc = deflate_crc32(gz.crc, gz.buffer + DEFLATE_WINDOW + gz.len, got);
+         gz.size += got;
+         gz.len += got;
+         InterlockedExchangeAdd64(&job->progress->bytes_in, got);
+ 
+         if (gz.len == DUMP_BLOCK_SIZE)
+         {
+             gzip_flush(&gz, FALSE);
+             InterlockedExchangeAdd64(&job->progress->bytes_out, gz.written - reported);
+             reported = gz.written;
+         }
+         if (gz.failed || is_cancelled(job))
+         {
+             TerminateProcess(child.process, 1);
+             break;
+         }
+     }
+ 
+     exited = finish_child(&child, message, sizeof(message));
+     written = gzip_close(&gz);
+     InterlockedExchangeAdd64(&job->progress->bytes_out, gz.written - reported);
+ 
+     ok = exited && written && !is_cancelled(job) && MoveFileEx(temp_path, path, MOVEFILE_REPLACE_EXISTING);
+     if (!ok)
+     {
+         DeleteFile(temp_path);
+         if (!is_cancelled(job))
+         {
+             snprintf(error, sizeof(error), "%s: %s", table ? table : "schema",
+                      !written ? "cannot write the dump file" : !exited ? message : "cannot rename the dump file");
+             set_error(job, error);
+         }
+     }
+     return ok;
+ }
+ 
+ /**
+  * Dump worker: takes the next table until none are left
+  */
+ static DWORD WINAPI dump_thread(LPVOID param)
+ {
+     DumpJob *job = (DumpJob *)param;
+ 
+     for (;;)
+     {
+         LONG index = InterlockedIncrement(&job->next_table) - 1;
+ 
+         if (index >= job->table_count || is_cancelled(job))
+             break;
+         if (dump_table(job, job->tables[index]))
+             InterlockedIncrement(&job->progress->tables_done);
+         else
+             InterlockedIncrement(&job->progress->tables_failed);
+     }
+     return 0;
+ }
+ 
+ BOOL db_dump_database(const DbDumpOptions *options, const char *target_dir, DbDumpProgress *progress,
+                       char *error, size_t error_size)
+ {
+     DumpJob job;
+     ChildProcess session;
+     HANDLE threads[DB_DUMP_MAX_THREADS];
+     int thread_count = 0;
+     int threads_wanted = options->threads > 0 ? options->threads : DB_DUMP_DEFAULT_THREADS;
+     BOOL locked = FALSE;
+     BOOL ready;
+ 
+     memset(&job, 0, sizeof(job));
+     job.options = options;
+     job.dir = target_dir;
+     job.progress = progress;
+     job.error = error;
+     job.error_size = error_size;
+     if (error && error_size)
+         error[0] = '\0';
+     InitializeCriticalSection(&job.lock);
+     InitializeCriticalSection(&job.spawn_lock);
+ 
+     find_client(&job);
+     ready = build_environment(&job);
+     if (!ready)
+         set_error(&job, "Out of memory.");
+ 
+     // Lock first, so the table list belongs to the same moment as the data
+     if (ready && options->consistent)
+         locked = acquire_read_lock(&job, &session);
+ 
+     if (ready && list_tables(&job))
+     {
+         progress->tables_total = job.table_count;
+         if (threads_wanted > DB_DUMP_MAX_THREADS)
+             threads_wanted = DB_DUMP_MAX_THREADS;
+         if (threads_wanted > job.table_count)
+             threads_wanted = job.table_count;
+ 
+         for (int i = 0; i < threads_wanted; i++)
+         {
+             HANDLE thread = CreateThread(NULL, 0, dump_thread, &job, 0, NULL);
+             if (thread)
+                 threads[thread_count++] = thread;
+         }
+         if (thread_count == 0)
+             dump_thread(&job);
+         else
+             WaitForMultipleObjects(thread_count, threads, TRUE, INFINITE);
+ 
+         for (int i = 0; i < thread_count; i++)
+             CloseHandle(threads[i]);
+     }
+ 
+     if (locked)
+         release_read_lock(&session);
+     progress->consistent = locked;
+ 
+     for (int i = 0; i < job.table_count; i++)
+         free(job.tables[i]);
+     free(job.tables);
+     free(job.environment);
+     DeleteCriticalSection(&job.lock);
+     DeleteCriticalSection(&job.spawn_lock);
+ 
+     return job.table_count > 0 && progress->tables_done == job.table_count && !is_cancelled(&job);
+ }
+ 
+ BOOL db_dump_remove(const char *dir)
+ {
+     char search_path[MAX_PATH_LEN], file[MAX_PATH_LEN];
+     WIN32_FIND_DATA fd;
+     HANDLE hFind;
+ 
+     snprintf(search_path, sizeof(search_path), "%s\\*", dir);
+     hFind = FindFirstFile(search_path, &fd);
+     if (hFind != INVALID_HANDLE_VALUE)
+     {
+         do
+         {
+             if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+                 continue;
+             snprintf(file, sizeof(file), "%s\\%s", dir, fd.cFileName);
+             DeleteFile(file);
+         } while (FindNextFile(hFind, &fd));
+         FindClose(hFind);
+     }
+     return RemoveDirectory(dir);
+ }
+ 
+ 
+ /**
+  * Collect the start of a schema file, stops once the USE statement is in
+  */
+ static BOOL peek_schema(void *context, const BYTE *data, size_t len)
+ {
+     SchemaPeek *peek = (SchemaPeek *)context;
+     size_t room = sizeof(peek->text) - 1 - peek->len;
+ 
+     if (len > room)
+         len = room;
+     memcpy(peek->text + peek->len, data, len);
+     peek->len += len;
+     peek->text[peek->len] = '\0';
+ 
+     const char *use = strstr(peek->text, "\nUSE `");
+     return peek->len < sizeof(peek->text) - 1 && !(use && strchr(use + 6, '`'));
+ }
+ 
+ /**
+  * Read the database name of a dump from "USE `name`;" in its schema file
+  */
+ static BOOL read_dump_database(DumpJob *job)
+ {
+     char path[MAX_PATH_LEN];
+     SchemaPeek *peek = (SchemaPeek *)calloc(1, sizeof(SchemaPeek));
+     const char *name, *end;
+     HANDLE file;
+ 
+     snprintf(path, sizeof(path), "%s\\%s", job->dir, DB_DUMP_SCHEMA_FILE);
+     file = CreateFile(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+     if (!peek || file == INVALID_HANDLE_VALUE)
+     {
+         free(peek);
+         if (file != INVALID_HANDLE_VALUE)
+             CloseHandle(file);
+         return FALSE;
+     }
+ 
+     // Stopping early makes the decompression report a failure, the text is what counts
+     inflate_gzip_file(file, peek_schema, peek, NULL);
+     CloseHandle(file);
+ 
+     name = strstr(peek->text, "\nUSE `");
+     end = name ? strchr(name + 6, '`') : NULL;
+     if (end && end - (name + 6) > 0 && (size_t)(end - (name + 6)) < sizeof(job->database))
+     {
+         memcpy(job->database, name + 6, end - (name + 6));
+         job->database[end - (name + 6)] = '\0';
+     }
+     free(peek);
+     return job->database[0] != '\0';
+ }
+ 
+ static int compare_dump_files(const void *a, const void *b)
+ {
+     ULONGLONG size_a = ((const DumpFile *)a)->size;
+     ULONGLONG size_b = ((const DumpFile *)b)->size;
+ 
+     return size_a < size_b ? 1 : size_a > size_b ? -1 : 0;
+ }
+ 
+ /**
+  * List the table files of a dump, largest first; entry 0 is NULL and
+  * stands for the schema as in a dump
+  */
+ static BOOL list_dump_files(DumpJob *job)
+ {
+     char search_path[MAX_PATH_LEN];
+     WIN32_FIND_DATA fd;
+     DumpFile *files = NULL;
+     int count = 0;
+     HANDLE hFind;
+     BOOL ok = TRUE;
+ 
+     snprintf(search_path, sizeof(search_path), "%s\\*%s", job->dir, DB_DUMP_EXTENSION);
+     hFind = FindFirstFile(search_path, &fd);
+     if (hFind != INVALID_HANDLE_VALUE)
+     {
+         do
+         {
+             if ((fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) || _stricmp(fd.cFileName, DB_DUMP_SCHEMA_FILE) == 0)
+                 continue;
+ 
+             DumpFile *grown = (DumpFile *)realloc(files, (count + 1) * sizeof(DumpFile));
+             char *name = _strdup(fd.cFileName);
+             if (!grown || !name)
+             {
+                 free(name);
+                 if (grown)
+                     files = grown;
+                 ok = FALSE;
+                 break;
+             }
+             files = grown;
+             files[count].name = name;
+             files[count].size = ((ULONGLONG)fd.nFileSizeHigh << 32) | fd.nFileSizeLow;
+             count++;
+         } while (FindNextFile(hFind, &fd));
+         FindClose(hFind);
+     }
+ 
+     if (count > 0)
+         qsort(files, count, sizeof(DumpFile), compare_dump_files);
+ 
+     job->tables = ok ? (char **)calloc(count + 1, sizeof(char *)) : NULL;
+     for (int i = 0; i < count; i++)
+     {
+         if (job->tables)
+             job->tables[i + 1] = files[i].name;
+         else
+             free(files[i].name);
+     }
+     free(files);
+ 
+     if (!job->tables)
+     {
+         set_error(job, "Out of memory.");
+         return FALSE;
+     }
+     job->table_count = count + 1;
+     return TRUE;
+ }
+ 
+ /**
+  * Load the journal of an interrupted restore: the files already replayed
+  */
+ static void load_journal(DumpJob *job)
+ {
+     char path[MAX_PATH_LEN], line[MAX_PATH_LEN];
+     FILE *f;
+ 
+     snprintf(path, sizeof(path), "%s\\%s", job->dir, DB_DUMP_JOURNAL_FILE);
+     f = fopen(path, "r");
+     if (!f)
+         return;
+ 
+     while (fgets(line, sizeof(line), f))
+     {
+         line[strcspn(line, "\r\n")] = '\0';
+         if (!line[0])
+             continue;
+ 
+         char **grown = (char **)realloc(job->restored, (job->restored_count + 1) * sizeof(char *));
+         char *name = _strdup(line);
+         if (!grown || !name)
+         {
+             free(name);
+             if (grown)
+                 job->restored = grown;
+             break;
+         }
+         job->restored = grown;
+         job->restored[job->restored_count++] = name;
+     }
+     fclose(f);
+ }
+ 
+ static BOOL is_journaled(const DumpJob *job, const char *file_name)
+ {
+     for (int i = 0; i < job->restored_count; i++)
+     {
+         if (_stricmp(job->restored[i], file_name) == 0)
+             return TRUE;
+     }
+     return FALSE;
+ }
+ 
+ /**
+  * Record a replayed file, a restarted restore skips it
+  */
+ static void add_to_journal(DumpJob *job, const char *file_name)
+ {
+     char path[MAX_PATH_LEN];
+     FILE *f;
+ 
+     snprintf(path, sizeof(path), "%s\\%s", job->dir, DB_DUMP_JOURNAL_FILE);
+     EnterCriticalSection(&job->lock);
+     f = fopen(path, "a");
+     if (f)
+     {
+         fprintf(f, "%s\n", file_name);
+         fclose(f);
+     }
+     LeaveCriticalSection(&job->lock);
+ }
+ 
+ static BOOL replay_write(ReplayStream *stream, const void *data, size_t len)
+ {
+     DWORD written = 0;
+ 
+     if (!WriteFile(stream->input, data, (DWORD)len, &written, NULL) || written != len)
+         return FALSE;
+     InterlockedExchangeAdd64(&stream->job->progress->bytes_out, len);
+     return TRUE;
+ }
+ 
+ /**
+  * Release the held start of a file, behind a TRUNCATE of the table its
+  * first INSERT names. File names cannot be used: they lose the characters
+  * Windows does not allow. A file without rows has nothing to undo.
+  */
+ static BOOL replay_release(ReplayStream *stream)
+ {
+     const char *insert = strstr(stream->held, "INSERT INTO `");
+     const char *end = NULL;
+     BOOL ok = TRUE;
+ 
+     // Backticks inside the name are doubled
+     if (insert)
+     {
+         insert += 13;
+         for (end = insert; *end && !(end[0] == '`' && end[1] != '`'); end += end[0] == '`' ? 2 : 1)
+             ;
+     }
+     if (end && *end && end - insert < MAX_PATH_LEN)
+     {
+         char statements[MAX_PATH_LEN + 64];
+ 
+         snprintf(statements, sizeof(statements), "SET FOREIGN_KEY_CHECKS=0;\nTRUNCATE TABLE `%.*s`;\n",
+                  (int)(end - insert), insert);
+         ok = replay_write(stream, statements, strlen(statements));
+     }
+ 
+     ok = ok && replay_write(stream, stream->held, stream->held_len);
+     free(stream->held);
+     stream->held = NULL;
+     return ok;
+ }
+ 
+ /**
+  * Pass decompressed SQL on to the client
+  */
+ static BOOL replay_output(void *context, const BYTE *data, size_t len)
+ {
+     ReplayStream *stream = (ReplayStream *)context;
+ 
+     if (is_cancelled(stream->job))
+         return FALSE;
+     if (!stream->held)
+         return replay_write(stream, data, len);
+ 
+     size_t take = SCHEMA_PEEK_SIZE - 1 - stream->held_len;
+     if (take > len)
+         take = len;
+     memcpy(stream->held + stream->held_len, data, take);
+     stream->held_len += take;
+     stream->held[stream->held_len] = '\0';
+ 
+     // Held until the first INSERT is complete or the buffer is full
+     const char *insert = strstr(stream->held, "INSERT INTO `");
+     if ((!insert || !strchr(insert, '\n')) && stream->held_len < SCHEMA_PEEK_SIZE - 1)
+         return TRUE;
+     return replay_release(stream) && (take == len || replay_write(stream, data + take, len - take));
+ }
+ 
+ /**
+  * Replay one dump file (NULL for the schema) through the mysql client.
+  * A table that an interrupted run had started is emptied first.
+  */
+ static BOOL replay_file(DumpJob *job, const char *file_name)
+ {
+     char command[MAX_COMMAND_LEN], path[MAX_PATH_LEN], message[256], error[MAX_PATH_LEN + 320];
+     const char *name = file_name ? file_name : DB_DUMP_SCHEMA_FILE;
+     ChildProcess child;
+     ReplayStream stream;
+     HANDLE file;
+     BOOL ok, inflated, exited;
+ 
+     message[0] = '\0';
+     snprintf(path, sizeof(path), "%s\\%s", job->dir, name);
+     file = CreateFile(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+     if (file == INVALID_HANDLE_VALUE)
+     {
+         snprintf(error, sizeof(error), "Cannot open %s (Error: %lu)", path, GetLastError());
+         set_error(job, error);
+         return FALSE;
+     }
+ 
+     // The schema creates the database itself, table data goes into it
+     ok = build_command(job, "mysql", command, sizeof(command)) &&
+          (!file_name || append_arg(command, sizeof(command), job->database));
+     if (!ok || !start_child(job, command, CHILD_PIPE_INPUT, &child))
+     {
+         CloseHandle(file);
+         snprintf(error, sizeof(error), "Cannot start: %s", job->client);
+         set_error(job, error);
+         return FALSE;
+     }
+ 
+     // A table that an interrupted run had started is emptied first
+     stream.job = job;
+     stream.input = child.input;
+     stream.held = file_name && job->restored_count > 0 ? (char *)malloc(SCHEMA_PEEK_SIZE) : NULL;
+     stream.held_len = 0;
+     if (stream.held)
+         stream.held[0] = '\0';
+     inflated = inflate_gzip_file(file, replay_output, &stream, &job->progress->bytes_in);
+     if (stream.held)
+         inflated = replay_release(&stream) && inflated;
+     CloseHandle(file);
+     if (!inflated)
+         TerminateProcess(child.process, 1);
+ 
+     // Closing stdin lets the client finish the last statement and exit
+     exited = finish_child(&child, message, sizeof(message));
+     ok = inflated && exited && !is_cancelled(job);
+     if (!ok && !is_cancelled(job))
+     {
+         snprintf(error, sizeof(error), "%s: %s", name,
+                  !exited && message[0] ? message : "the dump file is damaged");
+         set_error(job, error);
+     }
+     return ok;
+ }
+ 
+ /**
+  * Replay worker: takes the next table file until none are left
+  */
+ static DWORD WINAPI replay_thread(LPVOID param)
+ {
+     DumpJob *job = (DumpJob *)param;
+ 
+     for (;;)
+     {
+         LONG index = InterlockedIncrement(&job->next_table) - 1;
+ 
+         if (index >= job->table_count || is_cancelled(job))
+             break;
+         if (is_journaled(job, job->tables[index]))
+         {
+             InterlockedIncrement(&job->progress->tables_done);
+         }
+         else if (replay_file(job, job->tables[index]))
+         {
+             add_to_journal(job, job->tables[index]);
+             InterlockedIncrement(&job->progress->tables_done);
+         }
+         else
+         {
+             InterlockedIncrement(&job->progress->tables_failed);
+         }
+     }
+     return 0;
+ }
+ 
+ BOOL db_restore_database(const DbDumpOptions *options, const char *dump_dir, DbDumpProgress *progress,
+                          char *error, size_t error_size)
+ {
+     DumpJob job;
+     HANDLE threads[DB_DUMP_MAX_THREADS];
+     int thread_count = 0;
+     int threads_wanted = options->threads > 0 ? options->threads : DB_DUMP_DEFAULT_THREADS;
+     BOOL ok = FALSE;
+ 
+     memset(&job, 0, sizeof(job));
+     job.options = options;
+     job.dir = dump_dir;
+     job.progress = progress;
+     job.error = error;
+     job.error_size = error_size;
+     if (error && error_size)
+         error[0] = '\0';
+     InitializeCriticalSection(&job.lock);
+     InitializeCriticalSection(&job.spawn_lock);
+ 
+     if (!read_dump_database(&job))
+         set_error(&job, "The dump has no schema file naming its database.");
+     else if (!build_environment(&job))
+         set_error(&job, "Out of memory.");
+     else if (list_dump_files(&job))
+     {
+         find_client(&job);
+         load_journal(&job);
+         progress->tables_total = job.table_count;
+ 
+         // Tables are created by the schema, so it goes first and alone
+         if (is_journaled(&job, DB_DUMP_SCHEMA_FILE))
+             InterlockedIncrement(&progress->tables_done);
+         else if (replay_file(&job, NULL))
+         {
+             add_to_journal(&job, DB_DUMP_SCHEMA_FILE);
+             InterlockedIncrement(&progress->tables_done);
+         }
+         else
+         {
+             InterlockedIncrement(&progress->tables_failed);
+             job.next_table = job.table_count;
+         }
+ 
+         if (job.next_table == 0)
+         {
+             job.next_table = 1;
+             if (threads_wanted > DB_DUMP_MAX_THREADS)
+                 threads_wanted = DB_DUMP_MAX_THREADS;
+             if (threads_wanted > job.table_count - 1)
+                 threads_wanted = job.table_count - 1;
+ 
+             for (int i = 0; i < threads_wanted; i++)
+             {
+                 HANDLE thread = CreateThread(NULL, 0, replay_thread, &job, 0, NULL);
+                 if (thread)
+                     threads[thread_count++] = thread;
+             }
+             if (thread_count == 0)
+                 replay_thread(&job);
+             else
+                 WaitForMultipleObjects(thread_count, threads, TRUE, INFINITE);
+             for (int i = 0; i < thread_count; i++)
+                 CloseHandle(threads[i]);
+         }
+ 
+         // A complete restore starts from scratch next time
+         ok = progress->tables_done == job.table_count && !is_cancelled(&job);
+         if (ok)
+         {
+             char path[MAX_PATH_LEN];
+             snprintf(path, sizeof(path), "%s\\%s", dump_dir, DB_DUMP_JOURNAL_FILE);
+             DeleteFile(path);
+         }
+     }
+ 
+     for (int i = 0; i < job.table_count; i++)
+         free(job.tables[i]);
+     free(job.tables);
+     for (int i = 0; i < job.restored_count; i++)
+         free(job.restored[i]);
+     free(job.restored);
+     free(job.environment);
+     DeleteCriticalSection(&job.lock);
+     DeleteCriticalSection(&job.spawn_lock);
+     return ok;
+ }
\ No newline at end of file
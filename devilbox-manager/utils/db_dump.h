@@ -0,0 +1,96 @@
+/*******************************************************************************
+ * Database Dump Module Header
+ * Parallel per-table dumps of a database in the devilbox mysql service,
+ * every table streamed through mysqldump into its own gzip file, and
+ * their parallel replay through the mysql client
+ *******************************************************************************/
+#ifndef DB_DUMP_H
+#define DB_DUMP_H
+
+#include <windows.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// docker-compose service running MySQL or MariaDB
+#define DB_DUMP_SERVICE "mysql"
+
+// Replaces the command the MySQL tools are run through, e.g. a stand-in client for tests
+#define DB_DUMP_CLIENT_ENV "DEVILBOX_DB_CLIENT"
+
+// One file per table plus the schema (tables, views, routines and events without data)
+#define DB_DUMP_EXTENSION ".sql.gz"
+#define DB_DUMP_SCHEMA_FILE "_schema" DB_DUMP_EXTENSION
+
+// Files of a dump already replayed, lets an interrupted restore resume
+#define DB_DUMP_JOURNAL_FILE ".restored"
+
+// Tables dumped at once
+#define DB_DUMP_DEFAULT_THREADS 4
+#define DB_DUMP_MAX_THREADS 16
+
+// Dump parameters
+typedef struct
+{
+    const char *devilbox_path;  // Directory of docker-compose.yml
+    const char *database;
+    const char *password;       // MYSQL_ROOT_PASSWORD (may be empty)
+    const char *client;         // Command prefix of the MySQL tools, NULL to find the mysql container
+    int threads;                // 0 for DB_DUMP_DEFAULT_THREADS
+    int level;                  // gzip level 1-9
+    BOOL consistent;            // Hold a global read lock so all tables show the same moment
+} DbDumpOptions;
+
+// Progress of a dump or restore, updated while db_dump_database or db_restore_database runs
+typedef struct
+{
+    volatile LONG tables_total;
+    volatile LONG tables_done;
+    volatile LONG tables_failed;
+    volatile LONGLONG bytes_in;    // SQL text received (restore: gzip data read)
+    volatile LONGLONG bytes_out;   // gzip data written (restore: SQL text sent)
+    volatile LONG *cancelled;      // Stops the dump when set (may be NULL)
+    BOOL consistent;               // The read lock was held for the whole dump
+} DbDumpProgress;
+
+/**
+ * Dump a database into a directory, one gzip file per table. The largest
+ * tables are started first so the workers finish close together.
+ * @param options Dump parameters
+ * @param target_dir Directory receiving the files (must exist)
+ * @param progress Progress to update
+ * @param error Receives the first error (may be NULL)
+ * @param error_size Size of the error buffer
+ * @return TRUE if the schema and every table were dumped
+ */
+BOOL db_dump_database(const DbDumpOptions *options, const char *target_dir, DbDumpProgress *progress,
+                      char *error, size_t error_size);
+
+/**
+ * Delete a dump directory and the files in it
+ * @param dir Directory written by db_dump_database
+ * @return TRUE if the directory is gone
+ */
+BOOL db_dump_remove(const char *dir);
+
+/**
+ * Replay a dump into the database it was taken from: the schema first,
+ * then the tables in parallel, largest first. Replayed files are recorded
+ * in DB_DUMP_JOURNAL_FILE so a cancelled or failed restore resumes where
+ * it stopped; tables it had started are emptied and replayed again.
+ * @param options Connection parameters (database and level are unused)
+ * @param dump_dir Directory written by db_dump_database
+ * @param progress Progress to update
+ * @param error Receives the first error (may be NULL)
+ * @param error_size Size of the error buffer
+ * @return TRUE if the schema and every table were replayed
+ */
+BOOL db_restore_database(const DbDumpOptions *options, const char *dump_dir, DbDumpProgress *progress,
+                         char *error, size_t error_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DB_DUMP_H */
\ No newline at end of file
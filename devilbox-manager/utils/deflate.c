@@ -0,0 +1,1432 @@
+/*******************************************************************************
+ * Deflate Module Implementation
+ * LZ77 with hash chains and lazy matching, dynamic/fixed/stored block
+ * selection per block, and a slice-by-8 CRC-32
+ *******************************************************************************/
+
+ #include "deflate.h"
+ #include <stdlib.h>
+ #include <string.h>
+ 
+ #define WINDOW_MASK (DEFLATE_WINDOW - 1)
+ #define HASH_BITS 15
+ #define HASH_SIZE (1 << HASH_BITS)
+ #define MIN_MATCH 3
+ #define MAX_MATCH 258
+ 
+ // Symbols per deflate block, each block gets its own Huffman codes
+ #define BLOCK_SYMBOLS 16384
+ 
+ #define LITERALS 286
+ #define DISTANCES 30
+ #define CODE_LENGTHS 19
+ #define END_OF_BLOCK 256
+ 
+ // Match finder settings per compression level
+ typedef struct
+ {
+     int chain;  // Hash chain entries to follow
+     int nice;   // Stop searching at this match length
+     BOOL lazy;  // Try a longer match at the next position
+ } LevelConfig;
+ 
+ static const LevelConfig levels[10] = {
+     {4, 8, FALSE},    // 0 is treated as 1
+     {4, 8, FALSE},
+     {8, 16, FALSE},
+     {16, 32, FALSE},
+     {32, 32, TRUE},
+     {64, 64, TRUE},
+     {128, 128, TRUE},
+     {256, 128, TRUE},
+     {1024, 258, TRUE},
+     {4096, 258, TRUE},
+ };
+ 
+ static const unsigned short length_base[29] = {
+     3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+     35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+ static const BYTE length_extra[29] = {
+     0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+     3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+ static const unsigned short dist_base[30] = {
+     1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+     257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+ static const BYTE dist_extra[30] = {
+     0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+     7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+ static const BYTE code_length_order[CODE_LENGTHS] = {
+     16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+ 
+ // Lookup tables, built once
+ static BYTE length_code[MAX_MATCH + 1];   // Match length -> length code index
+ static BYTE dist_code[512];               // See get_dist_code
+ static DWORD crc_table[8][256];
+ static BYTE fixed_lit_lengths[288];
+ static BYTE fixed_dist_lengths[DISTANCES];
+ static unsigned short fixed_lit_codes[288];
+ static unsigned short fixed_dist_codes[DISTANCES];
+ static volatile LONG tables_state = 0;
+ 
+ // Output bit stream (deflate writes bits LSB first)
+ typedef struct
+ {
+     BYTE *out;
+     size_t len;
+     size_t capacity;
+     ULONGLONG bits;
+     int count;
+     BOOL overflow;
+ } BitWriter;
+ 
+ // Huffman codes of one block
+ typedef struct
+ {
+     BYTE lit_lengths[LITERALS];
+     BYTE dist_lengths[DISTANCES];
+     unsigned short lit_codes[LITERALS];
+     unsigned short dist_codes[DISTANCES];
+     int hlit;
+     int hdist;
+     int hclen;
+     BYTE cl_lengths[CODE_LENGTHS];
+     unsigned short cl_codes[CODE_LENGTHS];
+     BYTE rle[LITERALS + DISTANCES];
+     BYTE rle_extra[LITERALS + DISTANCES];
+     int rle_count;
+ } BlockCodes;
+ 
+ // Forward declarations of internal functions
+ static void init_tables(void);
+ static int get_dist_code(int dist);
+ static void put_bits(BitWriter *bw, unsigned int value, int count);
+ static void align_bits(BitWriter *bw);
+ static unsigned short reverse_bits(unsigned short code, int length);
+ static int huffman_depths(const unsigned int *freq, int n, BYTE *lengths);
+ static void build_lengths(const unsigned int *freq, int n, int limit, BYTE *lengths);
+ static void build_codes(const BYTE *lengths, int n, unsigned short *codes);
+ static ULONGLONG build_block_codes(BlockCodes *codes, const unsigned int *lit_freq, const unsigned int *dist_freq);
+ static void emit_block(BitWriter *bw, const unsigned int *symbols, int count, const BYTE *data,
+                        size_t len, BOOL final);
+ static int find_match(const BYTE *buffer, int pos, int end, const int *head, const int *prev,
+                       const LevelConfig *config, int *dist);
+ 
+ /**
+  * Build the lookup tables on first use (safe to call from several threads)
+  */
+ static void init_tables(void)
+ {
+     if (tables_state == 2)
+         return;
+ 
+     if (InterlockedCompareExchange(&tables_state, 1, 0) != 0)
+     {
+         while (tables_state != 2)
+             Sleep(0);
+         return;
+     }
+ 
+     for (int code = 0; code < 29; code++)
+     {
+         int last = code < 28 ? length_base[code + 1] : MAX_MATCH + 1;
+         for (int len = length_base[code]; len < last && len <= MAX_MATCH; len++)
+             length_code[len] = (BYTE)code;
+     }
+     length_code[MAX_MATCH] = 28;
+ 
+     // Distances up to 256 directly, larger ones in steps of 128
+     for (int code = 0; code < DISTANCES; code++)
+     {
+         for (int d = dist_base[code]; d < dist_base[code] + (1 << dist_extra[code]); d++)
+         {
+             if (d <= 256)
+                 dist_code[d - 1] = (BYTE)code;
+             else
+                 dist_code[256 + ((d - 1) >> 7)] = (BYTE)code;
+         }
+     }
+ 
+     for (int n = 0; n < 256; n++)
+     {
+         DWORD c = (DWORD)n;
+         for (int k = 0; k < 8; k++)
+             c = c & 1 ? 0xEDB88320UL ^ (c >> 1) : c >> 1;
+         crc_table[0][n] = c;
+     }
+     for (int n = 0; n < 256; n++)
+     {
+         for (int t = 1; t < 8; t++)
+             crc_table[t][n] = (crc_table[t - 1][n] >> 8) ^ crc_table[0][crc_table[t - 1][n] & 0xff];
+     }
+ 
+     for (int n = 0; n < 288; n++)
+         fixed_lit_lengths[n] = n < 144 ? 8 : n < 256 ? 9 : n < 280 ? 7 : 8;
+     for (int n = 0; n < DISTANCES; n++)
+         fixed_dist_lengths[n] = 5;
+     build_codes(fixed_lit_lengths, 288, fixed_lit_codes);
+     build_codes(fixed_dist_lengths, DISTANCES, fixed_dist_codes);
+ 
+     InterlockedExchange(&tables_state, 2);
+ }
+ 
+ /**
+  * Distance code of a match distance (1-32768)
+  */
+ static int get_dist_code(int dist)
+ {
+     return dist <= 256 ? dist_code[dist - 1] : dist_code[256 + ((dist - 1) >> 7)];
+ }
+ 
+ /**
+  * Append bits to the output
+  */
+ static void put_bits(BitWriter *bw, unsigned int value, int count)
+ {
+     bw->bits |= (ULONGLONG)value << bw->count;
+     bw->count += count;
+ 
+     while (bw->count >= 8)
+     {
+         if (bw->len < bw->capacity)
+             bw->out[bw->len++] = (BYTE)bw->bits;
+         else
+             bw->overflow = TRUE;
+         bw->bits >>= 8;
+         bw->count -= 8;
+     }
+ }
+ 
+ /**
+  * Pad the output to a byte boundary
+  */
+ static void align_bits(BitWriter *bw)
+ {
+     if (bw->count > 0)
+         put_bits(bw, 0, 8 - bw->count);
+ }
+ 
+ /**
+  * Reverse a Huffman code (deflate sends codes MSB first inside an LSB first stream)
+  */
+ static unsigned short reverse_bits(unsigned short code, int length)
+ {
+     unsigned short result = 0;
+ 
+     while (length-- > 0)
+     {
+         result = (unsigned short)((result << 1) | (code & 1));
+         code >>= 1;
+     }
+ 
+     return result;
+ }
+ 
+ /**
+  * Huffman code lengths without a length limit, returns the longest length
+  */
+ static int huffman_depths(const unsigned int *freq, int n, BYTE *lengths)
+ {
+     int leaves[288];
+     unsigned int weight[576];
+     int parent[576];
+     int depth[576];
+     int count = 0;
+     int max_depth = 0;
+ 
+     for (int i = 0; i < n; i++)
+     {
+         lengths[i] = 0;
+         if (!freq[i])
+             continue;
+ 
+         // Insertion sort by frequency, alphabets are small
+         int j = count++;
+         while (j > 0 && freq[leaves[j - 1]] > freq[i])
+         {
+             leaves[j] = leaves[j - 1];
+             j--;
+         }
+         leaves[j] = i;
+     }
+ 
+     for (int i = 0; i < count; i++)
+         weight[i] = freq[leaves[i]];
+ 
+     // Two queues: sorted leaves and internal nodes (created in ascending weight order)
+     int next_leaf = 0, next_node = count, nodes = count;
+     for (int k = 0; k < count - 1; k++)
+     {
+         int pick[2];
+         for (int m = 0; m < 2; m++)
+         {
+             if (next_leaf < count && (next_node >= nodes || weight[next_leaf] <= weight[next_node]))
+                 pick[m] = next_leaf++;
+             else
+                 pick[m] = next_node++;
+         }
+         weight[nodes] = weight[pick[0]] + weight[pick[1]];
+         parent[pick[0]] = nodes;
+         parent[pick[1]] = nodes;
+         nodes++;
+     }
+ 
+     depth[nodes - 1] = 0;
+     for (int i = nodes - 2; i >= 0; i--)
+         depth[i] = depth[parent[i]] + 1;
+ 
+     for (int i = 0; i < count; i++)
+     {
+         lengths[leaves[i]] = (BYTE)depth[i];
+         if (depth[i] > max_depth)
+             max_depth = depth[i];
+     }
+ 
+     return max_depth;
+ }
+ 
+ /**
+  * Length-limited Huffman code lengths: frequencies are flattened until the
+  * longest code fits, which costs little since it only happens for rare symbols
+  */
+ static void build_lengths(const unsigned int *freq, int n, int limit, BYTE *lengths)
+ {
+     unsigned int f[288];
+     int used = 0;
+ 
+     for (int i = 0; i < n; i++)
+     {
+         f[i] = freq[i];
+         if (f[i])
+             used++;
+     }
+ 
+     // A complete code needs at least two symbols
+     for (int i = 0; used < 2 && i < n; i++)
+     {
+         if (!f[i])
+         {
+             f[i] = 1;
+             used++;
+         }
+     }
+ 
+     while (huffman_depths(f, n, lengths) > limit)
+     {
+         for (int i = 0; i < n; i++)
+         {
+             if (f[i])
+                 f[i] = (f[i] >> 1) | 1;
+         }
+     }
+ }
+ 
+ /**
+  * Canonical Huffman codes from code lengths (bit reversed for output)
+  */
+ static void build_codes(const BYTE *lengths, int n, unsigned short *codes)
+ {
+     unsigned short bl_count[16] = {0};
+     unsigned short next_code[16];
+     unsigned short code = 0;
+ 
+     for (int i = 0; i < n; i++)
+         bl_count[lengths[i]]++;
+     bl_count[0] = 0;
+ 
+     for (int bits = 1; bits < 16; bits++)
+     {
+         code = (unsigned short)((code + bl_count[bits - 1]) << 1);
+         next_code[bits] = code;
+     }
+ 
+     for (int i = 0; i < n; i++)
+         codes[i] = lengths[i] ? reverse_bits(next_code[lengths[i]]++, lengths[i]) : 0;
+ }
+ 
+ /**
+  * Build the dynamic Huffman codes of a block, returns the size of the tree header in bits
+  */
+ static ULONGLONG build_block_codes(BlockCodes *codes, const unsigned int *lit_freq, const unsigned int *dist_freq)
+ {
+     BYTE all[LITERALS + DISTANCES];
+     unsigned int cl_freq[CODE_LENGTHS] = {0};
+     ULONGLONG bits;
+     int n, total;
+ 
+     build_lengths(lit_freq, LITERALS, 15, codes->lit_lengths);
+     build_lengths(dist_freq, DISTANCES, 15, codes->dist_lengths);
+     build_codes(codes->lit_lengths, LITERALS, codes->lit_codes);
+     build_codes(codes->dist_lengths, DISTANCES, codes->dist_codes);
+ 
+     for (codes->hlit = LITERALS; codes->hlit > 257 && !codes->lit_lengths[codes->hlit - 1]; codes->hlit--)
+         ;
+     for (codes->hdist = DISTANCES; codes->hdist > 1 && !codes->dist_lengths[codes->hdist - 1]; codes->hdist--)
+         ;
+ 
+     memcpy(all, codes->lit_lengths, codes->hlit);
+     memcpy(all + codes->hlit, codes->dist_lengths, codes->hdist);
+     total = codes->hlit + codes->hdist;
+ 
+     // Run-length encode the code lengths (16 = repeat previous, 17/18 = runs of zeros)
+     codes->rle_count = 0;
+     for (int i = 0; i < total;)
+     {
+         BYTE len = all[i];
+         int run = 1;
+         while (i + run < total && all[i + run] == len)
+             run++;
+ 
+         if (len == 0 && run >= 3)
+         {
+             n = run > 138 ? 138 : run;
+             codes->rle[codes->rle_count] = n >= 11 ? 18 : 17;
+             codes->rle_extra[codes->rle_count++] = (BYTE)(n >= 11 ? n - 11 : n - 3);
+             i += n;
+         }
+         else if (len != 0 && run >= 4)
+         {
+             codes->rle[codes->rle_count] = len;
+             codes->rle_extra[codes->rle_count++] = 0;
+             i++;
+             run--;
+             while (run >= 3)
+             {
+                 n = run > 6 ? 6 : run;
+                 codes->rle[codes->rle_count] = 16;
+                 codes->rle_extra[codes->rle_count++] = (BYTE)(n - 3);
+                 i += n;
+                 run -= n;
+             }
+         }
+         else
+         {
+             codes->rle[codes->rle_count] = len;
+             codes->rle_extra[codes->rle_count++] = 0;
+             i++;
+         }
+     }
+ 
+     for (int i = 0; i < codes->rle_count; i++)
+         cl_freq[codes->rle[i]]++;
+ 
+     build_lengths(cl_freq, CODE_LENGTHS, 7, codes->cl_lengths);
+     build_codes(codes->cl_lengths, CODE_LENGTHS, codes->cl_codes);
+ 
+     for (codes->hclen = CODE_LENGTHS; codes->hclen > 4 && !codes->cl_lengths[code_length_order[codes->hclen - 1]];
+          codes->hclen--)
+         ;
+ 
+     bits = 5 + 5 + 4 + 3 * codes->hclen;
+     for (int i = 0; i < codes->rle_count; i++)
+     {
+         BYTE sym = codes->rle[i];
+         bits += codes->cl_lengths[sym] + (sym == 16 ? 2 : sym == 17 ? 3 : sym == 18 ? 7 : 0);
+     }
+ 
+     return bits;
+ }
+ 
+ /**
+  * Write one deflate block, choosing the smallest of dynamic, fixed and stored
+  */
+ static void emit_block(BitWriter *bw, const unsigned int *symbols, int count, const BYTE *data,
+                        size_t len, BOOL final)
+ {
+     unsigned int lit_freq[LITERALS] = {0};
+     unsigned int dist_freq[DISTANCES] = {0};
+     BlockCodes codes;
+     ULONGLONG extra = 0;
+     ULONGLONG dynamic_bits, fixed_bits, stored_bits;
+ 
+     for (int i = 0; i < count; i++)
+     {
+         unsigned int sym = symbols[i];
+         if (sym >> 16)
+         {
+             int lc = length_code[sym & 0xffff];
+             int dc = get_dist_code(sym >> 16);
+             lit_freq[257 + lc]++;
+             dist_freq[dc]++;
+             extra += length_extra[lc] + dist_extra[dc];
+         }
+         else
+         {
+             lit_freq[sym]++;
+         }
+     }
+     lit_freq[END_OF_BLOCK]++;
+ 
+     dynamic_bits = 3 + build_block_codes(&codes, lit_freq, dist_freq) + extra;
+     fixed_bits = 3 + extra;
+     for (int i = 0; i < LITERALS; i++)
+     {
+         dynamic_bits += (ULONGLONG)lit_freq[i] * codes.lit_lengths[i];
+         fixed_bits += (ULONGLONG)lit_freq[i] * fixed_lit_lengths[i];
+     }
+     for (int i = 0; i < DISTANCES; i++)
+     {
+         dynamic_bits += (ULONGLONG)dist_freq[i] * codes.dist_lengths[i];
+         fixed_bits += (ULONGLONG)dist_freq[i] * 5;
+     }
+     stored_bits = ((ULONGLONG)len + 5 * (len / 65535 + 1)) * 8 + 7;
+ 
+     if (stored_bits < dynamic_bits && stored_bits < fixed_bits)
+     {
+         // Stored blocks hold at most 65535 bytes each
+         size_t offset = 0;
+         do
+         {
+             size_t part = len - offset > 65535 ? 65535 : len - offset;
+             BOOL last = offset + part == len;
+ 
+             put_bits(bw, (final && last) ? 1 : 0, 3);
+             align_bits(bw);
+             put_bits(bw, (unsigned int)part, 16);
+             put_bits(bw, (unsigned int)(~part & 0xffff), 16);
+             if (bw->len + part <= bw->capacity)
+             {
+                 memcpy(bw->out + bw->len, data + offset, part);
+                 bw->len += part;
+             }
+             else
+             {
+                 bw->overflow = TRUE;
+             }
+             offset += part;
+         } while (offset < len);
+         return;
+     }
+ 
+     const BYTE *lit_lengths = fixed_lit_lengths;
+     const BYTE *dist_lengths = fixed_dist_lengths;
+     const unsigned short *lit_codes = fixed_lit_codes;
+     const unsigned short *dist_codes = fixed_dist_codes;
+ 
+     if (dynamic_bits < fixed_bits)
+     {
+         put_bits(bw, final ? 1 : 0, 1);
+         put_bits(bw, 2, 2);
+         put_bits(bw, codes.hlit - 257, 5);
+         put_bits(bw, codes.hdist - 1, 5);
+         put_bits(bw, codes.hclen - 4, 4);
+         for (int i = 0; i < codes.hclen; i++)
+             put_bits(bw, codes.cl_lengths[code_length_order[i]], 3);
+         for (int i = 0; i < codes.rle_count; i++)
+         {
+             BYTE sym = codes.rle[i];
+             put_bits(bw, codes.cl_codes[sym], codes.cl_lengths[sym]);
+             if (sym == 16)
+                 put_bits(bw, codes.rle_extra[i], 2);
+             else if (sym == 17)
+                 put_bits(bw, codes.rle_extra[i], 3);
+             else if (sym == 18)
+                 put_bits(bw, codes.rle_extra[i], 7);
+         }
+ 
+         lit_lengths = codes.lit_lengths;
+         dist_lengths = codes.dist_lengths;
+         lit_codes = codes.lit_codes;
+         dist_codes = codes.dist_codes;
+     }
+     else
+     {
+         put_bits(bw, final ? 1 : 0, 1);
+         put_bits(bw, 1, 2);
+     }
+ 
+     for (int i = 0; i < count; i++)
+     {
+         unsigned int sym = symbols[i];
+         if (sym >> 16)
+         {
+             int length = sym & 0xffff;
+             int dist = sym >> 16;
+             int lc = length_code[length];
+             int dc = get_dist_code(dist);
+ 
+             put_bits(bw, lit_codes[257 + lc], lit_lengths[257 + lc]);
+             if (length_extra[lc])
+                 put_bits(bw, length - length_base[lc], length_extra[lc]);
+             put_bits(bw, dist_codes[dc], dist_lengths[dc]);
+             if (dist_extra[dc])
+                 put_bits(bw, dist - dist_base[dc], dist_extra[dc]);
+         }
+         else
+         {
+             put_bits(bw, lit_codes[sym], lit_lengths[sym]);
+         }
+     }
+ 
+     put_bits(bw, lit_codes[END_OF_BLOCK], lit_lengths[END_OF_BLOCK]);
+ }
+ 
+ /**
+  * Hash of the three bytes at a position
+  */
+ static unsigned int hash3(const BYTE *p)
+ {
+     return (((unsigned int)p[0] << 16 | (unsigned int)p[1] << 8 | p[2]) * 2654435761U) >> (32 - HASH_BITS);
+ }
+ 
+ /**
+  * Longest match for a position within the window, 0 if shorter than MIN_MATCH
+  */
+ static int find_match(const BYTE *buffer, int pos, int end, const int *head, const int *prev,
+                       const LevelConfig *config, int *dist)
+ {
+     int limit = pos > DEFLATE_WINDOW ? pos - DEFLATE_WINDOW : 0;
+     int max_len = end - pos < MAX_MATCH ? end - pos : MAX_MATCH;
+     int best = MIN_MATCH - 1;
+     int chain = config->chain;
+     int cand = head[hash3(buffer + pos)];
+ 
+     while (cand >= limit && chain-- > 0)
+     {
+         if (buffer[cand + best] == buffer[pos + best] && buffer[cand] == buffer[pos] &&
+             buffer[cand + 1] == buffer[pos + 1])
+         {
+             int len = 0;
+             while (len < max_len && buffer[cand + len] == buffer[pos + len])
+                 len++;
+ 
+             if (len > best)
+             {
+                 best = len;
+                 *dist = pos - cand;
+                 if (len >= config->nice || len >= max_len)
+                     break;
+             }
+         }
+ 
+         // Links are only valid while they point backwards
+         int next = prev[cand & WINDOW_MASK];
+         if (next >= cand)
+             break;
+         cand = next;
+     }
+ 
+     return best >= MIN_MATCH ? best : 0;
+ }
+ 
+ /**
+  * Allocate compressor state
+  */
+ BOOL deflate_work_init(DeflateWork *work)
+ {
+     memset(work, 0, sizeof(*work));
+     init_tables();
+ 
+     work->head = (int *)malloc(HASH_SIZE * sizeof(int));
+     work->prev = (int *)malloc(DEFLATE_WINDOW * sizeof(int));
+     work->symbols = (unsigned int *)malloc(BLOCK_SYMBOLS * sizeof(unsigned int));
+     if (!work->head || !work->prev || !work->symbols)
+     {
+         deflate_work_free(work);
+         return FALSE;
+     }
+ 
+     return TRUE;
+ }
+ 
+ /**
+  * Release compressor state
+  */
+ void deflate_work_free(DeflateWork *work)
+ {
+     free(work->head);
+     free(work->prev);
+     free(work->symbols);
+     free(work->out);
+     memset(work, 0, sizeof(*work));
+ }
+ 
+ /**
+  * Upper bound of the compressed size of a block
+  */
+ size_t deflate_bound(size_t len)
+ {
+     return len + (len >> 11) + 64;
+ }
+ 
+ /**
+  * Compress one block of a stream as raw deflate
+  */
+ BOOL deflate_compress(DeflateWork *work, const BYTE *buffer, size_t dict_len, size_t len,
+                       int level, BOOL final)
+ {
+     const LevelConfig *config = &levels[level < 1 ? 1 : level > 9 ? 9 : level];
+     BitWriter bw;
+     int count = 0;
+ 
+     if (dict_len > DEFLATE_WINDOW)
+     {
+         buffer += dict_len - DEFLATE_WINDOW;
+         dict_len = DEFLATE_WINDOW;
+     }
+ 
+     size_t needed = deflate_bound(len);
+     if (work->out_capacity < needed)
+     {
+         BYTE *out = (BYTE *)realloc(work->out, needed);
+         if (!out)
+             return FALSE;
+         work->out = out;
+         work->out_capacity = needed;
+     }
+ 
+     memset(&bw, 0, sizeof(bw));
+     bw.out = work->out;
+     bw.capacity = work->out_capacity;
+ 
+     memset(work->head, 0xff, HASH_SIZE * sizeof(int));
+ 
+     int pos = (int)dict_len;
+     int end = (int)(dict_len + len);
+     int block_start = pos;
+     int next_insert = 0;
+ 
+     while (pos < end)
+     {
+         int best_len = 0, best_dist = 0;
+ 
+         if (count == BLOCK_SYMBOLS)
+         {
+             emit_block(&bw, work->symbols, count, buffer + block_start, pos - block_start, FALSE);
+             count = 0;
+             block_start = pos;
+         }
+ 
+         if (end - pos >= MIN_MATCH)
+         {
+             // Chain every position before this one (including the dictionary)
+             for (; next_insert < pos; next_insert++)
+             {
+                 if (next_insert + MIN_MATCH > end)
+                     continue;
+                 unsigned int h = hash3(buffer + next_insert);
+                 work->prev[next_insert & WINDOW_MASK] = work->head[h];
+                 work->head[h] = next_insert;
+             }
+ 
+             best_len = find_match(buffer, pos, end, work->head, work->prev, config, &best_dist);
+ 
+             // Lazy evaluation: prefer a literal if the next position starts a longer match
+             if (best_len && config->lazy && best_len < config->nice && pos + 1 + MIN_MATCH <= end)
+             {
+                 int next_dist = 0;
+                 unsigned int h = hash3(buffer + pos);
+                 work->prev[pos & WINDOW_MASK] = work->head[h];
+                 work->head[h] = pos;
+                 next_insert = pos + 1;
+ 
+                 if (find_match(buffer, pos + 1, end, work->head, work->prev, config, &next_dist) > best_len)
+                     best_len = 0;
+             }
+         }
+ 
+         if (best_len)
+         {
+             work->symbols[count++] = ((unsigned int)best_dist << 16) | (unsigned int)best_len;
+             pos += best_len;
+ 
+             // Fast levels do not chain the inside of long matches
+             if (!config->lazy && best_len > config->nice)
+                 next_insert = pos;
+         }
+         else
+         {
+             work->symbols[count++] = buffer[pos];
+             pos++;
+         }
+     }
+ 
+     if (count > 0 || final)
+         emit_block(&bw, work->symbols, count, buffer + block_start, pos - block_start, final);
+ 
+     if (final)
+     {
+         align_bits(&bw);
+     }
+     else
+     {
+         // Empty stored block: ends the block on a byte boundary so the next one can follow
+         put_bits(&bw, 0, 3);
+         align_bits(&bw);
+         put_bits(&bw, 0, 16);
+         put_bits(&bw, 0xffff, 16);
+     }
+ 
+     work->out_len = bw.len;
+     return !bw.overflow;
+ }
+ 
+ /**
+  * Update a CRC-32 (gzip polynomial), eight bytes per step
+  */
+ DWORD deflate_crc32(DWORD crc, const void *data, size_t len)
+ {
+     const BYTE *p = (const BYTE *)data;
+ 
+     init_tables();
+     crc = ~crc;
+ 
+     while (len >= 8)
+     {
+         DWORD one = crc ^ ((DWORD)p[0] | (DWORD)p[1] << 8 | (DWORD)p[2] << 16 | (DWORD)p[3] << 24);
+         DWORD two = (DWORD)p[4] | (DWORD)p[5] << 8 | (DWORD)p[6] << 16 | (DWORD)p[7] << 24;
+         crc = crc_table[7][one & 0xff] ^ crc_table[6][(one >> 8) & 0xff] ^
+               crc_table[5][(one >> 16) & 0xff] ^ crc_table[4][one >> 24] ^
+               crc_table[3][two & 0xff] ^ crc_table[2][(two >> 8) & 0xff] ^
+               crc_table[1][(two >> 16) & 0xff] ^ crc_table[0][two >> 24];
+         p += 8;
+         len -= 8;
+     }
+ 
+     while (len--)
+         crc = crc_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+ 
+     return ~crc;
+ }
+ 
+ /**
+  * Multiply a vector by a 32x32 matrix over GF(2)
+  */
+ static DWORD gf2_times(const DWORD *mat, DWORD vec)
+ {
+     DWORD sum = 0;
+ 
+     while (vec)
+     {
+         if (vec & 1)
+             sum ^= *mat;
+         vec >>= 1;
+         mat++;
+     }
+ 
+     return sum;
+ }
+ 
+ /**
+  * Square a 32x32 matrix over GF(2)
+  */
+ static void gf2_square(DWORD *square, const DWORD *mat)
+ {
+     for (int n = 0; n < 32; n++)
+         square[n] = gf2_times(mat, mat[n]);
+ }
+ 
+ /**
+  * Combine the CRCs of two consecutive pieces of data (zero operator
+  * applied len2 times by repeated squaring, as in zlib)
+  */
+ DWORD deflate_crc32_combine(DWORD crc1, DWORD crc2, ULONGLONG len2)
+ {
+     DWORD even[32];
+     DWORD odd[32];
+     DWORD row = 1;
+ 
+     if (len2 == 0)
+         return crc1;
+ 
+     // Operator for one zero bit
+     odd[0] = 0xEDB88320UL;
+     for (int n = 1; n < 32; n++)
+     {
+         odd[n] = row;
+         row <<= 1;
+     }
+ 
+     gf2_square(even, odd);  // Two zero bits
+     gf2_square(odd, even);  // Four zero bits
+ 
+     do
+     {
+         gf2_square(even, odd);
+         if (len2 & 1)
+             crc1 = gf2_times(even, crc1);
+         len2 >>= 1;
+         if (!len2)
+             break;
+ 
+         gf2_square(odd, even);
+         if (len2 & 1)
+             crc1 = gf2_times(odd, crc1);
+         len2 >>= 1;
+     } while (len2);
+ 
+     return crc1 ^ crc2;
+ }
+ // Streaming inflate: input and output buffers, the output keeps a window of history
+ #define INFLATE_INPUT_SIZE (256 * 1024)
+ #define INFLATE_OUTPUT_SIZE (256 * 1024)
+ #define INFLATE_FAST_BITS 10
+ #define MAX_CODE_BITS 15
+ 
+ // Canonical Huffman decoder: codes up to INFLATE_FAST_BITS long come from the
+ // table (symbol << 4 | length), longer ones are decoded bit by bit
+ typedef struct
+ {
+     unsigned short fast[1 << INFLATE_FAST_BITS];
+     unsigned short count[MAX_CODE_BITS + 1];
+     unsigned short symbol[288];
+ } HuffmanDecoder;
+ 
+ // Decompressor state
+ typedef struct
+ {
+     HANDLE file;
+     BYTE *in;
+     ULONGLONG in_offset;  // File offset of in[0]
+     size_t in_pos;
+     size_t in_len;
+     BOOL in_end;
+     ULONGLONG bits;
+     int bit_count;
+     BYTE *out;            // DEFLATE_WINDOW of history, then INFLATE_OUTPUT_SIZE of new data
+     size_t out_pos;
+     size_t out_flushed;
+     DWORD crc;            // CRC-32 and length of the current member
+     ULONGLONG size;
+     ULONGLONG total;      // Output passed on, all members
+     InflateOutput output;
+     InflatePointOutput point_output;
+     void *context;
+     volatile LONGLONG *bytes_read;
+     ULONGLONG span;       // Output between seek points
+     ULONGLONG next_point;
+     InflatePoint *point;
+     BOOL failed;
+     BOOL stopped;         // The output asked to stop
+     HuffmanDecoder lit;
+     HuffmanDecoder dist;
+ } Inflater;
+ 
+ /**
+  * Fill the bit buffer up to 57 bits, reading more input when it runs out
+  */
+ static void fill_bits(Inflater *inf)
+ {
+     while (inf->bit_count <= 56)
+     {
+         if (inf->in_pos == inf->in_len)
+         {
+             DWORD got = 0;
+ 
+             if (inf->in_end || !ReadFile(inf->file, inf->in, INFLATE_INPUT_SIZE, &got, NULL) || got == 0)
+             {
+                 inf->in_end = TRUE;
+                 return;
+             }
+             inf->in_offset += inf->in_len;
+             inf->in_pos = 0;
+             inf->in_len = got;
+             if (inf->bytes_read)
+                 InterlockedExchangeAdd64(inf->bytes_read, got);
+         }
+         inf->bits |= (ULONGLONG)inf->in[inf->in_pos++] << inf->bit_count;
+         inf->bit_count += 8;
+     }
+ }
+ 
+ /**
+  * Take count bits (up to 32) from the stream, 0 and the failed flag past its end
+  */
+ static DWORD get_bits(Inflater *inf, int count)
+ {
+     DWORD value;
+ 
+     if (inf->bit_count < count)
+     {
+         fill_bits(inf);
+         if (inf->bit_count < count)
+         {
+             inf->failed = TRUE;
+             return 0;
+         }
+     }
+     value = (DWORD)(inf->bits & ((1ULL << count) - 1));
+     inf->bits >>= count;
+     inf->bit_count -= count;
+     return value;
+ }
+ 
+ /**
+  * Build a decoder from code lengths; incomplete codes are allowed (a single
+  * distance code), over-subscribed ones are not
+  */
+ static BOOL build_decoder(HuffmanDecoder *h, const BYTE *lengths, int n)
+ {
+     unsigned short offsets[MAX_CODE_BITS + 2];
+     int left = 1, code = 0, k = 0;
+ 
+     memset(h->count, 0, sizeof(h->count));
+     for (int i = 0; i < n; i++)
+         h->count[lengths[i]]++;
+     h->count[0] = 0;
+ 
+     for (int len = 1; len <= MAX_CODE_BITS; len++)
+     {
+         left = (left << 1) - h->count[len];
+         if (left < 0)
+             return FALSE;
+     }
+ 
+     offsets[1] = 0;
+     for (int len = 1; len <= MAX_CODE_BITS; len++)
+         offsets[len + 1] = (unsigned short)(offsets[len] + h->count[len]);
+     for (int i = 0; i < n; i++)
+     {
+         if (lengths[i])
+             h->symbol[offsets[lengths[i]]++] = (unsigned short)i;
+     }
+ 
+     // Codes are assigned in (length, symbol) order, the table is indexed by the reversed code
+     memset(h->fast, 0, sizeof(h->fast));
+     for (int len = 1; len <= INFLATE_FAST_BITS; len++)
+     {
+         for (int i = 0; i < h->count[len]; i++, code++, k++)
+         {
+             unsigned short entry = (unsigned short)(h->symbol[k] << 4 | len);
+             for (int r = reverse_bits((unsigned short)code, len); r < (1 << INFLATE_FAST_BITS); r += 1 << len)
+                 h->fast[r] = entry;
+         }
+         code <<= 1;
+     }
+     return TRUE;
+ }
+ 
+ /**
+  * Decode one symbol, -1 on an invalid code or the end of the input
+  */
+ static int decode_symbol(Inflater *inf, const HuffmanDecoder *h)
+ {
+     int code = 0, first = 0, index = 0;
+ 
+     if (inf->bit_count < MAX_CODE_BITS)
+         fill_bits(inf);
+     if (inf->bit_count >= INFLATE_FAST_BITS)
+     {
+         unsigned short entry = h->fast[inf->bits & ((1 << INFLATE_FAST_BITS) - 1)];
+         if (entry)
+         {
+             inf->bits >>= entry & 15;
+             inf->bit_count -= entry & 15;
+             return entry >> 4;
+         }
+     }
+ 
+     // Long code, or too few bits left for the table
+     for (int len = 1; len <= MAX_CODE_BITS; len++)
+     {
+         code |= (int)get_bits(inf, 1);
+         if (inf->failed)
+             return -1;
+         if (code - h->count[len] < first)
+             return h->symbol[index + (code - first)];
+         index += h->count[len];
+         first = (first + h->count[len]) << 1;
+         code <<= 1;
+     }
+     return -1;
+ }
+ 
+ /**
+  * Pass the new output on and keep the last window as history
+  */
+ static void flush_output(Inflater *inf)
+ {
+     size_t len = inf->out_pos - inf->out_flushed;
+ 
+     if (len == 0 || inf->failed)
+         return;
+     inf->crc = deflate_crc32(inf->crc, inf->out + inf->out_flushed, len);
+     inf->size += len;
+     inf->total += len;
+     if (!inf->output(inf->context, inf->out + inf->out_flushed, len))
+     {
+         inf->failed = inf->stopped = TRUE;
+         return;
+     }
+ 
+     if (inf->out_pos > DEFLATE_WINDOW)
+     {
+         memmove(inf->out, inf->out + inf->out_pos - DEFLATE_WINDOW, DEFLATE_WINDOW);
+         inf->out_pos = DEFLATE_WINDOW;
+     }
+     inf->out_flushed = inf->out_pos;
+ }
+ 
+ /**
+  * Decode the symbols of a fixed or dynamic block
+  */
+ static BOOL inflate_codes(Inflater *inf)
+ {
+     for (;;)
+     {
+         int symbol = decode_symbol(inf, &inf->lit);
+ 
+         if (symbol < 0)
+             return FALSE;
+         if (inf->out_pos >= DEFLATE_WINDOW + INFLATE_OUTPUT_SIZE)
+         {
+             flush_output(inf);
+             if (inf->failed)
+                 return FALSE;
+         }
+ 
+         if (symbol < 256)
+         {
+             inf->out[inf->out_pos++] = (BYTE)symbol;
+             continue;
+         }
+         if (symbol == END_OF_BLOCK)
+             return TRUE;
+ 
+         symbol -= 257;
+         if (symbol >= 29)
+             return FALSE;
+         int len = length_base[symbol] + (int)get_bits(inf, length_extra[symbol]);
+ 
+         int dist_symbol = decode_symbol(inf, &inf->dist);
+         if (dist_symbol < 0 || dist_symbol >= DISTANCES)
+             return FALSE;
+         size_t dist = dist_base[dist_symbol] + get_bits(inf, dist_extra[dist_symbol]);
+         if (inf->failed || dist > inf->out_pos)
+             return FALSE;
+ 
+         // Byte by byte: the source may overlap the bytes being written
+         BYTE *to = inf->out + inf->out_pos;
+         const BYTE *from = to - dist;
+         for (int i = 0; i < len; i++)
+             to[i] = from[i];
+         inf->out_pos += len;
+     }
+ }
+ 
+ /**
+  * Read the code length codes and the two codes of a dynamic block
+  */
+ static BOOL read_dynamic_codes(Inflater *inf)
+ {
+     BYTE lengths[LITERALS + DISTANCES];
+     BYTE cl_lengths[CODE_LENGTHS];
+     HuffmanDecoder *cl = &inf->dist;  // Free until the distance code is built
+     int hlit = (int)get_bits(inf, 5) + 257;
+     int hdist = (int)get_bits(inf, 5) + 1;
+     int hclen = (int)get_bits(inf, 4) + 4;
+ 
+     if (inf->failed || hlit > LITERALS || hdist > DISTANCES)
+         return FALSE;
+ 
+     memset(cl_lengths, 0, sizeof(cl_lengths));
+     for (int i = 0; i < hclen; i++)
+         cl_lengths[code_length_order[i]] = (BYTE)get_bits(inf, 3);
+     if (inf->failed || !build_decoder(cl, cl_lengths, CODE_LENGTHS))
+         return FALSE;
+ 
+     for (int i = 0; i < hlit + hdist;)
+     {
+         int symbol = decode_symbol(inf, cl);
+         int repeat;
+         BYTE value = 0;
+ 
+         if (symbol < 0)
+             return FALSE;
+         if (symbol < 16)
+         {
+             lengths[i++] = (BYTE)symbol;
+             continue;
+         }
+         if (symbol == 16)
+         {
+             if (i == 0)
+                 return FALSE;
+             value = lengths[i - 1];
+             repeat = 3 + (int)get_bits(inf, 2);
+         }
+         else if (symbol == 17)
+             repeat = 3 + (int)get_bits(inf, 3);
+         else
+             repeat = 11 + (int)get_bits(inf, 7);
+ 
+         if (inf->failed || i + repeat > hlit + hdist)
+             return FALSE;
+         while (repeat--)
+             lengths[i++] = value;
+     }
+ 
+     if (lengths[END_OF_BLOCK] == 0)
+         return FALSE;
+     return build_decoder(&inf->lit, lengths, hlit) && build_decoder(&inf->dist, lengths + hlit, hdist);
+ }
+ 
+ /**
+  * Report a seek point at the start of a block: the bit position and the
+  * history the block can copy from
+  */
+ static BOOL record_point(Inflater *inf)
+ {
+     InflatePoint *point = inf->point;
+     ULONGLONG consumed = (inf->in_offset + inf->in_pos) * 8 - (ULONGLONG)inf->bit_count;
+     size_t window = inf->out_pos < DEFLATE_WINDOW ? inf->out_pos : DEFLATE_WINDOW;
+ 
+     point->output = inf->total + (inf->out_pos - inf->out_flushed);
+     point->input = consumed / 8;
+     point->bits = (DWORD)(consumed % 8);
+     point->window_length = (DWORD)window;
+     memcpy(point->window, inf->out + inf->out_pos - window, window);
+     inf->next_point = point->output + inf->span;
+ 
+     if (!inf->point_output(inf->context, point))
+     {
+         inf->failed = inf->stopped = TRUE;
+         return FALSE;
+     }
+     return TRUE;
+ }
+ 
+ /**
+  * Decompress one raw deflate stream
+  */
+ static BOOL inflate_stream(Inflater *inf)
+ {
+     DWORD last;
+ 
+     do
+     {
+         if (inf->point_output && inf->total + (inf->out_pos - inf->out_flushed) >= inf->next_point &&
+             !record_point(inf))
+             return FALSE;
+ 
+         last = get_bits(inf, 1);
+         DWORD type = get_bits(inf, 2);
+         BOOL ok = FALSE;
+ 
+         if (inf->failed)
+             return FALSE;
+ 
+         if (type == 0)
+         {
+             // Stored block: whole bytes after the header bits
+             get_bits(inf, inf->bit_count & 7);
+             DWORD len = get_bits(inf, 16);
+             DWORD nlen = get_bits(inf, 16);
+             ok = !inf->failed && len == (~nlen & 0xFFFF);
+             while (ok && len > 0)
+             {
+                 if (inf->out_pos >= DEFLATE_WINDOW + INFLATE_OUTPUT_SIZE)
+                 {
+                     flush_output(inf);
+                     ok = !inf->failed;
+                     continue;
+                 }
+ 
+                 // Bytes already in the bit buffer first, then straight from the input
+                 if (inf->bit_count >= 8 || inf->in_pos == inf->in_len)
+                 {
+                     inf->out[inf->out_pos++] = (BYTE)get_bits(inf, 8);
+                     ok = !inf->failed;
+                     len--;
+                     continue;
+                 }
+ 
+                 size_t n = inf->in_len - inf->in_pos;
+                 if (n > len)
+                     n = len;
+                 if (n > DEFLATE_WINDOW + INFLATE_OUTPUT_SIZE - inf->out_pos)
+                     n = DEFLATE_WINDOW + INFLATE_OUTPUT_SIZE - inf->out_pos;
+                 memcpy(inf->out + inf->out_pos, inf->in + inf->in_pos, n);
+                 inf->out_pos += n;
+                 inf->in_pos += n;
+                 len -= (DWORD)n;
+             }
+         }
+         else if (type == 1)
+         {
+             ok = build_decoder(&inf->lit, fixed_lit_lengths, 288) &&
+                  build_decoder(&inf->dist, fixed_dist_lengths, DISTANCES) && inflate_codes(inf);
+         }
+         else if (type == 2)
+         {
+             ok = read_dynamic_codes(inf) && inflate_codes(inf);
+         }
+ 
+         if (!ok || inf->failed)
+             return FALSE;
+     } while (!last);
+ 
+     return TRUE;
+ }
+ 
+ /**
+  * Skip a zero-terminated header field
+  */
+ static BOOL skip_string(Inflater *inf)
+ {
+     while (get_bits(inf, 8) != 0)
+     {
+         if (inf->failed)
+             return FALSE;
+     }
+     return !inf->failed;
+ }
+ 
+ /**
+  * Decompress gzip members up to the end of the file; a resumed inflater is
+  * inside a member whose CRC-32 and length it has not seen all of
+  */
+ static BOOL inflate_members(Inflater *inf, BOOL resumed)
+ {
+     int members = 0;
+ 
+     // Concatenated members form one stream (gzip -c a b > c)
+     for (;;)
+     {
+         if (!resumed)
+         {
+             fill_bits(inf);
+             if (inf->bit_count == 0 && members > 0)
+                 return TRUE;
+ 
+             DWORD id = get_bits(inf, 16);
+             DWORD method = get_bits(inf, 8);
+             DWORD flags = get_bits(inf, 8);
+             get_bits(inf, 32);  // Modification time
+             get_bits(inf, 16);  // Extra flags and OS
+             if (inf->failed || id != 0x8b1f || method != 8 || (flags & 0xE0))
+                 return FALSE;
+             if (flags & 4)
+             {
+                 DWORD extra = get_bits(inf, 16);
+                 while (extra-- > 0 && !inf->failed)
+                     get_bits(inf, 8);
+             }
+             if (((flags & 8) && !skip_string(inf)) || ((flags & 16) && !skip_string(inf)))
+                 return FALSE;
+             if (flags & 2)
+                 get_bits(inf, 16);
+ 
+             inf->crc = 0;
+             inf->size = 0;
+             inf->out_pos = 0;
+             inf->out_flushed = 0;
+         }
+         if (!inflate_stream(inf))
+             return FALSE;
+         flush_output(inf);
+ 
+         // Trailer: CRC-32 and length modulo 2^32 of the member
+         get_bits(inf, inf->bit_count & 7);
+         DWORD crc = get_bits(inf, 32);
+         DWORD size = get_bits(inf, 32);
+         if (inf->failed || (!resumed && (crc != inf->crc || size != (DWORD)inf->size)))
+             return FALSE;
+         resumed = FALSE;
+         members++;
+     }
+ }
+ 
+ /**
+  * Allocate a decompressor for a file
+  */
+ static Inflater *create_inflater(HANDLE file, InflateOutput output, void *context)
+ {
+     Inflater *inf = (Inflater *)calloc(1, sizeof(Inflater));
+ 
+     init_tables();
+     if (!inf)
+         return NULL;
+     inf->file = file;
+     inf->output = output;
+     inf->context = context;
+     inf->in = (BYTE *)malloc(INFLATE_INPUT_SIZE);
+     inf->out = (BYTE *)malloc(DEFLATE_WINDOW + INFLATE_OUTPUT_SIZE + MAX_MATCH);
+     if (!inf->in || !inf->out)
+     {
+         free(inf->in);
+         free(inf->out);
+         free(inf);
+         return NULL;
+     }
+     return inf;
+ }
+ 
+ static void free_inflater(Inflater *inf)
+ {
+     free(inf->in);
+     free(inf->out);
+     free(inf->point);
+     free(inf);
+ }
+ 
+ BOOL inflate_gzip_file(HANDLE file, InflateOutput output, void *context, volatile LONGLONG *bytes_read)
+ {
+     Inflater *inf = create_inflater(file, output, context);
+     BOOL ok;
+ 
+     if (!inf)
+         return FALSE;
+     inf->bytes_read = bytes_read;
+     ok = inflate_members(inf, FALSE);
+     free_inflater(inf);
+     return ok;
+ }
+ 
+ /**
+  * Output that only counts, for the seek point pass
+  */
+ static BOOL discard_output(void *context, const BYTE *data, size_t len)
+ {
+     (void)context;
+     (void)data;
+     (void)len;
+     return TRUE;
+ }
+ 
+ BOOL inflate_gzip_points(HANDLE file, ULONGLONG span, InflatePointOutput point_output, void *context,
+                          ULONGLONG *size)
+ {
+     Inflater *inf = create_inflater(file, discard_output, context);
+     BOOL ok;
+ 
+     if (!inf)
+         return FALSE;
+     inf->point = (InflatePoint *)malloc(sizeof(InflatePoint));
+     inf->point_output = point_output;
+     inf->span = span;
+     inf->next_point = span;
+     ok = inf->point && inflate_members(inf, FALSE);
+     if (size)
+         *size = inf->total;
+     free_inflater(inf);
+     return ok;
+ }
+ 
+ BOOL inflate_gzip_resume(HANDLE file, const InflatePoint *point, InflateOutput output, void *context)
+ {
+     Inflater *inf = create_inflater(file, output, context);
+     LARGE_INTEGER position;
+     BOOL ok = FALSE;
+ 
+     if (!inf)
+         return FALSE;
+ 
+     position.QuadPart = point ? (LONGLONG)point->input : 0;
+     if (SetFilePointerEx(file, position, NULL, FILE_BEGIN))
+     {
+         inf->in_offset = (ULONGLONG)position.QuadPart;
+         if (point)
+         {
+             // The block starts part way into its first byte, after the history it copies from
+             get_bits(inf, (int)point->bits);
+             memcpy(inf->out, point->window, point->window_length);
+             inf->out_pos = inf->out_flushed = point->window_length;
+             inf->total = point->output;
+         }
+         ok = !inf->failed && inflate_members(inf, point != NULL);
+     }
+ 
+     ok = ok || inf->stopped;
+     free_inflater(inf);
+     return ok;
+ }
\ No newline at end of file
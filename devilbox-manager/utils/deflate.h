@@ -0,0 +1,153 @@
+/*******************************************************************************
+ * Deflate Module Header
+ * Raw deflate (RFC 1951) block compressor, a gzip decompressor for restores
+ * and log archives, and CRC-32
+ *******************************************************************************/
+#ifndef DEFLATE_H
+#define DEFLATE_H
+
+#include <windows.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Deflate window size (maximum match distance)
+#define DEFLATE_WINDOW 32768
+
+// Compression levels
+#define DEFLATE_LEVEL_FASTEST 1
+#define DEFLATE_LEVEL_DEFAULT 6
+#define DEFLATE_LEVEL_BEST 9
+
+// Per-thread compressor state, reused for every block
+typedef struct
+{
+    int *head;                // Hash chain heads
+    int *prev;                // Hash chain links (window sized)
+    unsigned int *symbols;    // Literal/length + distance symbols of the current deflate block
+    BYTE *out;                // Compressed output of the last call
+    size_t out_len;
+    size_t out_capacity;
+} DeflateWork;
+
+/**
+ * Allocate compressor state
+ * @param work State to initialize
+ * @return TRUE on success
+ */
+BOOL deflate_work_init(DeflateWork *work);
+
+/**
+ * Release compressor state
+ * @param work State to free
+ */
+void deflate_work_free(DeflateWork *work);
+
+/**
+ * Compress one block of a stream as raw deflate into work->out. Blocks can be
+ * compressed independently and concatenated: a non-final block ends with an
+ * empty stored block so it finishes on a byte boundary.
+ * @param work Compressor state
+ * @param buffer dict_len bytes of preceding data followed by the block data
+ * @param dict_len Length of the preset dictionary (at most DEFLATE_WINDOW)
+ * @param len Length of the block data
+ * @param level Compression level 1-9
+ * @param final TRUE for the last block of the stream
+ * @return TRUE on success
+ */
+BOOL deflate_compress(DeflateWork *work, const BYTE *buffer, size_t dict_len, size_t len,
+                      int level, BOOL final);
+
+/**
+ * Upper bound of the compressed size of a block
+ * @param len Length of the block data
+ * @return Maximum output size in bytes
+ */
+size_t deflate_bound(size_t len);
+
+/**
+ * Update a CRC-32 (gzip polynomial)
+ * @param crc CRC of the preceding data (0 to start)
+ * @param data Data to add
+ * @param len Length of the data
+ * @return Updated CRC
+ */
+DWORD deflate_crc32(DWORD crc, const void *data, size_t len);
+
+/**
+ * Combine the CRCs of two consecutive pieces of data
+ * @param crc1 CRC of the first piece
+ * @param crc2 CRC of the second piece
+ * @param len2 Length of the second piece
+ * @return CRC of both pieces
+ */
+DWORD deflate_crc32_combine(DWORD crc1, DWORD crc2, ULONGLONG len2);
+
+/**
+ * Receives decompressed data
+ * @param context Context passed to inflate_gzip_file
+ * @param data Decompressed bytes
+ * @param len Number of bytes
+ * @return FALSE to stop decompressing
+ */
+typedef BOOL (*InflateOutput)(void *context, const BYTE *data, size_t len);
+
+/**
+ * Decompress a gzip file (one or more members) and check the CRC-32 and
+ * length of every member
+ * @param file File positioned at the gzip header
+ * @param output Receives the data in pieces of up to 256 KB
+ * @param context Passed to output
+ * @param bytes_read Incremented by the compressed bytes read (may be NULL)
+ * @return TRUE if the whole file was decompressed and checked
+ */
+BOOL inflate_gzip_file(HANDLE file, InflateOutput output, void *context, volatile LONGLONG *bytes_read);
+
+// Place to resume decompressing a gzip file from: the start of a deflate block
+typedef struct
+{
+    ULONGLONG output;           // Decompressed bytes before the block
+    ULONGLONG input;            // File offset of the byte holding the first bit of the block
+    DWORD bits;                 // Bits of that byte belonging to the previous block
+    DWORD window_length;        // History the block can copy from
+    BYTE window[DEFLATE_WINDOW];
+} InflatePoint;
+
+/**
+ * Receives a seek point
+ * @param context Context passed to inflate_gzip_points
+ * @param point Seek point, valid during the call
+ * @return FALSE to stop decompressing
+ */
+typedef BOOL (*InflatePointOutput)(void *context, const InflatePoint *point);
+
+/**
+ * Decompress a gzip file once to find seek points, at the first block start
+ * after every span bytes of output
+ * @param file File positioned at the gzip header
+ * @param span Decompressed bytes between seek points
+ * @param point_output Receives the seek points in order
+ * @param context Passed to point_output
+ * @param size Receives the decompressed size (may be NULL)
+ * @return TRUE if the whole file was decompressed and checked
+ */
+BOOL inflate_gzip_points(HANDLE file, ULONGLONG span, InflatePointOutput point_output, void *context,
+                         ULONGLONG *size);
+
+/**
+ * Decompress a gzip file from a seek point to the end, or until the output
+ * asks to stop. The CRC-32 of the member holding the point is not checked.
+ * @param file Gzip file
+ * @param point Seek point from inflate_gzip_points, NULL to start at the beginning
+ * @param output Receives the data in pieces of up to 256 KB
+ * @param context Passed to output
+ * @return TRUE if the data was valid up to where it ended or the output stopped
+ */
+BOOL inflate_gzip_resume(HANDLE file, const InflatePoint *point, InflateOutput output, void *context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DEFLATE_H */
\ No newline at end of file
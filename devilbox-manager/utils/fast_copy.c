@@ -0,0 +1,323 @@
+/*******************************************************************************
+ * Fast Copy Module Implementation
+ * Strategy selection, ReFS block cloning and the buffered fallback
+ *******************************************************************************/
+
+ #include "fast_copy.h"
+ #include <winioctl.h>
+ #include <stdio.h>
+ #include <string.h>
+ 
+ #ifndef MAX_PATH_LEN
+ #define MAX_PATH_LEN 260
+ #endif
+ 
+ // Buffer of the buffered copy
+ #define COPY_BUFFER_SIZE (1024 * 1024)
+ 
+ // CopyFileEx bypasses the file cache from this size on, the data is not read again
+ #define UNBUFFERED_MIN_SIZE (32 * 1024 * 1024)
+ 
+ // ReFS clones less than 4 GB per request
+ #define CLONE_MAX_CHUNK (1024 * 1024 * 1024)
+ 
+ // Declarations missing from older MinGW headers
+ #ifndef FSCTL_DUPLICATE_EXTENTS_TO_FILE
+ #define FSCTL_DUPLICATE_EXTENTS_TO_FILE CTL_CODE(FILE_DEVICE_FILE_SYSTEM, 209, METHOD_BUFFERED, FILE_WRITE_ACCESS)
+ #endif
+ #ifndef FILE_SUPPORTS_BLOCK_REFCOUNTING
+ #define FILE_SUPPORTS_BLOCK_REFCOUNTING 0x08000000
+ #endif
+ #ifndef COPY_FILE_NO_BUFFERING
+ #define COPY_FILE_NO_BUFFERING 0x00001000
+ #endif
+ #ifndef ERROR_REQUEST_ABORTED
+ #define ERROR_REQUEST_ABORTED 1235L
+ #endif
+ 
+ // Input of FSCTL_DUPLICATE_EXTENTS_TO_FILE (DUPLICATE_EXTENTS_DATA)
+ typedef struct
+ {
+     HANDLE file;
+     LARGE_INTEGER source_offset;
+     LARGE_INTEGER target_offset;
+     LARGE_INTEGER byte_count;
+ } DuplicateExtents;
+ 
+ // Progress of a CopyFileEx call
+ typedef struct
+ {
+     const FastCopyOptions *options;
+     LONGLONG reported;
+ } KernelProgress;
+ 
+ static const char *strategy_names[FAST_COPY_STRATEGY_COUNT] = {"clone", "kernel", "buffered", "overlapped"};
+ 
+ /**
+  * Get the volume of a path: serial number, file system flags and cluster size
+  */
+ static BOOL get_volume(const char *path, DWORD *serial, DWORD *flags, DWORD *cluster)
+ {
+     char root[MAX_PATH_LEN];
+     DWORD sectors, bytes, free_clusters, total_clusters;
+ 
+     if (!GetVolumePathName(path, root, sizeof(root)))
+         return FALSE;
+     if (!GetVolumeInformation(root, NULL, 0, serial, NULL, flags, NULL, 0))
+         return FALSE;
+     if (!GetDiskFreeSpace(root, &sectors, &bytes, &free_clusters, &total_clusters))
+         return FALSE;
+     *cluster = sectors * bytes;
+     return TRUE;
+ }
+ 
+ /**
+  * Set the timestamps of a copy to those of the source
+  */
+ static BOOL copy_times(HANDLE target, const WIN32_FILE_ATTRIBUTE_DATA *attr)
+ {
+     return SetFileTime(target, &attr->ftCreationTime, &attr->ftLastAccessTime, &attr->ftLastWriteTime);
+ }
+ 
+ /**
+  * Clone the file's extents when source and target are on the same volume
+  * and it supports block cloning (ReFS). No data is read or written, the
+  * clusters are shared until either file changes.
+  */
+ static BOOL clone_file(const char *source, const char *target, const WIN32_FILE_ATTRIBUTE_DATA *attr,
+                        ULONGLONG size)
+ {
+     DWORD source_serial, target_serial, flags, target_flags, cluster, target_cluster;
+     HANDLE in, out;
+     LARGE_INTEGER end;
+     BOOL ok;
+ 
+     // A sparse source needs a sparse target; leave those to the copy engine
+     if (attr->dwFileAttributes & FILE_ATTRIBUTE_SPARSE_FILE)
+         return FALSE;
+     if (!get_volume(source, &source_serial, &flags, &cluster) || !(flags & FILE_SUPPORTS_BLOCK_REFCOUNTING))
+         return FALSE;
+     if (!get_volume(target, &target_serial, &target_flags, &target_cluster) || target_serial != source_serial)
+         return FALSE;
+ 
+     in = CreateFile(source, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+     if (in == INVALID_HANDLE_VALUE)
+         return FALSE;
+     out = CreateFile(target, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+     if (out == INVALID_HANDLE_VALUE)
+     {
+         CloseHandle(in);
+         return FALSE;
+     }
+ 
+     // The target gets its final size first, then the clusters are cloned
+     // in whole clusters; the tail past the end of file is ignored
+     end.QuadPart = (LONGLONG)size;
+     ok = SetFilePointerEx(out, end, NULL, FILE_BEGIN) && SetEndOfFile(out);
+ 
+     ULONGLONG rounded = (size + cluster - 1) / cluster * cluster;
+     for (ULONGLONG offset = 0; ok && offset < rounded; offset += CLONE_MAX_CHUNK)
+     {
+         DuplicateExtents extents;
+         DWORD returned;
+ 
+         extents.file = in;
+         extents.source_offset.QuadPart = (LONGLONG)offset;
+         extents.target_offset.QuadPart = (LONGLONG)offset;
+         extents.byte_count.QuadPart = (LONGLONG)(rounded - offset < CLONE_MAX_CHUNK ? rounded - offset : CLONE_MAX_CHUNK);
+         ok = DeviceIoControl(out, FSCTL_DUPLICATE_EXTENTS_TO_FILE, &extents, sizeof(extents),
+                              NULL, 0, &returned, NULL);
+     }
+ 
+     ok = ok && copy_times(out, attr);
+     CloseHandle(out);
+     CloseHandle(in);
+     if (!ok)
+         DeleteFile(target);
+     return ok;
+ }
+ 
+ /**
+  * Copy with ReadFile/WriteFile. Small files go through a stack buffer in
+  * one read and one write, larger ones through a page-aligned 1 MB buffer
+  * into a target preallocated to the final size.
+  */
+ static BOOL buffered_copy(const char *source, const char *target, const WIN32_FILE_ATTRIBUTE_DATA *attr,
+                           ULONGLONG size, const FastCopyOptions *options)
+ {
+     BYTE small_buffer[FAST_COPY_SMALL_FILE];
+     BYTE *buffer = small_buffer;
+     DWORD buffer_size = sizeof(small_buffer);
+     HANDLE in, out;
+     BOOL ok = TRUE;
+     DWORD error = 0;
+ 
+     // Other programs may keep the file open for writing (logs, databases)
+     in = CreateFile(source, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+                     FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+     if (in == INVALID_HANDLE_VALUE)
+         return FALSE;
+     out = CreateFile(target, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+     if (out == INVALID_HANDLE_VALUE)
+     {
+         error = GetLastError();
+         CloseHandle(in);
+         SetLastError(error);
+         return FALSE;
+     }
+ 
+     if (size > FAST_COPY_SMALL_FILE)
+     {
+         LARGE_INTEGER end, start;
+ 
+         buffer_size = COPY_BUFFER_SIZE;
+         buffer = (BYTE *)VirtualAlloc(NULL, buffer_size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+         if (!buffer)
+         {
+             buffer = small_buffer;
+             buffer_size = sizeof(small_buffer);
+         }
+ 
+         // Reserving the whole size at once keeps large copies contiguous
+         end.QuadPart = (LONGLONG)size;
+         start.QuadPart = 0;
+         if (SetFilePointerEx(out, end, NULL, FILE_BEGIN))
+             SetEndOfFile(out);
+         SetFilePointerEx(out, start, NULL, FILE_BEGIN);
+     }
+ 
+     for (;;)
+     {
+         DWORD got = 0, written = 0;
+ 
+         if (!ReadFile(in, buffer, buffer_size, &got, NULL))
+         {
+             ok = FALSE;
+             break;
+         }
+         if (got == 0)
+             break;
+         if (!WriteFile(out, buffer, got, &written, NULL) || written != got)
+         {
+             ok = FALSE;
+             break;
+         }
+         if (options && options->progress && !options->progress(got, options->context))
+         {
+             SetLastError(ERROR_REQUEST_ABORTED);
+             ok = FALSE;
+             break;
+         }
+     }
+ 
+     // The source may have shrunk since the target was preallocated
+     ok = ok && SetEndOfFile(out) && copy_times(out, attr);
+     if (!ok)
+         error = GetLastError();
+ 
+     if (buffer != small_buffer)
+         VirtualFree(buffer, 0, MEM_RELEASE);
+     CloseHandle(out);
+     CloseHandle(in);
+     if (!ok)
+     {
+         DeleteFile(target);
+         SetLastError(error);
+     }
+     return ok;
+ }
+ 
+ /**
+  * CopyFileEx progress routine: forwards the bytes of each chunk
+  */
+ static DWORD CALLBACK kernel_progress(LARGE_INTEGER total_size, LARGE_INTEGER transferred,
+                                       LARGE_INTEGER stream_size, LARGE_INTEGER stream_transferred,
+                                       DWORD stream, DWORD reason, HANDLE source, HANDLE target, LPVOID data)
+ {
+     KernelProgress *progress = (KernelProgress *)data;
+     LONGLONG bytes = transferred.QuadPart - progress->reported;
+ 
+     if (bytes <= 0)
+         return PROGRESS_CONTINUE;
+     progress->reported = transferred.QuadPart;
+     return progress->options->progress(bytes, progress->options->context) ? PROGRESS_CONTINUE : PROGRESS_CANCEL;
+ }
+ 
+ int fast_copy_file(const char *source, const char *target, const FastCopyOptions *options)
+ {
+     FastCopyStats *stats = options ? options->stats : NULL;
+     WIN32_FILE_ATTRIBUTE_DATA attr;
+     LARGE_INTEGER start, end, frequency;
+     ULONGLONG size;
+     int strategy = -1;
+ 
+     QueryPerformanceCounter(&start);
+     if (!GetFileAttributesEx(source, GetFileExInfoStandard, &attr))
+         return -1;
+     size = ((ULONGLONG)attr.nFileSizeHigh << 32) | attr.nFileSizeLow;
+ 
+     // Setting up a clone or CopyFileEx costs more than copying a small file
+     if (size > FAST_COPY_SMALL_FILE)
+     {
+         KernelProgress progress = {options, 0};
+         BOOL tracked = options && options->progress;
+ 
+         if (clone_file(source, target, &attr, size))
+             strategy = FAST_COPY_CLONE;
+         else if (CopyFileEx(source, target, tracked ? kernel_progress : NULL, tracked ? &progress : NULL, NULL,
+                             size >= UNBUFFERED_MIN_SIZE ? COPY_FILE_NO_BUFFERING : 0))
+             strategy = FAST_COPY_KERNEL;
+         else if (GetLastError() == ERROR_REQUEST_ABORTED)
+             return -1;
+         else if (progress.reported > 0)
+             options->progress(-progress.reported, options->context);
+     }
+ 
+     // CopyFileEx also fails on files other programs have open for writing
+     if (strategy < 0 && buffered_copy(source, target, &attr, size, options))
+         strategy = FAST_COPY_BUFFERED;
+     if (strategy < 0)
+         return -1;
+ 
+     if (stats)
+     {
+         FastCopyCounter *counter = &stats->strategies[strategy];
+ 
+         QueryPerformanceCounter(&end);
+         QueryPerformanceFrequency(&frequency);
+         InterlockedIncrement64(&counter->files);
+         InterlockedExchangeAdd64(&counter->bytes, (LONGLONG)size);
+         InterlockedExchangeAdd64(&counter->microseconds,
+                                  (end.QuadPart - start.QuadPart) * 1000000 / frequency.QuadPart);
+     }
+     return strategy;
+ }
+ 
+ const char *fast_copy_strategy_name(int strategy)
+ {
+     return strategy >= 0 && strategy < FAST_COPY_STRATEGY_COUNT ? strategy_names[strategy] : "none";
+ }
+ 
+ void fast_copy_format_stats(const FastCopyStats *stats, char *buffer, size_t size)
+ {
+     size_t used = 0;
+ 
+     if (size == 0)
+         return;
+     buffer[0] = '\0';
+ 
+     for (int i = 0; i < FAST_COPY_STRATEGY_COUNT; i++)
+     {
+         const FastCopyCounter *counter = &stats->strategies[i];
+         int written;
+ 
+         if (counter->files == 0)
+             continue;
+         written = snprintf(buffer + used, size - used, "%s%s %lld files %.1f MB %.1f MB/s",
+                            used ? ", " : "", strategy_names[i], counter->files, counter->bytes / 1048576.0,
+                            counter->microseconds ? counter->bytes / 1048576.0 * 1000000.0 / counter->microseconds : 0.0);
+         if (written < 0 || (size_t)written >= size - used)
+             break;
+         used += written;
+     }
+ }
\ No newline at end of file
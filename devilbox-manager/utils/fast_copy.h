@@ -0,0 +1,89 @@
+/*******************************************************************************
+ * Fast Copy Module Header
+ * File copy with the cheapest strategy the volume supports: ReFS block
+ * cloning, the kernel copy engine (CopyFileEx) or a large-buffer copy
+ *******************************************************************************/
+#ifndef FAST_COPY_H
+#define FAST_COPY_H
+
+#include <windows.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Copy strategies, in order of preference
+enum
+{
+    FAST_COPY_CLONE,       // Block clone on the same ReFS volume, no data is moved
+    FAST_COPY_KERNEL,      // CopyFileEx, offloaded copies and no user-mode buffers
+    FAST_COPY_BUFFERED,    // ReadFile/WriteFile with a page-aligned buffer
+    FAST_COPY_OVERLAPPED,  // Many files at once through a completion port, see async_copy.h
+    FAST_COPY_STRATEGY_COUNT
+};
+
+// Files at most this large skip cloning and CopyFileEx, one read and one write is cheaper
+#define FAST_COPY_SMALL_FILE (64 * 1024)
+
+// Counters of one strategy
+typedef struct
+{
+    volatile LONGLONG files;
+    volatile LONGLONG bytes;
+    volatile LONGLONG microseconds;  // Time spent copying, summed over threads
+} FastCopyCounter;
+
+// Statistics of a series of copies (shared between threads)
+typedef struct
+{
+    FastCopyCounter strategies[FAST_COPY_STRATEGY_COUNT];
+} FastCopyStats;
+
+/**
+ * Progress callback, called on the copying thread as data is written
+ * @param bytes Bytes copied since the last call, negative when a failed
+ *              attempt is taken back before the next strategy is tried
+ * @param context Caller context
+ * @return FALSE to abort the copy
+ */
+typedef BOOL (*FastCopyProgress)(LONGLONG bytes, void *context);
+
+// Optional parameters of a copy
+typedef struct
+{
+    FastCopyStats *stats;       // Statistics to update (may be NULL)
+    FastCopyProgress progress;  // May be NULL; may sleep to throttle the copy
+    void *context;
+} FastCopyOptions;
+
+/**
+ * Copy a file, keeping its timestamps. The target is
+ * overwritten, its directory must exist.
+ * @param source Source file
+ * @param target Target file
+ * @param options Statistics and progress callback (may be NULL)
+ * @return Strategy used, -1 on failure (GetLastError has the reason,
+ *         ERROR_REQUEST_ABORTED when the callback aborted the copy)
+ */
+int fast_copy_file(const char *source, const char *target, const FastCopyOptions *options);
+
+/**
+ * Get the display name of a strategy
+ * @param strategy FAST_COPY_* value
+ * @return Name such as "clone"
+ */
+const char *fast_copy_strategy_name(int strategy);
+
+/**
+ * Describe the statistics, e.g. "clone 12 files 40.1 MB 950.0 MB/s, buffered 300 files ..."
+ * @param stats Statistics
+ * @param buffer Receives the text (empty when nothing was copied)
+ * @param size Size of the buffer
+ */
+void fast_copy_format_stats(const FastCopyStats *stats, char *buffer, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FAST_COPY_H */
\ No newline at end of file
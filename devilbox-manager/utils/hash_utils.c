@@ -0,0 +1,217 @@
+/*******************************************************************************
+ * Hash Utilities Implementation
+ * XXH64 content hashing for backup manifests and verification
+ *******************************************************************************/
+
+ #include "hash_utils.h"
+ #include <string.h>
+ 
+ #define PRIME64_1 0x9E3779B185EBCA87ULL
+ #define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+ #define PRIME64_3 0x165667B19E3779F9ULL
+ #define PRIME64_4 0x85EBCA77C2B2AE63ULL
+ #define PRIME64_5 0x27D4EB2F165667C5ULL
+ 
+ // Read buffer for file hashing
+ #define HASH_FILE_BUFFER (256 * 1024)
+ 
+ #define ROTL64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+ 
+ /**
+  * Read little-endian 64-bit value
+  */
+ static ULONGLONG read64(const BYTE *p)
+ {
+     ULONGLONG v;
+     memcpy(&v, p, sizeof(v));
+     return v;
+ }
+ 
+ /**
+  * Read little-endian 32-bit value
+  */
+ static ULONGLONG read32(const BYTE *p)
+ {
+     unsigned int v;
+     memcpy(&v, p, sizeof(v));
+     return v;
+ }
+ 
+ static ULONGLONG round64(ULONGLONG acc, ULONGLONG input)
+ {
+     acc += input * PRIME64_2;
+     acc = ROTL64(acc, 31);
+     return acc * PRIME64_1;
+ }
+ 
+ static ULONGLONG merge_round64(ULONGLONG acc, ULONGLONG val)
+ {
+     acc ^= round64(0, val);
+     return acc * PRIME64_1 + PRIME64_4;
+ }
+ 
+ /**
+  * Start a streaming hash
+  */
+ void hash_init(HashState *state, ULONGLONG seed)
+ {
+     memset(state, 0, sizeof(*state));
+     state->seed = seed;
+     state->v[0] = seed + PRIME64_1 + PRIME64_2;
+     state->v[1] = seed + PRIME64_2;
+     state->v[2] = seed;
+     state->v[3] = seed - PRIME64_1;
+ }
+ 
+ /**
+  * Add data to a streaming hash
+  */
+ void hash_update(HashState *state, const void *data, size_t len)
+ {
+     const BYTE *p = (const BYTE *)data;
+     const BYTE *end = p + len;
+ 
+     state->total_len += len;
+ 
+     // Not enough for a full stripe yet
+     if (state->mem_size + len < 32)
+     {
+         memcpy(state->mem + state->mem_size, p, len);
+         state->mem_size += (unsigned int)len;
+         return;
+     }
+ 
+     // Complete the buffered stripe first
+     if (state->mem_size)
+     {
+         memcpy(state->mem + state->mem_size, p, 32 - state->mem_size);
+         p += 32 - state->mem_size;
+         state->v[0] = round64(state->v[0], read64(state->mem));
+         state->v[1] = round64(state->v[1], read64(state->mem + 8));
+         state->v[2] = round64(state->v[2], read64(state->mem + 16));
+         state->v[3] = round64(state->v[3], read64(state->mem + 24));
+         state->mem_size = 0;
+     }
+ 
+     // Four independent lanes let the CPU overlap the multiplications
+     while (p + 32 <= end)
+     {
+         state->v[0] = round64(state->v[0], read64(p));
+         state->v[1] = round64(state->v[1], read64(p + 8));
+         state->v[2] = round64(state->v[2], read64(p + 16));
+         state->v[3] = round64(state->v[3], read64(p + 24));
+         p += 32;
+     }
+ 
+     if (p < end)
+     {
+         memcpy(state->mem, p, end - p);
+         state->mem_size = (unsigned int)(end - p);
+     }
+ }
+ 
+ /**
+  * Get the hash of all data added so far
+  */
+ ULONGLONG hash_final(const HashState *state)
+ {
+     const BYTE *p = state->mem;
+     const BYTE *end = p + state->mem_size;
+     ULONGLONG h;
+ 
+     if (state->total_len >= 32)
+     {
+         h = ROTL64(state->v[0], 1) + ROTL64(state->v[1], 7) +
+             ROTL64(state->v[2], 12) + ROTL64(state->v[3], 18);
+         h = merge_round64(h, state->v[0]);
+         h = merge_round64(h, state->v[1]);
+         h = merge_round64(h, state->v[2]);
+         h = merge_round64(h, state->v[3]);
+     }
+     else
+     {
+         h = state->seed + PRIME64_5;
+     }
+ 
+     h += state->total_len;
+ 
+     while (p + 8 <= end)
+     {
+         h ^= round64(0, read64(p));
+         h = ROTL64(h, 27) * PRIME64_1 + PRIME64_4;
+         p += 8;
+     }
+ 
+     if (p + 4 <= end)
+     {
+         h ^= read32(p) * PRIME64_1;
+         h = ROTL64(h, 23) * PRIME64_2 + PRIME64_3;
+         p += 4;
+     }
+ 
+     while (p < end)
+     {
+         h ^= (*p) * PRIME64_5;
+         h = ROTL64(h, 11) * PRIME64_1;
+         p++;
+     }
+ 
+     h ^= h >> 33;
+     h *= PRIME64_2;
+     h ^= h >> 29;
+     h *= PRIME64_3;
+     h ^= h >> 32;
+ 
+     return h;
+ }
+ 
+ /**
+  * Hash a buffer in one call
+  */
+ ULONGLONG hash_buffer(const void *data, size_t len, ULONGLONG seed)
+ {
+     HashState state;
+     hash_init(&state, seed);
+     hash_update(&state, data, len);
+     return hash_final(&state);
+ }
+ 
+ /**
+  * Hash the content of a file
+  */
+ BOOL hash_file(const char *path, ULONGLONG *hash, ULONGLONG *size)
+ {
+     HashState state;
+     DWORD read = 0;
+     BOOL ok = TRUE;
+ 
+     HANDLE hFile = CreateFile(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                               OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+     if (hFile == INVALID_HANDLE_VALUE)
+         return FALSE;
+ 
+     BYTE *buffer = (BYTE *)malloc(HASH_FILE_BUFFER);
+     if (!buffer)
+     {
+         CloseHandle(hFile);
+         return FALSE;
+     }
+ 
+     hash_init(&state, 0);
+     while ((ok = ReadFile(hFile, buffer, HASH_FILE_BUFFER, &read, NULL)) && read > 0)
+     {
+         hash_update(&state, buffer, read);
+     }
+ 
+     free(buffer);
+     CloseHandle(hFile);
+ 
+     if (!ok)
+         return FALSE;
+ 
+     *hash = hash_final(&state);
+     if (size)
+         *size = state.total_len;
+ 
+     return TRUE;
+ }
\ No newline at end of file
@@ -0,0 +1,68 @@
+/*******************************************************************************
+ * Hash Utilities Header
+ * XXH64 content hashing for backup manifests and verification
+ *******************************************************************************/
+#ifndef HASH_UTILS_H
+#define HASH_UTILS_H
+
+#include <windows.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Streaming hash state
+typedef struct
+{
+    ULONGLONG total_len;
+    ULONGLONG v[4];
+    BYTE mem[32];
+    unsigned int mem_size;
+    ULONGLONG seed;
+} HashState;
+
+/**
+ * Start a streaming hash
+ * @param state State to initialize
+ * @param seed Hash seed
+ */
+void hash_init(HashState *state, ULONGLONG seed);
+
+/**
+ * Add data to a streaming hash
+ * @param state Hash state
+ * @param data Data to add
+ * @param len Length of the data in bytes
+ */
+void hash_update(HashState *state, const void *data, size_t len);
+
+/**
+ * Get the hash of all data added so far
+ * @param state Hash state
+ * @return 64-bit hash
+ */
+ULONGLONG hash_final(const HashState *state);
+
+/**
+ * Hash a buffer in one call
+ * @param data Data to hash
+ * @param len Length of the data in bytes
+ * @param seed Hash seed
+ * @return 64-bit hash
+ */
+ULONGLONG hash_buffer(const void *data, size_t len, ULONGLONG seed);
+
+/**
+ * Hash the content of a file
+ * @param path File to hash
+ * @param hash Receives the hash
+ * @param size Receives the number of bytes hashed (may be NULL)
+ * @return TRUE on success
+ */
+BOOL hash_file(const char *path, ULONGLONG *hash, ULONGLONG *size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HASH_UTILS_H */
\ No newline at end of file
@@ -0,0 +1,659 @@
+/*******************************************************************************
+ * Hosts Sync Module Implementation
+ * Keeps the Windows hosts file in sync with Devilbox projects and verifies
+ * that every project vhost resolves
+ *******************************************************************************/
+
+ #include <winsock2.h>
+ #include <ws2tcpip.h>
+ #include "hosts_sync.h"
+ #include <stdio.h>
+ #include <string.h>
+ #include <ctype.h>
+ 
+ // Maximum number of concurrent resolver threads
+ #define RESOLVE_MAX_WORKERS 8
+ // Number of slots in the resolver cache (direct mapped)
+ #define RESOLVE_CACHE_SIZE 256
+ // Maximum host name length
+ #define MAX_HOST_LEN 256
+ 
+ // Resolution status of a single vhost
+ enum
+ {
+     RESOLVE_PENDING = 0,
+     RESOLVE_OK,
+     RESOLVE_MISMATCH,
+     RESOLVE_FAILED
+ };
+ 
+ // Host name to address mapping found in the hosts file
+ typedef struct
+ {
+     const char *name;
+     const char *ip;
+     BOOL used;
+ } HostsMapping;
+ 
+ // Open addressing table of host mappings, keyed by lowercase name
+ typedef struct
+ {
+     HostsMapping *slots;
+     size_t mask;
+ } HostsTable;
+ 
+ // Hosts file line, kept as-is for the rewrite
+ typedef struct
+ {
+     size_t offset;
+     size_t length;
+     BOOL managed;
+ } HostsLine;
+ 
+ // Resolver cache entry
+ typedef struct
+ {
+     char name[MAX_HOST_LEN];
+     char addr[64];
+     int status;
+     DWORD stamp;
+ } ResolveCacheEntry;
+ 
+ // Batch of vhosts shared between the caller and resolver threads
+ typedef struct
+ {
+     volatile LONG refs;
+     volatile LONG next;
+     int count;
+     char ip[64];
+     char (*vhosts)[MAX_HOST_LEN];
+     volatile LONG *status;
+ } ResolveBatch;
+ 
+ static ResolveCacheEntry resolve_cache[RESOLVE_CACHE_SIZE];
+ static CRITICAL_SECTION resolve_lock;
+ static BOOL resolver_ready = FALSE;
+ 
+ // Forward declarations of internal functions
+ static unsigned long hash_host_name(const char *name);
+ static HostsMapping *hosts_table_find(HostsTable *table, const char *name);
+ static void hosts_table_insert(HostsTable *table, const char *name, const char *ip);
+ static void format_vhost(char *vhost, size_t size, const char *name, const char *tld);
+ static void resolver_init(void);
+ static void resolver_flush(void);
+ static int resolve_vhost_cached(const char *vhost, const char *ip);
+ static DWORD WINAPI resolve_worker(LPVOID param);
+ static void release_batch(ResolveBatch *batch);
+ 
+ /**
+  * Get the path of the system hosts file
+  */
+ void get_hosts_file_path(char *path, size_t size)
+ {
+     if (!ExpandEnvironmentStrings("%SystemRoot%\\System32\\drivers\\etc\\hosts", path, (DWORD)size) ||
+         strchr(path, '%'))
+     {
+         snprintf(path, size, "C:\\Windows\\System32\\drivers\\etc\\hosts");
+     }
+ }
+ 
+ /**
+  * Case-insensitive FNV-1a hash of a host name
+  */
+ static unsigned long hash_host_name(const char *name)
+ {
+     unsigned long hash = 2166136261UL;
+ 
+     while (*name)
+     {
+         hash ^= (unsigned char)tolower((unsigned char)*name++);
+         hash *= 16777619UL;
+     }
+ 
+     return hash;
+ }
+ 
+ /**
+  * Find a host mapping in the table
+  */
+ static HostsMapping *hosts_table_find(HostsTable *table, const char *name)
+ {
+     size_t i = hash_host_name(name) & table->mask;
+ 
+     while (table->slots[i].name)
+     {
+         if (_stricmp(table->slots[i].name, name) == 0)
+             return &table->slots[i];
+         i = (i + 1) & table->mask;
+     }
+ 
+     return NULL;
+ }
+ 
+ /**
+  * Insert a host mapping, the first mapping of a name wins like in the resolver
+  */
+ static void hosts_table_insert(HostsTable *table, const char *name, const char *ip)
+ {
+     size_t i = hash_host_name(name) & table->mask;
+ 
+     while (table->slots[i].name)
+     {
+         if (_stricmp(table->slots[i].name, name) == 0)
+             return;
+         i = (i + 1) & table->mask;
+     }
+ 
+     table->slots[i].name = name;
+     table->slots[i].ip = ip;
+     table->slots[i].used = FALSE;
+ }
+ 
+ /**
+  * Build the lowercase vhost name of a project
+  */
+ static void format_vhost(char *vhost, size_t size, const char *name, const char *tld)
+ {
+     snprintf(vhost, size, "%s.%s", name, tld);
+ 
+     for (char *p = vhost; *p; p++)
+     {
+         *p = (char)tolower((unsigned char)*p);
+     }
+ }
+ 
+ /**
+  * Bring the managed block of the hosts file in line with the projects list
+  */
+ BOOL sync_hosts_entries(const char *const *names, int count, const char *tld,
+                         const char *ip, HostsSyncReport *report)
+ {
+     char hosts_path[MAX_PATH_LEN];
+     char tmp_path[MAX_PATH_LEN];
+     char vhost[MAX_HOST_LEN];
+     char *raw = NULL;
+     char *work = NULL;
+     char *output = NULL;
+     HostsLine *lines = NULL;
+     HostsTable external = {0};
+     HostsTable managed = {0};
+     size_t size = 0;
+     size_t line_count = 0;
+     size_t out_len = 0;
+     size_t max_lines = 1;
+     size_t max_names = 0;
+     size_t slots = 64;
+     size_t pos = 0;
+     char *block = NULL;
+     size_t block_cap = 0;
+     size_t block_len = 0;
+     int entries = 0;
+     BOOL in_block = FALSE;
+     BOOL ok = FALSE;
+     DWORD written = 0;
+     HANDLE hFile;
+     BOOL result = FALSE;
+ 
+     report->added = report->updated = report->removed = report->conflicts = 0;
+     report->written = FALSE;
+     report->error = 0;
+ 
+     get_hosts_file_path(hosts_path, sizeof(hosts_path));
+     snprintf(tmp_path, sizeof(tmp_path), "%s.devilbox.tmp", hosts_path);
+ 
+     // Read the whole hosts file at once. Only a missing file counts as empty:
+     // a file that cannot be read in full would lose its user entries on rewrite.
+     hFile = CreateFile(hosts_path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                        NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+     if (hFile != INVALID_HANDLE_VALUE)
+     {
+         LARGE_INTEGER file_size;
+         DWORD read = 0;
+ 
+         if (!GetFileSizeEx(hFile, &file_size))
+             report->error = GetLastError();
+         else if (file_size.QuadPart >= 64 * 1024 * 1024)
+             report->error = ERROR_FILE_TOO_LARGE;
+         else
+         {
+             size = (size_t)file_size.QuadPart;
+             raw = (char *)malloc(size + 1);
+             if (!raw)
+                 report->error = ERROR_NOT_ENOUGH_MEMORY;
+             else if (!ReadFile(hFile, raw, (DWORD)size, &read, NULL))
+                 report->error = GetLastError();
+             else if (read < size)
+                 report->error = ERROR_HANDLE_EOF;
+         }
+         CloseHandle(hFile);
+ 
+         if (report->error)
+         {
+             free(raw);
+             return FALSE;
+         }
+     }
+     else if (GetLastError() != ERROR_FILE_NOT_FOUND)
+     {
+         report->error = GetLastError();
+         return FALSE;
+     }
+ 
+     if (!raw)
+         raw = (char *)malloc(1);
+     work = (char *)malloc(size + 1);
+     if (!raw || !work)
+     {
+         report->error = ERROR_NOT_ENOUGH_MEMORY;
+         goto cleanup;
+     }
+ 
+     raw[size] = '\0';
+     memcpy(work, raw, size + 1);
+ 
+     // Count lines and words to size the line array and both lookup tables
+     for (size_t i = 0; i < size; i++)
+     {
+         if (raw[i] == '\n')
+             max_lines++;
+         if (!isspace((unsigned char)raw[i]) && (i == 0 || isspace((unsigned char)raw[i - 1])))
+             max_names++;
+     }
+ 
+     while (slots < max_names * 2)
+         slots <<= 1;
+ 
+     lines = (HostsLine *)calloc(max_lines, sizeof(HostsLine));
+     external.slots = (HostsMapping *)calloc(slots, sizeof(HostsMapping));
+     managed.slots = (HostsMapping *)calloc(slots, sizeof(HostsMapping));
+     external.mask = managed.mask = slots - 1;
+     if (!lines || !external.slots || !managed.slots)
+         goto cleanup;
+ 
+     // Parse the file once: remember line boundaries and all mappings
+     while (pos < size)
+     {
+         size_t end = pos;
+         while (end < size && work[end] != '\n')
+             end++;
+ 
+         HostsLine *line = &lines[line_count++];
+         line->offset = pos;
+         line->length = (end < size ? end + 1 : end) - pos;
+ 
+         work[end] = '\0';
+         if (end > pos && work[end - 1] == '\r')
+             work[end - 1] = '\0';
+ 
+         char *text = work + pos;
+         while (*text == ' ' || *text == '\t')
+             text++;
+ 
+         if (strncmp(text, HOSTS_BLOCK_BEGIN, strlen(HOSTS_BLOCK_BEGIN)) == 0)
+         {
+             in_block = TRUE;
+             line->managed = TRUE;
+         }
+         else if (strncmp(text, HOSTS_BLOCK_END, strlen(HOSTS_BLOCK_END)) == 0)
+         {
+             in_block = FALSE;
+             line->managed = TRUE;
+         }
+         else
+         {
+             line->managed = in_block;
+ 
+             char *comment = strchr(text, '#');
+             if (comment)
+                 *comment = '\0';
+ 
+             char *address = strtok(text, " \t");
+             char *host = address ? strtok(NULL, " \t") : NULL;
+             while (host)
+             {
+                 hosts_table_insert(in_block ? &managed : &external, host, address);
+                 host = strtok(NULL, " \t");
+             }
+         }
+ 
+         pos = end + 1;
+     }
+ 
+     // A begin marker without its end would take every user line after it
+     // into the block and the rewrite would drop them: leave the file alone
+     if (in_block)
+     {
+         report->error = ERROR_INVALID_DATA;
+         goto cleanup;
+     }
+ 
+     // Build the new managed block
+     block_cap = 128 + (size_t)count * (MAX_HOST_LEN + 80);
+     block = (char *)malloc(block_cap);
+     if (!block)
+         goto cleanup;
+ 
+     block_len += snprintf(block + block_len, block_cap - block_len, "%s\r\n", HOSTS_BLOCK_BEGIN);
+ 
+     for (int i = 0; i < count; i++)
+     {
+         format_vhost(vhost, sizeof(vhost), names[i], tld);
+ 
+         HostsMapping *mapping = hosts_table_find(&external, vhost);
+         if (mapping)
+         {
+             // A user entry outside our block takes precedence, leave it alone
+             if (strcmp(mapping->ip, ip) != 0)
+                 report->conflicts++;
+             continue;
+         }
+ 
+         mapping = hosts_table_find(&managed, vhost);
+         if (!mapping)
+             report->added++;
+         else if (strcmp(mapping->ip, ip) != 0)
+             report->updated++;
+ 
+         if (mapping)
+             mapping->used = TRUE;
+ 
+         block_len += snprintf(block + block_len, block_cap - block_len, "%s\t%s\r\n", ip, vhost);
+         entries++;
+     }
+ 
+     block_len += snprintf(block + block_len, block_cap - block_len, "%s\r\n", HOSTS_BLOCK_END);
+ 
+     for (size_t i = 0; i <= managed.mask; i++)
+     {
+         if (managed.slots[i].name && !managed.slots[i].used)
+             report->removed++;
+     }
+ 
+     // Nothing to do if the block already matches
+     if (report->added == 0 && report->updated == 0 && report->removed == 0)
+     {
+         free(block);
+         result = TRUE;
+         goto cleanup;
+     }
+ 
+     // Assemble the new file: unmanaged lines followed by the managed block
+     output = (char *)malloc(size + block_len + 3);
+     if (!output)
+     {
+         free(block);
+         goto cleanup;
+     }
+ 
+     for (size_t i = 0; i < line_count; i++)
+     {
+         if (lines[i].managed)
+             continue;
+         memcpy(output + out_len, raw + lines[i].offset, lines[i].length);
+         out_len += lines[i].length;
+     }
+ 
+     if (out_len > 0 && output[out_len - 1] != '\n')
+     {
+         output[out_len++] = '\r';
+         output[out_len++] = '\n';
+     }
+ 
+     if (entries > 0)
+     {
+         memcpy(output + out_len, block, block_len);
+         out_len += block_len;
+     }
+     free(block);
+ 
+     // Write a temporary file next to the hosts file and swap it in atomically
+     hFile = CreateFile(tmp_path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                        FILE_ATTRIBUTE_NORMAL, NULL);
+     if (hFile == INVALID_HANDLE_VALUE)
+     {
+         report->error = GetLastError();
+         goto cleanup;
+     }
+ 
+     ok = WriteFile(hFile, output, (DWORD)out_len, &written, NULL) &&
+               written == out_len && FlushFileBuffers(hFile);
+     if (!ok)
+         report->error = GetLastError();
+     CloseHandle(hFile);
+ 
+     if (ok)
+     {
+         // ReplaceFile keeps the ACL and attributes of the original hosts file
+         if (size > 0 || GetFileAttributes(hosts_path) != INVALID_FILE_ATTRIBUTES)
+             ok = ReplaceFile(hosts_path, tmp_path, NULL, REPLACEFILE_WRITE_THROUGH, NULL, NULL);
+         else
+             ok = MoveFileEx(tmp_path, hosts_path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+ 
+         if (!ok)
+             report->error = GetLastError();
+     }
+ 
+     if (!ok)
+     {
+         DeleteFile(tmp_path);
+         goto cleanup;
+     }
+ 
+     report->written = TRUE;
+     result = TRUE;
+ 
+     // Cached lookups predate the new entries
+     resolver_flush();
+ 
+ cleanup:
+     free(raw);
+     free(work);
+     free(output);
+     free(lines);
+     free(external.slots);
+     free(managed.slots);
+     return result;
+ }
+ 
+ /**
+  * Initialize the resolver cache and Winsock once
+  */
+ static void resolver_init(void)
+ {
+     if (resolver_ready)
+         return;
+ 
+     WSADATA wsa;
+     WSAStartup(MAKEWORD(2, 2), &wsa);
+     InitializeCriticalSection(&resolve_lock);
+     memset(resolve_cache, 0, sizeof(resolve_cache));
+     resolver_ready = TRUE;
+ }
+ 
+ /**
+  * Drop all cached lookups
+  */
+ static void resolver_flush(void)
+ {
+     if (!resolver_ready)
+         return;
+ 
+     EnterCriticalSection(&resolve_lock);
+     memset(resolve_cache, 0, sizeof(resolve_cache));
+     LeaveCriticalSection(&resolve_lock);
+ }
+ 
+ /**
+  * Resolve a vhost, answering from the cache while the entry is fresh
+  */
+ static int resolve_vhost_cached(const char *vhost, const char *ip)
+ {
+     ResolveCacheEntry *entry = &resolve_cache[hash_host_name(vhost) % RESOLVE_CACHE_SIZE];
+     char addr[64] = {0};
+     int status;
+ 
+     EnterCriticalSection(&resolve_lock);
+     if (entry->status != RESOLVE_PENDING && strcmp(entry->name, vhost) == 0 &&
+         GetTickCount() - entry->stamp < HOSTS_RESOLVE_CACHE_TTL)
+     {
+         status = entry->status;
+         strcpy(addr, entry->addr);
+         LeaveCriticalSection(&resolve_lock);
+ 
+         // The expected address may differ between calls
+         if (status != RESOLVE_FAILED)
+             status = strcmp(addr, ip) == 0 ? RESOLVE_OK : RESOLVE_MISMATCH;
+         return status;
+     }
+     LeaveCriticalSection(&resolve_lock);
+ 
+     struct addrinfo hints;
+     struct addrinfo *res = NULL;
+     memset(&hints, 0, sizeof(hints));
+     hints.ai_family = AF_INET;
+     hints.ai_socktype = SOCK_STREAM;
+ 
+     status = RESOLVE_FAILED;
+     if (getaddrinfo(vhost, NULL, &hints, &res) == 0)
+     {
+         status = RESOLVE_MISMATCH;
+         for (struct addrinfo *ai = res; ai; ai = ai->ai_next)
+         {
+             const char *text = inet_ntoa(((struct sockaddr_in *)ai->ai_addr)->sin_addr);
+             if (!text)
+                 continue;
+             if (!addr[0] || strcmp(text, ip) == 0)
+                 snprintf(addr, sizeof(addr), "%s", text);
+             if (strcmp(text, ip) == 0)
+             {
+                 status = RESOLVE_OK;
+                 break;
+             }
+         }
+         freeaddrinfo(res);
+     }
+ 
+     EnterCriticalSection(&resolve_lock);
+     snprintf(entry->name, sizeof(entry->name), "%s", vhost);
+     snprintf(entry->addr, sizeof(entry->addr), "%s", addr);
+     entry->status = status;
+     entry->stamp = GetTickCount();
+     LeaveCriticalSection(&resolve_lock);
+ 
+     return status;
+ }
+ 
+ /**
+  * Drop a reference to a resolve batch, freeing it with the last one
+  */
+ static void release_batch(ResolveBatch *batch)
+ {
+     if (InterlockedDecrement(&batch->refs) == 0)
+     {
+         free(batch->vhosts);
+         free((void *)batch->status);
+         free(batch);
+     }
+ }
+ 
+ /**
+  * Resolver thread: takes vhosts from the shared batch until it is drained
+  */
+ static DWORD WINAPI resolve_worker(LPVOID param)
+ {
+     ResolveBatch *batch = (ResolveBatch *)param;
+     LONG i;
+ 
+     while ((i = InterlockedIncrement(&batch->next) - 1) < batch->count)
+     {
+         InterlockedExchange(&batch->status[i], resolve_vhost_cached(batch->vhosts[i], batch->ip));
+     }
+ 
+     release_batch(batch);
+     return 0;
+ }
+ 
+ /**
+  * Resolve all project vhosts concurrently through a cached resolver
+  */
+ int verify_vhosts_resolution(const char *const *names, int count, const char *tld,
+                              const char *ip, DWORD timeout_ms, HostsSyncReport *report)
+ {
+     HANDLE threads[RESOLVE_MAX_WORKERS];
+     int thread_count = 0;
+ 
+     report->resolved = report->mismatched = report->unresolved = 0;
+     report->failed[0] = '\0';
+ 
+     if (count <= 0)
+         return 0;
+ 
+     resolver_init();
+ 
+     ResolveBatch *batch = (ResolveBatch *)calloc(1, sizeof(ResolveBatch));
+     if (!batch)
+         return 0;
+ 
+     batch->vhosts = (char (*)[MAX_HOST_LEN])calloc(count, MAX_HOST_LEN);
+     batch->status = (volatile LONG *)calloc(count, sizeof(LONG));
+     if (!batch->vhosts || !batch->status)
+     {
+         free(batch->vhosts);
+         free((void *)batch->status);
+         free(batch);
+         return 0;
+     }
+ 
+     batch->count = count;
+     batch->refs = 1;
+     snprintf(batch->ip, sizeof(batch->ip), "%s", ip);
+     for (int i = 0; i < count; i++)
+     {
+         format_vhost(batch->vhosts[i], MAX_HOST_LEN, names[i], tld);
+     }
+ 
+     // Lookups block in the system resolver, so run them on a few threads
+     int workers = count < RESOLVE_MAX_WORKERS ? count : RESOLVE_MAX_WORKERS;
+     for (int i = 0; i < workers; i++)
+     {
+         InterlockedIncrement(&batch->refs);
+         threads[thread_count] = CreateThread(NULL, 0, resolve_worker, batch, 0, NULL);
+         if (threads[thread_count])
+             thread_count++;
+         else
+             InterlockedDecrement(&batch->refs);
+     }
+ 
+     // Slow lookups are reported as unresolved, their threads finish on their own
+     if (thread_count > 0)
+         WaitForMultipleObjects(thread_count, threads, TRUE, timeout_ms);
+     else
+         resolve_worker((InterlockedIncrement(&batch->refs), batch));
+ 
+     for (int i = 0; i < thread_count; i++)
+     {
+         CloseHandle(threads[i]);
+     }
+ 
+     for (int i = 0; i < count; i++)
+     {
+         LONG status = batch->status[i];
+         if (status == RESOLVE_OK)
+         {
+             report->resolved++;
+             continue;
+         }
+ 
+         if (status == RESOLVE_MISMATCH)
+             report->mismatched++;
+         else
+             report->unresolved++;
+ 
+         size_t len = strlen(report->failed);
+         snprintf(report->failed + len, sizeof(report->failed) - len, "%s%s",
+                  len ? ", " : "", batch->vhosts[i]);
+     }
+ 
+     release_batch(batch);
+     return report->resolved;
+ }
\ No newline at end of file
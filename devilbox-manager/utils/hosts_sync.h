@@ -0,0 +1,83 @@
+/*******************************************************************************
+ * Hosts Sync Module Header
+ * Keeps the Windows hosts file in sync with Devilbox projects and verifies
+ * that every project vhost resolves
+ *******************************************************************************/
+#ifndef HOSTS_SYNC_H
+#define HOSTS_SYNC_H
+
+#include <windows.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Maximum path length constant (if not already defined)
+#ifndef MAX_PATH_LEN
+#define MAX_PATH_LEN 260
+#endif
+
+// Markers of the block managed by DevilboxManager inside the hosts file
+#define HOSTS_BLOCK_BEGIN "# BEGIN DevilboxManager"
+#define HOSTS_BLOCK_END "# END DevilboxManager"
+
+// Default address for project vhosts when LOCAL_LISTEN_ADDR is empty
+#define HOSTS_DEFAULT_IP "127.0.0.1"
+
+// Resolver cache entry lifetime in milliseconds
+#define HOSTS_RESOLVE_CACHE_TTL 30000
+
+// Hosts sync and verification report
+typedef struct
+{
+    int added;       // Entries added to the managed block
+    int updated;     // Entries in the managed block pointing to a wrong address
+    int removed;     // Entries of projects that no longer exist
+    int conflicts;   // Names mapped to another address outside the managed block
+    BOOL written;    // Hosts file was rewritten
+    DWORD error;     // Win32 error code of the failed read or write (0 on success)
+
+    int resolved;    // Vhosts resolving to the expected address
+    int mismatched;  // Vhosts resolving to another address
+    int unresolved;  // Vhosts that failed to resolve or timed out
+    char failed[1024]; // Comma separated list of vhosts that did not verify
+} HostsSyncReport;
+
+/**
+ * Get the path of the system hosts file
+ * @param path Buffer receiving the path
+ * @param size Size of the buffer
+ */
+void get_hosts_file_path(char *path, size_t size);
+
+/**
+ * Bring the managed block of the hosts file in line with the projects list.
+ * The hosts file is parsed once and rewritten atomically only if needed.
+ * @param names Project names (directory names under data/www)
+ * @param count Number of project names
+ * @param tld TLD_SUFFIX from .env (e.g. "loc")
+ * @param ip Address the vhosts must point to
+ * @param report Report to fill
+ * @return TRUE if the hosts file is up to date after the call
+ */
+BOOL sync_hosts_entries(const char *const *names, int count, const char *tld,
+                        const char *ip, HostsSyncReport *report);
+
+/**
+ * Resolve all project vhosts concurrently through a cached resolver
+ * @param names Project names
+ * @param count Number of project names
+ * @param tld TLD_SUFFIX from .env
+ * @param ip Expected address of the vhosts
+ * @param timeout_ms Overall time limit for the verification
+ * @param report Report to fill
+ * @return Number of vhosts resolving to the expected address
+ */
+int verify_vhosts_resolution(const char *const *names, int count, const char *tld,
+                             const char *ip, DWORD timeout_ms, HostsSyncReport *report);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HOSTS_SYNC_H */
\ No newline at end of file
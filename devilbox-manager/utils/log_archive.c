@@ -0,0 +1,343 @@
+/*******************************************************************************
+ * Log Archive Module Implementation
+ * Seek points into gzip archives, saved next to them
+ *******************************************************************************/
+
+ #include "log_archive.h"
+ #include "deflate.h"
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ 
+ #define LOG_ARCHIVE_MAGIC "DBXSEEK1"
+ 
+ // Seek point file header, followed by the points
+ typedef struct
+ {
+     char magic[8];
+     ULONGLONG archive_size;  // Compressed size and write time of the archive
+     ULONGLONG archive_time;
+     ULONGLONG size;          // Decompressed size
+     ULONGLONG count;         // Points in the file
+ } LogArchiveHeader;
+ 
+ struct LogArchive
+ {
+     char path[MAX_PATH_LEN]; // Seek point file
+     HANDLE file;
+     LogArchiveHeader header;
+     InflatePoint *points;    // By output offset; the start of the file comes before the first
+     size_t count;
+     size_t capacity;
+     char *buffer;            // Last span read
+     size_t buffer_capacity;
+     ULONGLONG buffer_start;
+     size_t buffer_length;
+     size_t filled;
+     BOOL buffered;
+ };
+ 
+ static BOOL read_stamp(HANDLE file, LogArchiveHeader *header);
+ static BOOL load_points(LogArchive *archive);
+ static BOOL points_valid(const LogArchive *archive, const LogArchiveHeader *header);
+ static BOOL find_points(LogArchive *archive);
+ static void save_points(LogArchive *archive);
+ static BOOL add_point(void *context, const InflatePoint *point);
+ static BOOL fill_span(void *context, const BYTE *data, size_t len);
+ 
+ BOOL log_archive_supported(const char *name)
+ {
+     size_t length = strlen(name);
+ 
+     return length >= 3 && _stricmp(name + length - 3, ".gz") == 0;
+ }
+ 
+ LogArchive *log_archive_open(const char *path)
+ {
+     LogArchive *archive = (LogArchive *)calloc(1, sizeof(LogArchive));
+ 
+     if (!archive)
+         return NULL;
+ 
+     archive->file = CreateFile(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                                OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+     if (archive->file == INVALID_HANDLE_VALUE)
+     {
+         free(archive);
+         return NULL;
+     }
+     if (!read_stamp(archive->file, &archive->header))
+     {
+         log_archive_close(archive);
+         return NULL;
+     }
+ 
+     snprintf(archive->path, sizeof(archive->path), "%s%s", path, LOG_ARCHIVE_SUFFIX);
+     memcpy(archive->header.magic, LOG_ARCHIVE_MAGIC, sizeof(archive->header.magic));
+ 
+     // Archives are written once, the points stay valid while size and time match
+     if (!load_points(archive))
+     {
+         if (!find_points(archive))
+         {
+             log_archive_close(archive);
+             return NULL;
+         }
+         save_points(archive);
+     }
+     return archive;
+ }
+ 
+ LogArchive *log_archive_clone(const LogArchive *archive)
+ {
+     LogArchive *clone = (LogArchive *)calloc(1, sizeof(LogArchive));
+     char path[MAX_PATH_LEN];
+     LogArchiveHeader stamp;
+ 
+     if (!clone)
+         return NULL;
+ 
+     // Decompressing moves the file position, so each clone opens the archive itself
+     snprintf(path, sizeof(path), "%.*s", (int)(strlen(archive->path) - strlen(LOG_ARCHIVE_SUFFIX)), archive->path);
+     clone->file = CreateFile(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+     if (clone->file == INVALID_HANDLE_VALUE)
+     {
+         free(clone);
+         return NULL;
+     }
+ 
+     // Another archive under the name since: the points belong to the old one
+     clone->header = archive->header;
+     if (!read_stamp(clone->file, &stamp) || stamp.archive_size != archive->header.archive_size ||
+         stamp.archive_time != archive->header.archive_time)
+     {
+         log_archive_close(clone);
+         return NULL;
+     }
+     if (archive->count > 0)
+     {
+         clone->points = (InflatePoint *)malloc(archive->count * sizeof(InflatePoint));
+         if (!clone->points)
+         {
+             log_archive_close(clone);
+             return NULL;
+         }
+         memcpy(clone->points, archive->points, archive->count * sizeof(InflatePoint));
+     }
+     strcpy(clone->path, archive->path);
+     clone->count = clone->capacity = archive->count;
+     return clone;
+ }
+ 
+ ULONGLONG log_archive_size(const LogArchive *archive)
+ {
+     return archive->header.size;
+ }
+ 
+ const char *log_archive_read(LogArchive *archive, ULONGLONG offset, ULONGLONG *start, size_t *length)
+ {
+     size_t low = 0, high = archive->count;
+     const InflatePoint *point;
+     ULONGLONG end;
+ 
+     if (offset >= archive->header.size)
+         return NULL;
+ 
+     if (!archive->buffered || offset < archive->buffer_start ||
+         offset >= archive->buffer_start + archive->buffer_length)
+     {
+         // The last point at or before the offset, up to the next one
+         while (low < high)
+         {
+             size_t mid = low + (high - low) / 2;
+ 
+             if (archive->points[mid].output <= offset)
+                 low = mid + 1;
+             else
+                 high = mid;
+         }
+         point = low > 0 ? &archive->points[low - 1] : NULL;
+         end = low < archive->count ? archive->points[low].output : archive->header.size;
+ 
+         archive->buffered = FALSE;
+         archive->buffer_start = point ? point->output : 0;
+         archive->buffer_length = (size_t)(end - archive->buffer_start);
+         if (archive->buffer_length > archive->buffer_capacity)
+         {
+             char *grown = (char *)realloc(archive->buffer, archive->buffer_length);
+ 
+             if (!grown)
+                 return NULL;
+             archive->buffer = grown;
+             archive->buffer_capacity = archive->buffer_length;
+         }
+ 
+         archive->filled = 0;
+         if (!inflate_gzip_resume(archive->file, point, fill_span, archive) ||
+             archive->filled != archive->buffer_length)
+             return NULL;
+         archive->buffered = TRUE;
+     }
+ 
+     *start = archive->buffer_start;
+     *length = archive->buffer_length;
+     return archive->buffer;
+ }
+ 
+ void log_archive_close(LogArchive *archive)
+ {
+     if (!archive)
+         return;
+ 
+     CloseHandle(archive->file);
+     free(archive->points);
+     free(archive->buffer);
+     free(archive);
+ }
+ 
+ /**
+  * Get the size and write time that tie a seek point file to its archive
+  */
+ static BOOL read_stamp(HANDLE file, LogArchiveHeader *header)
+ {
+     BY_HANDLE_FILE_INFORMATION info;
+ 
+     if (!GetFileInformationByHandle(file, &info))
+         return FALSE;
+ 
+     header->archive_size = ((ULONGLONG)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+     header->archive_time = ((ULONGLONG)info.ftLastWriteTime.dwHighDateTime << 32) | info.ftLastWriteTime.dwLowDateTime;
+     return TRUE;
+ }
+ 
+ /**
+  * Read the seek point file, if it belongs to this archive
+  */
+ static BOOL load_points(LogArchive *archive)
+ {
+     FILE *f = fopen(archive->path, "rb");
+     LogArchiveHeader header;
+     BOOL ok;
+ 
+     if (!f)
+         return FALSE;
+ 
+     // Points are at least a span apart
+     ok = fread(&header, sizeof(header), 1, f) == 1 &&
+          memcmp(header.magic, archive->header.magic, sizeof(header.magic)) == 0 &&
+          header.archive_size == archive->header.archive_size && header.archive_time == archive->header.archive_time &&
+          header.count <= header.size / LOG_ARCHIVE_SPAN;
+     if (ok && header.count > 0)
+     {
+         archive->points = (InflatePoint *)malloc((size_t)header.count * sizeof(InflatePoint));
+         ok = archive->points &&
+              fread(archive->points, sizeof(InflatePoint), (size_t)header.count, f) == header.count &&
+              points_valid(archive, &header);
+     }
+     fclose(f);
+ 
+     if (!ok)
+     {
+         free(archive->points);
+         archive->points = NULL;
+         return FALSE;
+     }
+     archive->header = header;
+     archive->count = archive->capacity = (size_t)header.count;
+     return TRUE;
+ }
+ 
+ /**
+  * Check loaded points before resuming from them: a damaged file must not make
+  * the decompressor copy more history than the window holds or read outside
+  * the archive. One bad point discards them all.
+  */
+ static BOOL points_valid(const LogArchive *archive, const LogArchiveHeader *header)
+ {
+     ULONGLONG output = 0, input = 0;
+ 
+     for (size_t i = 0; i < (size_t)header->count; i++)
+     {
+         const InflatePoint *point = &archive->points[i];
+ 
+         if (point->window_length > DEFLATE_WINDOW || point->window_length > point->output || point->bits >= 8 ||
+             point->output <= output || point->output > header->size || point->input < input ||
+             point->input >= header->archive_size)
+             return FALSE;
+         output = point->output;
+         input = point->input;
+     }
+     return TRUE;
+ }
+ 
+ /**
+  * Decompress the whole archive once, keeping a seek point every span
+  */
+ static BOOL find_points(LogArchive *archive)
+ {
+     LARGE_INTEGER start;
+ 
+     start.QuadPart = 0;
+     return SetFilePointerEx(archive->file, start, NULL, FILE_BEGIN) &&
+            inflate_gzip_points(archive->file, LOG_ARCHIVE_SPAN, add_point, archive, &archive->header.size);
+ }
+ 
+ /**
+  * Write the seek point file; without it the points are found again next time.
+  * It is written under a name of its own and renamed into place, so a reader
+  * in another thread or process never loads a half-written file.
+  */
+ static void save_points(LogArchive *archive)
+ {
+     char temp[MAX_PATH_LEN];
+     FILE *f;
+     BOOL ok;
+ 
+     // error.log.2.gz.1234.seek: still a seek point file to the log dialogs
+     snprintf(temp, sizeof(temp), "%.*s.%lu%s", (int)(strlen(archive->path) - strlen(LOG_ARCHIVE_SUFFIX)),
+              archive->path, (unsigned long)GetCurrentThreadId(), LOG_ARCHIVE_SUFFIX);
+     f = fopen(temp, "wb");
+     if (!f)
+         return;
+ 
+     archive->header.count = archive->count;
+     ok = fwrite(&archive->header, sizeof(archive->header), 1, f) == 1 &&
+          fwrite(archive->points, sizeof(InflatePoint), archive->count, f) == archive->count;
+     if (fclose(f) != 0 || !ok || !MoveFileEx(temp, archive->path, MOVEFILE_REPLACE_EXISTING))
+         DeleteFile(temp);
+ }
+ 
+ static BOOL add_point(void *context, const InflatePoint *point)
+ {
+     LogArchive *archive = (LogArchive *)context;
+ 
+     if (archive->count == archive->capacity)
+     {
+         size_t capacity = archive->capacity ? archive->capacity * 2 : 16;
+         InflatePoint *grown = (InflatePoint *)realloc(archive->points, capacity * sizeof(InflatePoint));
+ 
+         if (!grown)
+             return FALSE;
+         archive->points = grown;
+         archive->capacity = capacity;
+     }
+ 
+     archive->points[archive->count++] = *point;
+     return TRUE;
+ }
+ 
+ /**
+  * Copy decompressed data into the span buffer, stopping when it is full
+  */
+ static BOOL fill_span(void *context, const BYTE *data, size_t len)
+ {
+     LogArchive *archive = (LogArchive *)context;
+     size_t take = archive->buffer_length - archive->filled;
+ 
+     if (take > len)
+         take = len;
+     memcpy(archive->buffer + archive->filled, data, take);
+     archive->filled += take;
+     return archive->filled < archive->buffer_length;
+ }
\ No newline at end of file
@@ -0,0 +1,81 @@
+/*******************************************************************************
+ * Log Archive Module Header
+ * Random access to gzip-compressed rotated logs: seek points recorded on the
+ * first read let any part be decompressed without starting from the top
+ *******************************************************************************/
+#ifndef LOG_ARCHIVE_H
+#define LOG_ARCHIVE_H
+
+#include <windows.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Maximum path length constant (if not already defined)
+#ifndef MAX_PATH_LEN
+#define MAX_PATH_LEN 260
+#endif
+
+// Seek point file, kept next to the archive
+#define LOG_ARCHIVE_SUFFIX ".seek"
+
+// Decompressed bytes between seek points; each costs 32 KB of history
+#define LOG_ARCHIVE_SPAN (4 * 1048576)
+
+// Compressed log opened for reading (opaque)
+typedef struct LogArchive LogArchive;
+
+/**
+ * Check whether a file name has a compression suffix that can be read
+ * @param name File name or path
+ * @return TRUE for gzip
+ */
+BOOL log_archive_supported(const char *name);
+
+/**
+ * Open a compressed log. The seek points are loaded from their file, or
+ * found by decompressing the archive once and saved for the next time; an
+ * archive changed since is decompressed again.
+ * @param path Archive path
+ * @return Archive, NULL if it cannot be opened or is not valid gzip
+ */
+LogArchive *log_archive_open(const char *path);
+
+/**
+ * Open an archive again with the seek points of an open one, for reading
+ * it from another thread without loading or finding the points again
+ * @param archive Open archive
+ * @return Archive, NULL if it cannot be opened or was replaced since
+ */
+LogArchive *log_archive_clone(const LogArchive *archive);
+
+/**
+ * Get the decompressed size of an archive
+ * @param archive Archive
+ * @return Size in bytes
+ */
+ULONGLONG log_archive_size(const LogArchive *archive);
+
+/**
+ * Decompress the span between two seek points holding an offset. The last
+ * span read is kept, reading inside it again costs nothing.
+ * @param archive Archive
+ * @param offset Decompressed offset, below the size
+ * @param start Receives the decompressed offset of the span
+ * @param length Receives the length of the span
+ * @return Span data, valid until the next read or close; NULL on failure
+ */
+const char *log_archive_read(LogArchive *archive, ULONGLONG offset, ULONGLONG *start, size_t *length);
+
+/**
+ * Close an archive
+ * @param archive Archive (may be NULL)
+ */
+void log_archive_close(LogArchive *archive);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LOG_ARCHIVE_H */
\ No newline at end of file
@@ -0,0 +1,344 @@
+/*******************************************************************************
+ * Log Groups Module Implementation
+ * Fingerprint table of log entries, updated as the log grows
+ *******************************************************************************/
+
+ #include "log_groups.h"
+ #include "hash_utils.h"
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ 
+ // Longest part of an entry read for its fingerprint
+ #define GROUP_LINE_MAX 2048
+ 
+ struct LogGroups
+ {
+     LogGroup *groups;        // In order of first appearance
+     size_t count;
+     size_t allocated;
+     DWORD *slots;            // Open addressing by fingerprint: group index + 1, 0 when free
+     size_t capacity;         // Power of two, at most half full
+     ULONGLONG entries;
+     ULONGLONG ungrouped;
+ };
+ 
+ static ULONGLONG fingerprint(const char *line, size_t length);
+ static LogGroup *find_group(LogGroups *groups, ULONGLONG fingerprint);
+ static void add_entry(LogGroups *groups, const char *line, size_t length, const LogFields *fields);
+ 
+ LogGroups *log_groups_create(void)
+ {
+     return (LogGroups *)calloc(1, sizeof(LogGroups));
+ }
+ 
+ void log_groups_add(LogGroups *groups, LogReader *reader, ULONGLONG offset, ULONGLONG end)
+ {
+     ULONGLONG lines[LOG_SCAN_BATCH];
+     LogFields fields[LOG_SCAN_BATCH];
+     char line[GROUP_LINE_MAX];
+ 
+     while (offset < end)
+     {
+         size_t count = log_reader_scan(reader, offset, end, lines, fields, LOG_SCAN_BATCH, &offset);
+ 
+         if (count == 0)
+             break;
+         for (size_t i = 0; i < count; i++)
+         {
+             if (fields[i].time)
+                 add_entry(groups, line, log_reader_get_line(reader, lines[i], line, sizeof(line), NULL), &fields[i]);
+         }
+     }
+ }
+ 
+ /**
+  * Order of groups in the top list: by count, the older one first on a tie
+  */
+ static BOOL group_less(const LogGroup *a, const LogGroup *b)
+ {
+     return a->count < b->count || (a->count == b->count && a->first_seen > b->first_seen);
+ }
+ 
+ static void sift_down(const LogGroup **heap, size_t count, size_t i)
+ {
+     for (;;)
+     {
+         size_t child = 2 * i + 1;
+         const LogGroup *swap;
+ 
+         if (child >= count)
+             break;
+         if (child + 1 < count && group_less(heap[child + 1], heap[child]))
+             child++;
+         if (!group_less(heap[child], heap[i]))
+             break;
+         swap = heap[i];
+         heap[i] = heap[child];
+         heap[child] = swap;
+         i = child;
+     }
+ }
+ 
+ size_t log_groups_top(const LogGroups *groups, const LogGroup **top, size_t max)
+ {
+     size_t count = 0;
+ 
+     // Keep the largest groups in a heap with the smallest of them on top
+     for (size_t i = 0; i < groups->count && max > 0; i++)
+     {
+         const LogGroup *group = &groups->groups[i];
+ 
+         if (count < max)
+         {
+             size_t j = count++;
+ 
+             top[j] = group;
+             while (j > 0 && group_less(top[j], top[(j - 1) / 2]))
+             {
+                 const LogGroup *swap = top[j];
+                 top[j] = top[(j - 1) / 2];
+                 top[(j - 1) / 2] = swap;
+                 j = (j - 1) / 2;
+             }
+         }
+         else if (group_less(top[0], group))
+         {
+             top[0] = group;
+             sift_down(top, count, 0);
+         }
+     }
+ 
+     // Taking the smallest off to the back leaves the largest first
+     for (size_t n = count; n > 1; n--)
+     {
+         const LogGroup *swap = top[0];
+         top[0] = top[n - 1];
+         top[n - 1] = swap;
+         sift_down(top, n - 1, 0);
+     }
+     return count;
+ }
+ 
+ size_t log_groups_count(const LogGroups *groups, ULONGLONG *entries, ULONGLONG *ungrouped)
+ {
+     if (entries)
+         *entries = groups->entries;
+     if (ungrouped)
+         *ungrouped = groups->ungrouped;
+     return groups->count;
+ }
+ 
+ void log_groups_clear(LogGroups *groups)
+ {
+     if (groups->slots)
+         memset(groups->slots, 0, groups->capacity * sizeof(DWORD));
+     groups->count = 0;
+     groups->entries = groups->ungrouped = 0;
+ }
+ 
+ void log_groups_free(LogGroups *groups)
+ {
+     if (!groups)
+         return;
+ 
+     free(groups->groups);
+     free(groups->slots);
+     free(groups);
+ }
+ 
+ static BOOL is_word(char c)
+ {
+     return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == '-';
+ }
+ 
+ /**
+  * Check whether a word is an ID: hex of some length (hashes, UUIDs) or a
+  * long mix of letters and digits (request and session IDs)
+  */
+ static BOOL is_id(const char *p, const char *end)
+ {
+     BOOL digit = FALSE, hex = TRUE;
+ 
+     for (const char *q = p; q < end; q++)
+     {
+         if (*q >= '0' && *q <= '9')
+             digit = TRUE;
+         else if (!((*q >= 'a' && *q <= 'f') || (*q >= 'A' && *q <= 'F') || *q == '-'))
+             hex = FALSE;
+     }
+     return digit && (end - p >= 16 || (hex && end - p >= 8));
+ }
+ 
+ /**
+  * Find where an entry names its file: " in /var/www/index.php on line 12"
+  * or " in /var/www/index.php:12", the end of the line when there is none
+  */
+ static const char *find_location(const char *p, const char *end)
+ {
+     for (size_t i = (size_t)(end - p); i >= 5; i--)
+     {
+         const char *q = p + i - 5;
+ 
+         // A path on the Linux side of the containers, or a Windows one with a drive letter
+         if (q[0] == ' ' && q[1] == 'i' && q[2] == 'n' && q[3] == ' ' &&
+             (q[4] == '/' || (end - q > 6 && q[5] == ':' && q[6] == '\\')))
+             return q;
+     }
+     return end;
+ }
+ 
+ /**
+  * Fingerprint of an entry: the message as a template and the location as written
+  */
+ static ULONGLONG fingerprint(const char *line, size_t length)
+ {
+     const char *p = line, *end = line + length, *location, *start;
+     char text[GROUP_LINE_MAX];
+     size_t used = 0;
+     HashState state;
+     ULONGLONG hash;
+ 
+     // Leave out the timestamp, it differs on every entry
+     if (p < end && *p == '[')
+     {
+         const char *close = (const char *)memchr(p, ']', (size_t)(end - p));
+         if (close)
+             p = close + 1;
+     }
+     start = p;
+     location = find_location(p, end);
+ 
+     while (p < location && used < sizeof(text) - 1)
+     {
+         if ((*p == '"' || *p == '\'') && (p == start || !is_word(p[-1])))
+         {
+             // A quoted value, up to its closing quote
+             const char *close = (const char *)memchr(p + 1, *p, (size_t)(location - p - 1));
+             text[used++] = '?';
+             p = close ? close + 1 : location;
+         }
+         else if (is_word(*p))
+         {
+             const char *q = p;
+ 
+             while (q < location && is_word(*q))
+                 q++;
+             if (is_id(p, q))
+                 text[used++] = '?';
+             else
+             {
+                 // Numbers become a single '#': "$v592" and "$v7" are the same variable slot
+                 for (; p < q && used < sizeof(text) - 1; p++)
+                 {
+                     if (*p < '0' || *p > '9')
+                         text[used++] = *p;
+                     else if (p == q - 1 || p[1] < '0' || p[1] > '9')
+                         text[used++] = '#';
+                 }
+             }
+             p = q;
+         }
+         else
+             text[used++] = *p++;
+     }
+ 
+     hash_init(&state, 0);
+     hash_update(&state, text, used);
+     hash_update(&state, location, (size_t)(end - location));
+     hash = hash_final(&state);
+     return hash ? hash : 1;
+ }
+ 
+ /**
+  * Double the slot table and place the groups again
+  */
+ static BOOL grow_slots(LogGroups *groups)
+ {
+     size_t capacity = groups->capacity ? groups->capacity * 2 : 1024;
+     DWORD *slots = (DWORD *)calloc(capacity, sizeof(DWORD));
+ 
+     if (!slots)
+         return FALSE;
+ 
+     for (size_t i = 0; i < groups->count; i++)
+     {
+         size_t slot = (size_t)groups->groups[i].fingerprint & (capacity - 1);
+ 
+         while (slots[slot])
+             slot = (slot + 1) & (capacity - 1);
+         slots[slot] = (DWORD)i + 1;
+     }
+ 
+     free(groups->slots);
+     groups->slots = slots;
+     groups->capacity = capacity;
+     return TRUE;
+ }
+ 
+ /**
+  * Find the group of a fingerprint, adding it when new
+  * @return Group, NULL when the table is full or out of memory
+  */
+ static LogGroup *find_group(LogGroups *groups, ULONGLONG fingerprint)
+ {
+     LogGroup *group;
+     size_t slot;
+ 
+     if ((groups->count + 1) * 2 > groups->capacity && !grow_slots(groups))
+         return NULL;
+ 
+     for (slot = (size_t)fingerprint & (groups->capacity - 1); groups->slots[slot];
+          slot = (slot + 1) & (groups->capacity - 1))
+     {
+         group = &groups->groups[groups->slots[slot] - 1];
+         if (group->fingerprint == fingerprint)
+             return group;
+     }
+ 
+     if (groups->count >= LOG_GROUPS_MAX)
+         return NULL;
+     if (groups->count == groups->allocated)
+     {
+         size_t allocated = groups->allocated ? groups->allocated * 2 : 256;
+         LogGroup *grown = (LogGroup *)realloc(groups->groups, allocated * sizeof(LogGroup));
+ 
+         if (!grown)
+             return NULL;
+         groups->groups = grown;
+         groups->allocated = allocated;
+     }
+ 
+     group = &groups->groups[groups->count];
+     memset(group, 0, sizeof(*group));
+     group->fingerprint = fingerprint;
+     groups->slots[slot] = (DWORD)++groups->count;
+     return group;
+ }
+ 
+ /**
+  * Count one entry in its group
+  */
+ static void add_entry(LogGroups *groups, const char *line, size_t length, const LogFields *fields)
+ {
+     LogGroup *group = find_group(groups, fingerprint(line, length));
+ 
+     groups->entries++;
+     if (!group)
+     {
+         groups->ungrouped++;
+         return;
+     }
+ 
+     if (group->count == 0)
+     {
+         group->first_seen = group->last_seen = fields->time;
+         group->severity = fields->severity;
+         snprintf(group->sample, sizeof(group->sample), "%.*s", (int)length, line);
+     }
+     if (fields->time < group->first_seen)
+         group->first_seen = fields->time;
+     if (fields->time > group->last_seen)
+         group->last_seen = fields->time;
+     group->count++;
+ }
\ No newline at end of file
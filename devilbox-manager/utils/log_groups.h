@@ -0,0 +1,88 @@
+/*******************************************************************************
+ * Log Groups Module Header
+ * Groups the entries of a PHP log by fingerprint, the message with numbers,
+ * quoted values and request IDs taken out plus the file:line it points at,
+ * so a warning repeated a million times shows up as one counted row
+ *******************************************************************************/
+#ifndef LOG_GROUPS_H
+#define LOG_GROUPS_H
+
+#include <windows.h>
+#include "log_reader.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Longest sample entry kept per group
+#define LOG_GROUP_SAMPLE_LEN 512
+
+// Distinct groups kept at most, further entries are only counted
+#define LOG_GROUPS_MAX 65536
+
+// Entries that share a fingerprint
+typedef struct
+{
+    ULONGLONG fingerprint;
+    ULONGLONG count;
+    ULONGLONG first_seen;    // FILETIME values of the first and the latest entry
+    ULONGLONG last_seen;
+    LogSeverity severity;
+    char sample[LOG_GROUP_SAMPLE_LEN]; // First entry of the group
+} LogGroup;
+
+// Fingerprint table of a log (opaque)
+typedef struct LogGroups LogGroups;
+
+/**
+ * Create an empty table
+ * @return Table, NULL when out of memory
+ */
+LogGroups *log_groups_create(void);
+
+/**
+ * Add the entries of part of a log. Lines without a timestamp belong to the
+ * entry above them and are not counted. Called again with the lines that
+ * were appended, the table grows without reading the log again.
+ * @param groups Table
+ * @param reader Reader open on the log
+ * @param offset Line start to begin at
+ * @param end Line start to stop at
+ */
+void log_groups_add(LogGroups *groups, LogReader *reader, ULONGLONG offset, ULONGLONG end);
+
+/**
+ * Get the largest groups, by count
+ * @param groups Table
+ * @param top Receives pointers to the groups, valid until the next add or clear
+ * @param max Capacity of top
+ * @return Number of groups returned
+ */
+size_t log_groups_top(const LogGroups *groups, const LogGroup **top, size_t max);
+
+/**
+ * Get the totals of a table
+ * @param groups Table
+ * @param entries Receives the number of entries added (may be NULL)
+ * @param ungrouped Receives the entries left out once LOG_GROUPS_MAX was reached (may be NULL)
+ * @return Number of groups
+ */
+size_t log_groups_count(const LogGroups *groups, ULONGLONG *entries, ULONGLONG *ungrouped);
+
+/**
+ * Remove all groups
+ * @param groups Table
+ */
+void log_groups_clear(LogGroups *groups);
+
+/**
+ * Free a table
+ * @param groups Table (may be NULL)
+ */
+void log_groups_free(LogGroups *groups);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LOG_GROUPS_H */
\ No newline at end of file
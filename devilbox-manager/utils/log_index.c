@@ -0,0 +1,243 @@
+/*******************************************************************************
+ * Log Index Module Implementation
+ * Sparse timestamp index of a PHP log, extended as the log grows
+ *******************************************************************************/
+
+ #include "log_index.h"
+ #include "hash_utils.h"
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ 
+ #define LOG_INDEX_MAGIC "DBXLIDX1"
+ 
+ // Index file header, followed by the entries
+ typedef struct
+ {
+     char magic[8];
+     ULONGLONG file_id;       // Identity of the indexed log
+     ULONGLONG head_hash;     // Hash of the first head_length bytes of the log
+     ULONGLONG indexed;       // Bytes indexed, always the end of a line
+     ULONGLONG latest;        // Latest timestamp before indexed
+     ULONGLONG count;         // Entries in the file
+     DWORD head_length;
+     DWORD pending;           // Lines since the last entry
+ } LogIndexHeader;
+ 
+ // Every line before offset has a timestamp of at most latest
+ typedef struct
+ {
+     ULONGLONG offset;
+     ULONGLONG latest;
+ } LogIndexEntry;
+ 
+ struct LogIndex
+ {
+     char path[MAX_PATH_LEN];
+     LogIndexHeader header;
+     LogIndexEntry *entries;
+     ULONGLONG count;
+     ULONGLONG capacity;
+     ULONGLONG saved;         // Entries already in the file
+     BOOL loaded;             // The file holds a valid index of this log
+ };
+ 
+ static BOOL load_index(LogIndex *index);
+ static BOOL index_matches(LogIndex *index, LogReader *reader, ULONGLONG file_id);
+ static ULONGLONG head_hash(LogReader *reader, DWORD length);
+ static void index_line(LogIndex *index, ULONGLONG offset, ULONGLONG time);
+ static void extend_index(LogIndex *index, LogReader *reader);
+ static void save_index(LogIndex *index);
+ 
+ LogIndex *log_index_open(const char *log_path, LogReader *reader)
+ {
+     LogIndex *index = (LogIndex *)calloc(1, sizeof(LogIndex));
+     ULONGLONG file_id = 0;
+ 
+     if (!index)
+         return NULL;
+ 
+     snprintf(index->path, sizeof(index->path), "%s%s", log_path, LOG_INDEX_SUFFIX);
+     log_reader_file_id(reader, &file_id);
+ 
+     // Start over unless the index covers the beginning of this very log
+     if (!load_index(index) || !index_matches(index, reader, file_id))
+     {
+         index->count = index->saved = 0;
+         index->loaded = FALSE;
+         ZeroMemory(&index->header, sizeof(index->header));
+         memcpy(index->header.magic, LOG_INDEX_MAGIC, sizeof(index->header.magic));
+         index->header.file_id = file_id;
+     }
+ 
+     extend_index(index, reader);
+     return index;
+ }
+ 
+ ULONGLONG log_index_seek(const LogIndex *index, ULONGLONG time)
+ {
+     ULONGLONG low = 0, high = index->count;
+ 
+     // Latest times never decrease, find the last entry still before the time
+     while (low < high)
+     {
+         ULONGLONG mid = low + (high - low) / 2;
+ 
+         if (index->entries[mid].latest < time)
+             low = mid + 1;
+         else
+             high = mid;
+     }
+ 
+     return low > 0 ? index->entries[low - 1].offset : 0;
+ }
+ 
+ void log_index_free(LogIndex *index)
+ {
+     if (!index)
+         return;
+ 
+     free(index->entries);
+     free(index);
+ }
+ 
+ /**
+  * Read the index file
+  */
+ static BOOL load_index(LogIndex *index)
+ {
+     FILE *f = fopen(index->path, "rb");
+     BOOL ok;
+ 
+     if (!f)
+         return FALSE;
+ 
+     ok = fread(&index->header, sizeof(index->header), 1, f) == 1 &&
+          memcmp(index->header.magic, LOG_INDEX_MAGIC, sizeof(index->header.magic)) == 0 &&
+          index->header.count <= index->header.indexed / LOG_INDEX_INTERVAL;
+     if (ok && index->header.count > 0)
+     {
+         index->entries = (LogIndexEntry *)malloc((size_t)index->header.count * sizeof(LogIndexEntry));
+         ok = index->entries &&
+              fread(index->entries, sizeof(LogIndexEntry), (size_t)index->header.count, f) == index->header.count;
+     }
+     fclose(f);
+ 
+     if (ok)
+         index->count = index->capacity = index->saved = index->header.count;
+     index->loaded = ok;
+     return ok;
+ }
+ 
+ /**
+  * Check that the index belongs to the log as it is now
+  */
+ static BOOL index_matches(LogIndex *index, LogReader *reader, ULONGLONG file_id)
+ {
+     // Copy-truncate rotation keeps the file, so check its content as well
+     return index->header.file_id == file_id && index->header.indexed <= log_reader_size(reader) &&
+            index->header.head_length <= index->header.indexed &&
+            head_hash(reader, index->header.head_length) == index->header.head_hash;
+ }
+ 
+ /**
+  * Hash the start of the log
+  */
+ static ULONGLONG head_hash(LogReader *reader, DWORD length)
+ {
+     size_t available;
+     const char *p = length ? log_reader_map(reader, 0, &available) : NULL;
+ 
+     if (!p || available < length)
+         return 0;
+     return hash_buffer(p, length, 0);
+ }
+ 
+ /**
+  * Account for one line of the log
+  */
+ static void index_line(LogIndex *index, ULONGLONG offset, ULONGLONG time)
+ {
+     if (index->header.pending >= LOG_INDEX_INTERVAL && index->count == index->capacity)
+     {
+         ULONGLONG capacity = index->capacity ? index->capacity * 2 : 1024;
+         LogIndexEntry *entries = (LogIndexEntry *)realloc(index->entries, (size_t)capacity * sizeof(LogIndexEntry));
+ 
+         // Without memory the index just gets sparser, seeks stay correct
+         if (entries)
+         {
+             index->entries = entries;
+             index->capacity = capacity;
+         }
+     }
+ 
+     if (index->header.pending >= LOG_INDEX_INTERVAL && index->count < index->capacity)
+     {
+         index->entries[index->count].offset = offset;
+         index->entries[index->count].latest = index->header.latest;
+         index->count++;
+         index->header.pending = 0;
+     }
+ 
+     if (time > index->header.latest)
+         index->header.latest = time;
+     index->header.pending++;
+ }
+ 
+ /**
+  * Index the complete lines appended since the last update and save the result
+  */
+ static void extend_index(LogIndex *index, LogReader *reader)
+ {
+     // A line still being written is left for the next update
+     ULONGLONG end = log_reader_line_start(reader, log_reader_size(reader));
+     ULONGLONG offset = index->header.indexed;
+ 
+     if (offset >= end && index->loaded)
+         return;
+ 
+     while (offset < end)
+     {
+         ULONGLONG lines[LOG_SCAN_BATCH];
+         LogFields fields[LOG_SCAN_BATCH];
+         size_t count = log_reader_scan(reader, offset, end, lines, fields, LOG_SCAN_BATCH, &offset);
+ 
+         if (count == 0)
+             break;
+         for (size_t i = 0; i < count; i++)
+             index_line(index, lines[i], fields[i].time);
+     }
+ 
+     index->header.indexed = offset;
+     index->header.head_length = offset < LOG_INDEX_HEAD ? (DWORD)offset : LOG_INDEX_HEAD;
+     index->header.head_hash = head_hash(reader, index->header.head_length);
+     index->header.count = index->count;
+     save_index(index);
+ }
+ 
+ /**
+  * Write the new entries and then the header, so an interrupted update only
+  * loses the lines it added
+  */
+ static void save_index(LogIndex *index)
+ {
+     FILE *f = index->loaded ? fopen(index->path, "r+b") : NULL;
+ 
+     if (!f)
+     {
+         f = fopen(index->path, "wb");
+         index->saved = 0;
+     }
+     if (!f)
+         return;
+ 
+     if (fseek(f, (long)(sizeof(LogIndexHeader) + index->saved * sizeof(LogIndexEntry)), SEEK_SET) == 0 &&
+         fwrite(index->entries + index->saved, sizeof(LogIndexEntry), (size_t)(index->count - index->saved), f) ==
+             index->count - index->saved &&
+         fflush(f) == 0 && fseek(f, 0, SEEK_SET) == 0)
+     {
+         index->loaded = fwrite(&index->header, sizeof(index->header), 1, f) == 1;
+         index->saved = index->count;
+     }
+     fclose(f);
+ }
\ No newline at end of file
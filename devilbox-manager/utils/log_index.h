@@ -0,0 +1,65 @@
+/*******************************************************************************
+ * Log Index Module Header
+ * Sparse on-disk index from timestamps to offsets in a PHP log, so the
+ * date/time filters of the logs viewer seek instead of reading the log
+ * from the start
+ *******************************************************************************/
+#ifndef LOG_INDEX_H
+#define LOG_INDEX_H
+
+#include <windows.h>
+#include "log_reader.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Maximum path length constant (if not already defined)
+#ifndef MAX_PATH_LEN
+#define MAX_PATH_LEN 260
+#endif
+
+// Index file, kept next to the log
+#define LOG_INDEX_SUFFIX ".index"
+
+// Lines between index entries
+#define LOG_INDEX_INTERVAL 1024
+
+// Bytes at the start of the log checked to tell a rotated log from a grown one
+#define LOG_INDEX_HEAD 512
+
+// Timestamp index of a log (opaque)
+typedef struct LogIndex LogIndex;
+
+/**
+ * Load the index of a log and bring it up to date. Lines appended since the
+ * last call are indexed and saved; an index of a rotated, truncated or
+ * replaced log is rebuilt. When the index cannot be saved it is still
+ * usable until freed.
+ * @param log_path Log file path
+ * @param reader Reader open on the log
+ * @return Index, NULL when out of memory
+ */
+LogIndex *log_index_open(const char *log_path, LogReader *reader);
+
+/**
+ * Find where to start reading for the first line at or after a time. Every
+ * line before the returned offset has an earlier timestamp, even if the log
+ * is not strictly in time order.
+ * @param index Index
+ * @param time Time as a FILETIME value
+ * @return Offset of a line start
+ */
+ULONGLONG log_index_seek(const LogIndex *index, ULONGLONG time);
+
+/**
+ * Free an index
+ * @param index Index (may be NULL)
+ */
+void log_index_free(LogIndex *index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LOG_INDEX_H */
\ No newline at end of file
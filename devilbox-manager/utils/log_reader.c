@@ -0,0 +1,565 @@
+/*******************************************************************************
+ * Log Reader Module Implementation
+ * Sliding memory-mapped view over a log file and its rotated copies
+ *******************************************************************************/
+
+ #include "log_reader.h"
+ #include "log_archive.h"
+ #include "log_index.h"
+ #include "log_search.h"
+ #include <stdio.h>
+ #include <string.h>
+ #include <stdlib.h>
+ 
+ // Rotated copy of a log, plain or compressed
+ typedef struct
+ {
+     int number;              // logrotate suffix, higher is older
+     HANDLE file;             // Plain copy
+     HANDLE mapping;
+     LogArchive *archive;     // Compressed copy
+     ULONGLONG base;          // Offset of the part in the stream
+     ULONGLONG size;
+ } LogPart;
+ 
+ struct LogReader
+ {
+     HANDLE file;
+     HANDLE mapping;          // Created on the first read after a refresh or unmap, NULL for empty logs
+     ULONGLONG size;          // Size of the stream: the rotated parts and the size the mapping covers
+     ULONGLONG base;          // Offset of the log itself, after the rotated parts
+     LogPart *parts;          // Oldest first
+     int part_count;
+     const char *view;
+     ULONGLONG view_offset;
+     size_t view_length;
+     BOOL view_mapped;        // The view is a file view, not decompressed data
+     DWORD granularity;       // View offsets are multiples of the allocation granularity
+ };
+ 
+ static void find_parts(LogReader *reader, const char *path);
+ static BOOL open_part(LogPart *part, const char *path);
+ static BOOL handle_id(HANDLE file, ULONGLONG *id);
+ static const char *map_part(LogReader *reader, HANDLE file, HANDLE *mapping, ULONGLONG base, ULONGLONG size,
+                             ULONGLONG offset);
+ 
+ LogReader *log_reader_open(const char *path)
+ {
+     LogReader *reader = (LogReader *)calloc(1, sizeof(LogReader));
+     SYSTEM_INFO si;
+ 
+     if (!reader)
+         return NULL;
+ 
+     reader->file = CreateFile(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                               OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+     if (reader->file == INVALID_HANDLE_VALUE)
+     {
+         free(reader);
+         return NULL;
+     }
+ 
+     GetSystemInfo(&si);
+     reader->granularity = si.dwAllocationGranularity ? si.dwAllocationGranularity : 65536;
+     log_reader_refresh(reader);
+     return reader;
+ }
+ 
+ LogReader *log_reader_open_rotated(const char *path)
+ {
+     LogReader *reader = log_reader_open(path);
+ 
+     if (!reader)
+         return NULL;
+ 
+     find_parts(reader, path);
+     reader->size = 0;
+     log_reader_refresh(reader);
+     return reader;
+ }
+ 
+ LogReader *log_reader_clone(const LogReader *reader)
+ {
+     LogReader *clone = (LogReader *)calloc(1, sizeof(LogReader));
+     HANDLE process = GetCurrentProcess();
+     BOOL ok = TRUE;
+ 
+     if (!clone)
+         return NULL;
+ 
+     // Plain files are only mapped, their handles can be shared
+     if (!DuplicateHandle(process, reader->file, process, &clone->file, 0, FALSE, DUPLICATE_SAME_ACCESS))
+     {
+         free(clone);
+         return NULL;
+     }
+     clone->size = reader->size;
+     clone->base = reader->base;
+     clone->granularity = reader->granularity;
+ 
+     if (reader->part_count > 0)
+     {
+         clone->parts = (LogPart *)calloc((size_t)reader->part_count, sizeof(LogPart));
+         ok = clone->parts != NULL;
+     }
+     for (int i = 0; i < reader->part_count && ok; i++)
+     {
+         const LogPart *part = &reader->parts[i];
+         LogPart *copy = &clone->parts[i];
+ 
+         copy->number = part->number;
+         copy->base = part->base;
+         copy->size = part->size;
+         if (part->file)
+             ok = DuplicateHandle(process, part->file, process, &copy->file, 0, FALSE, DUPLICATE_SAME_ACCESS);
+         else
+             ok = (copy->archive = log_archive_clone(part->archive)) != NULL;
+         if (!ok)
+             copy->file = NULL;
+         else
+             clone->part_count++;
+     }
+     if (!ok)
+     {
+         log_reader_close(clone);
+         return NULL;
+     }
+     return clone;
+ }
+ 
+ BOOL log_reader_refresh(LogReader *reader)
+ {
+     LARGE_INTEGER size;
+ 
+     if (!GetFileSizeEx(reader->file, &size) || reader->base + (ULONGLONG)size.QuadPart == reader->size)
+         return FALSE;
+ 
+     // A mapping is as large as the file was when it was created
+     log_reader_unmap(reader);
+     reader->size = reader->base + (ULONGLONG)size.QuadPart;
+     return TRUE;
+ }
+ 
+ ULONGLONG log_reader_size(const LogReader *reader)
+ {
+     return reader->size;
+ }
+ 
+ ULONGLONG log_reader_base(const LogReader *reader)
+ {
+     return reader->base;
+ }
+ 
+ BOOL log_reader_file_id(const LogReader *reader, ULONGLONG *id)
+ {
+     return handle_id(reader->file, id);
+ }
+ 
+ BOOL log_reader_locate(const LogReader *reader, const LogReader *previous, LONGLONG *shift)
+ {
+     ULONGLONG live_id, id, part_id;
+     const LogPart *newest;
+     BOOL copied = TRUE;
+ 
+     if (!handle_id(previous->file, &live_id))
+         return FALSE;
+ 
+     // Renamed away: the old log is one of the plain copies now
+     for (int i = 0; i < reader->part_count; i++)
+     {
+         const LogPart *part = &reader->parts[i];
+ 
+         if (part->file && handle_id(part->file, &id) && id == live_id)
+         {
+             *shift = (LONGLONG)(part->base - previous->base);
+             return TRUE;
+         }
+     }
+ 
+     // Copied and truncated: the newest copy is one the previous reader did not have,
+     // holding at least what the log had
+     if (!handle_id(reader->file, &id) || id != live_id || reader->part_count == 0)
+         return FALSE;
+     newest = &reader->parts[reader->part_count - 1];
+     if (!newest->file || !handle_id(newest->file, &id) || newest->size < previous->size - previous->base)
+         return FALSE;
+     for (int i = 0; i < previous->part_count && copied; i++)
+         copied = !previous->parts[i].file || !handle_id(previous->parts[i].file, &part_id) || part_id != id;
+     if (!copied)
+         return FALSE;
+     *shift = (LONGLONG)(newest->base - previous->base);
+     return TRUE;
+ }
+ 
+ BOOL log_reader_is_log(const char *name, BOOL rotated)
+ {
+     const char *ext = strrchr(name, '.');
+ 
+     if (!ext)
+         return TRUE;
+     if (_stricmp(ext, LOG_INDEX_SUFFIX) == 0 || _stricmp(ext, LOG_SEARCH_SUFFIX) == 0 ||
+         _stricmp(ext, LOG_ARCHIVE_SUFFIX) == 0 || _stricmp(ext, ".gz") == 0 || _stricmp(ext, ".bz2") == 0 ||
+         _stricmp(ext, ".zip") == 0 || _stricmp(ext, ".zst") == 0)
+         return FALSE;
+ 
+     // logrotate numbers the old logs: error.log.1, error.log.2.gz
+     return rotated || !ext[1] || strspn(ext + 1, "0123456789") != strlen(ext + 1);
+ }
+ 
+ const char *log_reader_map(LogReader *reader, ULONGLONG offset, size_t *length)
+ {
+     if (offset >= reader->size)
+         return NULL;
+ 
+     if (!reader->view || offset < reader->view_offset || offset >= reader->view_offset + reader->view_length)
+     {
+         const char *view = NULL;
+ 
+         if (reader->view && reader->view_mapped)
+             UnmapViewOfFile(reader->view);
+         reader->view = NULL;
+ 
+         if (offset >= reader->base)
+             view = map_part(reader, reader->file, &reader->mapping, reader->base, reader->size - reader->base, offset);
+         else
+         {
+             // The rotated parts cover everything before the log itself
+             LogPart *part = reader->parts;
+             ULONGLONG start;
+ 
+             while (offset >= part->base + part->size)
+                 part++;
+             if (part->file)
+                 view = map_part(reader, part->file, &part->mapping, part->base, part->size, offset);
+             else if ((view = log_archive_read(part->archive, offset - part->base, &start, &reader->view_length)))
+             {
+                 // A decompressed span, kept by the archive
+                 reader->view = view;
+                 reader->view_offset = part->base + start;
+                 reader->view_mapped = FALSE;
+             }
+         }
+         if (!view)
+             return NULL;
+     }
+ 
+     *length = (size_t)(reader->view_offset + reader->view_length - offset);
+     return reader->view + (offset - reader->view_offset);
+ }
+ 
+ ULONGLONG log_reader_line_start(LogReader *reader, ULONGLONG offset)
+ {
+     if (offset > reader->size)
+         offset = reader->size;
+ 
+     // The line starts after the last line break before the offset
+     while (offset > 0)
+     {
+         size_t length;
+         const char *p = log_reader_map(reader, offset - 1, &length);
+ 
+         if (!p)
+             break;
+         for (const char *q = p; q >= reader->view; q--)
+         {
+             if (*q == '\n')
+                 return reader->view_offset + (ULONGLONG)(q - reader->view) + 1;
+         }
+         offset = reader->view_offset;
+     }
+ 
+     return 0;
+ }
+ 
+ ULONGLONG log_reader_next_line(LogReader *reader, ULONGLONG offset)
+ {
+     while (offset < reader->size)
+     {
+         size_t length;
+         const char *p = log_reader_map(reader, offset, &length);
+         const char *newline;
+ 
+         if (!p)
+             break;
+         newline = (const char *)memchr(p, '\n', length);
+         if (newline)
+             return offset + (ULONGLONG)(newline - p) + 1;
+         offset += length;
+     }
+ 
+     return reader->size;
+ }
+ 
+ size_t log_reader_get_line(LogReader *reader, ULONGLONG offset, char *line, size_t size, ULONGLONG *next)
+ {
+     size_t used = 0;
+ 
+     while (offset < reader->size)
+     {
+         size_t length, take;
+         const char *p = log_reader_map(reader, offset, &length);
+         const char *newline;
+ 
+         if (!p)
+         {
+             offset = reader->size;
+             break;
+         }
+ 
+         newline = (const char *)memchr(p, '\n', length);
+         take = newline ? (size_t)(newline - p) : length;
+         if (used < size - 1)
+         {
+             size_t copy = take < size - 1 - used ? take : size - 1 - used;
+             memcpy(line + used, p, copy);
+             used += copy;
+         }
+ 
+         offset += take;
+         if (newline)
+         {
+             offset++;
+             break;
+         }
+     }
+ 
+     if (used > 0 && line[used - 1] == '\r')
+         used--;
+     line[used] = 0;
+     if (next)
+         *next = offset;
+     return used;
+ }
+ 
+ size_t log_reader_scan(LogReader *reader, ULONGLONG offset, ULONGLONG end, ULONGLONG *lines, LogFields *fields,
+                        size_t max, ULONGLONG *next)
+ {
+     size_t length, count;
+     const char *p = offset < end ? log_reader_map(reader, offset, &length) : NULL;
+ 
+     *next = offset;
+     if (!p)
+         return 0;
+     if (length > end - offset)
+         length = (size_t)(end - offset);
+ 
+     lines[0] = offset;
+     count = 1 + log_scan_lines(p, length, offset, lines + 1, max - 1);
+     if (offset + length == end && count < max)
+     {
+         // Everything up to the end is in the view, a line break right at the end starts no line
+         if (lines[count - 1] == end)
+             count--;
+         *next = end;
+     }
+     else
+     {
+         // The last line may run on past the view or the batch
+         count--;
+         *next = lines[count];
+     }
+ 
+     if (count == 0)
+     {
+         // A line longer than the view ahead of it, its start is enough for the fields
+         char head[64];
+         size_t used = log_reader_get_line(reader, offset, head, sizeof(head), next);
+ 
+         log_scan_fields(head, used, offset, lines, 1, fields);
+         return 1;
+     }
+ 
+     log_scan_fields(p, length, offset, lines, count, fields);
+     return count;
+ }
+ 
+ void log_reader_unmap(LogReader *reader)
+ {
+     if (reader->view && reader->view_mapped)
+         UnmapViewOfFile(reader->view);
+     if (reader->mapping)
+         CloseHandle(reader->mapping);
+     for (int i = 0; i < reader->part_count; i++)
+     {
+         if (reader->parts[i].mapping)
+             CloseHandle(reader->parts[i].mapping);
+         reader->parts[i].mapping = NULL;
+     }
+     reader->view = NULL;
+     reader->mapping = NULL;
+ }
+ 
+ void log_reader_close(LogReader *reader)
+ {
+     if (!reader)
+         return;
+ 
+     log_reader_unmap(reader);
+     for (int i = 0; i < reader->part_count; i++)
+     {
+         if (reader->parts[i].file)
+             CloseHandle(reader->parts[i].file);
+         log_archive_close(reader->parts[i].archive);
+     }
+     free(reader->parts);
+     CloseHandle(reader->file);
+     free(reader);
+ }
+ 
+ /**
+  * Map the part of a file around an offset of the stream
+  */
+ static const char *map_part(LogReader *reader, HANDLE file, HANDLE *mapping, ULONGLONG base, ULONGLONG size,
+                             ULONGLONG offset)
+ {
+     // Centered on the offset, scans in either direction find half a view ready
+     ULONGLONG position = offset - base;
+     ULONGLONG start = position > LOG_READER_VIEW_SIZE / 2 ? position - LOG_READER_VIEW_SIZE / 2 : 0;
+ 
+     start -= start % reader->granularity;
+     if (!*mapping)
+     {
+         *mapping = CreateFileMapping(file, NULL, PAGE_READONLY, (DWORD)(size >> 32), (DWORD)size, NULL);
+         if (!*mapping)
+             return NULL;
+     }
+ 
+     reader->view_length = size - start < LOG_READER_VIEW_SIZE ? (size_t)(size - start) : LOG_READER_VIEW_SIZE;
+     reader->view = (const char *)MapViewOfFile(*mapping, FILE_MAP_READ, (DWORD)(start >> 32), (DWORD)start,
+                                                reader->view_length);
+     reader->view_offset = base + start;
+     reader->view_mapped = TRUE;
+     return reader->view;
+ }
+ 
+ /**
+  * Parse the name of a rotated copy of a log: the log name, a number and
+  * optionally a compression suffix (error.log.1, error.log.2.gz)
+  * @return The number, 0 when the name is not a rotated copy that can be read
+  */
+ static int rotated_number(const char *name, const char *log_name)
+ {
+     size_t length = strlen(log_name);
+     const char *p = name + length + 1;
+     const char *end;
+     int number = 0;
+ 
+     if (_strnicmp(name, log_name, length) != 0 || name[length] != '.')
+         return 0;
+     for (end = p; *end >= '0' && *end <= '9' && end - p < 6; end++)
+         number = number * 10 + (*end - '0');
+     if (end == p || (*end && (*end != '.' || !log_archive_supported(end))))
+         return 0;
+     return number;
+ }
+ 
+ static int compare_parts(const void *a, const void *b)
+ {
+     const LogPart *pa = (const LogPart *)a, *pb = (const LogPart *)b;
+ 
+     // Oldest first; a plain copy before a compressed one, which may still be written
+     if (pa->number != pb->number)
+         return pa->number > pb->number ? -1 : 1;
+     return (pa->file != NULL) == (pb->file != NULL) ? 0 : (pa->file ? -1 : 1);
+ }
+ 
+ /**
+  * Open the rotated copies of a log, ordered and placed before the log
+  */
+ static void find_parts(LogReader *reader, const char *path)
+ {
+     const char *slash = strrchr(path, '\\');
+     const char *log_name = slash ? slash + 1 : path;
+     char pattern[MAX_PATH_LEN];
+     char part_path[MAX_PATH_LEN];
+     WIN32_FIND_DATA fd;
+     HANDLE hFind;
+     int kept = 0;
+ 
+     snprintf(pattern, sizeof(pattern), "%s.*", path);
+     hFind = FindFirstFile(pattern, &fd);
+     if (hFind == INVALID_HANDLE_VALUE)
+         return;
+ 
+     reader->parts = (LogPart *)calloc(LOG_READER_MAX_PARTS, sizeof(LogPart));
+     do
+     {
+         LogPart *part = reader->parts ? &reader->parts[reader->part_count] : NULL;
+         int number = rotated_number(fd.cFileName, log_name);
+ 
+         if (!part || number == 0 || (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+             continue;
+         snprintf(part_path, sizeof(part_path), "%.*s%s", (int)(log_name - path), path, fd.cFileName);
+         part->number = number;
+         if (open_part(part, part_path))
+             reader->part_count++;
+     } while (reader->part_count < LOG_READER_MAX_PARTS && FindNextFile(hFind, &fd));
+     FindClose(hFind);
+ 
+     // One copy per number, empty ones add nothing
+     qsort(reader->parts, (size_t)reader->part_count, sizeof(LogPart), compare_parts);
+     for (int i = 0; i < reader->part_count; i++)
+     {
+         LogPart *part = &reader->parts[i];
+ 
+         if (part->size == 0 || (kept > 0 && reader->parts[kept - 1].number == part->number))
+         {
+             if (part->file)
+                 CloseHandle(part->file);
+             log_archive_close(part->archive);
+             continue;
+         }
+         part->base = reader->base;
+         reader->base += part->size;
+         reader->parts[kept++] = *part;
+     }
+     reader->part_count = kept;
+ }
+ 
+ /**
+  * Identify an open file by its volume and file index
+  */
+ static BOOL handle_id(HANDLE file, ULONGLONG *id)
+ {
+     BY_HANDLE_FILE_INFORMATION info;
+ 
+     if (!GetFileInformationByHandle(file, &info))
+         return FALSE;
+ 
+     // The file index is 64 bits; folding the serial in keeps the volume in the identity
+     *id = (((ULONGLONG)info.nFileIndexHigh << 32) | info.nFileIndexLow) ^ ((ULONGLONG)info.dwVolumeSerialNumber << 32);
+     return TRUE;
+ }
+ 
+ /**
+  * Open one rotated copy and get its size in the stream
+  */
+ static BOOL open_part(LogPart *part, const char *path)
+ {
+     LARGE_INTEGER size;
+ 
+     if (log_archive_supported(path))
+     {
+         part->archive = log_archive_open(path);
+         if (!part->archive)
+             return FALSE;
+         part->size = log_archive_size(part->archive);
+         return TRUE;
+     }
+ 
+     part->file = CreateFile(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                             OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+     if (part->file == INVALID_HANDLE_VALUE)
+     {
+         part->file = NULL;
+         return FALSE;
+     }
+     if (!GetFileSizeEx(part->file, &size))
+     {
+         CloseHandle(part->file);
+         part->file = NULL;
+         return FALSE;
+     }
+     part->size = (ULONGLONG)size.QuadPart;
+     return TRUE;
+ }
\ No newline at end of file
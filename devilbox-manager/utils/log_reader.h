@@ -0,0 +1,176 @@
+/*******************************************************************************
+ * Log Reader Module Header
+ * Reads log files through a sliding memory-mapped view, so a log of any size
+ * opens instantly and only the lines on screen are ever copied out of it
+ *******************************************************************************/
+#ifndef LOG_READER_H
+#define LOG_READER_H
+
+#include <windows.h>
+#include "log_scan.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Maximum path length constant (if not already defined)
+#ifndef MAX_PATH_LEN
+#define MAX_PATH_LEN 260
+#endif
+
+// Bytes of the log mapped at a time, centered on the position being read
+#define LOG_READER_VIEW_SIZE (4 * 1048576)
+
+// Rotated copies of a log read ahead of it
+#define LOG_READER_MAX_PARTS 64
+
+// Log file opened for reading (opaque)
+typedef struct LogReader LogReader;
+
+/**
+ * Open a log file. Writers keep full access: php-fpm appends while the log
+ * is open and rotation may rename or truncate it between reads.
+ * @param path Log file path
+ * @return Reader, NULL if the file cannot be opened
+ */
+LogReader *log_reader_open(const char *path);
+
+/**
+ * Open a log together with the copies logrotate left of it, as one stream
+ * from the oldest copy to the end of the log: error.log.3.gz, error.log.2.gz,
+ * error.log.1, error.log. Compressed copies are read through their seek
+ * points; only the log itself grows on refresh.
+ * @param path Log file path
+ * @return Reader, NULL if the log itself cannot be opened
+ */
+LogReader *log_reader_open_rotated(const char *path);
+
+/**
+ * Open a reader again for another thread: the same files and rotated copies,
+ * at the size of the last refresh, with the seek points already loaded
+ * @param reader Reader
+ * @return Reader, NULL if a file cannot be opened again
+ */
+LogReader *log_reader_clone(const LogReader *reader);
+
+/**
+ * Pick up a changed size of the log
+ * @param reader Reader
+ * @return TRUE if the size changed since the last call
+ */
+BOOL log_reader_refresh(LogReader *reader);
+
+/**
+ * Get the size of the log as of the last refresh
+ * @param reader Reader
+ * @return Size in bytes
+ */
+ULONGLONG log_reader_size(const LogReader *reader);
+
+/**
+ * Get the offset of the log itself in the stream, after its rotated copies
+ * @param reader Reader
+ * @return Offset in bytes
+ */
+ULONGLONG log_reader_base(const LogReader *reader);
+
+/**
+ * Identify the log behind the reader; a rotated log gets a new identity
+ * even when it is recreated under the same name
+ * @param reader Reader
+ * @param id Receives the volume serial number and file index
+ * @return TRUE on success
+ */
+BOOL log_reader_file_id(const LogReader *reader, ULONGLONG *id);
+
+/**
+ * Find the log another reader followed in the stream of a reader opened
+ * after a rotation: renamed to a rotated copy, or copied to a new one and
+ * truncated. A byte at an offset of the previous stream is at that offset
+ * plus the shift in this one; copies dropped by the rotation make the
+ * shifted offsets of their bytes negative.
+ * @param reader Reader opened with log_reader_open_rotated after the rotation
+ * @param previous Reader from before the rotation, as of its last refresh
+ * @param shift Receives the distance the offsets moved
+ * @return TRUE if the old log is found whole, FALSE if it is gone or compressed
+ */
+BOOL log_reader_locate(const LogReader *reader, const LogReader *previous, LONGLONG *shift);
+
+/**
+ * Check whether a file in a log directory holds log text, not an index,
+ * search index, seek point file or compressed archive kept next to a log
+ * @param name File name
+ * @param rotated TRUE to count rotated copies (error.log.1) as logs too
+ * @return TRUE for a log
+ */
+BOOL log_reader_is_log(const char *name, BOOL rotated);
+
+/**
+ * Map the part of the log around an offset
+ * @param reader Reader
+ * @param offset Byte offset, below the size
+ * @param length Receives the number of bytes readable from the returned pointer
+ * @return Pointer to the byte at offset, NULL past the end or on failure
+ */
+const char *log_reader_map(LogReader *reader, ULONGLONG offset, size_t *length);
+
+/**
+ * Find the start of the line holding an offset
+ * @param reader Reader
+ * @param offset Byte offset (the size stands for the position after the last line)
+ * @return Offset of the first byte of the line
+ */
+ULONGLONG log_reader_line_start(LogReader *reader, ULONGLONG offset);
+
+/**
+ * Find the start of the line after the one holding an offset
+ * @param reader Reader
+ * @param offset Byte offset
+ * @return Offset of the next line, the size after the last line
+ */
+ULONGLONG log_reader_next_line(LogReader *reader, ULONGLONG offset);
+
+/**
+ * Copy a line without its line break; lines longer than the buffer are cut
+ * @param reader Reader
+ * @param offset Offset of the line start
+ * @param line Buffer for the line
+ * @param size Size of the buffer
+ * @param next Receives the offset of the next line (may be NULL)
+ * @return Length of the copied line
+ */
+size_t log_reader_get_line(LogReader *reader, ULONGLONG offset, char *line, size_t size, ULONGLONG *next);
+
+/**
+ * Split lines from a line start into offsets and header fields, as many as
+ * the mapped view holds in one piece
+ * @param reader Reader
+ * @param offset Offset of a line start
+ * @param end Where to stop: a line start or the size
+ * @param lines Receives the offsets of the lines
+ * @param fields Receives the header fields of the lines
+ * @param max Capacity of lines and fields, at least 1
+ * @param next Receives the offset after the last line returned
+ * @return Number of lines, 0 at end
+ */
+size_t log_reader_scan(LogReader *reader, ULONGLONG offset, ULONGLONG end, ULONGLONG *lines, LogFields *fields,
+                       size_t max, ULONGLONG *next);
+
+/**
+ * Release the mapped view between reads, so the log can be truncated or
+ * rotated; the next read maps it again
+ * @param reader Reader
+ */
+void log_reader_unmap(LogReader *reader);
+
+/**
+ * Close a log file
+ * @param reader Reader (may be NULL)
+ */
+void log_reader_close(LogReader *reader);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LOG_READER_H */
\ No newline at end of file
@@ -0,0 +1,556 @@
+/*******************************************************************************
+ * Log Scan Module Implementation
+ * Line and header scanning kernels, selected by the features of the CPU
+ *******************************************************************************/
+
+ #include "log_scan.h"
+ #include <string.h>
+ #include <ctype.h>
+ 
+ #if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+ #define LOG_SCAN_X86
+ #include <immintrin.h>
+ #define TARGET_SSE2 __attribute__((target("sse2")))
+ #define TARGET_AVX2 __attribute__((target("avx2")))
+ #endif
+ 
+ // Bytes a vector template match reads from the line start
+ #define MATCH_WIDTH 32
+ 
+ // Timestamp layout at the start of a line
+ typedef struct
+ {
+     const char *pattern;     // '0' stands for a digit, 'A' for a byte the parser checks
+     size_t length;
+     unsigned literal;        // Bit masks over the first MATCH_WIDTH bytes
+     unsigned digits;
+     char expected[MATCH_WIDTH];
+ } TimeFormat;
+ 
+ // Severity keywords, matched without case after the timestamp
+ #define KEYWORD(text, severity) {text, sizeof(text) - 1, severity}
+ static const struct
+ {
+     const char *keyword;
+     size_t length;
+     LogSeverity severity;
+ } severities[] = {
+     KEYWORD("Fatal error", LOG_SEVERITY_FATAL),
+     KEYWORD("Parse error", LOG_SEVERITY_ERROR),
+     KEYWORD("Recoverable fatal error", LOG_SEVERITY_ERROR),
+     KEYWORD("Catchable fatal error", LOG_SEVERITY_ERROR),
+     KEYWORD("Strict Standards", LOG_SEVERITY_NOTICE),
+     KEYWORD("Deprecated", LOG_SEVERITY_DEPRECATED),
+     KEYWORD("warn", LOG_SEVERITY_WARNING),
+     KEYWORD("notice", LOG_SEVERITY_NOTICE),
+     KEYWORD("note", LOG_SEVERITY_NOTICE),
+     KEYWORD("system", LOG_SEVERITY_INFO),
+     KEYWORD("error", LOG_SEVERITY_ERROR),
+     KEYWORD("crit", LOG_SEVERITY_FATAL),
+     KEYWORD("alert", LOG_SEVERITY_FATAL),
+     KEYWORD("emerg", LOG_SEVERITY_FATAL),
+     KEYWORD("info", LOG_SEVERITY_INFO),
+     KEYWORD("debug", LOG_SEVERITY_DEBUG),
+ };
+ 
+ typedef size_t (*FindLinesFunc)(const char *data, size_t length, ULONGLONG base, ULONGLONG *next, size_t max);
+ typedef BOOL (*MatchFunc)(const char *p, const TimeFormat *format);
+ 
+ // Kernels in use and the timestamp layouts prepared for them
+ typedef struct
+ {
+     FindLinesFunc find_lines;
+     MatchFunc match;
+     TimeFormat php;          // PHP and php-fpm
+     TimeFormat nginx;        // nginx error log
+     TimeFormat iso;          // MySQL and MariaDB, T or space in the middle
+     TimeFormat apache;       // Apache error log, the year follows
+     TimeFormat access;       // Access logs, after the client fields
+ } ScanKernels;
+ 
+ // Filled by the first caller, then published; the worker threads of the access
+ // statistics scan at the same time, so nothing is read before it is published
+ static ScanKernels chosen_kernels = {
+     NULL,
+     NULL,
+     {"[00-AAA-0000 00:00:00"},
+     {"0000/00/00 00:00:00"},
+     {"0000-00-00A00:00:00"},
+     {"[AAA AAA 00 00:00:00"},
+     {"[00/AAA/0000:00:00:00"},
+ };
+ static ScanKernels *volatile published_kernels = NULL;
+ static volatile LONG kernels_claimed = 0;
+ 
+ static const ScanKernels *select_kernels(void);
+ 
+ /**
+  * Scalar kernels
+  */
+ static size_t find_lines_scalar(const char *data, size_t length, ULONGLONG base, ULONGLONG *next, size_t max)
+ {
+     const char *p = data, *end = data + length;
+     size_t count = 0;
+ 
+     while (count < max && (p = (const char *)memchr(p, '\n', (size_t)(end - p))) != NULL)
+     {
+         p++;
+         next[count++] = base + (ULONGLONG)(p - data);
+     }
+ 
+     return count;
+ }
+ 
+ static BOOL match_scalar(const char *p, const TimeFormat *format)
+ {
+     for (size_t i = 0; i < format->length; i++)
+     {
+         char c = format->pattern[i];
+ 
+         if (c == '0' ? (p[i] < '0' || p[i] > '9') : (c != 'A' && p[i] != c))
+             return FALSE;
+     }
+     return TRUE;
+ }
+ 
+ #ifdef LOG_SCAN_X86
+ /**
+  * SSE2 kernels, 16 bytes at a time
+  */
+ TARGET_SSE2 static size_t find_lines_sse2(const char *data, size_t length, ULONGLONG base, ULONGLONG *next,
+                                           size_t max)
+ {
+     const __m128i newline = _mm_set1_epi8('\n');
+     size_t i = 0, count = 0;
+ 
+     for (; i + 16 <= length; i += 16)
+     {
+         unsigned mask = (unsigned)_mm_movemask_epi8(
+             _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + i)), newline));
+ 
+         while (mask)
+         {
+             if (count == max)
+                 return count;
+             next[count++] = base + i + (unsigned)__builtin_ctz(mask) + 1;
+             mask &= mask - 1;
+         }
+     }
+ 
+     if (count < max)
+         count += find_lines_scalar(data + i, length - i, base + i, next + count, max - count);
+     return count;
+ }
+ 
+ TARGET_SSE2 static BOOL match_sse2(const char *p, const TimeFormat *format)
+ {
+     const __m128i zero = _mm_set1_epi8('0'), nine = _mm_set1_epi8(9);
+     __m128i lo = _mm_loadu_si128((const __m128i *)p);
+     __m128i hi = _mm_loadu_si128((const __m128i *)(p + 16));
+     __m128i dlo = _mm_sub_epi8(lo, zero), dhi = _mm_sub_epi8(hi, zero);
+     unsigned literal, digits;
+ 
+     literal = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(lo, _mm_loadu_si128((const __m128i *)format->expected))) |
+               (unsigned)_mm_movemask_epi8(
+                   _mm_cmpeq_epi8(hi, _mm_loadu_si128((const __m128i *)(format->expected + 16)))) << 16;
+ 
+     // A byte is a digit if subtracting '0' leaves it at most 9 (unsigned)
+     digits = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(dlo, nine), dlo)) |
+              (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(dhi, nine), dhi)) << 16;
+ 
+     return (literal & format->literal) == format->literal && (digits & format->digits) == format->digits;
+ }
+ 
+ /**
+  * AVX2 kernels, 32 bytes at a time
+  */
+ TARGET_AVX2 static size_t find_lines_avx2(const char *data, size_t length, ULONGLONG base, ULONGLONG *next,
+                                           size_t max)
+ {
+     const __m256i newline = _mm256_set1_epi8('\n');
+     size_t i = 0, count = 0;
+ 
+     for (; i + 32 <= length; i += 32)
+     {
+         unsigned mask = (unsigned)_mm256_movemask_epi8(
+             _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(data + i)), newline));
+ 
+         while (mask)
+         {
+             if (count == max)
+                 return count;
+             next[count++] = base + i + (unsigned)__builtin_ctz(mask) + 1;
+             mask &= mask - 1;
+         }
+     }
+ 
+     if (count < max)
+         count += find_lines_scalar(data + i, length - i, base + i, next + count, max - count);
+     return count;
+ }
+ 
+ TARGET_AVX2 static BOOL match_avx2(const char *p, const TimeFormat *format)
+ {
+     __m256i text = _mm256_loadu_si256((const __m256i *)p);
+     __m256i value = _mm256_sub_epi8(text, _mm256_set1_epi8('0'));
+     unsigned literal, digits;
+ 
+     literal = (unsigned)_mm256_movemask_epi8(
+         _mm256_cmpeq_epi8(text, _mm256_loadu_si256((const __m256i *)format->expected)));
+     digits = (unsigned)_mm256_movemask_epi8(
+         _mm256_cmpeq_epi8(_mm256_min_epu8(value, _mm256_set1_epi8(9)), value));
+ 
+     return (literal & format->literal) == format->literal && (digits & format->digits) == format->digits;
+ }
+ #endif
+ 
+ /**
+  * Build the vector masks of a timestamp layout
+  */
+ static void prepare_format(TimeFormat *format)
+ {
+     format->length = strlen(format->pattern);
+     for (size_t i = 0; i < format->length; i++)
+     {
+         if (format->pattern[i] == '0')
+             format->digits |= 1u << i;
+         else if (format->pattern[i] != 'A')
+         {
+             format->literal |= 1u << i;
+             format->expected[i] = format->pattern[i];
+         }
+     }
+ }
+ 
+ /**
+  * Pick the widest kernels the CPU and OS support, once. The first caller
+  * prepares them and publishes the pointer, any other waits for it; a
+  * compare-exchange rather than InitOnceExecuteOnce keeps XP supported.
+  */
+ static const ScanKernels *select_kernels(void)
+ {
+     const ScanKernels *ready = published_kernels;
+ 
+     if (ready)
+         return ready;
+ 
+     if (InterlockedCompareExchange(&kernels_claimed, 1, 0) == 0)
+     {
+         chosen_kernels.find_lines = find_lines_scalar;
+         chosen_kernels.match = match_scalar;
+         prepare_format(&chosen_kernels.php);
+         prepare_format(&chosen_kernels.nginx);
+         prepare_format(&chosen_kernels.iso);
+         prepare_format(&chosen_kernels.apache);
+         prepare_format(&chosen_kernels.access);
+ 
+ #ifdef LOG_SCAN_X86
+         __builtin_cpu_init();
+         if (__builtin_cpu_supports("avx2"))
+         {
+             chosen_kernels.find_lines = find_lines_avx2;
+             chosen_kernels.match = match_avx2;
+         }
+         else if (__builtin_cpu_supports("sse2"))
+         {
+             chosen_kernels.find_lines = find_lines_sse2;
+             chosen_kernels.match = match_sse2;
+         }
+ #endif
+ 
+         InterlockedExchangePointer((PVOID volatile *)&published_kernels, &chosen_kernels);
+     }
+ 
+     while ((ready = published_kernels) == NULL)
+         Sleep(0);
+     return ready;
+ }
+ 
+ /**
+  * Convert a date and time to a FILETIME value
+  */
+ static BOOL make_time(int year, int month, int day, int hour, int minute, int second, ULONGLONG *time)
+ {
+     LONGLONG days;
+ 
+     if (year < 1601 || month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || minute > 59 || second > 59)
+         return FALSE;
+ 
+     // Days since 1601-01-01, counting years from March so the leap day comes last
+     if (month <= 2)
+         year--;
+     days = 365LL * (year - 1600) + (year - 1600) / 4 - (year - 1600) / 100 + (year - 1600) / 400 +
+            (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1 - 306;
+ 
+     *time = ((ULONGLONG)days * 86400 + hour * 3600 + minute * 60 + second) * 10000000ULL;
+     return TRUE;
+ }
+ 
+ static int digits2(const char *p)
+ {
+     return (p[0] - '0') * 10 + (p[1] - '0');
+ }
+ 
+ /**
+  * Read the zone written after a timestamp: Z, UTC or an offset such as +0100
+  * or -05:30. A zone name other than UTC cannot be resolved.
+  * @return Minutes east of UTC, LOG_ZONE_NONE if there is none
+  */
+ static short parse_zone(const char *p, const char *end)
+ {
+     const char *q;
+ 
+     if (p < end && *p == ' ')
+         p++;
+     if ((p < end && *p == 'Z') || (end - p >= 4 && memcmp(p, "UTC", 3) == 0 && (p[3] == ']' || p[3] == ' ')))
+         return 0;
+ 
+     if (end - p < 5 || (*p != '+' && *p != '-') || !isdigit((unsigned char)p[1]) || !isdigit((unsigned char)p[2]))
+         return LOG_ZONE_NONE;
+     q = p[3] == ':' ? p + 4 : p + 3;
+     if (end - q < 2 || !isdigit((unsigned char)q[0]) || !isdigit((unsigned char)q[1]))
+         return LOG_ZONE_NONE;
+     return (short)((*p == '-' ? -1 : 1) * (digits2(p + 1) * 60 + digits2(q)));
+ }
+ 
+ /**
+  * Zone after an ISO timestamp, past the fraction of the second
+  */
+ static short iso_zone(const char *p, const char *end)
+ {
+     if (p < end && *p == '.')
+     {
+         p++;
+         while (p < end && *p >= '0' && *p <= '9')
+             p++;
+     }
+     return p < end && *p != ' ' ? parse_zone(p, end) : LOG_ZONE_NONE;
+ }
+ 
+ /**
+  * Number of an English month abbreviation, 0 if it is none
+  */
+ static int month_number(const char *p)
+ {
+     static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+ 
+     for (int month = 0; month < 12; month++)
+     {
+         if (memcmp(p, months + month * 3, 3) == 0)
+             return month + 1;
+     }
+     return 0;
+ }
+ 
+ /**
+  * Check a timestamp layout at a position, with vectors where whole ones can be read
+  */
+ static BOOL match_at(const ScanKernels *kernels, const char *p, const char *end, const TimeFormat *format)
+ {
+     size_t available = (size_t)(end - p);
+ 
+     if (available < format->length)
+         return FALSE;
+     return (available >= MATCH_WIDTH ? kernels->match : match_scalar)(p, format);
+ }
+ 
+ /**
+  * Read the fields of a matched timestamp
+  */
+ static BOOL php_time(const char *p, ULONGLONG *time)
+ {
+     // [25-Feb-2025 07:16:59
+     return make_time(digits2(p + 8) * 100 + digits2(p + 10), month_number(p + 4), digits2(p + 1), digits2(p + 13),
+                      digits2(p + 16), digits2(p + 19), time);
+ }
+ 
+ static BOOL nginx_time(const char *p, ULONGLONG *time)
+ {
+     // 2025/02/25 07:16:59
+     return make_time(digits2(p) * 100 + digits2(p + 2), digits2(p + 5), digits2(p + 8), digits2(p + 11),
+                      digits2(p + 14), digits2(p + 17), time);
+ }
+ 
+ static BOOL iso_time(const char *p, ULONGLONG *time)
+ {
+     // 2025-02-25T07:16:59.123456Z or 2025-02-25 07:16:59
+     if (p[10] != 'T' && p[10] != ' ')
+         return FALSE;
+     return make_time(digits2(p) * 100 + digits2(p + 2), digits2(p + 5), digits2(p + 8), digits2(p + 11),
+                      digits2(p + 14), digits2(p + 17), time);
+ }
+ 
+ static BOOL access_time(const char *p, ULONGLONG *time)
+ {
+     // [25/Feb/2025:07:16:59 +0000]
+     return make_time(digits2(p + 8) * 100 + digits2(p + 10), month_number(p + 4), digits2(p + 1), digits2(p + 13),
+                      digits2(p + 16), digits2(p + 19), time);
+ }
+ 
+ static const char *apache_time(const char *p, const char *end, size_t length, ULONGLONG *time)
+ {
+     // [Tue Feb 25 07:16:59.123456 2025]
+     const char *q = p + length;
+ 
+     if (q < end && *q == '.')
+     {
+         q++;
+         while (q < end && *q >= '0' && *q <= '9')
+             q++;
+     }
+     if (end - q < 6 || q[0] != ' ' || q[5] != ']' || q[1] < '0' || q[1] > '9' || q[2] < '0' || q[2] > '9' ||
+         q[3] < '0' || q[3] > '9' || q[4] < '0' || q[4] > '9')
+     {
+         return NULL;
+     }
+ 
+     if (!make_time(digits2(q + 1) * 100 + digits2(q + 3), month_number(p + 5), digits2(p + 9), digits2(p + 12),
+                    digits2(p + 15), digits2(p + 18), time))
+     {
+         return NULL;
+     }
+     return q + 6;
+ }
+ 
+ /**
+  * Find the severity keyword after the timestamp: "... UTC] PHP Warning:",
+  * " [error]", " 0 [Warning]" or " [php:error]"
+  */
+ static LogSeverity parse_severity(const char *p, const char *end, char delimiter)
+ {
+     const char *limit = end - p > 64 ? p + 64 : end;
+     const char *q;
+ 
+     while (p < limit && *p != delimiter && *p != '\n')
+         p++;
+     if (p == limit || *p == '\n')
+         return LOG_SEVERITY_NONE;
+ 
+     p++;
+     while (p < end && *p == ' ')
+         p++;
+     if (end - p >= 4 && memcmp(p, "PHP ", 4) == 0)
+         p += 4;
+ 
+     // Apache puts the module first, "php:error"
+     for (q = p; q < limit && *q != ' ' && *q != ']' && *q != ':'; q++)
+         ;
+     if (q + 1 < end && *q == ':' && q[1] != ' ')
+         p = q + 1;
+ 
+     if (p == end)
+         return LOG_SEVERITY_NONE;
+ 
+     for (size_t i = 0; i < sizeof(severities) / sizeof(severities[0]); i++)
+     {
+         // Letters only differ in case by the 0x20 bit, checking the first one rules out most keywords
+         if ((p[0] | 0x20) == (severities[i].keyword[0] | 0x20) && (size_t)(end - p) >= severities[i].length &&
+             _strnicmp(p, severities[i].keyword, severities[i].length) == 0)
+         {
+             return severities[i].severity;
+         }
+     }
+     return LOG_SEVERITY_NONE;
+ }
+ 
+ /**
+  * Severity of an access log line from its status code: "GET / HTTP/1.1" 404
+  */
+ static LogSeverity parse_status(const char *p, const char *end)
+ {
+     const char *limit = end - p > 4096 ? p + 4096 : end;
+     const char *newline = (const char *)memchr(p, '\n', (size_t)(limit - p));
+     const char *quote;
+ 
+     if (newline)
+         limit = newline;
+     quote = (const char *)memchr(p, '"', (size_t)(limit - p));
+ 
+     // The request line is quoted, the status follows it
+     quote = quote ? (const char *)memchr(quote + 1, '"', (size_t)(limit - quote - 1)) : NULL;
+     if (!quote || limit - quote < 5 || quote[1] != ' ' || quote[2] < '1' || quote[2] > '5')
+         return LOG_SEVERITY_NONE;
+ 
+     return quote[2] == '5' ? LOG_SEVERITY_ERROR : quote[2] == '4' ? LOG_SEVERITY_WARNING : LOG_SEVERITY_INFO;
+ }
+ 
+ /**
+  * Extract the fields of one line
+  */
+ static void scan_line(const ScanKernels *kernels, const char *p, const char *end, LogFields *field)
+ {
+     const char *after;
+ 
+     field->time = 0;
+     field->severity = LOG_SEVERITY_NONE;
+     field->zone = LOG_ZONE_NONE;
+     if (end - p < 19)
+         return;
+ 
+     if (p[0] == '[')
+     {
+         if (match_at(kernels, p, end, &kernels->php) && php_time(p, &field->time))
+         {
+             field->zone = parse_zone(p + kernels->php.length, end);
+             field->severity = parse_severity(p + kernels->php.length, end, ']');
+         }
+         else if (match_at(kernels, p, end, &kernels->apache) &&
+                  (after = apache_time(p, end, kernels->apache.length, &field->time)) != NULL)
+             field->severity = parse_severity(after, end, '[');
+     }
+     else if (p[0] >= '0' && p[0] <= '9')
+     {
+         if (match_at(kernels, p, end, &kernels->nginx) && nginx_time(p, &field->time))
+             field->severity = parse_severity(p + kernels->nginx.length, end, '[');
+         else if (match_at(kernels, p, end, &kernels->iso) && iso_time(p, &field->time))
+         {
+             field->zone = iso_zone(p + kernels->iso.length, end);
+             field->severity = parse_severity(p + kernels->iso.length, end, '[');
+         }
+     }
+     else if (p[0] == '#')
+     {
+         // MySQL slow query log entries start with "# Time: 2025-02-25T07:16:59.123456Z"
+         if (memcmp(p, "# Time: ", 8) == 0 && match_at(kernels, p + 8, end, &kernels->iso) &&
+             iso_time(p + 8, &field->time))
+             field->zone = iso_zone(p + 8 + kernels->iso.length, end);
+     }
+ 
+     if (!field->time)
+     {
+         // Access logs put the client first, an address or a host name:
+         // 172.16.238.1 - - [25/Feb/2025:07:16:59 +0000] "GET / HTTP/1.1" 200
+         const char *bracket = (const char *)memchr(p, '[', end - p > 64 ? 64 : (size_t)(end - p));
+         const char *newline = bracket ? (const char *)memchr(p, '\n', (size_t)(bracket - p)) : NULL;
+ 
+         if (bracket && !newline && match_at(kernels, bracket, end, &kernels->access) &&
+             access_time(bracket, &field->time))
+         {
+             field->zone = parse_zone(bracket + kernels->access.length, end);
+             field->severity = parse_status(bracket + kernels->access.length, end);
+         }
+     }
+ }
+ 
+ size_t log_scan_lines(const char *data, size_t length, ULONGLONG base, ULONGLONG *next, size_t max)
+ {
+     return select_kernels()->find_lines(data, length, base, next, max);
+ }
+ 
+ void log_scan_fields(const char *data, size_t length, ULONGLONG base, const ULONGLONG *lines, size_t count,
+                      LogFields *fields)
+ {
+     const ScanKernels *kernels = select_kernels();
+ 
+     for (size_t i = 0; i < count; i++)
+         scan_line(kernels, data + (lines[i] - base), data + length, &fields[i]);
+ }
+ 
+ BOOL log_parse_time(const char *line, size_t length, ULONGLONG *time)
+ {
+     LogFields field;
+ 
+     scan_line(select_kernels(), line, line + length, &field);
+     *time = field.time;
+     return field.time != 0;
+ }
\ No newline at end of file
@@ -0,0 +1,89 @@
+/*******************************************************************************
+ * Log Scan Module Header
+ * Vectorized line splitting and timestamp/severity extraction for log text.
+ * SSE2 or AVX2 kernels are picked at runtime, with a scalar fallback.
+ *******************************************************************************/
+#ifndef LOG_SCAN_H
+#define LOG_SCAN_H
+
+#include <windows.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Lines handled per call by the batch readers
+#define LOG_SCAN_BATCH 1024
+
+// Severity of a log line
+typedef enum
+{
+    LOG_SEVERITY_NONE = 0,   // No recognised header, e.g. stack trace lines
+    LOG_SEVERITY_DEBUG,
+    LOG_SEVERITY_INFO,
+    LOG_SEVERITY_NOTICE,
+    LOG_SEVERITY_DEPRECATED,
+    LOG_SEVERITY_WARNING,
+    LOG_SEVERITY_ERROR,
+    LOG_SEVERITY_FATAL
+} LogSeverity;
+
+// Zone of a line that does not write one, or names one other than UTC
+#define LOG_ZONE_NONE 0x7FFF
+
+// Header fields of a log line
+typedef struct
+{
+    ULONGLONG time;          // FILETIME value in the zone of the log, 0 when the line has no timestamp
+    LogSeverity severity;
+    short zone;              // Minutes east of UTC written with the time, LOG_ZONE_NONE if not known
+} LogFields;
+
+/**
+ * Find the line breaks in a block of log text
+ * @param data Text
+ * @param length Length of the text
+ * @param base Offset of the text in the log
+ * @param next Receives the offset after each line break, i.e. of the line that follows
+ * @param max Capacity of next; when it fills up, scanning resumes at the last entry
+ * @return Number of line breaks found
+ */
+size_t log_scan_lines(const char *data, size_t length, ULONGLONG base, ULONGLONG *next, size_t max);
+
+/**
+ * Extract the header fields of lines in a block of log text. Understands
+ * the logs of the Devilbox containers:
+ *   PHP and php-fpm  [25-Feb-2025 07:16:59 UTC] PHP Warning: ...
+ *   nginx errors     2025/02/25 07:16:59 [error] ...
+ *   Apache errors    [Tue Feb 25 07:16:59.123456 2025] [php:error] ...
+ *   access logs      172.16.238.1 - - [25/Feb/2025:07:16:59 +0000] "GET / HTTP/1.1" 404 ...
+ *   MySQL, MariaDB   2025-02-25T07:16:59.123456Z 0 [Warning] ... (also "# Time:" of the slow log)
+ * Times are taken as written. The zone written with them, the Z of MySQL,
+ * the UTC of PHP or the offset of access logs, is returned next to them;
+ * nginx and Apache error logs and PHP with a zone name are in the TIMEZONE
+ * of .env with no offset to read. Access log lines get their severity from
+ * the status code.
+ * @param data Text
+ * @param length Length of the text
+ * @param base Offset of the text in the log
+ * @param lines Offsets of the line starts, within the text
+ * @param count Number of lines
+ * @param fields Receives the fields of each line
+ */
+void log_scan_fields(const char *data, size_t length, ULONGLONG base, const ULONGLONG *lines, size_t count,
+                     LogFields *fields);
+
+/**
+ * Parse the timestamp at the start of a single log line
+ * @param line Line text (need not be terminated)
+ * @param length Length of the line
+ * @param time Receives the time as a FILETIME value, in the zone of the log
+ * @return TRUE if the line starts with a timestamp
+ */
+BOOL log_parse_time(const char *line, size_t length, ULONGLONG *time);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LOG_SCAN_H */
\ No newline at end of file
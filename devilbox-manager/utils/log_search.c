@@ -0,0 +1,911 @@
+/*******************************************************************************
+ * Log Search Module Implementation
+ * Trigram block index of a log and line matching of search patterns
+ *******************************************************************************/
+
+ #include "log_search.h"
+ #include "log_reader.h"
+ #include "hash_utils.h"
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ 
+ #define LOG_SEARCH_MAGIC "DBXTRG01"
+ 
+ // Trigram hash buckets; block numbers within a segment fit in the low 16 bits of a posting
+ #define SEARCH_BUCKETS 65536
+ 
+ // Bytes at the start of the log checked to tell a rotated log from a grown one
+ #define SEARCH_HEAD 512
+ 
+ // Longest regular expression, in items
+ #define QUERY_MAX_ITEMS 128
+ 
+ // Trigrams a query requires, at most
+ #define QUERY_MAX_BUCKETS 64
+ 
+ // Index file header, followed by the segments
+ typedef struct
+ {
+     char magic[8];
+     ULONGLONG file_id;       // Identity of the indexed log
+     ULONGLONG head_hash;     // Hash of the first head_length bytes of the log
+     ULONGLONG indexed;       // End of the last indexed block, always a line end
+     DWORD head_length;
+     DWORD segments;
+ } SearchHeader;
+ 
+ // Segment header, followed by the block ends, the bucket directory and the posting lists
+ typedef struct
+ {
+     ULONGLONG start;         // Offset of the first block
+     DWORD blocks;
+     DWORD buckets;           // Buckets with postings
+     DWORD data_size;         // Bytes of posting lists
+     DWORD reserved;
+ } SegmentHeader;
+ 
+ // Where the posting list of a bucket starts in the segment data. Lists hold
+ // the numbers of the blocks with the trigram, ascending, as varint deltas.
+ typedef struct
+ {
+     DWORD bucket;
+     DWORD offset;
+ } BucketEntry;
+ 
+ // Blocks of the segment being built
+ typedef struct
+ {
+     unsigned long long bits[SEARCH_BUCKETS / 64]; // Trigrams of the current block
+     DWORD *postings;         // Bucket << 16 | block number, in block order
+     size_t count;
+     size_t allocated;
+     BOOL failed;             // Out of memory, the segment is not written
+     ULONGLONG ends[LOG_SEARCH_SEGMENT_BLOCKS];
+ } SegmentBuilder;
+ 
+ // Item of a regular expression
+ typedef enum
+ {
+     ITEM_CHAR,
+     ITEM_ANY,
+     ITEM_CLASS,
+     ITEM_BOL,
+     ITEM_EOL
+ } ItemType;
+ 
+ typedef enum
+ {
+     REPEAT_ONE,
+     REPEAT_STAR,
+     REPEAT_PLUS,
+     REPEAT_QUEST
+ } ItemRepeat;
+ 
+ typedef struct
+ {
+     ItemType type;
+     ItemRepeat repeat;
+     unsigned char c;         // ITEM_CHAR, lower case
+     unsigned char set[32];   // ITEM_CLASS, both cases of letters
+ } QueryItem;
+ 
+ struct LogQuery
+ {
+     BOOL regex;
+     char *text;              // Substring, lower case
+     size_t length;
+     QueryItem *items;        // Regular expression
+     int count;
+     DWORD buckets[QUERY_MAX_BUCKETS]; // Trigrams every match contains
+     int bucket_count;
+ };
+ 
+ static BOOL header_matches(const SearchHeader *header, LogReader *reader, ULONGLONG file_id);
+ static BOOL write_header(FILE *f, SearchHeader *header, LogReader *reader);
+ static ULONGLONG head_hash(LogReader *reader, DWORD length);
+ static void index_block(SegmentBuilder *builder, LogReader *reader, ULONGLONG start, ULONGLONG end, DWORD number);
+ static BOOL write_segment(FILE *f, long *position, ULONGLONG start, SegmentBuilder *builder, DWORD blocks);
+ static BOOL search_segment(FILE *f, LogReader *reader, const char *log_path, const LogQuery *query,
+                            LogMatchCallback callback, void *context, LogSearchStats *stats, BOOL *stopped);
+ static BOOL scan_region(LogReader *reader, const char *log_path, ULONGLONG offset, ULONGLONG end,
+                         const LogQuery *query, LogMatchCallback callback, void *context, LogSearchStats *stats);
+ static const char *parse_items(LogQuery *query, const char *pattern);
+ static void add_run(LogQuery *query, const unsigned char *run, size_t length);
+ 
+ static unsigned char fold(unsigned char c)
+ {
+     return c >= 'A' && c <= 'Z' ? c + 32 : c;
+ }
+ 
+ /**
+  * Bucket of the last three bytes, lower case, in the low 24 bits
+  */
+ static DWORD trigram_bucket(DWORD trigram)
+ {
+     return (DWORD)(trigram * 2654435761u) >> 16;
+ }
+ 
+ BOOL log_search_update(const char *log_path, const volatile LONG *cancelled)
+ {
+     char path[MAX_PATH_LEN];
+     SearchHeader header;
+     SegmentBuilder *builder;
+     LogReader *reader;
+     ULONGLONG file_id = 0, end, merge_start = 0;
+     DWORD merge_from;
+     long position, merge_position = 0;
+     BOOL ok = TRUE;
+     FILE *f;
+ 
+     reader = log_reader_open(log_path);
+     if (!reader)
+         return FALSE;
+     snprintf(path, sizeof(path), "%s%s", log_path, LOG_SEARCH_SUFFIX);
+     log_reader_file_id(reader, &file_id);
+ 
+     // Start over unless the index covers the beginning of this very log
+     f = fopen(path, "r+b");
+     if (!f || fread(&header, sizeof(header), 1, f) != 1 ||
+         memcmp(header.magic, LOG_SEARCH_MAGIC, sizeof(header.magic)) != 0 ||
+         !header_matches(&header, reader, file_id))
+     {
+         if (f)
+             fclose(f);
+         f = fopen(path, "w+b");
+         if (!f)
+         {
+             log_reader_close(reader);
+             return FALSE;
+         }
+         ZeroMemory(&header, sizeof(header));
+         memcpy(header.magic, LOG_SEARCH_MAGIC, sizeof(header.magic));
+         header.file_id = file_id;
+     }
+ 
+     // Walk the segments for the end of the file and the small ones updates left at the end
+     position = sizeof(header);
+     merge_from = header.segments;
+     for (DWORD i = 0; i < header.segments; i++)
+     {
+         SegmentHeader segment;
+ 
+         if (fseek(f, position, SEEK_SET) != 0 || fread(&segment, sizeof(segment), 1, f) != 1)
+         {
+             // Damaged, index the log again
+             header.segments = 0;
+             header.indexed = 0;
+             position = sizeof(header);
+             merge_from = 0;
+             break;
+         }
+         if (segment.blocks >= LOG_SEARCH_SEGMENT_BLOCKS)
+             merge_from = header.segments;
+         else if (merge_from == header.segments)
+         {
+             merge_from = i;
+             merge_position = position;
+             merge_start = segment.start;
+         }
+         position += (long)(sizeof(segment) + segment.blocks * sizeof(ULONGLONG) +
+                            segment.buckets * sizeof(BucketEntry) + segment.data_size);
+     }
+ 
+     // Many small segments slow searches down, their blocks are indexed again as one.
+     // The header drops them first, so an interrupted update cannot leave it pointing at overwritten data.
+     if (merge_from < header.segments && header.segments - merge_from > LOG_SEARCH_MAX_SEGMENTS)
+     {
+         header.segments = merge_from;
+         header.indexed = merge_start;
+         position = merge_position;
+         if (!write_header(f, &header, reader))
+         {
+             fclose(f);
+             log_reader_close(reader);
+             return FALSE;
+         }
+     }
+ 
+     // A block still being filled is left for the next update
+     end = log_reader_line_start(reader, log_reader_size(reader));
+     builder = (SegmentBuilder *)calloc(1, sizeof(SegmentBuilder));
+     ok = builder != NULL;
+     while (ok && end - header.indexed >= LOG_SEARCH_BLOCK && !(cancelled && *cancelled))
+     {
+         ULONGLONG start = header.indexed, offset = start;
+         DWORD blocks = 0;
+ 
+         builder->count = 0;
+         builder->failed = FALSE;
+         while (blocks < LOG_SEARCH_SEGMENT_BLOCKS && end - offset >= LOG_SEARCH_BLOCK && !(cancelled && *cancelled))
+         {
+             ULONGLONG block_end = log_reader_next_line(reader, offset + LOG_SEARCH_BLOCK - 1);
+ 
+             if (block_end > end)
+                 break;
+             index_block(builder, reader, offset, block_end, blocks);
+             builder->ends[blocks++] = offset = block_end;
+         }
+         if (blocks == 0)
+             break;
+ 
+         ok = write_segment(f, &position, start, builder, blocks);
+         if (ok)
+         {
+             header.segments++;
+             header.indexed = offset;
+         }
+     }
+     free(builder);
+     log_reader_unmap(reader);
+ 
+     // Header last, so an interrupted update only loses the segments it added
+     if (!write_header(f, &header, reader))
+         ok = FALSE;
+     if (fclose(f) != 0)
+         ok = FALSE;
+     log_reader_close(reader);
+     return ok && !(cancelled && *cancelled);
+ }
+ 
+ BOOL log_search_file(const char *log_path, const LogQuery *query, BOOL use_index, LogMatchCallback callback,
+                      void *context, LogSearchStats *stats)
+ {
+     LogSearchStats local;
+     LARGE_INTEGER started, finished, frequency;
+     LogReader *reader;
+     ULONGLONG file_id = 0, offset = 0;
+     BOOL ok = TRUE, stopped = FALSE;
+ 
+     if (!stats)
+         stats = &local;
+     QueryPerformanceCounter(&started);
+ 
+     reader = log_reader_open(log_path);
+     if (!reader)
+         return FALSE;
+ 
+     if (use_index)
+     {
+         char path[MAX_PATH_LEN];
+         SearchHeader header;
+         FILE *f;
+ 
+         snprintf(path, sizeof(path), "%s%s", log_path, LOG_SEARCH_SUFFIX);
+         log_reader_file_id(reader, &file_id);
+         f = fopen(path, "rb");
+         if (f && fread(&header, sizeof(header), 1, f) == 1 &&
+             memcmp(header.magic, LOG_SEARCH_MAGIC, sizeof(header.magic)) == 0 &&
+             header_matches(&header, reader, file_id))
+         {
+             DWORD segment = 0;
+ 
+             while (segment < header.segments &&
+                    search_segment(f, reader, log_path, query, callback, context, stats, &stopped))
+                 segment++;
+ 
+             // Only read past the index when every segment was searched
+             if (segment == header.segments)
+                 offset = header.indexed;
+             else
+                 ok = FALSE;
+         }
+         if (f)
+             fclose(f);
+     }
+ 
+     if (ok && !stopped)
+         ok = scan_region(reader, log_path, offset, log_reader_size(reader), query, callback, context, stats);
+     else if (stopped)
+         ok = FALSE;
+     log_reader_close(reader);
+ 
+     QueryPerformanceCounter(&finished);
+     QueryPerformanceFrequency(&frequency);
+     stats->query_us += (ULONGLONG)((finished.QuadPart - started.QuadPart) * 1000000 / frequency.QuadPart);
+     return ok;
+ }
+ 
+ LogQuery *log_query_compile(const char *pattern, BOOL regex, char *error, size_t error_size)
+ {
+     LogQuery *query = (LogQuery *)calloc(1, sizeof(LogQuery));
+     const char *problem = NULL;
+ 
+     if (!query)
+     {
+         snprintf(error, error_size, "Out of memory.");
+         return NULL;
+     }
+     query->regex = regex;
+ 
+     if (regex)
+     {
+         query->items = (QueryItem *)calloc(QUERY_MAX_ITEMS, sizeof(QueryItem));
+         problem = query->items ? parse_items(query, pattern) : "Out of memory.";
+     }
+     else
+     {
+         query->length = strlen(pattern);
+         query->text = (char *)malloc(query->length + 1);
+         if (query->text)
+         {
+             for (size_t i = 0; i <= query->length; i++)
+                 query->text[i] = (char)fold((unsigned char)pattern[i]);
+             add_run(query, (const unsigned char *)query->text, query->length);
+         }
+         else
+             problem = "Out of memory.";
+     }
+ 
+     if (problem)
+     {
+         snprintf(error, error_size, "%s", problem);
+         log_query_free(query);
+         return NULL;
+     }
+     return query;
+ }
+ 
+ /**
+  * Check whether an item accepts a character
+  */
+ static BOOL item_accepts(const QueryItem *item, unsigned char c)
+ {
+     switch (item->type)
+     {
+     case ITEM_CHAR:
+         return fold(c) == item->c;
+     case ITEM_ANY:
+         return TRUE;
+     case ITEM_CLASS:
+         return (item->set[c >> 3] >> (c & 7)) & 1;
+     default:
+         return FALSE;
+     }
+ }
+ 
+ /**
+  * Match the items from a position on, backtracking over repeats
+  */
+ static BOOL match_here(const QueryItem *item, const QueryItem *last, const char *line, size_t pos, size_t length)
+ {
+     for (; item < last; item++)
+     {
+         size_t count = 0, min, max;
+ 
+         if (item->type == ITEM_BOL || item->type == ITEM_EOL)
+         {
+             if (pos != (item->type == ITEM_BOL ? 0 : length))
+                 return FALSE;
+             continue;
+         }
+         if (item->repeat == REPEAT_ONE)
+         {
+             if (pos >= length || !item_accepts(item, (unsigned char)line[pos]))
+                 return FALSE;
+             pos++;
+             continue;
+         }
+ 
+         // Take as many as possible, then give them back one at a time
+         min = item->repeat == REPEAT_PLUS ? 1 : 0;
+         max = item->repeat == REPEAT_QUEST ? 1 : length - pos;
+         while (count < max && pos + count < length && item_accepts(item, (unsigned char)line[pos + count]))
+             count++;
+         for (size_t taken = count + 1; taken-- > min;)
+         {
+             if (match_here(item + 1, last, line, pos + taken, length))
+                 return TRUE;
+         }
+         return FALSE;
+     }
+     return TRUE;
+ }
+ 
+ BOOL log_query_match(const LogQuery *query, const char *line, size_t length)
+ {
+     if (query->regex)
+     {
+         const QueryItem *last = query->items + query->count;
+ 
+         if (query->count > 0 && query->items[0].type == ITEM_BOL)
+             return match_here(query->items, last, line, 0, length);
+         for (size_t pos = 0; pos <= length; pos++)
+         {
+             if (match_here(query->items, last, line, pos, length))
+                 return TRUE;
+         }
+         return FALSE;
+     }
+ 
+     if (query->length == 0)
+         return TRUE;
+     for (size_t pos = 0; pos + query->length <= length; pos++)
+     {
+         size_t i;
+ 
+         if (fold((unsigned char)line[pos]) != (unsigned char)query->text[0])
+             continue;
+         for (i = 1; i < query->length && fold((unsigned char)line[pos + i]) == (unsigned char)query->text[i]; i++)
+             ;
+         if (i == query->length)
+             return TRUE;
+     }
+     return FALSE;
+ }
+ 
+ void log_query_free(LogQuery *query)
+ {
+     if (!query)
+         return;
+ 
+     free(query->text);
+     free(query->items);
+     free(query);
+ }
+ 
+ /**
+  * Check that the index belongs to the log as it is now
+  */
+ static BOOL header_matches(const SearchHeader *header, LogReader *reader, ULONGLONG file_id)
+ {
+     // Copy-truncate rotation keeps the file, so check its content as well
+     return header->file_id == file_id && header->indexed <= log_reader_size(reader) &&
+            header->head_length <= header->indexed && head_hash(reader, header->head_length) == header->head_hash;
+ }
+ 
+ /**
+  * Write the header after the segments it lists
+  */
+ static BOOL write_header(FILE *f, SearchHeader *header, LogReader *reader)
+ {
+     header->head_length = header->indexed < SEARCH_HEAD ? (DWORD)header->indexed : SEARCH_HEAD;
+     header->head_hash = head_hash(reader, header->head_length);
+     return fflush(f) == 0 && fseek(f, 0, SEEK_SET) == 0 &&
+            fwrite(header, sizeof(*header), 1, f) == 1 && fflush(f) == 0;
+ }
+ 
+ /**
+  * Hash the start of the log
+  */
+ static ULONGLONG head_hash(LogReader *reader, DWORD length)
+ {
+     size_t available;
+     const char *p = length ? log_reader_map(reader, 0, &available) : NULL;
+ 
+     if (!p || available < length)
+         return 0;
+     return hash_buffer(p, length, 0);
+ }
+ 
+ /**
+  * Collect the trigrams of one block. Lines are matched one at a time, so
+  * trigrams across a line break are left out.
+  */
+ static void index_block(SegmentBuilder *builder, LogReader *reader, ULONGLONG start, ULONGLONG end, DWORD number)
+ {
+     DWORD trigram = 0;
+     int have = 0;
+ 
+     memset(builder->bits, 0, sizeof(builder->bits));
+     while (start < end)
+     {
+         size_t available;
+         const unsigned char *p = (const unsigned char *)log_reader_map(reader, start, &available);
+ 
+         if (!p)
+             break;
+         if (available > end - start)
+             available = (size_t)(end - start);
+ 
+         // The last bytes carry over when the block crosses the end of the view
+         for (size_t i = 0; i < available; i++)
+         {
+             if (p[i] == '\n')
+             {
+                 have = 0;
+                 continue;
+             }
+             trigram = ((trigram << 8) | fold(p[i])) & 0xFFFFFF;
+             if (++have >= 3)
+             {
+                 DWORD bucket = trigram_bucket(trigram);
+                 builder->bits[bucket >> 6] |= 1ULL << (bucket & 63);
+             }
+         }
+         start += available;
+     }
+ 
+     for (DWORD word = 0; word < SEARCH_BUCKETS / 64; word++)
+     {
+         for (unsigned long long bits = builder->bits[word]; bits; bits &= bits - 1)
+         {
+             if (builder->count == builder->allocated)
+             {
+                 size_t allocated = builder->allocated ? builder->allocated * 2 : 65536;
+                 DWORD *postings = (DWORD *)realloc(builder->postings, allocated * sizeof(DWORD));
+ 
+                 if (!postings)
+                 {
+                     builder->failed = TRUE;
+                     builder->count = 0;
+                     return;
+                 }
+                 builder->postings = postings;
+                 builder->allocated = allocated;
+             }
+             builder->postings[builder->count++] = ((word * 64 + __builtin_ctzll(bits)) << 16) | number;
+         }
+     }
+ }
+ 
+ /**
+  * Sort the postings by bucket and append the segment to the index file
+  */
+ static BOOL write_segment(FILE *f, long *position, ULONGLONG start, SegmentBuilder *builder, DWORD blocks)
+ {
+     DWORD *first = (DWORD *)calloc(SEARCH_BUCKETS + 1, sizeof(DWORD));
+     WORD *sorted = (WORD *)malloc(builder->count * sizeof(WORD) + 1);
+     BucketEntry *directory = (BucketEntry *)malloc(SEARCH_BUCKETS * sizeof(BucketEntry));
+     unsigned char *data = (unsigned char *)malloc(builder->count * 2 + 1);
+     SegmentHeader segment;
+     ULONGLONG size;
+     BOOL ok = first && sorted && directory && data && !builder->failed;
+ 
+     if (ok)
+     {
+         // Counting sort keeps the block order within each bucket
+         for (size_t i = 0; i < builder->count; i++)
+             first[(builder->postings[i] >> 16) + 1]++;
+         for (DWORD bucket = 0; bucket < SEARCH_BUCKETS; bucket++)
+             first[bucket + 1] += first[bucket];
+         for (size_t i = 0; i < builder->count; i++)
+             sorted[first[builder->postings[i] >> 16]++] = (WORD)builder->postings[i];
+ 
+         // first[] now holds the end of each bucket
+         ZeroMemory(&segment, sizeof(segment));
+         segment.start = start;
+         segment.blocks = blocks;
+         for (DWORD bucket = 0, i = 0; bucket < SEARCH_BUCKETS; bucket++)
+         {
+             WORD previous = 0;
+ 
+             if (i == first[bucket])
+                 continue;
+             directory[segment.buckets].bucket = bucket;
+             directory[segment.buckets++].offset = segment.data_size;
+             for (; i < first[bucket]; i++)
+             {
+                 WORD delta = sorted[i] - previous;
+ 
+                 if (delta >= 0x80)
+                     data[segment.data_size++] = (unsigned char)(delta | 0x80);
+                 data[segment.data_size++] = (unsigned char)(delta >= 0x80 ? delta >> 7 : delta);
+                 previous = sorted[i];
+             }
+         }
+ 
+         // Offsets in the index file are longs, an index that would pass 2 GB stops growing
+         size = sizeof(segment) + blocks * sizeof(ULONGLONG) + segment.buckets * sizeof(BucketEntry) +
+                segment.data_size;
+         ok = (ULONGLONG)*position + size <= 0x7FFFFFFF && fseek(f, *position, SEEK_SET) == 0 && fwrite(&segment, sizeof(segment), 1, f) == 1 &&
+              fwrite(builder->ends, sizeof(ULONGLONG), blocks, f) == blocks &&
+              fwrite(directory, sizeof(BucketEntry), segment.buckets, f) == segment.buckets &&
+              fwrite(data, 1, segment.data_size, f) == segment.data_size;
+         if (ok)
+             *position += (long)size;
+     }
+ 
+     free(first);
+     free(sorted);
+     free(directory);
+     free(data);
+     return ok;
+ }
+ 
+ /**
+  * Search the candidate blocks of the segment at the file position and move past it
+  * @return FALSE on a read error or when the callback stopped the search (stopped is set)
+  */
+ static BOOL search_segment(FILE *f, LogReader *reader, const char *log_path, const LogQuery *query,
+                            LogMatchCallback callback, void *context, LogSearchStats *stats, BOOL *stopped)
+ {
+     SegmentHeader segment;
+     ULONGLONG *ends = NULL;
+     BucketEntry *directory = NULL;
+     unsigned char candidates[LOG_SEARCH_SEGMENT_BLOCKS / 8];
+     unsigned char *list = NULL;
+     long data;
+     BOOL ok;
+ 
+     ok = fread(&segment, sizeof(segment), 1, f) == 1 && segment.blocks <= LOG_SEARCH_SEGMENT_BLOCKS &&
+          segment.buckets <= SEARCH_BUCKETS;
+     if (ok)
+     {
+         ends = (ULONGLONG *)malloc(segment.blocks * sizeof(ULONGLONG) + 1);
+         directory = (BucketEntry *)malloc(segment.buckets * sizeof(BucketEntry) + 1);
+         ok = ends && directory && fread(ends, sizeof(ULONGLONG), segment.blocks, f) == segment.blocks &&
+              fread(directory, sizeof(BucketEntry), segment.buckets, f) == segment.buckets;
+     }
+     data = ftell(f);
+ 
+     // Every trigram of the query narrows the blocks down to those holding it
+     memset(candidates, 0xFF, sizeof(candidates));
+     for (int q = 0; ok && q < query->bucket_count; q++)
+     {
+         unsigned char found[LOG_SEARCH_SEGMENT_BLOCKS / 8] = {0};
+         DWORD low = 0, high = segment.buckets, length, block = 0;
+ 
+         while (low < high)
+         {
+             DWORD mid = low + (high - low) / 2;
+ 
+             if (directory[mid].bucket < query->buckets[q])
+                 low = mid + 1;
+             else
+                 high = mid;
+         }
+         if (low < segment.buckets && directory[low].bucket == query->buckets[q])
+         {
+             length = (low + 1 < segment.buckets ? directory[low + 1].offset : segment.data_size) -
+                      directory[low].offset;
+             free(list);
+             list = (unsigned char *)malloc(length + 1);
+             ok = list && fseek(f, data + (long)directory[low].offset, SEEK_SET) == 0 &&
+                  fread(list, 1, length, f) == length;
+             for (DWORD i = 0; ok && i < length; i++)
+             {
+                 DWORD delta = list[i] & 0x7F;
+ 
+                 if ((list[i] & 0x80) && i + 1 < length)
+                     delta |= (DWORD)list[++i] << 7;
+                 block += delta;
+                 if (block < LOG_SEARCH_SEGMENT_BLOCKS)
+                     found[block >> 3] |= (unsigned char)(1 << (block & 7));
+             }
+         }
+         for (size_t i = 0; i < sizeof(candidates); i++)
+             candidates[i] &= found[i];
+     }
+ 
+     for (DWORD block = 0; ok && block < segment.blocks; block++)
+     {
+         if (!((candidates[block >> 3] >> (block & 7)) & 1))
+             continue;
+         stats->candidates++;
+         if (!scan_region(reader, log_path, block ? ends[block - 1] : segment.start, ends[block], query, callback,
+                          context, stats))
+         {
+             *stopped = TRUE;
+             ok = FALSE;
+         }
+     }
+     stats->blocks += segment.blocks;
+ 
+     if (ok)
+         ok = fseek(f, data + (long)segment.data_size, SEEK_SET) == 0;
+     log_reader_unmap(reader);
+     free(ends);
+     free(directory);
+     free(list);
+     return ok;
+ }
+ 
+ /**
+  * Match the lines of part of a log
+  * @return FALSE when the callback stopped the search
+  */
+ static BOOL scan_region(LogReader *reader, const char *log_path, ULONGLONG offset, ULONGLONG end,
+                         const LogQuery *query, LogMatchCallback callback, void *context, LogSearchStats *stats)
+ {
+     char line[LOG_SEARCH_LINE_MAX];
+ 
+     stats->bytes_read += end > offset ? end - offset : 0;
+     while (offset < end)
+     {
+         size_t available, length;
+         const char *p = log_reader_map(reader, offset, &available);
+         const char *newline;
+         ULONGLONG next;
+ 
+         if (!p)
+             break;
+         if (available > end - offset)
+             available = (size_t)(end - offset);
+         newline = (const char *)memchr(p, '\n', available);
+ 
+         if (newline || offset + available == end)
+         {
+             // The line is in the view, match it in place
+             length = newline ? (size_t)(newline - p) : available;
+             next = offset + length + (newline ? 1 : 0);
+             if (length > 0 && p[length - 1] == '\r')
+                 length--;
+         }
+         else
+         {
+             // The line crosses the end of the view
+             length = log_reader_get_line(reader, offset, line, sizeof(line), &next);
+             p = line;
+         }
+ 
+         if (log_query_match(query, p, length))
+         {
+             stats->matches++;
+             if (!callback(log_path, offset, p, length < LOG_SEARCH_LINE_MAX ? length : LOG_SEARCH_LINE_MAX - 1,
+                           context))
+                 return FALSE;
+         }
+         offset = next;
+     }
+     return TRUE;
+ }
+ 
+ /**
+  * Add the trigrams of a run of characters every match contains
+  */
+ static void add_run(LogQuery *query, const unsigned char *run, size_t length)
+ {
+     for (size_t i = 2; i < length && query->bucket_count < QUERY_MAX_BUCKETS; i++)
+     {
+         DWORD trigram = ((DWORD)run[i - 2] << 16) | ((DWORD)run[i - 1] << 8) | run[i];
+         query->buckets[query->bucket_count++] = trigram_bucket(trigram);
+     }
+ }
+ 
+ /**
+  * Add a character, or a range of them, to a class in both cases
+  */
+ static void class_add(QueryItem *item, unsigned char from, unsigned char to)
+ {
+     for (unsigned c = from; c <= to; c++)
+     {
+         unsigned char lower = fold((unsigned char)c);
+         unsigned char upper = lower >= 'a' && lower <= 'z' ? lower - 32 : lower;
+ 
+         item->set[lower >> 3] |= (unsigned char)(1 << (lower & 7));
+         item->set[upper >> 3] |= (unsigned char)(1 << (upper & 7));
+     }
+ }
+ 
+ /**
+  * Fill a class from an escape: \d, \w or \s, or their negations in upper case
+  * @return FALSE if the escape is not a class
+  */
+ static BOOL class_escape(QueryItem *item, char escape)
+ {
+     unsigned char set[32] = {0};
+     QueryItem tmp;
+ 
+     memset(&tmp, 0, sizeof(tmp));
+     switch (fold((unsigned char)escape))
+     {
+     case 'd':
+         class_add(&tmp, '0', '9');
+         break;
+     case 'w':
+         class_add(&tmp, '0', '9');
+         class_add(&tmp, 'a', 'z');
+         class_add(&tmp, '_', '_');
+         break;
+     case 's':
+         class_add(&tmp, ' ', ' ');
+         class_add(&tmp, '\t', '\r');
+         break;
+     default:
+         return FALSE;
+     }
+ 
+     memcpy(set, tmp.set, sizeof(set));
+     for (int i = 0; i < 32; i++)
+         item->set[i] |= escape >= 'A' && escape <= 'Z' ? (unsigned char)~set[i] : set[i];
+     return TRUE;
+ }
+ 
+ /**
+  * Parse a regular expression into items and collect the trigrams of its literal runs
+  * @return Error message, NULL on success
+  */
+ static const char *parse_items(LogQuery *query, const char *pattern)
+ {
+     unsigned char run[256];
+     size_t run_length = 0;
+     const char *p = pattern;
+ 
+     while (*p)
+     {
+         QueryItem *item = &query->items[query->count];
+ 
+         if (query->count == QUERY_MAX_ITEMS)
+             return "The regular expression is too long.";
+ 
+         if (*p == '^' && p == pattern)
+             item->type = ITEM_BOL;
+         else if (*p == '$' && p[1] == '\0')
+             item->type = ITEM_EOL;
+         else if (*p == '.')
+             item->type = ITEM_ANY;
+         else if (*p == '[')
+         {
+             BOOL negate = p[1] == '^';
+ 
+             item->type = ITEM_CLASS;
+             p += negate ? 2 : 1;
+             for (BOOL first = TRUE; *p && (*p != ']' || first); first = FALSE)
+             {
+                 unsigned char from = (unsigned char)*p++;
+ 
+                 if (from == '\\' && *p && class_escape(item, *p))
+                 {
+                     p++;
+                     continue;
+                 }
+                 if (from == '\\' && *p)
+                     from = (unsigned char)*p++;
+                 if (*p == '-' && p[1] && p[1] != ']')
+                 {
+                     unsigned char to = (unsigned char)p[1];
+ 
+                     p += 2;
+                     if (to < from)
+                         return "Invalid range in [ ].";
+                     class_add(item, from, to);
+                 }
+                 else
+                     class_add(item, from, from);
+             }
+             if (*p != ']')
+                 return "Missing ] in the regular expression.";
+             if (negate)
+             {
+                 for (int i = 0; i < 32; i++)
+                     item->set[i] = (unsigned char)~item->set[i];
+             }
+         }
+         else if (*p == '\\')
+         {
+             if (!p[1])
+                 return "The regular expression ends with a backslash.";
+             p++;
+             if (class_escape(item, *p))
+                 item->type = ITEM_CLASS;
+             else
+             {
+                 item->type = ITEM_CHAR;
+                 item->c = fold((unsigned char)*p);
+             }
+         }
+         else if (strchr("()|{}", *p))
+             return "Groups, alternation and counted repeats are not supported.";
+         else if (strchr("*+?", *p))
+             return "A repeat (* + ?) must follow a character or class.";
+         else
+         {
+             item->type = ITEM_CHAR;
+             item->c = fold((unsigned char)*p);
+         }
+         p++;
+ 
+         if (item->type != ITEM_BOL && item->type != ITEM_EOL && *p && strchr("*+?", *p))
+         {
+             item->repeat = *p == '*' ? REPEAT_STAR : *p == '+' ? REPEAT_PLUS : REPEAT_QUEST;
+             p++;
+         }
+         query->count++;
+ 
+         // Literal runs give the trigrams; a repeated character ends a run and, with +, starts the next
+         if (item->type == ITEM_CHAR && item->repeat != REPEAT_STAR && item->repeat != REPEAT_QUEST &&
+             run_length < sizeof(run))
+             run[run_length++] = item->c;
+         if (item->type != ITEM_CHAR || item->repeat != REPEAT_ONE || run_length == sizeof(run))
+         {
+             add_run(query, run, run_length);
+             run_length = 0;
+             if (item->type == ITEM_CHAR && item->repeat == REPEAT_PLUS)
+                 run[run_length++] = item->c;
+         }
+     }
+ 
+     add_run(query, run, run_length);
+     return NULL;
+ }
\ No newline at end of file
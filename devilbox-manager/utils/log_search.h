@@ -0,0 +1,117 @@
+/*******************************************************************************
+ * Log Search Module Header
+ * Substring and regular expression search in log files. An optional on-disk
+ * trigram index per log names the blocks that can hold a match, so only
+ * those are read; it is extended as the log grows.
+ *******************************************************************************/
+#ifndef LOG_SEARCH_H
+#define LOG_SEARCH_H
+
+#include <windows.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Maximum path length constant (if not already defined)
+#ifndef MAX_PATH_LEN
+#define MAX_PATH_LEN 260
+#endif
+
+// Index file, kept next to the log
+#define LOG_SEARCH_SUFFIX ".trigram"
+
+// Bytes of log per indexed block, blocks end at the first line end past this
+#define LOG_SEARCH_BLOCK 65536
+
+// Blocks per index segment, one segment is built in memory at a time
+#define LOG_SEARCH_SEGMENT_BLOCKS 512
+
+// Small segments appended by updates before they are merged into one
+#define LOG_SEARCH_MAX_SEGMENTS 8
+
+// Longest line passed to the match callback, longer lines are cut
+#define LOG_SEARCH_LINE_MAX 4096
+
+// Compiled search pattern (opaque)
+typedef struct LogQuery LogQuery;
+
+// Work done by searches, added up over calls
+typedef struct
+{
+    ULONGLONG blocks;        // Indexed blocks in the searched logs
+    ULONGLONG candidates;    // Blocks the index could not rule out
+    ULONGLONG bytes_read;    // Bytes matched line by line: candidate blocks and unindexed parts
+    ULONGLONG matches;
+    ULONGLONG query_us;      // Time spent searching, index updates not included
+} LogSearchStats;
+
+/**
+ * Called for each matching line
+ * @param path Log file
+ * @param offset Offset of the line start
+ * @param line Line text without its line break, not terminated
+ * @param length Length of the text
+ * @param context Caller data
+ * @return FALSE to stop the search
+ */
+typedef BOOL (*LogMatchCallback)(const char *path, ULONGLONG offset, const char *line, size_t length, void *context);
+
+/**
+ * Compile a search pattern. Case is ignored. Regular expressions support
+ * literals, '.', [classes] with ranges and '^' negation, \d \w \s and
+ * escaped characters, the anchors ^ and $, and the quantifiers * + ? on a
+ * single item; groups and alternation are not supported.
+ * @param pattern Text to find, or a regular expression
+ * @param regex TRUE if the pattern is a regular expression
+ * @param error Receives the reason when the pattern is invalid
+ * @param error_size Size of the error buffer
+ * @return Query, NULL if the pattern is invalid or out of memory
+ */
+LogQuery *log_query_compile(const char *pattern, BOOL regex, char *error, size_t error_size);
+
+/**
+ * Check a line against a query
+ * @param query Query
+ * @param line Line text without its line break
+ * @param length Length of the line
+ * @return TRUE if the line matches
+ */
+BOOL log_query_match(const LogQuery *query, const char *line, size_t length);
+
+/**
+ * Free a query
+ * @param query Query (may be NULL)
+ */
+void log_query_free(LogQuery *query);
+
+/**
+ * Bring the trigram index of a log up to date. Complete blocks appended
+ * since the last update are indexed; the index of a rotated, truncated or
+ * replaced log is rebuilt.
+ * @param log_path Log file path
+ * @param cancelled Checked between blocks, non-zero stops the update (may be NULL)
+ * @return TRUE if the index covers the log up to its last complete block
+ */
+BOOL log_search_update(const char *log_path, const volatile LONG *cancelled);
+
+/**
+ * Search a log. With the index, only candidate blocks and the part after
+ * the last indexed block are read; without it, or when the index does not
+ * match the log, the whole log is read.
+ * @param log_path Log file path
+ * @param query Query
+ * @param use_index TRUE to use the trigram index as left by log_search_update
+ * @param callback Called for each matching line
+ * @param context Passed to the callback
+ * @param stats Work counters, added to (may be NULL)
+ * @return FALSE if the log cannot be read or the callback stopped the search
+ */
+BOOL log_search_file(const char *log_path, const LogQuery *query, BOOL use_index, LogMatchCallback callback,
+                     void *context, LogSearchStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LOG_SEARCH_H */
\ No newline at end of file
@@ -0,0 +1,249 @@
+/*******************************************************************************
+ * Log Timeline Module Implementation
+ * Streaming k-way merge of log files by timestamp
+ *******************************************************************************/
+
+ #include "log_timeline.h"
+ #include "log_reader.h"
+ #include "log_index.h"
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ 
+ // Read position in one log
+ typedef struct
+ {
+     LogReader *reader;
+     char tag[LOG_TIMELINE_TAG_LEN];
+     ULONGLONG end;           // Size when opened
+     ULONGLONG next;          // Offset after the lines of the batch
+     ULONGLONG lines[LOG_SCAN_BATCH];
+     LogFields fields[LOG_SCAN_BATCH];
+     size_t count;            // Lines in the batch
+     size_t pos;              // Current line of the batch
+ } TimelineCursor;
+ 
+ struct LogTimeline
+ {
+     LogTimelineFilter filter;
+     TimelineCursor *cursors;
+     int count;
+     int heap[LOG_TIMELINE_MAX_SOURCES]; // Logs by the time of their next entry, earliest first
+     int heap_size;
+     int current;             // Log whose entry is being returned, -1 between entries
+ };
+ 
+ static ULONGLONG entry_time(const LogTimeline *timeline, const LogFields *field);
+ static BOOL cursor_fill(TimelineCursor *cursor);
+ static BOOL cursor_seek_entry(LogTimeline *timeline, TimelineCursor *cursor);
+ static void heap_push(LogTimeline *timeline, int source);
+ static int heap_pop(LogTimeline *timeline);
+ 
+ LogTimeline *log_timeline_open(const LogTimelineSource *sources, int count, const LogTimelineFilter *filter)
+ {
+     LogTimeline *timeline = (LogTimeline *)calloc(1, sizeof(LogTimeline));
+ 
+     if (!timeline)
+         return NULL;
+ 
+     if (count > LOG_TIMELINE_MAX_SOURCES)
+         count = LOG_TIMELINE_MAX_SOURCES;
+     timeline->cursors = (TimelineCursor *)calloc(count > 0 ? count : 1, sizeof(TimelineCursor));
+     if (!timeline->cursors)
+     {
+         free(timeline);
+         return NULL;
+     }
+     timeline->filter = *filter;
+     timeline->current = -1;
+ 
+     for (int i = 0; i < count; i++)
+     {
+         TimelineCursor *cursor = &timeline->cursors[timeline->count];
+         LogReader *reader = log_reader_open_rotated(sources[i].path);
+ 
+         if (!reader)
+             continue;
+ 
+         cursor->reader = reader;
+         cursor->end = log_reader_size(reader);
+         strncpy(cursor->tag, sources[i].tag, sizeof(cursor->tag) - 1);
+ 
+         if (filter->from)
+         {
+             // The index skips most of the log, the lines up to the range are read from there
+             LogIndex *index = log_index_open(sources[i].path, reader);
+ 
+             if (index)
+             {
+                 cursor->next = log_index_seek(index, filter->from);
+ 
+                 // A log written in another zone has the range at other times of its own
+                 if (cursor_fill(cursor))
+                 {
+                     const LogFields *first = &cursor->fields[cursor->pos];
+                     ULONGLONG shifted = entry_time(timeline, first);
+ 
+                     if (shifted != first->time)
+                     {
+                         cursor->next = log_index_seek(index, filter->from + first->time - shifted);
+                         cursor->count = cursor->pos = 0;
+                     }
+                 }
+             }
+             log_index_free(index);
+ 
+             while (cursor_fill(cursor) && entry_time(timeline, &cursor->fields[cursor->pos]) < filter->from)
+                 cursor->pos++;
+         }
+ 
+         if (cursor_seek_entry(timeline, cursor))
+             heap_push(timeline, timeline->count);
+         timeline->count++;
+     }
+ 
+     return timeline;
+ }
+ 
+ BOOL log_timeline_next(LogTimeline *timeline, char *line, size_t size)
+ {
+     TimelineCursor *cursor;
+     int tag;
+ 
+     if (timeline->current < 0)
+     {
+         if (timeline->heap_size == 0)
+             return FALSE;
+         timeline->current = heap_pop(timeline);
+     }
+     cursor = &timeline->cursors[timeline->current];
+ 
+     tag = snprintf(line, size, "[%s] ", cursor->tag);
+     if (tag < 0 || (size_t)tag >= size)
+         tag = 0;
+     log_reader_get_line(cursor->reader, cursor->lines[cursor->pos], line + tag, size - tag, NULL);
+     cursor->pos++;
+ 
+     // The entry goes on with the lines without a timestamp
+     if (cursor_fill(cursor) && cursor->fields[cursor->pos].time == 0)
+         return TRUE;
+ 
+     // Entry done, the log waits for its turn with the next one
+     if (cursor_seek_entry(timeline, cursor))
+         heap_push(timeline, timeline->current);
+     timeline->current = -1;
+     return TRUE;
+ }
+ 
+ void log_timeline_release(LogTimeline *timeline)
+ {
+     for (int i = 0; i < timeline->count; i++)
+         log_reader_unmap(timeline->cursors[i].reader);
+ }
+ 
+ void log_timeline_close(LogTimeline *timeline)
+ {
+     if (!timeline)
+         return;
+ 
+     for (int i = 0; i < timeline->count; i++)
+         log_reader_close(timeline->cursors[i].reader);
+     free(timeline->cursors);
+     free(timeline);
+ }
+ 
+ /**
+  * Time of a line in the zone of the lines that write none, so logs written in
+  * different zones merge in order: MySQL logs in UTC next to PHP in TIMEZONE
+  */
+ static ULONGLONG entry_time(const LogTimeline *timeline, const LogFields *field)
+ {
+     if (field->zone == LOG_ZONE_NONE || field->zone == timeline->filter.local_zone)
+         return field->time;
+     return field->time + (ULONGLONG)((LONGLONG)(timeline->filter.local_zone - field->zone) * 60 * 10000000);
+ }
+ 
+ /**
+  * Make sure the cursor is on a line, reading the next batch when needed
+  */
+ static BOOL cursor_fill(TimelineCursor *cursor)
+ {
+     if (cursor->pos < cursor->count)
+         return TRUE;
+ 
+     cursor->pos = 0;
+     cursor->count = log_reader_scan(cursor->reader, cursor->next, cursor->end, cursor->lines, cursor->fields,
+                                     LOG_SCAN_BATCH, &cursor->next);
+     return cursor->count > 0;
+ }
+ 
+ /**
+  * Move to the next entry the filter lets through. Logs are written in time
+  * order, so the first entry after the range ends the log.
+  */
+ static BOOL cursor_seek_entry(LogTimeline *timeline, TimelineCursor *cursor)
+ {
+     while (cursor_fill(cursor))
+     {
+         const LogFields *field = &cursor->fields[cursor->pos];
+ 
+         if (timeline->filter.to && entry_time(timeline, field) > timeline->filter.to)
+             return FALSE;
+         if (field->severity >= timeline->filter.min_severity)
+             return TRUE;
+ 
+         // Skip the entry with the lines below it
+         do
+             cursor->pos++;
+         while (cursor_fill(cursor) && cursor->fields[cursor->pos].time == 0);
+     }
+     return FALSE;
+ }
+ 
+ /**
+  * Order of two logs in the heap: by time, then by position in the source list
+  */
+ static BOOL heap_before(const LogTimeline *timeline, int a, int b)
+ {
+     const TimelineCursor *ca = &timeline->cursors[a];
+     const TimelineCursor *cb = &timeline->cursors[b];
+     ULONGLONG ta = entry_time(timeline, &ca->fields[ca->pos]), tb = entry_time(timeline, &cb->fields[cb->pos]);
+ 
+     return ta < tb || (ta == tb && a < b);
+ }
+ 
+ static void heap_push(LogTimeline *timeline, int source)
+ {
+     int i = timeline->heap_size++;
+ 
+     while (i > 0 && heap_before(timeline, source, timeline->heap[(i - 1) / 2]))
+     {
+         timeline->heap[i] = timeline->heap[(i - 1) / 2];
+         i = (i - 1) / 2;
+     }
+     timeline->heap[i] = source;
+ }
+ 
+ static int heap_pop(LogTimeline *timeline)
+ {
+     int top = timeline->heap[0];
+     int last = timeline->heap[--timeline->heap_size];
+     int i = 0;
+ 
+     for (;;)
+     {
+         int child = 2 * i + 1;
+ 
+         if (child >= timeline->heap_size)
+             break;
+         if (child + 1 < timeline->heap_size && heap_before(timeline, timeline->heap[child + 1], timeline->heap[child]))
+             child++;
+         if (!heap_before(timeline, timeline->heap[child], last))
+             break;
+         timeline->heap[i] = timeline->heap[child];
+         i = child;
+     }
+     if (timeline->heap_size > 0)
+         timeline->heap[i] = last;
+     return top;
+ }
\ No newline at end of file
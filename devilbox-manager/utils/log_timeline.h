@@ -0,0 +1,86 @@
+/*******************************************************************************
+ * Log Timeline Module Header
+ * Merges the logs of PHP, the web server and the database into one stream
+ * ordered by time, reading each log only from where the time range starts
+ *******************************************************************************/
+#ifndef LOG_TIMELINE_H
+#define LOG_TIMELINE_H
+
+#include <windows.h>
+#include "log_scan.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Maximum path length constant (if not already defined)
+#ifndef MAX_PATH_LEN
+#define MAX_PATH_LEN 260
+#endif
+
+// Logs merged at most
+#define LOG_TIMELINE_MAX_SOURCES 32
+
+// Longest source tag
+#define LOG_TIMELINE_TAG_LEN 48
+
+// Log merged into the timeline
+typedef struct
+{
+    char path[MAX_PATH_LEN];
+    char tag[LOG_TIMELINE_TAG_LEN]; // Put in front of its lines, e.g. "nginx/default-error"
+} LogTimelineSource;
+
+// What the timeline shows
+typedef struct
+{
+    ULONGLONG from;          // Time range as FILETIME values, 0 for no limit
+    ULONGLONG to;
+    LogSeverity min_severity; // Entries of lower severity are left out, LOG_SEVERITY_NONE for all
+    int local_zone;          // Minutes east of UTC of the TIMEZONE of .env; the range and the order are in
+                             // it, lines written in another zone are moved into it
+} LogTimelineFilter;
+
+// Merged stream of logs (opaque)
+typedef struct LogTimeline LogTimeline;
+
+/**
+ * Open logs for merging. Logs are positioned at the start of the time range
+ * through their timestamp indexes; logs that cannot be opened are skipped.
+ * Lines written after opening are not part of the timeline.
+ * @param sources Logs to merge
+ * @param count Number of logs, at most LOG_TIMELINE_MAX_SOURCES
+ * @param filter Time range and severity
+ * @return Timeline, NULL when out of memory
+ */
+LogTimeline *log_timeline_open(const LogTimelineSource *sources, int count, const LogTimelineFilter *filter);
+
+/**
+ * Get the next line of the timeline. Entries are ordered by time, equal
+ * times keep the order of the sources; lines without a timestamp (stack
+ * traces, continued messages) stay with the entry above them.
+ * @param timeline Timeline
+ * @param line Buffer, receives "[tag] " and the line; long lines are cut
+ * @param size Size of the buffer
+ * @return TRUE if a line was returned, FALSE at the end
+ */
+BOOL log_timeline_next(LogTimeline *timeline, char *line, size_t size);
+
+/**
+ * Release the mapped views of the logs between reads, so they can be
+ * rotated or cleared; reading maps them again
+ * @param timeline Timeline
+ */
+void log_timeline_release(LogTimeline *timeline);
+
+/**
+ * Close a timeline
+ * @param timeline Timeline (may be NULL)
+ */
+void log_timeline_close(LogTimeline *timeline);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LOG_TIMELINE_H */
\ No newline at end of file
@@ -4,15 +4,47 @@
  *******************************************************************************/
 
  #include "logs_viewer.h"
+ #include "log_reader.h"
+ #include "log_index.h"
+ #include "log_groups.h"
  #include <stdio.h>
+ #include <stdlib.h>
  #include <string.h>
  #include <commctrl.h> // For date time picker control
  
+ // Declarations missing from older MinGW headers
+ #ifndef WHEEL_DELTA
+ #define WHEEL_DELTA 120
+ #endif
+ 
+ // Follow mode: change notifications arriving within this delay make one update (ms)
+ #define LOG_FOLLOW_DELAY 200
+ // Follow mode: size check for writes that send no notification in time (ms)
+ #define LOG_FOLLOW_POLL 2000
+ 
+ #define ID_FOLLOW_TIMER 1
+ #define ID_FOLLOW_POLL_TIMER 2
+ #define WM_LOG_CHANGED (WM_APP + 1)
+ 
+ // Lines looked at above the first row for the entry it continues
+ #define LOG_SEVERITY_LOOKBACK 16
+ 
+ // Window class of the view that draws the rows
+ #define LOG_VIEW_CLASS "DevilboxLogView"
+ 
+ // Row of the log view; the text is in the row buffer
+ typedef struct
+ {
+     size_t start;
+     size_t length;
+     LogSeverity severity;    // Of the entry the line belongs to
+ } LogViewRow;
+ 
  // Logs dialog state structure
  typedef struct
  {
      HWND hDlg;
-     HWND hEdit;
+     HWND hView;              // Draws the rows on screen, nothing else of the log is held
      HWND hDateStart;
      HWND hDateEnd;
      HWND hTimeStart;
@@ -23,6 +55,35 @@
      SYSTEMTIME filterEndDate;
      SYSTEMTIME filterStartTime;
      SYSTEMTIME filterEndTime;
+     ULONGLONG filterStart;   // Filter range as FILETIME values
+     ULONGLONG filterEnd;
+     HWND hScroll;            // Position in the log, the view only holds the visible lines
+     HFONT hFont;
+     int lineHeight;
+     int charWidth;
+     LogViewRow *rows;        // Rows on screen
+     int rowCount;
+     int rowCapacity;
+     char *rowText;
+     size_t rowTextUsed;
+     size_t rowTextSize;
+     int column;              // First column shown of lines wider than the view
+     int widestRow;
+     LogReader *reader;
+     ULONGLONG top;           // Offset of the first line shown
+     ULONGLONG spanStart;     // Part of the log being viewed: all of it, or the lines of the filter range
+     ULONGLONG spanEnd;
+     BOOL following;          // Follow mode: new lines are added as the log grows
+     HANDLE followThread;     // Waits for changes in the log directory
+     HANDLE followStop;
+     volatile LONG followPending; // A change message is posted and not handled yet
+     BOOL followTimer;        // An update is scheduled
+     BOOL grouping;           // Repeated entries are shown as one counted row
+     LogGroups *groups;       // Fingerprints of the lines from groupedStart to groupedEnd
+     BOOL groupsValid;
+     ULONGLONG groupedStart;
+     ULONGLONG groupedEnd;
+     int groupTop;            // First group shown
  } LogsDialogState;
  
  // Global state for the logs dialog
@@ -31,10 +92,34 @@
  // Forward declarations of internal functions
  static LRESULT CALLBACK LogsDialogProc(HWND hwnd, UINT msg, WPARAM wp, LPARAM lp);
  static void refresh_log_content(void);
+ static BOOL line_visible(const char *line);
+ static int visible_lines(void);
+ static ULONGLONG step_lines(ULONGLONG offset, int count);
+ static void find_filter_span(void);
+ static void scan_filter_span(ULONGLONG offset);
+ static void render_log_window(void);
+ static void scroll_log(int lines);
+ static void on_log_scroll(WPARAM wp);
  static void apply_log_filter(void);
  static void reset_log_filter(void);
  static void clear_log_file(void);
- static BOOL parse_log_date(const char *log_line, SYSTEMTIME *datetime);
+ static DWORD WINAPI follow_thread(LPVOID param);
+ static void start_follow(void);
+ static void stop_follow(void);
+ static void follow_log(void);
+ static void shift_offsets(LONGLONG shift);
+ static void update_groups(void);
+ static void format_log_time(ULONGLONG time, char *text, size_t size);
+ static void render_groups(void);
+ static LRESULT CALLBACK LogViewProc(HWND hwnd, UINT msg, WPARAM wp, LPARAM lp);
+ static BOOL begin_rows(int count, size_t row_size);
+ static void add_row(const char *text, size_t length, LogSeverity severity);
+ static void end_rows(void);
+ static void show_view_message(const char *text);
+ static void update_view_columns(void);
+ static void paint_log_view(HWND hwnd);
+ static void copy_log_view(void);
+ static LogSeverity entry_severity(ULONGLONG offset);
  
  /**
   * Helper function to create a Windows control
@@ -128,19 +213,47 @@
      }
  
      // Create controls using helper function
-     DWORD editStyle = WS_CHILD | WS_VISIBLE | WS_VSCROLL | WS_HSCROLL |
-                       ES_MULTILINE | ES_AUTOVSCROLL | ES_AUTOHSCROLL | ES_READONLY | ES_WANTRETURN;
+     // The view draws only the lines on screen, the scrollbar beside it moves through the log
+     WNDCLASSEX wcView;
+     memset(&wcView, 0, sizeof(WNDCLASSEX));
+     wcView.cbSize = sizeof(WNDCLASSEX);
+     wcView.lpfnWndProc = LogViewProc;
+     wcView.hInstance = GetModuleHandle(NULL);
+     wcView.hCursor = LoadCursor(NULL, IDC_ARROW);
+     wcView.lpszClassName = LOG_VIEW_CLASS;
+     RegisterClassEx(&wcView);
  
      // Create text area for logs
-     logs_dialog.hEdit = create_control(logs_dialog.hDlg, "EDIT", "",
-                                        editStyle, 10, 70, 870, 540,
-                                        (HMENU)ID_LOGS_EDIT, WS_EX_CLIENTEDGE);
+     logs_dialog.hView = create_control(logs_dialog.hDlg, LOG_VIEW_CLASS, "",
+                                        WS_CHILD | WS_VISIBLE | WS_HSCROLL | WS_TABSTOP,
+                                        10, 70, 852, 540, (HMENU)ID_LOGS_VIEW, WS_EX_CLIENTEDGE);
+ 
+     logs_dialog.hScroll = create_control(logs_dialog.hDlg, "SCROLLBAR", "",
+                                          WS_CHILD | WS_VISIBLE | SBS_VERT,
+                                          862, 70, 18, 540, (HMENU)ID_LOGS_SCROLL, 0);
  
      // Set a monospaced font for better log readability
      HFONT hFont = CreateFont(16, 0, 0, 0, FW_NORMAL, FALSE, FALSE, FALSE,
                               DEFAULT_CHARSET, OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS,
                               DEFAULT_QUALITY, FIXED_PITCH | FF_MODERN, "Consolas");
-     SendMessage(logs_dialog.hEdit, WM_SETFONT, (WPARAM)hFont, TRUE);
+     logs_dialog.hFont = hFont;
+ 
+     // Height of a line decides how many lines are rendered
+     TEXTMETRIC tm;
+     HDC hdc = GetDC(logs_dialog.hView);
+     HGDIOBJ oldFont = SelectObject(hdc, hFont);
+     if (GetTextMetrics(hdc, &tm) && tm.tmHeight > 0)
+     {
+         logs_dialog.lineHeight = tm.tmHeight;
+         logs_dialog.charWidth = tm.tmAveCharWidth > 0 ? tm.tmAveCharWidth : 8;
+     }
+     else
+     {
+         logs_dialog.lineHeight = 16;
+         logs_dialog.charWidth = 8;
+     }
+     SelectObject(hdc, oldFont);
+     ReleaseDC(logs_dialog.hView, hdc);
  
      // Create filter controls
      create_control(logs_dialog.hDlg, "STATIC", "Start Date:",
@@ -196,6 +309,14 @@
                     WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_DEFPUSHBUTTON,
                     230, 620, 100, 30, (HMENU)ID_CLOSE_BTN, 0);
  
+     create_control(logs_dialog.hDlg, "BUTTON", "Follow new entries",
+                    WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_AUTOCHECKBOX,
+                    350, 620, 160, 30, (HMENU)ID_FOLLOW_CHECK, 0);
+ 
+     create_control(logs_dialog.hDlg, "BUTTON", "Group repeated errors",
+                    WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_AUTOCHECKBOX,
+                    520, 620, 180, 30, (HMENU)ID_GROUP_CHECK, 0);
+ 
      // Set default dates to today
      SYSTEMTIME today;
      GetLocalTime(&today);
@@ -216,192 +337,304 @@
  }
  
  /**
-  * Parse date from a log line
+  * Check whether a line passes the date/time filter
   */
- static BOOL parse_log_date(const char *log_line, SYSTEMTIME *datetime)
+ static BOOL line_visible(const char *line)
  {
-     // Example log format: [25-Feb-2025 07:16:59 UTC] PHP Warning: ...
-     int day, hour, minute, second;
-     char month[4];
-     int year;
+     ULONGLONG value;
  
-     if (sscanf(log_line, "[%d-%3[^-]-%d %d:%d:%d", &day, month, &year, &hour, &minute, &second) != 6)
-     {
+     if (!logs_dialog.filtering)
+         return TRUE;
+ 
+     // Lines without a timestamp are left out while filtering
+     if (!log_parse_time(line, strlen(line), &value))
          return FALSE;
-     }
  
-     // Convert month name to month number
-     int month_num = 0;
-     const char *months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
-                             "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+     return value >= logs_dialog.filterStart && value <= logs_dialog.filterEnd;
+ }
+ 
+ /**
+  * Number of lines the view shows
+  */
+ static int visible_lines(void)
+ {
+     RECT rc;
  
-     for (int i = 0; i < 12; i++)
+     GetClientRect(logs_dialog.hView, &rc);
+     return rc.bottom / logs_dialog.lineHeight > 1 ? rc.bottom / logs_dialog.lineHeight : 1;
+ }
+ 
+ /**
+  * Move a number of shown lines forward or back from a line start, within the span
+  */
+ static ULONGLONG step_lines(ULONGLONG offset, int count)
+ {
+     char line[LOG_LINE_MAX];
+     ULONGLONG next;
+ 
+     while (count > 0 && offset < logs_dialog.spanEnd)
      {
-         if (strcmp(month, months[i]) == 0)
-         {
-             month_num = i + 1;
+         log_reader_get_line(logs_dialog.reader, offset, line, sizeof(line), &next);
+         if (next >= logs_dialog.spanEnd)
              break;
-         }
+         if (line_visible(line))
+             count--;
+         offset = next;
      }
  
-     if (month_num == 0)
-         return FALSE;
+     // Skip lines the filter hides, so the offset lands on a shown line
+     while (offset < logs_dialog.spanEnd)
+     {
+         log_reader_get_line(logs_dialog.reader, offset, line, sizeof(line), &next);
+         if (line_visible(line))
+             break;
+         offset = next;
+     }
  
-     // Fill the SYSTEMTIME structure
-     ZeroMemory(datetime, sizeof(SYSTEMTIME));
-     datetime->wYear = year;
-     datetime->wMonth = month_num;
-     datetime->wDay = day;
-     datetime->wHour = hour;
-     datetime->wMinute = minute;
-     datetime->wSecond = second;
+     while (count < 0 && offset > logs_dialog.spanStart)
+     {
+         offset = log_reader_line_start(logs_dialog.reader, offset - 1);
+         log_reader_get_line(logs_dialog.reader, offset, line, sizeof(line), NULL);
+         if (line_visible(line))
+             count++;
+     }
  
-     return TRUE;
+     return offset;
  }
  
  /**
-  * Function to refresh log content with filtering capability
+  * Find the lines of the filter range. Log lines are written in time order,
+  * so the range is one span from the first line at or after the start up to
+  * the first line after the end. The timestamp index skips to the start.
   */
- static void refresh_log_content(void)
+ static void find_filter_span(void)
  {
-     if (!logs_dialog.hEdit || !IsWindow(logs_dialog.hEdit))
-         return;
+     ULONGLONG offset = 0;
+     LogIndex *index;
+     HCURSOR hOldCursor;
+ 
+     // Indexing a large log for the first time takes a while
+     hOldCursor = SetCursor(LoadCursor(NULL, IDC_WAIT));
+     index = log_index_open(logs_dialog.log_path, logs_dialog.reader);
+     if (index)
+         offset = log_index_seek(index, logs_dialog.filterStart);
+     log_index_free(index);
+     SetCursor(hOldCursor);
+ 
+     logs_dialog.spanStart = logs_dialog.spanEnd = 0;
+     scan_filter_span(offset);
+ }
  
-     // Clear current text
-     SetWindowText(logs_dialog.hEdit, "");
+ /**
+  * Stream the lines from an offset for the ends of the filter range. A span
+  * already started keeps its start, so follow mode only reads new lines.
+  */
+ static void scan_filter_span(ULONGLONG offset)
+ {
+     ULONGLONG size = log_reader_size(logs_dialog.reader);
+     ULONGLONG lines[LOG_SCAN_BATCH];
+     LogFields fields[LOG_SCAN_BATCH];
+     BOOL started = logs_dialog.spanStart < logs_dialog.spanEnd;
  
-     // Read log file
-     FILE *f = fopen(logs_dialog.log_path, "r");
-     if (!f)
+     logs_dialog.spanEnd = size;
+     if (!started)
+         logs_dialog.spanStart = size;
+ 
+     while (offset < size && logs_dialog.spanEnd == size)
      {
-         SetWindowText(logs_dialog.hEdit, "Failed to open log file.");
-         return;
+         size_t count = log_reader_scan(logs_dialog.reader, offset, size, lines, fields, LOG_SCAN_BATCH, &offset);
+ 
+         if (count == 0)
+             break;
+         for (size_t i = 0; i < count; i++)
+         {
+             // Lines without a timestamp belong to the entry above them
+             if (!fields[i].time)
+                 continue;
+             if (fields[i].time > logs_dialog.filterEnd)
+             {
+                 logs_dialog.spanEnd = lines[i];
+                 break;
+             }
+             if (fields[i].time >= logs_dialog.filterStart && !started)
+             {
+                 logs_dialog.spanStart = lines[i];
+                 started = TRUE;
+             }
+         }
      }
  
-     fseek(f, 0, SEEK_END);
-     long size = ftell(f);
-     fseek(f, 0, SEEK_SET);
+     if (logs_dialog.spanStart > logs_dialog.spanEnd)
+         logs_dialog.spanStart = logs_dialog.spanEnd;
+ }
  
-     if (size <= 0)
+ /**
+  * Read the lines on screen out of the log into the rows of the view
+  */
+ static void render_log_window(void)
+ {
+     int lines = visible_lines() + LOG_READ_AHEAD;
+     char line[LOG_LINE_MAX];
+     ULONGLONG offset = logs_dialog.top, next;
+     LogSeverity severity = LOG_SEVERITY_NONE;
+     BOOL first = TRUE;
+     SCROLLINFO si;
+ 
+     if (!begin_rows(lines, LOG_LINE_MAX))
      {
-         SetWindowText(logs_dialog.hEdit, "Log file is empty.");
-         fclose(f);
+         show_view_message("Memory allocation failed.");
          return;
      }
  
-     // Allocate buffer with room for conversion
-     char *buffer = (char *)malloc(size + 1);
-     if (!buffer)
+     while (logs_dialog.rowCount < lines && offset < logs_dialog.spanEnd)
      {
-         SetWindowText(logs_dialog.hEdit, "Memory allocation failed.");
-         fclose(f);
-         return;
+         size_t length = log_reader_get_line(logs_dialog.reader, offset, line, sizeof(line), &next);
+         ULONGLONG start = 0;
+         LogFields fields;
+ 
+         // Lines without a timestamp are colored as the entry above them
+         log_scan_fields(line, length, 0, &start, 1, &fields);
+         if (fields.time)
+             severity = fields.severity;
+         else if (first)
+             severity = entry_severity(offset);
+         first = FALSE;
+ 
+         if (line_visible(line))
+             add_row(line, length, severity);
+         offset = next;
      }
  
-     size_t read = fread(buffer, 1, size, f);
-     buffer[read] = '\0';
-     fclose(f);
+     // The log stays free for rotation between reads
+     log_reader_unmap(logs_dialog.reader);
  
-     if (logs_dialog.filtering)
+     if (logs_dialog.rowCount > 0)
+         end_rows();
+     else if (logs_dialog.filtering)
+         show_view_message("No log entries found in the specified date range.");
+     else
+         show_view_message("Log file is empty.");
+ 
+     memset(&si, 0, sizeof(si));
+     si.cbSize = sizeof(si);
+     si.fMask = SIF_RANGE | SIF_POS | SIF_PAGE;
+     si.nMax = LOG_SCROLL_RANGE;
+     si.nPage = 1;
+     if (logs_dialog.spanEnd > logs_dialog.spanStart)
+         si.nPos = (int)((double)(logs_dialog.top - logs_dialog.spanStart) * LOG_SCROLL_RANGE /
+                         (logs_dialog.spanEnd - logs_dialog.spanStart));
+     SetScrollInfo(logs_dialog.hScroll, SB_CTL, &si, TRUE);
+ }
+ 
+ /**
+  * Scroll by a number of lines, the last line stays at the bottom
+  */
+ static void scroll_log(int lines)
+ {
+     ULONGLONG last_top;
+ 
+     if (!logs_dialog.reader)
+         return;
+ 
+     if (logs_dialog.grouping)
      {
-         // Apply date/time filtering
-         char *filtered = (char *)malloc(size + 1);
-         if (!filtered)
-         {
-             SetWindowText(logs_dialog.hEdit, "Memory allocation failed for filtering.");
-             free(buffer);
-             return;
-         }
+         logs_dialog.groupTop += lines;
+         render_groups();
+         return;
+     }
  
-         char *filtered_ptr = filtered;
-         filtered[0] = '\0'; // Initialize as empty string
+     last_top = step_lines(logs_dialog.spanEnd, -visible_lines());
+     logs_dialog.top = step_lines(logs_dialog.top, lines);
+     if (logs_dialog.top > last_top)
+         logs_dialog.top = last_top;
+     render_log_window();
+ }
  
-         // Process line by line
-         char *line = strtok(buffer, "\n");
-         while (line)
-         {
-             // Parse date from log line
-             SYSTEMTIME lineDate;
-             if (parse_log_date(line, &lineDate))
-             {
-                 // Check if date is in range
-                 FILETIME ftLine, ftStart, ftEnd;
-                 SystemTimeToFileTime(&lineDate, &ftLine);
- 
-                 // Combine date and time for start
-                 SYSTEMTIME stStart = logs_dialog.filterStartDate;
-                 stStart.wHour = logs_dialog.filterStartTime.wHour;
-                 stStart.wMinute = logs_dialog.filterStartTime.wMinute;
-                 stStart.wSecond = logs_dialog.filterStartTime.wSecond;
-                 SystemTimeToFileTime(&stStart, &ftStart);
- 
-                 // Combine date and time for end
-                 SYSTEMTIME stEnd = logs_dialog.filterEndDate;
-                 stEnd.wHour = logs_dialog.filterEndTime.wHour;
-                 stEnd.wMinute = logs_dialog.filterEndTime.wMinute;
-                 stEnd.wSecond = logs_dialog.filterEndTime.wSecond;
-                 SystemTimeToFileTime(&stEnd, &ftEnd);
- 
-                 // Compare dates
-                 if (CompareFileTime(&ftLine, &ftStart) >= 0 &&
-                     CompareFileTime(&ftLine, &ftEnd) <= 0)
-                 {
-                     // Line is in date range
-                     filtered_ptr += sprintf(filtered_ptr, "%s\r\n", line);
-                 }
-             }
+ /**
+  * Scrollbar of the log position
+  */
+ static void on_log_scroll(WPARAM wp)
+ {
+     int page = visible_lines() - 1 > 1 ? visible_lines() - 1 : 1;
  
-             line = strtok(NULL, "\n");
-         }
+     if (!logs_dialog.reader)
+         return;
  
-         if (strlen(filtered) > 0)
-         {
-             SetWindowText(logs_dialog.hEdit, filtered);
-         }
-         else
+     switch (LOWORD(wp))
+     {
+     case SB_LINEUP:
+         scroll_log(-1);
+         break;
+     case SB_LINEDOWN:
+         scroll_log(1);
+         break;
+     case SB_PAGEUP:
+         scroll_log(-page);
+         break;
+     case SB_PAGEDOWN:
+         scroll_log(page);
+         break;
+     case SB_TOP:
+         logs_dialog.top = logs_dialog.spanStart;
+         scroll_log(0);
+         break;
+     case SB_BOTTOM:
+         logs_dialog.top = logs_dialog.spanEnd;
+         scroll_log(0);
+         break;
+     case SB_THUMBTRACK:
+     case SB_THUMBPOSITION:
+     {
+         // Jump to the line at the same relative position in the log
+         SCROLLINFO si;
+         ULONGLONG offset;
+ 
+         memset(&si, 0, sizeof(si));
+         si.cbSize = sizeof(si);
+         si.fMask = SIF_TRACKPOS;
+         GetScrollInfo(logs_dialog.hScroll, SB_CTL, &si);
+         if (logs_dialog.grouping)
          {
-             SetWindowText(logs_dialog.hEdit, "No log entries found in the specified date range.");
+             logs_dialog.groupTop = si.nTrackPos;
+             scroll_log(0);
+             break;
          }
- 
-         free(filtered);
+         offset = logs_dialog.spanStart +
+                  (ULONGLONG)((double)(logs_dialog.spanEnd - logs_dialog.spanStart) * si.nTrackPos / LOG_SCROLL_RANGE);
+         logs_dialog.top = offset > logs_dialog.spanStart ? log_reader_line_start(logs_dialog.reader, offset)
+                                                          : logs_dialog.spanStart;
+         scroll_log(0);
+         break;
      }
-     else
-     {
-         // Process the buffer to ensure proper line breaks without filtering
-         char *processed = (char *)malloc(size * 2 + 1); // Extra space for \r insertions
-         if (processed)
-         {
-             size_t j = 0;
-             for (size_t i = 0; i < read; i++)
-             {
-                 // Ensure proper Windows line endings (\r\n)
-                 if (buffer[i] == '\n' && (i == 0 || buffer[i - 1] != '\r'))
-                 {
-                     processed[j++] = '\r';
-                     processed[j++] = '\n';
-                 }
-                 else
-                 {
-                     processed[j++] = buffer[i];
-                 }
-             }
-             processed[j] = '\0';
+     }
+ }
  
-             SetWindowText(logs_dialog.hEdit, processed);
-             free(processed);
-         }
-         else
-         {
-             // Fallback if memory allocation failed
-             SetWindowText(logs_dialog.hEdit, buffer);
-         }
+ /**
+  * Function to refresh log content with filtering capability
+  */
+ static void refresh_log_content(void)
+ {
+     if (!logs_dialog.hView || !IsWindow(logs_dialog.hView))
+         return;
+ 
+     // Reopen the log, rotation may have replaced the file or added a copy ahead of it
+     log_reader_close(logs_dialog.reader);
+     logs_dialog.reader = log_reader_open_rotated(logs_dialog.log_path);
+     if (!logs_dialog.reader)
+     {
+         show_view_message("Failed to open log file.");
+         return;
      }
  
-     // Scroll to the end to show most recent logs
-     SendMessage(logs_dialog.hEdit, EM_SETSEL, (WPARAM)-1, (LPARAM)-1);
-     SendMessage(logs_dialog.hEdit, EM_SCROLLCARET, 0, 0);
+     logs_dialog.spanStart = 0;
+     logs_dialog.spanEnd = log_reader_size(logs_dialog.reader);
+     logs_dialog.groupsValid = FALSE;
+     if (logs_dialog.filtering)
+         find_filter_span();
  
-     free(buffer);
+     // Show the end to show most recent logs
+     logs_dialog.top = logs_dialog.spanEnd;
+     scroll_log(0);
  }
  
  /**
@@ -415,11 +648,15 @@
          return;
      }
  
+     // The file is reopened on the next refresh
+     log_reader_close(logs_dialog.reader);
+     logs_dialog.reader = NULL;
+ 
      FILE *f = fopen(logs_dialog.log_path, "w");
      if (f)
      {
          fclose(f);
-         SetWindowText(logs_dialog.hEdit, "Log file has been cleared.");
+         show_view_message("Log file has been cleared.");
      }
      else
      {
@@ -475,6 +712,28 @@
      logs_dialog.filterEndTime.wMinute = endMin;
      logs_dialog.filterEndTime.wSecond = endSec;
  
+     // Combine date and time for start and end
+     SYSTEMTIME stStart = logs_dialog.filterStartDate;
+     stStart.wHour = logs_dialog.filterStartTime.wHour;
+     stStart.wMinute = logs_dialog.filterStartTime.wMinute;
+     stStart.wSecond = logs_dialog.filterStartTime.wSecond;
+     stStart.wMilliseconds = 0;
+ 
+     SYSTEMTIME stEnd = logs_dialog.filterEndDate;
+     stEnd.wHour = logs_dialog.filterEndTime.wHour;
+     stEnd.wMinute = logs_dialog.filterEndTime.wMinute;
+     stEnd.wSecond = logs_dialog.filterEndTime.wSecond;
+     stEnd.wMilliseconds = 0;
+ 
+     FILETIME ftStart, ftEnd;
+     if (!SystemTimeToFileTime(&stStart, &ftStart) || !SystemTimeToFileTime(&stEnd, &ftEnd))
+     {
+         MessageBox(logs_dialog.hDlg, "Invalid date/time range.", "Error", MB_ICONERROR);
+         return;
+     }
+     logs_dialog.filterStart = ((ULONGLONG)ftStart.dwHighDateTime << 32) | ftStart.dwLowDateTime;
+     logs_dialog.filterEnd = ((ULONGLONG)ftEnd.dwHighDateTime << 32) | ftEnd.dwLowDateTime;
+ 
      // Set filtering flag and refresh content
      logs_dialog.filtering = TRUE;
      refresh_log_content();
@@ -489,6 +748,616 @@
      refresh_log_content();
  }
  
+ /**
+  * Watch the log directory and tell the dialog about changes
+  */
+ static DWORD WINAPI follow_thread(LPVOID param)
+ {
+     HWND hDlg = (HWND)param;
+     char dir[MAX_PATH_LEN];
+     char *slash;
+     HANDLE handles[2];
+ 
+     // Rotation renames and recreates the log, so watch the directory rather than the file
+     strcpy(dir, logs_dialog.log_path);
+     slash = strrchr(dir, '\\');
+     if (slash)
+         *slash = '\0';
+ 
+     handles[0] = logs_dialog.followStop;
+     handles[1] = FindFirstChangeNotification(dir, FALSE,
+                                              FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE |
+                                                  FILE_NOTIFY_CHANGE_LAST_WRITE);
+     if (handles[1] == INVALID_HANDLE_VALUE)
+         return 1; // The size check still follows the log
+ 
+     while (WaitForMultipleObjects(2, handles, FALSE, INFINITE) == WAIT_OBJECT_0 + 1)
+     {
+         // One message until the dialog has handled it, a burst of writes posts once
+         if (InterlockedExchange(&logs_dialog.followPending, 1) == 0)
+             PostMessage(hDlg, WM_LOG_CHANGED, 0, 0);
+         if (!FindNextChangeNotification(handles[1]))
+             break;
+     }
+ 
+     FindCloseChangeNotification(handles[1]);
+     return 0;
+ }
+ 
+ /**
+  * Turn follow mode on
+  */
+ static void start_follow(void)
+ {
+     if (logs_dialog.following)
+         return;
+ 
+     logs_dialog.following = TRUE;
+     logs_dialog.followPending = 0;
+     logs_dialog.followStop = CreateEvent(NULL, TRUE, FALSE, NULL);
+     if (logs_dialog.followStop)
+         logs_dialog.followThread = CreateThread(NULL, 0, follow_thread, logs_dialog.hDlg, 0, NULL);
+     SetTimer(logs_dialog.hDlg, ID_FOLLOW_POLL_TIMER, LOG_FOLLOW_POLL, NULL);
+ 
+     // Start at the newest lines
+     follow_log();
+     logs_dialog.top = logs_dialog.spanEnd;
+     scroll_log(0);
+ }
+ 
+ /**
+  * Turn follow mode off
+  */
+ static void stop_follow(void)
+ {
+     if (!logs_dialog.following)
+         return;
+ 
+     logs_dialog.following = FALSE;
+     if (logs_dialog.followThread)
+     {
+         SetEvent(logs_dialog.followStop);
+         WaitForSingleObject(logs_dialog.followThread, INFINITE);
+         CloseHandle(logs_dialog.followThread);
+     }
+     if (logs_dialog.followStop)
+         CloseHandle(logs_dialog.followStop);
+     logs_dialog.followThread = logs_dialog.followStop = NULL;
+ 
+     KillTimer(logs_dialog.hDlg, ID_FOLLOW_TIMER);
+     KillTimer(logs_dialog.hDlg, ID_FOLLOW_POLL_TIMER);
+     logs_dialog.followTimer = FALSE;
+ }
+ 
+ /**
+  * Add the lines written since the last update. Only new bytes are read: a
+  * rotated log is found among its copies and followed on in the new one,
+  * only a log cleared in place or gone whole is read from the new start.
+  */
+ static void follow_log(void)
+ {
+     LogReader *current = log_reader_open(logs_dialog.log_path);
+     LogReader *rotated;
+     ULONGLONG oldSize, size, id, currentId;
+     LONGLONG shift;
+     BOOL atBottom;
+ 
+     // Between rename and recreate during rotation there is no log, the next change brings it
+     if (!current)
+         return;
+ 
+     oldSize = logs_dialog.reader ? log_reader_size(logs_dialog.reader) : 0;
+     atBottom = !logs_dialog.reader || logs_dialog.top >= step_lines(logs_dialog.spanEnd, -visible_lines());
+     if (logs_dialog.reader && log_reader_file_id(logs_dialog.reader, &id) &&
+         log_reader_file_id(current, &currentId) && id == currentId &&
+         log_reader_base(logs_dialog.reader) + log_reader_size(current) >= oldSize)
+     {
+         // Grown in place
+         log_reader_close(current);
+         if (!log_reader_refresh(logs_dialog.reader))
+             return;
+     }
+     else
+     {
+         // Another file under the log name, or the same one truncated: the old content
+         // is a rotated copy now if it was rotated, read ahead of the new one
+         log_reader_close(current);
+         rotated = log_reader_open_rotated(logs_dialog.log_path);
+         if (!rotated)
+             return;
+         if (logs_dialog.reader && log_reader_locate(rotated, logs_dialog.reader, &shift))
+         {
+             oldSize += shift;
+             shift_offsets(shift);
+         }
+         else
+         {
+             // Cleared in place, or none open after Clear Logs: all of it is new
+             atBottom = TRUE;
+             oldSize = 0;
+             logs_dialog.spanStart = logs_dialog.spanEnd = logs_dialog.top = 0;
+             logs_dialog.groupsValid = FALSE;
+         }
+         log_reader_close(logs_dialog.reader);
+         logs_dialog.reader = rotated;
+     }
+ 
+     // A filter range that reaches the old end may go on in the new lines
+     size = log_reader_size(logs_dialog.reader);
+     if (!logs_dialog.filtering)
+         logs_dialog.spanEnd = size;
+     else if (logs_dialog.spanEnd == oldSize)
+         scan_filter_span(log_reader_line_start(logs_dialog.reader, oldSize));
+ 
+     // Stay at the newest lines unless scrolled away from them
+     if (atBottom)
+         logs_dialog.top = logs_dialog.spanEnd;
+     scroll_log(0);
+ }
+ 
+ /**
+  * Move the offsets into the log by the shift of a rotation. Lines of a
+  * dropped copy are gone, so a span starting in them starts at the oldest
+  * line left and its fingerprints are counted again.
+  */
+ static void shift_offsets(LONGLONG shift)
+ {
+     ULONGLONG dropped = shift < 0 ? (ULONGLONG)-shift : 0;
+ 
+     if (logs_dialog.spanStart < dropped || logs_dialog.groupedStart < dropped)
+         logs_dialog.groupsValid = FALSE;
+     logs_dialog.spanStart = logs_dialog.spanStart > dropped ? logs_dialog.spanStart + shift : 0;
+     logs_dialog.spanEnd = logs_dialog.spanEnd > dropped ? logs_dialog.spanEnd + shift : 0;
+     logs_dialog.top = logs_dialog.top > dropped ? logs_dialog.top + shift : 0;
+     logs_dialog.groupedStart = logs_dialog.groupedStart > dropped ? logs_dialog.groupedStart + shift : 0;
+     logs_dialog.groupedEnd = logs_dialog.groupedEnd > dropped ? logs_dialog.groupedEnd + shift : 0;
+ }
+ 
+ /**
+  * Bring the fingerprint table up to the lines of the span. Lines appended to
+  * the span are added to it, a span that moved rebuilds it.
+  */
+ static void update_groups(void)
+ {
+     // A line still being written is left for the next update
+     ULONGLONG end = log_reader_line_start(logs_dialog.reader, logs_dialog.spanEnd);
+     HCURSOR hOldCursor;
+ 
+     if (!logs_dialog.groups)
+         logs_dialog.groups = log_groups_create();
+     if (!logs_dialog.groups)
+         return;
+ 
+     if (!logs_dialog.groupsValid || logs_dialog.groupedStart != logs_dialog.spanStart ||
+         logs_dialog.groupedEnd > end)
+     {
+         log_groups_clear(logs_dialog.groups);
+         logs_dialog.groupedStart = logs_dialog.groupedEnd = logs_dialog.spanStart;
+         logs_dialog.groupsValid = TRUE;
+     }
+     if (logs_dialog.groupedEnd >= end)
+         return;
+ 
+     // Only a large log read for the first time takes a while
+     hOldCursor = SetCursor(LoadCursor(NULL, IDC_WAIT));
+     log_groups_add(logs_dialog.groups, logs_dialog.reader, logs_dialog.groupedEnd, end);
+     logs_dialog.groupedEnd = end;
+     SetCursor(hOldCursor);
+ }
+ 
+ /**
+  * Format a FILETIME value of a log line
+  */
+ static void format_log_time(ULONGLONG time, char *text, size_t size)
+ {
+     FILETIME ft;
+     SYSTEMTIME st;
+ 
+     ft.dwLowDateTime = (DWORD)time;
+     ft.dwHighDateTime = (DWORD)(time >> 32);
+     if (FileTimeToSystemTime(&ft, &st))
+         snprintf(text, size, "%04d-%02d-%02d %02d:%02d:%02d", st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute,
+                  st.wSecond);
+     else
+         snprintf(text, size, "%-19s", "-");
+ }
+ 
+ /**
+  * Show the entries of the span grouped by fingerprint, the most frequent first
+  */
+ static void render_groups(void)
+ {
+     int rows = visible_lines() - 1 > 1 ? visible_lines() - 1 : 1;
+     const LogGroup **top;
+     char row[LOG_GROUP_SAMPLE_LEN + 80];
+     char first[32], last[32];
+     ULONGLONG entries, ungrouped;
+     size_t count, shown;
+     int length;
+     SCROLLINFO si;
+ 
+     update_groups();
+     log_reader_unmap(logs_dialog.reader);
+     if (!logs_dialog.groups)
+     {
+         show_view_message("Memory allocation failed.");
+         return;
+     }
+ 
+     count = log_groups_count(logs_dialog.groups, &entries, &ungrouped);
+     if (logs_dialog.groupTop > (int)count - rows)
+         logs_dialog.groupTop = (int)count - rows;
+     if (logs_dialog.groupTop < 0)
+         logs_dialog.groupTop = 0;
+ 
+     // Only the groups down to the last row are ranked
+     top = (const LogGroup **)malloc((logs_dialog.groupTop + rows) * sizeof(*top));
+     if (!top || !begin_rows(rows + 1, sizeof(row)))
+     {
+         free(top);
+         show_view_message("Memory allocation failed.");
+         return;
+     }
+     shown = log_groups_top(logs_dialog.groups, top, logs_dialog.groupTop + rows);
+ 
+     length = snprintf(row, sizeof(row), "%llu entries in %u groups", entries, (unsigned)count);
+     if (ungrouped)
+         length += snprintf(row + length, sizeof(row) - length, ", %llu past the group limit are only counted",
+                            ungrouped);
+     add_row(row, length, LOG_SEVERITY_NONE);
+     for (size_t i = logs_dialog.groupTop; i < shown; i++)
+     {
+         format_log_time(top[i]->first_seen, first, sizeof(first));
+         format_log_time(top[i]->last_seen, last, sizeof(last));
+         length = snprintf(row, sizeof(row), "%10llu  %s  %s  %s", top[i]->count, first, last, top[i]->sample);
+         add_row(row, length < (int)sizeof(row) ? length : sizeof(row) - 1, top[i]->severity);
+     }
+     free(top);
+     if (count > 0)
+         end_rows();
+     else
+         show_view_message("No log entries to group.");
+ 
+     memset(&si, 0, sizeof(si));
+     si.cbSize = sizeof(si);
+     si.fMask = SIF_RANGE | SIF_POS | SIF_PAGE;
+     si.nMax = count > 0 ? (int)count - 1 : 0;
+     si.nPage = rows;
+     si.nPos = logs_dialog.groupTop;
+     SetScrollInfo(logs_dialog.hScroll, SB_CTL, &si, TRUE);
+ }
+ 
+ /**
+  * Make room for the rows of a frame and empty the view
+  * @return FALSE when out of memory
+  */
+ static BOOL begin_rows(int count, size_t row_size)
+ {
+     size_t size = (size_t)count * row_size;
+ 
+     if (count > logs_dialog.rowCapacity)
+     {
+         LogViewRow *rows = (LogViewRow *)realloc(logs_dialog.rows, count * sizeof(LogViewRow));
+ 
+         if (!rows)
+             return FALSE;
+         logs_dialog.rows = rows;
+         logs_dialog.rowCapacity = count;
+     }
+     if (size > logs_dialog.rowTextSize)
+     {
+         char *text = (char *)realloc(logs_dialog.rowText, size);
+ 
+         if (!text)
+             return FALSE;
+         logs_dialog.rowText = text;
+         logs_dialog.rowTextSize = size;
+     }
+ 
+     logs_dialog.rowCount = 0;
+     logs_dialog.rowTextUsed = 0;
+     return TRUE;
+ }
+ 
+ /**
+  * Add a row to the view, rows past the room made by begin_rows are dropped
+  */
+ static void add_row(const char *text, size_t length, LogSeverity severity)
+ {
+     LogViewRow *row;
+     char *copy;
+ 
+     if (logs_dialog.rowCount >= logs_dialog.rowCapacity ||
+         logs_dialog.rowTextUsed + length > logs_dialog.rowTextSize)
+         return;
+ 
+     // The view draws text as is, tabs become spaces
+     copy = logs_dialog.rowText + logs_dialog.rowTextUsed;
+     for (size_t i = 0; i < length; i++)
+         copy[i] = text[i] == '\t' ? ' ' : text[i];
+ 
+     row = &logs_dialog.rows[logs_dialog.rowCount++];
+     row->start = logs_dialog.rowTextUsed;
+     row->length = length;
+     row->severity = severity;
+     logs_dialog.rowTextUsed += length;
+ }
+ 
+ /**
+  * Show the rows added since begin_rows
+  */
+ static void end_rows(void)
+ {
+     logs_dialog.widestRow = 0;
+     for (int i = 0; i < logs_dialog.rowCount; i++)
+     {
+         if ((int)logs_dialog.rows[i].length > logs_dialog.widestRow)
+             logs_dialog.widestRow = (int)logs_dialog.rows[i].length;
+     }
+ 
+     update_view_columns();
+     InvalidateRect(logs_dialog.hView, NULL, FALSE);
+ }
+ 
+ /**
+  * Show a message in place of the log
+  */
+ static void show_view_message(const char *text)
+ {
+     if (!begin_rows(1, strlen(text)))
+         return;
+ 
+     add_row(text, strlen(text), LOG_SEVERITY_NONE);
+     end_rows();
+ }
+ 
+ /**
+  * Fit the horizontal scrollbar to the widest row on screen
+  */
+ static void update_view_columns(void)
+ {
+     RECT rc;
+     SCROLLINFO si;
+     int columns;
+ 
+     GetClientRect(logs_dialog.hView, &rc);
+     columns = rc.right / logs_dialog.charWidth > 1 ? rc.right / logs_dialog.charWidth : 1;
+     if (logs_dialog.column > logs_dialog.widestRow - columns)
+         logs_dialog.column = logs_dialog.widestRow - columns > 0 ? logs_dialog.widestRow - columns : 0;
+ 
+     memset(&si, 0, sizeof(si));
+     si.cbSize = sizeof(si);
+     si.fMask = SIF_RANGE | SIF_POS | SIF_PAGE;
+     si.nMax = logs_dialog.widestRow > 0 ? logs_dialog.widestRow - 1 : 0;
+     si.nPage = columns;
+     si.nPos = logs_dialog.column;
+     SetScrollInfo(logs_dialog.hView, SB_HORZ, &si, TRUE);
+ }
+ 
+ /**
+  * Colors of a row by the severity of its entry
+  */
+ static void severity_colors(LogSeverity severity, COLORREF *text, COLORREF *back)
+ {
+     switch (severity)
+     {
+     case LOG_SEVERITY_FATAL:
+     case LOG_SEVERITY_ERROR:
+         *text = RGB(160, 0, 0);
+         *back = RGB(255, 234, 234);
+         break;
+     case LOG_SEVERITY_WARNING:
+         *text = RGB(128, 80, 0);
+         *back = RGB(255, 247, 218);
+         break;
+     case LOG_SEVERITY_DEPRECATED:
+     case LOG_SEVERITY_NOTICE:
+         *text = RGB(0, 70, 140);
+         *back = GetSysColor(COLOR_WINDOW);
+         break;
+     default:
+         *text = GetSysColor(COLOR_WINDOWTEXT);
+         *back = GetSysColor(COLOR_WINDOW);
+         break;
+     }
+ }
+ 
+ /**
+  * Draw the rows in the invalid part of the view. Only the columns in view
+  * are drawn, so the cost of a frame does not depend on the log.
+  */
+ static void paint_log_view(HWND hwnd)
+ {
+     PAINTSTRUCT ps;
+     RECT rc, rest;
+     HDC hdc = BeginPaint(hwnd, &ps);
+     HGDIOBJ oldFont = SelectObject(hdc, logs_dialog.hFont);
+     int columns, first;
+ 
+     GetClientRect(hwnd, &rc);
+     columns = rc.right / logs_dialog.charWidth + 1;
+     first = ps.rcPaint.top / logs_dialog.lineHeight;
+ 
+     for (int i = first; i < logs_dialog.rowCount && i * logs_dialog.lineHeight < ps.rcPaint.bottom; i++)
+     {
+         const LogViewRow *row = &logs_dialog.rows[i];
+         size_t skip = (size_t)logs_dialog.column < row->length ? (size_t)logs_dialog.column : row->length;
+         size_t count = row->length - skip < (size_t)columns ? row->length - skip : (size_t)columns;
+         COLORREF text, back;
+         RECT line;
+ 
+         line.left = 0;
+         line.top = i * logs_dialog.lineHeight;
+         line.right = rc.right;
+         line.bottom = line.top + logs_dialog.lineHeight;
+ 
+         severity_colors(row->severity, &text, &back);
+         SetTextColor(hdc, text);
+         SetBkColor(hdc, back);
+         ExtTextOut(hdc, 2, line.top, ETO_OPAQUE | ETO_CLIPPED, &line, logs_dialog.rowText + row->start + skip,
+                    (UINT)count, NULL);
+     }
+ 
+     // Below the last row
+     rest = rc;
+     rest.top = logs_dialog.rowCount * logs_dialog.lineHeight;
+     if (rest.top < rest.bottom)
+         FillRect(hdc, &rest, (HBRUSH)(COLOR_WINDOW + 1));
+ 
+     SelectObject(hdc, oldFont);
+     EndPaint(hwnd, &ps);
+ }
+ 
+ /**
+  * Copy the rows on screen to the clipboard
+  */
+ static void copy_log_view(void)
+ {
+     HGLOBAL hText = GlobalAlloc(GMEM_MOVEABLE, logs_dialog.rowTextUsed + logs_dialog.rowCount * 2 + 1);
+     char *text;
+     size_t used = 0;
+ 
+     if (!hText)
+         return;
+ 
+     text = (char *)GlobalLock(hText);
+     for (int i = 0; i < logs_dialog.rowCount; i++)
+     {
+         memcpy(text + used, logs_dialog.rowText + logs_dialog.rows[i].start, logs_dialog.rows[i].length);
+         used += logs_dialog.rows[i].length;
+         text[used++] = '\r';
+         text[used++] = '\n';
+     }
+     text[used] = '\0';
+     GlobalUnlock(hText);
+ 
+     if (OpenClipboard(logs_dialog.hView))
+     {
+         EmptyClipboard();
+         if (!SetClipboardData(CF_TEXT, hText))
+             GlobalFree(hText);
+         CloseClipboard();
+     }
+     else
+         GlobalFree(hText);
+ }
+ 
+ /**
+  * Severity of the entry a line without a timestamp continues, looking a
+  * few lines up
+  */
+ static LogSeverity entry_severity(ULONGLONG offset)
+ {
+     char line[LOG_LINE_MAX];
+ 
+     for (int i = 0; i < LOG_SEVERITY_LOOKBACK && offset > logs_dialog.spanStart; i++)
+     {
+         ULONGLONG start = 0;
+         LogFields fields;
+         size_t length;
+ 
+         offset = log_reader_line_start(logs_dialog.reader, offset - 1);
+         length = log_reader_get_line(logs_dialog.reader, offset, line, sizeof(line), NULL);
+         log_scan_fields(line, length, 0, &start, 1, &fields);
+         if (fields.time)
+             return fields.severity;
+     }
+     return LOG_SEVERITY_NONE;
+ }
+ 
+ /**
+  * Window procedure of the log view
+  */
+ static LRESULT CALLBACK LogViewProc(HWND hwnd, UINT msg, WPARAM wp, LPARAM lp)
+ {
+     switch (msg)
+     {
+     case WM_PAINT:
+         paint_log_view(hwnd);
+         return 0;
+ 
+     case WM_ERASEBKGND:
+         // Painting covers the whole view
+         return 1;
+ 
+     case WM_SIZE:
+         update_view_columns();
+         return 0;
+ 
+     case WM_HSCROLL:
+     {
+         RECT rc;
+         int columns;
+ 
+         GetClientRect(hwnd, &rc);
+         columns = rc.right / logs_dialog.charWidth > 1 ? rc.right / logs_dialog.charWidth : 1;
+         switch (LOWORD(wp))
+         {
+         case SB_LINELEFT:
+             logs_dialog.column -= 1;
+             break;
+         case SB_LINERIGHT:
+             logs_dialog.column += 1;
+             break;
+         case SB_PAGELEFT:
+             logs_dialog.column -= columns;
+             break;
+         case SB_PAGERIGHT:
+             logs_dialog.column += columns;
+             break;
+         case SB_THUMBTRACK:
+         case SB_THUMBPOSITION:
+             logs_dialog.column = HIWORD(wp);
+             break;
+         }
+         if (logs_dialog.column < 0)
+             logs_dialog.column = 0;
+         update_view_columns();
+         InvalidateRect(hwnd, NULL, FALSE);
+         return 0;
+     }
+ 
+     case WM_LBUTTONDOWN:
+         SetFocus(hwnd);
+         return 0;
+ 
+     case WM_KEYDOWN:
+         switch (wp)
+         {
+         case VK_UP:
+             on_log_scroll(SB_LINEUP);
+             break;
+         case VK_DOWN:
+             on_log_scroll(SB_LINEDOWN);
+             break;
+         case VK_PRIOR:
+             on_log_scroll(SB_PAGEUP);
+             break;
+         case VK_NEXT:
+             on_log_scroll(SB_PAGEDOWN);
+             break;
+         case VK_HOME:
+             on_log_scroll(SB_TOP);
+             break;
+         case VK_END:
+             on_log_scroll(SB_BOTTOM);
+             break;
+         case VK_LEFT:
+             SendMessage(hwnd, WM_HSCROLL, SB_LINELEFT, 0);
+             break;
+         case VK_RIGHT:
+             SendMessage(hwnd, WM_HSCROLL, SB_LINERIGHT, 0);
+             break;
+         case 'C':
+             if (GetKeyState(VK_CONTROL) < 0)
+                 copy_log_view();
+             break;
+         }
+         return 0;
+     }
+     return DefWindowProc(hwnd, msg, wp, lp);
+ }
+ 
  /**
   * Dialog procedure for logs window
   */
@@ -514,19 +1383,60 @@
          case ID_RESET_FILTER_BTN:
              reset_log_filter();
              break;
+         case ID_FOLLOW_CHECK:
+             if (SendMessage(GetDlgItem(hwnd, ID_FOLLOW_CHECK), BM_GETCHECK, 0, 0) == BST_CHECKED)
+                 start_follow();
+             else
+                 stop_follow();
+             break;
+         case ID_GROUP_CHECK:
+             logs_dialog.grouping = SendMessage(GetDlgItem(hwnd, ID_GROUP_CHECK), BM_GETCHECK, 0, 0) == BST_CHECKED;
+             logs_dialog.groupTop = 0;
+             scroll_log(0);
+             break;
+         }
+         break;
+ 
+     case WM_LOG_CHANGED:
+         // Changes until the timer fires make one update
+         InterlockedExchange(&logs_dialog.followPending, 0);
+         if (logs_dialog.following && !logs_dialog.followTimer)
+             logs_dialog.followTimer = SetTimer(hwnd, ID_FOLLOW_TIMER, LOG_FOLLOW_DELAY, NULL) != 0;
+         break;
+ 
+     case WM_TIMER:
+         if (wp == ID_FOLLOW_TIMER)
+         {
+             KillTimer(hwnd, ID_FOLLOW_TIMER);
+             logs_dialog.followTimer = FALSE;
          }
+         if (logs_dialog.following && (wp == ID_FOLLOW_TIMER || wp == ID_FOLLOW_POLL_TIMER))
+             follow_log();
+         break;
+ 
+     case WM_VSCROLL:
+         if ((HWND)lp == logs_dialog.hScroll)
+             on_log_scroll(wp);
+         break;
+ 
+     case WM_MOUSEWHEEL:
+         scroll_log(-(short)HIWORD(wp) * 3 / WHEEL_DELTA);
          break;
  
      case WM_SIZE:
-         if (logs_dialog.hEdit)
+         if (logs_dialog.hView)
          {
              RECT rcClient;
              GetClientRect(hwnd, &rcClient);
  
-             // Resize edit control to fit window
-             SetWindowPos(logs_dialog.hEdit, NULL,
+             // Resize the view to fit window, the position scrollbar stays on its right
+             SetWindowPos(logs_dialog.hView, NULL,
                           10, 70,
-                          rcClient.right - 20, rcClient.bottom - 160,
+                          rcClient.right - 38, rcClient.bottom - 160,
+                          SWP_NOZORDER);
+             SetWindowPos(logs_dialog.hScroll, NULL,
+                          rcClient.right - 28, 70,
+                          18, rcClient.bottom - 160,
                           SWP_NOZORDER);
  
              // Reposition buttons at the bottom
@@ -536,6 +1446,13 @@
                           120, rcClient.bottom - 40, 100, 30, SWP_NOZORDER);
              SetWindowPos(GetDlgItem(hwnd, ID_CLOSE_BTN), NULL,
                           230, rcClient.bottom - 40, 100, 30, SWP_NOZORDER);
+             SetWindowPos(GetDlgItem(hwnd, ID_FOLLOW_CHECK), NULL,
+                          350, rcClient.bottom - 40, 160, 30, SWP_NOZORDER);
+             SetWindowPos(GetDlgItem(hwnd, ID_GROUP_CHECK), NULL,
+                          520, rcClient.bottom - 40, 180, 30, SWP_NOZORDER);
+ 
+             // More or fewer lines fit now
+             scroll_log(0);
          }
          break;
  
@@ -544,8 +1461,25 @@
          break;
  
      case WM_DESTROY:
-         logs_dialog.hDlg = logs_dialog.hEdit = logs_dialog.hDateStart = NULL;
+         stop_follow();
+         log_reader_close(logs_dialog.reader);
+         logs_dialog.reader = NULL;
+         log_groups_free(logs_dialog.groups);
+         logs_dialog.groups = NULL;
+         logs_dialog.grouping = logs_dialog.groupsValid = FALSE;
+         if (logs_dialog.hFont)
+             DeleteObject(logs_dialog.hFont);
+         logs_dialog.hFont = NULL;
+         free(logs_dialog.rows);
+         free(logs_dialog.rowText);
+         logs_dialog.rows = NULL;
+         logs_dialog.rowText = NULL;
+         logs_dialog.rowCount = logs_dialog.rowCapacity = 0;
+         logs_dialog.rowTextUsed = logs_dialog.rowTextSize = 0;
+         logs_dialog.column = logs_dialog.widestRow = 0;
+         logs_dialog.hDlg = logs_dialog.hView = logs_dialog.hDateStart = NULL;
          logs_dialog.hDateEnd = logs_dialog.hTimeStart = logs_dialog.hTimeEnd = NULL;
+         logs_dialog.hScroll = NULL;
          break;
  
      default:
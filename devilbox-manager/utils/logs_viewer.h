@@ -16,15 +16,19 @@ extern "C" {
 #define MAX_PATH_LEN 260
 #endif
 
-// Maximum buffer size for logs
-#ifndef MAX_BUFFER
-#define MAX_BUFFER 1048576 // 1MB buffer for logs
-#endif
+// Longest log line shown, longer lines are cut
+#define LOG_LINE_MAX 4096
+
+// Lines rendered below the visible ones, so a partly visible last row is filled
+#define LOG_READ_AHEAD 4
+
+// Resolution of the log position scrollbar
+#define LOG_SCROLL_RANGE 10000
 
 // Log dialog control IDs
 enum
 {
-    ID_LOGS_EDIT = 100,
+    ID_LOGS_VIEW = 100,
     ID_REFRESH_BTN,
     ID_CLOSE_BTN,
     ID_CLEAR_BTN,
@@ -33,7 +37,10 @@ enum
     ID_TIME_FILTER_START,
     ID_TIME_FILTER_END,
     ID_APPLY_FILTER_BTN,
-    ID_RESET_FILTER_BTN
+    ID_RESET_FILTER_BTN,
+    ID_LOGS_SCROLL,
+    ID_FOLLOW_CHECK,
+    ID_GROUP_CHECK
 };
 
 // Main function to display logs viewer
@@ -0,0 +1,460 @@
+/*******************************************************************************
+ * Search Viewer Module Implementation
+ * Searches all Devilbox log files for text or a regular expression
+ *******************************************************************************/
+
+ #include "search_viewer.h"
+ #include "logs_viewer.h"
+ #include "log_search.h"
+ #include "log_reader.h"
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ 
+ // Posted by the search thread: wParam logs searched, lParam logs found
+ #define WM_SEARCH_PROGRESS (WM_APP + 1)
+ 
+ // Posted by the search thread when it is done
+ #define WM_SEARCH_DONE (WM_APP + 2)
+ 
+ // Logs searched at most
+ #define SEARCH_MAX_FILES 1024
+ 
+ // Longest part of a matching line listed
+ #define SEARCH_LINE_SHOWN 512
+ 
+ // Room for one listed match: log path, line and line break
+ #define SEARCH_RESULT_SIZE (MAX_PATH_LEN + SEARCH_LINE_SHOWN + 4)
+ 
+ // One search, owned by the search thread until it is done
+ typedef struct
+ {
+     char root[MAX_PATH_LEN];     // Log directory, matches are listed relative to it
+     LogQuery *query;
+     BOOL use_index;
+     char (*files)[MAX_PATH_LEN];
+     int file_count;
+     char *text;                  // Listed matches
+     size_t used;
+     int listed;
+     LogSearchStats stats;
+     ULONGLONG update_us;         // Time spent bringing indexes up to date
+     int unreadable;              // Logs that could not be read
+     volatile LONG cancelled;
+ } SearchJob;
+ 
+ // Search dialog state structure
+ typedef struct
+ {
+     HWND hDlg;
+     HWND hQuery;
+     HWND hRegex;
+     HWND hUseIndex;
+     HWND hSearch;
+     HWND hEdit;
+     HWND hStatus;
+     HFONT hFont;
+     char app_path[MAX_PATH_LEN];
+     SearchJob *job;
+     HANDLE hThread;
+ } SearchDialogState;
+ 
+ // Global state for the search dialog
+ static SearchDialogState search_dialog = {0};
+ 
+ // Forward declarations of internal functions
+ static LRESULT CALLBACK SearchDialogProc(HWND hwnd, UINT msg, WPARAM wp, LPARAM lp);
+ static void start_search(void);
+ static void stop_search(void);
+ static void show_results(void);
+ static DWORD WINAPI search_thread(LPVOID param);
+ static void collect_logs(SearchJob *job, const char *dir);
+ static BOOL on_match(const char *path, ULONGLONG offset, const char *line, size_t length, void *context);
+ static void free_job(SearchJob *job);
+ 
+ /**
+  * Display the log search dialog
+  */
+ void show_log_search(const char *app_path)
+ {
+     // Check if dialog is already open
+     if (search_dialog.hDlg && IsWindow(search_dialog.hDlg))
+     {
+         SetForegroundWindow(search_dialog.hDlg);
+         return;
+     }
+ 
+     strncpy(search_dialog.app_path, app_path, sizeof(search_dialog.app_path) - 1);
+ 
+     // Register dialog class
+     WNDCLASSEX wcDialog;
+     memset(&wcDialog, 0, sizeof(WNDCLASSEX));
+     wcDialog.cbSize = sizeof(WNDCLASSEX);
+     wcDialog.lpfnWndProc = SearchDialogProc;
+     wcDialog.hInstance = GetModuleHandle(NULL);
+     wcDialog.hbrBackground = (HBRUSH)(COLOR_WINDOW + 1);
+     wcDialog.lpszClassName = "DevilboxSearchDialog";
+     RegisterClassEx(&wcDialog);
+ 
+     // Create dialog window
+     search_dialog.hDlg = CreateWindowEx(
+         WS_EX_DLGMODALFRAME,
+         "DevilboxSearchDialog",
+         "Search Logs",
+         WS_OVERLAPPEDWINDOW | WS_VISIBLE,
+         100, 100, 900, 700,
+         NULL, NULL, GetModuleHandle(NULL), NULL);
+ 
+     if (!search_dialog.hDlg)
+     {
+         MessageBox(NULL, "Failed to create log search window.", "Error", MB_ICONERROR);
+         return;
+     }
+ 
+     // Search text and options
+     create_control(search_dialog.hDlg, "STATIC", "Find:",
+                    WS_CHILD | WS_VISIBLE, 10, 12, 40, 20, NULL, 0);
+ 
+     search_dialog.hQuery = create_control(search_dialog.hDlg, "EDIT", "",
+                                           WS_CHILD | WS_VISIBLE | WS_TABSTOP | ES_AUTOHSCROLL,
+                                           50, 10, 450, 24, (HMENU)ID_SEARCH_QUERY, WS_EX_CLIENTEDGE);
+ 
+     search_dialog.hRegex = create_control(search_dialog.hDlg, "BUTTON", "Regex",
+                                           WS_CHILD | WS_VISIBLE | WS_TABSTOP | BS_AUTOCHECKBOX,
+                                           515, 10, 70, 24, (HMENU)ID_SEARCH_REGEX, 0);
+ 
+     search_dialog.hUseIndex = create_control(search_dialog.hDlg, "BUTTON", "Use index",
+                                              WS_CHILD | WS_VISIBLE | WS_TABSTOP | BS_AUTOCHECKBOX,
+                                              590, 10, 90, 24, (HMENU)ID_SEARCH_USE_INDEX, 0);
+     SendMessage(search_dialog.hUseIndex, BM_SETCHECK, BST_CHECKED, 0);
+ 
+     search_dialog.hSearch = create_control(search_dialog.hDlg, "BUTTON", "Search",
+                                            WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_DEFPUSHBUTTON,
+                                            790, 10, 100, 24, (HMENU)ID_SEARCH_BTN, 0);
+ 
+     // Matching lines
+     search_dialog.hEdit = create_control(search_dialog.hDlg, "EDIT", "",
+                                          WS_CHILD | WS_VISIBLE | WS_VSCROLL | WS_HSCROLL |
+                                              ES_MULTILINE | ES_AUTOHSCROLL | ES_AUTOVSCROLL | ES_READONLY,
+                                          10, 45, 870, 565, (HMENU)ID_SEARCH_EDIT, WS_EX_CLIENTEDGE);
+     SendMessage(search_dialog.hEdit, EM_SETLIMITTEXT, LOG_SEARCH_MAX_RESULTS * SEARCH_RESULT_SIZE, 0);
+ 
+     // Set a monospaced font for better log readability
+     search_dialog.hFont = CreateFont(16, 0, 0, 0, FW_NORMAL, FALSE, FALSE, FALSE,
+                                      DEFAULT_CHARSET, OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS,
+                                      DEFAULT_QUALITY, FIXED_PITCH | FF_MODERN, "Consolas");
+     SendMessage(search_dialog.hEdit, WM_SETFONT, (WPARAM)search_dialog.hFont, TRUE);
+ 
+     create_control(search_dialog.hDlg, "BUTTON", "Close",
+                    WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_PUSHBUTTON,
+                    10, 620, 100, 30, (HMENU)ID_SEARCH_CLOSE_BTN, 0);
+ 
+     search_dialog.hStatus = create_control(search_dialog.hDlg, "STATIC", "",
+                                            WS_CHILD | WS_VISIBLE, 130, 627, 750, 20, (HMENU)ID_SEARCH_STATUS, 0);
+ 
+     // Set icon
+     HICON hIcon = LoadIcon(NULL, IDI_APPLICATION);
+     SendMessage(search_dialog.hDlg, WM_SETICON, ICON_BIG, (LPARAM)hIcon);
+     SendMessage(search_dialog.hDlg, WM_SETICON, ICON_SMALL, (LPARAM)hIcon);
+ 
+     // Show window
+     ShowWindow(search_dialog.hDlg, SW_SHOW);
+     UpdateWindow(search_dialog.hDlg);
+     SetFocus(search_dialog.hQuery);
+ }
+ 
+ /**
+  * Start searching the logs in the background for the entered text
+  */
+ static void start_search(void)
+ {
+     char pattern[LOG_SEARCH_LINE_MAX];
+     char error[128];
+     char message[256];
+     SearchJob *job;
+ 
+     GetWindowText(search_dialog.hQuery, pattern, sizeof(pattern));
+     if (pattern[0] == '\0')
+     {
+         SetWindowText(search_dialog.hStatus, "Enter the text to find.");
+         return;
+     }
+ 
+     job = (SearchJob *)calloc(1, sizeof(SearchJob));
+     if (job)
+     {
+         job->files = (char (*)[MAX_PATH_LEN])malloc(SEARCH_MAX_FILES * MAX_PATH_LEN);
+         job->text = (char *)malloc((size_t)LOG_SEARCH_MAX_RESULTS * SEARCH_RESULT_SIZE + 1);
+     }
+     if (!job || !job->files || !job->text)
+     {
+         free_job(job);
+         SetWindowText(search_dialog.hStatus, "Memory allocation failed.");
+         return;
+     }
+ 
+     job->query = log_query_compile(pattern, SendMessage(search_dialog.hRegex, BM_GETCHECK, 0, 0) == BST_CHECKED,
+                                    error, sizeof(error));
+     if (!job->query)
+     {
+         free_job(job);
+         snprintf(message, sizeof(message), "Invalid search: %s", error);
+         SetWindowText(search_dialog.hStatus, message);
+         return;
+     }
+     job->use_index = SendMessage(search_dialog.hUseIndex, BM_GETCHECK, 0, 0) == BST_CHECKED;
+     job->text[0] = '\0';
+     snprintf(job->root, sizeof(job->root), "%s\\log", search_dialog.app_path);
+ 
+     search_dialog.job = job;
+     search_dialog.hThread = CreateThread(NULL, 0, search_thread, job, 0, NULL);
+     if (!search_dialog.hThread)
+     {
+         search_dialog.job = NULL;
+         free_job(job);
+         SetWindowText(search_dialog.hStatus, "Failed to start the search.");
+         return;
+     }
+ 
+     SetWindowText(search_dialog.hEdit, "");
+     SetWindowText(search_dialog.hStatus, "Looking for log files...");
+     SetWindowText(search_dialog.hSearch, "Stop");
+ }
+ 
+ /**
+  * Stop a running search and wait for its thread
+  */
+ static void stop_search(void)
+ {
+     if (!search_dialog.hThread)
+         return;
+ 
+     InterlockedExchange(&search_dialog.job->cancelled, 1);
+     WaitForSingleObject(search_dialog.hThread, INFINITE);
+     CloseHandle(search_dialog.hThread);
+     search_dialog.hThread = NULL;
+ }
+ 
+ /**
+  * Show the matches and the work the finished search took
+  */
+ static void show_results(void)
+ {
+     SearchJob *job = search_dialog.job;
+     char status[256];
+     int length;
+ 
+     if (job->file_count == 0)
+     {
+         snprintf(status, sizeof(status), "No log files found in %s", job->root);
+         SetWindowText(search_dialog.hStatus, status);
+         return;
+     }
+ 
+     SetWindowText(search_dialog.hEdit, job->listed ? job->text : "No matching lines found.");
+ 
+     length = snprintf(status, sizeof(status), "%s%llu matches in %d logs, query %llu ms",
+                       job->listed >= LOG_SEARCH_MAX_RESULTS ? "First " : "", job->stats.matches, job->file_count,
+                       job->stats.query_us / 1000);
+     if (job->stats.blocks > 0 && length > 0 && (size_t)length < sizeof(status))
+         length += snprintf(status + length, sizeof(status) - length, ", %llu of %llu indexed blocks read",
+                            job->stats.candidates, job->stats.blocks);
+     if (job->use_index && length > 0 && (size_t)length < sizeof(status))
+         length += snprintf(status + length, sizeof(status) - length, ", index update %llu ms",
+                            job->update_us / 1000);
+     if (job->unreadable > 0 && length > 0 && (size_t)length < sizeof(status))
+         length += snprintf(status + length, sizeof(status) - length, ", %d logs could not be read", job->unreadable);
+     if (job->cancelled && length > 0 && (size_t)length < sizeof(status))
+         snprintf(status + length, sizeof(status) - length, " (stopped)");
+     SetWindowText(search_dialog.hStatus, status);
+ }
+ 
+ /**
+  * Search thread: find the logs, update their indexes and search them
+  */
+ static DWORD WINAPI search_thread(LPVOID param)
+ {
+     SearchJob *job = (SearchJob *)param;
+     HWND hDlg = search_dialog.hDlg;
+     LARGE_INTEGER frequency;
+ 
+     QueryPerformanceFrequency(&frequency);
+     collect_logs(job, job->root);
+ 
+     for (int i = 0; i < job->file_count && !job->cancelled && job->listed < LOG_SEARCH_MAX_RESULTS; i++)
+     {
+         PostMessage(hDlg, WM_SEARCH_PROGRESS, i, job->file_count);
+ 
+         if (job->use_index)
+         {
+             LARGE_INTEGER started, finished;
+ 
+             // A log that cannot be indexed is still searched, from start to end
+             QueryPerformanceCounter(&started);
+             log_search_update(job->files[i], &job->cancelled);
+             QueryPerformanceCounter(&finished);
+             job->update_us += (ULONGLONG)((finished.QuadPart - started.QuadPart) * 1000000 / frequency.QuadPart);
+             if (job->cancelled)
+                 break;
+         }
+ 
+         // The search stops early once the list is full
+         if (!log_search_file(job->files[i], job->query, job->use_index, on_match, job, &job->stats) &&
+             job->listed < LOG_SEARCH_MAX_RESULTS && !job->cancelled)
+             job->unreadable++;
+     }
+ 
+     PostMessage(hDlg, WM_SEARCH_DONE, 0, 0);
+     return 0;
+ }
+ 
+ /**
+  * Add the logs of a directory and its subdirectories to the job
+  */
+ static void collect_logs(SearchJob *job, const char *dir)
+ {
+     char path[MAX_PATH_LEN];
+     WIN32_FIND_DATA fd;
+     HANDLE hFind;
+ 
+     snprintf(path, sizeof(path), "%s\\*", dir);
+     hFind = FindFirstFile(path, &fd);
+     if (hFind == INVALID_HANDLE_VALUE)
+         return;
+ 
+     do
+     {
+         if (strcmp(fd.cFileName, ".") == 0 || strcmp(fd.cFileName, "..") == 0)
+             continue;
+         if (job->file_count >= SEARCH_MAX_FILES || job->cancelled)
+             break;
+ 
+         snprintf(path, sizeof(path), "%s\\%s", dir, fd.cFileName);
+         if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+             collect_logs(job, path);
+         else if (log_reader_is_log(fd.cFileName, TRUE))
+             strcpy(job->files[job->file_count++], path);
+     } while (FindNextFile(hFind, &fd));
+ 
+     FindClose(hFind);
+ }
+ 
+ /**
+  * List a matching line as "log: line", with the log relative to the log directory
+  */
+ static BOOL on_match(const char *path, ULONGLONG offset, const char *line, size_t length, void *context)
+ {
+     SearchJob *job = (SearchJob *)context;
+     size_t root = strlen(job->root);
+     int written;
+ 
+     (void)offset;
+     if (strncmp(path, job->root, root) == 0 && path[root] == '\\')
+         path += root + 1;
+     if (length > SEARCH_LINE_SHOWN)
+         length = SEARCH_LINE_SHOWN;
+ 
+     written = snprintf(job->text + job->used, SEARCH_RESULT_SIZE, "%s: %.*s\r\n", path, (int)length, line);
+     if (written > 0)
+         job->used += (size_t)written < SEARCH_RESULT_SIZE ? (size_t)written : SEARCH_RESULT_SIZE - 1;
+     job->listed++;
+     return job->listed < LOG_SEARCH_MAX_RESULTS && !job->cancelled;
+ }
+ 
+ /**
+  * Free a search job
+  */
+ static void free_job(SearchJob *job)
+ {
+     if (!job)
+         return;
+ 
+     log_query_free(job->query);
+     free(job->files);
+     free(job->text);
+     free(job);
+ }
+ 
+ /**
+  * Search dialog window procedure
+  */
+ static LRESULT CALLBACK SearchDialogProc(HWND hwnd, UINT msg, WPARAM wp, LPARAM lp)
+ {
+     switch (msg)
+     {
+     case WM_COMMAND:
+         switch (LOWORD(wp))
+         {
+         case ID_SEARCH_BTN:
+             // The button stops a running search
+             if (search_dialog.hThread)
+                 InterlockedExchange(&search_dialog.job->cancelled, 1);
+             else
+             {
+                 free_job(search_dialog.job);
+                 search_dialog.job = NULL;
+                 start_search();
+             }
+             break;
+         case ID_SEARCH_CLOSE_BTN:
+             DestroyWindow(hwnd);
+             break;
+         }
+         break;
+ 
+     case WM_SEARCH_PROGRESS:
+         if (search_dialog.hThread)
+         {
+             char status[128];
+             snprintf(status, sizeof(status), "Searching log %d of %d...", (int)wp + 1, (int)lp);
+             SetWindowText(search_dialog.hStatus, status);
+         }
+         break;
+ 
+     case WM_SEARCH_DONE:
+         if (search_dialog.hThread)
+         {
+             stop_search();
+             show_results();
+             SetWindowText(search_dialog.hSearch, "Search");
+         }
+         break;
+ 
+     case WM_SIZE:
+         if (search_dialog.hEdit)
+         {
+             RECT rcClient;
+             GetClientRect(hwnd, &rcClient);
+ 
+             // Resize the results to fit the window
+             SetWindowPos(search_dialog.hEdit, NULL,
+                          10, 45, rcClient.right - 20, rcClient.bottom - 100, SWP_NOZORDER);
+ 
+             // Reposition the close button and status at the bottom
+             SetWindowPos(GetDlgItem(hwnd, ID_SEARCH_CLOSE_BTN), NULL,
+                          10, rcClient.bottom - 40, 100, 30, SWP_NOZORDER);
+             SetWindowPos(search_dialog.hStatus, NULL,
+                          130, rcClient.bottom - 33, rcClient.right - 140, 20, SWP_NOZORDER);
+         }
+         break;
+ 
+     case WM_CLOSE:
+         DestroyWindow(hwnd);
+         break;
+ 
+     case WM_DESTROY:
+         stop_search();
+         free_job(search_dialog.job);
+         search_dialog.job = NULL;
+         if (search_dialog.hFont)
+             DeleteObject(search_dialog.hFont);
+         search_dialog.hFont = NULL;
+         search_dialog.hDlg = search_dialog.hQuery = search_dialog.hRegex = search_dialog.hUseIndex = NULL;
+         search_dialog.hSearch = search_dialog.hEdit = search_dialog.hStatus = NULL;
+         break;
+ 
+     default:
+         return DefWindowProc(hwnd, msg, wp, lp);
+     }
+     return 0;
+ }
\ No newline at end of file
@@ -0,0 +1,46 @@
+/*******************************************************************************
+ * Search Viewer Module Header
+ * Searches all Devilbox log files for text or a regular expression
+ *******************************************************************************/
+#ifndef SEARCH_VIEWER_H
+#define SEARCH_VIEWER_H
+
+#include <windows.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Maximum path length constant (if not already defined)
+#ifndef MAX_PATH_LEN
+#define MAX_PATH_LEN 260
+#endif
+
+// Matching lines listed at most, the search stops there
+#define LOG_SEARCH_MAX_RESULTS 1000
+
+// Search dialog control IDs
+enum
+{
+    ID_SEARCH_QUERY = 300,
+    ID_SEARCH_REGEX,
+    ID_SEARCH_USE_INDEX,
+    ID_SEARCH_BTN,
+    ID_SEARCH_EDIT,
+    ID_SEARCH_CLOSE_BTN,
+    ID_SEARCH_STATUS
+};
+
+/**
+ * Display the log search dialog. Every log under the log directory is
+ * searched; with the index option, each log's trigram index is brought up
+ * to date in the background before it is searched.
+ * @param app_path Base path of the Devilbox installation
+ */
+void show_log_search(const char *app_path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEARCH_VIEWER_H */
\ No newline at end of file
@@ -101,6 +101,39 @@
      }
  }
  
+ /**
+  * Load a text value kept with the settings
+  */
+ void load_setting_text(const char *name, char *value, DWORD size)
+ {
+     HKEY key;
+     DWORD type, length = size;
+ 
+     value[0] = '\0';
+     if (RegOpenKeyEx(HKEY_CURRENT_USER, REG_KEY, 0, KEY_READ, &key) == ERROR_SUCCESS)
+     {
+         // A stored string need not be terminated
+         if (RegQueryValueEx(key, name, NULL, &type, (BYTE *)value, &length) != ERROR_SUCCESS || type != REG_SZ)
+             value[0] = '\0';
+         value[size - 1] = '\0';
+         RegCloseKey(key);
+     }
+ }
+ 
+ /**
+  * Save a text value with the settings
+  */
+ void save_setting_text(const char *name, const char *value)
+ {
+     HKEY key;
+ 
+     if (RegCreateKeyEx(HKEY_CURRENT_USER, REG_KEY, 0, NULL, 0, KEY_WRITE, NULL, &key, NULL) == ERROR_SUCCESS)
+     {
+         RegSetValueEx(key, name, 0, REG_SZ, (const BYTE *)value, strlen(value) + 1);
+         RegCloseKey(key);
+     }
+ }
+ 
  /**
   * Check if application is set to run at startup
   */
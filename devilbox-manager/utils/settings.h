@@ -53,6 +53,21 @@ void load_settings(AppSettings *settings);
  */
 void save_settings(const AppSettings *settings);
 
+/**
+ * Load a text value kept with the settings in the registry
+ * @param name Value name
+ * @param value Buffer for the text, empty when the value is not set
+ * @param size Size of the buffer
+ */
+void load_setting_text(const char *name, char *value, DWORD size);
+
+/**
+ * Save a text value with the settings in the registry
+ * @param name Value name
+ * @param value Text to save
+ */
+void save_setting_text(const char *name, const char *value);
+
 /**
  * Add or remove application from Windows startup
  * @param add TRUE to add to startup, FALSE to remove
@@ -0,0 +1,468 @@
+/*******************************************************************************
+ * Timeline Viewer Module Implementation
+ * Shows the PHP, web server and database logs merged into one timeline
+ *******************************************************************************/
+
+ #include "timeline_viewer.h"
+ #include "logs_viewer.h"
+ #include "log_timeline.h"
+ #include "log_reader.h"
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ #include <commctrl.h> // For date time picker control
+ 
+ // Room for one line of the page: tag, text and line break
+ #define TIMELINE_LINE_SIZE (LOG_TIMELINE_TAG_LEN + LOG_LINE_MAX + 2)
+ 
+ // Timeline dialog state structure
+ typedef struct
+ {
+     HWND hDlg;
+     HWND hEdit;
+     HWND hSources;
+     HWND hDateFrom;
+     HWND hTimeFrom;
+     HWND hDateTo;
+     HWND hTimeTo;
+     HWND hSeverity;
+     HWND hMore;
+     HWND hStatus;
+     HFONT hFont;
+     LogTimelineSource sources[LOG_TIMELINE_MAX_SOURCES];
+     int source_count;
+     LogTimeline *timeline;
+     int shown;               // Lines on the pages before the current one
+     int local_zone;          // Minutes east of UTC of the TIMEZONE of .env
+ } TimelineDialogState;
+ 
+ // Global state for the timeline dialog
+ static TimelineDialogState timeline_dialog = {0};
+ 
+ // Forward declarations of internal functions
+ static LRESULT CALLBACK TimelineDialogProc(HWND hwnd, UINT msg, WPARAM wp, LPARAM lp);
+ static void add_log_directory(const char *dir, const char *kind);
+ static int zone_offset(const char *time_zone);
+ static BOOL read_range_time(HWND hDate, HWND hTime, const char *which, ULONGLONG *value);
+ static void show_timeline(void);
+ static void show_timeline_page(void);
+ 
+ /**
+  * Display the log timeline dialog
+  */
+ void show_log_timeline(const char *app_path, const char *php_version, const char *httpd_version,
+                        const char *mysql_version, const char *time_zone)
+ {
+     char dir[MAX_PATH_LEN];
+     char kind[16];
+ 
+     // Check if dialog is already open
+     if (timeline_dialog.hDlg && IsWindow(timeline_dialog.hDlg))
+     {
+         SetForegroundWindow(timeline_dialog.hDlg);
+         return;
+     }
+ 
+     // Find the logs of the configured containers, e.g. log\nginx-stable\defaultlocalhost-error.log
+     const char *php = strstr(php_version, "php-");
+     php = php ? php + 4 : php_version;
+ 
+     timeline_dialog.source_count = 0;
+     snprintf(dir, sizeof(dir), "%s\\log\\php-fpm-%s", app_path, php);
+     add_log_directory(dir, "php");
+ 
+     snprintf(kind, sizeof(kind), "%.*s", (int)strcspn(httpd_version, "-"), httpd_version);
+     snprintf(dir, sizeof(dir), "%s\\log\\%s", app_path, httpd_version);
+     add_log_directory(dir, kind);
+ 
+     snprintf(kind, sizeof(kind), "%.*s", (int)strcspn(mysql_version, "-"), mysql_version);
+     snprintf(dir, sizeof(dir), "%s\\log\\%s", app_path, mysql_version);
+     add_log_directory(dir, kind);
+ 
+     if (timeline_dialog.source_count == 0)
+     {
+         char message[512];
+         snprintf(message, sizeof(message),
+                  "No log files found in:\n%s\\log\n\nDevilbox may not have generated log files yet.", app_path);
+         MessageBox(NULL, message, "Error", MB_ICONWARNING);
+         return;
+     }
+ 
+     timeline_dialog.local_zone = zone_offset(time_zone);
+ 
+     // Register dialog class
+     WNDCLASSEX wcDialog;
+     memset(&wcDialog, 0, sizeof(WNDCLASSEX));
+     wcDialog.cbSize = sizeof(WNDCLASSEX);
+     wcDialog.lpfnWndProc = TimelineDialogProc;
+     wcDialog.hInstance = GetModuleHandle(NULL);
+     wcDialog.hbrBackground = (HBRUSH)(COLOR_WINDOW + 1);
+     wcDialog.lpszClassName = "DevilboxTimelineDialog";
+     RegisterClassEx(&wcDialog);
+ 
+     // Create dialog window
+     timeline_dialog.hDlg = CreateWindowEx(
+         WS_EX_DLGMODALFRAME,
+         "DevilboxTimelineDialog",
+         "Log Timeline",
+         WS_OVERLAPPEDWINDOW | WS_VISIBLE,
+         100, 100, 900, 700,
+         NULL, NULL, GetModuleHandle(NULL), NULL);
+ 
+     if (!timeline_dialog.hDlg)
+     {
+         MessageBox(NULL, "Failed to create log timeline window.", "Error", MB_ICONERROR);
+         return;
+     }
+ 
+     // Time range; an unchecked date leaves that end open
+     create_control(timeline_dialog.hDlg, "STATIC", "From:",
+                    WS_CHILD | WS_VISIBLE, 10, 12, 40, 20, NULL, 0);
+ 
+     timeline_dialog.hDateFrom = create_control(timeline_dialog.hDlg, DATETIMEPICK_CLASS, "",
+                                                WS_CHILD | WS_VISIBLE | DTS_SHORTDATEFORMAT | DTS_SHOWNONE,
+                                                50, 10, 130, 24, (HMENU)ID_TIMELINE_DATE_FROM, 0);
+ 
+     timeline_dialog.hTimeFrom = create_control(timeline_dialog.hDlg, "EDIT", "00:00:00",
+                                                WS_CHILD | WS_VISIBLE,
+                                                185, 10, 70, 24, (HMENU)ID_TIMELINE_TIME_FROM, WS_EX_CLIENTEDGE);
+ 
+     create_control(timeline_dialog.hDlg, "STATIC", "To:",
+                    WS_CHILD | WS_VISIBLE, 270, 12, 30, 20, NULL, 0);
+ 
+     timeline_dialog.hDateTo = create_control(timeline_dialog.hDlg, DATETIMEPICK_CLASS, "",
+                                              WS_CHILD | WS_VISIBLE | DTS_SHORTDATEFORMAT | DTS_SHOWNONE,
+                                              300, 10, 130, 24, (HMENU)ID_TIMELINE_DATE_TO, 0);
+ 
+     timeline_dialog.hTimeTo = create_control(timeline_dialog.hDlg, "EDIT", "23:59:59",
+                                              WS_CHILD | WS_VISIBLE,
+                                              435, 10, 70, 24, (HMENU)ID_TIMELINE_TIME_TO, WS_EX_CLIENTEDGE);
+ 
+     create_control(timeline_dialog.hDlg, "STATIC", "Severity:",
+                    WS_CHILD | WS_VISIBLE, 520, 12, 60, 20, NULL, 0);
+ 
+     timeline_dialog.hSeverity = create_control(timeline_dialog.hDlg, "COMBOBOX", "",
+                                                WS_CHILD | WS_VISIBLE | WS_VSCROLL | CBS_DROPDOWNLIST,
+                                                580, 10, 160, 120, (HMENU)ID_TIMELINE_SEVERITY, 0);
+ 
+     create_control(timeline_dialog.hDlg, "BUTTON", "Show",
+                    WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_DEFPUSHBUTTON,
+                    790, 10, 100, 24, (HMENU)ID_TIMELINE_SHOW_BTN, 0);
+ 
+     // Logs to merge on the left, the timeline on the right
+     timeline_dialog.hSources = create_control(timeline_dialog.hDlg, "LISTBOX", "",
+                                               WS_CHILD | WS_VISIBLE | WS_VSCROLL | LBS_MULTIPLESEL | LBS_NOINTEGRALHEIGHT,
+                                               10, 45, 240, 565, (HMENU)ID_TIMELINE_SOURCES, WS_EX_CLIENTEDGE);
+ 
+     timeline_dialog.hEdit = create_control(timeline_dialog.hDlg, "EDIT", "",
+                                            WS_CHILD | WS_VISIBLE | WS_VSCROLL | WS_HSCROLL |
+                                                ES_MULTILINE | ES_AUTOHSCROLL | ES_AUTOVSCROLL | ES_READONLY,
+                                            260, 45, 620, 565, (HMENU)ID_TIMELINE_EDIT, WS_EX_CLIENTEDGE);
+     SendMessage(timeline_dialog.hEdit, EM_SETLIMITTEXT, LOG_TIMELINE_PAGE * TIMELINE_LINE_SIZE, 0);
+ 
+     // Set a monospaced font for better log readability
+     timeline_dialog.hFont = CreateFont(16, 0, 0, 0, FW_NORMAL, FALSE, FALSE, FALSE,
+                                        DEFAULT_CHARSET, OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS,
+                                        DEFAULT_QUALITY, FIXED_PITCH | FF_MODERN, "Consolas");
+     SendMessage(timeline_dialog.hEdit, WM_SETFONT, (WPARAM)timeline_dialog.hFont, TRUE);
+ 
+     // Action buttons
+     timeline_dialog.hMore = create_control(timeline_dialog.hDlg, "BUTTON", "Next Page",
+                                            WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_PUSHBUTTON,
+                                            10, 620, 100, 30, (HMENU)ID_TIMELINE_MORE_BTN, 0);
+ 
+     create_control(timeline_dialog.hDlg, "BUTTON", "Close",
+                    WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_PUSHBUTTON,
+                    120, 620, 100, 30, (HMENU)ID_TIMELINE_CLOSE_BTN, 0);
+ 
+     timeline_dialog.hStatus = create_control(timeline_dialog.hDlg, "STATIC", "",
+                                              WS_CHILD | WS_VISIBLE, 240, 627, 500, 20, (HMENU)ID_TIMELINE_STATUS, 0);
+ 
+     // Fill the lists, all logs and all severities to start with
+     for (int i = 0; i < timeline_dialog.source_count; i++)
+         SendMessage(timeline_dialog.hSources, LB_ADDSTRING, 0, (LPARAM)timeline_dialog.sources[i].tag);
+     SendMessage(timeline_dialog.hSources, LB_SETSEL, TRUE, -1);
+ 
+     static const struct
+     {
+         const char *name;
+         LogSeverity severity;
+     } severities[] = {
+         {"All entries", LOG_SEVERITY_NONE},
+         {"Notices and above", LOG_SEVERITY_NOTICE},
+         {"Warnings and above", LOG_SEVERITY_WARNING},
+         {"Errors only", LOG_SEVERITY_ERROR},
+     };
+     for (size_t i = 0; i < sizeof(severities) / sizeof(severities[0]); i++)
+     {
+         LRESULT item = SendMessage(timeline_dialog.hSeverity, CB_ADDSTRING, 0, (LPARAM)severities[i].name);
+         SendMessage(timeline_dialog.hSeverity, CB_SETITEMDATA, item, severities[i].severity);
+     }
+     SendMessage(timeline_dialog.hSeverity, CB_SETCURSEL, 0, 0);
+ 
+     // Set default dates to today
+     SYSTEMTIME today;
+     GetLocalTime(&today);
+     SendMessage(timeline_dialog.hDateFrom, DTM_SETSYSTEMTIME, GDT_VALID, (LPARAM)&today);
+     SendMessage(timeline_dialog.hDateTo, DTM_SETSYSTEMTIME, GDT_VALID, (LPARAM)&today);
+ 
+     show_timeline();
+ 
+     // Set icon
+     HICON hIcon = LoadIcon(NULL, IDI_APPLICATION);
+     SendMessage(timeline_dialog.hDlg, WM_SETICON, ICON_BIG, (LPARAM)hIcon);
+     SendMessage(timeline_dialog.hDlg, WM_SETICON, ICON_SMALL, (LPARAM)hIcon);
+ 
+     // Show window
+     ShowWindow(timeline_dialog.hDlg, SW_SHOW);
+     UpdateWindow(timeline_dialog.hDlg);
+ }
+ 
+ /**
+  * Add the current logs of a container log directory to the sources
+  */
+ static void add_log_directory(const char *dir, const char *kind)
+ {
+     char pattern[MAX_PATH_LEN];
+     WIN32_FIND_DATA fd;
+     HANDLE hFind;
+ 
+     snprintf(pattern, sizeof(pattern), "%s\\*", dir);
+     hFind = FindFirstFile(pattern, &fd);
+     if (hFind == INVALID_HANDLE_VALUE)
+         return;
+ 
+     do
+     {
+         LogTimelineSource *source = &timeline_dialog.sources[timeline_dialog.source_count];
+         const char *ext = strrchr(fd.cFileName, '.');
+         int stem = (int)strlen(fd.cFileName);
+ 
+         if ((fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) || !log_reader_is_log(fd.cFileName, FALSE))
+             continue;
+         if (timeline_dialog.source_count >= LOG_TIMELINE_MAX_SOURCES)
+             break;
+ 
+         // Tag as container kind and file name, e.g. "nginx/defaultlocalhost-access"
+         if (ext && _stricmp(ext, ".log") == 0)
+             stem = (int)(ext - fd.cFileName);
+         snprintf(source->path, sizeof(source->path), "%s\\%s", dir, fd.cFileName);
+         snprintf(source->tag, sizeof(source->tag), "%s/%.*s", kind, stem, fd.cFileName);
+         timeline_dialog.source_count++;
+     } while (FindNextFile(hFind, &fd));
+ 
+     FindClose(hFind);
+ }
+ 
+ /**
+  * Get the offset of the TIMEZONE of .env, for the logs that write their
+  * times in UTC. Windows cannot look zone names up, so a zone other than UTC
+  * is taken to be the zone of this computer, at its current offset.
+  */
+ static int zone_offset(const char *time_zone)
+ {
+     TIME_ZONE_INFORMATION tzi;
+     DWORD mode;
+ 
+     if (!time_zone[0] || _stricmp(time_zone, "UTC") == 0 || _stricmp(time_zone, "Etc/UTC") == 0 ||
+         _stricmp(time_zone, "GMT") == 0)
+         return 0;
+ 
+     mode = GetTimeZoneInformation(&tzi);
+     if (mode == TIME_ZONE_ID_INVALID)
+         return 0;
+     return -(int)(tzi.Bias + (mode == TIME_ZONE_ID_DAYLIGHT ? tzi.DaylightBias : tzi.StandardBias));
+ }
+ 
+ /**
+  * Read one end of the time range, 0 when its date is unchecked
+  */
+ static BOOL read_range_time(HWND hDate, HWND hTime, const char *which, ULONGLONG *value)
+ {
+     SYSTEMTIME st;
+     FILETIME ft;
+     char text[20] = {0};
+     char message[128];
+     int hour, minute, second;
+     LRESULT state = SendMessage(hDate, DTM_GETSYSTEMTIME, 0, (LPARAM)&st);
+ 
+     *value = 0;
+     if (state == GDT_NONE)
+         return TRUE;
+ 
+     GetWindowText(hTime, text, sizeof(text));
+     if (state == GDT_VALID && sscanf(text, "%d:%d:%d", &hour, &minute, &second) == 3)
+     {
+         st.wHour = hour;
+         st.wMinute = minute;
+         st.wSecond = second;
+         st.wMilliseconds = 0;
+         if (SystemTimeToFileTime(&st, &ft))
+         {
+             *value = ((ULONGLONG)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+             return TRUE;
+         }
+     }
+ 
+     snprintf(message, sizeof(message), "Invalid %s date or time. Use HH:MM:SS for the time.", which);
+     MessageBox(timeline_dialog.hDlg, message, "Error", MB_ICONERROR);
+     return FALSE;
+ }
+ 
+ /**
+  * Merge the selected logs with the chosen range and severity and show the first page
+  */
+ static void show_timeline(void)
+ {
+     LogTimelineSource selected[LOG_TIMELINE_MAX_SOURCES];
+     LogTimelineFilter filter;
+     LRESULT item;
+     HCURSOR hOldCursor;
+     int count = 0;
+ 
+     if (!read_range_time(timeline_dialog.hDateFrom, timeline_dialog.hTimeFrom, "start", &filter.from) ||
+         !read_range_time(timeline_dialog.hDateTo, timeline_dialog.hTimeTo, "end", &filter.to))
+         return;
+ 
+     filter.local_zone = timeline_dialog.local_zone;
+     item = SendMessage(timeline_dialog.hSeverity, CB_GETCURSEL, 0, 0);
+     filter.min_severity = item == CB_ERR ? LOG_SEVERITY_NONE
+                                          : (LogSeverity)SendMessage(timeline_dialog.hSeverity, CB_GETITEMDATA, item, 0);
+ 
+     for (int i = 0; i < timeline_dialog.source_count; i++)
+     {
+         if (SendMessage(timeline_dialog.hSources, LB_GETSEL, i, 0) > 0)
+             selected[count++] = timeline_dialog.sources[i];
+     }
+ 
+     // Indexing large logs for the first time takes a while
+     hOldCursor = SetCursor(LoadCursor(NULL, IDC_WAIT));
+     log_timeline_close(timeline_dialog.timeline);
+     timeline_dialog.timeline = log_timeline_open(selected, count, &filter);
+     SetCursor(hOldCursor);
+ 
+     timeline_dialog.shown = 0;
+     if (!timeline_dialog.timeline)
+     {
+         SetWindowText(timeline_dialog.hEdit, "Memory allocation failed.");
+         SetWindowText(timeline_dialog.hStatus, "");
+         EnableWindow(timeline_dialog.hMore, FALSE);
+         return;
+     }
+     show_timeline_page();
+ }
+ 
+ /**
+  * Show the next page of the timeline, only one page is held in memory
+  */
+ static void show_timeline_page(void)
+ {
+     char *text = (char *)malloc((size_t)LOG_TIMELINE_PAGE * TIMELINE_LINE_SIZE + 1);
+     char status[128];
+     size_t used = 0;
+     int lines = 0;
+ 
+     if (!text)
+     {
+         SetWindowText(timeline_dialog.hEdit, "Memory allocation failed.");
+         return;
+     }
+ 
+     while (lines < LOG_TIMELINE_PAGE &&
+            log_timeline_next(timeline_dialog.timeline, text + used, TIMELINE_LINE_SIZE - 2))
+     {
+         used += strlen(text + used);
+         text[used++] = '\r';
+         text[used++] = '\n';
+         lines++;
+     }
+     text[used] = '\0';
+ 
+     // The logs stay free for rotation between pages
+     log_timeline_release(timeline_dialog.timeline);
+ 
+     if (lines > 0)
+     {
+         SetWindowText(timeline_dialog.hEdit, text);
+         snprintf(status, sizeof(status), "Lines %d to %d%s", timeline_dialog.shown + 1,
+                  timeline_dialog.shown + lines, lines == LOG_TIMELINE_PAGE ? "" : ", end of the timeline");
+     }
+     else if (timeline_dialog.shown == 0)
+     {
+         SetWindowText(timeline_dialog.hEdit, "No log entries found for the selected logs, range and severity.");
+         snprintf(status, sizeof(status), "No entries");
+     }
+     else
+         snprintf(status, sizeof(status), "End of the timeline after %d lines", timeline_dialog.shown);
+     free(text);
+ 
+     timeline_dialog.shown += lines;
+     SetWindowText(timeline_dialog.hStatus, status);
+     EnableWindow(timeline_dialog.hMore, lines == LOG_TIMELINE_PAGE);
+ }
+ 
+ /**
+  * Timeline dialog window procedure
+  */
+ static LRESULT CALLBACK TimelineDialogProc(HWND hwnd, UINT msg, WPARAM wp, LPARAM lp)
+ {
+     switch (msg)
+     {
+     case WM_COMMAND:
+         switch (LOWORD(wp))
+         {
+         case ID_TIMELINE_SHOW_BTN:
+             show_timeline();
+             break;
+         case ID_TIMELINE_MORE_BTN:
+             if (timeline_dialog.timeline)
+                 show_timeline_page();
+             break;
+         case ID_TIMELINE_CLOSE_BTN:
+             DestroyWindow(hwnd);
+             break;
+         }
+         break;
+ 
+     case WM_SIZE:
+         if (timeline_dialog.hEdit)
+         {
+             RECT rcClient;
+             GetClientRect(hwnd, &rcClient);
+ 
+             // Resize the lists to fit the window
+             SetWindowPos(timeline_dialog.hSources, NULL,
+                          10, 45, 240, rcClient.bottom - 100, SWP_NOZORDER);
+             SetWindowPos(timeline_dialog.hEdit, NULL,
+                          260, 45, rcClient.right - 270, rcClient.bottom - 100, SWP_NOZORDER);
+ 
+             // Reposition buttons at the bottom
+             SetWindowPos(timeline_dialog.hMore, NULL,
+                          10, rcClient.bottom - 40, 100, 30, SWP_NOZORDER);
+             SetWindowPos(GetDlgItem(hwnd, ID_TIMELINE_CLOSE_BTN), NULL,
+                          120, rcClient.bottom - 40, 100, 30, SWP_NOZORDER);
+             SetWindowPos(timeline_dialog.hStatus, NULL,
+                          240, rcClient.bottom - 33, 500, 20, SWP_NOZORDER);
+         }
+         break;
+ 
+     case WM_CLOSE:
+         DestroyWindow(hwnd);
+         break;
+ 
+     case WM_DESTROY:
+         log_timeline_close(timeline_dialog.timeline);
+         timeline_dialog.timeline = NULL;
+         if (timeline_dialog.hFont)
+             DeleteObject(timeline_dialog.hFont);
+         timeline_dialog.hFont = NULL;
+         timeline_dialog.hDlg = timeline_dialog.hEdit = timeline_dialog.hSources = NULL;
+         timeline_dialog.hDateFrom = timeline_dialog.hTimeFrom = timeline_dialog.hDateTo = NULL;
+         timeline_dialog.hTimeTo = timeline_dialog.hSeverity = timeline_dialog.hMore = timeline_dialog.hStatus = NULL;
+         break;
+ 
+     default:
+         return DefWindowProc(hwnd, msg, wp, lp);
+     }
+     return 0;
+ }
\ No newline at end of file
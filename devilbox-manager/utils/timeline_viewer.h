@@ -0,0 +1,55 @@
+/*******************************************************************************
+ * Timeline Viewer Module Header
+ * Shows the PHP, web server and database logs merged into one timeline
+ *******************************************************************************/
+#ifndef TIMELINE_VIEWER_H
+#define TIMELINE_VIEWER_H
+
+#include <windows.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Maximum path length constant (if not already defined)
+#ifndef MAX_PATH_LEN
+#define MAX_PATH_LEN 260
+#endif
+
+// Lines shown per page of the timeline
+#define LOG_TIMELINE_PAGE 1000
+
+// Timeline dialog control IDs
+enum
+{
+    ID_TIMELINE_EDIT = 200,
+    ID_TIMELINE_SOURCES,
+    ID_TIMELINE_DATE_FROM,
+    ID_TIMELINE_TIME_FROM,
+    ID_TIMELINE_DATE_TO,
+    ID_TIMELINE_TIME_TO,
+    ID_TIMELINE_SEVERITY,
+    ID_TIMELINE_SHOW_BTN,
+    ID_TIMELINE_MORE_BTN,
+    ID_TIMELINE_CLOSE_BTN,
+    ID_TIMELINE_STATUS
+};
+
+/**
+ * Display the log timeline dialog. Logs are looked up in the log directory
+ * of each running container.
+ * @param app_path Base path of the Devilbox installation
+ * @param php_version PHP_SERVER of .env (e.g. "8.1")
+ * @param httpd_version HTTPD_SERVER of .env (e.g. "nginx-stable")
+ * @param mysql_version MYSQL_SERVER of .env (e.g. "mariadb-10.6")
+ * @param time_zone TIMEZONE of .env (e.g. "Europe/Berlin"), the zone the
+ *                  timeline is shown in
+ */
+void show_log_timeline(const char *app_path, const char *php_version, const char *httpd_version,
+                       const char *mysql_version, const char *time_zone);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TIMELINE_VIEWER_H */
\ No newline at end of file